@@ -31,6 +31,10 @@
 @ cdecl mbedtls_md_info_from_type(long)
 @ cdecl mbedtls_pk_get_bitlen(ptr)
 @ cdecl mbedtls_ctr_drbg_seed(ptr ptr ptr str long)
+@ cdecl mbedtls_ssl_get_session(ptr ptr)
+@ cdecl mbedtls_ssl_set_session(ptr ptr)
+@ cdecl mbedtls_ssl_session_init(ptr)
+@ cdecl mbedtls_ssl_session_free(ptr)
 @ cdecl mbedtls_md_init(ptr)
 @ cdecl mbedtls_md_setup(ptr ptr long)
 @ cdecl mbedtls_md_update(ptr ptr long)
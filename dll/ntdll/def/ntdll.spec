@@ -149,10 +149,12 @@
 @ stdcall NtApphelpCacheControl(long ptr)
 @ stdcall NtAreMappedFilesTheSame(ptr ptr)
 @ stdcall NtAssignProcessToJobObject(long long)
+@ stdcall NtAssociateWaitCompletionPacket(ptr ptr ptr ptr ptr long long ptr)
 @ stdcall NtCallbackReturn(ptr long long)
 @ stdcall NtCancelDeviceWakeupRequest(ptr)
 @ stdcall NtCancelIoFile(long ptr)
 @ stdcall NtCancelTimer(long ptr)
+@ stdcall NtCancelWaitCompletionPacket(ptr long)
 @ stdcall NtClearEvent(long)
 @ stdcall NtClose(long)
 @ stdcall NtCloseObjectAuditAlarm(ptr ptr long)
@@ -186,6 +188,7 @@
 @ stdcall NtCreateThread(ptr long ptr ptr ptr ptr ptr long)
 @ stdcall NtCreateTimer(ptr long ptr long)
 @ stdcall NtCreateToken(ptr long ptr long ptr ptr ptr ptr ptr ptr ptr ptr ptr)
+@ stdcall NtCreateWaitCompletionPacket(ptr long ptr)
 @ stdcall NtCreateWaitablePort(ptr ptr long long long)
 @ stdcall -arch=win32 NtCurrentTeb() _NtCurrentTeb
 @ stdcall NtDebugActiveProcess(ptr ptr)
@@ -333,6 +336,7 @@
 @ stdcall NtReleaseMutant(long ptr)
 @ stdcall NtReleaseSemaphore(long long ptr)
 @ stdcall NtRemoveIoCompletion(ptr ptr ptr ptr ptr)
+@ stdcall NtRemoveIoCompletionEx(ptr ptr long ptr ptr long)
 @ stdcall NtRemoveProcessDebug(ptr ptr)
 @ stdcall NtRenameKey(ptr ptr)
 @ stdcall NtReplaceKey(ptr long ptr)
@@ -997,10 +1001,12 @@
 @ stdcall ZwApphelpCacheControl(long ptr)
 @ stdcall ZwAreMappedFilesTheSame(ptr ptr)
 @ stdcall ZwAssignProcessToJobObject(long long)
+@ stdcall ZwAssociateWaitCompletionPacket(ptr ptr ptr ptr ptr long long ptr)
 @ stdcall ZwCallbackReturn(ptr long long)
 @ stdcall ZwCancelDeviceWakeupRequest(ptr)
 @ stdcall ZwCancelIoFile(long ptr)
 @ stdcall ZwCancelTimer(long ptr)
+@ stdcall ZwCancelWaitCompletionPacket(ptr long)
 @ stdcall ZwClearEvent(long)
 @ stdcall ZwClose(long)
 @ stdcall ZwCloseObjectAuditAlarm(ptr ptr long)
@@ -1034,6 +1040,7 @@
 @ stdcall ZwCreateThread(ptr long ptr ptr ptr ptr ptr long)
 @ stdcall ZwCreateTimer(ptr long ptr long)
 @ stdcall ZwCreateToken(ptr long ptr long ptr ptr ptr ptr ptr ptr ptr ptr ptr)
+@ stdcall ZwCreateWaitCompletionPacket(ptr long ptr)
 @ stdcall ZwCreateWaitablePort(ptr ptr long long long)
 @ stdcall ZwDebugActiveProcess(ptr ptr)
 @ stdcall ZwDebugContinue(ptr ptr long)
@@ -1179,6 +1186,7 @@
 @ stdcall ZwReleaseMutant(long ptr)
 @ stdcall ZwReleaseSemaphore(long long ptr)
 @ stdcall ZwRemoveIoCompletion(ptr ptr ptr ptr ptr)
+@ stdcall ZwRemoveIoCompletionEx(ptr ptr long ptr ptr long)
 @ stdcall ZwRemoveProcessDebug(ptr ptr)
 @ stdcall ZwRenameKey(ptr ptr)
 @ stdcall ZwReplaceKey(ptr long ptr)
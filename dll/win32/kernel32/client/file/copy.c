@@ -19,9 +19,198 @@
 DEBUG_CHANNEL(kernel32file);
 #endif
 
+/* Chunk sizes of the copy engine, picked by file size */
+#define COPY_SMALL_CHUNK        0x10000     /* Files up to 1 MB */
+#define COPY_MEDIUM_CHUNK       0x100000    /* Files up to 64 MB */
+#define COPY_LARGE_CHUNK        0x400000    /* Anything larger */
+
+/* Requests kept in flight, each alternating between a read and a write */
+#define COPY_MAX_REQUESTS       4
+
+/* Minimum time between two CALLBACK_CHUNK_FINISHED notifications, in ms */
+#define COPY_PROGRESS_INTERVAL  100
+
+typedef enum _COPY_REQUEST_STATE
+{
+    CopyRequestIdle,
+    CopyRequestReading,
+    CopyRequestWriting
+} COPY_REQUEST_STATE;
+
+typedef struct _COPY_REQUEST
+{
+    COPY_REQUEST_STATE State;
+    NTSTATUS Status;
+    HANDLE Event;
+    IO_STATUS_BLOCK IoStatusBlock;
+    LARGE_INTEGER Offset;
+    ULONG Length;
+    PUCHAR Buffer;
+} COPY_REQUEST, *PCOPY_REQUEST;
+
+typedef struct _COPY_PROGRESS
+{
+    LPPROGRESS_ROUTINE Routine;
+    LPVOID Data;
+    HANDLE Source;
+    HANDLE Dest;
+    LARGE_INTEGER TotalSize;
+    LARGE_INTEGER Reported;
+    DWORD LastTick;
+} COPY_PROGRESS, *PCOPY_PROGRESS;
+
 /* FUNCTIONS ****************************************************************/
 
+static ULONG
+CopyChunkSize(LARGE_INTEGER FileSize)
+{
+    if (FileSize.QuadPart <= 16 * COPY_SMALL_CHUNK)
+        return COPY_SMALL_CHUNK;
+    if (FileSize.QuadPart <= 64 * COPY_MEDIUM_CHUNK)
+        return COPY_MEDIUM_CHUNK;
+    return COPY_LARGE_CHUNK;
+}
+
+static ULONG
+CopySectorSize(HANDLE FileHandle)
+{
+    FILE_FS_SIZE_INFORMATION FsSize;
+    IO_STATUS_BLOCK IoStatusBlock;
+    NTSTATUS Status;
+
+    Status = NtQueryVolumeInformationFile(FileHandle,
+                                          &IoStatusBlock,
+                                          &FsSize,
+                                          sizeof(FsSize),
+                                          FileFsSizeInformation);
+    if (!NT_SUCCESS(Status) || FsSize.BytesPerSector == 0)
+    {
+        return 512;
+    }
+
+    return FsSize.BytesPerSector;
+}
 
+static NTSTATUS
+CopyReportProgress(PCOPY_PROGRESS Progress,
+                   LARGE_INTEGER BytesCopied,
+                   DWORD CallbackReason,
+                   BOOL *KeepDest)
+{
+    DWORD Tick, ProgressResult;
+
+    if (NULL == Progress->Routine)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    /* Chunk notifications are throttled, the last one always goes through */
+    Tick = GetTickCount();
+    if (CallbackReason == CALLBACK_CHUNK_FINISHED &&
+        BytesCopied.QuadPart < Progress->TotalSize.QuadPart &&
+        Tick - Progress->LastTick < COPY_PROGRESS_INTERVAL)
+    {
+        return STATUS_SUCCESS;
+    }
+    Progress->LastTick = Tick;
+    Progress->Reported = BytesCopied;
+
+    ProgressResult = (*Progress->Routine)(Progress->TotalSize,
+                                          BytesCopied,
+                                          Progress->TotalSize,
+                                          BytesCopied,
+                                          0,
+                                          CallbackReason,
+                                          Progress->Source,
+                                          Progress->Dest,
+                                          Progress->Data);
+    switch (ProgressResult)
+    {
+    case PROGRESS_CANCEL:
+        TRACE("Progress callback requested cancel\n");
+        return STATUS_REQUEST_ABORTED;
+    case PROGRESS_STOP:
+        TRACE("Progress callback requested stop\n");
+        *KeepDest = TRUE;
+        return STATUS_REQUEST_ABORTED;
+    case PROGRESS_QUIET:
+        Progress->Routine = NULL;
+        break;
+    case PROGRESS_CONTINUE:
+    default:
+        break;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static VOID
+CopyStartRead(HANDLE FileHandleSource,
+              PCOPY_REQUEST Request,
+              LONGLONG Offset,
+              ULONG ChunkSize)
+{
+    Request->State = CopyRequestReading;
+    Request->Offset.QuadPart = Offset;
+    Request->Status = NtReadFile(FileHandleSource,
+                                 Request->Event,
+                                 NULL,
+                                 NULL,
+                                 &Request->IoStatusBlock,
+                                 Request->Buffer,
+                                 ChunkSize,
+                                 &Request->Offset,
+                                 NULL);
+}
+
+static VOID
+CopyStartWrite(HANDLE FileHandleDest,
+               PCOPY_REQUEST Request,
+               ULONG SectorSize)
+{
+    ULONG WriteLength = Request->Length;
+
+    /* Unbuffered writes must cover whole sectors, the end of file is fixed later */
+    if (SectorSize)
+    {
+        WriteLength = ROUND_UP(Request->Length, SectorSize);
+        RtlZeroMemory(Request->Buffer + Request->Length, WriteLength - Request->Length);
+    }
+
+    Request->State = CopyRequestWriting;
+    Request->Status = NtWriteFile(FileHandleDest,
+                                  Request->Event,
+                                  NULL,
+                                  NULL,
+                                  &Request->IoStatusBlock,
+                                  Request->Buffer,
+                                  WriteLength,
+                                  &Request->Offset,
+                                  NULL);
+}
+
+static NTSTATUS
+CopyWaitRequest(PCOPY_REQUEST Request)
+{
+    /* Errors returned right away never signal the event */
+    if (Request->Status == STATUS_PENDING)
+    {
+        NtWaitForSingleObject(Request->Event, FALSE, NULL);
+        Request->Status = Request->IoStatusBlock.Status;
+    }
+    else if (!NT_SUCCESS(Request->Status))
+    {
+        Request->IoStatusBlock.Information = 0;
+    }
+
+    return Request->Status;
+}
+
+/*
+ * Copies the unnamed stream with up to COPY_MAX_REQUESTS reads and writes in
+ * flight. Both handles are opened for overlapped I/O; requests are completed
+ * in file order, so the progress routine sees the bytes copied grow steadily.
+ */
 static NTSTATUS
 CopyLoop (
     HANDLE			FileHandleSource,
@@ -30,135 +219,211 @@ CopyLoop (
     LPPROGRESS_ROUTINE	lpProgressRoutine,
     LPVOID			lpData,
     BOOL			*pbCancel,
+    BOOL			NoBuffering,
     BOOL                 *KeepDest
 )
 {
     NTSTATUS errCode;
     IO_STATUS_BLOCK IoStatusBlock;
+    COPY_REQUEST Requests[COPY_MAX_REQUESTS];
+    COPY_PROGRESS Progress;
+    FILE_ALLOCATION_INFORMATION FileAllocation;
+    FILE_END_OF_FILE_INFORMATION FileEndOfFile;
+    PCOPY_REQUEST Request;
     UCHAR *lpBuffer = NULL;
-    SIZE_T RegionSize = 0x10000;
+    SIZE_T RegionSize;
     LARGE_INTEGER BytesCopied;
-    DWORD CallbackReason;
-    DWORD ProgressResult;
-    BOOL EndOfFileFound;
+    LONGLONG ReadOffset, Chunks;
+    ULONG ChunkSize, SectorSize = 0, RequestCount, Active, Next, i;
+    BOOL EndOfFileFound = FALSE;
 
     *KeepDest = FALSE;
+    ChunkSize = CopyChunkSize(SourceFileSize);
+    if (NoBuffering)
+    {
+        SectorSize = max(CopySectorSize(FileHandleSource), CopySectorSize(FileHandleDest));
+        if (ChunkSize % SectorSize)
+        {
+            ChunkSize = ROUND_UP(ChunkSize, SectorSize);
+        }
+    }
+
+    /* Small files do with a single request */
+    Chunks = (SourceFileSize.QuadPart + ChunkSize - 1) / ChunkSize;
+    RequestCount = (ULONG)min(max(Chunks, 1), COPY_MAX_REQUESTS);
+
+    RtlZeroMemory(Requests, sizeof(Requests));
+    RegionSize = (SIZE_T)RequestCount * ChunkSize;
     errCode = NtAllocateVirtualMemory(NtCurrentProcess(),
                                       (PVOID *)&lpBuffer,
                                       0,
                                       &RegionSize,
                                       MEM_RESERVE | MEM_COMMIT,
                                       PAGE_READWRITE);
+    if (!NT_SUCCESS(errCode))
+    {
+        TRACE("Error 0x%08x allocating buffer of %lu bytes\n", errCode, RegionSize);
+        return errCode;
+    }
+
+    for (i = 0; i < RequestCount; i++)
+    {
+        Requests[i].Buffer = lpBuffer + (SIZE_T)i * ChunkSize;
+        errCode = NtCreateEvent(&Requests[i].Event,
+                                EVENT_ALL_ACCESS,
+                                NULL,
+                                NotificationEvent,
+                                FALSE);
+        if (!NT_SUCCESS(errCode))
+        {
+            goto Cleanup;
+        }
+    }
+
+    /* Let the file system lay out the destination in one go */
+    if (SourceFileSize.QuadPart > ChunkSize)
+    {
+        FileAllocation.AllocationSize = SourceFileSize;
+        NtSetInformationFile(FileHandleDest,
+                             &IoStatusBlock,
+                             &FileAllocation,
+                             sizeof(FileAllocation),
+                             FileAllocationInformation);
+    }
+
+    Progress.Routine = lpProgressRoutine;
+    Progress.Data = lpData;
+    Progress.Source = FileHandleSource;
+    Progress.Dest = FileHandleDest;
+    Progress.TotalSize = SourceFileSize;
+    Progress.Reported.QuadPart = 0;
+    Progress.LastTick = GetTickCount();
+    BytesCopied.QuadPart = 0;
+    errCode = CopyReportProgress(&Progress, BytesCopied, CALLBACK_STREAM_SWITCH, KeepDest);
+    if (!NT_SUCCESS(errCode))
+    {
+        goto Cleanup;
+    }
 
-    if (NT_SUCCESS(errCode))
+    ReadOffset = 0;
+    for (i = 0; i < RequestCount; i++)
     {
-        BytesCopied.QuadPart = 0;
-        EndOfFileFound = FALSE;
-        CallbackReason = CALLBACK_STREAM_SWITCH;
-        while (! EndOfFileFound &&
-                NT_SUCCESS(errCode) &&
-                (NULL == pbCancel || ! *pbCancel))
+        CopyStartRead(FileHandleSource, &Requests[i], ReadOffset, ChunkSize);
+        ReadOffset += ChunkSize;
+    }
+    Active = RequestCount;
+
+    for (Next = 0; Active && NT_SUCCESS(errCode); Next = (Next + 1) % RequestCount)
+    {
+        if (NULL != pbCancel && *pbCancel)
+        {
+            TRACE("User requested cancel\n");
+            errCode = STATUS_REQUEST_ABORTED;
+            break;
+        }
+
+        Request = &Requests[Next];
+        if (Request->State == CopyRequestIdle)
         {
-            if (NULL != lpProgressRoutine)
+            continue;
+        }
+
+        errCode = CopyWaitRequest(Request);
+        if (Request->State == CopyRequestReading)
+        {
+            /* Reading at the end of file fails, a read across it comes back short */
+            if (STATUS_END_OF_FILE == errCode)
             {
-                ProgressResult = (*lpProgressRoutine)(SourceFileSize,
-                                                      BytesCopied,
-                                                      SourceFileSize,
-                                                      BytesCopied,
-                                                      0,
-                                                      CallbackReason,
-                                                      FileHandleSource,
-                                                      FileHandleDest,
-                                                      lpData);
-                switch (ProgressResult)
-                {
-                case PROGRESS_CANCEL:
-                    TRACE("Progress callback requested cancel\n");
-                    errCode = STATUS_REQUEST_ABORTED;
-                    break;
-                case PROGRESS_STOP:
-                    TRACE("Progress callback requested stop\n");
-                    errCode = STATUS_REQUEST_ABORTED;
-                    *KeepDest = TRUE;
-                    break;
-                case PROGRESS_QUIET:
-                    lpProgressRoutine = NULL;
-                    break;
-                case PROGRESS_CONTINUE:
-                default:
-                    break;
-                }
-                CallbackReason = CALLBACK_CHUNK_FINISHED;
+                errCode = STATUS_SUCCESS;
             }
-            if (NT_SUCCESS(errCode))
+            if (!NT_SUCCESS(errCode))
             {
-                errCode = NtReadFile(FileHandleSource,
-                                     NULL,
-                                     NULL,
-                                     NULL,
-                                     (PIO_STATUS_BLOCK)&IoStatusBlock,
-                                     lpBuffer,
-                                     RegionSize,
-                                     NULL,
-                                     NULL);
-                /* With sync read, 0 length + status success mean EOF:
-                 * https://msdn.microsoft.com/en-us/library/windows/desktop/aa365467(v=vs.85).aspx
-                 */
-                if (NT_SUCCESS(errCode) && IoStatusBlock.Information == 0)
-                {
-                    errCode = STATUS_END_OF_FILE;
-                }
-                if (NT_SUCCESS(errCode) && (NULL == pbCancel || ! *pbCancel))
-                {
-                    errCode = NtWriteFile(FileHandleDest,
-                                          NULL,
-                                          NULL,
-                                          NULL,
-                                          (PIO_STATUS_BLOCK)&IoStatusBlock,
-                                          lpBuffer,
-                                          IoStatusBlock.Information,
-                                          NULL,
-                                          NULL);
-                    if (NT_SUCCESS(errCode))
-                    {
-                        BytesCopied.QuadPart += IoStatusBlock.Information;
-                    }
-                    else
-                    {
-                        WARN("Error 0x%08x reading writing to dest\n", errCode);
-                    }
-                }
-                else if (!NT_SUCCESS(errCode))
-                {
-                    if (STATUS_END_OF_FILE == errCode)
-                    {
-                        EndOfFileFound = TRUE;
-                        errCode = STATUS_SUCCESS;
-                    }
-                    else
-                    {
-                        WARN("Error 0x%08x reading from source\n", errCode);
-                    }
-                }
+                WARN("Error 0x%08x reading from source\n", errCode);
+                break;
             }
-        }
 
-        if (! EndOfFileFound && (NULL != pbCancel && *pbCancel))
+            Request->Length = (ULONG)Request->IoStatusBlock.Information;
+            if (Request->Length < ChunkSize)
+            {
+                EndOfFileFound = TRUE;
+            }
+            if (Request->Length == 0)
+            {
+                Request->State = CopyRequestIdle;
+                Active--;
+                continue;
+            }
+
+            CopyStartWrite(FileHandleDest, Request, SectorSize);
+        }
+        else
         {
-            TRACE("User requested cancel\n");
-            errCode = STATUS_REQUEST_ABORTED;
+            if (!NT_SUCCESS(errCode))
+            {
+                WARN("Error 0x%08x writing to dest\n", errCode);
+                break;
+            }
+
+            BytesCopied.QuadPart += Request->Length;
+            errCode = CopyReportProgress(&Progress, BytesCopied, CALLBACK_CHUNK_FINISHED, KeepDest);
+
+            /* Files that grow while being copied are copied to their new end */
+            if (NT_SUCCESS(errCode) && !EndOfFileFound)
+            {
+                CopyStartRead(FileHandleSource, Request, ReadOffset, ChunkSize);
+                ReadOffset += ChunkSize;
+            }
+            else
+            {
+                Request->State = CopyRequestIdle;
+                Active--;
+            }
         }
+    }
 
-        NtFreeVirtualMemory(NtCurrentProcess(),
-                            (PVOID *)&lpBuffer,
-                            &RegionSize,
-                            MEM_RELEASE);
+    if (NT_SUCCESS(errCode) && BytesCopied.QuadPart != Progress.Reported.QuadPart)
+    {
+        /* The source shrank, tell the routine where the copy ended */
+        Progress.TotalSize = BytesCopied;
+        errCode = CopyReportProgress(&Progress, BytesCopied, CALLBACK_CHUNK_FINISHED, KeepDest);
     }
-    else
+
+    if (NT_SUCCESS(errCode) && (NoBuffering || SourceFileSize.QuadPart != BytesCopied.QuadPart))
     {
-        TRACE("Error 0x%08x allocating buffer of %lu bytes\n", errCode, RegionSize);
+        /* Drop the sector padding of the last write, and any preallocated tail */
+        FileEndOfFile.EndOfFile = BytesCopied;
+        errCode = NtSetInformationFile(FileHandleDest,
+                                       &IoStatusBlock,
+                                       &FileEndOfFile,
+                                       sizeof(FileEndOfFile),
+                                       FileEndOfFileInformation);
     }
 
+Cleanup:
+    /* Nothing may still be using the buffers when they are freed */
+    if (!NT_SUCCESS(errCode))
+    {
+        NtCancelIoFile(FileHandleSource, &IoStatusBlock);
+        NtCancelIoFile(FileHandleDest, &IoStatusBlock);
+    }
+    for (i = 0; i < RequestCount; i++)
+    {
+        if (Requests[i].State != CopyRequestIdle && Requests[i].Status == STATUS_PENDING)
+        {
+            NtWaitForSingleObject(Requests[i].Event, FALSE, NULL);
+        }
+        if (Requests[i].Event)
+        {
+            NtClose(Requests[i].Event);
+        }
+    }
+
+    RegionSize = 0;
+    NtFreeVirtualMemory(NtCurrentProcess(),
+                        (PVOID *)&lpBuffer,
+                        &RegionSize,
+                        MEM_RELEASE);
+
     return errCode;
 }
 
@@ -223,7 +488,8 @@ BasepCopyFileExW(IN LPCWSTR lpExistingFileName,
                                    FILE_SHARE_READ | FILE_SHARE_WRITE,
                                    NULL,
                                    OPEN_EXISTING,
-                                   FILE_ATTRIBUTE_NORMAL|FILE_FLAG_NO_BUFFERING,
+                                   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN |
+                                   ((dwCopyFlags & COPY_FILE_NO_BUFFERING) ? FILE_FLAG_NO_BUFFERING : 0),
                                    NULL);
     if (INVALID_HANDLE_VALUE != FileHandleSource)
     {
@@ -254,8 +520,9 @@ BasepCopyFileExW(IN LPCWSTR lpExistingFileName,
                                              GENERIC_WRITE,
                                              FILE_SHARE_WRITE,
                                              NULL,
-                                             dwCopyFlags ? CREATE_NEW : CREATE_ALWAYS,
-                                             FileBasic.FileAttributes,
+                                             (dwCopyFlags & COPY_FILE_FAIL_IF_EXISTS) ? CREATE_NEW : CREATE_ALWAYS,
+                                             FileBasic.FileAttributes | FILE_FLAG_OVERLAPPED |
+                                             ((dwCopyFlags & COPY_FILE_NO_BUFFERING) ? FILE_FLAG_NO_BUFFERING : 0),
                                              NULL);
                 if (INVALID_HANDLE_VALUE != FileHandleDest)
                 {
@@ -265,6 +532,7 @@ BasepCopyFileExW(IN LPCWSTR lpExistingFileName,
                                        lpProgressRoutine,
                                        lpData,
                                        pbCancel,
+                                       (dwCopyFlags & COPY_FILE_NO_BUFFERING) != 0,
                                        &KeepDestOnError);
                     if (!NT_SUCCESS(errCode))
                     {
@@ -20,6 +20,19 @@
 #define  CACHEPAGESIZE(pDeviceExt) ((pDeviceExt)->FatInfo.BytesPerCluster > PAGE_SIZE ? \
 		   (pDeviceExt)->FatInfo.BytesPerCluster : PAGE_SIZE)
 
+/* Word-at-a-time check for a free (zero) entry in a machine word of the FAT */
+#define FAT16_ENTRIES_PER_WORD (sizeof(ULONG_PTR) / sizeof(USHORT))
+#define FAT16_LOW_BITS         ((ULONG_PTR)~(ULONG_PTR)0 / 0xffff)
+#define FAT16_HAS_FREE_ENTRY(w) ((((w) - FAT16_LOW_BITS) & ~(w) & (FAT16_LOW_BITS << 15)) != 0)
+
+#define FAT32_ENTRIES_PER_WORD (sizeof(ULONG_PTR) / sizeof(ULONG))
+#define FAT32_LOW_BITS         ((ULONG_PTR)~(ULONG_PTR)0 / 0xffffffff)
+#define FAT32_HAS_FREE_ENTRY(w) (((((w) & (FAT32_LOW_BITS * 0x0fffffff)) - FAT32_LOW_BITS) & \
+                                  ~((w) & (FAT32_LOW_BITS * 0x0fffffff)) & (FAT32_LOW_BITS << 31)) != 0)
+
+/* When starting a new run, look for at least that many free clusters */
+#define FAT_CLUSTER_RUN 16
+
 /* FUNCTIONS ****************************************************************/
 
 /*
@@ -371,6 +384,99 @@ FAT32FindAndMarkAvailableCluster(
     return STATUS_DISK_FULL;
 }
 
+/*
+ * FUNCTION: Finds an available cluster using the in-memory cluster bitmap.
+ *           The cluster following LastAvailableCluster is preferred, so that
+ *           files keep growing contiguously, otherwise we start a new run
+ *           where there's room for it to grow.
+ */
+NTSTATUS
+BitmapFindAndMarkAvailableCluster(
+    PDEVICE_EXTENSION DeviceExt,
+    PULONG Cluster)
+{
+    ULONG Hint;
+    ULONG Index;
+    ULONG OldValue;
+    NTSTATUS Status;
+
+    *Cluster = 0;
+    Hint = DeviceExt->LastAvailableCluster;
+    if (Hint < 2 || Hint >= DeviceExt->ClusterBitmap.SizeOfBitMap)
+    {
+        Hint = 2;
+    }
+
+    if (!RtlCheckBit(&DeviceExt->ClusterBitmap, Hint))
+    {
+        Index = Hint;
+    }
+    else
+    {
+        Index = RtlFindClearBits(&DeviceExt->ClusterBitmap, FAT_CLUSTER_RUN, Hint);
+        if (Index == MAXULONG)
+        {
+            Index = RtlFindClearBits(&DeviceExt->ClusterBitmap, 1, Hint);
+            if (Index == MAXULONG)
+            {
+                return STATUS_DISK_FULL;
+            }
+        }
+    }
+
+    DPRINT("Found available cluster 0x%x\n", Index);
+    Status = DeviceExt->WriteCluster(DeviceExt, Index, 0xffffffff, &OldValue);
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    ASSERT(OldValue == 0);
+    RtlSetBit(&DeviceExt->ClusterBitmap, Index);
+    *Cluster = Index;
+    DeviceExt->LastAvailableCluster = Index + 1;
+    if (DeviceExt->AvailableClustersValid)
+        InterlockedDecrement((PLONG)&DeviceExt->AvailableClusters);
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * FUNCTION: Allocates the cluster bitmap, with all the clusters in use.
+ *           The count functions then clear the free ones.
+ */
+static
+VOID
+AllocateClusterBitmap(
+    PDEVICE_EXTENSION DeviceExt)
+{
+    PULONG Buffer;
+    ULONG Bits;
+
+    Bits = DeviceExt->FatInfo.NumberOfClusters + 2;
+    Buffer = ExAllocatePoolWithTag(PagedPool, ROUND_UP(Bits, 32) / 8, TAG_BITMAP);
+    if (Buffer == NULL)
+    {
+        DPRINT1("No memory for the cluster bitmap, falling back to FAT scans\n");
+        return;
+    }
+
+    RtlInitializeBitMap(&DeviceExt->ClusterBitmap, Buffer, Bits);
+    RtlSetAllBits(&DeviceExt->ClusterBitmap);
+}
+
+VOID
+FreeClusterBitmap(
+    PDEVICE_EXTENSION DeviceExt)
+{
+    if (DeviceExt->ClusterBitmap.Buffer != NULL)
+    {
+        ExFreePoolWithTag(DeviceExt->ClusterBitmap.Buffer, TAG_BITMAP);
+        DeviceExt->ClusterBitmap.Buffer = NULL;
+        DeviceExt->ClusterBitmap.SizeOfBitMap = 0;
+    }
+}
+
 /*
  * FUNCTION: Counts free cluster in a FAT12 table
  */
@@ -414,7 +520,11 @@ FAT12CountAvailableClusters(
         }
 
         if (Entry == 0)
+        {
             ulCount++;
+            if (DeviceExt->ClusterBitmap.Buffer != NULL)
+                RtlClearBit(&DeviceExt->ClusterBitmap, i);
+        }
     }
 
     CcUnpinData(Context);
@@ -461,11 +571,25 @@ FAT16CountAvailableClusters(
         Block = (PUSHORT)((ULONG_PTR)BaseAddress + (i * 2) % ChunkSize);
         BlockEnd = (PUSHORT)((ULONG_PTR)BaseAddress + ChunkSize);
 
-        /* Now process the whole block */
+        /* Now process the whole block, skipping whole words without free entries */
         while (Block < BlockEnd && i < FatLength)
         {
+            if (((ULONG_PTR)Block % sizeof(ULONG_PTR)) == 0 &&
+                Block + FAT16_ENTRIES_PER_WORD <= BlockEnd &&
+                i + FAT16_ENTRIES_PER_WORD <= FatLength &&
+                !FAT16_HAS_FREE_ENTRY(*(PULONG_PTR)Block))
+            {
+                Block += FAT16_ENTRIES_PER_WORD;
+                i += FAT16_ENTRIES_PER_WORD;
+                continue;
+            }
+
             if (*Block == 0)
+            {
                 ulCount++;
+                if (DeviceExt->ClusterBitmap.Buffer != NULL)
+                    RtlClearBit(&DeviceExt->ClusterBitmap, i);
+            }
             Block++;
             i++;
         }
@@ -517,11 +641,25 @@ FAT32CountAvailableClusters(
         Block = (PULONG)((ULONG_PTR)BaseAddress + (i * 4) % ChunkSize);
         BlockEnd = (PULONG)((ULONG_PTR)BaseAddress + ChunkSize);
 
-        /* Now process the whole block */
+        /* Now process the whole block, skipping whole words without free entries */
         while (Block < BlockEnd && i < FatLength)
         {
+            if (((ULONG_PTR)Block % sizeof(ULONG_PTR)) == 0 &&
+                Block + FAT32_ENTRIES_PER_WORD <= BlockEnd &&
+                i + FAT32_ENTRIES_PER_WORD <= FatLength &&
+                !FAT32_HAS_FREE_ENTRY(*(PULONG_PTR)Block))
+            {
+                Block += FAT32_ENTRIES_PER_WORD;
+                i += FAT32_ENTRIES_PER_WORD;
+                continue;
+            }
+
             if ((*Block & 0x0fffffff) == 0)
+            {
                 ulCount++;
+                if (DeviceExt->ClusterBitmap.Buffer != NULL)
+                    RtlClearBit(&DeviceExt->ClusterBitmap, i);
+            }
             Block++;
             i++;
         }
@@ -544,12 +682,20 @@ CountAvailableClusters(
     ExAcquireResourceExclusiveLite (&DeviceExt->FatResource, TRUE);
     if (!DeviceExt->AvailableClustersValid)
     {
+        /* The cluster bitmap is built along with the first count */
+        if (DeviceExt->ClusterBitmap.Buffer == NULL)
+            AllocateClusterBitmap(DeviceExt);
+
         if (DeviceExt->FatInfo.FatType == FAT12)
             Status = FAT12CountAvailableClusters(DeviceExt);
         else if (DeviceExt->FatInfo.FatType == FAT16 || DeviceExt->FatInfo.FatType == FATX16)
             Status = FAT16CountAvailableClusters(DeviceExt);
         else
             Status = FAT32CountAvailableClusters(DeviceExt);
+
+        /* Don't keep a half built bitmap around */
+        if (!NT_SUCCESS(Status))
+            FreeClusterBitmap(DeviceExt);
     }
     if (Clusters != NULL)
     {
@@ -710,6 +856,13 @@ WriteCluster(
 
     ExAcquireResourceExclusiveLite (&DeviceExt->FatResource, TRUE);
     Status = DeviceExt->WriteCluster(DeviceExt, ClusterToWrite, NewValue, &OldValue);
+    if (NT_SUCCESS(Status) && DeviceExt->ClusterBitmap.Buffer != NULL)
+    {
+        if (NewValue == 0)
+            RtlClearBit(&DeviceExt->ClusterBitmap, ClusterToWrite);
+        else
+            RtlSetBit(&DeviceExt->ClusterBitmap, ClusterToWrite);
+    }
     if (DeviceExt->AvailableClustersValid)
     {
         if (OldValue && NewValue == 0)
@@ -804,7 +957,9 @@ GetNextClusterExtend(
     {
         /* We are after last existing cluster, we must add one to file */
         /* Firstly, find the next available open allocation unit and
-           mark it as end of file */
+           mark it as end of file. Try to keep the file contiguous. */
+        if (CurrentCluster + 1 < DeviceExt->FatInfo.NumberOfClusters + 2)
+            DeviceExt->LastAvailableCluster = CurrentCluster + 1;
         Status = DeviceExt->FindAndMarkAvailableCluster(DeviceExt, &NewCluster);
         if (!NT_SUCCESS(Status))
         {
@@ -738,8 +738,14 @@ VfatMount(
     _SEH2_END;
 
     DeviceExt->LastAvailableCluster = 2;
-    CountAvailableClusters(DeviceExt, NULL);
     ExInitializeResourceLite(&DeviceExt->FatResource);
+    CountAvailableClusters(DeviceExt, NULL);
+
+    /* Allocate from the cluster bitmap if it could be built */
+    if (DeviceExt->ClusterBitmap.Buffer != NULL)
+    {
+        DeviceExt->FindAndMarkAvailableCluster = BitmapFindAndMarkAvailableCluster;
+    }
 
     InitializeListHead(&DeviceExt->FcbListHead);
 
@@ -830,6 +836,8 @@ ByeBye:
             ExFreePoolWithTag(DeviceExt->SpareVPB, TAG_VPB);
         if (DeviceExt && DeviceExt->Statistics)
             ExFreePoolWithTag(DeviceExt->Statistics, TAG_STATS);
+        if (DeviceExt)
+            FreeClusterBitmap(DeviceExt);
         if (DeviceObject)
             IoDeleteDevice(DeviceObject);
     }
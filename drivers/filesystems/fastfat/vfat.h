@@ -325,6 +325,9 @@ typedef struct DEVICE_EXTENSION
     ULONG LastAvailableCluster;
     ULONG AvailableClusters;
     BOOLEAN AvailableClustersValid;
+    /* One bit per FAT entry, set when the cluster is in use. Built at mount
+     * time, and kept in sync by WriteCluster() under the FAT resource */
+    RTL_BITMAP ClusterBitmap;
     ULONG Flags;
     struct _VFATFCB *VolumeFcb;
     struct _VFATFCB *RootFcb;
@@ -553,6 +556,7 @@ typedef struct _VFATCCB
 #define TAG_NAME 'ntaF'
 #define TAG_SEARCH 'LtaF'
 #define TAG_DIRENT 'DtaF'
+#define TAG_BITMAP 'BtaF'
 
 #define ENTRIES_PER_SECTOR (BLOCKSIZE / sizeof(FATDirEntry))
 
@@ -896,6 +900,15 @@ FAT32WriteCluster(
     ULONG NewValue,
     PULONG OldValue);
 
+NTSTATUS
+BitmapFindAndMarkAvailableCluster(
+    PDEVICE_EXTENSION DeviceExt,
+    PULONG Cluster);
+
+VOID
+FreeClusterBitmap(
+    PDEVICE_EXTENSION DeviceExt);
+
 NTSTATUS
 OffsetToCluster(
     PDEVICE_EXTENSION DeviceExt,
@@ -368,6 +368,10 @@ AfdCreateSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
     InitializeListHead( &FCB->DatagramList );
     InitializeListHead( &FCB->PendingConnections );
 
+    KeInitializeSpinLock( &FCB->PollLock );
+    InitializeListHead( &FCB->PollWaiters );
+    InitializeListHead( &FCB->PollGroupMembers );
+
     AFD_DbgPrint(MID_TRACE,("%p: Checking command channel\n", FCB));
 
     if( ConnectInfo ) {
@@ -451,8 +455,16 @@ AfdCleanupSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
         }
     }
 
+    /* A recv being filled by the transport is not on the list */
+    if (FCB->DirectRecvIrp)
+        IoCancelIrp(FCB->DirectRecvIrp);
+
     KillSelectsForFCB( FCB->DeviceExt, FileObject, FALSE );
 
+    /* Closed sockets leave their poll groups, and a closed group lets its members go */
+    LeavePollGroups( FCB );
+    DestroyPollGroup( FCB );
+
     return UnlockAndMaybeComplete(FCB, STATUS_SUCCESS, Irp, 0);
 }
 
@@ -492,6 +504,8 @@ AfdCloseSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
 
     KillSelectsForFCB( FCB->DeviceExt, FileObject, FALSE );
 
+    DestroyPollGroup( FCB );
+
     ASSERT(IsListEmpty(&FCB->PendingIrpList[FUNCTION_CONNECT]));
     ASSERT(IsListEmpty(&FCB->PendingIrpList[FUNCTION_SEND]));
     ASSERT(IsListEmpty(&FCB->PendingIrpList[FUNCTION_RECV]));
@@ -1062,6 +1076,15 @@ AfdDispatch(PDEVICE_OBJECT DeviceObject, PIRP Irp)
             DbgPrint("IOCTL_AFD_VALIDATE_GROUP is UNIMPLEMENTED!\n");
             break;
 
+        case IOCTL_AFD_POLL_GROUP_ADD:
+            return AfdPollGroupAdd( DeviceObject, Irp, IrpSp );
+
+        case IOCTL_AFD_POLL_GROUP_REMOVE:
+            return AfdPollGroupRemove( DeviceObject, Irp, IrpSp );
+
+        case IOCTL_AFD_POLL_GROUP_WAIT:
+            return AfdPollGroupWait( DeviceObject, Irp, IrpSp );
+
         default:
             Status = STATUS_NOT_SUPPORTED;
             DbgPrint("Unknown IOCTL (0x%x)\n",
@@ -1138,11 +1161,10 @@ BOOLEAN CheckUnlockExtraBuffers(PAFD_FCB FCB, PIO_STACK_LOCATION IrpSp)
 }
 
 VOID
-CleanupPendingIrp(PAFD_FCB FCB, PIRP Irp, PIO_STACK_LOCATION IrpSp, PAFD_ACTIVE_POLL Poll)
+CleanupPendingIrp(PAFD_FCB FCB, PIRP Irp, PIO_STACK_LOCATION IrpSp)
 {
     PAFD_RECV_INFO RecvReq;
     PAFD_SEND_INFO SendReq;
-    PAFD_POLL_INFO PollReq;
 
     if (IrpSp->MajorFunction == IRP_MJ_READ)
     {
@@ -1168,14 +1190,6 @@ CleanupPendingIrp(PAFD_FCB FCB, PIRP Irp, PIO_STACK_LOCATION IrpSp, PAFD_ACTIVE_
             SendReq = GetLockedData(Irp, IrpSp);
             UnlockBuffers(SendReq->BufferArray, SendReq->BufferCount, CheckUnlockExtraBuffers(FCB, IrpSp));
         }
-        else if (IrpSp->Parameters.DeviceIoControl.IoControlCode == IOCTL_AFD_SELECT)
-        {
-            ASSERT(Poll);
-
-            PollReq = Irp->AssociatedIrp.SystemBuffer;
-            ZeroEvents(PollReq->Handles, PollReq->HandleCount);
-            SignalSocket(Poll, NULL, PollReq, STATUS_CANCELLED);
-        }
     }
 }
 
@@ -1190,9 +1204,21 @@ AfdCancelHandler(PDEVICE_OBJECT DeviceObject,
     ULONG Function, IoctlCode;
     PIRP CurrentIrp;
     PLIST_ENTRY CurrentEntry;
-    PAFD_DEVICE_EXTENSION DeviceExt = DeviceObject->DeviceExtension;
-    KIRQL OldIrql;
-    PAFD_ACTIVE_POLL Poll;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    /* A select can be completed as soon as the cancel spin lock is released,
+     * the poll has to be read from the IRP before that. It doesn't need the
+     * socket lock either. */
+    if (IrpSp->MajorFunction == IRP_MJ_DEVICE_CONTROL &&
+        IrpSp->Parameters.DeviceIoControl.IoControlCode == IOCTL_AFD_SELECT)
+    {
+        PAFD_ACTIVE_POLL Poll = Irp->Tail.Overlay.DriverContext[0];
+
+        IoReleaseCancelSpinLock(Irp->CancelIrql);
+        CancelSelect(Irp, Poll);
+        return;
+    }
 
     IoReleaseCancelSpinLock(Irp->CancelIrql);
 
@@ -1239,32 +1265,9 @@ AfdCancelHandler(PDEVICE_OBJECT DeviceObject,
             Function = FUNCTION_PREACCEPT;
             break;
 
-        case IOCTL_AFD_SELECT:
-            KeAcquireSpinLock(&DeviceExt->Lock, &OldIrql);
-
-            CurrentEntry = DeviceExt->Polls.Flink;
-            while (CurrentEntry != &DeviceExt->Polls)
-            {
-                Poll = CONTAINING_RECORD(CurrentEntry, AFD_ACTIVE_POLL, ListEntry);
-
-                if (Irp == Poll->Irp)
-                {
-                    CleanupPendingIrp(FCB, Irp, IrpSp, Poll);
-                    KeReleaseSpinLock(&DeviceExt->Lock, OldIrql);
-                    SocketStateUnlock(FCB);
-                    return;
-                }
-                else
-                {
-                    CurrentEntry = CurrentEntry->Flink;
-                }
-            }
-
-            KeReleaseSpinLock(&DeviceExt->Lock, OldIrql);
-
+        case IOCTL_AFD_POLL_GROUP_WAIT:
+            CancelPollGroupWait(FCB, Irp);
             SocketStateUnlock(FCB);
-
-            DbgPrint("WARNING!!! IRP cancellation race could lead to a process hang! (IOCTL_AFD_SELECT)\n");
             return;
 
         case IOCTL_AFD_DISCONNECT:
@@ -1277,6 +1280,14 @@ AfdCancelHandler(PDEVICE_OBJECT DeviceObject,
             return;
     }
 
+    /* The transport is filling this one, its receive completion finishes it */
+    if (Function == FUNCTION_RECV && Irp == FCB->DirectRecvIrp)
+    {
+        IoCancelIrp(FCB->ReceiveIrp.InFlightRequest);
+        SocketStateUnlock(FCB);
+        return;
+    }
+
     CurrentEntry = FCB->PendingIrpList[Function].Flink;
     while (CurrentEntry != &FCB->PendingIrpList[Function])
     {
@@ -1285,7 +1296,7 @@ AfdCancelHandler(PDEVICE_OBJECT DeviceObject,
         if (CurrentIrp == Irp)
         {
             RemoveEntryList(CurrentEntry);
-            CleanupPendingIrp(FCB, Irp, IrpSp, NULL);
+            CleanupPendingIrp(FCB, Irp, IrpSp);
             UnlockAndMaybeComplete(FCB, STATUS_CANCELLED, Irp, 0);
             return;
         }
@@ -1341,8 +1352,6 @@ DriverEntry(PDRIVER_OBJECT DriverObject, PUNICODE_STRING RegistryPath)
     }
 
     DeviceExt = DeviceObject->DeviceExtension;
-    KeInitializeSpinLock( &DeviceExt->Lock );
-    InitializeListHead( &DeviceExt->Polls );
 
     AFD_DbgPrint(MID_TRACE,("Device created: object %p ext %p\n",
                             DeviceObject, DeviceExt));
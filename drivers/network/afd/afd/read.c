@@ -52,6 +52,15 @@ static VOID RefillSocketBuffer( PAFD_FCB FCB )
 
 static VOID HandleReceiveComplete( PAFD_FCB FCB, NTSTATUS Status, ULONG_PTR Information )
 {
+    /* We cancelled the window receive so a recv request could take the data directly */
+    if (FCB->RecvWindowCancelled)
+    {
+        FCB->RecvWindowCancelled = FALSE;
+
+        if (Status == STATUS_CANCELLED && !FCB->TdiReceiveClosed)
+            return;
+    }
+
     FCB->LastReceiveStatus = Status;
 
     /* We got closed while the receive was in progress */
@@ -91,6 +100,78 @@ static BOOLEAN CantReadMore( PAFD_FCB FCB ) {
     return !BytesAvailable && FCB->TdiReceiveClosed;
 }
 
+static BOOLEAN CanReceiveDirect( PAFD_FCB FCB, PAFD_RECV_INFO RecvReq ) {
+    PAFD_MAPBUF Map = (PAFD_MAPBUF)(RecvReq->BufferArray + RecvReq->BufferCount);
+
+    /* The transport only fills the first buffer of a chain, so only plain
+     * reads of a single buffer at least as big as the window qualify.  A
+     * non-blocking read has to return right away instead of waiting. */
+    return FCB->State == SOCKET_STATE_CONNECTED &&
+           !(FCB->Flags & AFD_ENDPOINT_CONNECTIONLESS) &&
+           !(RecvReq->TdiFlags & TDI_RECEIVE_PEEK) &&
+           ((RecvReq->AfdFlags & AFD_OVERLAPPED) ||
+            !((RecvReq->AfdFlags & AFD_IMMEDIATE) || FCB->NonBlocking)) &&
+           RecvReq->BufferCount == 1 &&
+           Map[0].Mdl &&
+           RecvReq->BufferArray[0].len >= FCB->Recv.Size;
+}
+
+static VOID StartDirectReceive( PAFD_FCB FCB, PIRP Irp ) {
+    PLIST_ENTRY NextIrpEntry;
+    PIRP NextIrp;
+    PAFD_RECV_INFO RecvReq;
+    PAFD_MAPBUF Map;
+    NTSTATUS Status;
+
+    /* Buffered data has to be consumed first */
+    if( FCB->TdiReceiveClosed ||
+        FCB->Recv.Content != FCB->Recv.BytesUsed ||
+        IsListEmpty( &FCB->PendingIrpList[FUNCTION_RECV] ) )
+        return;
+
+    NextIrpEntry = FCB->PendingIrpList[FUNCTION_RECV].Flink;
+    NextIrp = CONTAINING_RECORD(NextIrpEntry, IRP, Tail.Overlay.ListEntry);
+
+    /* The caller still has to set up this one before it can leave our hands */
+    if( NextIrp == Irp ) return;
+
+    RecvReq = GetLockedData(NextIrp, IoGetCurrentIrpStackLocation( NextIrp ));
+    if( !CanReceiveDirect( FCB, RecvReq ) ) return;
+
+    if( FCB->ReceiveIrp.InFlightRequest ) {
+        /* Take the window receive back, its completion brings us here again */
+        if( !FCB->DirectRecvIrp && !FCB->RecvWindowCancelled ) {
+            AFD_DbgPrint(MID_TRACE,("Cancelling window receive for %p\n", NextIrp));
+            FCB->RecvWindowCancelled = TRUE;
+            IoCancelIrp( FCB->ReceiveIrp.InFlightRequest );
+        }
+        return;
+    }
+
+    AFD_DbgPrint(MID_TRACE,("Receiving directly into %p\n", NextIrp));
+
+    Map = (PAFD_MAPBUF)(RecvReq->BufferArray + RecvReq->BufferCount);
+
+    RemoveEntryList( NextIrpEntry );
+    FCB->DirectRecvIrp = NextIrp;
+
+    Status = TdiReceiveMdl( &FCB->ReceiveIrp.InFlightRequest,
+                            FCB->Connection.Object,
+                            TDI_RECEIVE_NORMAL,
+                            Map[0].Mdl,
+                            RecvReq->BufferArray[0].len,
+                            DirectReceiveComplete,
+                            FCB );
+
+    if( Status != STATUS_PENDING ) {
+        /* Leave it to the window */
+        FCB->DirectRecvIrp = NULL;
+        InsertHeadList( &FCB->PendingIrpList[FUNCTION_RECV],
+                        &NextIrp->Tail.Overlay.ListEntry );
+        RefillSocketBuffer( FCB );
+    }
+}
+
 static NTSTATUS TryToSatisfyRecvRequestFromBuffer( PAFD_FCB FCB,
                                                    PAFD_RECV_INFO RecvReq,
                                                    PUINT TotalBytesCopied ) {
@@ -233,6 +314,9 @@ static NTSTATUS ReceiveActivity( PAFD_FCB FCB, PIRP Irp ) {
                 IoCompleteRequest( NextIrp, IO_NETWORK_INCREMENT );
             }
         }
+
+        /* A large read that found the window empty skips the copy */
+        StartDirectReceive( FCB, Irp );
     }
 
     if( FCB->Recv.Content - FCB->Recv.BytesUsed &&
@@ -312,6 +396,76 @@ NTSTATUS NTAPI ReceiveComplete
 
     ReceiveActivity( FCB, NULL );
 
+    /* Keep the window stocked if no direct receive took its place */
+    RefillSocketBuffer( FCB );
+
+    SocketStateUnlock( FCB );
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS NTAPI DirectReceiveComplete
+( PDEVICE_OBJECT DeviceObject,
+  PIRP Irp,
+  PVOID Context ) {
+    PAFD_FCB FCB = (PAFD_FCB)Context;
+    PIRP RecvIrp;
+    PIO_STACK_LOCATION RecvIrpSp;
+    PAFD_RECV_INFO RecvReq;
+    NTSTATUS Status = Irp->IoStatus.Status;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    AFD_DbgPrint(MID_TRACE,("Called\n"));
+
+    /* The MDL belongs to the recv request, the I/O manager must not free it */
+    Irp->MdlAddress = NULL;
+
+    if( !SocketAcquireStateLock( FCB ) )
+        return STATUS_FILE_CLOSED;
+
+    ASSERT(FCB->ReceiveIrp.InFlightRequest == Irp);
+    FCB->ReceiveIrp.InFlightRequest = NULL;
+
+    RecvIrp = FCB->DirectRecvIrp;
+    FCB->DirectRecvIrp = NULL;
+    ASSERT(RecvIrp);
+
+    RecvIrpSp = IoGetCurrentIrpStackLocation( RecvIrp );
+    RecvReq = GetLockedData(RecvIrp, RecvIrpSp);
+
+    if( FCB->State == SOCKET_STATE_CLOSED ) {
+        /* The FCB is being destroyed */
+        Status = STATUS_FILE_CLOSED;
+        Irp->IoStatus.Information = 0;
+    }
+
+    if( (Status == STATUS_SUCCESS && Irp->IoStatus.Information) ||
+        FCB->State == SOCKET_STATE_CLOSED || RecvIrp->Cancel ) {
+        AFD_DbgPrint(MID_TRACE,("Completing direct recv %p (%u)\n", RecvIrp,
+                                (UINT)Irp->IoStatus.Information));
+        UnlockBuffers( RecvReq->BufferArray, RecvReq->BufferCount, FALSE );
+        RecvIrp->IoStatus.Status = Status;
+        RecvIrp->IoStatus.Information = Irp->IoStatus.Information;
+        if( RecvIrp->MdlAddress ) UnlockRequest( RecvIrp, RecvIrpSp );
+        (void)IoSetCancelRoutine(RecvIrp, NULL);
+        IoCompleteRequest( RecvIrp, IO_NETWORK_INCREMENT );
+
+        if( FCB->State == SOCKET_STATE_CLOSED ) {
+            SocketStateUnlock( FCB );
+            return STATUS_FILE_CLOSED;
+        }
+    } else {
+        /* A close or failure is reported the same way as for the window */
+        InsertHeadList( &FCB->PendingIrpList[FUNCTION_RECV],
+                        &RecvIrp->Tail.Overlay.ListEntry );
+        HandleReceiveComplete( FCB, Status, 0 );
+    }
+
+    ReceiveActivity( FCB, NULL );
+
+    RefillSocketBuffer( FCB );
+
     SocketStateUnlock( FCB );
 
     return STATUS_SUCCESS;
@@ -532,6 +686,9 @@ AfdConnectedSocketReadData(PDEVICE_OBJECT DeviceObject, PIRP Irp,
         AFD_DbgPrint(MID_TRACE,("Leaving read irp\n"));
         IoMarkIrpPending( Irp );
         (void)IoSetCancelRoutine(Irp, AfdCancelHandler);
+
+        /* Now the IRP can be handed to the transport */
+        StartDirectReceive( FCB, NULL );
     } else {
         AFD_DbgPrint(MID_TRACE,("Completed with status %x\n", Status));
     }
@@ -52,6 +52,57 @@ VOID ZeroEvents( PAFD_HANDLE HandleArray,
 }
 
 
+static VOID DereferencePoll( PAFD_ACTIVE_POLL Poll ) {
+    if( !InterlockedDecrement( &Poll->RefCount ) )
+        ExFreePoolWithTag(Poll, TAG_AFD_ACTIVE_POLL);
+}
+
+/* Take the poll off every socket it waits for.  The socket locks are
+ * taken one at a time, a poll is never reachable from two of them once
+ * somebody claimed it. */
+static VOID UnlinkPoll( PAFD_ACTIVE_POLL Poll ) {
+    UINT i;
+    KIRQL OldIrql;
+    PAFD_FCB FCB;
+
+    for( i = 0; i < Poll->EntryCount; i++ ) {
+        FCB = Poll->Entries[i].FCB;
+        if( !FCB ) continue;
+
+        KeAcquireSpinLock( &FCB->PollLock, &OldIrql );
+        RemoveEntryList( &Poll->Entries[i].ListEntry );
+        KeReleaseSpinLock( &FCB->PollLock, OldIrql );
+    }
+}
+
+/* Returns TRUE if the caller won the poll and has to complete it.  While
+ * AfdSelect is still linking the poll in, the signal is only recorded and
+ * picked up by FinishPollSetup. */
+static BOOLEAN ClaimPoll( PAFD_ACTIVE_POLL Poll, NTSTATUS Status ) {
+    LONG State;
+
+    if( Status == STATUS_CANCELLED )
+        Poll->Cancelled = TRUE;
+    else if( Status == STATUS_TIMEOUT )
+        Poll->TimedOut = TRUE;
+
+    for( ;; ) {
+        State = Poll->State;
+
+        if( State == AFD_POLL_FREE ) {
+            if( InterlockedCompareExchange( &Poll->State, AFD_POLL_CLAIMED,
+                                            AFD_POLL_FREE ) == AFD_POLL_FREE )
+                return TRUE;
+        } else if( State == AFD_POLL_SETUP ) {
+            if( InterlockedCompareExchange( &Poll->State, AFD_POLL_SETUP_SIGNALLED,
+                                            AFD_POLL_SETUP ) == AFD_POLL_SETUP )
+                return FALSE;
+        } else {
+            return FALSE;
+        }
+    }
+}
+
 /* you must pass either Poll OR Irp */
 VOID SignalSocket(
    PAFD_ACTIVE_POLL Poll OPTIONAL,
@@ -62,13 +113,16 @@ VOID SignalSocket(
 {
     UINT i;
     PIRP Irp = _Irp ? _Irp : Poll->Irp;
+    PDRIVER_CANCEL CancelRoutine;
     AFD_DbgPrint(MID_TRACE,("Called (Status %x)\n", Status));
 
     if (Poll)
     {
-        KeCancelTimer( &Poll->Timer );
-        RemoveEntryList( &Poll->ListEntry );
-        ExFreePoolWithTag(Poll, TAG_AFD_ACTIVE_POLL);
+        UnlinkPoll( Poll );
+
+        /* If the timer already went off, its DPC drops the reference */
+        if( KeCancelTimer( &Poll->Timer ) )
+            DereferencePoll( Poll );
     }
 
     Irp->IoStatus.Status = Status;
@@ -86,22 +140,89 @@ VOID SignalSocket(
     }
     UnlockHandles( AFD_HANDLES(PollReq), PollReq->HandleCount );
     if( Irp->MdlAddress ) UnlockRequest( Irp, IoGetCurrentIrpStackLocation( Irp ) );
+    CancelRoutine = IoSetCancelRoutine(Irp, NULL);
+
+    /* Once the cancel routine is taken, CancelSelect runs and reads the poll
+     * from the IRP, so the IRP must not be completed under it.  The later of
+     * the two completes it and drops the reference for completing the poll. */
+    if( Poll && !CancelRoutine &&
+        InterlockedIncrement( &Poll->CancelHandoff ) == 1 ) {
+        AFD_DbgPrint(MID_TRACE,("Left to CancelSelect\n"));
+        return;
+    }
+
     AFD_DbgPrint(MID_TRACE,("Completing\n"));
-    (void)IoSetCancelRoutine(Irp, NULL);
     IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+
+    if( Poll )
+        DereferencePoll( Poll );
+
     AFD_DbgPrint(MID_TRACE,("Done\n"));
 }
 
+static BOOLEAN UpdatePoll( PAFD_ACTIVE_POLL Poll ) {
+    UINT i;
+    PAFD_FCB FCB;
+    UINT Signalled = 0;
+    PAFD_POLL_INFO PollReq = Poll->Irp->AssociatedIrp.SystemBuffer;
+
+    for( i = 0; i < PollReq->HandleCount; i++ ) {
+        FCB = Poll->Entries[i].FCB;
+        if( !FCB ) continue;
+
+        PollReq->Handles[i].Status = PollReq->Handles[i].Events & FCB->PollState;
+        if( PollReq->Handles[i].Status ) {
+            AFD_DbgPrint(MID_TRACE,("Signalling %p with %x\n",
+                                    FCB, FCB->PollState));
+            Signalled++;
+        }
+    }
+
+    return Signalled ? 1 : 0;
+}
+
+static VOID CompletePoll( PAFD_ACTIVE_POLL Poll, NTSTATUS Status ) {
+    PAFD_POLL_INFO PollReq = Poll->Irp->AssociatedIrp.SystemBuffer;
+
+    if( Status == STATUS_SUCCESS )
+        UpdatePoll( Poll );
+    else
+        ZeroEvents( PollReq->Handles, PollReq->HandleCount );
+
+    SignalSocket( Poll, NULL, PollReq, Status );
+}
+
+static VOID CompleteClaimedPolls( PLIST_ENTRY Claimed, NTSTATUS Status ) {
+    PAFD_ACTIVE_POLL Poll;
+
+    while( !IsListEmpty( Claimed ) ) {
+        Poll = CONTAINING_RECORD(RemoveHeadList( Claimed ), AFD_ACTIVE_POLL, ListEntry);
+        CompletePoll( Poll, Status );
+    }
+}
+
+/* Open the poll to the sockets.  Returns TRUE if something signalled it
+ * meanwhile and the caller has to complete it. */
+static BOOLEAN FinishPollSetup( PAFD_ACTIVE_POLL Poll ) {
+    while( InterlockedCompareExchange( &Poll->State, AFD_POLL_FREE,
+                                       AFD_POLL_SETUP ) != AFD_POLL_SETUP ) {
+        (void)InterlockedExchange( &Poll->State, AFD_POLL_SETUP );
+
+        if( Poll->Cancelled || Poll->TimedOut || UpdatePoll( Poll ) ) {
+            Poll->State = AFD_POLL_CLAIMED;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
 static KDEFERRED_ROUTINE SelectTimeout;
 static VOID NTAPI SelectTimeout( PKDPC Dpc,
                            PVOID DeferredContext,
                            PVOID SystemArgument1,
                            PVOID SystemArgument2 ) {
     PAFD_ACTIVE_POLL Poll = DeferredContext;
-    PAFD_POLL_INFO PollReq;
-    PIRP Irp;
-    KIRQL OldIrql;
-    PAFD_DEVICE_EXTENSION DeviceExt;
 
     UNREFERENCED_PARAMETER(Dpc);
     UNREFERENCED_PARAMETER(SystemArgument1);
@@ -109,17 +230,26 @@ static VOID NTAPI SelectTimeout( PKDPC Dpc,
 
     AFD_DbgPrint(MID_TRACE,("Called\n"));
 
-    Irp = Poll->Irp;
-    DeviceExt = Poll->DeviceExt;
-    PollReq = Irp->AssociatedIrp.SystemBuffer;
+    if( ClaimPoll( Poll, STATUS_TIMEOUT ) ) {
+        CompletePoll( Poll, STATUS_TIMEOUT );
+        AFD_DbgPrint(MID_TRACE,("Timeout\n"));
+    }
 
-    ZeroEvents( PollReq->Handles, PollReq->HandleCount );
+    /* Drop the reference of the timer */
+    DereferencePoll( Poll );
+}
 
-    KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
-    SignalSocket( Poll, NULL, PollReq, STATUS_TIMEOUT );
-    KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+/* Poll was read from the IRP under the cancel spin lock, the IRP may be
+ * completed as soon as it is released. */
+VOID CancelSelect( PIRP Irp, PAFD_ACTIVE_POLL Poll ) {
+    if( ClaimPoll( Poll, STATUS_CANCELLED ) )
+        CompletePoll( Poll, STATUS_CANCELLED );
 
-    AFD_DbgPrint(MID_TRACE,("Timeout\n"));
+    /* SignalSocket leaves the IRP to us if it gets here first */
+    if( InterlockedIncrement( &Poll->CancelHandoff ) == 2 ) {
+        IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+        DereferencePoll( Poll );
+    }
 }
 
 VOID KillSelectsForFCB( PAFD_DEVICE_EXTENSION DeviceExt,
@@ -127,36 +257,34 @@ VOID KillSelectsForFCB( PAFD_DEVICE_EXTENSION DeviceExt,
                         BOOLEAN OnlyExclusive ) {
     KIRQL OldIrql;
     PLIST_ENTRY ListEntry;
-    PAFD_ACTIVE_POLL Poll;
-    PIRP Irp;
-    PAFD_POLL_INFO PollReq;
-    PAFD_HANDLE HandleArray;
-    UINT i;
+    PAFD_POLL_ENTRY Entry;
+    PAFD_FCB FCB = FileObject->FsContext;
+    LIST_ENTRY Killed;
+
+    UNREFERENCED_PARAMETER(DeviceExt);
 
     AFD_DbgPrint(MID_TRACE,("Killing selects that refer to %p\n", FileObject));
 
-    KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+    if( !FCB ) return;
 
-    ListEntry = DeviceExt->Polls.Flink;
-    while ( ListEntry != &DeviceExt->Polls ) {
-        Poll = CONTAINING_RECORD(ListEntry, AFD_ACTIVE_POLL, ListEntry);
-        ListEntry = ListEntry->Flink;
-        Irp = Poll->Irp;
-        PollReq = Irp->AssociatedIrp.SystemBuffer;
-        HandleArray = AFD_HANDLES(PollReq);
+    InitializeListHead( &Killed );
 
-        for( i = 0; i < PollReq->HandleCount; i++ ) {
-            AFD_DbgPrint(MAX_TRACE,("Req: %u, This %p\n",
-                                    HandleArray[i].Handle, FileObject));
-            if( (PVOID)HandleArray[i].Handle == FileObject &&
-                (!OnlyExclusive || (OnlyExclusive && Poll->Exclusive)) ) {
-                ZeroEvents( PollReq->Handles, PollReq->HandleCount );
-                SignalSocket( Poll, NULL, PollReq, STATUS_CANCELLED );
-            }
+    KeAcquireSpinLock( &FCB->PollLock, &OldIrql );
+
+    for( ListEntry = FCB->PollWaiters.Flink;
+         ListEntry != &FCB->PollWaiters;
+         ListEntry = ListEntry->Flink ) {
+        Entry = CONTAINING_RECORD(ListEntry, AFD_POLL_ENTRY, ListEntry);
+
+        if( (!OnlyExclusive || Entry->Poll->Exclusive) &&
+            ClaimPoll( Entry->Poll, STATUS_CANCELLED ) ) {
+            InsertTailList( &Killed, &Entry->Poll->ListEntry );
         }
     }
 
-    KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+    KeReleaseSpinLock( &FCB->PollLock, OldIrql );
+
+    CompleteClaimedPolls( &Killed, STATUS_CANCELLED );
 
     AFD_DbgPrint(MID_TRACE,("Done\n"));
 }
@@ -169,6 +297,8 @@ AfdSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
     PFILE_OBJECT FileObject;
     PAFD_POLL_INFO PollReq = Irp->AssociatedIrp.SystemBuffer;
     PAFD_DEVICE_EXTENSION DeviceExt = DeviceObject->DeviceExtension;
+    PAFD_ACTIVE_POLL Poll;
+    PAFD_POLL_ENTRY Entry;
     KIRQL OldIrql;
     UINT i, Signalled = 0;
     ULONG Exclusive = PollReq->Exclusive;
@@ -199,8 +329,6 @@ AfdSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
         }
     }
 
-    KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
-
     for( i = 0; i < PollReq->HandleCount; i++ ) {
         if( !AFD_HANDLES(PollReq)[i].Handle ) continue;
 
@@ -224,41 +352,77 @@ AfdSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
         Status = STATUS_SUCCESS;
         Irp->IoStatus.Status = Status;
         SignalSocket( NULL, Irp, PollReq, Status );
-    } else {
+        return Status;
+    }
+
+    Poll = ExAllocatePoolWithTag(NonPagedPool,
+                                 FIELD_OFFSET(AFD_ACTIVE_POLL, Entries) +
+                                 PollReq->HandleCount * sizeof(AFD_POLL_ENTRY),
+                                 TAG_AFD_ACTIVE_POLL);
+
+    if( !Poll ) {
+        AFD_DbgPrint(MIN_TRACE,("Out of memory for the poll\n"));
+        ZeroEvents( PollReq->Handles, PollReq->HandleCount );
+        SignalSocket( NULL, Irp, PollReq, STATUS_NO_MEMORY );
+        return STATUS_NO_MEMORY;
+    }
 
-       PAFD_ACTIVE_POLL Poll = NULL;
+    Poll->Irp = Irp;
+    Poll->DeviceExt = DeviceExt;
+    Poll->Exclusive = Exclusive;
+    Poll->TimedOut = FALSE;
+    Poll->Cancelled = FALSE;
+    Poll->State = AFD_POLL_SETUP;
+    /* One reference for completing the poll, one for its timer and one
+     * for us while we set it up.  A cancel and an expired timer may both
+     * finish with it before FinishPollSetup looks at it again. */
+    Poll->RefCount = 3;
+    Poll->CancelHandoff = 0;
+    Poll->EntryCount = PollReq->HandleCount;
 
-       Poll = ExAllocatePoolWithTag(NonPagedPool,
-                                    sizeof(AFD_ACTIVE_POLL),
-                                    TAG_AFD_ACTIVE_POLL);
+    KeInitializeTimerEx( &Poll->Timer, NotificationTimer );
 
-       if (Poll){
-          Poll->Irp = Irp;
-          Poll->DeviceExt = DeviceExt;
-          Poll->Exclusive = Exclusive;
+    KeInitializeDpc( (PRKDPC)&Poll->TimeoutDpc, SelectTimeout, Poll );
 
-          KeInitializeTimerEx( &Poll->Timer, NotificationTimer );
+    Irp->Tail.Overlay.DriverContext[0] = Poll;
+    IoMarkIrpPending( Irp );
+    (void)IoSetCancelRoutine(Irp, AfdCancelHandler);
 
-          KeInitializeDpc( (PRKDPC)&Poll->TimeoutDpc, SelectTimeout, Poll );
+    /* Cancelled before the routine was set, nobody will call it */
+    if( Irp->Cancel )
+        Poll->Cancelled = TRUE;
 
-          InsertTailList( &DeviceExt->Polls, &Poll->ListEntry );
+    /* Queue the poll on each socket so their state changes find it */
+    for( i = 0; i < PollReq->HandleCount; i++ ) {
+        Entry = &Poll->Entries[i];
+        Entry->Poll = Poll;
+        Entry->Events = PollReq->Handles[i].Events;
+        Entry->FCB = NULL;
 
-          KeSetTimer( &Poll->Timer, PollReq->Timeout, &Poll->TimeoutDpc );
+        if( !AFD_HANDLES(PollReq)[i].Handle ) continue;
 
-          Status = STATUS_PENDING;
-          IoMarkIrpPending( Irp );
-          (void)IoSetCancelRoutine(Irp, AfdCancelHandler);
-       } else {
-          AFD_DbgPrint(MAX_TRACE, ("FIXME: do something with the IRP!\n"));
-          Status = STATUS_NO_MEMORY;
-       }
+        FileObject = (PFILE_OBJECT)AFD_HANDLES(PollReq)[i].Handle;
+        FCB = FileObject->FsContext;
+        if( !FCB ) continue;
+
+        Entry->FCB = FCB;
+        KeAcquireSpinLock( &FCB->PollLock, &OldIrql );
+        InsertTailList( &FCB->PollWaiters, &Entry->ListEntry );
+        KeReleaseSpinLock( &FCB->PollLock, OldIrql );
     }
 
-    KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+    KeSetTimer( &Poll->Timer, PollReq->Timeout, &Poll->TimeoutDpc );
 
-    AFD_DbgPrint(MID_TRACE,("Returning %x\n", Status));
+    if( FinishPollSetup( Poll ) ) {
+        CompletePoll( Poll, Poll->Cancelled ? STATUS_CANCELLED :
+                            Poll->TimedOut ? STATUS_TIMEOUT : STATUS_SUCCESS );
+    }
+
+    DereferencePoll( Poll );
+
+    AFD_DbgPrint(MID_TRACE,("Returning %x\n", STATUS_PENDING));
 
-    return Status;
+    return STATUS_PENDING;
 }
 
 NTSTATUS NTAPI
@@ -378,69 +542,126 @@ AfdEnumEvents( PDEVICE_OBJECT DeviceObject, PIRP Irp,
     return UnlockAndMaybeComplete( FCB, STATUS_SUCCESS, Irp, 0 );
 }
 
-/* * * NOTE ALWAYS CALLED AT DISPATCH_LEVEL * * */
-static BOOLEAN UpdatePollWithFCB( PAFD_ACTIVE_POLL Poll, PFILE_OBJECT FileObject ) {
-    UINT i;
+
+/* Called with the group lock held.  Fills the wait IRP with the members
+ * that are still signalled, returns FALSE if none of them is. */
+static BOOLEAN FillPollGroupWait( PAFD_POLL_GROUP Group, PIRP Irp ) {
+    PIO_STACK_LOCATION IrpSp = IoGetCurrentIrpStackLocation( Irp );
+    PAFD_POLL_GROUP_EVENT Events = Irp->AssociatedIrp.SystemBuffer;
+    UINT Count = 0, MaxCount =
+        IrpSp->Parameters.DeviceIoControl.OutputBufferLength / sizeof(AFD_POLL_GROUP_EVENT);
+    PAFD_POLL_GROUP_MEMBER Member;
     PAFD_FCB FCB;
-    UINT Signalled = 0;
-    PAFD_POLL_INFO PollReq = Poll->Irp->AssociatedIrp.SystemBuffer;
+    ULONG Signalled;
 
-    ASSERT( KeGetCurrentIrql() == DISPATCH_LEVEL );
+    while( Count < MaxCount && !IsListEmpty( &Group->ReadyList ) ) {
+        Member = CONTAINING_RECORD(RemoveHeadList( &Group->ReadyList ),
+                                   AFD_POLL_GROUP_MEMBER, ReadyEntry);
+        Member->Ready = FALSE;
 
-    for( i = 0; i < PollReq->HandleCount; i++ ) {
-        if( !AFD_HANDLES(PollReq)[i].Handle ) continue;
+        /* The member is queued again on its next matching state change */
+        FCB = Member->FileObject->FsContext;
+        Signalled = Member->Events & FCB->PollState;
+        if( !Signalled ) continue;
 
-        FileObject = (PFILE_OBJECT)AFD_HANDLES(PollReq)[i].Handle;
-        FCB = FileObject->FsContext;
+        Events[Count].Context = Member->Context;
+        Events[Count].Events = Signalled;
+        Count++;
+    }
 
-        PollReq->Handles[i].Status = PollReq->Handles[i].Events & FCB->PollState;
-        if( PollReq->Handles[i].Status ) {
-            AFD_DbgPrint(MID_TRACE,("Signalling %p with %x\n",
-                                    FCB, FCB->PollState));
-            Signalled++;
-        }
+    Irp->IoStatus.Status = STATUS_SUCCESS;
+    Irp->IoStatus.Information = Count * sizeof(AFD_POLL_GROUP_EVENT);
+
+    return Count != 0;
+}
+
+/* Called with the group lock held */
+static PIRP SignalPollGroup( PAFD_POLL_GROUP Group, PAFD_POLL_GROUP_MEMBER Member ) {
+    PIRP Irp = NULL;
+
+    if( !Member->Ready ) {
+        Member->Ready = TRUE;
+        InsertTailList( &Group->ReadyList, &Member->ReadyEntry );
     }
 
-    return Signalled ? 1 : 0;
+    if( Group->WaitIrp && FillPollGroupWait( Group, Group->WaitIrp ) ) {
+        Irp = Group->WaitIrp;
+        Group->WaitIrp = NULL;
+    }
+
+    return Irp;
+}
+
+static VOID CompletePollGroupWait( PIRP Irp ) {
+    AFD_DbgPrint(MID_TRACE,("Completing group wait %p (%u)\n",
+                            Irp, (UINT)Irp->IoStatus.Information));
+    (void)IoSetCancelRoutine(Irp, NULL);
+    IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
 }
 
 VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceExt, PFILE_OBJECT FileObject ) {
-    PAFD_ACTIVE_POLL Poll = NULL;
-    PLIST_ENTRY ThePollEnt = NULL;
     PAFD_FCB FCB;
     KIRQL OldIrql;
-    PAFD_POLL_INFO PollReq;
+    PLIST_ENTRY ListEntry;
+    PAFD_POLL_ENTRY Entry;
+    PAFD_POLL_GROUP_MEMBER Member;
+    LIST_ENTRY Signalled, GroupWaits;
+    PIRP Irp;
+
+    UNREFERENCED_PARAMETER(DeviceExt);
 
     AFD_DbgPrint(MID_TRACE,("Called: DeviceExt %p FileObject %p\n",
                             DeviceExt, FileObject));
 
-    KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
-
     /* Take care of any event select signalling */
     FCB = (PAFD_FCB)FileObject->FsContext;
 
     if( !FCB ) {
-        KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
         return;
     }
 
-    /* Now signal normal select irps */
-    ThePollEnt = DeviceExt->Polls.Flink;
+    InitializeListHead( &Signalled );
+    InitializeListHead( &GroupWaits );
+
+    KeAcquireSpinLock( &FCB->PollLock, &OldIrql );
+
+    /* Now signal normal select irps, only the ones waiting on this socket */
+    for( ListEntry = FCB->PollWaiters.Flink;
+         ListEntry != &FCB->PollWaiters;
+         ListEntry = ListEntry->Flink ) {
+        Entry = CONTAINING_RECORD(ListEntry, AFD_POLL_ENTRY, ListEntry);
+        AFD_DbgPrint(MID_TRACE,("Checking poll %p\n", Entry->Poll));
+
+        if( (Entry->Events & FCB->PollState) &&
+            ClaimPoll( Entry->Poll, STATUS_SUCCESS ) ) {
+            InsertTailList( &Signalled, &Entry->Poll->ListEntry );
+        }
+    }
+
+    /* And the poll groups the socket is a member of */
+    for( ListEntry = FCB->PollGroupMembers.Flink;
+         ListEntry != &FCB->PollGroupMembers;
+         ListEntry = ListEntry->Flink ) {
+        Member = CONTAINING_RECORD(ListEntry, AFD_POLL_GROUP_MEMBER, FcbEntry);
+        if( !(Member->Events & FCB->PollState) ) continue;
 
-    while( ThePollEnt != &DeviceExt->Polls ) {
-        Poll = CONTAINING_RECORD( ThePollEnt, AFD_ACTIVE_POLL, ListEntry );
-        PollReq = Poll->Irp->AssociatedIrp.SystemBuffer;
-        AFD_DbgPrint(MID_TRACE,("Checking poll %p\n", Poll));
+        KeAcquireSpinLockAtDpcLevel( &Member->Group->Lock );
+        Irp = SignalPollGroup( Member->Group, Member );
+        KeReleaseSpinLockFromDpcLevel( &Member->Group->Lock );
 
-        if( UpdatePollWithFCB( Poll, FileObject ) ) {
-            ThePollEnt = ThePollEnt->Flink;
-            AFD_DbgPrint(MID_TRACE,("Signalling socket\n"));
-            SignalSocket( Poll, NULL, PollReq, STATUS_SUCCESS );
-        } else
-            ThePollEnt = ThePollEnt->Flink;
+        if( Irp )
+            InsertTailList( &GroupWaits, &Irp->Tail.Overlay.ListEntry );
     }
 
-    KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+    KeReleaseSpinLock( &FCB->PollLock, OldIrql );
+
+    AFD_DbgPrint(MID_TRACE,("Signalling sockets\n"));
+    CompleteClaimedPolls( &Signalled, STATUS_SUCCESS );
+
+    while( !IsListEmpty( &GroupWaits ) ) {
+        Irp = CONTAINING_RECORD(RemoveHeadList( &GroupWaits ), IRP, Tail.Overlay.ListEntry);
+        CompletePollGroupWait( Irp );
+    }
 
     if((FCB->EventSelect) &&
        (FCB->PollState & (FCB->EventSelectTriggers & ~FCB->EventSelectDisabled)))
@@ -453,3 +674,313 @@ VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceExt, PFILE_OBJECT FileObject ) {
 
     AFD_DbgPrint(MID_TRACE,("Leaving\n"));
 }
+
+/* Drops the memberships of a socket in Group, or in every group */
+static UINT RemoveGroupMembers( PAFD_FCB FCB, PAFD_POLL_GROUP Group ) {
+    KIRQL OldIrql;
+    PLIST_ENTRY ListEntry;
+    PAFD_POLL_GROUP_MEMBER Member;
+    LIST_ENTRY Removed;
+    UINT Count = 0;
+
+    InitializeListHead( &Removed );
+
+    KeAcquireSpinLock( &FCB->PollLock, &OldIrql );
+
+    ListEntry = FCB->PollGroupMembers.Flink;
+    while( ListEntry != &FCB->PollGroupMembers ) {
+        Member = CONTAINING_RECORD(ListEntry, AFD_POLL_GROUP_MEMBER, FcbEntry);
+        ListEntry = ListEntry->Flink;
+
+        if( Group && Member->Group != Group ) continue;
+
+        RemoveEntryList( &Member->FcbEntry );
+
+        KeAcquireSpinLockAtDpcLevel( &Member->Group->Lock );
+        RemoveEntryList( &Member->GroupEntry );
+        if( Member->Ready ) RemoveEntryList( &Member->ReadyEntry );
+        KeReleaseSpinLockFromDpcLevel( &Member->Group->Lock );
+
+        InsertTailList( &Removed, &Member->FcbEntry );
+    }
+
+    KeReleaseSpinLock( &FCB->PollLock, OldIrql );
+
+    while( !IsListEmpty( &Removed ) ) {
+        Member = CONTAINING_RECORD(RemoveHeadList( &Removed ), AFD_POLL_GROUP_MEMBER, FcbEntry);
+        ObDereferenceObject( Member->FileObject );
+        ExFreePoolWithTag(Member, TAG_AFD_POLL_GROUP_MEMBER);
+        Count++;
+    }
+
+    return Count;
+}
+
+static NTSTATUS ReferencePollGroupMember( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                                          PAFD_FCB FCB, SOCKET Handle,
+                                          PFILE_OBJECT *MemberObject ) {
+    PAFD_FCB MemberFCB;
+    NTSTATUS Status;
+
+    Status = ObReferenceObjectByHandle( (HANDLE)Handle,
+                                        FILE_READ_DATA,
+                                        *IoFileObjectType,
+                                        Irp->RequestorMode,
+                                        (PVOID *)MemberObject,
+                                        NULL );
+    if( !NT_SUCCESS(Status) ) {
+        AFD_DbgPrint(MIN_TRACE,("Failed to reference the member (0x%x)\n", Status));
+        return Status;
+    }
+
+    /* Only sockets with a transport can be members */
+    MemberFCB = (*MemberObject)->FsContext;
+    if( (*MemberObject)->DeviceObject != DeviceObject || !MemberFCB ||
+        MemberFCB == FCB || !MemberFCB->TdiDeviceName.Length ) {
+        ObDereferenceObject( *MemberObject );
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS NTAPI
+AfdPollGroupAdd( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                 PIO_STACK_LOCATION IrpSp ) {
+    PFILE_OBJECT FileObject = IrpSp->FileObject;
+    PAFD_FCB FCB = FileObject->FsContext, MemberFCB;
+    PAFD_POLL_GROUP_INFO GroupInfo = Irp->AssociatedIrp.SystemBuffer;
+    PAFD_POLL_GROUP Group;
+    PAFD_POLL_GROUP_MEMBER Member, NewMember;
+    PFILE_OBJECT MemberObject;
+    PLIST_ENTRY ListEntry;
+    PIRP WaitIrp = NULL;
+    KIRQL OldIrql;
+    NTSTATUS Status;
+
+    if( !SocketAcquireStateLock( FCB ) ) return LostSocket( Irp );
+
+    /* Only a handle without a transport can be a poll group */
+    if( IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(*GroupInfo) ||
+        FCB->TdiDeviceName.Length )
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+
+    Status = ReferencePollGroupMember( DeviceObject, Irp, FCB,
+                                       GroupInfo->Handle, &MemberObject );
+    if( !NT_SUCCESS(Status) )
+        return UnlockAndMaybeComplete( FCB, Status, Irp, 0 );
+
+    if( !FCB->PollGroup ) {
+        Group = ExAllocatePoolWithTag(NonPagedPool,
+                                      sizeof(AFD_POLL_GROUP),
+                                      TAG_AFD_POLL_GROUP);
+        if( !Group ) {
+            ObDereferenceObject( MemberObject );
+            return UnlockAndMaybeComplete( FCB, STATUS_NO_MEMORY, Irp, 0 );
+        }
+
+        KeInitializeSpinLock( &Group->Lock );
+        InitializeListHead( &Group->Members );
+        InitializeListHead( &Group->ReadyList );
+        Group->WaitIrp = NULL;
+        FCB->PollGroup = Group;
+    }
+    Group = FCB->PollGroup;
+
+    NewMember = ExAllocatePoolWithTag(NonPagedPool,
+                                      sizeof(AFD_POLL_GROUP_MEMBER),
+                                      TAG_AFD_POLL_GROUP_MEMBER);
+    if( !NewMember ) {
+        ObDereferenceObject( MemberObject );
+        return UnlockAndMaybeComplete( FCB, STATUS_NO_MEMORY, Irp, 0 );
+    }
+
+    MemberFCB = MemberObject->FsContext;
+
+    AFD_DbgPrint(MID_TRACE,("Adding %p to group %p (Events %x)\n",
+                            MemberFCB, Group, GroupInfo->Events));
+
+    KeAcquireSpinLock( &MemberFCB->PollLock, &OldIrql );
+    KeAcquireSpinLockAtDpcLevel( &Group->Lock );
+
+    /* Adding a member again changes its events and context */
+    for( ListEntry = MemberFCB->PollGroupMembers.Flink;
+         ListEntry != &MemberFCB->PollGroupMembers;
+         ListEntry = ListEntry->Flink ) {
+        Member = CONTAINING_RECORD(ListEntry, AFD_POLL_GROUP_MEMBER, FcbEntry);
+        if( Member->Group == Group ) break;
+    }
+
+    if( ListEntry == &MemberFCB->PollGroupMembers ) {
+        Member = NewMember;
+        NewMember = NULL;
+        Member->Group = Group;
+        Member->FileObject = MemberObject;
+        Member->Ready = FALSE;
+        InsertTailList( &MemberFCB->PollGroupMembers, &Member->FcbEntry );
+        InsertTailList( &Group->Members, &Member->GroupEntry );
+        MemberObject = NULL;
+    }
+
+    Member->Events = GroupInfo->Events;
+    Member->Context = GroupInfo->Context;
+
+    /* A socket that is already signalled is reported right away */
+    if( Member->Events & MemberFCB->PollState )
+        WaitIrp = SignalPollGroup( Group, Member );
+
+    KeReleaseSpinLockFromDpcLevel( &Group->Lock );
+    KeReleaseSpinLock( &MemberFCB->PollLock, OldIrql );
+
+    if( NewMember ) ExFreePoolWithTag(NewMember, TAG_AFD_POLL_GROUP_MEMBER);
+    if( MemberObject ) ObDereferenceObject( MemberObject );
+    if( WaitIrp ) CompletePollGroupWait( WaitIrp );
+
+    return UnlockAndMaybeComplete( FCB, STATUS_SUCCESS, Irp, 0 );
+}
+
+NTSTATUS NTAPI
+AfdPollGroupRemove( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                    PIO_STACK_LOCATION IrpSp ) {
+    PFILE_OBJECT FileObject = IrpSp->FileObject;
+    PAFD_FCB FCB = FileObject->FsContext;
+    PAFD_POLL_GROUP_INFO GroupInfo = Irp->AssociatedIrp.SystemBuffer;
+    PFILE_OBJECT MemberObject;
+    NTSTATUS Status;
+
+    if( !SocketAcquireStateLock( FCB ) ) return LostSocket( Irp );
+
+    if( IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(*GroupInfo) ||
+        !FCB->PollGroup )
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+
+    Status = ReferencePollGroupMember( DeviceObject, Irp, FCB,
+                                       GroupInfo->Handle, &MemberObject );
+    if( !NT_SUCCESS(Status) )
+        return UnlockAndMaybeComplete( FCB, Status, Irp, 0 );
+
+    if( !RemoveGroupMembers( MemberObject->FsContext, FCB->PollGroup ) )
+        Status = STATUS_NOT_FOUND;
+
+    ObDereferenceObject( MemberObject );
+
+    return UnlockAndMaybeComplete( FCB, Status, Irp, 0 );
+}
+
+NTSTATUS NTAPI
+AfdPollGroupWait( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                  PIO_STACK_LOCATION IrpSp ) {
+    PFILE_OBJECT FileObject = IrpSp->FileObject;
+    PAFD_FCB FCB = FileObject->FsContext;
+    PAFD_POLL_GROUP_WAIT_INFO WaitInfo = Irp->AssociatedIrp.SystemBuffer;
+    PAFD_POLL_GROUP Group;
+    ULONG AfdFlags;
+    KIRQL OldIrql;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    if( !SocketAcquireStateLock( FCB ) ) return LostSocket( Irp );
+
+    if( IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(*WaitInfo) ||
+        IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(AFD_POLL_GROUP_EVENT) ||
+        !(Group = FCB->PollGroup) )
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+
+    /* The events are returned in the same buffer */
+    AfdFlags = WaitInfo->AfdFlags;
+
+    KeAcquireSpinLock( &Group->Lock, &OldIrql );
+
+    if( FillPollGroupWait( Group, Irp ) || (AfdFlags & AFD_IMMEDIATE) ) {
+        KeReleaseSpinLock( &Group->Lock, OldIrql );
+        return UnlockAndMaybeComplete( FCB, STATUS_SUCCESS, Irp,
+                                       Irp->IoStatus.Information );
+    }
+
+    /* Only one thread waits on a group at a time */
+    if( Group->WaitIrp ) {
+        KeReleaseSpinLock( &Group->Lock, OldIrql );
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+    }
+
+    Group->WaitIrp = Irp;
+    IoMarkIrpPending( Irp );
+    (void)IoSetCancelRoutine(Irp, AfdCancelHandler);
+
+    /* Cancelled before the routine was set, nobody will call it */
+    if( Irp->Cancel && IoSetCancelRoutine(Irp, NULL) ) {
+        Group->WaitIrp = NULL;
+        KeReleaseSpinLock( &Group->Lock, OldIrql );
+        Irp->IoStatus.Status = STATUS_CANCELLED;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+        SocketStateUnlock( FCB );
+        return STATUS_PENDING;
+    }
+
+    KeReleaseSpinLock( &Group->Lock, OldIrql );
+
+    SocketStateUnlock( FCB );
+
+    return STATUS_PENDING;
+}
+
+VOID CancelPollGroupWait( PAFD_FCB FCB, PIRP Irp ) {
+    PAFD_POLL_GROUP Group = FCB->PollGroup;
+    KIRQL OldIrql;
+
+    if( !Group ) return;
+
+    KeAcquireSpinLock( &Group->Lock, &OldIrql );
+    if( Group->WaitIrp != Irp ) {
+        KeReleaseSpinLock( &Group->Lock, OldIrql );
+        return;
+    }
+    Group->WaitIrp = NULL;
+    KeReleaseSpinLock( &Group->Lock, OldIrql );
+
+    Irp->IoStatus.Status = STATUS_CANCELLED;
+    Irp->IoStatus.Information = 0;
+    IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+}
+
+VOID LeavePollGroups( PAFD_FCB FCB ) {
+    RemoveGroupMembers( FCB, NULL );
+}
+
+VOID DestroyPollGroup( PAFD_FCB FCB ) {
+    PAFD_POLL_GROUP Group = FCB->PollGroup;
+    PAFD_POLL_GROUP_MEMBER Member;
+    PFILE_OBJECT MemberObject;
+    PIRP WaitIrp;
+    KIRQL OldIrql;
+
+    if( !Group ) return;
+
+    for( ;; ) {
+        KeAcquireSpinLock( &Group->Lock, &OldIrql );
+        if( IsListEmpty( &Group->Members ) ) break;
+
+        /* The member lock comes first, keep the socket around until we have it */
+        Member = CONTAINING_RECORD(Group->Members.Flink, AFD_POLL_GROUP_MEMBER, GroupEntry);
+        MemberObject = Member->FileObject;
+        ObReferenceObject( MemberObject );
+        KeReleaseSpinLock( &Group->Lock, OldIrql );
+
+        RemoveGroupMembers( MemberObject->FsContext, Group );
+        ObDereferenceObject( MemberObject );
+    }
+
+    WaitIrp = Group->WaitIrp;
+    Group->WaitIrp = NULL;
+    KeReleaseSpinLock( &Group->Lock, OldIrql );
+
+    if( WaitIrp ) {
+        WaitIrp->IoStatus.Status = STATUS_CANCELLED;
+        WaitIrp->IoStatus.Information = 0;
+        CompletePollGroupWait( WaitIrp );
+    }
+
+    FCB->PollGroup = NULL;
+    ExFreePoolWithTag(Group, TAG_AFD_POLL_GROUP);
+}
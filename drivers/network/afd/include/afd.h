@@ -47,6 +47,8 @@
 #define TAG_AFD_POLL_HANDLE                'hpfA'
 #define TAG_AFD_FCB                        'cffA'
 #define TAG_AFD_ACTIVE_POLL                'pafA'
+#define TAG_AFD_POLL_GROUP                 'gpfA'
+#define TAG_AFD_POLL_GROUP_MEMBER          'mpfA'
 #define TAG_AFD_EA_INFO                    'aefA'
 #define TAG_AFD_STORED_DATAGRAM            'gsfA'
 #define TAG_AFD_SNMP_ADDRESS_INFO          'asfA'
@@ -109,10 +111,25 @@ typedef struct _AFD_MAPBUF {
 
 typedef struct _AFD_DEVICE_EXTENSION {
     PDEVICE_OBJECT DeviceObject;
-    LIST_ENTRY Polls;
-    KSPIN_LOCK Lock;
 } AFD_DEVICE_EXTENSION, *PAFD_DEVICE_EXTENSION;
 
+/* Poll states, only the owner of a claimed poll may complete it */
+#define AFD_POLL_FREE                      0
+#define AFD_POLL_SETUP                     1
+#define AFD_POLL_SETUP_SIGNALLED           2
+#define AFD_POLL_CLAIMED                   3
+
+struct _AFD_FCB;
+struct _AFD_ACTIVE_POLL;
+
+/* One per handle of a select, queued on the socket it waits for */
+typedef struct _AFD_POLL_ENTRY {
+    LIST_ENTRY ListEntry;
+    struct _AFD_ACTIVE_POLL *Poll;
+    struct _AFD_FCB *FCB;
+    ULONG Events;
+} AFD_POLL_ENTRY, *PAFD_POLL_ENTRY;
+
 typedef struct _AFD_ACTIVE_POLL {
     LIST_ENTRY ListEntry;
     PIRP Irp;
@@ -121,8 +138,32 @@ typedef struct _AFD_ACTIVE_POLL {
     KTIMER Timer;
     PKEVENT EventObject;
     BOOLEAN Exclusive;
+    BOOLEAN TimedOut, Cancelled;
+    LONG State;
+    LONG RefCount;
+    LONG CancelHandoff;
+    UINT EntryCount;
+    AFD_POLL_ENTRY Entries[1];
 } AFD_ACTIVE_POLL, *PAFD_ACTIVE_POLL;
 
+typedef struct _AFD_POLL_GROUP {
+    KSPIN_LOCK Lock;
+    LIST_ENTRY Members;
+    LIST_ENTRY ReadyList;
+    PIRP WaitIrp;
+} AFD_POLL_GROUP, *PAFD_POLL_GROUP;
+
+typedef struct _AFD_POLL_GROUP_MEMBER {
+    LIST_ENTRY FcbEntry;
+    LIST_ENTRY GroupEntry;
+    LIST_ENTRY ReadyEntry;
+    PAFD_POLL_GROUP Group;
+    PFILE_OBJECT FileObject;
+    ULONG Events;
+    ULONG_PTR Context;
+    BOOLEAN Ready;
+} AFD_POLL_GROUP_MEMBER, *PAFD_POLL_GROUP_MEMBER;
+
 typedef struct _IRP_LIST {
     LIST_ENTRY ListEntry;
     PIRP Irp;
@@ -176,7 +217,13 @@ typedef struct _AFD_FCB {
     AFD_TDI_OBJECT AddressFile, Connection;
     AFD_IN_FLIGHT_REQUEST ConnectIrp, ListenIrp, ReceiveIrp, SendIrp, DisconnectIrp;
     AFD_DATA_WINDOW Send, Recv;
+    PIRP DirectRecvIrp;
+    BOOLEAN RecvWindowCancelled;
     KMUTEX Mutex;
+    KSPIN_LOCK PollLock;
+    LIST_ENTRY PollWaiters;
+    LIST_ENTRY PollGroupMembers;
+    PAFD_POLL_GROUP PollGroup;
     PKEVENT EventSelect;
     DWORD EventSelectTriggers;
     DWORD EventSelectDisabled;
@@ -308,6 +355,7 @@ BOOLEAN CheckUnlockExtraBuffers(PAFD_FCB FCB, PIO_STACK_LOCATION IrpSp);
 /* read.c */
 
 IO_COMPLETION_ROUTINE ReceiveComplete;
+IO_COMPLETION_ROUTINE DirectReceiveComplete;
 
 IO_COMPLETION_ROUTINE PacketSocketRecvComplete;
 
@@ -336,6 +384,19 @@ VOID ZeroEvents( PAFD_HANDLE HandleArray,
 VOID SignalSocket(
    PAFD_ACTIVE_POLL Poll OPTIONAL, PIRP _Irp OPTIONAL,
    PAFD_POLL_INFO PollReq, NTSTATUS Status);
+VOID CancelSelect( PIRP Irp, PAFD_ACTIVE_POLL Poll );
+NTSTATUS NTAPI
+AfdPollGroupAdd( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                 PIO_STACK_LOCATION IrpSp );
+NTSTATUS NTAPI
+AfdPollGroupRemove( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                    PIO_STACK_LOCATION IrpSp );
+NTSTATUS NTAPI
+AfdPollGroupWait( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                  PIO_STACK_LOCATION IrpSp );
+VOID CancelPollGroupWait( PAFD_FCB FCB, PIRP Irp );
+VOID LeavePollGroups( PAFD_FCB FCB );
+VOID DestroyPollGroup( PAFD_FCB FCB );
 
 /* tdi.c */
 
@@ -370,6 +431,15 @@ NTSTATUS TdiReceive
   PIO_COMPLETION_ROUTINE  CompletionRoutine,
   PVOID CompletionContext);
 
+NTSTATUS TdiReceiveMdl
+( PIRP *Irp,
+  PFILE_OBJECT ConnectionObject,
+  USHORT Flags,
+  PMDL Mdl,
+  UINT BufferLength,
+  PIO_COMPLETION_ROUTINE  CompletionRoutine,
+  PVOID CompletionContext);
+
 NTSTATUS TdiSend
 ( PIRP *Irp,
   PFILE_OBJECT ConnectionObject,
@@ -313,6 +313,7 @@ VOID LanReceiveWorker( PVOID Context ) {
     IP_PACKET IPPacket;
     BOOLEAN LegacyReceive;
     PIP_INTERFACE Interface;
+    NDIS_TCP_IP_CHECKSUM_PACKET_INFO ChecksumInfo;
 
     TI_DbgPrint(DEBUG_DATALINK, ("Called.\n"));
 
@@ -358,6 +359,19 @@ VOID LanReceiveWorker( PVOID Context ) {
 
         /* Calculate packet size (excluding media header) */
         NdisQueryPacketLength(IPPacket.NdisPacket, &IPPacket.TotalSize);
+
+        /* Remember which checksums the miniport already validated */
+        if (Adapter->ChecksumOffload)
+        {
+            ChecksumInfo.Value = (ULONG)(ULONG_PTR)NDIS_PER_PACKET_INFO_FROM_PACKET(IPPacket.NdisPacket,
+                                                                                   TcpIpChecksumPacketInfo);
+            if (ChecksumInfo.Receive.NdisPacketIpChecksumSucceeded)
+                IPPacket.Flags |= IP_PACKET_FLAG_IP_CHECKSUM_OK;
+            if (ChecksumInfo.Receive.NdisPacketTcpChecksumSucceeded)
+                IPPacket.Flags |= IP_PACKET_FLAG_TCP_CHECKSUM_OK;
+            if (ChecksumInfo.Receive.NdisPacketUdpChecksumSucceeded)
+                IPPacket.Flags |= IP_PACKET_FLAG_UDP_CHECKSUM_OK;
+        }
     }
 
     TI_DbgPrint
@@ -1309,6 +1323,90 @@ VOID GetName( PUNICODE_STRING RegistryKey,
     AppendUnicodeString( OutName, &PartialRegistryKey, FALSE );
 }
 
+static VOID EnableChecksumOffload(
+    PLAN_ADAPTER Adapter)
+/*
+ * FUNCTION: Lets the miniport validate IPv4 receive checksums
+ * ARGUMENTS:
+ *     Adapter = Pointer to LAN_ADAPTER structure
+ * NOTES:
+ *     The task list the miniport reports is set back with only the
+ *     checksum task changed, so other tasks stay as they were. Failing
+ *     here is not fatal, the checksums are then verified in software
+ */
+{
+    ULONG Buffer[128];
+    PNDIS_TASK_OFFLOAD_HEADER Header = (PNDIS_TASK_OFFLOAD_HEADER)Buffer;
+    PNDIS_TASK_OFFLOAD Task;
+    PNDIS_TASK_TCP_IP_CHECKSUM Checksum = NULL;
+    ULONG Offset, Length;
+    NDIS_STATUS NdisStatus;
+
+    if (Adapter->Media != NdisMedium802_3)
+        return;
+
+    RtlZeroMemory(Buffer, sizeof(Buffer));
+    Header->Version = NDIS_TASK_OFFLOAD_VERSION;
+    Header->Size = sizeof(NDIS_TASK_OFFLOAD_HEADER);
+    Header->EncapsulationFormat.Encapsulation = IEEE_802_3_Encapsulation;
+    Header->EncapsulationFormat.Flags.FixedHeaderSize = 1;
+    Header->EncapsulationFormat.EncapsulationHeaderSize = Adapter->HeaderSize;
+
+    NdisStatus = NDISCall(Adapter,
+                          NdisRequestQueryInformation,
+                          OID_TCP_TASK_OFFLOAD,
+                          Buffer,
+                          sizeof(Buffer));
+    if (NdisStatus != NDIS_STATUS_SUCCESS || Header->OffsetFirstTask == 0) {
+        TI_DbgPrint(DEBUG_DATALINK, ("No task offload (0x%X).\n", NdisStatus));
+        return;
+    }
+
+    /* Walk the task list, remembering where it ends */
+    Offset = Header->OffsetFirstTask;
+    Length = Offset;
+    while (Offset + FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer) <= sizeof(Buffer)) {
+        Task = (PNDIS_TASK_OFFLOAD)((PUCHAR)Buffer + Offset);
+        if (Offset + FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer) + Task->TaskBufferLength > sizeof(Buffer))
+            break;
+
+        Length = Offset + FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer) + Task->TaskBufferLength;
+
+        if (Task->Task == TcpIpChecksumNdisTask &&
+            Task->TaskBufferLength >= sizeof(NDIS_TASK_TCP_IP_CHECKSUM))
+            Checksum = (PNDIS_TASK_TCP_IP_CHECKSUM)Task->TaskBuffer;
+
+        if (Task->OffsetNextTask == 0)
+            break;
+        Offset += Task->OffsetNextTask;
+    }
+
+    if (!Checksum ||
+        !(Checksum->V4Receive.IpChecksum ||
+          Checksum->V4Receive.TcpChecksum ||
+          Checksum->V4Receive.UdpChecksum)) {
+        TI_DbgPrint(DEBUG_DATALINK, ("No receive checksum offload.\n"));
+        return;
+    }
+
+    /* We still compute transmit checksums, so only ask for receive */
+    RtlZeroMemory(&Checksum->V4Transmit, sizeof(Checksum->V4Transmit));
+    RtlZeroMemory(&Checksum->V6Transmit, sizeof(Checksum->V6Transmit));
+    RtlZeroMemory(&Checksum->V6Receive, sizeof(Checksum->V6Receive));
+
+    NdisStatus = NDISCall(Adapter,
+                          NdisRequestSetInformation,
+                          OID_TCP_TASK_OFFLOAD,
+                          Buffer,
+                          Length);
+    if (NdisStatus != NDIS_STATUS_SUCCESS) {
+        TI_DbgPrint(MIN_TRACE, ("Could not enable checksum offload (0x%X).\n", NdisStatus));
+        return;
+    }
+
+    Adapter->ChecksumOffload = TRUE;
+}
+
 BOOLEAN BindAdapter(
     PLAN_ADAPTER Adapter,
     PNDIS_STRING RegistryPath)
@@ -1410,6 +1508,9 @@ BOOLEAN BindAdapter(
     if (NdisStatus != NDIS_STATUS_SUCCESS)
         return FALSE;
 
+    /* Skip software checksums the miniport can validate for us */
+    EnableChecksumOffload(Adapter);
+
     /* Register interface with IP layer */
     IPRegisterInterface(IF);
 
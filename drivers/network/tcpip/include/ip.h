@@ -91,6 +91,10 @@ typedef struct _IP_PACKET {
 } IP_PACKET, *PIP_PACKET;
 
 #define IP_PACKET_FLAG_RAW      0x01    /* Raw IP packet */
+#define IP_PACKET_FLAG_IP_CHECKSUM_OK   0x02    /* Miniport validated the IP header checksum */
+#define IP_PACKET_FLAG_TCP_CHECKSUM_OK  0x04    /* Miniport validated the TCP checksum */
+#define IP_PACKET_FLAG_UDP_CHECKSUM_OK  0x08    /* Miniport validated the UDP checksum */
+#define IP_PACKET_FLAG_CHECKSUM_OK      0x0E
 
 
 /* Packet context */
@@ -59,6 +59,7 @@ typedef struct LAN_ADAPTER {
     UINT MacOptions;                        /* MAC options for NIC driver/adapter */
     UINT Speed;                             /* Link speed */
     UINT PacketFilter;                      /* Packet filter for this adapter */
+    BOOLEAN ChecksumOffload;                /* Miniport validates IPv4 receive checksums */
 } LAN_ADAPTER, *PLAN_ADAPTER;
 
 /* LAN adapter state constants */
@@ -0,0 +1,514 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Tests and timings for EventWrite and private trace sessions
+ */
+
+#include "precomp.h"
+
+#include <wmistr.h>
+#include <evntcons.h>
+#include <tdh.h>
+
+#define TEST_SESSION_NAME   L"EventWriteApitest"
+#define TEST_EVENT_COUNT    100000
+
+/* 8 KB buffers hold 29 records of 280 bytes behind their 72 byte header */
+#define EXACT_BUFFER_SIZE   8
+#define EXACT_PAYLOAD_SIZE  (280 - sizeof(EVENT_HEADER))
+#define EXACT_EVENT_COUNT   (29 + 5)
+
+#define TEST_STRING         L"EventWriteString test"
+
+static const GUID TestProviderId = { 0x5d8a5a8e, 0x1b7c, 0x4e55, { 0x9f, 0x3d, 0x7a, 0x61, 0x2c, 0x4e, 0x90, 0x13 } };
+
+static ULONG (WINAPI *pEventRegister)(LPCGUID, PENABLECALLBACK, PVOID, PREGHANDLE);
+static ULONG (WINAPI *pEventUnregister)(REGHANDLE);
+static ULONG (WINAPI *pEventWrite)(REGHANDLE, PCEVENT_DESCRIPTOR, ULONG, PEVENT_DATA_DESCRIPTOR);
+static ULONG (WINAPI *pEnableTraceEx2)(TRACEHANDLE, LPCGUID, ULONG, UCHAR, ULONGLONG, ULONGLONG, ULONG, PENABLE_TRACE_PARAMETERS);
+static ULONG (WINAPI *pStartTraceW)(PTRACEHANDLE, LPCWSTR, PEVENT_TRACE_PROPERTIES);
+static ULONG (WINAPI *pControlTraceW)(TRACEHANDLE, LPCWSTR, PEVENT_TRACE_PROPERTIES, ULONG);
+static TRACEHANDLE (WINAPI *pOpenTraceW)(PEVENT_TRACE_LOGFILEW);
+static ULONG (WINAPI *pProcessTrace)(PTRACEHANDLE, ULONG, LPFILETIME, LPFILETIME);
+static ULONG (WINAPI *pCloseTrace)(TRACEHANDLE);
+static ULONG (WINAPI *pEventWriteString)(REGHANDLE, UCHAR, ULONGLONG, PCWSTR);
+static ULONG (WINAPI *pTdhGetEventInformation)(PEVENT_RECORD, ULONG, PTDH_CONTEXT, PTRACE_EVENT_INFO, PULONG);
+static ULONG (WINAPI *pTdhGetPropertySize)(PEVENT_RECORD, ULONG, PTDH_CONTEXT, ULONG, PPROPERTY_DATA_DESCRIPTOR, PULONG);
+static ULONG (WINAPI *pTdhGetProperty)(PEVENT_RECORD, ULONG, PTDH_CONTEXT, ULONG, PPROPERTY_DATA_DESCRIPTOR, ULONG, PBYTE);
+
+static LONG EnableCount;
+static LONG DisableCount;
+static ULONG EventsRead;
+static ULONG LastPayload;
+static BOOL PayloadsOrdered;
+static USHORT PayloadSize = sizeof(ULONG);
+static ULONG StringEventsRead;
+static ULONG BinaryEventsRead;
+
+static
+VOID
+NTAPI
+EnableCallback(
+    LPCGUID SourceId,
+    ULONG IsEnabled,
+    UCHAR Level,
+    ULONGLONG MatchAnyKeyword,
+    ULONGLONG MatchAllKeyword,
+    PEVENT_FILTER_DESCRIPTOR FilterData,
+    PVOID CallbackContext)
+{
+    ok(IsEqualGUID(SourceId, &TestProviderId), "Unexpected provider\n");
+    ok(CallbackContext == &EnableCount, "Unexpected context %p\n", CallbackContext);
+
+    if (IsEnabled)
+        EnableCount++;
+    else
+        DisableCount++;
+}
+
+static
+VOID
+WINAPI
+EventRecordCallback(
+    PEVENT_RECORD EventRecord)
+{
+    ULONG Payload;
+
+    if (!IsEqualGUID(&EventRecord->EventHeader.ProviderId, &TestProviderId))
+        return;
+
+    ok(EventRecord->UserDataLength == PayloadSize, "UserDataLength = %u\n", EventRecord->UserDataLength);
+    if (EventRecord->UserDataLength != PayloadSize)
+        return;
+
+    Payload = *(ULONG *)EventRecord->UserData;
+    if (EventsRead && Payload <= LastPayload)
+        PayloadsOrdered = FALSE;
+
+    LastPayload = Payload;
+    EventsRead++;
+}
+
+/* Without a manifest tdh only knows the events written with EventWriteString,
+ * their payload is a single property called "String" */
+static
+VOID
+WINAPI
+StringEventCallback(
+    PEVENT_RECORD EventRecord)
+{
+    PROPERTY_DATA_DESCRIPTOR Descriptor;
+    PTRACE_EVENT_INFO Info;
+    PEVENT_PROPERTY_INFO Property;
+    WCHAR String[64];
+    ULONG Size, Error;
+
+    if (!IsEqualGUID(&EventRecord->EventHeader.ProviderId, &TestProviderId))
+        return;
+
+    Size = 0;
+    Error = pTdhGetEventInformation(EventRecord, 0, NULL, NULL, &Size);
+
+    if (!(EventRecord->EventHeader.Flags & EVENT_HEADER_FLAG_STRING_ONLY))
+    {
+        ok(Error == ERROR_NOT_FOUND, "TdhGetEventInformation returned %lu for a binary event\n", Error);
+        BinaryEventsRead++;
+        return;
+    }
+
+    ok(Error == ERROR_INSUFFICIENT_BUFFER, "TdhGetEventInformation returned %lu\n", Error);
+    ok(Size > sizeof(TRACE_EVENT_INFO), "Size = %lu\n", Size);
+    if (Error != ERROR_INSUFFICIENT_BUFFER)
+        return;
+
+    Info = HeapAlloc(GetProcessHeap(), 0, Size);
+    if (!Info)
+        return;
+    Error = pTdhGetEventInformation(EventRecord, 0, NULL, Info, &Size);
+    ok(Error == ERROR_SUCCESS, "TdhGetEventInformation failed: %lu\n", Error);
+    if (Error == ERROR_SUCCESS)
+    {
+        ok(IsEqualGUID(&Info->ProviderGuid, &TestProviderId), "Unexpected provider\n");
+        ok(Info->EventDescriptor.Level == TRACE_LEVEL_WARNING, "Level = %u\n", Info->EventDescriptor.Level);
+        ok(Info->PropertyCount == 1, "PropertyCount = %lu\n", Info->PropertyCount);
+        ok(Info->TopLevelPropertyCount == 1, "TopLevelPropertyCount = %lu\n", Info->TopLevelPropertyCount);
+
+        Property = &Info->EventPropertyInfoArray[0];
+        ok(Property->nonStructType.InType == TDH_INTYPE_UNICODESTRING, "InType = %u\n", Property->nonStructType.InType);
+        ok(Property->NameOffset && !wcscmp((PWSTR)((PUCHAR)Info + Property->NameOffset), L"String"),
+           "Unexpected property name\n");
+    }
+    HeapFree(GetProcessHeap(), 0, Info);
+
+    Descriptor.PropertyName = (ULONGLONG)(ULONG_PTR)L"String";
+    Descriptor.ArrayIndex = ULONG_MAX;
+    Descriptor.Reserved = 0;
+
+    Size = 0;
+    Error = pTdhGetPropertySize(EventRecord, 0, NULL, 1, &Descriptor, &Size);
+    ok(Error == ERROR_SUCCESS, "TdhGetPropertySize failed: %lu\n", Error);
+    ok(Size == sizeof(TEST_STRING), "Size = %lu\n", Size);
+
+    Error = pTdhGetProperty(EventRecord, 0, NULL, 1, &Descriptor, 1, (PBYTE)String);
+    ok(Error == ERROR_INSUFFICIENT_BUFFER, "TdhGetProperty with a short buffer returned %lu\n", Error);
+
+    ZeroMemory(String, sizeof(String));
+    Error = pTdhGetProperty(EventRecord, 0, NULL, 1, &Descriptor, sizeof(String), (PBYTE)String);
+    ok(Error == ERROR_SUCCESS, "TdhGetProperty failed: %lu\n", Error);
+    ok(!wcscmp(String, TEST_STRING), "String = %S\n", String);
+
+    /* Only the string property exists */
+    Descriptor.PropertyName = (ULONGLONG)(ULONG_PTR)L"Data";
+    Error = pTdhGetPropertySize(EventRecord, 0, NULL, 1, &Descriptor, &Size);
+    ok(Error == ERROR_NOT_FOUND, "TdhGetPropertySize returned %lu for an unknown property\n", Error);
+
+    StringEventsRead++;
+}
+
+static
+double
+WriteEvents(
+    REGHANDLE RegHandle,
+    PCEVENT_DESCRIPTOR Descriptor,
+    ULONG Count)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    EVENT_DATA_DESCRIPTOR Data;
+    ULONG i;
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    for (i = 0; i < Count; i++)
+    {
+        EventDataDescCreate(&Data, &i, sizeof(i));
+        pEventWrite(RegHandle, Descriptor, 1, &Data);
+    }
+
+    QueryPerformanceCounter(&End);
+
+    return (double)(End.QuadPart - Start.QuadPart) * 1e9 / Frequency.QuadPart / Count;
+}
+
+static
+PEVENT_TRACE_PROPERTIES
+AllocateProperties(
+    PCWSTR LogFileName,
+    ULONG BufferSize,
+    ULONG MinimumBuffers)
+{
+    PEVENT_TRACE_PROPERTIES Properties;
+    ULONG PropertiesSize;
+
+    PropertiesSize = sizeof(*Properties) + 2 * MAX_PATH * sizeof(WCHAR);
+    Properties = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, PropertiesSize);
+    if (!Properties)
+        return NULL;
+
+    Properties->Wnode.BufferSize = PropertiesSize;
+    Properties->Wnode.Flags = WNODE_FLAG_TRACED_GUID;
+    Properties->Wnode.ClientContext = 1;
+    Properties->BufferSize = BufferSize;
+    Properties->MinimumBuffers = MinimumBuffers;
+    Properties->LogFileMode = EVENT_TRACE_FILE_MODE_SEQUENTIAL;
+    Properties->LoggerNameOffset = sizeof(*Properties);
+    Properties->LogFileNameOffset = sizeof(*Properties) + MAX_PATH * sizeof(WCHAR);
+    StringCbCopyW((PWCHAR)((PUCHAR)Properties + Properties->LogFileNameOffset), MAX_PATH * sizeof(WCHAR), LogFileName);
+
+    return Properties;
+}
+
+static
+BOOL
+ReadEvents(
+    PWSTR LogFileName)
+{
+    EVENT_TRACE_LOGFILEW Logfile;
+    TRACEHANDLE TraceHandle;
+    ULONG Error;
+
+    ZeroMemory(&Logfile, sizeof(Logfile));
+    Logfile.LogFileName = LogFileName;
+    Logfile.ProcessTraceMode = PROCESS_TRACE_MODE_EVENT_RECORD;
+    Logfile.EventRecordCallback = EventRecordCallback;
+
+    TraceHandle = pOpenTraceW(&Logfile);
+    ok(TraceHandle != INVALID_PROCESSTRACE_HANDLE, "OpenTraceW failed: %lu\n", GetLastError());
+    if (TraceHandle == INVALID_PROCESSTRACE_HANDLE)
+        return FALSE;
+
+    EventsRead = 0;
+    PayloadsOrdered = TRUE;
+    Error = pProcessTrace(&TraceHandle, 1, NULL, NULL);
+    ok(Error == ERROR_SUCCESS, "ProcessTrace failed: %lu\n", Error);
+
+    pCloseTrace(TraceHandle);
+    return Error == ERROR_SUCCESS;
+}
+
+/* Records that fill their buffer to the last byte must close it, or the
+ * events written after them have nowhere to go */
+static
+VOID
+TestExactFit(
+    REGHANDLE RegHandle,
+    PCEVENT_DESCRIPTOR Descriptor,
+    PCWSTR TempPath)
+{
+    WCHAR LogFileName[MAX_PATH];
+    PEVENT_TRACE_PROPERTIES Properties;
+    EVENT_DATA_DESCRIPTOR Data;
+    TRACEHANDLE SessionHandle;
+    ULONG Payload[EXACT_PAYLOAD_SIZE / sizeof(ULONG)];
+    ULONG i, Error;
+
+    StringCchPrintfW(LogFileName, ARRAYSIZE(LogFileName), L"%sEventWriteExact.etl", TempPath);
+
+    /* Each ring has at least two buffers, the events after the first full
+     * buffer all fit into the second one */
+    Properties = AllocateProperties(LogFileName, EXACT_BUFFER_SIZE, 2);
+    if (!Properties)
+        return;
+
+    Error = pStartTraceW(&SessionHandle, TEST_SESSION_NAME, Properties);
+    ok(Error == ERROR_SUCCESS, "StartTraceW failed: %lu\n", Error);
+    if (Error != ERROR_SUCCESS)
+    {
+        HeapFree(GetProcessHeap(), 0, Properties);
+        return;
+    }
+
+    Error = pEnableTraceEx2(SessionHandle, &TestProviderId, EVENT_CONTROL_CODE_ENABLE_PROVIDER,
+                            TRACE_LEVEL_VERBOSE, 0, 0, 0, NULL);
+    ok(Error == ERROR_SUCCESS, "EnableTraceEx2 failed: %lu\n", Error);
+
+    ZeroMemory(Payload, sizeof(Payload));
+    for (i = 0; i < EXACT_EVENT_COUNT; i++)
+    {
+        Payload[0] = i;
+        EventDataDescCreate(&Data, Payload, sizeof(Payload));
+        Error = pEventWrite(RegHandle, Descriptor, 1, &Data);
+        ok(Error == ERROR_SUCCESS, "EventWrite %lu failed: %lu\n", i, Error);
+    }
+
+    Error = pControlTraceW(SessionHandle, NULL, Properties, EVENT_TRACE_CONTROL_STOP);
+    ok(Error == ERROR_SUCCESS, "Stopping the session failed: %lu\n", Error);
+    ok(Properties->EventsLost == 0, "%lu events lost\n", Properties->EventsLost);
+
+    PayloadSize = (USHORT)sizeof(Payload);
+    if (ReadEvents(LogFileName))
+    {
+        ok(EventsRead == EXACT_EVENT_COUNT, "Read %lu events\n", EventsRead);
+        ok(PayloadsOrdered, "Events came back out of order\n");
+    }
+    PayloadSize = sizeof(ULONG);
+
+    DeleteFileW(LogFileName);
+    HeapFree(GetProcessHeap(), 0, Properties);
+}
+
+/* A string event and a binary one go through a session and are decoded with tdh */
+static
+VOID
+TestStringEvent(
+    REGHANDLE RegHandle,
+    PCEVENT_DESCRIPTOR Descriptor,
+    PCWSTR TempPath)
+{
+    WCHAR LogFileName[MAX_PATH];
+    PEVENT_TRACE_PROPERTIES Properties;
+    EVENT_TRACE_LOGFILEW Logfile;
+    EVENT_DATA_DESCRIPTOR Data;
+    TRACEHANDLE SessionHandle, TraceHandle;
+    ULONG Payload = 0, Error;
+    HMODULE Tdh;
+
+    Tdh = LoadLibraryW(L"tdh.dll");
+    pTdhGetEventInformation = (PVOID)GetProcAddress(Tdh, "TdhGetEventInformation");
+    pTdhGetPropertySize = (PVOID)GetProcAddress(Tdh, "TdhGetPropertySize");
+    pTdhGetProperty = (PVOID)GetProcAddress(Tdh, "TdhGetProperty");
+    if (!pEventWriteString || !pTdhGetEventInformation || !pTdhGetPropertySize || !pTdhGetProperty)
+    {
+        skip("EventWriteString or tdh is not available\n");
+        if (Tdh)
+            FreeLibrary(Tdh);
+        return;
+    }
+
+    StringCchPrintfW(LogFileName, ARRAYSIZE(LogFileName), L"%sEventWriteString.etl", TempPath);
+
+    Properties = AllocateProperties(LogFileName, 8, 2);
+    if (!Properties)
+    {
+        FreeLibrary(Tdh);
+        return;
+    }
+
+    Error = pStartTraceW(&SessionHandle, TEST_SESSION_NAME, Properties);
+    ok(Error == ERROR_SUCCESS, "StartTraceW failed: %lu\n", Error);
+    if (Error != ERROR_SUCCESS)
+        goto Cleanup;
+
+    Error = pEnableTraceEx2(SessionHandle, &TestProviderId, EVENT_CONTROL_CODE_ENABLE_PROVIDER,
+                            TRACE_LEVEL_VERBOSE, 0, 0, 0, NULL);
+    ok(Error == ERROR_SUCCESS, "EnableTraceEx2 failed: %lu\n", Error);
+
+    Error = pEventWriteString(RegHandle, TRACE_LEVEL_WARNING, 0, TEST_STRING);
+    ok(Error == ERROR_SUCCESS, "EventWriteString failed: %lu\n", Error);
+    EventDataDescCreate(&Data, &Payload, sizeof(Payload));
+    Error = pEventWrite(RegHandle, Descriptor, 1, &Data);
+    ok(Error == ERROR_SUCCESS, "EventWrite failed: %lu\n", Error);
+
+    Error = pControlTraceW(SessionHandle, NULL, Properties, EVENT_TRACE_CONTROL_STOP);
+    ok(Error == ERROR_SUCCESS, "Stopping the session failed: %lu\n", Error);
+
+    ZeroMemory(&Logfile, sizeof(Logfile));
+    Logfile.LogFileName = LogFileName;
+    Logfile.ProcessTraceMode = PROCESS_TRACE_MODE_EVENT_RECORD;
+    Logfile.EventRecordCallback = StringEventCallback;
+
+    TraceHandle = pOpenTraceW(&Logfile);
+    ok(TraceHandle != INVALID_PROCESSTRACE_HANDLE, "OpenTraceW failed: %lu\n", GetLastError());
+    if (TraceHandle != INVALID_PROCESSTRACE_HANDLE)
+    {
+        Error = pProcessTrace(&TraceHandle, 1, NULL, NULL);
+        ok(Error == ERROR_SUCCESS, "ProcessTrace failed: %lu\n", Error);
+        ok(StringEventsRead == 1, "Decoded %lu string events\n", StringEventsRead);
+        ok(BinaryEventsRead == 1, "Read %lu binary events\n", BinaryEventsRead);
+        pCloseTrace(TraceHandle);
+    }
+
+    DeleteFileW(LogFileName);
+
+Cleanup:
+    HeapFree(GetProcessHeap(), 0, Properties);
+    FreeLibrary(Tdh);
+}
+
+static
+BOOL
+InitFunctionPointers(VOID)
+{
+    HMODULE Advapi, Sechost;
+
+    Advapi = GetModuleHandleW(L"advapi32.dll");
+    pEventRegister = (PVOID)GetProcAddress(Advapi, "EventRegister");
+    if (!pEventRegister)
+    {
+        Advapi = LoadLibraryW(L"advapiex.dll");
+        if (!Advapi)
+            return FALSE;
+        pEventRegister = (PVOID)GetProcAddress(Advapi, "EventRegister");
+    }
+    pEventUnregister = (PVOID)GetProcAddress(Advapi, "EventUnregister");
+    pEventWrite = (PVOID)GetProcAddress(Advapi, "EventWrite");
+    pEnableTraceEx2 = (PVOID)GetProcAddress(Advapi, "EnableTraceEx2");
+    pEventWriteString = (PVOID)GetProcAddress(Advapi, "EventWriteString");
+
+    Sechost = LoadLibraryW(L"sechost.dll");
+    if (!Sechost)
+        return FALSE;
+    pStartTraceW = (PVOID)GetProcAddress(Sechost, "StartTraceW");
+    pControlTraceW = (PVOID)GetProcAddress(Sechost, "ControlTraceW");
+    pOpenTraceW = (PVOID)GetProcAddress(Sechost, "OpenTraceW");
+    pProcessTrace = (PVOID)GetProcAddress(Sechost, "ProcessTrace");
+    pCloseTrace = (PVOID)GetProcAddress(Sechost, "CloseTrace");
+
+    return pEventRegister && pEventUnregister && pEventWrite && pEnableTraceEx2 &&
+           pStartTraceW && pControlTraceW && pOpenTraceW && pProcessTrace && pCloseTrace;
+}
+
+START_TEST(EventWrite)
+{
+    EVENT_DESCRIPTOR Descriptor = { 1, 0, 0, TRACE_LEVEL_INFORMATION, 0, 0, 0x1 };
+    WCHAR LogFileName[MAX_PATH], TempPath[MAX_PATH];
+    PEVENT_TRACE_PROPERTIES Properties;
+    EVENT_TRACE_LOGFILEW Logfile;
+    TRACEHANDLE SessionHandle, TraceHandle;
+    REGHANDLE RegHandle;
+    ULONG EventsLost, Error;
+    double Disabled, Enabled;
+
+    if (!InitFunctionPointers())
+    {
+        skip("Event tracing functions are not available\n");
+        return;
+    }
+
+    GetTempPathW(ARRAYSIZE(TempPath), TempPath);
+    StringCchPrintfW(LogFileName, ARRAYSIZE(LogFileName), L"%sEventWrite.etl", TempPath);
+
+    Error = pEventRegister(&TestProviderId, EnableCallback, &EnableCount, &RegHandle);
+    ok(Error == ERROR_SUCCESS, "EventRegister failed: %lu\n", Error);
+    if (Error != ERROR_SUCCESS)
+        return;
+
+    /* Nobody listens yet, a write only tests the enable mask */
+    Disabled = WriteEvents(RegHandle, &Descriptor, TEST_EVENT_COUNT);
+    trace("EventWrite with the provider disabled: %.1f ns/event\n", Disabled);
+
+    Properties = AllocateProperties(LogFileName, 256, 1024);
+    if (!Properties)
+    {
+        pEventUnregister(RegHandle);
+        return;
+    }
+
+    Error = pStartTraceW(&SessionHandle, TEST_SESSION_NAME, Properties);
+    ok(Error == ERROR_SUCCESS, "StartTraceW failed: %lu\n", Error);
+    if (Error != ERROR_SUCCESS)
+        goto Cleanup;
+
+    Error = pStartTraceW(&TraceHandle, TEST_SESSION_NAME, Properties);
+    ok(Error == ERROR_ALREADY_EXISTS, "Second StartTraceW returned %lu\n", Error);
+
+    Error = pEnableTraceEx2(SessionHandle, &TestProviderId, EVENT_CONTROL_CODE_ENABLE_PROVIDER,
+                            TRACE_LEVEL_VERBOSE, 0, 0, 0, NULL);
+    ok(Error == ERROR_SUCCESS, "EnableTraceEx2 failed: %lu\n", Error);
+    ok(EnableCount == 1, "EnableCount = %ld\n", EnableCount);
+
+    Enabled = WriteEvents(RegHandle, &Descriptor, TEST_EVENT_COUNT);
+    trace("EventWrite with the provider enabled: %.1f ns/event\n", Enabled);
+
+    Error = pControlTraceW(SessionHandle, NULL, Properties, EVENT_TRACE_CONTROL_STOP);
+    ok(Error == ERROR_SUCCESS, "Stopping the session failed: %lu\n", Error);
+    ok(DisableCount == 1, "DisableCount = %ld\n", DisableCount);
+    EventsLost = Properties->EventsLost;
+    trace("%lu buffers written, %lu events lost\n", Properties->BuffersWritten, EventsLost);
+
+    Error = pControlTraceW(SessionHandle, NULL, Properties, EVENT_TRACE_CONTROL_QUERY);
+    ok(Error == ERROR_WMI_INSTANCE_NOT_FOUND, "Query after stop returned %lu\n", Error);
+
+    /* Read the file back, every event that was not counted lost must be there */
+    ZeroMemory(&Logfile, sizeof(Logfile));
+    Logfile.LogFileName = LogFileName;
+    Logfile.ProcessTraceMode = PROCESS_TRACE_MODE_EVENT_RECORD;
+    Logfile.EventRecordCallback = EventRecordCallback;
+
+    TraceHandle = pOpenTraceW(&Logfile);
+    ok(TraceHandle != INVALID_PROCESSTRACE_HANDLE, "OpenTraceW failed: %lu\n", GetLastError());
+    if (TraceHandle != INVALID_PROCESSTRACE_HANDLE)
+    {
+        ok(Logfile.LogfileHeader.BufferSize == 256 * 1024, "BufferSize = %lu\n", Logfile.LogfileHeader.BufferSize);
+        ok(Logfile.LogfileHeader.LoggerName && !wcscmp(Logfile.LogfileHeader.LoggerName, TEST_SESSION_NAME),
+           "Unexpected logger name\n");
+
+        PayloadsOrdered = TRUE;
+        Error = pProcessTrace(&TraceHandle, 1, NULL, NULL);
+        ok(Error == ERROR_SUCCESS, "ProcessTrace failed: %lu\n", Error);
+        ok(EventsRead + EventsLost == TEST_EVENT_COUNT, "Read %lu events, %lu lost\n", EventsRead, EventsLost);
+        ok(PayloadsOrdered, "Events came back out of order\n");
+
+        Error = pCloseTrace(TraceHandle);
+        ok(Error == ERROR_SUCCESS, "CloseTrace failed: %lu\n", Error);
+    }
+
+    DeleteFileW(LogFileName);
+
+    TestExactFit(RegHandle, &Descriptor, TempPath);
+    TestStringEvent(RegHandle, &Descriptor, TempPath);
+
+Cleanup:
+    HeapFree(GetProcessHeap(), 0, Properties);
+    pEventUnregister(RegHandle);
+}
@@ -6,6 +6,7 @@
 extern void func_CreateService(void);
 extern void func_DuplicateTokenEx(void);
 extern void func_eventlog(void);
+extern void func_EventWrite(void);
 extern void func_HKEY_CLASSES_ROOT(void);
 extern void func_IsTextUnicode(void);
 extern void func_LockServiceDatabase(void);
@@ -26,6 +27,7 @@ const struct test winetest_testlist[] =
     { "CreateService", func_CreateService },
     { "DuplicateTokenEx", func_DuplicateTokenEx },
     { "eventlog_supp", func_eventlog },
+    { "EventWrite", func_EventWrite },
     { "HKEY_CLASSES_ROOT", func_HKEY_CLASSES_ROOT },
     { "IsTextUnicode" , func_IsTextUnicode },
     { "LockServiceDatabase" , func_LockServiceDatabase },
@@ -506,3 +506,52 @@ AfdGetInformation(
 
     return Status;
 }
+
+BOOL
+ConnectLoopback(
+    SOCKET *Client,
+    SOCKET *Server)
+{
+    struct sockaddr_in Address;
+    int AddressLength = sizeof(Address);
+    SOCKET Listener;
+
+    *Client = *Server = INVALID_SOCKET;
+
+    Listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    ok(Listener != INVALID_SOCKET, "socket failed with %d\n", WSAGetLastError());
+    if (Listener == INVALID_SOCKET)
+        return FALSE;
+
+    ZeroMemory(&Address, sizeof(Address));
+    Address.sin_family = AF_INET;
+    Address.sin_addr.s_addr = inet_addr("127.0.0.1");
+    Address.sin_port = htons(0);
+
+    if (bind(Listener, (struct sockaddr *)&Address, sizeof(Address)) ||
+        getsockname(Listener, (struct sockaddr *)&Address, &AddressLength) ||
+        listen(Listener, 1))
+    {
+        ok(0, "Listening on loopback failed with %d\n", WSAGetLastError());
+        closesocket(Listener);
+        return FALSE;
+    }
+
+    *Client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (*Client != INVALID_SOCKET &&
+        !connect(*Client, (struct sockaddr *)&Address, sizeof(Address)))
+    {
+        *Server = accept(Listener, NULL, NULL);
+    }
+    ok(*Server != INVALID_SOCKET, "Connecting on loopback failed with %d\n", WSAGetLastError());
+
+    closesocket(Listener);
+    if (*Server == INVALID_SOCKET)
+    {
+        if (*Client != INVALID_SOCKET)
+            closesocket(*Client);
+        return FALSE;
+    }
+
+    return TRUE;
+}
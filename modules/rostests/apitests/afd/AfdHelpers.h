@@ -56,3 +56,8 @@ AfdGetInformation(
     _In_opt_ PBOOLEAN Boolean,
     _In_opt_ PULONG Ulong,
     _In_opt_ PLARGE_INTEGER LargeInteger);
+
+BOOL
+ConnectLoopback(
+    _Out_ SOCKET *Client,
+    _Out_ SOCKET *Server);
@@ -0,0 +1,177 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1+ (https://spdx.org/licenses/LGPL-2.1+)
+ * PURPOSE:     Test for AFD poll groups
+ */
+
+#include "precomp.h"
+
+#define CONTEXT_CLIENT  0x1234
+
+/* The wait takes its flags in and returns the events in the same buffer */
+typedef union _POLL_GROUP_WAIT_BUFFER
+{
+    AFD_POLL_GROUP_WAIT_INFO WaitInfo;
+    AFD_POLL_GROUP_EVENT Events[4];
+} POLL_GROUP_WAIT_BUFFER;
+
+static
+NTSTATUS
+CreatePollGroup(
+    PHANDLE GroupHandle)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatus;
+    UNICODE_STRING DeviceName = RTL_CONSTANT_STRING(L"\\Device\\Afd\\PollGroup");
+
+    /* An AFD handle without a transport */
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &DeviceName,
+                               OBJ_CASE_INSENSITIVE,
+                               0,
+                               0);
+
+    return NtCreateFile(GroupHandle,
+                        GENERIC_READ | GENERIC_WRITE | SYNCHRONIZE,
+                        &ObjectAttributes,
+                        &IoStatus,
+                        NULL,
+                        0,
+                        FILE_SHARE_READ | FILE_SHARE_WRITE,
+                        FILE_OPEN_IF,
+                        0,
+                        NULL,
+                        0);
+}
+
+static
+NTSTATUS
+PollGroupControl(
+    HANDLE GroupHandle,
+    ULONG IoControlCode,
+    SOCKET Socket,
+    ULONG Events)
+{
+    AFD_POLL_GROUP_INFO GroupInfo;
+    IO_STATUS_BLOCK IoStatus;
+    NTSTATUS Status;
+    HANDLE Event;
+
+    Event = CreateEventW(NULL, FALSE, FALSE, NULL);
+    if (!Event)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    GroupInfo.Handle = Socket;
+    GroupInfo.Events = Events;
+    GroupInfo.Context = CONTEXT_CLIENT;
+
+    Status = NtDeviceIoControlFile(GroupHandle, Event, NULL, NULL, &IoStatus,
+                                   IoControlCode,
+                                   &GroupInfo, sizeof(GroupInfo),
+                                   NULL, 0);
+    if (Status == STATUS_PENDING)
+    {
+        WaitForSingleObject(Event, INFINITE);
+        Status = IoStatus.Status;
+    }
+
+    CloseHandle(Event);
+    return Status;
+}
+
+static
+NTSTATUS
+PollGroupWait(
+    HANDLE GroupHandle,
+    HANDLE Event,
+    ULONG AfdFlags,
+    POLL_GROUP_WAIT_BUFFER *Buffer,
+    PIO_STATUS_BLOCK IoStatus)
+{
+    Buffer->WaitInfo.AfdFlags = AfdFlags;
+    return NtDeviceIoControlFile(GroupHandle, Event, NULL, NULL, IoStatus,
+                                 IOCTL_AFD_POLL_GROUP_WAIT,
+                                 Buffer, sizeof(Buffer->WaitInfo),
+                                 Buffer, sizeof(Buffer->Events));
+}
+
+START_TEST(pollgroup)
+{
+    WSADATA WsaData;
+    HANDLE GroupHandle, Event;
+    SOCKET Client, Server;
+    POLL_GROUP_WAIT_BUFFER Buffer;
+    IO_STATUS_BLOCK IoStatus;
+    NTSTATUS Status;
+    char Byte = 'x';
+
+    if (WSAStartup(MAKEWORD(2, 2), &WsaData))
+    {
+        skip("WSAStartup failed\n");
+        return;
+    }
+
+    Status = CreatePollGroup(&GroupHandle);
+    ok(Status == STATUS_SUCCESS, "Creating the poll group failed with 0x%lx\n", Status);
+    if (!NT_SUCCESS(Status))
+    {
+        WSACleanup();
+        return;
+    }
+
+    if (!ConnectLoopback(&Client, &Server))
+    {
+        NtClose(GroupHandle);
+        WSACleanup();
+        return;
+    }
+
+    Event = CreateEventW(NULL, FALSE, FALSE, NULL);
+
+    /* Nothing is waiting to be read yet */
+    Status = PollGroupControl(GroupHandle, IOCTL_AFD_POLL_GROUP_ADD, Client, AFD_EVENT_RECEIVE);
+    ok(Status == STATUS_SUCCESS, "Adding the socket failed with 0x%lx\n", Status);
+    Status = PollGroupWait(GroupHandle, Event, AFD_IMMEDIATE, &Buffer, &IoStatus);
+    ok(Status == STATUS_SUCCESS, "Immediate wait returned 0x%lx\n", Status);
+    ok(IoStatus.Information == 0, "Immediate wait returned %lu bytes\n", (ULONG)IoStatus.Information);
+
+    /* A wait pending before the data arrives is completed by it */
+    Status = PollGroupWait(GroupHandle, Event, 0, &Buffer, &IoStatus);
+    ok(Status == STATUS_PENDING, "Wait returned 0x%lx\n", Status);
+    ok(send(Server, &Byte, 1, 0) == 1, "send failed with %d\n", WSAGetLastError());
+    if (Status == STATUS_PENDING)
+    {
+        ok(WaitForSingleObject(Event, 10000) == WAIT_OBJECT_0, "Wait did not complete\n");
+        Status = IoStatus.Status;
+    }
+    ok(Status == STATUS_SUCCESS, "Wait completed with 0x%lx\n", Status);
+    ok(IoStatus.Information == sizeof(Buffer.Events[0]), "Wait returned %lu bytes\n", (ULONG)IoStatus.Information);
+    ok(Buffer.Events[0].Context == CONTEXT_CLIENT, "Context is 0x%lx\n", (ULONG)Buffer.Events[0].Context);
+    ok(Buffer.Events[0].Events & AFD_EVENT_RECEIVE, "Events are 0x%lx\n", Buffer.Events[0].Events);
+
+    /* Reported sockets are only queued again by their next state change */
+    Status = PollGroupWait(GroupHandle, Event, AFD_IMMEDIATE, &Buffer, &IoStatus);
+    ok(Status == STATUS_SUCCESS, "Immediate wait returned 0x%lx\n", Status);
+    ok(IoStatus.Information == 0, "Immediate wait returned %lu bytes\n", (ULONG)IoStatus.Information);
+
+    Status = PollGroupControl(GroupHandle, IOCTL_AFD_POLL_GROUP_REMOVE, Client, 0);
+    ok(Status == STATUS_SUCCESS, "Removing the socket failed with 0x%lx\n", Status);
+    Status = PollGroupControl(GroupHandle, IOCTL_AFD_POLL_GROUP_REMOVE, Client, 0);
+    ok(Status == STATUS_NOT_FOUND, "Removing the socket again returned 0x%lx\n", Status);
+
+    /* A wait on an empty group only ends when it is cancelled */
+    Status = PollGroupWait(GroupHandle, Event, 0, &Buffer, &IoStatus);
+    ok(Status == STATUS_PENDING, "Wait returned 0x%lx\n", Status);
+    if (Status == STATUS_PENDING)
+    {
+        ok(CancelIo(GroupHandle), "CancelIo failed with %lu\n", GetLastError());
+        ok(WaitForSingleObject(Event, 10000) == WAIT_OBJECT_0, "Wait was not cancelled\n");
+        ok(IoStatus.Status == STATUS_CANCELLED, "Cancelled wait completed with 0x%lx\n", IoStatus.Status);
+    }
+
+    CloseHandle(Event);
+    closesocket(Client);
+    closesocket(Server);
+    NtClose(GroupHandle);
+    WSACleanup();
+}
@@ -0,0 +1,168 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1+ (https://spdx.org/licenses/LGPL-2.1+)
+ * PURPOSE:     Test and loopback throughput for receiving on stream sockets
+ */
+
+#include "precomp.h"
+
+#define TEST_BYTES          (16 * 1024 * 1024)
+#define SEND_CHUNK          (64 * 1024)
+#define PATTERN_PERIOD      251
+
+static UCHAR Pattern[SEND_CHUNK + PATTERN_PERIOD];
+
+static
+DWORD
+WINAPI
+SendThread(
+    LPVOID Parameter)
+{
+    SOCKET Socket = (SOCKET)Parameter;
+    ULONG Sent, Length;
+
+    /* Every byte is its stream offset modulo the period */
+    for (Sent = 0; Sent < TEST_BYTES; Sent += Length)
+    {
+        Length = min(SEND_CHUNK, TEST_BYTES - Sent);
+        if (send(Socket, (char *)Pattern + Sent % PATTERN_PERIOD, Length, 0) != (int)Length)
+            break;
+    }
+
+    shutdown(Socket, SD_SEND);
+    return Sent == TEST_BYTES ? 0 : 1;
+}
+
+static
+void
+TestThroughput(
+    ULONG RecvSize)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    SOCKET Client, Server;
+    HANDLE Thread;
+    PUCHAR Buffer;
+    ULONG Received = 0, Mismatches = 0;
+    DWORD ExitCode;
+    int Ret;
+
+    if (!ConnectLoopback(&Client, &Server))
+        return;
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, RecvSize);
+    ok(Buffer != NULL, "Out of memory\n");
+    if (!Buffer)
+        goto Cleanup;
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    Thread = CreateThread(NULL, 0, SendThread, (LPVOID)Server, 0, NULL);
+    ok(Thread != NULL, "CreateThread failed with %lu\n", GetLastError());
+    if (!Thread)
+    {
+        HeapFree(GetProcessHeap(), 0, Buffer);
+        goto Cleanup;
+    }
+
+    while ((Ret = recv(Client, (char *)Buffer, RecvSize, 0)) > 0)
+    {
+        if (Received + Ret > TEST_BYTES ||
+            memcmp(Buffer, Pattern + Received % PATTERN_PERIOD, Ret))
+        {
+            Mismatches++;
+        }
+        Received += Ret;
+    }
+
+    QueryPerformanceCounter(&End);
+
+    ok(Ret == 0, "recv failed with %d\n", WSAGetLastError());
+    ok(Received == TEST_BYTES, "Received %lu bytes\n", Received);
+    ok(Mismatches == 0, "%lu receives returned unexpected data\n", Mismatches);
+
+    WaitForSingleObject(Thread, INFINITE);
+    GetExitCodeThread(Thread, &ExitCode);
+    ok(ExitCode == 0, "Sending failed\n");
+    CloseHandle(Thread);
+
+    trace("recv of %lu bytes: %.1f MB/s\n", RecvSize,
+          (double)Received / (1024 * 1024) * Frequency.QuadPart / (End.QuadPart - Start.QuadPart));
+
+    HeapFree(GetProcessHeap(), 0, Buffer);
+
+Cleanup:
+    closesocket(Client);
+    closesocket(Server);
+}
+
+static
+void
+TestCancel(void)
+{
+    SOCKET Client, Server;
+    WSAOVERLAPPED Overlapped;
+    WSABUF WsaBuf;
+    DWORD Flags = 0, Transferred;
+    PUCHAR Buffer;
+    int Ret;
+
+    if (!ConnectLoopback(&Client, &Server))
+        return;
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, SEND_CHUNK);
+    ok(Buffer != NULL, "Out of memory\n");
+    if (!Buffer)
+        goto Cleanup;
+
+    /* A large read on an idle connection waits inside the transport */
+    ZeroMemory(&Overlapped, sizeof(Overlapped));
+    Overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    WsaBuf.buf = (char *)Buffer;
+    WsaBuf.len = SEND_CHUNK;
+    Ret = WSARecv(Client, &WsaBuf, 1, NULL, &Flags, &Overlapped, NULL);
+    ok(Ret == SOCKET_ERROR && WSAGetLastError() == WSA_IO_PENDING,
+       "WSARecv returned %d, error %d\n", Ret, WSAGetLastError());
+
+    ok(CancelIo((HANDLE)Client), "CancelIo failed with %lu\n", GetLastError());
+    ok(!GetOverlappedResult((HANDLE)Client, &Overlapped, &Transferred, TRUE) &&
+       GetLastError() == ERROR_OPERATION_ABORTED,
+       "Cancelled recv completed with %lu\n", GetLastError());
+    CloseHandle(Overlapped.hEvent);
+
+    /* Nothing may be lost to the cancelled read */
+    Ret = send(Server, (char *)Pattern, PATTERN_PERIOD, 0);
+    ok(Ret == PATTERN_PERIOD, "send returned %d\n", Ret);
+    Ret = recv(Client, (char *)Buffer, SEND_CHUNK, 0);
+    ok(Ret == PATTERN_PERIOD, "recv returned %d\n", Ret);
+    ok(Ret <= 0 || !memcmp(Buffer, Pattern, Ret), "recv returned unexpected data\n");
+
+    HeapFree(GetProcessHeap(), 0, Buffer);
+
+Cleanup:
+    closesocket(Client);
+    closesocket(Server);
+}
+
+START_TEST(recv)
+{
+    WSADATA WsaData;
+    ULONG i;
+
+    if (WSAStartup(MAKEWORD(2, 2), &WsaData))
+    {
+        skip("WSAStartup failed\n");
+        return;
+    }
+
+    for (i = 0; i < sizeof(Pattern); i++)
+        Pattern[i] = (UCHAR)(i % PATTERN_PERIOD);
+
+    /* Reads smaller than the receive window are copied out of it, large
+     * ones are handed to the transport */
+    TestThroughput(1024);
+    TestThroughput(SEND_CHUNK);
+    TestCancel();
+
+    WSACleanup();
+}
@@ -0,0 +1,127 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1+ (https://spdx.org/licenses/LGPL-2.1+)
+ * PURPOSE:     Test for cancelling AFD selects while they are set up
+ */
+
+#include "precomp.h"
+
+#define TEST_SELECTS        10000
+
+typedef BOOL (WINAPI *PCANCEL_IO_EX)(HANDLE, LPOVERLAPPED);
+
+static PCANCEL_IO_EX pCancelIoEx;
+static volatile LONG CancelDone;
+
+static
+DWORD
+WINAPI
+CancelThread(
+    LPVOID Parameter)
+{
+    HANDLE Handle = Parameter;
+
+    /* Hit the selects of the other thread at any point of their setup */
+    while (!CancelDone)
+        pCancelIoEx(Handle, NULL);
+
+    return 0;
+}
+
+static
+NTSTATUS
+SelectAndCancel(
+    SOCKET Socket,
+    HANDLE Event)
+{
+    AFD_POLL_INFO PollInfo;
+    IO_STATUS_BLOCK IoStatus;
+    NTSTATUS Status;
+
+    /* A zero timeout expires while the poll is still being set up */
+    PollInfo.Timeout.QuadPart = 0;
+    PollInfo.HandleCount = 1;
+    PollInfo.Exclusive = FALSE;
+    PollInfo.Handles[0].Handle = Socket;
+    PollInfo.Handles[0].Events = AFD_EVENT_RECEIVE;
+    PollInfo.Handles[0].Status = 0;
+
+    Status = NtDeviceIoControlFile((HANDLE)Socket, Event, NULL, NULL, &IoStatus,
+                                   IOCTL_AFD_SELECT,
+                                   &PollInfo, sizeof(PollInfo),
+                                   &PollInfo, sizeof(PollInfo));
+    if (Status == STATUS_PENDING)
+    {
+        CancelIo((HANDLE)Socket);
+        if (WaitForSingleObject(Event, 10000) != WAIT_OBJECT_0)
+            return STATUS_IO_TIMEOUT;
+        Status = IoStatus.Status;
+    }
+
+    return Status;
+}
+
+START_TEST(select)
+{
+    struct sockaddr_in Address;
+    WSADATA WsaData;
+    SOCKET Socket;
+    HANDLE Event, Thread = NULL;
+    NTSTATUS Status;
+    ULONG i, Failed = 0;
+
+    if (WSAStartup(MAKEWORD(2, 2), &WsaData))
+    {
+        skip("WSAStartup failed\n");
+        return;
+    }
+
+    Socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    ok(Socket != INVALID_SOCKET, "socket failed with %d\n", WSAGetLastError());
+    if (Socket == INVALID_SOCKET)
+    {
+        WSACleanup();
+        return;
+    }
+
+    /* Nothing is ever sent to it, the selects can only time out or be cancelled */
+    ZeroMemory(&Address, sizeof(Address));
+    Address.sin_family = AF_INET;
+    Address.sin_addr.s_addr = inet_addr("127.0.0.1");
+    Address.sin_port = htons(0);
+    ok(!bind(Socket, (struct sockaddr *)&Address, sizeof(Address)), "bind failed with %d\n", WSAGetLastError());
+
+    Event = CreateEventW(NULL, FALSE, FALSE, NULL);
+
+    pCancelIoEx = (PCANCEL_IO_EX)GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "CancelIoEx");
+    if (pCancelIoEx && (pCancelIoEx((HANDLE)Socket, NULL) || GetLastError() == ERROR_NOT_FOUND))
+        Thread = CreateThread(NULL, 0, CancelThread, (LPVOID)Socket, 0, NULL);
+    else
+        skip("CancelIoEx is not available, selects are only cancelled after they are set up\n");
+
+    for (i = 0; i < TEST_SELECTS; i++)
+    {
+        Status = SelectAndCancel(Socket, Event);
+        if (Status != STATUS_TIMEOUT && Status != STATUS_CANCELLED)
+        {
+            ok(0, "Select %lu completed with 0x%lx\n", i, Status);
+            if (++Failed == 10)
+                break;
+        }
+    }
+
+    if (Thread)
+    {
+        InterlockedExchange(&CancelDone, TRUE);
+        WaitForSingleObject(Thread, INFINITE);
+        CloseHandle(Thread);
+    }
+
+    /* The socket still works after all of this */
+    Status = SelectAndCancel(Socket, Event);
+    ok(Status == STATUS_TIMEOUT || Status == STATUS_CANCELLED, "Last select completed with 0x%lx\n", Status);
+
+    CloseHandle(Event);
+    closesocket(Socket);
+    WSACleanup();
+}
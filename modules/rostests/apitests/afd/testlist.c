@@ -1,11 +1,17 @@
 #define STANDALONE
 #include <apitest.h>
 
+extern void func_pollgroup(void);
+extern void func_recv(void);
+extern void func_select(void);
 extern void func_send(void);
 extern void func_windowsize(void);
 
 const struct test winetest_testlist[] =
 {
+    { "pollgroup", func_pollgroup },
+    { "recv", func_recv },
+    { "select", func_select },
     { "send", func_send },
     { "windowsize", func_windowsize },
     { 0, 0 }
@@ -0,0 +1,132 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Known answer tests and benchmark for BCryptDeriveKeyPBKDF2
+ */
+#include "precomp.h"
+
+typedef NTSTATUS (WINAPI *FN_BCryptOpenAlgorithmProvider)(BCRYPT_ALG_HANDLE *, LPCWSTR, LPCWSTR, ULONG);
+typedef NTSTATUS (WINAPI *FN_BCryptCloseAlgorithmProvider)(BCRYPT_ALG_HANDLE, ULONG);
+typedef NTSTATUS (WINAPI *FN_BCryptDeriveKeyPBKDF2)(BCRYPT_ALG_HANDLE, PUCHAR, ULONG, PUCHAR, ULONG, ULONGLONG, PUCHAR, ULONG, ULONG);
+
+static FN_BCryptOpenAlgorithmProvider pBCryptOpenAlgorithmProvider;
+static FN_BCryptCloseAlgorithmProvider pBCryptCloseAlgorithmProvider;
+static FN_BCryptDeriveKeyPBKDF2 pBCryptDeriveKeyPBKDF2;
+
+typedef struct _PBKDF2_TEST
+{
+    PCWSTR Algorithm;
+    const char *Password;
+    ULONG PasswordLength;
+    const char *Salt;
+    ULONG SaltLength;
+    ULONGLONG Iterations;
+    ULONG KeyLength;
+    UCHAR Key[64];
+} PBKDF2_TEST;
+
+/* RFC 6070 for SHA-1, RFC 7914 section 11 for SHA-256 */
+static const PBKDF2_TEST Tests[] =
+{
+    { BCRYPT_SHA1_ALGORITHM, "password", 8, "salt", 4, 1, 20,
+      { 0x0c, 0x60, 0xc8, 0x0f, 0x96, 0x1f, 0x0e, 0x71, 0xf3, 0xa9, 0xb5, 0x24, 0xaf, 0x60, 0x12, 0x06,
+        0x2f, 0xe0, 0x37, 0xa6 } },
+    { BCRYPT_SHA1_ALGORITHM, "password", 8, "salt", 4, 2, 20,
+      { 0xea, 0x6c, 0x01, 0x4d, 0xc7, 0x2d, 0x6f, 0x8c, 0xcd, 0x1e, 0xd9, 0x2a, 0xce, 0x1d, 0x41, 0xf0,
+        0xd8, 0xde, 0x89, 0x57 } },
+    { BCRYPT_SHA1_ALGORITHM, "password", 8, "salt", 4, 4096, 20,
+      { 0x4b, 0x00, 0x79, 0x01, 0xb7, 0x65, 0x48, 0x9a, 0xbe, 0xad, 0x49, 0xd9, 0x26, 0xf7, 0x21, 0xd0,
+        0x65, 0xa4, 0x29, 0xc1 } },
+    { BCRYPT_SHA1_ALGORITHM, "passwordPASSWORDpassword", 24, "saltSALTsaltSALTsaltSALTsaltSALTsalt", 36, 4096, 25,
+      { 0x3d, 0x2e, 0xec, 0x4f, 0xe4, 0x1c, 0x84, 0x9b, 0x80, 0xc8, 0xd8, 0x36, 0x62, 0xc0, 0xe4, 0x4a,
+        0x8b, 0x29, 0x1a, 0x96, 0x4c, 0xf2, 0xf0, 0x70, 0x38 } },
+    { BCRYPT_SHA1_ALGORITHM, "pass\0word", 9, "sa\0lt", 5, 4096, 16,
+      { 0x56, 0xfa, 0x6a, 0xa7, 0x55, 0x48, 0x09, 0x9d, 0xcc, 0x37, 0xd7, 0xf0, 0x34, 0x25, 0xe0, 0xc3 } },
+    { BCRYPT_SHA256_ALGORITHM, "passwd", 6, "salt", 4, 1, 64,
+      { 0x55, 0xac, 0x04, 0x6e, 0x56, 0xe3, 0x08, 0x9f, 0xec, 0x16, 0x91, 0xc2, 0x25, 0x44, 0xb6, 0x05,
+        0xf9, 0x41, 0x85, 0x21, 0x6d, 0xde, 0x04, 0x65, 0xe6, 0x8b, 0x9d, 0x57, 0xc2, 0x0d, 0xac, 0xbc,
+        0x49, 0xca, 0x9c, 0xcc, 0xf1, 0x79, 0xb6, 0x45, 0x99, 0x16, 0x64, 0xb3, 0x9d, 0x77, 0xef, 0x31,
+        0x7c, 0x71, 0xb8, 0x45, 0xb1, 0xe3, 0x0b, 0xd5, 0x09, 0x11, 0x20, 0x41, 0xd3, 0xa1, 0x97, 0x83 } },
+    { BCRYPT_SHA256_ALGORITHM, "Password", 8, "NaCl", 4, 80000, 64,
+      { 0x4d, 0xdc, 0xd8, 0xf6, 0x0b, 0x98, 0xbe, 0x21, 0x83, 0x0c, 0xee, 0x5e, 0xf2, 0x27, 0x01, 0xf9,
+        0x64, 0x1a, 0x44, 0x18, 0xd0, 0x4c, 0x04, 0x14, 0xae, 0xff, 0x08, 0x87, 0x6b, 0x34, 0xab, 0x56,
+        0xa1, 0xd4, 0x25, 0xa1, 0x22, 0x58, 0x33, 0x54, 0x9a, 0xdb, 0x84, 0x1b, 0x51, 0xc9, 0xb3, 0x17,
+        0x6a, 0x27, 0x2b, 0xde, 0xbb, 0xa1, 0xd0, 0x78, 0x47, 0x8f, 0x62, 0xb3, 0x97, 0xf3, 0x3c, 0x8d } },
+};
+
+static
+VOID
+TestVector(const PBKDF2_TEST *Test)
+{
+    BCRYPT_ALG_HANDLE Alg;
+    UCHAR Key[64];
+    NTSTATUS Status;
+
+    Status = pBCryptOpenAlgorithmProvider(&Alg, Test->Algorithm, NULL, BCRYPT_ALG_HANDLE_HMAC_FLAG);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status)) return;
+
+    memset(Key, 0xcc, sizeof(Key));
+    Status = pBCryptDeriveKeyPBKDF2(Alg, (PUCHAR)Test->Password, Test->PasswordLength,
+                                    (PUCHAR)Test->Salt, Test->SaltLength, Test->Iterations,
+                                    Key, Test->KeyLength, 0);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok(!memcmp(Key, Test->Key, Test->KeyLength), "%S/%I64u/%lu: wrong key\n",
+       Test->Algorithm, Test->Iterations, Test->KeyLength);
+    if (Test->KeyLength < sizeof(Key))
+        ok(Key[Test->KeyLength] == 0xcc, "%S: wrote past the key\n", Test->Algorithm);
+
+    pBCryptCloseAlgorithmProvider(Alg, 0);
+}
+
+static
+VOID
+Benchmark(PCWSTR Algorithm, ULONG KeyLength)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    BCRYPT_ALG_HANDLE Alg;
+    UCHAR Key[256];
+    NTSTATUS Status;
+
+    Status = pBCryptOpenAlgorithmProvider(&Alg, Algorithm, NULL, BCRYPT_ALG_HANDLE_HMAC_FLAG);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status)) return;
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    Status = pBCryptDeriveKeyPBKDF2(Alg, (PUCHAR)"password", 8, (PUCHAR)"salt", 4, 100000, Key, KeyLength, 0);
+    QueryPerformanceCounter(&End);
+    ok_hex(Status, STATUS_SUCCESS);
+
+    trace("PBKDF2 %S, 100000 iterations, %lu bytes: %.1f ms\n", Algorithm, KeyLength,
+          (double)(End.QuadPart - Start.QuadPart) * 1000 / (double)Frequency.QuadPart);
+
+    pBCryptCloseAlgorithmProvider(Alg, 0);
+}
+
+START_TEST(BCryptDeriveKeyPBKDF2)
+{
+    HMODULE Module;
+    ULONG i;
+
+    Module = LoadBcrypt();
+    if (Module)
+    {
+        pBCryptOpenAlgorithmProvider = (FN_BCryptOpenAlgorithmProvider)GetProcAddress(Module, "BCryptOpenAlgorithmProvider");
+        pBCryptCloseAlgorithmProvider = (FN_BCryptCloseAlgorithmProvider)GetProcAddress(Module, "BCryptCloseAlgorithmProvider");
+        pBCryptDeriveKeyPBKDF2 = (FN_BCryptDeriveKeyPBKDF2)GetProcAddress(Module, "BCryptDeriveKeyPBKDF2");
+    }
+    if (!pBCryptOpenAlgorithmProvider || !pBCryptCloseAlgorithmProvider || !pBCryptDeriveKeyPBKDF2)
+    {
+        skip("BCryptDeriveKeyPBKDF2 is not available\n");
+        return;
+    }
+
+    for (i = 0; i < sizeof(Tests) / sizeof(Tests[0]); i++)
+        TestVector(&Tests[i]);
+
+    /* One block, then eight independent blocks */
+    Benchmark(BCRYPT_SHA1_ALGORITHM, 20);
+    Benchmark(BCRYPT_SHA256_ALGORITHM, 32);
+    Benchmark(BCRYPT_SHA256_ALGORITHM, 256);
+}
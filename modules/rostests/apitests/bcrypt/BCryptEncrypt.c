@@ -0,0 +1,333 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Known answer tests and benchmark for AES in BCryptEncrypt/BCryptDecrypt
+ */
+#include "precomp.h"
+
+#define BENCH_SIZE  (1024 * 1024)
+#define BENCH_LOOPS 32
+
+typedef NTSTATUS (WINAPI *FN_BCryptOpenAlgorithmProvider)(BCRYPT_ALG_HANDLE *, LPCWSTR, LPCWSTR, ULONG);
+typedef NTSTATUS (WINAPI *FN_BCryptCloseAlgorithmProvider)(BCRYPT_ALG_HANDLE, ULONG);
+typedef NTSTATUS (WINAPI *FN_BCryptSetProperty)(BCRYPT_HANDLE, LPCWSTR, PUCHAR, ULONG, ULONG);
+typedef NTSTATUS (WINAPI *FN_BCryptGenerateSymmetricKey)(BCRYPT_ALG_HANDLE, BCRYPT_KEY_HANDLE *, PUCHAR, ULONG, PUCHAR, ULONG, ULONG);
+typedef NTSTATUS (WINAPI *FN_BCryptEncrypt)(BCRYPT_KEY_HANDLE, PUCHAR, ULONG, PVOID, PUCHAR, ULONG, PUCHAR, ULONG, ULONG *, ULONG);
+typedef NTSTATUS (WINAPI *FN_BCryptDestroyKey)(BCRYPT_KEY_HANDLE);
+
+static FN_BCryptOpenAlgorithmProvider pBCryptOpenAlgorithmProvider;
+static FN_BCryptCloseAlgorithmProvider pBCryptCloseAlgorithmProvider;
+static FN_BCryptSetProperty pBCryptSetProperty;
+static FN_BCryptGenerateSymmetricKey pBCryptGenerateSymmetricKey;
+static FN_BCryptEncrypt pBCryptEncrypt;
+static FN_BCryptEncrypt pBCryptDecrypt;
+static FN_BCryptDestroyKey pBCryptDestroyKey;
+
+/* FIPS-197 appendix C */
+static const UCHAR Fips197Plain[16] =
+    { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff };
+static const UCHAR Fips197Key[32] =
+    { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+      0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f };
+static const UCHAR Fips197Cipher[3][16] =
+{
+    { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a },
+    { 0xdd, 0xa9, 0x7c, 0xa4, 0x86, 0x4c, 0xdf, 0xe0, 0x6e, 0xaf, 0x70, 0xa0, 0xec, 0x0d, 0x71, 0x91 },
+    { 0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf, 0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89 },
+};
+
+/* SP 800-38A appendix F, AES-128 */
+static const UCHAR Sp80038aKey[16] =
+    { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+static const UCHAR Sp80038aIv[16] =
+    { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+static const UCHAR Sp80038aPlain[64] =
+    { 0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+      0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+      0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+      0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10 };
+static const UCHAR CbcCipher[64] =
+    { 0x76, 0x49, 0xab, 0xac, 0x81, 0x19, 0xb2, 0x46, 0xce, 0xe9, 0x8e, 0x9b, 0x12, 0xe9, 0x19, 0x7d,
+      0x50, 0x86, 0xcb, 0x9b, 0x50, 0x72, 0x19, 0xee, 0x95, 0xdb, 0x11, 0x3a, 0x91, 0x76, 0x78, 0xb2,
+      0x73, 0xbe, 0xd6, 0xb8, 0xe3, 0xc1, 0x74, 0x3b, 0x71, 0x16, 0xe6, 0x9e, 0x22, 0x22, 0x95, 0x16,
+      0x3f, 0xf1, 0xca, 0xa1, 0x68, 0x1f, 0xac, 0x09, 0x12, 0x0e, 0xca, 0x30, 0x75, 0x86, 0xe1, 0xa7 };
+static const UCHAR Cfb128Cipher[64] =
+    { 0x3b, 0x3f, 0xd9, 0x2e, 0xb7, 0x2d, 0xad, 0x20, 0x33, 0x34, 0x49, 0xf8, 0xe8, 0x3c, 0xfb, 0x4a,
+      0xc8, 0xa6, 0x45, 0x37, 0xa0, 0xb3, 0xa9, 0x3f, 0xcd, 0xe3, 0xcd, 0xad, 0x9f, 0x1c, 0xe5, 0x8b,
+      0x26, 0x75, 0x1f, 0x67, 0xa3, 0xcb, 0xb1, 0x40, 0xb1, 0x80, 0x8c, 0xf1, 0x87, 0xa4, 0xf4, 0xdf,
+      0xc0, 0x4b, 0x05, 0x35, 0x7c, 0x5d, 0x1c, 0x0e, 0xea, 0xc4, 0xc6, 0x6f, 0x9f, 0xf7, 0xf2, 0xe6 };
+static const UCHAR Cfb8Cipher[18] =
+    { 0x3b, 0x79, 0x42, 0x4c, 0x9c, 0x0d, 0xd4, 0x36, 0xba, 0xce, 0x9e, 0x0e, 0xd4, 0x58, 0x6a, 0x4f,
+      0x32, 0xb9 };
+
+/* GCM specification, test case 4 */
+static const UCHAR GcmKey[16] =
+    { 0xfe, 0xff, 0xe9, 0x92, 0x86, 0x65, 0x73, 0x1c, 0x6d, 0x6a, 0x8f, 0x94, 0x67, 0x30, 0x83, 0x08 };
+static const UCHAR GcmNonce[12] =
+    { 0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad, 0xde, 0xca, 0xf8, 0x88 };
+static const UCHAR GcmAuthData[20] =
+    { 0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef, 0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+      0xab, 0xad, 0xda, 0xd2 };
+static const UCHAR GcmPlain[60] =
+    { 0xd9, 0x31, 0x32, 0x25, 0xf8, 0x84, 0x06, 0xe5, 0xa5, 0x59, 0x09, 0xc5, 0xaf, 0xf5, 0x26, 0x9a,
+      0x86, 0xa7, 0xa9, 0x53, 0x15, 0x34, 0xf7, 0xda, 0x2e, 0x4c, 0x30, 0x3d, 0x8a, 0x31, 0x8a, 0x72,
+      0x1c, 0x3c, 0x0c, 0x95, 0x95, 0x68, 0x09, 0x53, 0x2f, 0xcf, 0x0e, 0x24, 0x49, 0xa6, 0xb5, 0x25,
+      0xb1, 0x6a, 0xed, 0xf5, 0xaa, 0x0d, 0xe6, 0x57, 0xba, 0x63, 0x7b, 0x39 };
+static const UCHAR GcmCipher[60] =
+    { 0x42, 0x83, 0x1e, 0xc2, 0x21, 0x77, 0x74, 0x24, 0x4b, 0x72, 0x21, 0xb7, 0x84, 0xd0, 0xd4, 0x9c,
+      0xe3, 0xaa, 0x21, 0x2f, 0x2c, 0x02, 0xa4, 0xe0, 0x35, 0xc1, 0x7e, 0x23, 0x29, 0xac, 0xa1, 0x2e,
+      0x21, 0xd5, 0x14, 0xb2, 0x54, 0x66, 0x93, 0x1c, 0x7d, 0x8f, 0x6a, 0x5a, 0xac, 0x84, 0xaa, 0x05,
+      0x1b, 0xa3, 0x0b, 0x39, 0x6a, 0x0a, 0xac, 0x97, 0x3d, 0x58, 0xe0, 0x91 };
+static const UCHAR GcmTag[16] =
+    { 0x5b, 0xc9, 0x4f, 0xbc, 0x32, 0x21, 0xa5, 0xdb, 0x94, 0xfa, 0xe9, 0x5a, 0xe7, 0x12, 0x1a, 0x47 };
+
+static
+BCRYPT_KEY_HANDLE
+CreateKey(BCRYPT_ALG_HANDLE *Alg, PCWSTR Mode, const UCHAR *Secret, ULONG SecretLength)
+{
+    BCRYPT_KEY_HANDLE Key = NULL;
+    NTSTATUS Status;
+
+    Status = pBCryptOpenAlgorithmProvider(Alg, BCRYPT_AES_ALGORITHM, NULL, 0);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status)) return NULL;
+
+    Status = pBCryptSetProperty(*Alg, BCRYPT_CHAINING_MODE, (PUCHAR)Mode, (ULONG)(wcslen(Mode) + 1) * sizeof(WCHAR), 0);
+    ok_hex(Status, STATUS_SUCCESS);
+
+    Status = pBCryptGenerateSymmetricKey(*Alg, &Key, NULL, 0, (PUCHAR)Secret, SecretLength, 0);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+    {
+        pBCryptCloseAlgorithmProvider(*Alg, 0);
+        return NULL;
+    }
+    return Key;
+}
+
+static
+VOID
+DestroyKey(BCRYPT_ALG_HANDLE Alg, BCRYPT_KEY_HANDLE Key)
+{
+    pBCryptDestroyKey(Key);
+    pBCryptCloseAlgorithmProvider(Alg, 0);
+}
+
+static
+VOID
+TestCipher(PCWSTR Mode, ULONG MessageBlockLength, const UCHAR *Secret, ULONG SecretLength,
+           const UCHAR *Iv, const UCHAR *Plain, const UCHAR *Cipher, ULONG Length)
+{
+    BCRYPT_ALG_HANDLE Alg;
+    BCRYPT_KEY_HANDLE Key;
+    UCHAR Buffer[64], IvCopy[16];
+    ULONG Size;
+    NTSTATUS Status;
+
+    Key = CreateKey(&Alg, Mode, Secret, SecretLength);
+    if (!Key) return;
+
+    if (MessageBlockLength)
+    {
+        Status = pBCryptSetProperty(Key, BCRYPT_MESSAGE_BLOCK_LENGTH, (PUCHAR)&MessageBlockLength, sizeof(ULONG), 0);
+        ok_hex(Status, STATUS_SUCCESS);
+    }
+
+    if (Iv) memcpy(IvCopy, Iv, sizeof(IvCopy));
+    Size = 0;
+    Status = pBCryptEncrypt(Key, (PUCHAR)Plain, Length, NULL, Iv ? IvCopy : NULL, Iv ? sizeof(IvCopy) : 0,
+                            Buffer, sizeof(Buffer), &Size, 0);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_long(Size, Length);
+    ok(!memcmp(Buffer, Cipher, Length), "%S/%lu/%lu: wrong ciphertext\n", Mode, SecretLength * 8, MessageBlockLength);
+
+    if (Iv) memcpy(IvCopy, Iv, sizeof(IvCopy));
+    Size = 0;
+    Status = pBCryptDecrypt(Key, (PUCHAR)Cipher, Length, NULL, Iv ? IvCopy : NULL, Iv ? sizeof(IvCopy) : 0,
+                            Buffer, sizeof(Buffer), &Size, 0);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_long(Size, Length);
+    ok(!memcmp(Buffer, Plain, Length), "%S/%lu/%lu: wrong plaintext\n", Mode, SecretLength * 8, MessageBlockLength);
+
+    DestroyKey(Alg, Key);
+}
+
+static
+VOID
+TestPadding(VOID)
+{
+    BCRYPT_ALG_HANDLE Alg;
+    BCRYPT_KEY_HANDLE Key;
+    UCHAR Buffer[80], Plain[80], IvCopy[16];
+    ULONG Size;
+    NTSTATUS Status;
+
+    Key = CreateKey(&Alg, BCRYPT_CHAIN_MODE_CBC, Sp80038aKey, sizeof(Sp80038aKey));
+    if (!Key) return;
+
+    /* A full block of padding follows block aligned input */
+    memcpy(IvCopy, Sp80038aIv, sizeof(IvCopy));
+    Status = pBCryptEncrypt(Key, (PUCHAR)Sp80038aPlain, sizeof(Sp80038aPlain), NULL, IvCopy, sizeof(IvCopy),
+                            Buffer, sizeof(Buffer), &Size, BCRYPT_BLOCK_PADDING);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_long(Size, sizeof(Sp80038aPlain) + 16);
+    ok(!memcmp(Buffer, CbcCipher, sizeof(CbcCipher)), "wrong ciphertext\n");
+
+    memcpy(IvCopy, Sp80038aIv, sizeof(IvCopy));
+    Status = pBCryptDecrypt(Key, Buffer, Size, NULL, IvCopy, sizeof(IvCopy),
+                            Plain, sizeof(Plain), &Size, BCRYPT_BLOCK_PADDING);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_long(Size, sizeof(Sp80038aPlain));
+    ok(!memcmp(Plain, Sp80038aPlain, sizeof(Sp80038aPlain)), "wrong plaintext\n");
+
+    /* Without padding, the input must be block aligned */
+    memcpy(IvCopy, Sp80038aIv, sizeof(IvCopy));
+    Status = pBCryptEncrypt(Key, (PUCHAR)Sp80038aPlain, 17, NULL, IvCopy, sizeof(IvCopy),
+                            Buffer, sizeof(Buffer), &Size, 0);
+    ok_hex(Status, STATUS_INVALID_BUFFER_SIZE);
+
+    DestroyKey(Alg, Key);
+}
+
+static
+VOID
+TestGcm(VOID)
+{
+    BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO Info;
+    BCRYPT_ALG_HANDLE Alg;
+    BCRYPT_KEY_HANDLE Key;
+    UCHAR Buffer[64], Tag[16];
+    ULONG Size;
+    NTSTATUS Status;
+
+    Key = CreateKey(&Alg, BCRYPT_CHAIN_MODE_GCM, GcmKey, sizeof(GcmKey));
+    if (!Key) return;
+
+    memset(&Info, 0, sizeof(Info));
+    Info.cbSize = sizeof(Info);
+    Info.dwInfoVersion = BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO_VERSION;
+    Info.pbNonce = (PUCHAR)GcmNonce;
+    Info.cbNonce = sizeof(GcmNonce);
+    Info.pbAuthData = (PUCHAR)GcmAuthData;
+    Info.cbAuthData = sizeof(GcmAuthData);
+    Info.pbTag = Tag;
+    Info.cbTag = sizeof(Tag);
+
+    Status = pBCryptEncrypt(Key, (PUCHAR)GcmPlain, sizeof(GcmPlain), &Info, NULL, 0,
+                            Buffer, sizeof(Buffer), &Size, 0);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_long(Size, sizeof(GcmPlain));
+    ok(!memcmp(Buffer, GcmCipher, sizeof(GcmCipher)), "wrong ciphertext\n");
+    ok(!memcmp(Tag, GcmTag, sizeof(GcmTag)), "wrong tag\n");
+
+    Status = pBCryptDecrypt(Key, (PUCHAR)GcmCipher, sizeof(GcmCipher), &Info, NULL, 0,
+                            Buffer, sizeof(Buffer), &Size, 0);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok(!memcmp(Buffer, GcmPlain, sizeof(GcmPlain)), "wrong plaintext\n");
+
+    /* Any change to the authenticated data is caught */
+    Tag[0] ^= 1;
+    Status = pBCryptDecrypt(Key, (PUCHAR)GcmCipher, sizeof(GcmCipher), &Info, NULL, 0,
+                            Buffer, sizeof(Buffer), &Size, 0);
+    ok_hex(Status, STATUS_AUTH_TAG_MISMATCH);
+
+    DestroyKey(Alg, Key);
+}
+
+static
+VOID
+Benchmark(PCWSTR Mode, ULONG MessageBlockLength)
+{
+    BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO Info;
+    LARGE_INTEGER Frequency, Start, End;
+    BCRYPT_ALG_HANDLE Alg;
+    BCRYPT_KEY_HANDLE Key;
+    UCHAR IvCopy[16], Tag[16];
+    PUCHAR Buffer;
+    ULONG Size, i;
+    BOOL Gcm = !wcscmp(Mode, BCRYPT_CHAIN_MODE_GCM);
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    Buffer = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, BENCH_SIZE);
+    if (!Buffer)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+
+    Key = CreateKey(&Alg, Mode, Fips197Key, 16);
+    if (!Key)
+    {
+        HeapFree(GetProcessHeap(), 0, Buffer);
+        return;
+    }
+    if (MessageBlockLength)
+        pBCryptSetProperty(Key, BCRYPT_MESSAGE_BLOCK_LENGTH, (PUCHAR)&MessageBlockLength, sizeof(ULONG), 0);
+
+    memset(&Info, 0, sizeof(Info));
+    Info.cbSize = sizeof(Info);
+    Info.dwInfoVersion = BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO_VERSION;
+    Info.pbNonce = (PUCHAR)GcmNonce;
+    Info.cbNonce = sizeof(GcmNonce);
+    Info.pbTag = Tag;
+    Info.cbTag = sizeof(Tag);
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    for (i = 0; i < BENCH_LOOPS && NT_SUCCESS(Status); i++)
+    {
+        memcpy(IvCopy, Sp80038aIv, sizeof(IvCopy));
+        Status = pBCryptEncrypt(Key, Buffer, BENCH_SIZE, Gcm ? &Info : NULL,
+                                (Gcm || !wcscmp(Mode, BCRYPT_CHAIN_MODE_ECB)) ? NULL : IvCopy,
+                                (Gcm || !wcscmp(Mode, BCRYPT_CHAIN_MODE_ECB)) ? 0 : sizeof(IvCopy),
+                                Buffer, BENCH_SIZE, &Size, 0);
+    }
+
+    QueryPerformanceCounter(&End);
+    ok_hex(Status, STATUS_SUCCESS);
+
+    trace("AES-128 %S%s: %.1f MB/s\n", Mode, MessageBlockLength == 1 ? " (8 bit)" : "",
+          (double)BENCH_LOOPS * BENCH_SIZE * Frequency.QuadPart / (double)(End.QuadPart - Start.QuadPart) / (1024 * 1024));
+
+    DestroyKey(Alg, Key);
+    HeapFree(GetProcessHeap(), 0, Buffer);
+}
+
+START_TEST(BCryptEncrypt)
+{
+    HMODULE Module;
+    ULONG i;
+
+    Module = LoadBcrypt();
+    if (Module)
+    {
+        pBCryptOpenAlgorithmProvider = (FN_BCryptOpenAlgorithmProvider)GetProcAddress(Module, "BCryptOpenAlgorithmProvider");
+        pBCryptCloseAlgorithmProvider = (FN_BCryptCloseAlgorithmProvider)GetProcAddress(Module, "BCryptCloseAlgorithmProvider");
+        pBCryptSetProperty = (FN_BCryptSetProperty)GetProcAddress(Module, "BCryptSetProperty");
+        pBCryptGenerateSymmetricKey = (FN_BCryptGenerateSymmetricKey)GetProcAddress(Module, "BCryptGenerateSymmetricKey");
+        pBCryptEncrypt = (FN_BCryptEncrypt)GetProcAddress(Module, "BCryptEncrypt");
+        pBCryptDecrypt = (FN_BCryptEncrypt)GetProcAddress(Module, "BCryptDecrypt");
+        pBCryptDestroyKey = (FN_BCryptDestroyKey)GetProcAddress(Module, "BCryptDestroyKey");
+    }
+    if (!pBCryptOpenAlgorithmProvider || !pBCryptCloseAlgorithmProvider || !pBCryptSetProperty ||
+        !pBCryptGenerateSymmetricKey || !pBCryptEncrypt || !pBCryptDecrypt || !pBCryptDestroyKey)
+    {
+        skip("BCrypt is not available\n");
+        return;
+    }
+
+    for (i = 0; i < 3; i++)
+        TestCipher(BCRYPT_CHAIN_MODE_ECB, 0, Fips197Key, 16 + 8 * i, NULL, Fips197Plain, Fips197Cipher[i], 16);
+    TestCipher(BCRYPT_CHAIN_MODE_CBC, 0, Sp80038aKey, sizeof(Sp80038aKey), Sp80038aIv, Sp80038aPlain, CbcCipher, sizeof(CbcCipher));
+    TestCipher(BCRYPT_CHAIN_MODE_CFB, 16, Sp80038aKey, sizeof(Sp80038aKey), Sp80038aIv, Sp80038aPlain, Cfb128Cipher, sizeof(Cfb128Cipher));
+    TestCipher(BCRYPT_CHAIN_MODE_CFB, 1, Sp80038aKey, sizeof(Sp80038aKey), Sp80038aIv, Sp80038aPlain, Cfb8Cipher, sizeof(Cfb8Cipher));
+    TestPadding();
+    TestGcm();
+
+    Benchmark(BCRYPT_CHAIN_MODE_ECB, 0);
+    Benchmark(BCRYPT_CHAIN_MODE_CBC, 0);
+    Benchmark(BCRYPT_CHAIN_MODE_CFB, 16);
+    Benchmark(BCRYPT_CHAIN_MODE_CFB, 1);
+    Benchmark(BCRYPT_CHAIN_MODE_GCM, 0);
+}
@@ -0,0 +1,178 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Known answer tests and benchmark for the BCrypt SHA hashes
+ */
+#include "precomp.h"
+
+#define BENCH_SIZE  (1024 * 1024)
+#define BENCH_LOOPS 32
+
+typedef NTSTATUS (WINAPI *FN_BCryptOpenAlgorithmProvider)(BCRYPT_ALG_HANDLE *, LPCWSTR, LPCWSTR, ULONG);
+typedef NTSTATUS (WINAPI *FN_BCryptCloseAlgorithmProvider)(BCRYPT_ALG_HANDLE, ULONG);
+typedef NTSTATUS (WINAPI *FN_BCryptCreateHash)(BCRYPT_ALG_HANDLE, BCRYPT_HASH_HANDLE *, PUCHAR, ULONG, PUCHAR, ULONG, ULONG);
+typedef NTSTATUS (WINAPI *FN_BCryptHashData)(BCRYPT_HASH_HANDLE, PUCHAR, ULONG, ULONG);
+typedef NTSTATUS (WINAPI *FN_BCryptFinishHash)(BCRYPT_HASH_HANDLE, PUCHAR, ULONG, ULONG);
+typedef NTSTATUS (WINAPI *FN_BCryptDestroyHash)(BCRYPT_HASH_HANDLE);
+
+static FN_BCryptOpenAlgorithmProvider pBCryptOpenAlgorithmProvider;
+static FN_BCryptCloseAlgorithmProvider pBCryptCloseAlgorithmProvider;
+static FN_BCryptCreateHash pBCryptCreateHash;
+static FN_BCryptHashData pBCryptHashData;
+static FN_BCryptFinishHash pBCryptFinishHash;
+static FN_BCryptDestroyHash pBCryptDestroyHash;
+
+/* FIPS 180 examples */
+static const UCHAR Sha1Abc[20] =
+    { 0xa9, 0x99, 0x3e, 0x36, 0x47, 0x06, 0x81, 0x6a, 0xba, 0x3e, 0x25, 0x71, 0x78, 0x50, 0xc2, 0x6c,
+      0x9c, 0xd0, 0xd8, 0x9d };
+static const UCHAR Sha1Million[20] =
+    { 0x34, 0xaa, 0x97, 0x3c, 0xd4, 0xc4, 0xda, 0xa4, 0xf6, 0x1e, 0xeb, 0x2b, 0xdb, 0xad, 0x27, 0x31,
+      0x65, 0x34, 0x01, 0x6f };
+static const UCHAR Sha256Abc[32] =
+    { 0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+      0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad };
+static const UCHAR Sha256Million[32] =
+    { 0xcd, 0xc7, 0x6e, 0x5c, 0x99, 0x14, 0xfb, 0x92, 0x81, 0xa1, 0xc7, 0xe2, 0x84, 0xd7, 0x3e, 0x67,
+      0xf1, 0x80, 0x9a, 0x48, 0xa4, 0x97, 0xc8, 0x50, 0x0f, 0x3a, 0x2a, 0xbb, 0x2b, 0x2f, 0xbb, 0x7b };
+
+static
+BCRYPT_HASH_HANDLE
+CreateHash(BCRYPT_ALG_HANDLE *Alg, PCWSTR Algorithm)
+{
+    BCRYPT_HASH_HANDLE Hash = NULL;
+    NTSTATUS Status;
+
+    Status = pBCryptOpenAlgorithmProvider(Alg, Algorithm, NULL, 0);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status)) return NULL;
+
+    Status = pBCryptCreateHash(*Alg, &Hash, NULL, 0, NULL, 0, 0);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+    {
+        pBCryptCloseAlgorithmProvider(*Alg, 0);
+        return NULL;
+    }
+    return Hash;
+}
+
+static
+VOID
+TestHash(PCWSTR Algorithm, const UCHAR *Abc, const UCHAR *Million, ULONG Length)
+{
+    static const ULONG Chunks[] = { 1, 55, 64, 1000, 4096 };
+    BCRYPT_ALG_HANDLE Alg;
+    BCRYPT_HASH_HANDLE Hash;
+    UCHAR Digest[32], Data[4096];
+    ULONG Left, Size, i;
+    NTSTATUS Status;
+
+    Hash = CreateHash(&Alg, Algorithm);
+    if (!Hash) return;
+
+    Status = pBCryptHashData(Hash, (PUCHAR)"abc", 3, 0);
+    ok_hex(Status, STATUS_SUCCESS);
+    Status = pBCryptFinishHash(Hash, Digest, Length, 0);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok(!memcmp(Digest, Abc, Length), "%S: wrong digest for \"abc\"\n", Algorithm);
+    pBCryptDestroyHash(Hash);
+    pBCryptCloseAlgorithmProvider(Alg, 0);
+
+    /* Feed one million 'a' in chunks that do and do not line up with the block size */
+    memset(Data, 'a', sizeof(Data));
+    for (i = 0; i < ARRAYSIZE(Chunks); i++)
+    {
+        Hash = CreateHash(&Alg, Algorithm);
+        if (!Hash) return;
+
+        for (Left = 1000000; Left; Left -= Size)
+        {
+            Size = min(Left, Chunks[i]);
+            Status = pBCryptHashData(Hash, Data, Size, 0);
+            if (!NT_SUCCESS(Status)) break;
+        }
+        ok_hex(Status, STATUS_SUCCESS);
+        Status = pBCryptFinishHash(Hash, Digest, Length, 0);
+        ok_hex(Status, STATUS_SUCCESS);
+        ok(!memcmp(Digest, Million, Length), "%S/%lu: wrong digest for one million 'a'\n", Algorithm, Chunks[i]);
+
+        pBCryptDestroyHash(Hash);
+        pBCryptCloseAlgorithmProvider(Alg, 0);
+    }
+}
+
+static
+VOID
+Benchmark(PCWSTR Algorithm, ULONG Length)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    BCRYPT_ALG_HANDLE Alg;
+    BCRYPT_HASH_HANDLE Hash;
+    UCHAR Digest[64];
+    PUCHAR Buffer;
+    ULONG i;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    Buffer = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, BENCH_SIZE);
+    if (!Buffer)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+
+    Hash = CreateHash(&Alg, Algorithm);
+    if (!Hash)
+    {
+        HeapFree(GetProcessHeap(), 0, Buffer);
+        return;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    for (i = 0; i < BENCH_LOOPS && NT_SUCCESS(Status); i++)
+        Status = pBCryptHashData(Hash, Buffer, BENCH_SIZE, 0);
+    if (NT_SUCCESS(Status))
+        Status = pBCryptFinishHash(Hash, Digest, Length, 0);
+
+    QueryPerformanceCounter(&End);
+    ok_hex(Status, STATUS_SUCCESS);
+
+    trace("%S: %.1f MB/s\n", Algorithm,
+          (double)BENCH_LOOPS * BENCH_SIZE * Frequency.QuadPart / (double)(End.QuadPart - Start.QuadPart) / (1024 * 1024));
+
+    pBCryptDestroyHash(Hash);
+    pBCryptCloseAlgorithmProvider(Alg, 0);
+    HeapFree(GetProcessHeap(), 0, Buffer);
+}
+
+START_TEST(BCryptHash)
+{
+    HMODULE Module;
+
+    Module = LoadBcrypt();
+    if (Module)
+    {
+        pBCryptOpenAlgorithmProvider = (FN_BCryptOpenAlgorithmProvider)GetProcAddress(Module, "BCryptOpenAlgorithmProvider");
+        pBCryptCloseAlgorithmProvider = (FN_BCryptCloseAlgorithmProvider)GetProcAddress(Module, "BCryptCloseAlgorithmProvider");
+        pBCryptCreateHash = (FN_BCryptCreateHash)GetProcAddress(Module, "BCryptCreateHash");
+        pBCryptHashData = (FN_BCryptHashData)GetProcAddress(Module, "BCryptHashData");
+        pBCryptFinishHash = (FN_BCryptFinishHash)GetProcAddress(Module, "BCryptFinishHash");
+        pBCryptDestroyHash = (FN_BCryptDestroyHash)GetProcAddress(Module, "BCryptDestroyHash");
+    }
+    if (!pBCryptOpenAlgorithmProvider || !pBCryptCloseAlgorithmProvider || !pBCryptCreateHash ||
+        !pBCryptHashData || !pBCryptFinishHash || !pBCryptDestroyHash)
+    {
+        skip("BCrypt is not available\n");
+        return;
+    }
+
+    TestHash(BCRYPT_SHA1_ALGORITHM, Sha1Abc, Sha1Million, sizeof(Sha1Abc));
+    TestHash(BCRYPT_SHA256_ALGORITHM, Sha256Abc, Sha256Million, sizeof(Sha256Abc));
+
+    Benchmark(BCRYPT_SHA1_ALGORITHM, 20);
+    Benchmark(BCRYPT_SHA256_ALGORITHM, 32);
+    Benchmark(BCRYPT_SHA384_ALGORITHM, 48);
+    Benchmark(BCRYPT_SHA512_ALGORITHM, 64);
+}
@@ -0,0 +1,26 @@
+#ifndef _BCRYPT_APITEST_PRECOMP_H_
+#define _BCRYPT_APITEST_PRECOMP_H_
+
+#define WIN32_NO_STATUS
+
+#include <apitest.h>
+#include <bcrypt.h>
+#include <ndk/umtypes.h>
+
+#ifndef BCRYPT_MESSAGE_BLOCK_LENGTH
+#define BCRYPT_MESSAGE_BLOCK_LENGTH L"MessageBlockLength"
+#endif
+
+#ifndef STATUS_AUTH_TAG_MISMATCH
+#define STATUS_AUTH_TAG_MISMATCH ((NTSTATUS)0xC000A002)
+#endif
+
+/* The extended bcrypt is tested when it is installed */
+static inline HMODULE LoadBcrypt(VOID)
+{
+    HMODULE Module = LoadLibraryW(L"bcryptext.dll");
+    if (!Module) Module = LoadLibraryW(L"bcrypt.dll");
+    return Module;
+}
+
+#endif /* _BCRYPT_APITEST_PRECOMP_H_ */
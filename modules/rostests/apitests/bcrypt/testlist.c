@@ -0,0 +1,16 @@
+#define __ROS_LONG64__
+
+#define STANDALONE
+#include <apitest.h>
+
+extern void func_BCryptDeriveKeyPBKDF2(void);
+extern void func_BCryptEncrypt(void);
+extern void func_BCryptHash(void);
+
+const struct test winetest_testlist[] =
+{
+    { "BCryptDeriveKeyPBKDF2", func_BCryptDeriveKeyPBKDF2 },
+    { "BCryptEncrypt", func_BCryptEncrypt },
+    { "BCryptHash", func_BCryptHash },
+    { 0, 0 }
+};
@@ -0,0 +1,170 @@
+/*
+ * PROJECT:     ReactOS API tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for the buffer mode framing of the compression API
+ */
+
+#include <apitest.h>
+#include <compressapi.h>
+
+#define BUFFER_SIGNATURE    0x0a51e5c0
+#define BUFFER_HEADER_SIZE  24
+
+typedef BOOL (WINAPI *PFN_CreateCompressor)(DWORD, PCOMPRESS_ALLOCATION_ROUTINES, PCOMPRESSOR_HANDLE);
+typedef BOOL (WINAPI *PFN_Compress)(COMPRESSOR_HANDLE, LPCVOID, SIZE_T, PVOID, SIZE_T, PSIZE_T);
+typedef BOOL (WINAPI *PFN_CloseCompressor)(COMPRESSOR_HANDLE);
+typedef BOOL (WINAPI *PFN_CreateDecompressor)(DWORD, PCOMPRESS_ALLOCATION_ROUTINES, PDECOMPRESSOR_HANDLE);
+typedef BOOL (WINAPI *PFN_Decompress)(DECOMPRESSOR_HANDLE, LPCVOID, SIZE_T, PVOID, SIZE_T, PSIZE_T);
+typedef BOOL (WINAPI *PFN_CloseDecompressor)(DECOMPRESSOR_HANDLE);
+
+static PFN_CreateCompressor pCreateCompressor;
+static PFN_Compress pCompress;
+static PFN_CloseCompressor pCloseCompressor;
+static PFN_CreateDecompressor pCreateDecompressor;
+static PFN_Decompress pDecompress;
+static PFN_CloseDecompressor pCloseDecompressor;
+
+/* "abc" 100 times in the buffer mode framing, the stream is the [MS-XCA] 3.2 example */
+static const UCHAR AbcBuffer[] =
+{
+    0xc0, 0xe5, 0x51, 0x0a, 0x03, 0x00, 0x00, 0x00,
+    0x2c, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x0d, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xff, 0xff, 0xff, 0x1f, 0x61, 0x62, 0x63, 0x17, 0x00, 0x0f, 0xff, 0x26,
+    0x01
+};
+
+static
+void
+FillAbc(PUCHAR Buffer, ULONG Size)
+{
+    ULONG i;
+
+    for (i = 0; i < Size; i++)
+        Buffer[i] = "abc"[i % 3];
+}
+
+static
+void
+Test_ParseBuffer(void)
+{
+    DECOMPRESSOR_HANDLE Decompressor;
+    UCHAR Expected[300], Output[300], Corrupt[sizeof(AbcBuffer)];
+    SIZE_T Size;
+    BOOL Ret;
+
+    FillAbc(Expected, sizeof(Expected));
+
+    Ret = pCreateDecompressor(COMPRESS_ALGORITHM_XPRESS, NULL, &Decompressor);
+    ok(Ret, "CreateDecompressor failed, error %lu\n", GetLastError());
+    if (!Ret)
+        return;
+
+    /* The header tells how much room the output needs */
+    Size = 0;
+    SetLastError(0xdeadbeef);
+    Ret = pDecompress(Decompressor, AbcBuffer, sizeof(AbcBuffer), NULL, 0, &Size);
+    ok(!Ret, "Decompress succeeded without an output buffer\n");
+    ok_long(GetLastError(), ERROR_INSUFFICIENT_BUFFER);
+    ok(Size == sizeof(Output), "Size is %lu\n", (ULONG)Size);
+
+    Size = 0;
+    Ret = pDecompress(Decompressor, AbcBuffer, sizeof(AbcBuffer), Output, sizeof(Output), &Size);
+    ok(Ret, "Decompress failed, error %lu\n", GetLastError());
+    ok(Size == sizeof(Output), "Size is %lu\n", (ULONG)Size);
+    ok(Ret && !memcmp(Output, Expected, sizeof(Output)), "Wrong output\n");
+
+    /* Buffers without the signature or with a short stream are rejected */
+    memcpy(Corrupt, AbcBuffer, sizeof(Corrupt));
+    Corrupt[0] ^= 0xff;
+    Ret = pDecompress(Decompressor, Corrupt, sizeof(Corrupt), Output, sizeof(Output), &Size);
+    ok(!Ret, "Decompress succeeded without the signature\n");
+    Ret = pDecompress(Decompressor, AbcBuffer, sizeof(AbcBuffer) - 1, Output, sizeof(Output), &Size);
+    ok(!Ret, "Decompress succeeded on a truncated buffer\n");
+
+    pCloseDecompressor(Decompressor);
+}
+
+static
+void
+Test_RoundTrip(DWORD Algorithm)
+{
+    COMPRESSOR_HANDLE Compressor;
+    DECOMPRESSOR_HANDLE Decompressor;
+    UCHAR Input[4096], Buffer[8192], Output[4096];
+    SIZE_T Size, OutputSize;
+    UINT64 Field;
+    BOOL Ret;
+
+    FillAbc(Input, sizeof(Input));
+
+    Ret = pCreateCompressor(Algorithm, NULL, &Compressor);
+    ok(Ret, "CreateCompressor(%lu) failed, error %lu\n", Algorithm, GetLastError());
+    if (!Ret)
+        return;
+    Size = 0;
+    Ret = pCompress(Compressor, Input, sizeof(Input), Buffer, sizeof(Buffer), &Size);
+    ok(Ret, "Compress(%lu) failed, error %lu\n", Algorithm, GetLastError());
+    pCloseCompressor(Compressor);
+    if (!Ret)
+        return;
+
+    /* Signature, algorithm, uncompressed size and stream size */
+    ok(Size > BUFFER_HEADER_SIZE && Size < sizeof(Input), "Compressed to %lu bytes\n", (ULONG)Size);
+    ok(*(ULONG UNALIGNED *)Buffer == BUFFER_SIGNATURE, "Signature is 0x%lx\n", *(ULONG UNALIGNED *)Buffer);
+    ok(Buffer[4] == Algorithm, "Algorithm is %u\n", Buffer[4]);
+    Field = *(UINT64 UNALIGNED *)(Buffer + 8);
+    ok(Field == sizeof(Input), "Uncompressed size is %I64u\n", Field);
+    Field = *(UINT64 UNALIGNED *)(Buffer + 16);
+    ok(Field == Size - BUFFER_HEADER_SIZE, "Stream size is %I64u of %lu\n", Field, (ULONG)Size);
+
+    Ret = pCreateDecompressor(Algorithm, NULL, &Decompressor);
+    ok(Ret, "CreateDecompressor(%lu) failed, error %lu\n", Algorithm, GetLastError());
+    if (!Ret)
+        return;
+    OutputSize = 0;
+    Ret = pDecompress(Decompressor, Buffer, Size, Output, sizeof(Output), &OutputSize);
+    ok(Ret, "Decompress(%lu) failed, error %lu\n", Algorithm, GetLastError());
+    ok(OutputSize == sizeof(Output), "Size is %lu\n", (ULONG)OutputSize);
+    ok(Ret && !memcmp(Output, Input, sizeof(Output)), "Wrong output\n");
+    pCloseDecompressor(Decompressor);
+}
+
+START_TEST(compressapi)
+{
+    HMODULE Module;
+
+    /* ReactOS keeps the compression API out of Wine's cabinet.dll */
+    Module = LoadLibraryW(L"cabinet.dll");
+    if (!Module || !GetProcAddress(Module, "Compress"))
+    {
+        if (Module)
+            FreeLibrary(Module);
+        Module = LoadLibraryW(L"cabiext.dll");
+    }
+    if (!Module)
+    {
+        skip("No compression API available\n");
+        return;
+    }
+
+    pCreateCompressor = (PFN_CreateCompressor)GetProcAddress(Module, "CreateCompressor");
+    pCompress = (PFN_Compress)GetProcAddress(Module, "Compress");
+    pCloseCompressor = (PFN_CloseCompressor)GetProcAddress(Module, "CloseCompressor");
+    pCreateDecompressor = (PFN_CreateDecompressor)GetProcAddress(Module, "CreateDecompressor");
+    pDecompress = (PFN_Decompress)GetProcAddress(Module, "Decompress");
+    pCloseDecompressor = (PFN_CloseDecompressor)GetProcAddress(Module, "CloseDecompressor");
+    if (!pCreateCompressor || !pCompress || !pCloseCompressor ||
+        !pCreateDecompressor || !pDecompress || !pCloseDecompressor)
+    {
+        skip("The compression API is incomplete\n");
+        FreeLibrary(Module);
+        return;
+    }
+
+    Test_ParseBuffer();
+    Test_RoundTrip(COMPRESS_ALGORITHM_XPRESS);
+    Test_RoundTrip(COMPRESS_ALGORITHM_XPRESS_HUFF);
+
+    FreeLibrary(Module);
+}
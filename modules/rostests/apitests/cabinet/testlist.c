@@ -0,0 +1,12 @@
+#define __ROS_LONG64__
+
+#define STANDALONE
+#include <apitest.h>
+
+extern void func_compressapi(void);
+
+const struct test winetest_testlist[] =
+{
+    { "compressapi", func_compressapi },
+    { 0, 0 }
+};
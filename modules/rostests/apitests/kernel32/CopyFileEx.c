@@ -0,0 +1,320 @@
+/*
+ * PROJECT:     ReactOS API tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for CopyFileEx, with a small-file and large-file benchmark
+ */
+
+#include "precomp.h"
+
+#ifndef COPY_FILE_NO_BUFFERING
+#define COPY_FILE_NO_BUFFERING 0x00001000
+#endif
+
+static WCHAR SourcePath[MAX_PATH];
+static WCHAR DestPath[MAX_PATH];
+static WCHAR TempDir[MAX_PATH];
+
+typedef struct _PROGRESS_STATE
+{
+    ULONG Calls;
+    ULONG StreamSwitches;
+    DWORD Result;
+    DWORD ResultAfter;
+    LARGE_INTEGER LastTransferred;
+    LARGE_INTEGER TotalSize;
+    BOOL Decreasing;
+} PROGRESS_STATE, *PPROGRESS_STATE;
+
+static
+BOOL
+WriteTestFile(PCWSTR Path, ULONG Size, ULONG Seed)
+{
+    PUCHAR Buffer;
+    ULONG i;
+    DWORD Written = 0;
+    HANDLE File;
+    BOOL Ret;
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, max(Size, 1));
+    if (!Buffer)
+        return FALSE;
+    for (i = 0; i < Size; i++)
+    {
+        Seed = Seed * 1103515245 + 12345;
+        Buffer[i] = (UCHAR)(Seed >> 16);
+    }
+
+    File = CreateFileW(Path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    Ret = (File != INVALID_HANDLE_VALUE);
+    if (Ret)
+    {
+        Ret = WriteFile(File, Buffer, Size, &Written, NULL) && Written == Size;
+        CloseHandle(File);
+    }
+    HeapFree(GetProcessHeap(), 0, Buffer);
+    return Ret;
+}
+
+static
+BOOL
+FilesEqual(PCWSTR Path1, PCWSTR Path2)
+{
+    HANDLE File1, File2;
+    UCHAR Buffer1[4096], Buffer2[4096];
+    DWORD Read1, Read2;
+    BOOL Equal = FALSE;
+
+    File1 = CreateFileW(Path1, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    File2 = CreateFileW(Path2, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    if (File1 != INVALID_HANDLE_VALUE && File2 != INVALID_HANDLE_VALUE &&
+        GetFileSize(File1, NULL) == GetFileSize(File2, NULL))
+    {
+        for (;;)
+        {
+            if (!ReadFile(File1, Buffer1, sizeof(Buffer1), &Read1, NULL) ||
+                !ReadFile(File2, Buffer2, sizeof(Buffer2), &Read2, NULL) ||
+                Read1 != Read2 || memcmp(Buffer1, Buffer2, Read1))
+            {
+                break;
+            }
+            if (Read1 == 0)
+            {
+                Equal = TRUE;
+                break;
+            }
+        }
+    }
+    if (File1 != INVALID_HANDLE_VALUE) CloseHandle(File1);
+    if (File2 != INVALID_HANDLE_VALUE) CloseHandle(File2);
+    return Equal;
+}
+
+static
+DWORD
+CALLBACK
+ProgressRoutine(LARGE_INTEGER TotalFileSize,
+                LARGE_INTEGER TotalBytesTransferred,
+                LARGE_INTEGER StreamSize,
+                LARGE_INTEGER StreamBytesTransferred,
+                DWORD dwStreamNumber,
+                DWORD dwCallbackReason,
+                HANDLE hSourceFile,
+                HANDLE hDestinationFile,
+                LPVOID lpData)
+{
+    PPROGRESS_STATE State = lpData;
+
+    State->Calls++;
+    if (dwCallbackReason == CALLBACK_STREAM_SWITCH)
+        State->StreamSwitches++;
+    if (TotalBytesTransferred.QuadPart < State->LastTransferred.QuadPart)
+        State->Decreasing = TRUE;
+    State->LastTransferred = TotalBytesTransferred;
+    State->TotalSize = TotalFileSize;
+    return State->Calls == 1 ? State->Result : State->ResultAfter;
+}
+
+static
+void
+Test_Sizes(void)
+{
+    static const ULONG Sizes[] = { 0, 1, 511, 4096, 65535, 65536, 65537, 1048577, 3 * 1048576 + 17 };
+    static const DWORD Flags[] = { 0, COPY_FILE_NO_BUFFERING };
+    ULONG i, j;
+    BOOL Ret;
+
+    for (i = 0; i < _countof(Sizes); i++)
+    {
+        if (!WriteTestFile(SourcePath, Sizes[i], i))
+        {
+            skip("Cannot create a file of %lu bytes\n", Sizes[i]);
+            continue;
+        }
+        for (j = 0; j < _countof(Flags); j++)
+        {
+            DeleteFileW(DestPath);
+            Ret = CopyFileExW(SourcePath, DestPath, NULL, NULL, NULL, Flags[j]);
+            ok(Ret, "%lu/0x%lx: CopyFileExW failed with %lu\n", Sizes[i], Flags[j], GetLastError());
+            ok(FilesEqual(SourcePath, DestPath), "%lu/0x%lx: Files differ\n", Sizes[i], Flags[j]);
+        }
+    }
+}
+
+static
+void
+Test_Flags(void)
+{
+    BOOL Ret;
+
+    if (!WriteTestFile(SourcePath, 1000, 1) || !WriteTestFile(DestPath, 10, 2))
+    {
+        skip("Cannot create test files\n");
+        return;
+    }
+
+    SetLastError(0xdeadbeef);
+    Ret = CopyFileExW(SourcePath, DestPath, NULL, NULL, NULL, COPY_FILE_FAIL_IF_EXISTS);
+    ok(!Ret, "CopyFileExW succeeded\n");
+    ok_err(ERROR_FILE_EXISTS);
+
+    /* Other flags must not make an existing destination an error */
+    Ret = CopyFileExW(SourcePath, DestPath, NULL, NULL, NULL, COPY_FILE_NO_BUFFERING);
+    ok(Ret, "CopyFileExW failed with %lu\n", GetLastError());
+    ok(FilesEqual(SourcePath, DestPath), "Files differ\n");
+}
+
+static
+void
+Test_Progress(void)
+{
+    PROGRESS_STATE State;
+    const ULONG Size = 24 * 1048576 + 5;
+    BOOL Ret;
+
+    if (!WriteTestFile(SourcePath, Size, 3))
+    {
+        skip("Cannot create test file\n");
+        return;
+    }
+
+    DeleteFileW(DestPath);
+    ZeroMemory(&State, sizeof(State));
+    State.Result = State.ResultAfter = PROGRESS_CONTINUE;
+    Ret = CopyFileExW(SourcePath, DestPath, ProgressRoutine, &State, NULL, 0);
+    ok(Ret, "CopyFileExW failed with %lu\n", GetLastError());
+    ok_long(State.StreamSwitches, 1);
+    ok(State.Calls >= 2, "Only %lu calls\n", State.Calls);
+    ok(!State.Decreasing, "Bytes transferred went backwards\n");
+    ok(State.LastTransferred.QuadPart == Size, "Last call at %I64u\n", State.LastTransferred.QuadPart);
+    ok(State.TotalSize.QuadPart == Size, "Total size %I64u\n", State.TotalSize.QuadPart);
+    ok(FilesEqual(SourcePath, DestPath), "Files differ\n");
+    trace("%lu progress calls for %lu bytes\n", State.Calls, Size);
+
+    /* PROGRESS_QUIET stops the notifications */
+    ZeroMemory(&State, sizeof(State));
+    State.Result = PROGRESS_QUIET;
+    State.ResultAfter = PROGRESS_CANCEL;
+    Ret = CopyFileExW(SourcePath, DestPath, ProgressRoutine, &State, NULL, 0);
+    ok(Ret, "CopyFileExW failed with %lu\n", GetLastError());
+    ok_long(State.Calls, 1);
+
+    /* PROGRESS_CANCEL deletes the destination, PROGRESS_STOP keeps it */
+    DeleteFileW(DestPath);
+    ZeroMemory(&State, sizeof(State));
+    State.Result = PROGRESS_CANCEL;
+    SetLastError(0xdeadbeef);
+    Ret = CopyFileExW(SourcePath, DestPath, ProgressRoutine, &State, NULL, 0);
+    ok(!Ret, "CopyFileExW succeeded\n");
+    ok_err(ERROR_REQUEST_ABORTED);
+    ok(GetFileAttributesW(DestPath) == INVALID_FILE_ATTRIBUTES, "Destination was kept\n");
+
+    ZeroMemory(&State, sizeof(State));
+    State.Result = PROGRESS_STOP;
+    SetLastError(0xdeadbeef);
+    Ret = CopyFileExW(SourcePath, DestPath, ProgressRoutine, &State, NULL, 0);
+    ok(!Ret, "CopyFileExW succeeded\n");
+    ok_err(ERROR_REQUEST_ABORTED);
+    ok(GetFileAttributesW(DestPath) != INVALID_FILE_ATTRIBUTES, "Destination was deleted\n");
+    DeleteFileW(DestPath);
+}
+
+static
+void
+Benchmark_SmallFiles(DWORD Flags)
+{
+    const ULONG Count = 200, Size = 4096;
+    WCHAR Source[MAX_PATH], Dest[MAX_PATH];
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG i, Failed = 0;
+
+    for (i = 0; i < Count; i++)
+    {
+        StringCchPrintfW(Source, _countof(Source), L"%s\\small%lu.src", TempDir, i);
+        if (!WriteTestFile(Source, Size, i))
+        {
+            skip("Cannot create test files\n");
+            goto Cleanup;
+        }
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < Count; i++)
+    {
+        StringCchPrintfW(Source, _countof(Source), L"%s\\small%lu.src", TempDir, i);
+        StringCchPrintfW(Dest, _countof(Dest), L"%s\\small%lu.dst", TempDir, i);
+        if (!CopyFileExW(Source, Dest, NULL, NULL, NULL, Flags))
+            Failed++;
+    }
+    QueryPerformanceCounter(&End);
+    ok_long(Failed, 0);
+
+    if (End.QuadPart > Start.QuadPart)
+    {
+        trace("Flags 0x%lx: %lu files of %lu bytes in %I64u ms\n", Flags, Count, Size,
+              (End.QuadPart - Start.QuadPart) * 1000 / Frequency.QuadPart);
+    }
+
+Cleanup:
+    for (i = 0; i < Count; i++)
+    {
+        StringCchPrintfW(Source, _countof(Source), L"%s\\small%lu.src", TempDir, i);
+        StringCchPrintfW(Dest, _countof(Dest), L"%s\\small%lu.dst", TempDir, i);
+        DeleteFileW(Source);
+        DeleteFileW(Dest);
+    }
+}
+
+static
+void
+Benchmark_LargeFile(DWORD Flags)
+{
+    const ULONG Size = 128 * 1048576;
+    LARGE_INTEGER Frequency, Start, End;
+    BOOL Ret;
+
+    if (!WriteTestFile(SourcePath, Size, 4))
+    {
+        skip("Cannot create a file of %lu bytes\n", Size);
+        return;
+    }
+
+    DeleteFileW(DestPath);
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    Ret = CopyFileExW(SourcePath, DestPath, NULL, NULL, NULL, Flags);
+    QueryPerformanceCounter(&End);
+    ok(Ret, "CopyFileExW failed with %lu\n", GetLastError());
+
+    if (Ret && End.QuadPart > Start.QuadPart)
+    {
+        trace("Flags 0x%lx: %lu MB in %I64u ms, %I64u MB/s\n", Flags, Size / 1048576,
+              (End.QuadPart - Start.QuadPart) * 1000 / Frequency.QuadPart,
+              (ULONGLONG)(Size / 1048576) * Frequency.QuadPart / (End.QuadPart - Start.QuadPart));
+    }
+    DeleteFileW(DestPath);
+}
+
+START_TEST(CopyFileEx)
+{
+    WCHAR TempPath[MAX_PATH];
+
+    GetTempPathW(_countof(TempPath), TempPath);
+    StringCchPrintfW(TempDir, _countof(TempDir), L"%sCopyFileEx", TempPath);
+    CreateDirectoryW(TempDir, NULL);
+    StringCchPrintfW(SourcePath, _countof(SourcePath), L"%s\\source.bin", TempDir);
+    StringCchPrintfW(DestPath, _countof(DestPath), L"%s\\dest.bin", TempDir);
+
+    Test_Sizes();
+    Test_Flags();
+    Test_Progress();
+
+    Benchmark_SmallFiles(0);
+    Benchmark_SmallFiles(COPY_FILE_NO_BUFFERING);
+    Benchmark_LargeFile(0);
+    Benchmark_LargeFile(COPY_FILE_NO_BUFFERING);
+
+    DeleteFileW(SourcePath);
+    DeleteFileW(DestPath);
+    RemoveDirectoryW(TempDir);
+}
@@ -0,0 +1,245 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Test and benchmark for timer queues and thread pool timers
+ */
+#include "precomp.h"
+
+#define BENCH_TIMERS 100000
+
+typedef VOID (CALLBACK *FN_TimerCallback)(PVOID, PVOID, PVOID);
+typedef PVOID (WINAPI *FN_CreateThreadpoolTimer)(FN_TimerCallback, PVOID, PVOID);
+typedef VOID (WINAPI *FN_SetThreadpoolTimer)(PVOID, PFILETIME, DWORD, DWORD);
+typedef VOID (WINAPI *FN_CloseThreadpoolTimer)(PVOID);
+typedef VOID (WINAPI *FN_WaitForThreadpoolTimerCallbacks)(PVOID, BOOL);
+
+static FN_CreateThreadpoolTimer pCreateThreadpoolTimer;
+static FN_SetThreadpoolTimer pSetThreadpoolTimer;
+static FN_CloseThreadpoolTimer pCloseThreadpoolTimer;
+static FN_WaitForThreadpoolTimerCallbacks pWaitForThreadpoolTimerCallbacks;
+
+static volatile LONG Fired;
+static volatile LONG FireTicks[2];
+
+static
+VOID
+CALLBACK
+QueueTimerCallback(PVOID Parameter, BOOLEAN TimerOrWaitFired)
+{
+    InterlockedIncrement(&Fired);
+}
+
+static
+VOID
+CALLBACK
+PoolTimerCallback(PVOID Instance, PVOID Context, PVOID Timer)
+{
+    LONG Index = (LONG)(ULONG_PTR)Context;
+
+    if (Index >= 0 && Index < _countof(FireTicks))
+        FireTicks[Index] = GetTickCount();
+    InterlockedIncrement(&Fired);
+}
+
+static
+VOID
+RelativeTime(PFILETIME FileTime, LONGLONG Milliseconds)
+{
+    ULARGE_INTEGER Due;
+
+    Due.QuadPart = (ULONGLONG)(-Milliseconds * 10000);
+    FileTime->dwLowDateTime = Due.LowPart;
+    FileTime->dwHighDateTime = Due.HighPart;
+}
+
+static
+VOID
+TestTimerQueue(VOID)
+{
+    HANDLE Queue, Timers[16];
+    ULONG i;
+
+    Queue = CreateTimerQueue();
+    ok(Queue != NULL, "CreateTimerQueue failed\n");
+    if (!Queue) return;
+
+    /* Timers armed out of order all fire */
+    Fired = 0;
+    for (i = 0; i < _countof(Timers); i++)
+    {
+        ok(CreateTimerQueueTimer(&Timers[i], Queue, QueueTimerCallback, NULL, 10 + (i * 37) % 100, 0, 0),
+           "CreateTimerQueueTimer %lu failed\n", i);
+    }
+
+    /* Cancel one before it fires, and rearm another one far out */
+    ok(DeleteTimerQueueTimer(Queue, Timers[3], INVALID_HANDLE_VALUE), "DeleteTimerQueueTimer failed\n");
+    ok(ChangeTimerQueueTimer(Queue, Timers[5], 60000, 0), "ChangeTimerQueueTimer failed\n");
+
+    Sleep(500);
+    ok_long(Fired, _countof(Timers) - 2);
+
+    ok(DeleteTimerQueueEx(Queue, INVALID_HANDLE_VALUE), "DeleteTimerQueueEx failed\n");
+}
+
+static
+VOID
+TestPoolTimerWindow(VOID)
+{
+    PVOID Timers[2];
+    FILETIME Due;
+    LONG Delta;
+    ULONG i;
+
+    Fired = 0;
+    for (i = 0; i < _countof(Timers); i++)
+    {
+        Timers[i] = pCreateThreadpoolTimer(PoolTimerCallback, (PVOID)(ULONG_PTR)i, NULL);
+        ok(Timers[i] != NULL, "CreateThreadpoolTimer failed\n");
+        if (!Timers[i]) return;
+    }
+
+    /* Due at 100 ms and 300 ms, but the second one may run up to 250 ms
+       early, so both windows overlap and they fire in the same wakeup */
+    RelativeTime(&Due, 100);
+    pSetThreadpoolTimer(Timers[0], &Due, 0, 0);
+    RelativeTime(&Due, 300);
+    pSetThreadpoolTimer(Timers[1], &Due, 0, 250);
+
+    Sleep(600);
+    ok_long(Fired, 2);
+
+    Delta = FireTicks[1] - FireTicks[0];
+    ok(Delta >= -30 && Delta <= 60, "Timers fired %ld ms apart\n", Delta);
+
+    for (i = 0; i < _countof(Timers); i++)
+    {
+        pWaitForThreadpoolTimerCallbacks(Timers[i], TRUE);
+        pCloseThreadpoolTimer(Timers[i]);
+    }
+}
+
+static
+VOID
+BenchmarkTimerQueue(VOID)
+{
+    LARGE_INTEGER Frequency, Start, Armed, End;
+    HANDLE Queue, *Timers;
+    ULONG i, Created;
+
+    Timers = HeapAlloc(GetProcessHeap(), 0, BENCH_TIMERS * sizeof(*Timers));
+    Queue = CreateTimerQueue();
+    if (!Timers || !Queue)
+    {
+        skip("Out of resources\n");
+        goto Cleanup;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    /* Far away and scattered due times, so that none of them fires */
+    for (Created = 0; Created < BENCH_TIMERS; Created++)
+    {
+        if (!CreateTimerQueueTimer(&Timers[Created], Queue, QueueTimerCallback, NULL,
+                                   600000 + (Created * 7919) % 600000, 0, 0))
+            break;
+    }
+    QueryPerformanceCounter(&Armed);
+    ok_long(Created, BENCH_TIMERS);
+
+    for (i = 0; i < Created; i++)
+        ChangeTimerQueueTimer(Queue, Timers[i], 600000 + (i * 104729) % 600000, 0);
+
+    QueryPerformanceCounter(&End);
+
+    trace("Timer queue: %lu timers, %.0f arms/s, %.0f rearms/s\n",
+          Created,
+          (double)Created * Frequency.QuadPart / (double)(Armed.QuadPart - Start.QuadPart),
+          (double)Created * Frequency.QuadPart / (double)(End.QuadPart - Armed.QuadPart));
+
+Cleanup:
+    if (Queue) DeleteTimerQueueEx(Queue, INVALID_HANDLE_VALUE);
+    if (Timers) HeapFree(GetProcessHeap(), 0, Timers);
+}
+
+static
+VOID
+BenchmarkPoolTimers(VOID)
+{
+    LARGE_INTEGER Frequency, Start, Armed, End;
+    PVOID *Timers;
+    FILETIME Due;
+    ULONG i, Created;
+
+    Timers = HeapAlloc(GetProcessHeap(), 0, BENCH_TIMERS * sizeof(*Timers));
+    if (!Timers)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+
+    for (Created = 0; Created < BENCH_TIMERS; Created++)
+    {
+        Timers[Created] = pCreateThreadpoolTimer(PoolTimerCallback, (PVOID)-1, NULL);
+        if (!Timers[Created]) break;
+    }
+    ok_long(Created, BENCH_TIMERS);
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    for (i = 0; i < Created; i++)
+    {
+        RelativeTime(&Due, 600000 + (i * 7919) % 600000);
+        pSetThreadpoolTimer(Timers[i], &Due, 0, i % 1000);
+    }
+    QueryPerformanceCounter(&Armed);
+
+    /* Cancel them all */
+    for (i = 0; i < Created; i++)
+        pSetThreadpoolTimer(Timers[i], NULL, 0, 0);
+
+    QueryPerformanceCounter(&End);
+
+    trace("Thread pool: %lu timers, %.0f arms/s, %.0f cancels/s\n",
+          Created,
+          (double)Created * Frequency.QuadPart / (double)(Armed.QuadPart - Start.QuadPart),
+          (double)Created * Frequency.QuadPart / (double)(End.QuadPart - Armed.QuadPart));
+
+    for (i = 0; i < Created; i++)
+        pCloseThreadpoolTimer(Timers[i]);
+    HeapFree(GetProcessHeap(), 0, Timers);
+}
+
+START_TEST(TimerQueue)
+{
+    HMODULE Module;
+
+    TestTimerQueue();
+    BenchmarkTimerQueue();
+
+    Module = GetModuleHandleW(L"kernel32.dll");
+    pCreateThreadpoolTimer = (FN_CreateThreadpoolTimer)GetProcAddress(Module, "CreateThreadpoolTimer");
+    if (!pCreateThreadpoolTimer)
+    {
+        Module = LoadLibraryW(L"kernelex.dll");
+        if (Module)
+            pCreateThreadpoolTimer = (FN_CreateThreadpoolTimer)GetProcAddress(Module, "CreateThreadpoolTimer");
+    }
+
+    if (pCreateThreadpoolTimer)
+    {
+        pSetThreadpoolTimer = (FN_SetThreadpoolTimer)GetProcAddress(Module, "SetThreadpoolTimer");
+        pCloseThreadpoolTimer = (FN_CloseThreadpoolTimer)GetProcAddress(Module, "CloseThreadpoolTimer");
+        pWaitForThreadpoolTimerCallbacks = (FN_WaitForThreadpoolTimerCallbacks)GetProcAddress(Module, "WaitForThreadpoolTimerCallbacks");
+    }
+
+    if (!pCreateThreadpoolTimer || !pSetThreadpoolTimer || !pCloseThreadpoolTimer || !pWaitForThreadpoolTimerCallbacks)
+    {
+        skip("Thread pool timers are not available\n");
+        return;
+    }
+
+    TestPoolTimerWindow();
+    BenchmarkPoolTimers();
+}
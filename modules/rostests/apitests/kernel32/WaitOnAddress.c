@@ -0,0 +1,219 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Test and benchmark for WaitOnAddress
+ */
+#include "precomp.h"
+
+#define BENCH_ROUNDS 20000
+
+typedef BOOL (WINAPI *FN_WaitOnAddress)(volatile VOID *, PVOID, SIZE_T, DWORD);
+typedef VOID (WINAPI *FN_WakeByAddress)(PVOID);
+
+static FN_WaitOnAddress pWaitOnAddress;
+static FN_WakeByAddress pWakeByAddressSingle;
+static FN_WakeByAddress pWakeByAddressAll;
+
+typedef struct _PING_PONG
+{
+    volatile LONG Turn;
+    BOOLEAN UseEvents;
+    HANDLE Events[2];
+} PING_PONG, *PPING_PONG;
+
+static volatile LONG Address;
+static volatile LONG Woken;
+
+static
+DWORD
+WINAPI
+WaitThread(PVOID Parameter)
+{
+    LONG Compare = 0;
+
+    while (Address == 0)
+    {
+        if (!pWaitOnAddress(&Address, &Compare, sizeof(Address), INFINITE))
+            break;
+    }
+
+    InterlockedIncrement(&Woken);
+    return 0;
+}
+
+static
+VOID
+TestWait(VOID)
+{
+    HANDLE Threads[4];
+    LONG Compare;
+    USHORT Short = 1, ShortCompare = 1;
+    DWORD Start;
+    ULONG i;
+
+    /* Different values return right away */
+    Address = 1;
+    Compare = 0;
+    ok(pWaitOnAddress(&Address, &Compare, sizeof(Address), INFINITE), "WaitOnAddress failed\n");
+
+    /* Same values time out */
+    Compare = 1;
+    Start = GetTickCount();
+    ok(!pWaitOnAddress(&Address, &Compare, sizeof(Address), 100), "WaitOnAddress succeeded\n");
+    ok(GetTickCount() - Start >= 50, "Waited only %lu ms\n", GetTickCount() - Start);
+
+    ok(!pWaitOnAddress(&Short, &ShortCompare, sizeof(Short), 0), "WaitOnAddress succeeded\n");
+
+    /* Only valid sizes are accepted */
+    SetLastError(0xdeadbeef);
+    ok(!pWaitOnAddress(&Address, &Compare, 3, 0), "WaitOnAddress succeeded\n");
+    ok_long(GetLastError(), ERROR_INVALID_PARAMETER);
+
+    /* Waking nobody is fine */
+    pWakeByAddressSingle((PVOID)&Address);
+    pWakeByAddressAll((PVOID)&Address);
+
+    /* Wake the waiters one by one, then all at once */
+    Address = 0;
+    Woken = 0;
+    for (i = 0; i < _countof(Threads); i++)
+        Threads[i] = CreateThread(NULL, 0, WaitThread, NULL, 0, NULL);
+
+    Sleep(100);
+    ok_long(Woken, 0);
+
+    /* A single wake on a value that didn't change lets one waiter go back to sleep */
+    pWakeByAddressSingle((PVOID)&Address);
+    Sleep(100);
+    ok_long(Woken, 0);
+
+    Address = 1;
+    pWakeByAddressSingle((PVOID)&Address);
+    Sleep(100);
+    ok_long(Woken, 1);
+
+    pWakeByAddressAll((PVOID)&Address);
+    ok_long(WaitForMultipleObjects(_countof(Threads), Threads, TRUE, 5000), WAIT_OBJECT_0);
+    ok_long(Woken, _countof(Threads));
+
+    for (i = 0; i < _countof(Threads); i++)
+        CloseHandle(Threads[i]);
+}
+
+static
+VOID
+PingPongWait(PPING_PONG Context, LONG Turn)
+{
+    LONG Compare = !Turn;
+
+    while (Context->Turn != Turn)
+    {
+        if (Context->UseEvents)
+            WaitForSingleObject(Context->Events[Turn], INFINITE);
+        else
+            pWaitOnAddress(&Context->Turn, &Compare, sizeof(Context->Turn), INFINITE);
+    }
+}
+
+static
+VOID
+PingPongPass(PPING_PONG Context, LONG Turn)
+{
+    Context->Turn = !Turn;
+
+    if (Context->UseEvents)
+        SetEvent(Context->Events[!Turn]);
+    else
+        pWakeByAddressSingle((PVOID)&Context->Turn);
+}
+
+static
+DWORD
+WINAPI
+PingPongThread(PVOID Parameter)
+{
+    PPING_PONG Context = Parameter;
+    ULONG i;
+
+    for (i = 0; i < BENCH_ROUNDS; i++)
+    {
+        PingPongWait(Context, 1);
+        PingPongPass(Context, 1);
+    }
+
+    return 0;
+}
+
+static
+double
+RunBench(BOOLEAN UseEvents)
+{
+    PING_PONG Context;
+    LARGE_INTEGER Frequency, Start, End;
+    HANDLE Thread;
+    ULONG i;
+
+    Context.Turn = 0;
+    Context.UseEvents = UseEvents;
+    Context.Events[0] = CreateEventW(NULL, FALSE, FALSE, NULL);
+    Context.Events[1] = CreateEventW(NULL, FALSE, FALSE, NULL);
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    Thread = CreateThread(NULL, 0, PingPongThread, &Context, 0, NULL);
+
+    for (i = 0; i < BENCH_ROUNDS; i++)
+    {
+        PingPongWait(&Context, 0);
+        PingPongPass(&Context, 0);
+    }
+
+    WaitForSingleObject(Thread, INFINITE);
+    QueryPerformanceCounter(&End);
+
+    CloseHandle(Thread);
+    CloseHandle(Context.Events[0]);
+    CloseHandle(Context.Events[1]);
+
+    /* Hand-offs per second */
+    return 2.0 * BENCH_ROUNDS * Frequency.QuadPart / (double)(End.QuadPart - Start.QuadPart);
+}
+
+static
+VOID
+Benchmark(VOID)
+{
+    double Events, Woa;
+
+    /* Events stand in for the old implementation, which created one per wait */
+    Events = RunBench(TRUE);
+    Woa = RunBench(FALSE);
+    trace("Ping-pong: events %.0f wakes/s, WaitOnAddress %.0f wakes/s (x%.2f)\n",
+          Events, Woa, Events ? Woa / Events : 0.0);
+}
+
+START_TEST(WaitOnAddress)
+{
+    HMODULE Module;
+
+    Module = GetModuleHandleW(L"api-ms-win-core-synch-l1-2-0.dll");
+    if (!Module) Module = LoadLibraryW(L"api-ms-win-core-synch-l1-2-0.dll");
+    if (!Module) Module = LoadLibraryW(L"kernelex.dll");
+
+    if (Module)
+    {
+        pWaitOnAddress = (FN_WaitOnAddress)GetProcAddress(Module, "WaitOnAddress");
+        pWakeByAddressSingle = (FN_WakeByAddress)GetProcAddress(Module, "WakeByAddressSingle");
+        pWakeByAddressAll = (FN_WakeByAddress)GetProcAddress(Module, "WakeByAddressAll");
+    }
+
+    if (!pWaitOnAddress || !pWakeByAddressSingle || !pWakeByAddressAll)
+    {
+        skip("WaitOnAddress is not available\n");
+        return;
+    }
+
+    TestWait();
+    Benchmark();
+}
@@ -4,6 +4,7 @@
 #include <apitest.h>
 
 extern void func_ConsoleCP(void);
+extern void func_CopyFileEx(void);
 extern void func_CreateProcess(void);
 extern void func_DefaultActCtx(void);
 extern void func_DeviceIoControl(void);
@@ -32,12 +33,15 @@ extern void func_SetCurrentDirectory(void);
 extern void func_SetUnhandledExceptionFilter(void);
 extern void func_SystemFirmware(void);
 extern void func_TerminateProcess(void);
+extern void func_TimerQueue(void);
 extern void func_TunnelCache(void);
+extern void func_WaitOnAddress(void);
 extern void func_WideCharToMultiByte(void);
 
 const struct test winetest_testlist[] =
 {
     { "ConsoleCP",                   func_ConsoleCP },
+    { "CopyFileEx",                  func_CopyFileEx },
     { "CreateProcess",               func_CreateProcess },
     { "DefaultActCtx",               func_DefaultActCtx },
     { "DeviceIoControl",             func_DeviceIoControl },
@@ -66,7 +70,9 @@ const struct test winetest_testlist[] =
     { "SetUnhandledExceptionFilter", func_SetUnhandledExceptionFilter },
     { "SystemFirmware",              func_SystemFirmware },
     { "TerminateProcess",            func_TerminateProcess },
+    { "TimerQueue",                  func_TimerQueue },
     { "TunnelCache",                 func_TunnelCache },
+    { "WaitOnAddress",               func_WaitOnAddress },
     { "WideCharToMultiByte",         func_WideCharToMultiByte },
     { 0, 0 }
 };
@@ -0,0 +1,193 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Test and benchmark for wait completion packets
+ */
+#include "precomp.h"
+
+#define BENCH_WAITS 4096
+
+typedef NTSTATUS (NTAPI *FN_NtCreateWaitCompletionPacket)(PHANDLE, ACCESS_MASK, POBJECT_ATTRIBUTES);
+typedef NTSTATUS (NTAPI *FN_NtAssociateWaitCompletionPacket)(HANDLE, HANDLE, HANDLE, PVOID, PVOID, NTSTATUS, ULONG_PTR, PBOOLEAN);
+typedef NTSTATUS (NTAPI *FN_NtCancelWaitCompletionPacket)(HANDLE, BOOLEAN);
+
+static FN_NtCreateWaitCompletionPacket pNtCreateWaitCompletionPacket;
+static FN_NtAssociateWaitCompletionPacket pNtAssociateWaitCompletionPacket;
+static FN_NtCancelWaitCompletionPacket pNtCancelWaitCompletionPacket;
+
+static
+NTSTATUS
+RemoveOne(HANDLE Port, PVOID *Key, PVOID *ApcContext, PIO_STATUS_BLOCK IoStatus, LONGLONG Milliseconds)
+{
+    LARGE_INTEGER Timeout;
+
+    Timeout.QuadPart = -Milliseconds * 10000;
+    return NtRemoveIoCompletion(Port, Key, ApcContext, IoStatus, &Timeout);
+}
+
+static
+VOID
+TestAssociate(VOID)
+{
+    HANDLE Port, Packet, Event, Mutant;
+    IO_STATUS_BLOCK IoStatus;
+    PVOID Key, ApcContext;
+    BOOLEAN Signaled;
+    NTSTATUS Status;
+
+    Status = NtCreateIoCompletion(&Port, IO_COMPLETION_ALL_ACCESS, NULL, 0);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status)) return;
+
+    Status = pNtCreateWaitCompletionPacket(&Packet, MAXIMUM_ALLOWED, NULL);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+    {
+        NtClose(Port);
+        return;
+    }
+
+    Event = CreateEventW(NULL, FALSE, FALSE, NULL);
+
+    /* Nothing is queued until the event is signaled */
+    Signaled = TRUE;
+    Status = pNtAssociateWaitCompletionPacket(Packet, Port, Event, (PVOID)1, (PVOID)2, STATUS_ABANDONED, 3, &Signaled);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok(!Signaled, "Already signaled\n");
+    ok_hex(RemoveOne(Port, &Key, &ApcContext, &IoStatus, 10), STATUS_TIMEOUT);
+
+    /* A packet can only be used for one wait at a time */
+    Status = pNtAssociateWaitCompletionPacket(Packet, Port, Event, NULL, NULL, STATUS_SUCCESS, 0, NULL);
+    ok_hex(Status, STATUS_INVALID_PARAMETER_1);
+
+    SetEvent(Event);
+    Status = RemoveOne(Port, &Key, &ApcContext, &IoStatus, 1000);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok(Key == (PVOID)1, "Key is %p\n", Key);
+    ok(ApcContext == (PVOID)2, "ApcContext is %p\n", ApcContext);
+    ok_hex(IoStatus.Status, STATUS_ABANDONED);
+    ok_size_t(IoStatus.Information, 3);
+
+    /* The wait was satisfied, so the auto reset event is reset */
+    ok_long(WaitForSingleObject(Event, 0), WAIT_TIMEOUT);
+
+    /* Once the completion is removed, there is nothing to cancel */
+    ok_hex(pNtCancelWaitCompletionPacket(Packet, TRUE), STATUS_CANCELLED);
+
+    /* Signaled objects queue the completion right away */
+    SetEvent(Event);
+    Signaled = FALSE;
+    Status = pNtAssociateWaitCompletionPacket(Packet, Port, Event, NULL, NULL, STATUS_SUCCESS, 0, &Signaled);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok(Signaled, "Not signaled\n");
+
+    /* A queued completion is left in the port, unless asked to take it back */
+    ok_hex(pNtCancelWaitCompletionPacket(Packet, FALSE), STATUS_PENDING);
+    ok_hex(pNtCancelWaitCompletionPacket(Packet, TRUE), STATUS_SUCCESS);
+    ok_hex(RemoveOne(Port, &Key, &ApcContext, &IoStatus, 10), STATUS_TIMEOUT);
+
+    /* A wait which isn't signaled yet is cancelled without touching the object */
+    Status = pNtAssociateWaitCompletionPacket(Packet, Port, Event, NULL, NULL, STATUS_SUCCESS, 0, NULL);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_hex(pNtCancelWaitCompletionPacket(Packet, FALSE), STATUS_SUCCESS);
+    SetEvent(Event);
+    ok_hex(RemoveOne(Port, &Key, &ApcContext, &IoStatus, 10), STATUS_TIMEOUT);
+    ok_long(WaitForSingleObject(Event, 0), WAIT_OBJECT_0);
+
+    /* Mutants can't be owned without a thread */
+    Mutant = CreateMutexW(NULL, FALSE, NULL);
+    Status = pNtAssociateWaitCompletionPacket(Packet, Port, Mutant, NULL, NULL, STATUS_SUCCESS, 0, NULL);
+    ok_hex(Status, STATUS_OBJECT_TYPE_MISMATCH);
+    CloseHandle(Mutant);
+
+    /* Closing the packet cancels its wait */
+    Status = pNtAssociateWaitCompletionPacket(Packet, Port, Event, NULL, NULL, STATUS_SUCCESS, 0, NULL);
+    ok_hex(Status, STATUS_SUCCESS);
+    NtClose(Packet);
+    SetEvent(Event);
+    ok_hex(RemoveOne(Port, &Key, &ApcContext, &IoStatus, 10), STATUS_TIMEOUT);
+
+    CloseHandle(Event);
+    NtClose(Port);
+}
+
+static
+VOID
+Benchmark(VOID)
+{
+    LARGE_INTEGER Frequency, Start, Armed, End;
+    HANDLE Port, *Packets, *Events;
+    IO_STATUS_BLOCK IoStatus;
+    PVOID Key, ApcContext;
+    ULONG Created, Total, i;
+    NTSTATUS Status;
+
+    Packets = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, BENCH_WAITS * sizeof(*Packets));
+    Events = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, BENCH_WAITS * sizeof(*Events));
+    if (!Packets || !Events || !NT_SUCCESS(NtCreateIoCompletion(&Port, IO_COMPLETION_ALL_ACCESS, NULL, 0)))
+    {
+        skip("Out of resources\n");
+        goto Cleanup;
+    }
+
+    for (Created = 0; Created < BENCH_WAITS; Created++)
+    {
+        Events[Created] = CreateEventW(NULL, FALSE, FALSE, NULL);
+        if (!Events[Created] ||
+            !NT_SUCCESS(pNtCreateWaitCompletionPacket(&Packets[Created], MAXIMUM_ALLOWED, NULL)))
+            break;
+    }
+    ok_long(Created, BENCH_WAITS);
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    /* Far more waits than a thread could wait on, all on a single port */
+    for (i = 0; i < Created; i++)
+        pNtAssociateWaitCompletionPacket(Packets[i], Port, Events[i], (PVOID)(ULONG_PTR)i, NULL, STATUS_SUCCESS, 0, NULL);
+    QueryPerformanceCounter(&Armed);
+
+    for (i = 0; i < Created; i++)
+        SetEvent(Events[i]);
+
+    for (Total = 0; Total < Created; Total++)
+    {
+        Status = RemoveOne(Port, &Key, &ApcContext, &IoStatus, 1000);
+        if (Status != STATUS_SUCCESS) break;
+    }
+    QueryPerformanceCounter(&End);
+
+    ok_long(Total, Created);
+    trace("%lu waits: %.0f associations/s, %.0f signals/s\n",
+          Created,
+          (double)Created * Frequency.QuadPart / (double)(Armed.QuadPart - Start.QuadPart),
+          (double)Total * Frequency.QuadPart / (double)(End.QuadPart - Armed.QuadPart));
+
+    NtClose(Port);
+
+Cleanup:
+    for (i = 0; i < BENCH_WAITS; i++)
+    {
+        if (Packets && Packets[i]) NtClose(Packets[i]);
+        if (Events && Events[i]) CloseHandle(Events[i]);
+    }
+    if (Packets) HeapFree(GetProcessHeap(), 0, Packets);
+    if (Events) HeapFree(GetProcessHeap(), 0, Events);
+}
+
+START_TEST(NtAssociateWaitCompletionPacket)
+{
+    HMODULE Module = GetModuleHandleW(L"ntdll.dll");
+
+    pNtCreateWaitCompletionPacket = (FN_NtCreateWaitCompletionPacket)GetProcAddress(Module, "NtCreateWaitCompletionPacket");
+    pNtAssociateWaitCompletionPacket = (FN_NtAssociateWaitCompletionPacket)GetProcAddress(Module, "NtAssociateWaitCompletionPacket");
+    pNtCancelWaitCompletionPacket = (FN_NtCancelWaitCompletionPacket)GetProcAddress(Module, "NtCancelWaitCompletionPacket");
+    if (!pNtCreateWaitCompletionPacket || !pNtAssociateWaitCompletionPacket || !pNtCancelWaitCompletionPacket)
+    {
+        skip("Wait completion packets are not available\n");
+        return;
+    }
+
+    TestAssociate();
+    Benchmark();
+}
@@ -0,0 +1,138 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Test and benchmark for NtRemoveIoCompletionEx
+ */
+#include "precomp.h"
+
+#define BENCH_PACKETS 100000
+
+typedef NTSTATUS (NTAPI *FN_NtRemoveIoCompletionEx)(HANDLE, PFILE_IO_COMPLETION_INFORMATION, ULONG, PULONG, PLARGE_INTEGER, BOOLEAN);
+
+static FN_NtRemoveIoCompletionEx pNtRemoveIoCompletionEx;
+
+static
+VOID
+NTAPI
+DummyApc(ULONG_PTR Parameter)
+{
+    *(PBOOLEAN)Parameter = TRUE;
+}
+
+static
+VOID
+TestRemove(VOID)
+{
+    FILE_IO_COMPLETION_INFORMATION Info[8];
+    LARGE_INTEGER Timeout;
+    BOOLEAN ApcCalled = FALSE;
+    HANDLE Port;
+    NTSTATUS Status;
+    ULONG Removed, i;
+
+    Status = NtCreateIoCompletion(&Port, IO_COMPLETION_ALL_ACCESS, NULL, 0);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status)) return;
+
+    /* Nothing queued */
+    Timeout.QuadPart = -10000;
+    Removed = 0xdeadbeef;
+    Status = pNtRemoveIoCompletionEx(Port, Info, _countof(Info), &Removed, &Timeout, FALSE);
+    ok_hex(Status, STATUS_TIMEOUT);
+    ok_long(Removed, 0);
+
+    /* Zero entries is invalid */
+    Status = pNtRemoveIoCompletionEx(Port, Info, 0, &Removed, &Timeout, FALSE);
+    ok_hex(Status, STATUS_INVALID_PARAMETER);
+
+    /* Queue some packets, get them in order and in a single call */
+    for (i = 0; i < 5; i++)
+    {
+        Status = NtSetIoCompletion(Port, (PVOID)(ULONG_PTR)(i + 1), (PVOID)(ULONG_PTR)(i + 100), STATUS_SUCCESS, i * 10);
+        ok_hex(Status, STATUS_SUCCESS);
+    }
+
+    Status = pNtRemoveIoCompletionEx(Port, Info, _countof(Info), &Removed, &Timeout, FALSE);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_long(Removed, 5);
+    for (i = 0; i < Removed; i++)
+    {
+        ok(Info[i].KeyContext == (PVOID)(ULONG_PTR)(i + 1), "Key %lu is %p\n", i, Info[i].KeyContext);
+        ok(Info[i].ApcContext == (PVOID)(ULONG_PTR)(i + 100), "ApcContext %lu is %p\n", i, Info[i].ApcContext);
+        ok_hex(Info[i].IoStatusBlock.Status, STATUS_SUCCESS);
+        ok_size_t(Info[i].IoStatusBlock.Information, i * 10);
+    }
+
+    /* Only as many as asked for */
+    for (i = 0; i < 3; i++)
+        NtSetIoCompletion(Port, NULL, NULL, STATUS_SUCCESS, 0);
+    Status = pNtRemoveIoCompletionEx(Port, Info, 2, &Removed, &Timeout, FALSE);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_long(Removed, 2);
+    Status = pNtRemoveIoCompletionEx(Port, Info, 2, &Removed, &Timeout, FALSE);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_long(Removed, 1);
+
+    /* An alertable wait gets interrupted by user APCs */
+    QueueUserAPC(DummyApc, GetCurrentThread(), (ULONG_PTR)&ApcCalled);
+    Timeout.QuadPart = -10000000;
+    Status = pNtRemoveIoCompletionEx(Port, Info, _countof(Info), &Removed, &Timeout, TRUE);
+    ok_hex(Status, STATUS_USER_APC);
+    ok_long(Removed, 0);
+    ok(ApcCalled, "APC was not called\n");
+
+    NtClose(Port);
+}
+
+static
+VOID
+Benchmark(VOID)
+{
+    static const ULONG BatchSizes[] = { 1, 16, 64 };
+    FILE_IO_COMPLETION_INFORMATION Info[64];
+    LARGE_INTEGER Frequency, Start, End, Timeout;
+    ULONG Removed, Total, i, j;
+    HANDLE Port;
+    NTSTATUS Status;
+
+    if (!NT_SUCCESS(NtCreateIoCompletion(&Port, IO_COMPLETION_ALL_ACCESS, NULL, 0)))
+        return;
+
+    QueryPerformanceFrequency(&Frequency);
+    Timeout.QuadPart = 0;
+
+    for (i = 0; i < _countof(BatchSizes); i++)
+    {
+        for (j = 0; j < BENCH_PACKETS; j++)
+            NtSetIoCompletion(Port, NULL, NULL, STATUS_SUCCESS, j);
+
+        QueryPerformanceCounter(&Start);
+        for (Total = 0; Total < BENCH_PACKETS; Total += Removed)
+        {
+            Status = pNtRemoveIoCompletionEx(Port, Info, BatchSizes[i], &Removed, &Timeout, FALSE);
+            if (Status != STATUS_SUCCESS) break;
+        }
+        QueryPerformanceCounter(&End);
+
+        ok_long(Total, BENCH_PACKETS);
+        trace("%2lu entries per call: %.0f packets/s\n",
+              BatchSizes[i],
+              (double)Total * Frequency.QuadPart / (double)(End.QuadPart - Start.QuadPart));
+    }
+
+    NtClose(Port);
+}
+
+START_TEST(NtRemoveIoCompletionEx)
+{
+    pNtRemoveIoCompletionEx = (FN_NtRemoveIoCompletionEx)GetProcAddress(GetModuleHandleW(L"ntdll.dll"),
+                                                                        "NtRemoveIoCompletionEx");
+    if (!pNtRemoveIoCompletionEx)
+    {
+        skip("NtRemoveIoCompletionEx is not available\n");
+        return;
+    }
+
+    TestRemove();
+    Benchmark();
+}
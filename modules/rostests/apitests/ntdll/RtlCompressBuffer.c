@@ -0,0 +1,228 @@
+/*
+ * PROJECT:     ReactOS API tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for RtlCompressBuffer with the XPRESS formats
+ */
+
+#include "precomp.h"
+
+/* [MS-XCA] 3.1 and 3.2 example data */
+static const UCHAR Alphabet[] = "abcdefghijklmnopqrstuvwxyz";
+static const UCHAR AlphabetXpress[] =
+{
+    0x3f, 0x00, 0x00, 0x00, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72, 0x73, 0x74,
+    0x75, 0x76, 0x77, 0x78, 0x79, 0x7a
+};
+static const UCHAR AbcXpress[] =
+{
+    0xff, 0xff, 0xff, 0x1f, 0x61, 0x62, 0x63, 0x17, 0x00, 0x0f, 0xff, 0x26,
+    0x01
+};
+
+static
+void
+FillBuffer(PUCHAR Buffer, ULONG Size, ULONG Kind)
+{
+    static const char Text[] = "The quick brown fox jumps over the lazy dog. ";
+    ULONG Seed = 0x1234, i;
+
+    for (i = 0; i < Size; i++)
+    {
+        switch (Kind)
+        {
+            case 0:
+                Buffer[i] = 0;
+                break;
+            case 1:
+                Buffer[i] = (UCHAR)RtlRandom(&Seed);
+                break;
+            default:
+                Buffer[i] = Text[i % (sizeof(Text) - 1)] ^ (RtlRandom(&Seed) % 61 == 0);
+                break;
+        }
+    }
+}
+
+static
+void
+Test_Vectors(PVOID WorkSpace)
+{
+    UCHAR Buffer[512];
+    ULONG Size;
+    NTSTATUS Status;
+    ULONG i;
+
+    Size = 0xdeadbeef;
+    Status = RtlCompressBuffer(COMPRESSION_FORMAT_XPRESS, (PUCHAR)Alphabet, 26,
+                               Buffer, sizeof(Buffer), 4096, &Size, WorkSpace);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok_int(Size, sizeof(AlphabetXpress));
+    ok(!memcmp(Buffer, AlphabetXpress, sizeof(AlphabetXpress)), "Wrong compressed data\n");
+
+    Size = 0xdeadbeef;
+    Status = RtlDecompressBuffer(COMPRESSION_FORMAT_XPRESS, Buffer, sizeof(Buffer),
+                                 (PUCHAR)AbcXpress, sizeof(AbcXpress), &Size);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok_int(Size, 300);
+    for (i = 0; i < 300; i++)
+    {
+        if (Buffer[i] != "abc"[i % 3])
+            break;
+    }
+    ok_int(i, 300);
+
+    /* Truncated and corrupted input */
+    Status = RtlDecompressBuffer(COMPRESSION_FORMAT_XPRESS, Buffer, sizeof(Buffer),
+                                 (PUCHAR)AbcXpress, 9, &Size);
+    ok_ntstatus(Status, STATUS_BAD_COMPRESSION_BUFFER);
+
+    Status = RtlDecompressBuffer(COMPRESSION_FORMAT_XPRESS_HUFF, Buffer, sizeof(Buffer),
+                                 (PUCHAR)AbcXpress, sizeof(AbcXpress), &Size);
+    ok_ntstatus(Status, STATUS_BAD_COMPRESSION_BUFFER);
+}
+
+static
+void
+Test_RoundTrip(USHORT Format, PVOID WorkSpace, PVOID FragmentWorkSpace)
+{
+    static const ULONG Sizes[] = { 0, 1, 3, 4, 32, 33, 4095, 65536, 65537, 300000 };
+    ULONG Kind, i, CompressedSize, FinalSize;
+    PUCHAR Input, Compressed, Output;
+    NTSTATUS Status;
+
+    Input = RtlAllocateHeap(RtlGetProcessHeap(), 0, 300000);
+    Compressed = RtlAllocateHeap(RtlGetProcessHeap(), 0, 2 * 300000);
+    Output = RtlAllocateHeap(RtlGetProcessHeap(), 0, 300000 + 16);
+    if (!Input || !Compressed || !Output)
+    {
+        skip("Out of memory\n");
+        goto Cleanup;
+    }
+
+    for (Kind = 0; Kind < 3; Kind++)
+    {
+        for (i = 0; i < RTL_NUMBER_OF(Sizes); i++)
+        {
+            FillBuffer(Input, Sizes[i], Kind);
+
+            CompressedSize = 0xdeadbeef;
+            Status = RtlCompressBuffer(Format, Input, Sizes[i], Compressed, 2 * 300000,
+                                       4096, &CompressedSize, WorkSpace);
+            ok(Status == STATUS_SUCCESS, "0x%x/%lu/%lu: Status 0x%lx\n", Format, Kind, Sizes[i], Status);
+            if (Status != STATUS_SUCCESS)
+                continue;
+            if (Kind == 0 && Sizes[i] >= 65536)
+                ok(CompressedSize < Sizes[i] / 16, "0x%x/%lu: %lu bytes\n", Format, Sizes[i], CompressedSize);
+
+            FinalSize = 0xdeadbeef;
+            memset(Output, 0x55, Sizes[i] + 16);
+            Status = RtlDecompressFragment(Format, Output, Sizes[i] + 16, Compressed, CompressedSize,
+                                           0, &FinalSize, FragmentWorkSpace);
+            ok(Status == STATUS_SUCCESS, "0x%x/%lu/%lu: Status 0x%lx\n", Format, Kind, Sizes[i], Status);
+            ok(FinalSize == Sizes[i], "0x%x/%lu/%lu: FinalSize %lu\n", Format, Kind, Sizes[i], FinalSize);
+            ok(!memcmp(Output, Input, Sizes[i]), "0x%x/%lu/%lu: Wrong data\n", Format, Kind, Sizes[i]);
+            ok(Output[Sizes[i]] == 0x55, "0x%x/%lu/%lu: Buffer overrun\n", Format, Kind, Sizes[i]);
+
+            /* Output buffer one byte too small */
+            if (CompressedSize > 1)
+            {
+                Status = RtlCompressBuffer(Format, Input, Sizes[i], Compressed, CompressedSize - 1,
+                                           4096, &FinalSize, WorkSpace);
+                ok(Status == STATUS_BUFFER_TOO_SMALL, "0x%x/%lu/%lu: Status 0x%lx\n", Format, Kind, Sizes[i], Status);
+            }
+        }
+    }
+
+Cleanup:
+    if (Output) RtlFreeHeap(RtlGetProcessHeap(), 0, Output);
+    if (Compressed) RtlFreeHeap(RtlGetProcessHeap(), 0, Compressed);
+    if (Input) RtlFreeHeap(RtlGetProcessHeap(), 0, Input);
+}
+
+static
+void
+Test_Throughput(USHORT Format, PVOID WorkSpace, PVOID FragmentWorkSpace)
+{
+    const ULONG Size = 4 * 1024 * 1024;
+    LARGE_INTEGER Frequency, Start, Middle, End;
+    ULONG CompressedSize, FinalSize;
+    PUCHAR Input, Compressed, Output;
+    NTSTATUS Status;
+
+    Input = RtlAllocateHeap(RtlGetProcessHeap(), 0, Size);
+    Compressed = RtlAllocateHeap(RtlGetProcessHeap(), 0, 2 * Size);
+    Output = RtlAllocateHeap(RtlGetProcessHeap(), 0, Size);
+    if (!Input || !Compressed || !Output)
+    {
+        skip("Out of memory\n");
+        goto Cleanup;
+    }
+    FillBuffer(Input, Size, 2);
+
+    NtQueryPerformanceCounter(&Start, &Frequency);
+    Status = RtlCompressBuffer(Format, Input, Size, Compressed, 2 * Size,
+                               4096, &CompressedSize, WorkSpace);
+    NtQueryPerformanceCounter(&Middle, NULL);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Status = RtlDecompressFragment(Format, Output, Size, Compressed, CompressedSize,
+                                   0, &FinalSize, FragmentWorkSpace);
+    NtQueryPerformanceCounter(&End, NULL);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok_int(FinalSize, Size);
+
+    if (Middle.QuadPart > Start.QuadPart && End.QuadPart > Middle.QuadPart)
+    {
+        trace("Format 0x%x: %lu%% of input, compress %I64u KB/s, decompress %I64u KB/s\n",
+              Format, (ULONG)((ULONGLONG)CompressedSize * 100 / Size),
+              (ULONGLONG)Size / 1024 * Frequency.QuadPart / (Middle.QuadPart - Start.QuadPart),
+              (ULONGLONG)Size / 1024 * Frequency.QuadPart / (End.QuadPart - Middle.QuadPart));
+    }
+
+Cleanup:
+    if (Output) RtlFreeHeap(RtlGetProcessHeap(), 0, Output);
+    if (Compressed) RtlFreeHeap(RtlGetProcessHeap(), 0, Compressed);
+    if (Input) RtlFreeHeap(RtlGetProcessHeap(), 0, Input);
+}
+
+START_TEST(RtlCompressBuffer)
+{
+    static const USHORT Formats[] =
+    {
+        COMPRESSION_FORMAT_XPRESS | COMPRESSION_ENGINE_STANDARD,
+        COMPRESSION_FORMAT_XPRESS | COMPRESSION_ENGINE_MAXIMUM,
+        COMPRESSION_FORMAT_XPRESS_HUFF | COMPRESSION_ENGINE_STANDARD,
+        COMPRESSION_FORMAT_XPRESS_HUFF | COMPRESSION_ENGINE_MAXIMUM,
+    };
+    ULONG WorkSpaceSize, FragmentWorkSpaceSize, i;
+    PVOID WorkSpace, FragmentWorkSpace;
+    NTSTATUS Status;
+
+    for (i = 0; i < RTL_NUMBER_OF(Formats); i++)
+    {
+        Status = RtlGetCompressionWorkSpaceSize(Formats[i], &WorkSpaceSize, &FragmentWorkSpaceSize);
+        if (Status == STATUS_UNSUPPORTED_COMPRESSION)
+        {
+            skip("Format 0x%x not supported\n", Formats[i]);
+            continue;
+        }
+        ok_ntstatus(Status, STATUS_SUCCESS);
+
+        WorkSpace = RtlAllocateHeap(RtlGetProcessHeap(), 0, WorkSpaceSize);
+        FragmentWorkSpace = RtlAllocateHeap(RtlGetProcessHeap(), 0, FragmentWorkSpaceSize + 1);
+        if (!WorkSpace || !FragmentWorkSpace)
+        {
+            skip("Out of memory\n");
+        }
+        else
+        {
+            if (i == 0)
+                Test_Vectors(WorkSpace);
+            Test_RoundTrip(Formats[i], WorkSpace, FragmentWorkSpace);
+            Test_Throughput(Formats[i], WorkSpace, FragmentWorkSpace);
+        }
+
+        if (FragmentWorkSpace) RtlFreeHeap(RtlGetProcessHeap(), 0, FragmentWorkSpace);
+        if (WorkSpace) RtlFreeHeap(RtlGetProcessHeap(), 0, WorkSpace);
+    }
+}
@@ -0,0 +1,223 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Test and benchmark for the low fragmentation heap
+ */
+#include "precomp.h"
+
+#define HEAP_LFH 2
+#define BENCH_ITERATIONS 200000
+#define BENCH_BATCH 64
+
+typedef struct _BENCH_CONTEXT
+{
+    HANDLE Heap;
+    HANDLE StartEvent;
+    ULONG Seed;
+} BENCH_CONTEXT, *PBENCH_CONTEXT;
+
+static
+ULONG
+QueryFrontEnd(HANDLE Heap)
+{
+    ULONG Type = 0xdeadbeef;
+    SIZE_T ReturnLength = 0;
+    NTSTATUS Status;
+
+    Status = RtlQueryHeapInformation(Heap, HeapCompatibilityInformation, &Type, sizeof(Type), &ReturnLength);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_size_t(ReturnLength, sizeof(ULONG));
+    return Type;
+}
+
+static
+VOID
+TestEnable(VOID)
+{
+    HANDLE Heap;
+    ULONG Type;
+    NTSTATUS Status;
+
+    Heap = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    ok(Heap != NULL, "RtlCreateHeap failed\n");
+    if (!Heap) return;
+
+    ok_long(QueryFrontEnd(Heap), 0);
+
+    Type = 1;
+    Status = RtlSetHeapInformation(Heap, HeapCompatibilityInformation, &Type, sizeof(Type));
+    ok_hex(Status, STATUS_UNSUCCESSFUL);
+
+    Type = HEAP_LFH;
+    Status = RtlSetHeapInformation(Heap, HeapCompatibilityInformation, &Type, sizeof(USHORT));
+    ok_hex(Status, STATUS_BUFFER_TOO_SMALL);
+
+    Status = RtlSetHeapInformation(Heap, HeapCompatibilityInformation, &Type, sizeof(Type));
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_long(QueryFrontEnd(Heap), HEAP_LFH);
+
+    /* Enabling it twice is fine */
+    Status = RtlSetHeapInformation(Heap, HeapCompatibilityInformation, &Type, sizeof(Type));
+    ok_hex(Status, STATUS_SUCCESS);
+
+    RtlDestroyHeap(Heap);
+
+    /* Unserialized heaps can't have it */
+    Heap = RtlCreateHeap(HEAP_GROWABLE | HEAP_NO_SERIALIZE, NULL, 0, 0, NULL, NULL);
+    ok(Heap != NULL, "RtlCreateHeap failed\n");
+    if (!Heap) return;
+
+    Status = RtlSetHeapInformation(Heap, HeapCompatibilityInformation, &Type, sizeof(Type));
+    ok(!NT_SUCCESS(Status), "Status = 0x%lx\n", Status);
+    ok_long(QueryFrontEnd(Heap), 0);
+
+    RtlDestroyHeap(Heap);
+}
+
+static
+VOID
+TestBlocks(VOID)
+{
+    HANDLE Heap;
+    ULONG Type = HEAP_LFH;
+    PUCHAR Blocks[256];
+    SIZE_T Size, i, j;
+    BOOLEAN Zeroed;
+
+    Heap = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    ok(Heap != NULL, "RtlCreateHeap failed\n");
+    if (!Heap) return;
+
+    ok_hex(RtlSetHeapInformation(Heap, HeapCompatibilityInformation, &Type, sizeof(Type)), STATUS_SUCCESS);
+
+    for (i = 0; i < _countof(Blocks); i++)
+    {
+        Size = 1 + (i * 7) % 900;
+        Blocks[i] = RtlAllocateHeap(Heap, 0, Size);
+        ok(Blocks[i] != NULL, "Allocation %Iu failed\n", i);
+        if (!Blocks[i]) continue;
+        ok_size_t(RtlSizeHeap(Heap, 0, Blocks[i]), Size);
+        memset(Blocks[i], 0xCC, Size);
+    }
+
+    /* Free half of them, so they get cached, and reuse them with zeroing */
+    for (i = 0; i < _countof(Blocks); i += 2)
+        ok(RtlFreeHeap(Heap, 0, Blocks[i]), "Free %Iu failed\n", i);
+
+    for (i = 0; i < _countof(Blocks); i += 2)
+    {
+        Size = 1 + (i * 7) % 900;
+        Blocks[i] = RtlAllocateHeap(Heap, HEAP_ZERO_MEMORY, Size);
+        ok(Blocks[i] != NULL, "Allocation %Iu failed\n", i);
+        if (!Blocks[i]) continue;
+        ok_size_t(RtlSizeHeap(Heap, 0, Blocks[i]), Size);
+
+        for (j = 0, Zeroed = TRUE; j < Size; j++)
+            Zeroed = Zeroed && (Blocks[i][j] == 0);
+        ok(Zeroed, "Block %Iu is not zeroed\n", i);
+    }
+
+    /* A cached block must not be freed twice */
+    ok(RtlFreeHeap(Heap, 0, Blocks[0]), "Free failed\n");
+    ok(!RtlFreeHeap(Heap, 0, Blocks[0]), "Double free succeeded\n");
+
+    for (i = 1; i < _countof(Blocks); i++)
+        ok(RtlFreeHeap(Heap, 0, Blocks[i]), "Free %Iu failed\n", i);
+
+    ok(RtlValidateHeap(Heap, 0, NULL), "Heap is corrupted\n");
+
+    RtlDestroyHeap(Heap);
+}
+
+static
+DWORD
+WINAPI
+BenchThread(PVOID Parameter)
+{
+    PBENCH_CONTEXT Context = Parameter;
+    PVOID Blocks[BENCH_BATCH];
+    ULONG Seed = Context->Seed;
+    ULONG i, j;
+
+    WaitForSingleObject(Context->StartEvent, INFINITE);
+
+    for (i = 0; i < BENCH_ITERATIONS / BENCH_BATCH; i++)
+    {
+        for (j = 0; j < BENCH_BATCH; j++)
+        {
+            Seed = Seed * 1103515245 + 12345;
+            Blocks[j] = RtlAllocateHeap(Context->Heap, 0, 8 + (Seed >> 16) % 248);
+        }
+
+        for (j = 0; j < BENCH_BATCH; j++)
+            RtlFreeHeap(Context->Heap, 0, Blocks[j]);
+    }
+
+    return 0;
+}
+
+static
+double
+RunBench(BOOLEAN UseLfh, ULONG ThreadCount)
+{
+    BENCH_CONTEXT Contexts[16];
+    HANDLE Threads[16];
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG Type = HEAP_LFH;
+    HANDLE Heap, StartEvent;
+    ULONG i;
+
+    Heap = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    if (!Heap) return 0.0;
+
+    if (UseLfh)
+        RtlSetHeapInformation(Heap, HeapCompatibilityInformation, &Type, sizeof(Type));
+
+    StartEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        Contexts[i].Heap = Heap;
+        Contexts[i].StartEvent = StartEvent;
+        Contexts[i].Seed = i;
+        Threads[i] = CreateThread(NULL, 0, BenchThread, &Contexts[i], 0, NULL);
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    SetEvent(StartEvent);
+    WaitForMultipleObjects(ThreadCount, Threads, TRUE, INFINITE);
+    QueryPerformanceCounter(&End);
+
+    for (i = 0; i < ThreadCount; i++)
+        CloseHandle(Threads[i]);
+    CloseHandle(StartEvent);
+    RtlDestroyHeap(Heap);
+
+    /* Allocation + free pairs per second */
+    return (double)ThreadCount * BENCH_ITERATIONS * Frequency.QuadPart / (double)(End.QuadPart - Start.QuadPart);
+}
+
+static
+VOID
+Benchmark(VOID)
+{
+    static const ULONG ThreadCounts[] = { 1, 2, 4, 8, 16 };
+    double Backend, FrontEnd;
+    ULONG i;
+
+    for (i = 0; i < _countof(ThreadCounts); i++)
+    {
+        Backend = RunBench(FALSE, ThreadCounts[i]);
+        FrontEnd = RunBench(TRUE, ThreadCounts[i]);
+        trace("%2lu threads: back end %.0f ops/s, LFH %.0f ops/s (x%.2f)\n",
+              ThreadCounts[i], Backend, FrontEnd, Backend ? FrontEnd / Backend : 0.0);
+    }
+}
+
+START_TEST(RtlLowFragHeap)
+{
+    TestEnable();
+    TestBlocks();
+    Benchmark();
+}
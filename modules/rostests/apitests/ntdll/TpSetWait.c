@@ -0,0 +1,118 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Test for thread pool waits on objects which need a waiting thread
+ */
+#include "precomp.h"
+
+typedef VOID (NTAPI *FN_WaitCallback)(PVOID, PVOID, PVOID, ULONG);
+typedef NTSTATUS (NTAPI *FN_TpAllocWait)(PVOID *, FN_WaitCallback, PVOID, PVOID);
+typedef VOID (NTAPI *FN_TpSetWait)(PVOID, HANDLE, PLARGE_INTEGER);
+typedef VOID (NTAPI *FN_TpWaitForWait)(PVOID, BOOL);
+typedef VOID (NTAPI *FN_TpReleaseWait)(PVOID);
+
+static FN_TpAllocWait pTpAllocWait;
+static FN_TpSetWait pTpSetWait;
+static FN_TpWaitForWait pTpWaitForWait;
+static FN_TpReleaseWait pTpReleaseWait;
+
+typedef struct _WAIT_CONTEXT
+{
+    HANDLE Done;
+    LONG Calls;
+    ULONG WaitResult;
+} WAIT_CONTEXT, *PWAIT_CONTEXT;
+
+static
+VOID
+NTAPI
+WaitCallback(PVOID Instance, PVOID Context, PVOID Wait, ULONG WaitResult)
+{
+    PWAIT_CONTEXT WaitContext = Context;
+
+    WaitContext->WaitResult = WaitResult;
+    InterlockedIncrement(&WaitContext->Calls);
+    SetEvent(WaitContext->Done);
+}
+
+static
+VOID
+TestMutex(VOID)
+{
+    WAIT_CONTEXT Context = { 0 };
+    LARGE_INTEGER Timeout;
+    PVOID Wait;
+    HANDLE Mutex, Event;
+    NTSTATUS Status;
+
+    Context.Done = CreateEventW(NULL, FALSE, FALSE, NULL);
+    Mutex = CreateMutexW(NULL, TRUE, NULL);
+    ok(Context.Done && Mutex, "Failed to create the objects\n");
+    if (!Context.Done || !Mutex) return;
+
+    Status = pTpAllocWait(&Wait, WaitCallback, &Context, NULL);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status)) return;
+
+    /* A mutex can't be waited on by a wait completion packet. The wait
+     * must still see it released, not only time out */
+    Timeout.QuadPart = -5000 * 10000;
+    pTpSetWait(Wait, Mutex, &Timeout);
+    ok_long(WaitForSingleObject(Context.Done, 100), WAIT_TIMEOUT);
+    ok_long(Context.Calls, 0);
+
+    ReleaseMutex(Mutex);
+    ok_long(WaitForSingleObject(Context.Done, 2000), WAIT_OBJECT_0);
+    ok_long(Context.Calls, 1);
+    ok_long(Context.WaitResult, WAIT_OBJECT_0);
+
+    /* A mutex which stays owned times out */
+    CloseHandle(Mutex);
+    Mutex = CreateMutexW(NULL, TRUE, NULL);
+    Timeout.QuadPart = -100 * 10000;
+    pTpSetWait(Wait, Mutex, &Timeout);
+    ok_long(WaitForSingleObject(Context.Done, 2000), WAIT_OBJECT_0);
+    ok_long(Context.Calls, 2);
+    ok_long(Context.WaitResult, WAIT_TIMEOUT);
+
+    /* Waits on events are still delivered afterwards */
+    ReleaseMutex(Mutex);
+    CloseHandle(Mutex);
+    Event = CreateEventW(NULL, TRUE, FALSE, NULL);
+    pTpSetWait(Wait, Event, NULL);
+    SetEvent(Event);
+    ok_long(WaitForSingleObject(Context.Done, 2000), WAIT_OBJECT_0);
+    ok_long(Context.Calls, 3);
+    ok_long(Context.WaitResult, WAIT_OBJECT_0);
+
+    pTpWaitForWait(Wait, FALSE);
+    pTpReleaseWait(Wait);
+    CloseHandle(Event);
+    CloseHandle(Context.Done);
+}
+
+START_TEST(TpSetWait)
+{
+    HMODULE Module = GetModuleHandleW(L"ntdll.dll");
+
+    /* ReactOS has the thread pool in ntext */
+    if (!GetProcAddress(Module, "TpAllocWait"))
+        Module = LoadLibraryW(L"ntext.dll");
+    if (!Module)
+    {
+        skip("No thread pool available\n");
+        return;
+    }
+
+    pTpAllocWait = (FN_TpAllocWait)GetProcAddress(Module, "TpAllocWait");
+    pTpSetWait = (FN_TpSetWait)GetProcAddress(Module, "TpSetWait");
+    pTpWaitForWait = (FN_TpWaitForWait)GetProcAddress(Module, "TpWaitForWait");
+    pTpReleaseWait = (FN_TpReleaseWait)GetProcAddress(Module, "TpReleaseWait");
+    if (!pTpAllocWait || !pTpSetWait || !pTpWaitForWait || !pTpReleaseWait)
+    {
+        skip("The thread pool wait functions are missing\n");
+        return;
+    }
+
+    TestMutex();
+}
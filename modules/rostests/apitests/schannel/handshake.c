@@ -0,0 +1,309 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1+ (https://spdx.org/licenses/LGPL-2.1+)
+ * PURPOSE:     Test and benchmark for schannel client handshakes
+ */
+
+#include <apitest.h>
+
+#include <winsock2.h>
+#define SECURITY_WIN32
+#include <security.h>
+#include <schannel.h>
+
+#define TEST_HOST           "test.winehq.org"
+#define TEST_HANDSHAKES     10
+#define ISC_FLAGS           (ISC_REQ_ALLOCATE_MEMORY | ISC_REQ_CONFIDENTIALITY | \
+                             ISC_REQ_SEQUENCE_DETECT | ISC_REQ_REPLAY_DETECT | ISC_REQ_STREAM)
+
+static struct sockaddr_in ServerAddress;
+static CHAR UnispName[] = UNISP_NAME_A;
+static CHAR TargetName[] = TEST_HOST;
+static CHAR Buffer[16 * 1024];
+
+static
+BOOL
+SendToken(
+    SOCKET Socket,
+    PSecBuffer OutBuffer)
+{
+    BOOL Success = TRUE;
+
+    if (OutBuffer->pvBuffer)
+    {
+        if (OutBuffer->cbBuffer)
+            Success = send(Socket, OutBuffer->pvBuffer, OutBuffer->cbBuffer, 0) == (int)OutBuffer->cbBuffer;
+        FreeContextBuffer(OutBuffer->pvBuffer);
+    }
+
+    return Success;
+}
+
+static
+SECURITY_STATUS
+Handshake(
+    PCredHandle Credential,
+    SOCKET Socket,
+    PSTR Target,
+    PSecPkgContext_SessionInfo SessionInfo)
+{
+    CtxtHandle Context;
+    SecBuffer InBuffers[2], OutBuffer;
+    SecBufferDesc InDesc, OutDesc;
+    SECURITY_STATUS Status;
+    ULONG Attributes, Received = 0;
+    int Ret;
+
+    OutDesc.ulVersion = SECBUFFER_VERSION;
+    OutDesc.cBuffers = 1;
+    OutDesc.pBuffers = &OutBuffer;
+    InDesc.ulVersion = SECBUFFER_VERSION;
+    InDesc.cBuffers = 2;
+    InDesc.pBuffers = InBuffers;
+
+    OutBuffer.BufferType = SECBUFFER_TOKEN;
+    OutBuffer.pvBuffer = NULL;
+    OutBuffer.cbBuffer = 0;
+    Status = InitializeSecurityContextA(Credential, NULL, Target, ISC_FLAGS, 0, 0,
+                                        NULL, 0, &Context, &OutDesc, &Attributes, NULL);
+    if (Status != SEC_I_CONTINUE_NEEDED)
+        return Status;
+
+    if (!SendToken(Socket, &OutBuffer))
+        Status = SEC_E_INTERNAL_ERROR;
+
+    while (Status == SEC_I_CONTINUE_NEEDED || Status == SEC_E_INCOMPLETE_MESSAGE)
+    {
+        if (!Received || Status == SEC_E_INCOMPLETE_MESSAGE)
+        {
+            Ret = recv(Socket, Buffer + Received, sizeof(Buffer) - Received, 0);
+            if (Ret <= 0)
+            {
+                Status = SEC_E_INTERNAL_ERROR;
+                break;
+            }
+            Received += Ret;
+        }
+
+        InBuffers[0].BufferType = SECBUFFER_TOKEN;
+        InBuffers[0].pvBuffer = Buffer;
+        InBuffers[0].cbBuffer = Received;
+        InBuffers[1].BufferType = SECBUFFER_EMPTY;
+        InBuffers[1].pvBuffer = NULL;
+        InBuffers[1].cbBuffer = 0;
+        OutBuffer.BufferType = SECBUFFER_TOKEN;
+        OutBuffer.pvBuffer = NULL;
+        OutBuffer.cbBuffer = 0;
+        Status = InitializeSecurityContextA(Credential, &Context, Target, ISC_FLAGS, 0, 0,
+                                            &InDesc, 0, NULL, &OutDesc, &Attributes, NULL);
+
+        if (!SendToken(Socket, &OutBuffer))
+        {
+            Status = SEC_E_INTERNAL_ERROR;
+            break;
+        }
+
+        if (Status == SEC_E_INCOMPLETE_MESSAGE)
+            continue;
+
+        /* Keep what belongs to the next handshake message */
+        if (InBuffers[1].BufferType == SECBUFFER_EXTRA)
+        {
+            MoveMemory(Buffer, Buffer + Received - InBuffers[1].cbBuffer, InBuffers[1].cbBuffer);
+            Received = InBuffers[1].cbBuffer;
+        }
+        else
+        {
+            Received = 0;
+        }
+    }
+
+    if (Status == SEC_E_OK)
+    {
+        Status = QueryContextAttributesA(&Context, SECPKG_ATTR_SESSION_INFO, SessionInfo);
+        ok(Status == SEC_E_OK, "Querying the session info failed with 0x%lx\n", Status);
+    }
+
+    DeleteSecurityContext(&Context);
+    return Status;
+}
+
+static
+SOCKET
+ConnectServer(VOID)
+{
+    SOCKET Socket;
+
+    Socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (Socket == INVALID_SOCKET)
+        return INVALID_SOCKET;
+
+    if (connect(Socket, (struct sockaddr *)&ServerAddress, sizeof(ServerAddress)))
+    {
+        closesocket(Socket);
+        return INVALID_SOCKET;
+    }
+
+    return Socket;
+}
+
+static
+SECURITY_STATUS
+ConnectAndHandshake(
+    PCredHandle Credential,
+    PSTR Target,
+    PSecPkgContext_SessionInfo SessionInfo,
+    LONGLONG *Ticks)
+{
+    LARGE_INTEGER Start, End;
+    SECURITY_STATUS Status;
+    SOCKET Socket;
+
+    Socket = ConnectServer();
+    if (Socket == INVALID_SOCKET)
+        return SEC_E_INTERNAL_ERROR;
+
+    /* Only the handshake itself is timed */
+    QueryPerformanceCounter(&Start);
+    Status = Handshake(Credential, Socket, Target, SessionInfo);
+    QueryPerformanceCounter(&End);
+
+    if (Ticks)
+        *Ticks += End.QuadPart - Start.QuadPart;
+
+    closesocket(Socket);
+    return Status;
+}
+
+static
+void
+Benchmark(
+    PCredHandle Credential,
+    PSTR Target,
+    PCSTR Description)
+{
+    SecPkgContext_SessionInfo FirstInfo, SessionInfo;
+    LARGE_INTEGER Frequency;
+    LONGLONG Ticks = 0;
+    SECURITY_STATUS Status;
+    ULONG i, Completed = 0, Resumed = 0;
+
+    /* The first connection fills the session cache for the resumed ones */
+    Status = ConnectAndHandshake(Credential, Target, &FirstInfo, NULL);
+    ok(Status == SEC_E_OK, "First %s handshake failed with 0x%lx\n", Description, Status);
+    if (Status != SEC_E_OK)
+        return;
+    ok(!(FirstInfo.dwFlags & SSL_SESSION_RECONNECT), "First %s handshake was abbreviated\n", Description);
+
+    for (i = 0; i < TEST_HANDSHAKES; i++)
+    {
+        Status = ConnectAndHandshake(Credential, Target, &SessionInfo, &Ticks);
+        ok(Status == SEC_E_OK, "%s handshake %lu failed with 0x%lx\n", Description, i, Status);
+        if (Status != SEC_E_OK)
+            continue;
+
+        Completed++;
+
+        /* Without a target name nothing is looked up in the session cache */
+        if (!Target)
+        {
+            ok(!(SessionInfo.dwFlags & SSL_SESSION_RECONNECT), "%s handshake %lu was abbreviated\n", Description, i);
+            continue;
+        }
+
+        /* Servers may decline to resume, e.g. behind a load balancer */
+        if (SessionInfo.dwFlags & SSL_SESSION_RECONNECT)
+            Resumed++;
+    }
+
+    if (Target && Completed)
+    {
+        if (Resumed)
+            trace("%s handshakes: %lu of %lu abbreviated\n", Description, Resumed, Completed);
+        else
+            skip("The server never resumed a session, no abbreviated handshakes to time\n");
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    if (Completed && Ticks)
+    {
+        trace("%s handshakes: %.1f/s\n", Description,
+              (double)Completed * Frequency.QuadPart / Ticks);
+    }
+}
+
+START_TEST(handshake)
+{
+    SecPkgContext_SessionInfo SessionInfo;
+    SCHANNEL_CRED SchannelCred;
+    CredHandle Credential, OtherCredential;
+    SECURITY_STATUS Status;
+    struct hostent *Host;
+    WSADATA WsaData;
+    SOCKET Socket;
+
+    if (WSAStartup(MAKEWORD(2, 2), &WsaData))
+    {
+        skip("WSAStartup failed\n");
+        return;
+    }
+
+    Host = gethostbyname(TEST_HOST);
+    if (!Host)
+    {
+        skip("Cannot resolve %s, error %d\n", TEST_HOST, WSAGetLastError());
+        WSACleanup();
+        return;
+    }
+
+    ZeroMemory(&ServerAddress, sizeof(ServerAddress));
+    ServerAddress.sin_family = AF_INET;
+    ServerAddress.sin_addr.s_addr = *(u_long *)Host->h_addr_list[0];
+    ServerAddress.sin_port = htons(443);
+
+    /* Everything below needs the server, test machines may be offline */
+    Socket = ConnectServer();
+    if (Socket == INVALID_SOCKET)
+    {
+        skip("Cannot connect to %s, error %d\n", TEST_HOST, WSAGetLastError());
+        WSACleanup();
+        return;
+    }
+    closesocket(Socket);
+
+    ZeroMemory(&SchannelCred, sizeof(SchannelCred));
+    SchannelCred.dwVersion = SCHANNEL_CRED_VERSION;
+    SchannelCred.dwFlags = SCH_CRED_NO_DEFAULT_CREDS | SCH_CRED_MANUAL_CRED_VALIDATION;
+
+    Status = AcquireCredentialsHandleA(NULL, UnispName, SECPKG_CRED_OUTBOUND, NULL,
+                                       &SchannelCred, NULL, NULL, &Credential, NULL);
+    ok(Status == SEC_E_OK, "AcquireCredentialsHandleA failed with 0x%lx\n", Status);
+    if (Status != SEC_E_OK)
+    {
+        WSACleanup();
+        return;
+    }
+
+    /* Sessions are cached by target name, without one every handshake is a full one */
+    Benchmark(&Credential, NULL, "New");
+    Benchmark(&Credential, TargetName, "Resumed");
+
+    /* The cached sessions belong to the credential they were negotiated with */
+    Status = AcquireCredentialsHandleA(NULL, UnispName, SECPKG_CRED_OUTBOUND, NULL,
+                                       &SchannelCred, NULL, NULL, &OtherCredential, NULL);
+    ok(Status == SEC_E_OK, "AcquireCredentialsHandleA failed with 0x%lx\n", Status);
+    if (Status == SEC_E_OK)
+    {
+        Status = ConnectAndHandshake(&OtherCredential, TargetName, &SessionInfo, NULL);
+        ok(Status == SEC_E_OK, "Handshake with another credential failed with 0x%lx\n", Status);
+        if (Status == SEC_E_OK)
+        {
+            ok(!(SessionInfo.dwFlags & SSL_SESSION_RECONNECT),
+               "Another credential resumed the session of the first one\n");
+        }
+        FreeCredentialsHandle(&OtherCredential);
+    }
+
+    FreeCredentialsHandle(&Credential);
+    WSACleanup();
+}
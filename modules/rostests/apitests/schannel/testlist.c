@@ -0,0 +1,10 @@
+#define STANDALONE
+#include <apitest.h>
+
+extern void func_handshake(void);
+
+const struct test winetest_testlist[] =
+{
+    { "handshake", func_handshake },
+    { 0, 0 }
+};
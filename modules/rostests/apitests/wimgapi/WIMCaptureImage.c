@@ -0,0 +1,691 @@
+/*
+ * PROJECT:     ReactOS API tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for capturing, applying and exporting WIM images
+ */
+
+#include "precomp.h"
+
+static PFN_WIMCreateFile pWIMCreateFile;
+static PFN_WIMCloseHandle pWIMCloseHandle;
+static PFN_WIMGetImageCount pWIMGetImageCount;
+static PFN_WIMLoadImage pWIMLoadImage;
+static PFN_WIMGetImageInformation pWIMGetImageInformation;
+static PFN_WIMCaptureImage pWIMCaptureImage;
+static PFN_WIMApplyImage pWIMApplyImage;
+static PFN_WIMExportImage pWIMExportImage;
+
+static WCHAR BasePath[MAX_PATH];
+
+/* On-disk structures the LZX test patches */
+#define WIM_HDR_FLAG_COMPRESSION    0x00000002
+#define WIM_HDR_FLAG_COMPRESS_LZX   0x00040000
+#define RESHDR_FLAG_METADATA        0x02
+#define RESHDR_FLAG_COMPRESSED      0x04
+#define RESHDR_SIZE_MASK            0x00ffffffffffffffULL
+
+#include <pshpack1.h>
+typedef struct _WIM_RESHDR
+{
+    ULONGLONG SizeAndFlags;
+    ULONGLONG Offset;
+    ULONGLONG OriginalSize;
+} WIM_RESHDR;
+
+typedef struct _WIM_HEADER
+{
+    CHAR Tag[8];
+    ULONG HeaderSize;
+    ULONG Version;
+    ULONG Flags;
+    ULONG ChunkSize;
+    GUID Guid;
+    USHORT PartNumber;
+    USHORT TotalParts;
+    ULONG ImageCount;
+    WIM_RESHDR LookupTable;
+    WIM_RESHDR XmlData;
+    WIM_RESHDR BootMetadata;
+    ULONG BootIndex;
+    WIM_RESHDR Integrity;
+    UCHAR Unused[60];
+} WIM_HEADER;
+
+typedef struct _WIM_LOOKUP_ENTRY
+{
+    WIM_RESHDR Resource;
+    USHORT PartNumber;
+    ULONG RefCount;
+    UCHAR Hash[20];
+} WIM_LOOKUP_ENTRY;
+#include <poppack.h>
+
+#define LZX_TEXT_LINES  100
+
+/* The text of BuildLzxText() compressed into a WIM LZX chunk: a verbatim,
+ * an aligned and an uncompressed block, then a verbatim one for the rest */
+static const UCHAR LzxChunk[] =
+{
+    0x5d, 0x20, 0x00, 0xc2, 0x00, 0x00, 0x22, 0x00, 0x00, 0x54, 0x44, 0x00,
+    0x6f, 0x5a, 0x41, 0x90, 0x54, 0xd9, 0x1d, 0x30, 0xbc, 0x85, 0x4b, 0xab,
+    0x69, 0xb9, 0x22, 0xaa, 0xae, 0xe9, 0x02, 0x43, 0xde, 0xb2, 0x95, 0x78,
+    0x70, 0x01, 0xe2, 0xaa, 0x17, 0xd4, 0xa0, 0x0e, 0x0c, 0x8e, 0x00, 0x40,
+    0x00, 0x00, 0x46, 0x00, 0x0a, 0x6a, 0x61, 0x08, 0x16, 0x19, 0x41, 0xf9,
+    0xc0, 0x6f, 0xf3, 0x4d, 0x01, 0x99, 0x5e, 0xda, 0x2e, 0x05, 0xc9, 0xfe,
+    0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0xa0, 0xaa, 0x87, 0x19, 0x49, 0x0f,
+    0x01, 0x05, 0xfd, 0x13, 0x7f, 0xbf, 0xfe, 0x7e, 0x7c, 0xfe, 0xdf, 0xc9,
+    0x57, 0x8b, 0xa7, 0x4a, 0x57, 0xcd, 0xca, 0xff, 0x33, 0xd5, 0xd1, 0xd7,
+    0xf3, 0x5e, 0xff, 0xfe, 0x2d, 0x68, 0xd7, 0xf7, 0xa9, 0xf0, 0xbe, 0xb3,
+    0xc9, 0x97, 0x7f, 0xc7, 0x34, 0xa2, 0x6b, 0x1a, 0x2d, 0xa9, 0x2b, 0x8d,
+    0x92, 0xd9, 0x93, 0x52, 0x18, 0x35, 0x4b, 0xf2, 0xeb, 0x6c, 0x22, 0x49,
+    0x50, 0x3c, 0x27, 0x76, 0xf0, 0xa1, 0x07, 0xc5, 0x47, 0x6a, 0xdc, 0xd9,
+    0xb3, 0x92, 0x24, 0x25, 0xc9, 0xb8, 0x39, 0x69, 0xb5, 0x77, 0x72, 0xea,
+    0xc7, 0x4f, 0x7b, 0x51, 0x1c, 0x8a, 0x83, 0xa2, 0xb6, 0x92, 0xdb, 0x01,
+    0x63, 0x2c, 0x1b, 0x02, 0x9d, 0x4b, 0x21, 0x95, 0x4c, 0x8e, 0x03, 0x7f,
+    0x35, 0x93, 0xdb, 0x41, 0xb2, 0x35, 0x68, 0xb9, 0xc9, 0x85, 0x6d, 0xbe,
+    0xb9, 0xf6, 0xe4, 0x39, 0x23, 0xd9, 0x33, 0x48, 0xc5, 0x9a, 0x28, 0x66,
+    0x37, 0x46, 0x58, 0x06, 0x9a, 0x8b, 0x2c, 0xc9, 0x80, 0x06, 0x6c, 0x0d,
+    0x46, 0xd8, 0x0f, 0xe8, 0x0b, 0x3f, 0xcc, 0x47, 0x9b, 0x06, 0x1b, 0x5e,
+    0x31, 0x40, 0x9a, 0xf8, 0xe0, 0x3d, 0x80, 0x2f, 0x6b, 0xd7, 0x78, 0xc3,
+    0xa0, 0x0f, 0xe3, 0x2e, 0xb6, 0x6d, 0xa0, 0xd9, 0x00, 0x00, 0x91, 0x22,
+    0x00, 0x00, 0x9a, 0x3b, 0xec, 0x36, 0x27, 0xff, 0x10, 0xbc, 0x16, 0x20,
+    0xf0, 0x43, 0x99, 0x5d, 0xef, 0x26, 0xbc, 0xa0, 0x1c, 0x47, 0x4b, 0xbf,
+    0xe2, 0x15, 0x2f, 0x2b, 0xf8, 0xd2, 0xa2, 0xdf, 0xe2, 0xb1, 0x3c, 0xae,
+    0x20, 0x23, 0x04, 0x00, 0x04, 0x40, 0x04, 0x00, 0x02, 0x03, 0x5c, 0x0a,
+    0xfe, 0x92, 0xe0, 0xce, 0xef, 0x07, 0xbf, 0xdf, 0x48, 0x40, 0x08, 0x00,
+    0x00, 0x00, 0x88, 0x00, 0x86, 0x08, 0x05, 0x40, 0x2c, 0xfc, 0x80, 0x0d,
+    0x4f, 0x1d, 0xbf, 0xdf, 0x8b, 0x7e, 0xbf, 0x97, 0xc5, 0x74, 0x5e, 0x64,
+    0x68, 0x46, 0x3a, 0xfb, 0xe0, 0xbb, 0x45, 0xfe, 0x62, 0xa4, 0xa4, 0x46,
+    0x7c, 0xe3, 0x3c, 0x3e, 0xed, 0x37, 0xa6, 0x2b, 0xfe, 0x45, 0x9d, 0x31,
+    0x7e, 0x1d, 0x53, 0x34, 0x7f, 0x86, 0x8b, 0xf1, 0x4c, 0x71, 0x8d, 0xc6,
+    0xa5, 0x68, 0x05, 0xe5, 0x60, 0x84, 0x85, 0x46, 0xee, 0xc9, 0x39, 0xcf,
+    0x94, 0x8a, 0xfc, 0x52, 0x23, 0x2e, 0xf2, 0x24, 0x4f, 0x92, 0xf3, 0x29,
+    0x05, 0xe9, 0x9b, 0x9e, 0x28, 0x8c, 0x9a, 0xd2, 0x4e, 0x76, 0x59, 0xdf,
+    0xa8, 0x8a, 0x1f, 0xbb, 0x54, 0xa6, 0x9b, 0xfc, 0x94, 0x27, 0xf6, 0xfa,
+    0x39, 0x8a, 0x09, 0xb0, 0x00, 0x68, 0x29, 0x00, 0x00, 0x00, 0x9a, 0x01,
+    0x00, 0x00, 0x99, 0x01, 0x00, 0x00, 0x58, 0x20, 0x63, 0x6f, 0x6d, 0x70,
+    0x72, 0x65, 0x73, 0x73, 0x65, 0x64, 0x20, 0x66, 0x69, 0x6c, 0x65, 0x0d,
+    0x0a, 0xe8, 0x5b, 0x10, 0x00, 0x00, 0x4c, 0x69, 0x6e, 0x65, 0x20, 0x37,
+    0x34, 0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x4c, 0x5a, 0x58,
+    0x20, 0x63, 0x6f, 0x6d, 0x70, 0x72, 0x65, 0x73, 0x73, 0x65, 0x64, 0x20,
+    0x66, 0x69, 0x6c, 0x65, 0x0d, 0x0a, 0xe8, 0x94, 0x10, 0x00, 0x00, 0x4c,
+    0x69, 0x6e, 0x65, 0x20, 0x37, 0x35, 0x20, 0x6f, 0x66, 0x20, 0x74, 0x68,
+    0x65, 0x20, 0x4c, 0x5a, 0x58, 0x20, 0x63, 0x6f, 0x6d, 0x70, 0x72, 0x65,
+    0x73, 0x73, 0x65, 0x64, 0x20, 0x66, 0x69, 0x6c, 0x65, 0x0d, 0x0a, 0xe8,
+    0xcd, 0x10, 0x00, 0x00, 0x4c, 0x69, 0x6e, 0x65, 0x20, 0x37, 0x36, 0x20,
+    0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x4c, 0x5a, 0x58, 0x20, 0x63,
+    0x6f, 0x6d, 0x70, 0x72, 0x65, 0x73, 0x73, 0x65, 0x64, 0x20, 0x66, 0x69,
+    0x6c, 0x65, 0x0d, 0x0a, 0xe8, 0x06, 0x11, 0x00, 0x00, 0x4c, 0x69, 0x6e,
+    0x65, 0x20, 0x37, 0x37, 0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20,
+    0x4c, 0x5a, 0x58, 0x20, 0x63, 0x6f, 0x6d, 0x70, 0x72, 0x65, 0x73, 0x73,
+    0x65, 0x64, 0x20, 0x66, 0x69, 0x6c, 0x65, 0x0d, 0x0a, 0xe8, 0x3f, 0x11,
+    0x00, 0x00, 0x4c, 0x69, 0x6e, 0x65, 0x20, 0x37, 0x38, 0x20, 0x6f, 0x66,
+    0x20, 0x74, 0x68, 0x65, 0x20, 0x4c, 0x5a, 0x58, 0x20, 0x63, 0x6f, 0x6d,
+    0x70, 0x72, 0x65, 0x73, 0x73, 0x65, 0x64, 0x20, 0x66, 0x69, 0x6c, 0x65,
+    0x0d, 0x0a, 0xe8, 0x78, 0x11, 0x00, 0x00, 0x4c, 0x69, 0x6e, 0x65, 0x20,
+    0x37, 0x39, 0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x4c, 0x5a,
+    0x58, 0x20, 0x63, 0x6f, 0x6d, 0x70, 0x72, 0x65, 0x73, 0x73, 0x65, 0x64,
+    0x20, 0x66, 0x69, 0x6c, 0x65, 0x0d, 0x0a, 0xe8, 0xb1, 0x11, 0x00, 0x00,
+    0x4c, 0x69, 0x6e, 0x65, 0x20, 0x38, 0x30, 0x20, 0x6f, 0x66, 0x20, 0x74,
+    0x68, 0x65, 0x20, 0x4c, 0x5a, 0x58, 0x20, 0x63, 0x6f, 0x6d, 0x70, 0x72,
+    0x65, 0x73, 0x73, 0x65, 0x64, 0x20, 0x66, 0x00, 0x31, 0x20, 0x05, 0x54,
+    0x00, 0x00, 0x00, 0x50, 0x00, 0x15, 0x24, 0x00, 0xdc, 0x58, 0xe5, 0x97,
+    0x64, 0x26, 0xfc, 0xa8, 0xd3, 0x88, 0x73, 0x1a, 0xbf, 0xfc, 0x5f, 0xb8,
+    0xa6, 0x21, 0x87, 0x2f, 0x2f, 0x3a, 0x30, 0x43, 0x33, 0x00, 0x03, 0x00,
+    0x00, 0x00, 0x30, 0x43, 0xe0, 0x3c, 0xc6, 0x08, 0x3d, 0x02, 0xfb, 0xfb,
+    0xf5, 0xfb, 0xfd, 0x25, 0x00, 0x72, 0x40, 0x00, 0x00, 0x00, 0x00, 0x02,
+    0x32, 0x00, 0x87, 0x43, 0x44, 0x90, 0xe0, 0xc0, 0xff, 0x0b, 0xdf, 0x2f,
+    0xb7, 0xbf, 0x5d, 0xad, 0x33, 0x1c, 0x1d, 0x24, 0x54, 0xb0, 0xe2, 0x42,
+    0x23, 0x19, 0xd0, 0x43, 0xc0, 0xfd, 0x58, 0xa1, 0x21, 0x2c, 0x0d, 0x81,
+    0x73, 0x96, 0x4b, 0xfa, 0x8a, 0x12, 0xf7, 0xc8, 0x5e, 0xbe, 0x19, 0x8d,
+    0x7e, 0x90, 0x3a, 0x35, 0x97, 0x62, 0x73, 0x48, 0x5d, 0x9b, 0x51, 0x0c,
+    0xcd, 0xa6, 0xe8, 0x6e, 0xff, 0x4d, 0x00, 0x14
+};
+
+static
+void
+BuildPath(PWSTR Buffer, PCWSTR Name)
+{
+    StringCchPrintfW(Buffer, MAX_PATH, L"%s\\%s", BasePath, Name);
+}
+
+static
+BOOL
+WriteTestFile(PCWSTR Name, ULONG Size, ULONG Kind)
+{
+    static const char Text[] = "Windows Imaging Format test data. ";
+    WCHAR Path[MAX_PATH];
+    PUCHAR Buffer;
+    ULONG Seed = 0x4321, i;
+    DWORD Written = 0;
+    HANDLE File;
+    BOOL Ret;
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, Size + 1);
+    if (!Buffer)
+        return FALSE;
+    for (i = 0; i < Size; i++)
+    {
+        if (Kind == 1)
+        {
+            Seed = Seed * 1103515245 + 12345;
+            Buffer[i] = (UCHAR)(Seed >> 16);
+        }
+        else
+        {
+            Buffer[i] = Text[i % (sizeof(Text) - 1)];
+        }
+    }
+
+    BuildPath(Path, Name);
+    File = CreateFileW(Path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    Ret = File != INVALID_HANDLE_VALUE;
+    if (Ret)
+    {
+        Ret = WriteFile(File, Buffer, Size, &Written, NULL) && Written == Size;
+        CloseHandle(File);
+    }
+    HeapFree(GetProcessHeap(), 0, Buffer);
+    return Ret;
+}
+
+static
+PUCHAR
+ReadTestFile(PCWSTR Path, PDWORD Size)
+{
+    HANDLE File;
+    PUCHAR Buffer = NULL;
+    DWORD Read;
+
+    File = CreateFileW(Path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    if (File == INVALID_HANDLE_VALUE)
+        return NULL;
+    *Size = GetFileSize(File, NULL);
+    Buffer = HeapAlloc(GetProcessHeap(), 0, *Size + 1);
+    if (Buffer && (!ReadFile(File, Buffer, *Size, &Read, NULL) || Read != *Size))
+    {
+        HeapFree(GetProcessHeap(), 0, Buffer);
+        Buffer = NULL;
+    }
+    CloseHandle(File);
+    return Buffer;
+}
+
+static
+void
+CompareFile(PCWSTR Dest, PCWSTR Name)
+{
+    WCHAR Source[MAX_PATH], Applied[MAX_PATH], Relative[MAX_PATH];
+    PUCHAR SourceData, AppliedData;
+    DWORD SourceSize = 0, AppliedSize = 0;
+
+    StringCchPrintfW(Relative, MAX_PATH, L"src\\%s", Name);
+    BuildPath(Source, Relative);
+    StringCchPrintfW(Relative, MAX_PATH, L"%s\\%s", Dest, Name);
+    BuildPath(Applied, Relative);
+
+    SourceData = ReadTestFile(Source, &SourceSize);
+    AppliedData = ReadTestFile(Applied, &AppliedSize);
+    ok(AppliedData != NULL, "%S not applied\n", Applied);
+    if (SourceData && AppliedData)
+    {
+        ok(AppliedSize == SourceSize, "%S: %lu bytes, expected %lu\n", Applied, AppliedSize, SourceSize);
+        ok(AppliedSize == SourceSize && !memcmp(SourceData, AppliedData, SourceSize),
+           "%S: wrong contents\n", Applied);
+    }
+    if (AppliedData) HeapFree(GetProcessHeap(), 0, AppliedData);
+    if (SourceData) HeapFree(GetProcessHeap(), 0, SourceData);
+}
+
+static
+void
+CompareTree(PCWSTR Dest)
+{
+    WCHAR Path[MAX_PATH], Relative[MAX_PATH];
+    DWORD Attributes;
+
+    CompareFile(Dest, L"text.txt");
+    CompareFile(Dest, L"copy.txt");
+    CompareFile(Dest, L"empty.txt");
+    CompareFile(Dest, L"sub\\random.bin");
+    CompareFile(Dest, L"sub\\large.txt");
+
+    StringCchPrintfW(Relative, MAX_PATH, L"%s\\sub\\empty", Dest);
+    BuildPath(Path, Relative);
+    Attributes = GetFileAttributesW(Path);
+    ok(Attributes != INVALID_FILE_ATTRIBUTES && (Attributes & FILE_ATTRIBUTE_DIRECTORY),
+       "%S: attributes 0x%lx\n", Path, Attributes);
+}
+
+static
+void
+DeleteTree(PCWSTR Path)
+{
+    WCHAR Pattern[MAX_PATH], Child[MAX_PATH];
+    WIN32_FIND_DATAW Data;
+    HANDLE Find;
+
+    StringCchPrintfW(Pattern, MAX_PATH, L"%s\\*", Path);
+    Find = FindFirstFileW(Pattern, &Data);
+    if (Find != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            if (!wcscmp(Data.cFileName, L".") || !wcscmp(Data.cFileName, L".."))
+                continue;
+            StringCchPrintfW(Child, MAX_PATH, L"%s\\%s", Path, Data.cFileName);
+            if (Data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            {
+                DeleteTree(Child);
+            }
+            else
+            {
+                SetFileAttributesW(Child, FILE_ATTRIBUTE_NORMAL);
+                DeleteFileW(Child);
+            }
+        } while (FindNextFileW(Find, &Data));
+        FindClose(Find);
+    }
+    RemoveDirectoryW(Path);
+}
+
+static
+ULONGLONG
+GetSize(PCWSTR Path)
+{
+    WIN32_FILE_ATTRIBUTE_DATA Data;
+
+    if (!GetFileAttributesExW(Path, GetFileExInfoStandard, &Data))
+        return 0;
+    return ((ULONGLONG)Data.nFileSizeHigh << 32) | Data.nFileSizeLow;
+}
+
+static
+void
+Test_CaptureApply(void)
+{
+    WCHAR Source[MAX_PATH], Dest[MAX_PATH], WimPath[MAX_PATH], ExportPath[MAX_PATH];
+    LARGE_INTEGER Frequency, Start, End;
+    ULONGLONG FirstSize, SecondSize;
+    HANDLE Wim, Image, Export;
+    PWSTR Info;
+    DWORD Result, Size;
+    BOOL Ret;
+
+    BuildPath(Source, L"src");
+    BuildPath(WimPath, L"test.wim");
+    BuildPath(ExportPath, L"export.wim");
+
+    /* Capture into a new compressed image */
+    Result = 0xdeadbeef;
+    Wim = pWIMCreateFile(WimPath, WIM_GENERIC_READ | WIM_GENERIC_WRITE, WIM_CREATE_ALWAYS, 0,
+                         WIM_COMPRESS_XPRESS, &Result);
+    ok(Wim != NULL, "WIMCreateFile failed, error %lu\n", GetLastError());
+    if (!Wim)
+        return;
+    ok_long(Result, WIM_CREATED_NEW);
+    ok_long(pWIMGetImageCount(Wim), 0);
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    Image = pWIMCaptureImage(Wim, Source, 0);
+    QueryPerformanceCounter(&End);
+    ok(Image != NULL, "WIMCaptureImage failed, error %lu\n", GetLastError());
+    ok_long(pWIMGetImageCount(Wim), 1);
+    if (End.QuadPart > Start.QuadPart)
+        trace("Capture took %I64u ms\n", (End.QuadPart - Start.QuadPart) * 1000 / Frequency.QuadPart);
+
+    if (Image)
+    {
+        Info = NULL;
+        Size = 0;
+        Ret = pWIMGetImageInformation(Image, (PVOID *)&Info, &Size);
+        ok(Ret, "WIMGetImageInformation failed, error %lu\n", GetLastError());
+        if (Ret)
+        {
+            ok(Size > sizeof(WCHAR) && Info[0] == 0xfeff, "No byte order mark\n");
+            ok(wcsstr(Info, L"<IMAGE INDEX=\"1\">") != NULL, "Wrong information %S\n", Info);
+            ok(wcsstr(Info, L"<FILECOUNT>5</FILECOUNT>") != NULL, "Wrong information %S\n", Info);
+            LocalFree(Info);
+        }
+        ok(pWIMCloseHandle(Image), "WIMCloseHandle failed\n");
+    }
+    ok(pWIMCloseHandle(Wim), "WIMCloseHandle failed\n");
+    FirstSize = GetSize(WimPath);
+
+    /* Identical files are stored once, so a second capture only adds metadata */
+    Wim = pWIMCreateFile(WimPath, WIM_GENERIC_READ | WIM_GENERIC_WRITE, WIM_OPEN_EXISTING, 0, 0, &Result);
+    ok(Wim != NULL, "WIMCreateFile failed, error %lu\n", GetLastError());
+    if (!Wim)
+        return;
+    ok_long(Result, WIM_OPENED_EXISTING);
+    ok_long(pWIMGetImageCount(Wim), 1);
+    Image = pWIMCaptureImage(Wim, Source, 0);
+    ok(Image != NULL, "WIMCaptureImage failed, error %lu\n", GetLastError());
+    ok_long(pWIMGetImageCount(Wim), 2);
+    if (Image)
+        pWIMCloseHandle(Image);
+    pWIMCloseHandle(Wim);
+    SecondSize = GetSize(WimPath);
+    ok(SecondSize - FirstSize < 8192, "Second capture added %I64u bytes\n", SecondSize - FirstSize);
+
+    /* Apply and verify */
+    Wim = pWIMCreateFile(WimPath, WIM_GENERIC_READ, WIM_OPEN_EXISTING, 0, 0, &Result);
+    ok(Wim != NULL, "WIMCreateFile failed, error %lu\n", GetLastError());
+    if (!Wim)
+        return;
+
+    SetLastError(0xdeadbeef);
+    ok(pWIMLoadImage(Wim, 0) == NULL, "WIMLoadImage succeeded for image 0\n");
+    ok(pWIMLoadImage(Wim, 3) == NULL, "WIMLoadImage succeeded for image 3\n");
+    ok(pWIMCaptureImage(Wim, Source, 0) == NULL, "WIMCaptureImage succeeded without write access\n");
+
+    Image = pWIMLoadImage(Wim, 2);
+    ok(Image != NULL, "WIMLoadImage failed, error %lu\n", GetLastError());
+    if (Image)
+    {
+        BuildPath(Dest, L"dst");
+        QueryPerformanceCounter(&Start);
+        Ret = pWIMApplyImage(Image, Dest, WIM_FLAG_VERIFY);
+        QueryPerformanceCounter(&End);
+        ok(Ret, "WIMApplyImage failed, error %lu\n", GetLastError());
+        if (End.QuadPart > Start.QuadPart)
+            trace("Apply took %I64u ms\n", (End.QuadPart - Start.QuadPart) * 1000 / Frequency.QuadPart);
+        CompareTree(L"dst");
+
+        /* Export into an uncompressed WIM, which recompresses every resource */
+        Export = pWIMCreateFile(ExportPath, WIM_GENERIC_READ | WIM_GENERIC_WRITE, WIM_CREATE_ALWAYS, 0,
+                                WIM_COMPRESS_NONE, &Result);
+        ok(Export != NULL, "WIMCreateFile failed, error %lu\n", GetLastError());
+        if (Export)
+        {
+            Ret = pWIMExportImage(Image, Export, 0);
+            ok(Ret, "WIMExportImage failed, error %lu\n", GetLastError());
+            ok_long(pWIMGetImageCount(Export), 1);
+            pWIMCloseHandle(Export);
+            ok(GetSize(ExportPath) > FirstSize, "Export is not larger than the compressed WIM\n");
+        }
+        pWIMCloseHandle(Image);
+    }
+    pWIMCloseHandle(Wim);
+
+    Wim = pWIMCreateFile(ExportPath, WIM_GENERIC_READ, WIM_OPEN_EXISTING, 0, 0, &Result);
+    ok(Wim != NULL, "WIMCreateFile failed, error %lu\n", GetLastError());
+    if (!Wim)
+        return;
+    Image = pWIMLoadImage(Wim, 1);
+    ok(Image != NULL, "WIMLoadImage failed, error %lu\n", GetLastError());
+    if (Image)
+    {
+        BuildPath(Dest, L"dst2");
+        ok(pWIMApplyImage(Image, Dest, WIM_FLAG_VERIFY), "WIMApplyImage failed, error %lu\n", GetLastError());
+        CompareTree(L"dst2");
+        pWIMCloseHandle(Image);
+    }
+    pWIMCloseHandle(Wim);
+}
+
+static
+void
+Test_CaptureLzx(void)
+{
+    WCHAR Source[MAX_PATH], Dest[MAX_PATH], WimPath[MAX_PATH];
+    HANDLE Wim, Image;
+    DWORD Result;
+
+    BuildPath(Source, L"src");
+    BuildPath(WimPath, L"lzx.wim");
+
+    /* Capture and append both go through the LZX chunk encoder */
+    Wim = pWIMCreateFile(WimPath, WIM_GENERIC_READ | WIM_GENERIC_WRITE, WIM_CREATE_ALWAYS, 0,
+                         WIM_COMPRESS_LZX, &Result);
+    ok(Wim != NULL, "WIMCreateFile failed, error %lu\n", GetLastError());
+    if (!Wim)
+        return;
+    Image = pWIMCaptureImage(Wim, Source, 0);
+    ok(Image != NULL, "WIMCaptureImage failed, error %lu\n", GetLastError());
+    if (Image)
+        pWIMCloseHandle(Image);
+    pWIMCloseHandle(Wim);
+
+    Wim = pWIMCreateFile(WimPath, WIM_GENERIC_READ | WIM_GENERIC_WRITE, WIM_OPEN_EXISTING, 0, 0, &Result);
+    ok(Wim != NULL, "WIMCreateFile failed, error %lu\n", GetLastError());
+    if (!Wim)
+        return;
+    Image = pWIMCaptureImage(Wim, Source, 0);
+    ok(Image != NULL, "WIMCaptureImage failed, error %lu\n", GetLastError());
+    ok_long(pWIMGetImageCount(Wim), 2);
+    if (Image)
+        pWIMCloseHandle(Image);
+    pWIMCloseHandle(Wim);
+
+    /* The text files shrink well below their 4 MB, the random one stays raw */
+    ok(GetSize(WimPath) < 1024 * 1024, "LZX WIM is %I64u bytes\n", GetSize(WimPath));
+
+    Wim = pWIMCreateFile(WimPath, WIM_GENERIC_READ, WIM_OPEN_EXISTING, 0, 0, &Result);
+    ok(Wim != NULL, "WIMCreateFile failed, error %lu\n", GetLastError());
+    if (!Wim)
+        return;
+    Image = pWIMLoadImage(Wim, 2);
+    ok(Image != NULL, "WIMLoadImage failed, error %lu\n", GetLastError());
+    if (Image)
+    {
+        BuildPath(Dest, L"dst3");
+        ok(pWIMApplyImage(Image, Dest, WIM_FLAG_VERIFY), "WIMApplyImage failed, error %lu\n", GetLastError());
+        CompareTree(L"dst3");
+        pWIMCloseHandle(Image);
+    }
+    pWIMCloseHandle(Wim);
+}
+
+static
+ULONG
+BuildLzxText(PUCHAR Buffer)
+{
+    ULONG Length = 0, i;
+
+    /* Every line is followed by a call instruction the compressor translates */
+    for (i = 0; i < LZX_TEXT_LINES; i++)
+    {
+        StringCchPrintfA((PSTR)Buffer + Length, 64, "Line %lu of the LZX compressed file\r\n", i);
+        Length += strlen((PSTR)Buffer + Length);
+        Buffer[Length++] = 0xe8;
+        *(ULONG UNALIGNED *)(Buffer + Length) = i * 16;
+        Length += sizeof(ULONG);
+    }
+
+    return Length;
+}
+
+static
+BOOL
+ReadWriteAt(HANDLE File, ULONGLONG Offset, PVOID Buffer, ULONG Size, BOOL Write)
+{
+    LARGE_INTEGER Position;
+    DWORD Done = 0;
+
+    Position.QuadPart = Offset;
+    if (!SetFilePointerEx(File, Position, NULL, FILE_BEGIN))
+        return FALSE;
+    if (Write)
+        return WriteFile(File, Buffer, Size, &Done, NULL) && Done == Size;
+    return ReadFile(File, Buffer, Size, &Done, NULL) && Done == Size;
+}
+
+/* Turn the file resource of an uncompressed WIM into the LZX chunk */
+static
+BOOL
+PatchLzxResource(PCWSTR WimPath, ULONG TextSize)
+{
+    WIM_LOOKUP_ENTRY *Entries = NULL;
+    WIM_HEADER Header;
+    ULONGLONG TableSize, End;
+    ULONG Count, i;
+    HANDLE File;
+    BOOL Ret = FALSE;
+
+    File = CreateFileW(WimPath, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+    if (File == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    if (!ReadWriteAt(File, 0, &Header, sizeof(Header), FALSE))
+        goto done;
+    TableSize = Header.LookupTable.SizeAndFlags & RESHDR_SIZE_MASK;
+    Count = (ULONG)(TableSize / sizeof(*Entries));
+    Entries = HeapAlloc(GetProcessHeap(), 0, max(TableSize, 1));
+    if (!Entries || !ReadWriteAt(File, Header.LookupTable.Offset, Entries, (ULONG)TableSize, FALSE))
+        goto done;
+
+    for (i = 0; i < Count; i++)
+    {
+        if (Entries[i].Resource.OriginalSize == TextSize &&
+            !((Entries[i].Resource.SizeAndFlags >> 56) & RESHDR_FLAG_METADATA))
+            break;
+    }
+    ok(i < Count, "Resource of the file not found\n");
+    if (i == Count)
+        goto done;
+
+    /* A chunk that is the whole resource has no chunk table in front of it */
+    End = GetSize(WimPath);
+    if (!ReadWriteAt(File, End, (PVOID)LzxChunk, sizeof(LzxChunk), TRUE))
+        goto done;
+    Entries[i].Resource.SizeAndFlags = sizeof(LzxChunk) |
+        ((ULONGLONG)(RESHDR_FLAG_COMPRESSED | (Entries[i].Resource.SizeAndFlags >> 56)) << 56);
+    Entries[i].Resource.Offset = End;
+
+    /* Resources without the compressed flag, like the metadata, stay readable */
+    Header.Flags |= WIM_HDR_FLAG_COMPRESSION | WIM_HDR_FLAG_COMPRESS_LZX;
+    Header.ChunkSize = 32768;
+    Ret = ReadWriteAt(File, Header.LookupTable.Offset, Entries, (ULONG)TableSize, TRUE) &&
+          ReadWriteAt(File, 0, &Header, sizeof(Header), TRUE);
+
+done:
+    if (Entries) HeapFree(GetProcessHeap(), 0, Entries);
+    CloseHandle(File);
+    return Ret;
+}
+
+static
+void
+Test_ApplyLzx(void)
+{
+    WCHAR Source[MAX_PATH], Dest[MAX_PATH], WimPath[MAX_PATH], Path[MAX_PATH];
+    UCHAR Text[LZX_TEXT_LINES * 64];
+    PUCHAR Applied;
+    HANDLE File, Wim, Image;
+    DWORD Result, TextSize, Size = 0, Written;
+    BOOL Ret;
+
+    BuildPath(Source, L"lzxsrc");
+    BuildPath(Dest, L"lzxdst");
+    BuildPath(WimPath, L"lzx.wim");
+    BuildPath(Path, L"lzxsrc\\lzx.txt");
+
+    TextSize = BuildLzxText(Text);
+    CreateDirectoryW(Source, NULL);
+    File = CreateFileW(Path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    ok(File != INVALID_HANDLE_VALUE, "Cannot create %S, error %lu\n", Path, GetLastError());
+    if (File == INVALID_HANDLE_VALUE)
+        return;
+    Ret = WriteFile(File, Text, TextSize, &Written, NULL) && Written == TextSize;
+    CloseHandle(File);
+    ok(Ret, "Cannot write %S, error %lu\n", Path, GetLastError());
+
+    /* wimgapi does not compress LZX, so a stored resource is swapped for the chunk */
+    Wim = pWIMCreateFile(WimPath, WIM_GENERIC_READ | WIM_GENERIC_WRITE, WIM_CREATE_ALWAYS, 0,
+                         WIM_COMPRESS_NONE, &Result);
+    ok(Wim != NULL, "WIMCreateFile failed, error %lu\n", GetLastError());
+    if (!Wim)
+        return;
+    Image = pWIMCaptureImage(Wim, Source, 0);
+    ok(Image != NULL, "WIMCaptureImage failed, error %lu\n", GetLastError());
+    if (Image)
+        pWIMCloseHandle(Image);
+    pWIMCloseHandle(Wim);
+    if (!Image || !PatchLzxResource(WimPath, TextSize))
+    {
+        skip("Cannot build the LZX WIM\n");
+        return;
+    }
+
+    Wim = pWIMCreateFile(WimPath, WIM_GENERIC_READ, WIM_OPEN_EXISTING, 0, 0, &Result);
+    ok(Wim != NULL, "WIMCreateFile failed, error %lu\n", GetLastError());
+    if (!Wim)
+        return;
+    Image = pWIMLoadImage(Wim, 1);
+    ok(Image != NULL, "WIMLoadImage failed, error %lu\n", GetLastError());
+    if (Image)
+    {
+        /* Verifying checks the decompressed data against the hash of the text */
+        ok(pWIMApplyImage(Image, Dest, WIM_FLAG_VERIFY), "WIMApplyImage failed, error %lu\n", GetLastError());
+        BuildPath(Path, L"lzxdst\\lzx.txt");
+        Applied = ReadTestFile(Path, &Size);
+        ok(Applied != NULL, "%S not applied\n", Path);
+        if (Applied)
+        {
+            ok(Size == TextSize, "%S: %lu bytes, expected %lu\n", Path, Size, TextSize);
+            ok(Size == TextSize && !memcmp(Applied, Text, TextSize), "%S: wrong contents\n", Path);
+            HeapFree(GetProcessHeap(), 0, Applied);
+        }
+        pWIMCloseHandle(Image);
+    }
+    pWIMCloseHandle(Wim);
+}
+
+START_TEST(WIMCaptureImage)
+{
+    WCHAR Path[MAX_PATH];
+    HMODULE Module;
+
+    Module = LoadLibraryW(L"wimgapi.dll");
+    if (!Module)
+    {
+        skip("wimgapi.dll not available\n");
+        return;
+    }
+    pWIMCreateFile = (PFN_WIMCreateFile)GetProcAddress(Module, "WIMCreateFile");
+    pWIMCloseHandle = (PFN_WIMCloseHandle)GetProcAddress(Module, "WIMCloseHandle");
+    pWIMGetImageCount = (PFN_WIMGetImageCount)GetProcAddress(Module, "WIMGetImageCount");
+    pWIMLoadImage = (PFN_WIMLoadImage)GetProcAddress(Module, "WIMLoadImage");
+    pWIMGetImageInformation = (PFN_WIMGetImageInformation)GetProcAddress(Module, "WIMGetImageInformation");
+    pWIMCaptureImage = (PFN_WIMCaptureImage)GetProcAddress(Module, "WIMCaptureImage");
+    pWIMApplyImage = (PFN_WIMApplyImage)GetProcAddress(Module, "WIMApplyImage");
+    pWIMExportImage = (PFN_WIMExportImage)GetProcAddress(Module, "WIMExportImage");
+    if (!pWIMCreateFile || !pWIMCloseHandle || !pWIMGetImageCount || !pWIMLoadImage ||
+        !pWIMGetImageInformation || !pWIMCaptureImage || !pWIMApplyImage || !pWIMExportImage)
+    {
+        skip("wimgapi.dll is incomplete\n");
+        FreeLibrary(Module);
+        return;
+    }
+
+    GetTempPathW(MAX_PATH, Path);
+    StringCchPrintfW(BasePath, MAX_PATH, L"%swimgapi_apitest", Path);
+    DeleteTree(BasePath);
+    CreateDirectoryW(BasePath, NULL);
+    BuildPath(Path, L"src");
+    CreateDirectoryW(Path, NULL);
+    BuildPath(Path, L"src\\sub");
+    CreateDirectoryW(Path, NULL);
+    BuildPath(Path, L"src\\sub\\empty");
+    CreateDirectoryW(Path, NULL);
+
+    if (!WriteTestFile(L"src\\text.txt", 100000, 0) ||
+        !WriteTestFile(L"src\\copy.txt", 100000, 0) ||
+        !WriteTestFile(L"src\\empty.txt", 0, 0) ||
+        !WriteTestFile(L"src\\sub\\random.bin", 200000, 1) ||
+        !WriteTestFile(L"src\\sub\\large.txt", 4 * 1024 * 1024 + 123, 0))
+    {
+        skip("Cannot create the test files\n");
+    }
+    else
+    {
+        Test_CaptureApply();
+        Test_CaptureLzx();
+    }
+    Test_ApplyLzx();
+
+    DeleteTree(BasePath);
+    FreeLibrary(Module);
+}
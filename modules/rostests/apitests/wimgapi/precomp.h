@@ -0,0 +1,27 @@
+#ifndef _WIMGAPI_APITEST_PRECOMP_H_
+#define _WIMGAPI_APITEST_PRECOMP_H_
+
+#include <apitest.h>
+#include <strsafe.h>
+
+/* wimgapi.h is not part of the PSDK, declare what the tests use */
+#define WIM_GENERIC_READ            GENERIC_READ
+#define WIM_GENERIC_WRITE           GENERIC_WRITE
+#define WIM_CREATE_ALWAYS           CREATE_ALWAYS
+#define WIM_OPEN_EXISTING           OPEN_EXISTING
+#define WIM_COMPRESS_NONE           0
+#define WIM_COMPRESS_XPRESS         1
+#define WIM_CREATED_NEW             0
+#define WIM_OPENED_EXISTING         1
+#define WIM_FLAG_VERIFY             0x00000002
+
+typedef HANDLE (WINAPI *PFN_WIMCreateFile)(PCWSTR, DWORD, DWORD, DWORD, DWORD, PDWORD);
+typedef BOOL   (WINAPI *PFN_WIMCloseHandle)(HANDLE);
+typedef DWORD  (WINAPI *PFN_WIMGetImageCount)(HANDLE);
+typedef HANDLE (WINAPI *PFN_WIMLoadImage)(HANDLE, DWORD);
+typedef BOOL   (WINAPI *PFN_WIMGetImageInformation)(HANDLE, PVOID *, PDWORD);
+typedef HANDLE (WINAPI *PFN_WIMCaptureImage)(HANDLE, PCWSTR, DWORD);
+typedef BOOL   (WINAPI *PFN_WIMApplyImage)(HANDLE, PCWSTR, DWORD);
+typedef BOOL   (WINAPI *PFN_WIMExportImage)(HANDLE, HANDLE, DWORD);
+
+#endif /* _WIMGAPI_APITEST_PRECOMP_H_ */
@@ -0,0 +1,12 @@
+#define __ROS_LONG64__
+
+#define STANDALONE
+#include <apitest.h>
+
+extern void func_WIMCaptureImage(void);
+
+const struct test winetest_testlist[] =
+{
+    { "WIMCaptureImage", func_WIMCaptureImage },
+    { 0, 0 }
+};
@@ -0,0 +1,124 @@
+/*
+ * Times AlphaBlend and StretchBlt between 32bpp DIB sections and
+ * reports the throughput in Mpixels/s.
+ */
+
+#include <windows.h>
+#include <stdio.h>
+
+#define WIDTH   1024
+#define HEIGHT  768
+#define LOOPS   50
+
+static HDC
+CreateDibDC(int Width, int Height, HBITMAP *Bitmap, BYTE Alpha)
+{
+    BITMAPINFO bmi;
+    ULONG *Bits;
+    HDC hdc;
+    int i;
+
+    ZeroMemory(&bmi, sizeof(bmi));
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = Width;
+    bmi.bmiHeader.biHeight = -Height;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    hdc = CreateCompatibleDC(NULL);
+    *Bitmap = CreateDIBSection(hdc, &bmi, DIB_RGB_COLORS, (void **)&Bits, NULL, 0);
+    if (!*Bitmap)
+    {
+        DeleteDC(hdc);
+        return NULL;
+    }
+    SelectObject(hdc, *Bitmap);
+
+    /* Premultiplied gradient */
+    for (i = 0; i < Width * Height; i++)
+    {
+        BYTE a = Alpha ? Alpha : (BYTE)(i % Width * 255 / Width);
+        BYTE c = (BYTE)(i * 7) * a / 255;
+        Bits[i] = (a << 24) | (c << 16) | (c << 8) | c;
+    }
+
+    return hdc;
+}
+
+static void
+Report(const char *Name, LARGE_INTEGER *Start, LARGE_INTEGER *End, int Width, int Height)
+{
+    LARGE_INTEGER Frequency;
+    double Seconds;
+
+    QueryPerformanceFrequency(&Frequency);
+    Seconds = (double)(End->QuadPart - Start->QuadPart) / (double)Frequency.QuadPart;
+    printf("%-32s %8.1f Mpixels/s\n", Name,
+           (double)Width * Height * LOOPS / Seconds / 1000000.0);
+}
+
+static void
+BenchAlphaBlend(const char *Name, HDC hdcDst, HDC hdcSrc, int SrcWidth, int SrcHeight,
+                BYTE ConstAlpha, BYTE Format)
+{
+    BLENDFUNCTION Blend = { AC_SRC_OVER, 0, ConstAlpha, Format };
+    LARGE_INTEGER Start, End;
+    int i;
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < LOOPS; i++)
+        AlphaBlend(hdcDst, 0, 0, WIDTH, HEIGHT, hdcSrc, 0, 0, SrcWidth, SrcHeight, Blend);
+    GdiFlush();
+    QueryPerformanceCounter(&End);
+
+    Report(Name, &Start, &End, WIDTH, HEIGHT);
+}
+
+static void
+BenchStretchBlt(const char *Name, HDC hdcDst, int DstWidth, int DstHeight,
+                HDC hdcSrc, int SrcWidth, int SrcHeight)
+{
+    LARGE_INTEGER Start, End;
+    int i;
+
+    SetStretchBltMode(hdcDst, COLORONCOLOR);
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < LOOPS; i++)
+        StretchBlt(hdcDst, 0, 0, DstWidth, DstHeight, hdcSrc, 0, 0, SrcWidth, SrcHeight, SRCCOPY);
+    GdiFlush();
+    QueryPerformanceCounter(&End);
+
+    Report(Name, &Start, &End, DstWidth, DstHeight);
+}
+
+int main(int argc, char *argv[])
+{
+    HBITMAP hbmDst, hbmSrc, hbmSmall;
+    HDC hdcDst, hdcSrc, hdcSmall;
+
+    hdcDst = CreateDibDC(WIDTH, HEIGHT, &hbmDst, 255);
+    hdcSrc = CreateDibDC(WIDTH, HEIGHT, &hbmSrc, 0);
+    hdcSmall = CreateDibDC(WIDTH / 2 + 1, HEIGHT / 2 + 1, &hbmSmall, 0);
+    if (!hdcDst || !hdcSrc || !hdcSmall)
+    {
+        printf("Failed to create the DIB sections\n");
+        return 1;
+    }
+
+    BenchAlphaBlend("AlphaBlend constant alpha", hdcDst, hdcSrc, WIDTH, HEIGHT, 128, 0);
+    BenchAlphaBlend("AlphaBlend per-pixel alpha", hdcDst, hdcSrc, WIDTH, HEIGHT, 255, AC_SRC_ALPHA);
+    BenchAlphaBlend("AlphaBlend per-pixel and constant", hdcDst, hdcSrc, WIDTH, HEIGHT, 200, AC_SRC_ALPHA);
+    BenchAlphaBlend("AlphaBlend stretched", hdcDst, hdcSmall, WIDTH / 2 + 1, HEIGHT / 2 + 1, 255, AC_SRC_ALPHA);
+    BenchStretchBlt("StretchBlt same size", hdcDst, WIDTH, HEIGHT, hdcSrc, WIDTH, HEIGHT);
+    BenchStretchBlt("StretchBlt enlarge", hdcDst, WIDTH, HEIGHT, hdcSmall, WIDTH / 2 + 1, HEIGHT / 2 + 1);
+    BenchStretchBlt("StretchBlt shrink", hdcSmall, WIDTH / 2 + 1, HEIGHT / 2 + 1, hdcSrc, WIDTH, HEIGHT);
+
+    DeleteDC(hdcSmall);
+    DeleteDC(hdcSrc);
+    DeleteDC(hdcDst);
+    DeleteObject(hbmSmall);
+    DeleteObject(hbmSrc);
+    DeleteObject(hbmDst);
+    return 0;
+}
@@ -0,0 +1,111 @@
+/*
+ * PROJECT:         ReactOS kernel-mode tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Kernel-Mode Test Suite CcRandomRead test user-mode part
+ */
+
+#include <kmt_test.h>
+
+#define READ_COUNT      1024
+#define READ_PASSES     8
+#define READ_LENGTH     4096
+#define FILE_PAGES      (4294967296ULL / READ_LENGTH)
+
+static
+ULONG
+NextRandom(
+    _Inout_ PULONG Seed)
+{
+    *Seed = *Seed * 1103515245 + 12345;
+    return *Seed;
+}
+
+START_TEST(CcRandomRead)
+{
+    HANDLE Handle;
+    NTSTATUS Status;
+    LARGE_INTEGER ByteOffset;
+    LARGE_INTEGER Start, End, Frequency;
+    IO_STATUS_BLOCK IoStatusBlock;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    PULONGLONG Offsets;
+    PULONG Buffer;
+    ULONG Seed, Pass, i, Failures;
+    ULONGLONG Bytes, Ticks;
+    UNICODE_STRING BigFile = RTL_CONSTANT_STRING(L"\\Device\\Kmtest-CcRandomRead\\BigFile");
+
+    Buffer = RtlAllocateHeap(RtlGetProcessHeap(), 0, READ_LENGTH);
+    Offsets = RtlAllocateHeap(RtlGetProcessHeap(), 0, READ_COUNT * sizeof(*Offsets));
+    if (!Buffer || !Offsets)
+    {
+        skip(FALSE, "Out of memory\n");
+        goto Cleanup;
+    }
+
+    /* Spread the reads over the whole 4GB file, so that each of them
+     * is likely to hit a different view */
+    Seed = 0x4B4D5453;
+    for (i = 0; i < READ_COUNT; i++)
+    {
+        Offsets[i] = (ULONGLONG)(((ULONGLONG)NextRandom(&Seed) << 16 ^ NextRandom(&Seed)) % FILE_PAGES) * READ_LENGTH;
+    }
+
+    KmtLoadDriver(L"CcRandomRead", FALSE);
+    KmtOpenDriver();
+
+    InitializeObjectAttributes(&ObjectAttributes, &BigFile, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    Status = NtOpenFile(&Handle, FILE_ALL_ACCESS, &ObjectAttributes, &IoStatusBlock, 0, FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+    {
+        goto Unload;
+    }
+
+    NtQueryPerformanceCounter(&Start, &Frequency);
+
+    /* First pass creates the views, the following ones mostly look them up */
+    Failures = 0;
+    for (Pass = 0; Pass < READ_PASSES; Pass++)
+    {
+        for (i = 0; i < READ_COUNT; i++)
+        {
+            ByteOffset.QuadPart = Offsets[i];
+            Status = NtReadFile(Handle, NULL, NULL, NULL, &IoStatusBlock, Buffer, READ_LENGTH, &ByteOffset, NULL);
+            if (!NT_SUCCESS(Status) ||
+                IoStatusBlock.Information != READ_LENGTH ||
+                Buffer[0] != (ULONG)(Offsets[i] / PAGE_SIZE) ||
+                Buffer[READ_LENGTH / sizeof(ULONG) - 1] != (ULONG)((Offsets[i] + READ_LENGTH - 1) / PAGE_SIZE))
+            {
+                if (Failures++ < 10)
+                {
+                    ok(0, "Read at %I64u failed: %lx, %lu, %lx\n", Offsets[i], Status, (ULONG)IoStatusBlock.Information, Buffer[0]);
+                }
+            }
+        }
+    }
+
+    NtQueryPerformanceCounter(&End, NULL);
+    ok_eq_ulong(Failures, 0UL);
+
+    Bytes = (ULONGLONG)READ_COUNT * READ_PASSES * READ_LENGTH;
+    Ticks = End.QuadPart - Start.QuadPart;
+    if (Ticks != 0 && Frequency.QuadPart != 0)
+    {
+        trace("%lu random reads of %lu bytes in %I64u ms, %I64u KB/s\n",
+              READ_COUNT * READ_PASSES, READ_LENGTH,
+              Ticks * 1000 / Frequency.QuadPart,
+              Bytes * Frequency.QuadPart / Ticks / 1024);
+    }
+
+    NtClose(Handle);
+
+Unload:
+    KmtCloseDriver();
+    KmtUnloadDriver();
+
+Cleanup:
+    if (Offsets)
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Offsets);
+    if (Buffer)
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Buffer);
+}
@@ -1314,6 +1314,134 @@ static void test_bitmap_scaler(void)
     IWICBitmap_Release(bitmap);
 }
 
+static void test_bitmap_scaler_filters(void)
+{
+    static const WICBitmapInterpolationMode modes[] =
+    {
+        WICBitmapInterpolationModeNearestNeighbor,
+        WICBitmapInterpolationModeLinear,
+        WICBitmapInterpolationModeCubic,
+        WICBitmapInterpolationModeFant,
+        WICBitmapInterpolationModeHighQualityCubic,
+    };
+    static const BYTE ramp[4] = { 10, 30, 50, 70 };
+    IWICBitmapScaler *scaler;
+    IWICBitmap *bitmap;
+    BYTE src[8 * 8 * 4], dst[8 * 8 * 4], *big;
+    DWORD start, elapsed;
+    UINT i, j, y;
+    HRESULT hr;
+
+    /* A flat color stays flat in every mode */
+    for (i = 0; i < 8 * 8; i++)
+    {
+        src[i * 4] = 0x40; src[i * 4 + 1] = 0x80; src[i * 4 + 2] = 0xc0; src[i * 4 + 3] = 0xff;
+    }
+    hr = IWICImagingFactory_CreateBitmapFromMemory(factory, 8, 8, &GUID_WICPixelFormat32bppBGRA,
+        8 * 4, sizeof(src), src, &bitmap);
+    ok(hr == S_OK, "Failed to create a bitmap, hr %#x.\n", hr);
+
+    for (i = 0; i < ARRAY_SIZE(modes); i++)
+    {
+        hr = IWICImagingFactory_CreateBitmapScaler(factory, &scaler);
+        ok(hr == S_OK, "Failed to create bitmap scaler, hr %#x.\n", hr);
+        hr = IWICBitmapScaler_Initialize(scaler, (IWICBitmapSource *)bitmap, 3, 5, modes[i]);
+        if (hr != S_OK)
+        {
+            win_skip("Interpolation mode %u is not supported.\n", modes[i]);
+            IWICBitmapScaler_Release(scaler);
+            continue;
+        }
+
+        memset(dst, 0, sizeof(dst));
+        hr = IWICBitmapScaler_CopyPixels(scaler, NULL, 3 * 4, 3 * 5 * 4, dst);
+        ok(hr == S_OK, "Mode %u: CopyPixels failed, hr %#x.\n", modes[i], hr);
+        for (j = 0; j < 3 * 5; j++)
+            ok(!memcmp(dst + j * 4, src, 4), "Mode %u: pixel %u is %02x%02x%02x%02x.\n", modes[i], j,
+                dst[j * 4 + 3], dst[j * 4 + 2], dst[j * 4 + 1], dst[j * 4]);
+
+        /* Scanline by scanline gives the same rows */
+        for (y = 0; y < 5; y++)
+        {
+            WICRect rc = { 1, y, 2, 1 };
+            memset(dst, 0, 2 * 4);
+            hr = IWICBitmapScaler_CopyPixels(scaler, &rc, 2 * 4, 2 * 4, dst);
+            ok(hr == S_OK, "Mode %u: CopyPixels failed, hr %#x.\n", modes[i], hr);
+            ok(!memcmp(dst, src, 4) && !memcmp(dst + 4, src, 4), "Mode %u: row %u differs.\n", modes[i], y);
+        }
+
+        IWICBitmapScaler_Release(scaler);
+    }
+    IWICBitmap_Release(bitmap);
+
+    /* Fant averages the pixels under each destination pixel */
+    for (i = 0; i < 4 * 2; i++)
+        src[i * 4] = src[i * 4 + 1] = src[i * 4 + 2] = ramp[i % 4], src[i * 4 + 3] = 0xff;
+    hr = IWICImagingFactory_CreateBitmapFromMemory(factory, 4, 2, &GUID_WICPixelFormat32bppBGRA,
+        4 * 4, 4 * 2 * 4, src, &bitmap);
+    ok(hr == S_OK, "Failed to create a bitmap, hr %#x.\n", hr);
+    hr = IWICImagingFactory_CreateBitmapScaler(factory, &scaler);
+    ok(hr == S_OK, "Failed to create bitmap scaler, hr %#x.\n", hr);
+    hr = IWICBitmapScaler_Initialize(scaler, (IWICBitmapSource *)bitmap, 2, 1, WICBitmapInterpolationModeFant);
+    ok(hr == S_OK, "Failed to initialize bitmap scaler, hr %#x.\n", hr);
+    hr = IWICBitmapScaler_CopyPixels(scaler, NULL, 2 * 4, 2 * 4, dst);
+    ok(hr == S_OK, "CopyPixels failed, hr %#x.\n", hr);
+    ok(dst[0] == 20 && dst[4] == 60, "Unexpected pixels %u, %u.\n", dst[0], dst[4]);
+    IWICBitmapScaler_Release(scaler);
+    IWICBitmap_Release(bitmap);
+
+    /* Premultiplied color never exceeds alpha, even with cubic overshoot */
+    for (i = 0; i < 8 * 8; i++)
+    {
+        BYTE alpha = (i % 8) < 4 ? 0xff : 0x20;
+        src[i * 4] = src[i * 4 + 1] = src[i * 4 + 2] = alpha;
+        src[i * 4 + 3] = alpha;
+    }
+    hr = IWICImagingFactory_CreateBitmapFromMemory(factory, 8, 8, &GUID_WICPixelFormat32bppPBGRA,
+        8 * 4, sizeof(src), src, &bitmap);
+    ok(hr == S_OK, "Failed to create a bitmap, hr %#x.\n", hr);
+    hr = IWICImagingFactory_CreateBitmapScaler(factory, &scaler);
+    ok(hr == S_OK, "Failed to create bitmap scaler, hr %#x.\n", hr);
+    hr = IWICBitmapScaler_Initialize(scaler, (IWICBitmapSource *)bitmap, 13, 3, WICBitmapInterpolationModeCubic);
+    ok(hr == S_OK, "Failed to initialize bitmap scaler, hr %#x.\n", hr);
+    hr = IWICBitmapScaler_CopyPixels(scaler, NULL, 13 * 4, 13 * 3 * 4, dst);
+    ok(hr == S_OK, "CopyPixels failed, hr %#x.\n", hr);
+    for (j = 0; j < 13 * 3; j++)
+        ok(dst[j * 4] <= dst[j * 4 + 3], "Pixel %u: color %u above alpha %u.\n", j, dst[j * 4], dst[j * 4 + 3]);
+    IWICBitmapScaler_Release(scaler);
+    IWICBitmap_Release(bitmap);
+
+    /* 4K to thumbnail */
+    big = HeapAlloc(GetProcessHeap(), 0, 3840 * 2160 * 4);
+    if (!big) return;
+    for (i = 0; i < 3840 * 2160 * 4; i++)
+        big[i] = (BYTE)(i * 7 + i / 15360);
+    hr = IWICImagingFactory_CreateBitmapFromMemory(factory, 3840, 2160, &GUID_WICPixelFormat32bppBGRA,
+        3840 * 4, 3840 * 2160 * 4, big, &bitmap);
+    ok(hr == S_OK, "Failed to create a bitmap, hr %#x.\n", hr);
+    HeapFree(GetProcessHeap(), 0, big);
+    if (hr != S_OK) return;
+
+    big = HeapAlloc(GetProcessHeap(), 0, 256 * 144 * 4);
+    for (i = 0; big && i < ARRAY_SIZE(modes); i++)
+    {
+        hr = IWICImagingFactory_CreateBitmapScaler(factory, &scaler);
+        ok(hr == S_OK, "Failed to create bitmap scaler, hr %#x.\n", hr);
+        hr = IWICBitmapScaler_Initialize(scaler, (IWICBitmapSource *)bitmap, 256, 144, modes[i]);
+        if (hr == S_OK)
+        {
+            start = GetTickCount();
+            hr = IWICBitmapScaler_CopyPixels(scaler, NULL, 256 * 4, 256 * 144 * 4, big);
+            elapsed = GetTickCount() - start;
+            ok(hr == S_OK, "Mode %u: CopyPixels failed, hr %#x.\n", modes[i], hr);
+            trace("Mode %u: 3840x2160 to 256x144 in %u ms.\n", modes[i], elapsed);
+        }
+        IWICBitmapScaler_Release(scaler);
+    }
+    HeapFree(GetProcessHeap(), 0, big);
+    IWICBitmap_Release(bitmap);
+}
+
 static LONG obj_refcount(void *obj)
 {
     IUnknown_AddRef((IUnknown *)obj);
@@ -1484,6 +1612,7 @@ START_TEST(bitmap)
     test_CreateBitmapFromHBITMAP();
     test_clipper();
     test_bitmap_scaler();
+    test_bitmap_scaler_filters();
 
     IWICImagingFactory_Release(factory);
 
@@ -1841,6 +1841,102 @@ static void test_converter_8bppIndexed(void)
     DeleteTestBitmap(src_obj);
 }
 
+static void test_converter_large(void)
+{
+    static const struct
+    {
+        const WICPixelFormatGUID *src_format;
+        UINT src_bpp;
+        const WICPixelFormatGUID *dst_format;
+    } tests[] =
+    {
+        { &GUID_WICPixelFormat24bppBGR, 24, &GUID_WICPixelFormat32bppBGRA },
+        { &GUID_WICPixelFormat24bppBGR, 24, &GUID_WICPixelFormat32bppRGBA },
+        { &GUID_WICPixelFormat8bppGray, 8, &GUID_WICPixelFormat32bppBGRA },
+        { &GUID_WICPixelFormat32bppBGRA, 32, &GUID_WICPixelFormat32bppPBGRA },
+        { &GUID_WICPixelFormat32bppBGRA, 32, &GUID_WICPixelFormat32bppPRGBA },
+    };
+    /* Larger than a conversion band, with odd sizes for the SIMD tails */
+    const UINT width = 1021, height = 301;
+    IWICFormatConverter *converter;
+    IWICBitmap *bitmap;
+    BYTE *src, *dst;
+    DWORD start;
+    UINT i, x, y, c, src_stride, errors, tolerance;
+    HRESULT hr;
+
+    src = HeapAlloc(GetProcessHeap(), 0, width * height * 4);
+    dst = HeapAlloc(GetProcessHeap(), 0, width * height * 4);
+    for (i = 0; i < width * height * 4; i++)
+        src[i] = (BYTE)(i * 131 + i / 509);
+
+    for (i = 0; i < ARRAY_SIZE(tests); i++)
+    {
+        src_stride = width * tests[i].src_bpp / 8;
+        hr = IWICImagingFactory_CreateBitmapFromMemory(factory, width, height, tests[i].src_format,
+            src_stride, src_stride * height, src, &bitmap);
+        ok(hr == S_OK, "%u: CreateBitmapFromMemory error %#x\n", i, hr);
+        hr = IWICImagingFactory_CreateFormatConverter(factory, &converter);
+        ok(hr == S_OK, "%u: CreateFormatConverter error %#x\n", i, hr);
+        hr = IWICFormatConverter_Initialize(converter, (IWICBitmapSource *)bitmap, tests[i].dst_format,
+            WICBitmapDitherTypeNone, NULL, 0.0, WICBitmapPaletteTypeCustom);
+        ok(hr == S_OK, "%u: Initialize error %#x\n", i, hr);
+
+        start = GetTickCount();
+        hr = IWICFormatConverter_CopyPixels(converter, NULL, width * 4, width * height * 4, dst);
+        trace("%u: converted %ux%u in %u ms\n", i, width, height, GetTickCount() - start);
+        ok(hr == S_OK, "%u: CopyPixels error %#x\n", i, hr);
+
+        /* Native may round premultiplied colors instead of truncating them */
+        tolerance = IsEqualGUID(tests[i].dst_format, &GUID_WICPixelFormat32bppPBGRA) ||
+                    IsEqualGUID(tests[i].dst_format, &GUID_WICPixelFormat32bppPRGBA);
+        errors = 0;
+        for (y = 0; y < height; y++)
+        {
+            for (x = 0; x < width; x++)
+            {
+                const BYTE *s = src + y * src_stride + x * tests[i].src_bpp / 8;
+                BYTE expect[4];
+
+                if (tests[i].src_bpp == 8)
+                    expect[0] = expect[1] = expect[2] = s[0], expect[3] = 0xff;
+                else
+                {
+                    expect[0] = s[0];
+                    expect[1] = s[1];
+                    expect[2] = s[2];
+                    expect[3] = tests[i].src_bpp == 32 ? s[3] : 0xff;
+                }
+                if (IsEqualGUID(tests[i].dst_format, &GUID_WICPixelFormat32bppPBGRA) ||
+                    IsEqualGUID(tests[i].dst_format, &GUID_WICPixelFormat32bppPRGBA))
+                {
+                    expect[0] = expect[0] * expect[3] / 255;
+                    expect[1] = expect[1] * expect[3] / 255;
+                    expect[2] = expect[2] * expect[3] / 255;
+                }
+                if (IsEqualGUID(tests[i].dst_format, &GUID_WICPixelFormat32bppRGBA) ||
+                    IsEqualGUID(tests[i].dst_format, &GUID_WICPixelFormat32bppPRGBA))
+                {
+                    BYTE temp = expect[0];
+                    expect[0] = expect[2];
+                    expect[2] = temp;
+                }
+                for (c = 0; c < 4; c++)
+                    if (abs(dst[(y * width + x) * 4 + c] - expect[c]) > tolerance) break;
+                if (c < 4 && errors++ < 4)
+                    ok(0, "%u: pixel %u,%u is %08x\n", i, x, y, *(DWORD *)(dst + (y * width + x) * 4));
+            }
+        }
+        ok(!errors, "%u: %u wrong pixels\n", i, errors);
+
+        IWICFormatConverter_Release(converter);
+        IWICBitmap_Release(bitmap);
+    }
+
+    HeapFree(GetProcessHeap(), 0, src);
+    HeapFree(GetProcessHeap(), 0, dst);
+}
+
 START_TEST(converter)
 {
     HRESULT hr;
@@ -1895,6 +1991,7 @@ START_TEST(converter)
     test_invalid_conversion();
     test_default_converter();
     test_converter_8bppIndexed();
+    test_converter_large();
 
     test_encoder(&testdata_8bppIndexed, &CLSID_WICGifEncoder,
                  &testdata_8bppIndexed, &CLSID_WICGifDecoder, "GIF encoder 8bppIndexed");
@@ -163,6 +163,10 @@ CcScheduleReadAhead (
 {
     KIRQL OldIrql;
     LARGE_INTEGER NewOffset;
+    LONGLONG WindowEnd;
+    ULONG Window;
+    ULONG MaxWindow;
+    BOOLEAN Sequential;
     PROS_SHARED_CACHE_MAP SharedCacheMap;
     PPRIVATE_CACHE_MAP PrivateCacheMap;
 
@@ -183,40 +187,74 @@ CcScheduleReadAhead (
 
     /* Lock read ahead spin lock */
     KeAcquireSpinLock(&PrivateCacheMap->ReadAheadSpinLock, &OldIrql);
-    /* Easy case: the file is sequentially read */
+    /* Easy case: the file is sequentially read, unless we went backward */
     if (BooleanFlagOn(FileObject->Flags, FO_SEQUENTIAL_ONLY))
     {
-        /* If we went backward, this is no go! */
-        if (NewOffset.QuadPart < PrivateCacheMap->ReadAheadOffset[1].QuadPart)
-        {
-            KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
-            return;
-        }
+        Sequential = (FileOffset->QuadPart >= PrivateCacheMap->FileOffset2.QuadPart);
+        MaxWindow = CC_MAX_SEQUENTIAL_READ_AHEAD;
+    }
+    /* Other cases: look for a stream, that is a read going forward
+     * and starting where the previous one stopped (give or take a granule)
+     */
+    else
+    {
+        Sequential = (PrivateCacheMap->FileOffset2.QuadPart >= PrivateCacheMap->FileOffset1.QuadPart &&
+                      FileOffset->QuadPart >= PrivateCacheMap->FileOffset2.QuadPart &&
+                      FileOffset->QuadPart <= PrivateCacheMap->BeyondLastByte2.QuadPart +
+                                              PrivateCacheMap->ReadAheadMask + 1);
+        MaxWindow = CC_MAX_READ_AHEAD;
+    }
+
+    /* Random access: collapse the window, it will have to grow again */
+    if (!Sequential)
+    {
+        PrivateCacheMap->ReadAheadOffset[0].QuadPart = 0;
+        PrivateCacheMap->ReadAheadLength[0] = 0;
+        KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
+        return;
+    }
 
-        /* FIXME: hackish, but will do the job for now */
-        PrivateCacheMap->ReadAheadOffset[1].QuadPart = NewOffset.QuadPart;
-        PrivateCacheMap->ReadAheadLength[1] = Length;
+    /* ReadAheadOffset[0] and ReadAheadLength[0] describe the last window
+     * we scheduled. Don't schedule again before the reader went through
+     * half of it.
+     */
+    WindowEnd = PrivateCacheMap->ReadAheadOffset[0].QuadPart + PrivateCacheMap->ReadAheadLength[0];
+    if (PrivateCacheMap->ReadAheadLength[0] != 0 &&
+        NewOffset.QuadPart + PrivateCacheMap->ReadAheadLength[0] / 2 < WindowEnd)
+    {
+        KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
+        return;
+    }
+
+    /* Grow the window geometrically while the stream goes on */
+    if (PrivateCacheMap->ReadAheadLength[0] == 0)
+    {
+        Window = max(Length, CC_MIN_READ_AHEAD);
+        WindowEnd = NewOffset.QuadPart;
     }
-    /* Other cases: try to find some logic in that mess... */
     else
     {
-        /* Let's check if we always read the same way (like going down in the file)
-         * and pretend it's enough for now
-         */
-        if (PrivateCacheMap->FileOffset2.QuadPart >= PrivateCacheMap->FileOffset1.QuadPart &&
-            FileOffset->QuadPart >= PrivateCacheMap->FileOffset2.QuadPart)
-        {
-            /* FIXME: hackish, but will do the job for now */
-            PrivateCacheMap->ReadAheadOffset[1].QuadPart = NewOffset.QuadPart;
-            PrivateCacheMap->ReadAheadLength[1] = Length;
-        }
-        else
-        {
-            /* FIXME: handle the other cases */
-            KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
-            UNIMPLEMENTED_ONCE;
-            return;
-        }
+        Window = PrivateCacheMap->ReadAheadLength[0] * 2;
+        WindowEnd = max(WindowEnd, NewOffset.QuadPart);
+    }
+    Window = ROUND_UP(min(Window, MaxWindow), PrivateCacheMap->ReadAheadMask + 1);
+
+    PrivateCacheMap->ReadAheadOffset[0].QuadPart = WindowEnd;
+    PrivateCacheMap->ReadAheadLength[0] = Window;
+
+    /* ReadAheadOffset[1] and ReadAheadLength[1] describe what's left to
+     * read for CcPerformReadAhead. If it didn't get to it yet, extend it.
+     */
+    if (PrivateCacheMap->ReadAheadLength[1] != 0 &&
+        PrivateCacheMap->ReadAheadOffset[1].QuadPart <= WindowEnd)
+    {
+        PrivateCacheMap->ReadAheadLength[1] = (ULONG)(WindowEnd + Window -
+                                                      PrivateCacheMap->ReadAheadOffset[1].QuadPart);
+    }
+    else
+    {
+        PrivateCacheMap->ReadAheadOffset[1].QuadPart = WindowEnd;
+        PrivateCacheMap->ReadAheadLength[1] = Window;
     }
 
     /* If read ahead isn't active yet */
@@ -27,6 +27,18 @@ typedef enum _CC_COPY_OPERATION
     CcOperationZero
 } CC_COPY_OPERATION;
 
+/* Number of views CcPerformReadAhead reads in parallel */
+#define CC_READ_AHEAD_BATCH 8
+
+typedef struct _CC_READ_AHEAD_VIEW
+{
+    PROS_VACB Vacb;
+    PMDL Mdl;
+    ULONG Size;
+    KEVENT Event;
+    IO_STATUS_BLOCK IoStatus;
+} CC_READ_AHEAD_VIEW, *PCC_READ_AHEAD_VIEW;
+
 typedef enum _CC_CAN_WRITE_RETRY
 {
     FirstTry = 0,
@@ -76,16 +88,17 @@ CcInitCacheZeroPage (
     MiZeroPhysicalPage(CcZeroPage);
 }
 
+/* Locks the VACB pages and sends the paging read, the caller waits on Event */
+static
 NTSTATUS
-NTAPI
-CcReadVirtualAddress (
-    PROS_VACB Vacb)
+CcStartReadVirtualAddress (
+    PROS_VACB Vacb,
+    PKEVENT Event,
+    PIO_STATUS_BLOCK IoStatus,
+    PMDL *Mdl,
+    PULONG Size)
 {
-    ULONG Size;
-    PMDL Mdl;
     NTSTATUS Status;
-    IO_STATUS_BLOCK IoStatus;
-    KEVENT Event;
     ULARGE_INTEGER LargeSize;
 
     LargeSize.QuadPart = Vacb->SharedCacheMap->SectionSize.QuadPart - Vacb->FileOffset.QuadPart;
@@ -93,14 +106,14 @@ CcReadVirtualAddress (
     {
         LargeSize.QuadPart = VACB_MAPPING_GRANULARITY;
     }
-    Size = LargeSize.LowPart;
+    *Size = LargeSize.LowPart;
 
-    Size = ROUND_TO_PAGES(Size);
-    ASSERT(Size <= VACB_MAPPING_GRANULARITY);
-    ASSERT(Size > 0);
+    *Size = ROUND_TO_PAGES(*Size);
+    ASSERT(*Size <= VACB_MAPPING_GRANULARITY);
+    ASSERT(*Size > 0);
 
-    Mdl = IoAllocateMdl(Vacb->BaseAddress, Size, FALSE, FALSE, NULL);
-    if (!Mdl)
+    *Mdl = IoAllocateMdl(Vacb->BaseAddress, *Size, FALSE, FALSE, NULL);
+    if (!*Mdl)
     {
         return STATUS_INSUFFICIENT_RESOURCES;
     }
@@ -108,29 +121,50 @@ CcReadVirtualAddress (
     Status = STATUS_SUCCESS;
     _SEH2_TRY
     {
-        MmProbeAndLockPages(Mdl, KernelMode, IoWriteAccess);
+        MmProbeAndLockPages(*Mdl, KernelMode, IoWriteAccess);
     }
     _SEH2_EXCEPT (EXCEPTION_EXECUTE_HANDLER)
     {
         Status = _SEH2_GetExceptionCode();
-        DPRINT1("MmProbeAndLockPages failed with: %lx for %p (%p, %p)\n", Status, Mdl, Vacb, Vacb->BaseAddress);
+        DPRINT1("MmProbeAndLockPages failed with: %lx for %p (%p, %p)\n", Status, *Mdl, Vacb, Vacb->BaseAddress);
         KeBugCheck(CACHE_MANAGER);
     } _SEH2_END;
 
-    if (NT_SUCCESS(Status))
+    if (!NT_SUCCESS(Status))
     {
-        Mdl->MdlFlags |= MDL_IO_PAGE_READ;
-        KeInitializeEvent(&Event, NotificationEvent, FALSE);
-        Status = IoPageRead(Vacb->SharedCacheMap->FileObject, Mdl, &Vacb->FileOffset, &Event, &IoStatus);
-        if (Status == STATUS_PENDING)
-        {
-            KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
-            Status = IoStatus.Status;
-        }
+        IoFreeMdl(*Mdl);
+        *Mdl = NULL;
+        return Status;
+    }
 
-        MmUnlockPages(Mdl);
+    (*Mdl)->MdlFlags |= MDL_IO_PAGE_READ;
+    KeInitializeEvent(Event, NotificationEvent, FALSE);
+    Status = IoPageRead(Vacb->SharedCacheMap->FileObject, *Mdl, &Vacb->FileOffset, Event, IoStatus);
+    if (Status != STATUS_PENDING)
+    {
+        /* Completed inline, make the wait in CcFinishReadVirtualAddress a no-op */
+        IoStatus->Status = Status;
+        KeSetEvent(Event, IO_NO_INCREMENT, FALSE);
     }
 
+    return STATUS_PENDING;
+}
+
+static
+NTSTATUS
+CcFinishReadVirtualAddress (
+    PROS_VACB Vacb,
+    PKEVENT Event,
+    PIO_STATUS_BLOCK IoStatus,
+    PMDL Mdl,
+    ULONG Size)
+{
+    NTSTATUS Status;
+
+    KeWaitForSingleObject(Event, Executive, KernelMode, FALSE, NULL);
+    Status = IoStatus->Status;
+
+    MmUnlockPages(Mdl);
     IoFreeMdl(Mdl);
 
     if (!NT_SUCCESS(Status) && (Status != STATUS_END_OF_FILE))
@@ -148,6 +182,26 @@ CcReadVirtualAddress (
     return STATUS_SUCCESS;
 }
 
+NTSTATUS
+NTAPI
+CcReadVirtualAddress (
+    PROS_VACB Vacb)
+{
+    ULONG Size;
+    PMDL Mdl;
+    NTSTATUS Status;
+    IO_STATUS_BLOCK IoStatus;
+    KEVENT Event;
+
+    Status = CcStartReadVirtualAddress(Vacb, &Event, &IoStatus, &Mdl, &Size);
+    if (Status != STATUS_PENDING)
+    {
+        return Status;
+    }
+
+    return CcFinishReadVirtualAddress(Vacb, &Event, &IoStatus, Mdl, Size);
+}
+
 NTSTATUS
 NTAPI
 CcWriteVirtualAddress (
@@ -273,6 +327,7 @@ CcCopyData (
     ULONG PartialLength;
     PVOID BaseAddress;
     BOOLEAN Valid;
+    BOOLEAN Streaming;
     PPRIVATE_CACHE_MAP PrivateCacheMap;
 
     SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
@@ -280,6 +335,13 @@ CcCopyData (
     CurrentOffset = FileOffset;
     BytesCopied = 0;
 
+    /* Reads continuing a stream are the ones read ahead should have served */
+    Streaming = (Operation == CcOperationRead &&
+                 !BooleanFlagOn(FileObject->Flags, FO_RANDOM_ACCESS) &&
+                 !BooleanFlagOn(SharedCacheMap->Flags, READAHEAD_DISABLED) &&
+                 (BooleanFlagOn(FileObject->Flags, FO_SEQUENTIAL_ONLY) ||
+                  FileOffset == PrivateCacheMap->BeyondLastByte2.QuadPart));
+
     if (!Wait)
     {
         /* test if the requested data is available */
@@ -320,6 +382,11 @@ CcCopyData (
                                   &Vacb);
         if (!NT_SUCCESS(Status))
             ExRaiseStatus(Status);
+        if (Streaming)
+        {
+            InterlockedIncrement((PLONG)(Valid ? &SharedCacheMap->ReadAheadHits :
+                                                 &SharedCacheMap->ReadAheadMisses));
+        }
         if (!Valid)
         {
             Status = CcReadVirtualAddress(Vacb);
@@ -358,6 +425,11 @@ CcCopyData (
                                   &Vacb);
         if (!NT_SUCCESS(Status))
             ExRaiseStatus(Status);
+        if (Streaming)
+        {
+            InterlockedIncrement((PLONG)(Valid ? &SharedCacheMap->ReadAheadHits :
+                                                 &SharedCacheMap->ReadAheadMisses));
+        }
         if (!Valid &&
             (Operation == CcOperationRead ||
              PartialLength < VACB_MAPPING_GRANULARITY))
@@ -387,11 +459,10 @@ CcCopyData (
     /* If that was a successful sync read operation, let's handle read ahead */
     if (Operation == CcOperationRead && Length == 0 && Wait)
     {
-        /* If file isn't random access and next read may get us cross VACB boundary,
-         * schedule next read
+        /* If file isn't random access, let read ahead decide whether
+         * its window has to move (or shrink, on a random read)
          */
-        if (!BooleanFlagOn(FileObject->Flags, FO_RANDOM_ACCESS) &&
-            (CurrentOffset - 1) / VACB_MAPPING_GRANULARITY != (CurrentOffset + BytesCopied - 1) / VACB_MAPPING_GRANULARITY)
+        if (!BooleanFlagOn(FileObject->Flags, FO_RANDOM_ACCESS))
         {
             CcScheduleReadAhead(FileObject, (PLARGE_INTEGER)&FileOffset, BytesCopied);
         }
@@ -482,18 +553,97 @@ CcPostDeferredWrites(VOID)
     }
 }
 
+/* Brings the range in the cache, sending the paging reads of up to
+ * CC_READ_AHEAD_BATCH views at once before waiting for them */
+static
+VOID
+CcReadAheadRange(
+    IN PROS_SHARED_CACHE_MAP SharedCacheMap,
+    IN LONGLONG CurrentOffset,
+    IN ULONG Length)
+{
+    NTSTATUS Status;
+    LONGLONG EndOffset;
+    PVOID BaseAddress;
+    BOOLEAN Valid;
+    BOOLEAN Stop;
+    PROS_VACB Vacb;
+    ULONG Count, i;
+    CC_READ_AHEAD_VIEW Views[CC_READ_AHEAD_BATCH];
+
+    EndOffset = CurrentOffset + Length;
+    CurrentOffset = ROUND_DOWN(CurrentOffset, VACB_MAPPING_GRANULARITY);
+    Stop = FALSE;
+
+    while (!Stop && CurrentOffset < EndOffset)
+    {
+        /* Get the views and start reading the ones that aren't valid */
+        Count = 0;
+        while (CurrentOffset < EndOffset && Count < CC_READ_AHEAD_BATCH)
+        {
+            Status = CcRosRequestVacb(SharedCacheMap,
+                                      CurrentOffset,
+                                      &BaseAddress,
+                                      &Valid,
+                                      &Vacb);
+            if (!NT_SUCCESS(Status))
+            {
+                DPRINT1("Failed to request VACB: %lx!\n", Status);
+                Stop = TRUE;
+                break;
+            }
+
+            CurrentOffset += VACB_MAPPING_GRANULARITY;
+
+            if (Valid)
+            {
+                CcRosReleaseVacb(SharedCacheMap, Vacb, TRUE, FALSE, FALSE);
+                continue;
+            }
+
+            Status = CcStartReadVirtualAddress(Vacb,
+                                               &Views[Count].Event,
+                                               &Views[Count].IoStatus,
+                                               &Views[Count].Mdl,
+                                               &Views[Count].Size);
+            if (Status != STATUS_PENDING)
+            {
+                CcRosReleaseVacb(SharedCacheMap, Vacb, FALSE, FALSE, FALSE);
+                DPRINT1("Failed to read data: %lx!\n", Status);
+                Stop = TRUE;
+                break;
+            }
+
+            Views[Count].Vacb = Vacb;
+            Count++;
+        }
+
+        /* And wait for all of them */
+        for (i = 0; i < Count; i++)
+        {
+            Status = CcFinishReadVirtualAddress(Views[i].Vacb,
+                                                &Views[i].Event,
+                                                &Views[i].IoStatus,
+                                                Views[i].Mdl,
+                                                Views[i].Size);
+            if (!NT_SUCCESS(Status))
+            {
+                DPRINT1("Failed to read data: %lx!\n", Status);
+                Stop = TRUE;
+            }
+
+            CcRosReleaseVacb(SharedCacheMap, Views[i].Vacb, NT_SUCCESS(Status), FALSE, FALSE);
+        }
+    }
+}
+
 VOID
 CcPerformReadAhead(
     IN PFILE_OBJECT FileObject)
 {
-    NTSTATUS Status;
     LONGLONG CurrentOffset;
     KIRQL OldIrql;
     PROS_SHARED_CACHE_MAP SharedCacheMap;
-    PROS_VACB Vacb;
-    ULONG PartialLength;
-    PVOID BaseAddress;
-    BOOLEAN Valid;
     ULONG Length;
     PPRIVATE_CACHE_MAP PrivateCacheMap;
     BOOLEAN Locked;
@@ -521,6 +671,7 @@ CcPerformReadAhead(
         KeAcquireSpinLockAtDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
         CurrentOffset = PrivateCacheMap->ReadAheadOffset[1].QuadPart;
         Length = PrivateCacheMap->ReadAheadLength[1];
+        PrivateCacheMap->ReadAheadLength[1] = 0;
         KeReleaseSpinLockFromDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
     }
     KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
@@ -537,6 +688,7 @@ CcPerformReadAhead(
     /* Remember it's locked */
     Locked = TRUE;
 
+Next:
     /* Don't read past the end of the file */
     if (CurrentOffset >= SharedCacheMap->FileSize.QuadPart)
     {
@@ -547,74 +699,11 @@ CcPerformReadAhead(
         Length = SharedCacheMap->FileSize.QuadPart - CurrentOffset;
     }
 
-    /* Next of the algorithm will lock like CcCopyData with the slight
+    /* Next of the algorithm will look like CcCopyData with the slight
      * difference that we don't copy data back to an user-backed buffer
      * We just bring data into Cc
      */
-    PartialLength = CurrentOffset % VACB_MAPPING_GRANULARITY;
-    if (PartialLength != 0)
-    {
-        PartialLength = min(Length, VACB_MAPPING_GRANULARITY - PartialLength);
-        Status = CcRosRequestVacb(SharedCacheMap,
-                                  ROUND_DOWN(CurrentOffset,
-                                             VACB_MAPPING_GRANULARITY),
-                                  &BaseAddress,
-                                  &Valid,
-                                  &Vacb);
-        if (!NT_SUCCESS(Status))
-        {
-            DPRINT1("Failed to request VACB: %lx!\n", Status);
-            goto Clear;
-        }
-
-        if (!Valid)
-        {
-            Status = CcReadVirtualAddress(Vacb);
-            if (!NT_SUCCESS(Status))
-            {
-                CcRosReleaseVacb(SharedCacheMap, Vacb, FALSE, FALSE, FALSE);
-                DPRINT1("Failed to read data: %lx!\n", Status);
-                goto Clear;
-            }
-        }
-
-        CcRosReleaseVacb(SharedCacheMap, Vacb, TRUE, FALSE, FALSE);
-
-        Length -= PartialLength;
-        CurrentOffset += PartialLength;
-    }
-
-    while (Length > 0)
-    {
-        ASSERT(CurrentOffset % VACB_MAPPING_GRANULARITY == 0);
-        PartialLength = min(VACB_MAPPING_GRANULARITY, Length);
-        Status = CcRosRequestVacb(SharedCacheMap,
-                                  CurrentOffset,
-                                  &BaseAddress,
-                                  &Valid,
-                                  &Vacb);
-        if (!NT_SUCCESS(Status))
-        {
-            DPRINT1("Failed to request VACB: %lx!\n", Status);
-            goto Clear;
-        }
-
-        if (!Valid)
-        {
-            Status = CcReadVirtualAddress(Vacb);
-            if (!NT_SUCCESS(Status))
-            {
-                CcRosReleaseVacb(SharedCacheMap, Vacb, FALSE, FALSE, FALSE);
-                DPRINT1("Failed to read data: %lx!\n", Status);
-                goto Clear;
-            }
-        }
-
-        CcRosReleaseVacb(SharedCacheMap, Vacb, TRUE, FALSE, FALSE);
-
-        Length -= PartialLength;
-        CurrentOffset += PartialLength;
-    }
+    CcReadAheadRange(SharedCacheMap, CurrentOffset, Length);
 
 Clear:
     /* See previous comment about private cache map */
@@ -622,8 +711,19 @@ Clear:
     PrivateCacheMap = FileObject->PrivateCacheMap;
     if (PrivateCacheMap != NULL)
     {
-        /* Mark read ahead as unactive */
         KeAcquireSpinLockAtDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
+        /* The window moved while we were reading, keep going */
+        if (Locked && PrivateCacheMap->ReadAheadLength[1] != 0)
+        {
+            CurrentOffset = PrivateCacheMap->ReadAheadOffset[1].QuadPart;
+            Length = PrivateCacheMap->ReadAheadLength[1];
+            PrivateCacheMap->ReadAheadLength[1] = 0;
+            KeReleaseSpinLockFromDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
+            KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
+            goto Next;
+        }
+
+        /* Mark read ahead as unactive */
         InterlockedAnd((volatile long *)&PrivateCacheMap->UlongFlags, ~PRIVATE_CACHE_MAP_READ_AHEAD_ACTIVE);
         KeReleaseSpinLockFromDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
     }
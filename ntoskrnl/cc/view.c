@@ -363,6 +363,7 @@ retry:
             ASSERT(!current->MappedCount);
             ASSERT(Refs == 1);
 
+            CcRosRemoveVacbFromIndex(current);
             RemoveEntryList(&current->CacheMapVacbListEntry);
             RemoveEntryList(&current->VacbLruListEntry);
             InitializeListHead(&current->VacbLruListEntry);
@@ -452,6 +453,219 @@ CcRosReleaseVacb (
     return STATUS_SUCCESS;
 }
 
+/* Must be called with the shared cache map lock held */
+static
+PROS_VACB *
+CcRosVacbIndexSlot (
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset)
+{
+    ULONGLONG View;
+    ULONGLONG Leaf;
+
+    View = (ULONGLONG)FileOffset / VACB_MAPPING_GRANULARITY;
+    if (View < VACB_INDEX_INLINE_ENTRIES)
+    {
+        return &SharedCacheMap->InlineVacbs[View];
+    }
+
+    Leaf = View >> VACB_INDEX_LEAF_SHIFT;
+    if (Leaf >= SharedCacheMap->VacbIndexSize ||
+        SharedCacheMap->VacbIndex[Leaf] == NULL)
+    {
+        return NULL;
+    }
+
+    return &SharedCacheMap->VacbIndex[Leaf][View & (VACB_INDEX_LEAF_ENTRIES - 1)];
+}
+
+/* Must be called with the shared cache map lock held */
+static
+PROS_VACB
+CcRosVacbIndexFindPrevious (
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset)
+{
+    ULONGLONG View;
+    ULONG Leaf;
+    ULONG Entry;
+    PROS_VACB *Vacbs;
+
+    View = (ULONGLONG)FileOffset / VACB_MAPPING_GRANULARITY;
+    if (View > VACB_INDEX_INLINE_ENTRIES)
+    {
+        Leaf = (ULONG)(View >> VACB_INDEX_LEAF_SHIFT);
+        Entry = (ULONG)(View & (VACB_INDEX_LEAF_ENTRIES - 1));
+        ASSERT(Leaf < SharedCacheMap->VacbIndexSize);
+
+        /* The inline views are never set in the first leaf */
+        for (;;)
+        {
+            Vacbs = SharedCacheMap->VacbIndex[Leaf];
+            if (Vacbs != NULL)
+            {
+                while (Entry-- > 0)
+                {
+                    if (Vacbs[Entry] != NULL)
+                        return Vacbs[Entry];
+                }
+            }
+
+            if (Leaf == 0)
+                break;
+
+            Leaf--;
+            Entry = VACB_INDEX_LEAF_ENTRIES;
+        }
+
+        View = VACB_INDEX_INLINE_ENTRIES;
+    }
+
+    while (View-- > 0)
+    {
+        if (SharedCacheMap->InlineVacbs[View] != NULL)
+            return SharedCacheMap->InlineVacbs[View];
+    }
+
+    return NULL;
+}
+
+/*
+ * Makes sure the VACB index has a slot for the given offset. Small files
+ * only use the inline slots. The index only ever grows: leaves are
+ * released with the shared cache map.
+ */
+static
+NTSTATUS
+CcRosReserveVacbIndex (
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset)
+{
+    ULONGLONG Leaf;
+    ULONG OldSize;
+    ULONG NewSize;
+    PROS_VACB **OldIndex;
+    PROS_VACB **NewIndex;
+    PROS_VACB *NewLeaf;
+    KIRQL OldIrql;
+
+    if ((ULONGLONG)FileOffset / VACB_MAPPING_GRANULARITY < VACB_INDEX_INLINE_ENTRIES)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    Leaf = ((ULONGLONG)FileOffset / VACB_MAPPING_GRANULARITY) >> VACB_INDEX_LEAF_SHIFT;
+    if (Leaf >= MAXULONG / (2 * sizeof(PROS_VACB *)))
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &OldIrql);
+    OldSize = SharedCacheMap->VacbIndexSize;
+    if (Leaf < OldSize && SharedCacheMap->VacbIndex[Leaf] != NULL)
+    {
+        KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, OldIrql);
+        return STATUS_SUCCESS;
+    }
+    KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, OldIrql);
+
+    /* Allocate outside of the lock, we'll sort out races afterwards */
+    NewIndex = NULL;
+    NewSize = 0;
+    if (Leaf >= OldSize)
+    {
+        NewSize = max(OldSize * 2, (ULONG)Leaf + 1);
+        NewIndex = ExAllocatePoolWithTag(NonPagedPool, NewSize * sizeof(PROS_VACB *), TAG_VACB_INDEX);
+        if (NewIndex == NULL)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+    NewLeaf = ExAllocatePoolWithTag(NonPagedPool, VACB_INDEX_LEAF_ENTRIES * sizeof(PROS_VACB), TAG_VACB_INDEX);
+    if (NewLeaf == NULL)
+    {
+        if (NewIndex != NULL)
+        {
+            ExFreePoolWithTag(NewIndex, TAG_VACB_INDEX);
+        }
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    RtlZeroMemory(NewLeaf, VACB_INDEX_LEAF_ENTRIES * sizeof(PROS_VACB));
+
+    OldIndex = NULL;
+    KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &OldIrql);
+    if (Leaf >= SharedCacheMap->VacbIndexSize)
+    {
+        /* Nobody grew the directory past us in the meantime */
+        ASSERT(NewIndex != NULL);
+        OldSize = SharedCacheMap->VacbIndexSize;
+        RtlCopyMemory(NewIndex, SharedCacheMap->VacbIndex, OldSize * sizeof(PROS_VACB *));
+        RtlZeroMemory(NewIndex + OldSize, (NewSize - OldSize) * sizeof(PROS_VACB *));
+        OldIndex = SharedCacheMap->VacbIndex;
+        SharedCacheMap->VacbIndex = NewIndex;
+        SharedCacheMap->VacbIndexSize = NewSize;
+        NewIndex = NULL;
+    }
+    if (SharedCacheMap->VacbIndex[Leaf] == NULL)
+    {
+        SharedCacheMap->VacbIndex[Leaf] = NewLeaf;
+        NewLeaf = NULL;
+    }
+    KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, OldIrql);
+
+    if (OldIndex != NULL)
+    {
+        ExFreePoolWithTag(OldIndex, TAG_VACB_INDEX);
+    }
+    if (NewIndex != NULL)
+    {
+        ExFreePoolWithTag(NewIndex, TAG_VACB_INDEX);
+    }
+    if (NewLeaf != NULL)
+    {
+        ExFreePoolWithTag(NewLeaf, TAG_VACB_INDEX);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+CcRosFreeVacbIndex (
+    PROS_SHARED_CACHE_MAP SharedCacheMap)
+{
+    ULONG i;
+
+    for (i = 0; i < SharedCacheMap->VacbIndexSize; i++)
+    {
+        if (SharedCacheMap->VacbIndex[i] != NULL)
+        {
+            ExFreePoolWithTag(SharedCacheMap->VacbIndex[i], TAG_VACB_INDEX);
+        }
+    }
+
+    if (SharedCacheMap->VacbIndex != NULL)
+    {
+        ExFreePoolWithTag(SharedCacheMap->VacbIndex, TAG_VACB_INDEX);
+    }
+
+    SharedCacheMap->VacbIndex = NULL;
+    SharedCacheMap->VacbIndexSize = 0;
+}
+
+/* Must be called with the shared cache map lock held */
+VOID
+CcRosRemoveVacbFromIndex (
+    PROS_VACB Vacb)
+{
+    PROS_VACB *Slot;
+
+    Slot = CcRosVacbIndexSlot(Vacb->SharedCacheMap, Vacb->FileOffset.QuadPart);
+    ASSERT(Slot != NULL && *Slot == Vacb);
+    *Slot = NULL;
+}
+
 /* Returns with VACB Lock Held! */
 PROS_VACB
 NTAPI
@@ -459,7 +673,7 @@ CcRosLookupVacb (
     PROS_SHARED_CACHE_MAP SharedCacheMap,
     LONGLONG FileOffset)
 {
-    PLIST_ENTRY current_entry;
+    PROS_VACB *Slot;
     PROS_VACB current;
     KIRQL oldIrql;
 
@@ -468,33 +682,26 @@ CcRosLookupVacb (
     DPRINT("CcRosLookupVacb(SharedCacheMap 0x%p, FileOffset %I64u)\n",
            SharedCacheMap, FileOffset);
 
-    oldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
-    KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
+    /* The index is protected by the map lock, no need for the master lock:
+     * VACBs are only removed from it with this lock held, so a reference
+     * taken here keeps them alive.
+     */
+    KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &oldIrql);
 
-    current_entry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    while (current_entry != &SharedCacheMap->CacheMapVacbListHead)
+    current = NULL;
+    Slot = CcRosVacbIndexSlot(SharedCacheMap, FileOffset);
+    if (Slot != NULL && *Slot != NULL)
     {
-        current = CONTAINING_RECORD(current_entry,
-                                    ROS_VACB,
-                                    CacheMapVacbListEntry);
-        if (IsPointInRange(current->FileOffset.QuadPart,
-                           VACB_MAPPING_GRANULARITY,
-                           FileOffset))
-        {
-            CcRosVacbIncRefCount(current);
-            KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
-            KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
-            return current;
-        }
-        if (current->FileOffset.QuadPart > FileOffset)
-            break;
-        current_entry = current_entry->Flink;
+        current = *Slot;
+        ASSERT(IsPointInRange(current->FileOffset.QuadPart,
+                              VACB_MAPPING_GRANULARITY,
+                              FileOffset));
+        CcRosVacbIncRefCount(current);
     }
 
-    KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
-    KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
+    KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
 
-    return NULL;
+    return current;
 }
 
 VOID
@@ -733,6 +940,7 @@ CcRosFreeUnusedVacb (
             ASSERT(Refs == 1);
 
             /* Reset and move to free list */
+            CcRosRemoveVacbFromIndex(current);
             RemoveEntryList(&current->CacheMapVacbListEntry);
             RemoveEntryList(&current->VacbLruListEntry);
             InitializeListHead(&current->VacbLruListEntry);
@@ -784,7 +992,7 @@ CcRosCreateVacb (
 {
     PROS_VACB current;
     PROS_VACB previous;
-    PLIST_ENTRY current_entry;
+    PROS_VACB *Slot;
     NTSTATUS Status;
     KIRQL oldIrql;
     ULONG Refs;
@@ -800,6 +1008,13 @@ CcRosCreateVacb (
         return STATUS_INVALID_PARAMETER;
     }
 
+    Status = CcRosReserveVacbIndex(SharedCacheMap, FileOffset);
+    if (!NT_SUCCESS(Status))
+    {
+        *Vacb = NULL;
+        return Status;
+    }
+
     current = ExAllocateFromNPagedLookasideList(&VacbLookasideList);
     current->BaseAddress = NULL;
     current->Valid = FALSE;
@@ -853,48 +1068,35 @@ Retry:
      * our newly created VACB and return the existing one.
      */
     KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
-    current_entry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    previous = NULL;
-    while (current_entry != &SharedCacheMap->CacheMapVacbListHead)
+    Slot = CcRosVacbIndexSlot(SharedCacheMap, FileOffset);
+    ASSERT(Slot != NULL);
+    if (*Slot != NULL)
     {
-        current = CONTAINING_RECORD(current_entry,
-                                    ROS_VACB,
-                                    CacheMapVacbListEntry);
-        if (IsPointInRange(current->FileOffset.QuadPart,
-                           VACB_MAPPING_GRANULARITY,
-                           FileOffset))
-        {
-            CcRosVacbIncRefCount(current);
-            KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
+        current = *Slot;
+        CcRosVacbIncRefCount(current);
+        KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
 #if DBG
-            if (SharedCacheMap->Trace)
-            {
-                DPRINT1("CacheMap 0x%p: deleting newly created VACB 0x%p ( found existing one 0x%p )\n",
-                        SharedCacheMap,
-                        (*Vacb),
-                        current);
-            }
+        if (SharedCacheMap->Trace)
+        {
+            DPRINT1("CacheMap 0x%p: deleting newly created VACB 0x%p ( found existing one 0x%p )\n",
+                    SharedCacheMap,
+                    (*Vacb),
+                    current);
+        }
 #endif
-            KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
+        KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
 
-            Refs = CcRosVacbDecRefCount(*Vacb);
-            ASSERT(Refs == 0);
+        Refs = CcRosVacbDecRefCount(*Vacb);
+        ASSERT(Refs == 0);
 
-            *Vacb = current;
-            return STATUS_SUCCESS;
-        }
-        if (current->FileOffset.QuadPart < FileOffset)
-        {
-            ASSERT(previous == NULL ||
-                   previous->FileOffset.QuadPart < current->FileOffset.QuadPart);
-            previous = current;
-        }
-        if (current->FileOffset.QuadPart > FileOffset)
-            break;
-        current_entry = current_entry->Flink;
+        *Vacb = current;
+        return STATUS_SUCCESS;
     }
-    /* There was no existing VACB. */
+    /* There was no existing VACB. Keep the list sorted by offset. */
     current = *Vacb;
+    previous = CcRosVacbIndexFindPrevious(SharedCacheMap, FileOffset);
+    ASSERT(previous == NULL ||
+           previous->FileOffset.QuadPart < current->FileOffset.QuadPart);
     if (previous)
     {
         InsertHeadList(&previous->CacheMapVacbListEntry, &current->CacheMapVacbListEntry);
@@ -903,6 +1105,7 @@ Retry:
     {
         InsertHeadList(&SharedCacheMap->CacheMapVacbListHead, &current->CacheMapVacbListEntry);
     }
+    *Slot = current;
     KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
     InsertTailList(&VacbLruListHead, &current->VacbLruListEntry);
     KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
@@ -1189,9 +1392,10 @@ CcRosDeleteFileCache (
         while (!IsListEmpty(&SharedCacheMap->CacheMapVacbListHead))
         {
             current_entry = RemoveTailList(&SharedCacheMap->CacheMapVacbListHead);
+            current = CONTAINING_RECORD(current_entry, ROS_VACB, CacheMapVacbListEntry);
+            CcRosRemoveVacbFromIndex(current);
             KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
 
-            current = CONTAINING_RECORD(current_entry, ROS_VACB, CacheMapVacbListEntry);
             RemoveEntryList(&current->VacbLruListEntry);
             InitializeListHead(&current->VacbLruListEntry);
             if (current->Dirty)
@@ -1259,6 +1463,7 @@ CcRosDeleteFileCache (
         RemoveEntryList(&SharedCacheMap->SharedCacheMapLinks);
         KeReleaseQueuedSpinLock(LockQueueMasterLock, *OldIrql);
 
+        CcRosFreeVacbIndex(SharedCacheMap);
         ExFreeToNPagedLookasideList(&SharedCacheMapLookasideList, SharedCacheMap);
         *OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
     }
@@ -1577,7 +1782,7 @@ ExpKdbgExtFileCache(ULONG Argc, PCHAR Argv[])
     UNICODE_STRING NoName = RTL_CONSTANT_STRING(L"No name for File");
 
     KdbpPrint("  Usage Summary (in kb)\n");
-    KdbpPrint("Shared\t\tValid\tDirty\tName\n");
+    KdbpPrint("Shared\t\tValid\tDirty\tRA hit\tRA miss\tName\n");
     /* No need to lock the spin lock here, we're in DBG */
     for (ListEntry = CcCleanSharedCacheMapList.Flink;
          ListEntry != &CcCleanSharedCacheMapList;
@@ -1629,7 +1834,9 @@ ExpKdbgExtFileCache(ULONG Argc, PCHAR Argv[])
         }
 
         /* And print */
-        KdbpPrint("%p\t%d\t%d\t%wZ%S\n", SharedCacheMap, Valid, Dirty, FileName, Extra);
+        KdbpPrint("%p\t%d\t%d\t%lu\t%lu\t%wZ%S\n", SharedCacheMap, Valid, Dirty,
+                  SharedCacheMap->ReadAheadHits, SharedCacheMap->ReadAheadMisses,
+                  FileName, Extra);
     }
 
     return TRUE;
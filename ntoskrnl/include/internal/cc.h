@@ -167,6 +167,18 @@ typedef struct _PFSN_PREFETCHER_GLOBALS
     LONG ActivePrefetches;
 } PFSN_PREFETCHER_GLOBALS, *PPFSN_PREFETCHER_GLOBALS;
 
+/* Files up to 1MB never need the index levels */
+#define VACB_INDEX_INLINE_ENTRIES 4
+
+/* Each leaf of the VACB index is a 4KB page of pointers, covering 256MB
+ * of the file on 32-bit and 128MB on 64-bit */
+#ifdef _WIN64
+#define VACB_INDEX_LEAF_SHIFT 9
+#else
+#define VACB_INDEX_LEAF_SHIFT 10
+#endif
+#define VACB_INDEX_LEAF_ENTRIES (1 << VACB_INDEX_LEAF_SHIFT)
+
 typedef struct _ROS_SHARED_CACHE_MAP
 {
     CSHORT NodeTypeCode;
@@ -188,13 +200,28 @@ typedef struct _ROS_SHARED_CACHE_MAP
 
     /* ROS specific */
     LIST_ENTRY CacheMapVacbListHead;
+    /* VACBs by file offset, protected by CacheMapLock. The first views are
+     * kept inline like NT's InitialVacbs, the rest in a sparse two-level index */
+    struct _ROS_VACB *InlineVacbs[VACB_INDEX_INLINE_ENTRIES];
+    struct _ROS_VACB ***VacbIndex;
+    ULONG VacbIndexSize;
     BOOLEAN PinAccess;
     KSPIN_LOCK CacheMapLock;
+    /* Views found valid (or not) by reads continuing a stream */
+    ULONG ReadAheadHits;
+    ULONG ReadAheadMisses;
 #if DBG
     BOOLEAN Trace; /* enable extra trace output for this cache map and it's VACBs */
 #endif
 } ROS_SHARED_CACHE_MAP, *PROS_SHARED_CACHE_MAP;
 
+
+/* Read ahead window bounds: the window doubles on each sequential read,
+ * and gets larger for files opened with FILE_SEQUENTIAL_ONLY */
+#define CC_MIN_READ_AHEAD               (64 * 1024)
+#define CC_MAX_READ_AHEAD               (2 * 1024 * 1024)
+#define CC_MAX_SEQUENTIAL_READ_AHEAD    (8 * 1024 * 1024)
+
 #define READAHEAD_DISABLED 0x1
 #define WRITEBEHIND_DISABLED 0x2
 
@@ -474,6 +501,10 @@ NTSTATUS
 CcRosInternalFreeVacb(
     IN PROS_VACB Vacb);
 
+VOID
+CcRosRemoveVacbFromIndex(
+    IN PROS_VACB Vacb);
+
 FORCEINLINE
 BOOLEAN
 DoRangesIntersect(
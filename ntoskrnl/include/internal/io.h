@@ -57,6 +57,11 @@
 //
 #define IO_METHOD_FROM_CTL_CODE(c)                      (c & 0x00000003)
 
+//
+// Completion entries NtRemoveIoCompletionEx can dequeue without allocating
+//
+#define IOC_REMOVE_LOCAL_ENTRIES                        16
+
 //
 // Bugcheck codes for RAM disk booting
 //
@@ -266,7 +271,8 @@ typedef enum _COMPLETION_PACKET_TYPE
     {
     IopCompletionPacketIrp,
     IopCompletionPacketMini,
-    IopCompletionPacketQuota
+    IopCompletionPacketQuota,
+    IopCompletionPacketWait
 } COMPLETION_PACKET_TYPE, *PCOMPLETION_PACKET_TYPE;
 
 //
@@ -290,6 +296,21 @@ typedef struct _IOP_MINI_COMPLETION_PACKET
     ULONG_PTR IoStatusInformation;
 } IOP_MINI_COMPLETION_PACKET, *PIOP_MINI_COMPLETION_PACKET;
 
+//
+// Wait Completion Packet. While it's associated, the packet holds references
+// to itself, the completion port and the target object, which are dropped
+// once the completion is removed from the port or the wait is cancelled.
+//
+typedef struct _IOP_WAIT_COMPLETION_PACKET
+{
+    KWAIT_NOTIFICATION Wait;
+    IOP_MINI_COMPLETION_PACKET Packet;
+    KGUARDED_MUTEX Lock;
+    PKQUEUE IoCompletion;
+    PVOID TargetObject;
+    volatile LONG Associated;
+} IOP_WAIT_COMPLETION_PACKET, *PIOP_WAIT_COMPLETION_PACKET;
+
 //
 // I/O Completion Context for IoSetIoCompletionRoutineEx
 //
@@ -1383,6 +1404,16 @@ IopDeleteIoCompletion(
     PVOID ObjectBody
 );
 
+VOID
+NTAPI
+IopCloseWaitCompletionPacket(
+    IN PEPROCESS Process OPTIONAL,
+    IN PVOID ObjectBody,
+    IN ACCESS_MASK GrantedAccess,
+    IN ULONG ProcessHandleCount,
+    IN ULONG SystemHandleCount
+);
+
 NTSTATUS
 NTAPI
 IoSetIoCompletion(
@@ -1433,11 +1464,13 @@ IopQueueDeviceAction(
 // Global I/O Data
 //
 extern POBJECT_TYPE IoCompletionType;
+extern POBJECT_TYPE IoWaitCompletionPacketType;
 extern PDEVICE_NODE IopRootDeviceNode;
 extern KSPIN_LOCK IopDeviceTreeLock;
 extern ULONG IopTraceLevel;
 extern GENERAL_LOOKASIDE IopMdlLookasideList;
 extern GENERIC_MAPPING IopCompletionMapping;
+extern GENERIC_MAPPING IopWaitCompletionPacketMapping;
 extern GENERIC_MAPPING IopFileMapping;
 extern POBJECT_TYPE _IoFileObjectType;
 extern HAL_DISPATCH _HalDispatchTable;
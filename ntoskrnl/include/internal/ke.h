@@ -78,6 +78,17 @@ typedef struct _KNMI_HANDLER_CALLBACK
     PVOID Handle;
 } KNMI_HANDLER_CALLBACK, *PKNMI_HANDLER_CALLBACK;
 
+//
+// Threadless wait: once the object is signaled, the entry is inserted
+// into the queue instead of a thread being woken up
+//
+typedef struct _KWAIT_NOTIFICATION
+{
+    KWAIT_BLOCK WaitBlock;
+    PKQUEUE Queue;
+    PLIST_ENTRY QueueEntry;
+} KWAIT_NOTIFICATION, *PKWAIT_NOTIFICATION;
+
 typedef PCHAR
 (NTAPI *PKE_BUGCHECK_UNICODE_TO_ANSI)(
     IN PUNICODE_STRING Unicode,
@@ -712,6 +723,39 @@ VOID
 FASTCALL
 KiActivateWaiterQueue(IN PKQUEUE Queue);
 
+ULONG
+NTAPI
+KeRemoveQueueEx(
+    IN PKQUEUE Queue,
+    IN KPROCESSOR_MODE WaitMode,
+    IN BOOLEAN Alertable,
+    IN PLARGE_INTEGER Timeout OPTIONAL,
+    OUT PLIST_ENTRY *EntryArray,
+    IN ULONG Count
+);
+
+BOOLEAN
+NTAPI
+KeCancelQueueEntry(
+    IN PKQUEUE Queue,
+    IN PLIST_ENTRY Entry
+);
+
+BOOLEAN
+NTAPI
+KeAssociateWaitNotification(
+    IN PKWAIT_NOTIFICATION Notification,
+    IN PVOID Object,
+    IN PKQUEUE Queue,
+    IN PLIST_ENTRY QueueEntry
+);
+
+BOOLEAN
+NTAPI
+KeCancelWaitNotification(
+    IN PKWAIT_NOTIFICATION Notification
+);
+
 ULONG
 NTAPI
 KeQueryRuntimeProcess(IN PKPROCESS Process,
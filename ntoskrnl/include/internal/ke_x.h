@@ -1246,6 +1246,28 @@ KxSetTimerForThreadWait(IN PKTIMER Timer,
     /* Set the wait time */                                                 \
     Thread->WaitTime = KeTickCount.LowPart;
 
+//
+// Satisfies a threadless wait by handing its entry to the queue.
+// The object must have been satisfied already.
+//
+FORCEINLINE
+VOID
+KiSignalNotificationWait(IN PKWAIT_BLOCK WaitBlock)
+{
+    PKWAIT_NOTIFICATION Notification;
+
+    /* Get the notification */
+    Notification = CONTAINING_RECORD(WaitBlock, KWAIT_NOTIFICATION, WaitBlock);
+
+    /* It's only satisfied once, unlink it from the object */
+    RemoveEntryList(&WaitBlock->WaitListEntry);
+    WaitBlock->WaitListEntry.Flink = NULL;
+
+    /* The entry stays unlinked if it goes straight to a waiting thread */
+    Notification->QueueEntry->Flink = NULL;
+    KiInsertQueue(Notification->Queue, Notification->QueueEntry, FALSE);
+}
+
 //
 // Unwaits a Thread
 //
@@ -1268,6 +1290,14 @@ KxUnwaitThread(IN DISPATCHER_HEADER *Object,
         /* Get the current wait block */
         WaitBlock = CONTAINING_RECORD(WaitEntry, KWAIT_BLOCK, WaitListEntry);
 
+        /* Threadless waits just queue their entry */
+        if (WaitBlock->WaitType == WaitNotification)
+        {
+            KiSignalNotificationWait(WaitBlock);
+            WaitEntry = WaitList->Flink;
+            continue;
+        }
+
         /* Get the waiting thread */
         WaitThread = WaitBlock->Thread;
 
@@ -1312,6 +1342,14 @@ KxUnwaitThreadForEvent(IN PKEVENT Event,
         /* Get the current wait block */
         WaitBlock = CONTAINING_RECORD(WaitEntry, KWAIT_BLOCK, WaitListEntry);
 
+        /* Threadless waits consume the event like a WaitAny does */
+        if (WaitBlock->WaitType == WaitNotification)
+        {
+            Event->Header.SignalState = 0;
+            KiSignalNotificationWait(WaitBlock);
+            break;
+        }
+
         /* Get the waiting thread */
         WaitThread = WaitBlock->Thread;
 
@@ -3,6 +3,7 @@
 /* Cache Manager Tags */
 #define TAG_CC                  '  cC'
 #define TAG_VACB                'aVcC'
+#define TAG_VACB_INDEX          'xIcC'
 #define TAG_SHARED_CACHE_MAP    'cScC'
 #define TAG_PRIVATE_CACHE_MAP   'cPcC'
 #define TAG_BCB                 'cBcC'
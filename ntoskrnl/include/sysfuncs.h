@@ -294,3 +294,7 @@
     SVC_(QueryPortInformationProcess, 0)
     SVC_(GetCurrentProcessorNumber, 0)
     SVC_(WaitForMultipleObjects32, 5)
+    SVC_(RemoveIoCompletionEx, 6)
+    SVC_(CreateWaitCompletionPacket, 3)
+    SVC_(AssociateWaitCompletionPacket, 8)
+    SVC_(CancelWaitCompletionPacket, 2)
@@ -14,6 +14,7 @@
 #include <debug.h>
 
 POBJECT_TYPE IoCompletionType;
+POBJECT_TYPE IoWaitCompletionPacketType;
 
 GENERAL_LOOKASIDE IoCompletionPacketLookaside;
 
@@ -25,6 +26,14 @@ GENERIC_MAPPING IopCompletionMapping =
     IO_COMPLETION_ALL_ACCESS
 };
 
+GENERIC_MAPPING IopWaitCompletionPacketMapping =
+{
+    STANDARD_RIGHTS_READ,
+    STANDARD_RIGHTS_WRITE | WAIT_COMPLETION_PACKET_MODIFY_STATE,
+    STANDARD_RIGHTS_EXECUTE,
+    WAIT_COMPLETION_PACKET_ALL_ACCESS
+};
+
 static const INFORMATION_CLASS_INFO IoCompletionInfoClass[] =
 {
      /* IoCompletionBasicInformation */
@@ -95,6 +104,126 @@ IopFreeMiniPacket(PIOP_MINI_COMPLETION_PACKET Packet)
     InterlockedPushEntrySList(&List->L.ListHead, (PSLIST_ENTRY)Packet);
 }
 
+/*
+ * Drops the references an associated wait completion packet holds, once its
+ * completion has left the port or its wait was cancelled
+ */
+VOID
+NTAPI
+IopReleaseWaitCompletionPacket(IN PIOP_WAIT_COMPLETION_PACKET WaitPacket)
+{
+    PKQUEUE IoCompletion = WaitPacket->IoCompletion;
+    PVOID TargetObject = WaitPacket->TargetObject;
+
+    /* It can be associated again from now on */
+    InterlockedExchange(&WaitPacket->Associated, FALSE);
+
+    ObDereferenceObject(TargetObject);
+    ObDereferenceObject(IoCompletion);
+    ObDereferenceObject(WaitPacket);
+}
+
+/*
+ * Cancels an associated wait completion packet, called with its lock held
+ */
+NTSTATUS
+NTAPI
+IopCancelWaitCompletionPacket(IN PIOP_WAIT_COMPLETION_PACKET WaitPacket,
+                              IN BOOLEAN RemoveSignaledPacket)
+{
+    /* Nothing to cancel */
+    if (!WaitPacket->Associated) return STATUS_CANCELLED;
+
+    /* Still waiting, so it's not signaled yet */
+    if (KeCancelWaitNotification(&WaitPacket->Wait))
+    {
+        IopReleaseWaitCompletionPacket(WaitPacket);
+        return STATUS_SUCCESS;
+    }
+
+    /* It's signaled, take the completion back if it's still queued */
+    if ((RemoveSignaledPacket) &&
+        (KeCancelQueueEntry(WaitPacket->IoCompletion, &WaitPacket->Packet.ListEntry)))
+    {
+        IopReleaseWaitCompletionPacket(WaitPacket);
+        return STATUS_SUCCESS;
+    }
+
+    /* Whoever removes the completion from the port releases it */
+    return STATUS_PENDING;
+}
+
+VOID
+NTAPI
+IopCloseWaitCompletionPacket(IN PEPROCESS Process OPTIONAL,
+                             IN PVOID ObjectBody,
+                             IN ACCESS_MASK GrantedAccess,
+                             IN ULONG ProcessHandleCount,
+                             IN ULONG SystemHandleCount)
+{
+    PIOP_WAIT_COMPLETION_PACKET WaitPacket = ObjectBody;
+    PAGED_CODE();
+
+    /* Only cancel when the last handle goes away */
+    if (SystemHandleCount != 1) return;
+
+    /* Nobody can handle the completion anymore, don't leave it behind */
+    KeAcquireGuardedMutex(&WaitPacket->Lock);
+    IopCancelWaitCompletionPacket(WaitPacket, TRUE);
+    KeReleaseGuardedMutex(&WaitPacket->Lock);
+}
+
+VOID
+NTAPI
+IopUnpackCompletionPacket(IN PLIST_ENTRY ListEntry,
+                          OUT PFILE_IO_COMPLETION_INFORMATION Information)
+{
+    PIOP_MINI_COMPLETION_PACKET Packet;
+    PIRP Irp;
+
+    /* Get the Packet Data */
+    Packet = CONTAINING_RECORD(ListEntry,
+                               IOP_MINI_COMPLETION_PACKET,
+                               ListEntry);
+
+    /* Check if this is piggybacked on an IRP */
+    if (Packet->PacketType == IopCompletionPacketIrp)
+    {
+        /* Get the IRP */
+        Irp = CONTAINING_RECORD(ListEntry,
+                                IRP,
+                                Tail.Overlay.ListEntry);
+
+        /* Save values */
+        Information->KeyContext = Irp->Tail.CompletionKey;
+        Information->ApcContext = Irp->Overlay.AsynchronousParameters.UserApcContext;
+        Information->IoStatusBlock = Irp->IoStatus;
+
+        /* Free the IRP */
+        IoFreeIrp(Irp);
+    }
+    else
+    {
+        /* Save values */
+        Information->KeyContext = Packet->KeyContext;
+        Information->ApcContext = Packet->ApcContext;
+        Information->IoStatusBlock.Status = Packet->IoStatus;
+        Information->IoStatusBlock.Information = Packet->IoStatusInformation;
+
+        /* Wait completion packets are owned by their object */
+        if (Packet->PacketType == IopCompletionPacketWait)
+        {
+            IopReleaseWaitCompletionPacket(CONTAINING_RECORD(Packet,
+                                                             IOP_WAIT_COMPLETION_PACKET,
+                                                             Packet));
+            return;
+        }
+
+        /* Free the packet */
+        IopFreeMiniPacket(Packet);
+    }
+}
+
 VOID
 NTAPI
 IopDeleteIoCompletion(PVOID ObjectBody)
@@ -121,6 +250,9 @@ IopDeleteIoCompletion(PVOID ObjectBody)
             /* Go to next Entry */
             CurrentEntry = CurrentEntry->Flink;
 
+            /* Wait completion packets keep the port alive while queued */
+            ASSERT(Packet->PacketType != IopCompletionPacketWait);
+
             /* Check if it's part of an IRP, or a separate packet */
             if (Packet->PacketType == IopCompletionPacketIrp)
             {
@@ -449,13 +581,10 @@ NtRemoveIoCompletion(IN HANDLE IoCompletionHandle,
 {
     LARGE_INTEGER SafeTimeout;
     PKQUEUE Queue;
-    PIOP_MINI_COMPLETION_PACKET Packet;
     PLIST_ENTRY ListEntry;
     KPROCESSOR_MODE PreviousMode = ExGetPreviousMode();
     NTSTATUS Status;
-    PIRP Irp;
-    PVOID Apc, Key;
-    IO_STATUS_BLOCK IoStatus;
+    FILE_IO_COMPLETION_INFORMATION Information;
     PAGED_CODE();
 
     /* Check if the call was from user mode */
@@ -506,46 +635,134 @@ NtRemoveIoCompletion(IN HANDLE IoCompletionHandle,
         }
         else
         {
-            /* Get the Packet Data */
-            Packet = CONTAINING_RECORD(ListEntry,
-                                       IOP_MINI_COMPLETION_PACKET,
-                                       ListEntry);
+            /* Get the packet data and free it */
+            IopUnpackCompletionPacket(ListEntry, &Information);
 
-            /* Check if this is piggybacked on an IRP */
-            if (Packet->PacketType == IopCompletionPacketIrp)
+            /* Enter SEH to write back the values */
+            _SEH2_TRY
             {
-                /* Get the IRP */
-                Irp = CONTAINING_RECORD(ListEntry,
-                                        IRP,
-                                        Tail.Overlay.ListEntry);
-
-                /* Save values */
-                Key = Irp->Tail.CompletionKey;
-                Apc = Irp->Overlay.AsynchronousParameters.UserApcContext;
-                IoStatus = Irp->IoStatus;
-
-                /* Free the IRP */
-                IoFreeIrp(Irp);
+                /* Write the values to caller */
+                *ApcContext = Information.ApcContext;
+                *KeyContext = Information.KeyContext;
+                *IoStatusBlock = Information.IoStatusBlock;
             }
-            else
+            _SEH2_EXCEPT(ExSystemExceptionFilter())
             {
-                /* Save values */
-                Key = Packet->KeyContext;
-                Apc = Packet->ApcContext;
-                IoStatus.Status = Packet->IoStatus;
-                IoStatus.Information = Packet->IoStatusInformation;
+                /* Get the exception code */
+                Status = _SEH2_GetExceptionCode();
+            }
+            _SEH2_END;
+        }
 
-                /* Free the packet */
-                IopFreeMiniPacket(Packet);
+        /* Dereference the Object */
+        ObDereferenceObject(Queue);
+    }
+
+    /* Return status */
+    return Status;
+}
+
+NTSTATUS
+NTAPI
+NtRemoveIoCompletionEx(IN HANDLE IoCompletionHandle,
+                       OUT PFILE_IO_COMPLETION_INFORMATION IoCompletionInformation,
+                       IN ULONG Count,
+                       OUT PULONG NumEntriesRemoved,
+                       IN PLARGE_INTEGER Timeout OPTIONAL,
+                       IN BOOLEAN Alertable)
+{
+    LARGE_INTEGER SafeTimeout;
+    PKQUEUE Queue;
+    PLIST_ENTRY LocalEntries[IOC_REMOVE_LOCAL_ENTRIES];
+    PLIST_ENTRY *EntryArray = LocalEntries;
+    KPROCESSOR_MODE PreviousMode = ExGetPreviousMode();
+    NTSTATUS Status, WaitStatus;
+    FILE_IO_COMPLETION_INFORMATION Information;
+    ULONG Removed, i;
+    PAGED_CODE();
+
+    /* We need room for at least one entry, and not for more than we can address */
+    if (!Count || Count > MAXULONG / sizeof(FILE_IO_COMPLETION_INFORMATION))
+        return STATUS_INVALID_PARAMETER;
+
+    /* Check if the call was from user mode */
+    if (PreviousMode != KernelMode)
+    {
+        /* Protect probes in SEH */
+        _SEH2_TRY
+        {
+            /* Probe the output array and count */
+            ProbeForWrite(IoCompletionInformation,
+                          Count * sizeof(FILE_IO_COMPLETION_INFORMATION),
+                          sizeof(PVOID));
+            ProbeForWriteUlong(NumEntriesRemoved);
+            if (Timeout)
+            {
+                /* Probe and capture the timeout */
+                SafeTimeout = ProbeForReadLargeInteger(Timeout);
+                Timeout = &SafeTimeout;
             }
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            /* Return the exception code */
+            _SEH2_YIELD(return _SEH2_GetExceptionCode());
+        }
+        _SEH2_END;
+    }
+
+    /* Use a bigger array than the one on the stack if needed, it gets filled at SYNCH_LEVEL */
+    if (Count > IOC_REMOVE_LOCAL_ENTRIES)
+    {
+        EntryArray = ExAllocatePoolWithTag(NonPagedPool,
+                                           Count * sizeof(PLIST_ENTRY),
+                                           IOC_TAG);
+        if (!EntryArray)
+        {
+            /* Just do with what we have */
+            EntryArray = LocalEntries;
+            Count = IOC_REMOVE_LOCAL_ENTRIES;
+        }
+    }
+
+    /* Open the Object */
+    Status = ObReferenceObjectByHandle(IoCompletionHandle,
+                                       IO_COMPLETION_MODIFY_STATE,
+                                       IoCompletionType,
+                                       PreviousMode,
+                                       (PVOID*)&Queue,
+                                       NULL);
+    if (NT_SUCCESS(Status))
+    {
+        /* Remove as many entries as possible, in a single wait */
+        Removed = KeRemoveQueueEx(Queue,
+                                  PreviousMode,
+                                  Alertable,
+                                  Timeout,
+                                  EntryArray,
+                                  Count);
+
+        /* If we got a timeout, an alert or user_apc back, return the status */
+        WaitStatus = (NTSTATUS)(ULONG_PTR)EntryArray[0];
+        if ((WaitStatus == STATUS_TIMEOUT) ||
+            (WaitStatus == STATUS_USER_APC) ||
+            (WaitStatus == STATUS_ALERTED))
+        {
+            /* Set this as the status, nothing was removed */
+            Status = WaitStatus;
+            Removed = 0;
+        }
+
+        /* Unpack every packet, even if the caller's buffer went away */
+        for (i = 0; i < Removed; i++)
+        {
+            /* Get the packet data and free it */
+            IopUnpackCompletionPacket(EntryArray[i], &Information);
 
             /* Enter SEH to write back the values */
             _SEH2_TRY
             {
-                /* Write the values to caller */
-                *ApcContext = Apc;
-                *KeyContext = Key;
-                *IoStatusBlock = IoStatus;
+                IoCompletionInformation[i] = Information;
             }
             _SEH2_EXCEPT(ExSystemExceptionFilter())
             {
@@ -555,10 +772,25 @@ NtRemoveIoCompletion(IN HANDLE IoCompletionHandle,
             _SEH2_END;
         }
 
+        /* Return the number of entries */
+        _SEH2_TRY
+        {
+            *NumEntriesRemoved = Removed;
+        }
+        _SEH2_EXCEPT(ExSystemExceptionFilter())
+        {
+            /* Get the exception code */
+            Status = _SEH2_GetExceptionCode();
+        }
+        _SEH2_END;
+
         /* Dereference the Object */
         ObDereferenceObject(Queue);
     }
 
+    /* Free the array if we allocated one */
+    if (EntryArray != LocalEntries) ExFreePoolWithTag(EntryArray, IOC_TAG);
+
     /* Return status */
     return Status;
 }
@@ -599,3 +831,254 @@ NtSetIoCompletion(IN HANDLE IoCompletionPortHandle,
     /* Return status */
     return Status;
 }
+
+NTSTATUS
+NTAPI
+NtCreateWaitCompletionPacket(OUT PHANDLE WaitCompletionPacketHandle,
+                             IN ACCESS_MASK DesiredAccess,
+                             IN POBJECT_ATTRIBUTES ObjectAttributes OPTIONAL)
+{
+    PIOP_WAIT_COMPLETION_PACKET WaitPacket;
+    HANDLE hWaitPacketHandle;
+    KPROCESSOR_MODE PreviousMode = ExGetPreviousMode();
+    NTSTATUS Status;
+    PAGED_CODE();
+
+    /* Check if this was a user-mode call */
+    if (PreviousMode != KernelMode)
+    {
+        /* Wrap probing in SEH */
+        _SEH2_TRY
+        {
+            /* Probe the handle */
+            ProbeForWriteHandle(WaitCompletionPacketHandle);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            /* Return the exception code */
+            _SEH2_YIELD(return _SEH2_GetExceptionCode());
+        }
+        _SEH2_END;
+    }
+
+    /* Create the Object */
+    Status = ObCreateObject(PreviousMode,
+                            IoWaitCompletionPacketType,
+                            ObjectAttributes,
+                            PreviousMode,
+                            NULL,
+                            sizeof(IOP_WAIT_COMPLETION_PACKET),
+                            0,
+                            0,
+                            (PVOID*)&WaitPacket);
+    if (NT_SUCCESS(Status))
+    {
+        /* Initialize it, the completion packet is embedded */
+        RtlZeroMemory(WaitPacket, sizeof(IOP_WAIT_COMPLETION_PACKET));
+        KeInitializeGuardedMutex(&WaitPacket->Lock);
+        WaitPacket->Packet.PacketType = IopCompletionPacketWait;
+
+        /* Insert it */
+        Status = ObInsertObject(WaitPacket,
+                                NULL,
+                                DesiredAccess,
+                                0,
+                                NULL,
+                                &hWaitPacketHandle);
+        if (NT_SUCCESS(Status))
+        {
+            /* Protect writing the handle in SEH */
+            _SEH2_TRY
+            {
+                /* Write the handle back */
+                *WaitCompletionPacketHandle = hWaitPacketHandle;
+            }
+            _SEH2_EXCEPT(ExSystemExceptionFilter())
+            {
+                /* Get the exception code */
+                Status = _SEH2_GetExceptionCode();
+            }
+            _SEH2_END;
+        }
+    }
+
+    /* Return Status */
+    return Status;
+}
+
+/*
+ * Waits on the target object without a thread. Once it's signaled, the wait
+ * is satisfied and the given completion is queued to the port.
+ */
+NTSTATUS
+NTAPI
+NtAssociateWaitCompletionPacket(IN HANDLE WaitCompletionPacketHandle,
+                                IN HANDLE IoCompletionHandle,
+                                IN HANDLE TargetObjectHandle,
+                                IN PVOID KeyContext OPTIONAL,
+                                IN PVOID ApcContext OPTIONAL,
+                                IN NTSTATUS IoStatus,
+                                IN ULONG_PTR IoStatusInformation,
+                                OUT PBOOLEAN AlreadySignaled OPTIONAL)
+{
+    PIOP_WAIT_COMPLETION_PACKET WaitPacket;
+    PKQUEUE Queue;
+    PVOID Object, WaitableObject;
+    PDISPATCHER_HEADER Header;
+    KPROCESSOR_MODE PreviousMode = ExGetPreviousMode();
+    BOOLEAN Signaled = FALSE;
+    NTSTATUS Status;
+    PAGED_CODE();
+
+    /* Check if the call was from user mode */
+    if ((PreviousMode != KernelMode) && (AlreadySignaled))
+    {
+        /* Protect probes in SEH */
+        _SEH2_TRY
+        {
+            /* Probe the output */
+            ProbeForWriteBoolean(AlreadySignaled);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            /* Return the exception code */
+            _SEH2_YIELD(return _SEH2_GetExceptionCode());
+        }
+        _SEH2_END;
+    }
+
+    /* Get the packet */
+    Status = ObReferenceObjectByHandle(WaitCompletionPacketHandle,
+                                       WAIT_COMPLETION_PACKET_MODIFY_STATE,
+                                       IoWaitCompletionPacketType,
+                                       PreviousMode,
+                                       (PVOID*)&WaitPacket,
+                                       NULL);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* Get the port */
+    Status = ObReferenceObjectByHandle(IoCompletionHandle,
+                                       IO_COMPLETION_MODIFY_STATE,
+                                       IoCompletionType,
+                                       PreviousMode,
+                                       (PVOID*)&Queue,
+                                       NULL);
+    if (!NT_SUCCESS(Status))
+    {
+        ObDereferenceObject(WaitPacket);
+        return Status;
+    }
+
+    /* Get the object to wait on */
+    Status = ObReferenceObjectByHandle(TargetObjectHandle,
+                                       SYNCHRONIZE,
+                                       NULL,
+                                       PreviousMode,
+                                       &Object,
+                                       NULL);
+    if (!NT_SUCCESS(Status))
+    {
+        ObDereferenceObject(Queue);
+        ObDereferenceObject(WaitPacket);
+        return Status;
+    }
+
+    /* Get the Waitable Object, like NtWaitForSingleObject does */
+    WaitableObject = OBJECT_TO_OBJECT_HEADER(Object)->Type->DefaultObject;
+    if (IsPointerOffset(WaitableObject))
+    {
+        /* Turn it into a pointer */
+        WaitableObject = (PVOID)((ULONG_PTR)Object +
+                                 (ULONG_PTR)WaitableObject);
+    }
+
+    /* Threadless waits can't own mutants, nor wait on queues */
+    Header = WaitableObject;
+    if ((Header->Type == MutantObject) || (Header->Type == QueueObject))
+    {
+        ObDereferenceObject(Object);
+        ObDereferenceObject(Queue);
+        ObDereferenceObject(WaitPacket);
+        return STATUS_OBJECT_TYPE_MISMATCH;
+    }
+
+    KeAcquireGuardedMutex(&WaitPacket->Lock);
+
+    /* A packet can only be used for one wait at a time */
+    if (WaitPacket->Associated)
+    {
+        KeReleaseGuardedMutex(&WaitPacket->Lock);
+        ObDereferenceObject(Object);
+        ObDereferenceObject(Queue);
+        ObDereferenceObject(WaitPacket);
+        return STATUS_INVALID_PARAMETER_1;
+    }
+
+    /* Set up the completion, the references are kept until it's released */
+    WaitPacket->Associated = TRUE;
+    WaitPacket->IoCompletion = Queue;
+    WaitPacket->TargetObject = Object;
+    WaitPacket->Packet.KeyContext = KeyContext;
+    WaitPacket->Packet.ApcContext = ApcContext;
+    WaitPacket->Packet.IoStatus = IoStatus;
+    WaitPacket->Packet.IoStatusInformation = IoStatusInformation;
+
+    /* Start the wait */
+    Signaled = KeAssociateWaitNotification(&WaitPacket->Wait,
+                                           WaitableObject,
+                                           Queue,
+                                           &WaitPacket->Packet.ListEntry);
+
+    KeReleaseGuardedMutex(&WaitPacket->Lock);
+
+    if (AlreadySignaled)
+    {
+        /* Enter SEH to write back the value */
+        _SEH2_TRY
+        {
+            *AlreadySignaled = Signaled;
+        }
+        _SEH2_EXCEPT(ExSystemExceptionFilter())
+        {
+            /* The wait is set up anyway */
+            NOTHING;
+        }
+        _SEH2_END;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Returns STATUS_SUCCESS if the wait or its queued completion was cancelled,
+ * STATUS_PENDING if the completion was left in the port or already removed
+ * from it, and STATUS_CANCELLED if the packet wasn't associated.
+ */
+NTSTATUS
+NTAPI
+NtCancelWaitCompletionPacket(IN HANDLE WaitCompletionPacketHandle,
+                             IN BOOLEAN RemoveSignaledPacket)
+{
+    PIOP_WAIT_COMPLETION_PACKET WaitPacket;
+    NTSTATUS Status;
+    PAGED_CODE();
+
+    /* Get the packet */
+    Status = ObReferenceObjectByHandle(WaitCompletionPacketHandle,
+                                       WAIT_COMPLETION_PACKET_MODIFY_STATE,
+                                       IoWaitCompletionPacketType,
+                                       ExGetPreviousMode(),
+                                       (PVOID*)&WaitPacket,
+                                       NULL);
+    if (NT_SUCCESS(Status))
+    {
+        KeAcquireGuardedMutex(&WaitPacket->Lock);
+        Status = IopCancelWaitCompletionPacket(WaitPacket, RemoveSignaledPacket);
+        KeReleaseGuardedMutex(&WaitPacket->Lock);
+
+        ObDereferenceObject(WaitPacket);
+    }
+
+    /* Return status */
+    return Status;
+}
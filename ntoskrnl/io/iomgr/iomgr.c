@@ -307,6 +307,18 @@ IopCreateObjectTypes(VOID)
                                        NULL,
                                        &IoCompletionType))) return FALSE;
 
+    /* Initialize the Wait Completion Packet object type */
+    RtlInitUnicodeString(&Name, L"WaitCompletionPacket");
+    ObjectTypeInitializer.DefaultNonPagedPoolCharge = sizeof(IOP_WAIT_COMPLETION_PACKET);
+    ObjectTypeInitializer.ValidAccessMask = WAIT_COMPLETION_PACKET_ALL_ACCESS;
+    ObjectTypeInitializer.GenericMapping = IopWaitCompletionPacketMapping;
+    ObjectTypeInitializer.CloseProcedure = IopCloseWaitCompletionPacket;
+    ObjectTypeInitializer.DeleteProcedure = NULL;
+    if (!NT_SUCCESS(ObCreateObjectType(&Name,
+                                       &ObjectTypeInitializer,
+                                       NULL,
+                                       &IoWaitCompletionPacketType))) return FALSE;
+
     /* Initialize the File object type  */
     RtlInitUnicodeString(&Name, L"File");
     ObjectTypeInitializer.DefaultNonPagedPoolCharge = sizeof(FILE_OBJECT);
@@ -254,8 +254,8 @@ KeSetEventBoostPriority(IN PKEVENT Event,
                                   KWAIT_BLOCK,
                                   WaitListEntry);
 
-    /* Check if this is a WaitAll */
-    if (WaitBlock->WaitType == WaitAll)
+    /* Check if this is a WaitAll, or a threadless wait */
+    if (WaitBlock->WaitType != WaitAny)
     {
         /* Set the Event to Signaled */
         Event->Header.SignalState = 1;
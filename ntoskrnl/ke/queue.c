@@ -16,6 +16,35 @@
 
 /* PRIVATE FUNCTIONS *********************************************************/
 
+/*
+ * Unlinks an entry from the queue, called with the dispatcher lock held
+ */
+FORCEINLINE
+PLIST_ENTRY
+KiRemoveQueueEntry(IN PKQUEUE Queue,
+                   IN PLIST_ENTRY QueueEntry)
+{
+    /* Decrease the number of entries */
+    Queue->Header.SignalState--;
+
+    /* Check if the entry is valid. If not, bugcheck */
+    if (!(QueueEntry->Flink) || !(QueueEntry->Blink))
+    {
+        /* Invalid item */
+        KeBugCheckEx(INVALID_WORK_QUEUE_ITEM,
+                     (ULONG_PTR)QueueEntry,
+                     (ULONG_PTR)Queue,
+                     (ULONG_PTR)NULL,
+                     (ULONG_PTR)((PWORK_QUEUE_ITEM)QueueEntry)->
+                                 WorkerRoutine);
+    }
+
+    /* Remove the Entry */
+    RemoveEntryList(QueueEntry);
+    QueueEntry->Flink = NULL;
+    return QueueEntry;
+}
+
 /*
  * Called when a thread which has a queue entry is entering a wait state
  */
@@ -240,6 +269,30 @@ KeRemoveQueue(IN PKQUEUE Queue,
               IN PLARGE_INTEGER Timeout OPTIONAL)
 {
     PLIST_ENTRY QueueEntry;
+
+    /* Remove a single entry, the status is returned in its place on failure */
+    KeRemoveQueueEx(Queue, WaitMode, FALSE, Timeout, &QueueEntry, 1);
+    return QueueEntry;
+}
+
+/*
+ * @implemented
+ *
+ * Removes up to Count entries from the queue. The calling thread only
+ * counts once against the concurrency limit of the queue, no matter how
+ * many entries it gets. If the wait fails, the wait status is returned
+ * in place of the first entry, and the return value is 1.
+ */
+ULONG
+NTAPI
+KeRemoveQueueEx(IN PKQUEUE Queue,
+                IN KPROCESSOR_MODE WaitMode,
+                IN BOOLEAN Alertable,
+                IN PLARGE_INTEGER Timeout OPTIONAL,
+                OUT PLIST_ENTRY *EntryArray,
+                IN ULONG Count)
+{
+    PLIST_ENTRY QueueEntry;
     LONG_PTR Status;
     PKTHREAD Thread = KeGetCurrentThread();
     PKQUEUE PreviousQueue;
@@ -249,9 +302,10 @@ KeRemoveQueue(IN PKQUEUE Queue,
     BOOLEAN Swappable;
     PLARGE_INTEGER OriginalDueTime = Timeout;
     LARGE_INTEGER DueTime = {{0}}, NewDueTime, InterruptTime;
-    ULONG Hand = 0;
+    ULONG Hand = 0, Removed = 0;
     ASSERT_QUEUE(Queue);
     ASSERT_IRQL_LESS_OR_EQUAL(DISPATCH_LEVEL);
+    ASSERT(Count != 0);
 
     /* Check if the Lock is already held */
     if (Thread->WaitNext)
@@ -267,6 +321,7 @@ KeRemoveQueue(IN PKQUEUE Queue,
         KxQueueThreadWait();
         KiAcquireDispatcherLockAtSynchLevel();
     }
+    Thread->Alertable = Alertable;
 
     /*
      * This is needed so that we can set the new queue right here,
@@ -306,27 +361,15 @@ KeRemoveQueue(IN PKQUEUE Queue,
         if ((Queue->CurrentCount < Queue->MaximumCount) &&
             (QueueEntry != &Queue->EntryListHead))
         {
-            /* Decrease the number of entries */
-            Queue->Header.SignalState--;
-
             /* Increase numbef of running threads */
             Queue->CurrentCount++;
 
-            /* Check if the entry is valid. If not, bugcheck */
-            if (!(QueueEntry->Flink) || !(QueueEntry->Blink))
+            /* Take as many entries as the caller wants, in a single pass */
+            do
             {
-                /* Invalid item */
-                KeBugCheckEx(INVALID_WORK_QUEUE_ITEM,
-                             (ULONG_PTR)QueueEntry,
-                             (ULONG_PTR)Queue,
-                             (ULONG_PTR)NULL,
-                             (ULONG_PTR)((PWORK_QUEUE_ITEM)QueueEntry)->
-                                         WorkerRoutine);
-            }
-
-            /* Remove the Entry */
-            RemoveEntryList(QueueEntry);
-            QueueEntry->Flink = NULL;
+                EntryArray[Removed++] = KiRemoveQueueEntry(Queue, QueueEntry);
+                QueueEntry = Queue->EntryListHead.Flink;
+            } while ((Removed < Count) && (QueueEntry != &Queue->EntryListHead));
 
             /* Nothing to wait on */
             break;
@@ -344,12 +387,12 @@ KeRemoveQueue(IN PKQUEUE Queue,
             }
             else
             {
-                /* Fail if there's a User APC Pending */
-                if ((WaitMode != KernelMode) &&
-                    (Thread->ApcState.UserApcPending))
+                /* Fail if the thread is alerted or has a User APC Pending */
+                Status = KiCheckAlertability(Thread, Alertable, WaitMode);
+                if (Status != STATUS_WAIT_0)
                 {
                     /* Return the status and increase the pending threads */
-                    QueueEntry = (PLIST_ENTRY)STATUS_USER_APC;
+                    EntryArray[Removed++] = (PLIST_ENTRY)Status;
                     Queue->CurrentCount++;
                     break;
                 }
@@ -362,7 +405,7 @@ KeRemoveQueue(IN PKQUEUE Queue,
                     if ((ULONG64)InterruptTime.QuadPart >= Timer->DueTime.QuadPart)
                     {
                         /* It did, so we don't need to wait */
-                        QueueEntry = (PLIST_ENTRY)STATUS_TIMEOUT;
+                        EntryArray[Removed++] = (PLIST_ENTRY)STATUS_TIMEOUT;
                         Queue->CurrentCount++;
                         break;
                     }
@@ -404,7 +447,36 @@ KeRemoveQueue(IN PKQUEUE Queue,
                 Thread->WaitReason = 0;
 
                 /* Check if we were executing an APC */
-                if (Status != STATUS_KERNEL_APC) return (PLIST_ENTRY)Status;
+                if (Status != STATUS_KERNEL_APC)
+                {
+                    /* We got either an entry or the wait status */
+                    EntryArray[Removed++] = (PLIST_ENTRY)Status;
+
+                    /* Check if we were woken up with an entry and want more */
+                    if ((Removed < Count) &&
+                        (Status != STATUS_TIMEOUT) &&
+                        (Status != STATUS_USER_APC) &&
+                        (Status != STATUS_ALERTED))
+                    {
+                        /* Pick up whatever else got queued meanwhile */
+                        Thread->WaitIrql = KeRaiseIrqlToSynchLevel();
+                        KiAcquireDispatcherLockAtSynchLevel();
+
+                        QueueEntry = Queue->EntryListHead.Flink;
+                        while ((Removed < Count) &&
+                               (QueueEntry != &Queue->EntryListHead))
+                        {
+                            EntryArray[Removed++] = KiRemoveQueueEntry(Queue,
+                                                                       QueueEntry);
+                            QueueEntry = Queue->EntryListHead.Flink;
+                        }
+
+                        KiReleaseDispatcherLockFromSynchLevel();
+                        KiExitDispatcher(Thread->WaitIrql);
+                    }
+
+                    return Removed;
+                }
 
                 /* Check if we had a timeout */
                 if (Timeout)
@@ -419,6 +491,7 @@ KeRemoveQueue(IN PKQUEUE Queue,
             /* Start another wait */
             Thread->WaitIrql = KeRaiseIrqlToSynchLevel();
             KxQueueThreadWait();
+            Thread->Alertable = Alertable;
             KiAcquireDispatcherLockAtSynchLevel();
             Queue->CurrentCount--;
         }
@@ -427,7 +500,38 @@ KeRemoveQueue(IN PKQUEUE Queue,
     /* Unlock Database and return */
     KiReleaseDispatcherLockFromSynchLevel();
     KiExitDispatcher(Thread->WaitIrql);
-    return QueueEntry;
+    return Removed;
+}
+
+/*
+ * @implemented
+ *
+ * Removes a specific entry from the queue. Returns FALSE if the entry is
+ * not queued anymore, because a thread removed it already.
+ */
+BOOLEAN
+NTAPI
+KeCancelQueueEntry(IN PKQUEUE Queue,
+                   IN PLIST_ENTRY Entry)
+{
+    BOOLEAN Removed = FALSE;
+    KIRQL OldIrql;
+    ASSERT_QUEUE(Queue);
+    ASSERT_IRQL_LESS_OR_EQUAL(DISPATCH_LEVEL);
+
+    /* Lock the Dispatcher Database */
+    OldIrql = KiAcquireDispatcherLock();
+
+    /* Entries handed out by the queue get their link cleared */
+    if (Entry->Flink)
+    {
+        KiRemoveQueueEntry(Queue, Entry);
+        Removed = TRUE;
+    }
+
+    /* Release the lock */
+    KiReleaseDispatcherLock(OldIrql);
+    return Removed;
 }
 
 /*
@@ -33,6 +33,16 @@ KiWaitTest(IN PVOID ObjectPointer,
     {
         /* Get the current wait block */
         WaitBlock = CONTAINING_RECORD(WaitEntry, KWAIT_BLOCK, WaitListEntry);
+
+        /* Threadless waits are satisfied and queue their entry */
+        if (WaitBlock->WaitType == WaitNotification)
+        {
+            KiSatisfyNonMutantWait(FirstObject);
+            KiSignalNotificationWait(WaitBlock);
+            WaitEntry = WaitList->Flink;
+            continue;
+        }
+
         WaitThread = WaitBlock->Thread;
         WaitStatus = STATUS_KERNEL_APC;
 
@@ -275,6 +285,94 @@ KeIsWaitListEmpty(IN PVOID Object)
     return FALSE;
 }
 
+/*
+ * @implemented
+ *
+ * Starts a threadless wait on a dispatcher object. When the object gets
+ * signaled, the wait is satisfied like a WaitAny and QueueEntry is inserted
+ * into the queue. Returns TRUE if the object was already signaled, in which
+ * case the entry was queued right away. Mutants and queues can't be used.
+ */
+BOOLEAN
+NTAPI
+KeAssociateWaitNotification(IN PKWAIT_NOTIFICATION Notification,
+                            IN PVOID Object,
+                            IN PKQUEUE Queue,
+                            IN PLIST_ENTRY QueueEntry)
+{
+    PKWAIT_BLOCK WaitBlock = &Notification->WaitBlock;
+    PKMUTANT CurrentObject = Object;
+    BOOLEAN Signaled;
+    KIRQL OldIrql;
+    ASSERT_QUEUE(Queue);
+    ASSERT(CurrentObject->Header.Type != MutantObject);
+    ASSERT(CurrentObject->Header.Type != QueueObject);
+    ASSERT_IRQL_LESS_OR_EQUAL(DISPATCH_LEVEL);
+
+    /* Set up the wait block, there is no thread behind it */
+    WaitBlock->Object = Object;
+    WaitBlock->Thread = NULL;
+    WaitBlock->NextWaitBlock = WaitBlock;
+    WaitBlock->WaitKey = 0;
+    WaitBlock->WaitType = WaitNotification;
+    Notification->Queue = Queue;
+    Notification->QueueEntry = QueueEntry;
+
+    /* Lock the Dispatcher Database */
+    OldIrql = KiAcquireDispatcherLock();
+
+    Signaled = (CurrentObject->Header.SignalState > 0);
+    if (Signaled)
+    {
+        /* Satisfy it now and queue the entry */
+        KiSatisfyNonMutantWait(CurrentObject);
+        WaitBlock->WaitListEntry.Flink = NULL;
+        QueueEntry->Flink = NULL;
+        KiInsertQueue(Queue, QueueEntry, FALSE);
+    }
+    else
+    {
+        /* Link it to the object until it's signaled */
+        InsertTailList(&CurrentObject->Header.WaitListHead,
+                       &WaitBlock->WaitListEntry);
+    }
+
+    /* Release the lock, this may switch to a thread that got the entry */
+    KiReleaseDispatcherLock(OldIrql);
+    return Signaled;
+}
+
+/*
+ * @implemented
+ *
+ * Cancels a threadless wait. Returns TRUE if it was still waiting, FALSE if
+ * its entry has been queued already.
+ */
+BOOLEAN
+NTAPI
+KeCancelWaitNotification(IN PKWAIT_NOTIFICATION Notification)
+{
+    PKWAIT_BLOCK WaitBlock = &Notification->WaitBlock;
+    BOOLEAN Cancelled = FALSE;
+    KIRQL OldIrql;
+    ASSERT_IRQL_LESS_OR_EQUAL(DISPATCH_LEVEL);
+
+    /* Lock the Dispatcher Database */
+    OldIrql = KiAcquireDispatcherLock();
+
+    /* Satisfied waits are unlinked from their object */
+    if (WaitBlock->WaitListEntry.Flink)
+    {
+        RemoveEntryList(&WaitBlock->WaitListEntry);
+        WaitBlock->WaitListEntry.Flink = NULL;
+        Cancelled = TRUE;
+    }
+
+    /* Release the lock */
+    KiReleaseDispatcherLock(OldIrql);
+    return Cancelled;
+}
+
 /*
  * @implemented
  */
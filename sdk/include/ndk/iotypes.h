@@ -35,6 +35,13 @@ Author:
                                                  SYNCHRONIZE | \
                                                  0x3)
 
+//
+// Wait Completion Packet Access Rights
+//
+#define WAIT_COMPLETION_PACKET_MODIFY_STATE     0x0001
+#define WAIT_COMPLETION_PACKET_ALL_ACCESS       (STANDARD_RIGHTS_REQUIRED | \
+                                                 0x1)
+
 //
 // Kernel Exported Object Types
 //
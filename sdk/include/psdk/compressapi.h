@@ -0,0 +1,76 @@
+/*
+ * Compression API (cabinet.dll, Windows 8)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef _COMPRESSAPI_
+#define _COMPRESSAPI_
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* defined(__cplusplus) */
+
+#define COMPRESS_ALGORITHM_INVALID      0
+#define COMPRESS_ALGORITHM_NULL         1
+#define COMPRESS_ALGORITHM_MSZIP        2
+#define COMPRESS_ALGORITHM_XPRESS       3
+#define COMPRESS_ALGORITHM_XPRESS_HUFF  4
+#define COMPRESS_ALGORITHM_LZMS         5
+#define COMPRESS_ALGORITHM_MAX          6
+
+#define COMPRESS_RAW                    (1 << 29)
+
+DECLARE_HANDLE(COMPRESSOR_HANDLE);
+typedef COMPRESSOR_HANDLE *PCOMPRESSOR_HANDLE;
+typedef COMPRESSOR_HANDLE DECOMPRESSOR_HANDLE;
+typedef COMPRESSOR_HANDLE *PDECOMPRESSOR_HANDLE;
+
+typedef PVOID (__cdecl *PFN_COMPRESS_ALLOCATE)(PVOID UserContext, SIZE_T Size);
+typedef VOID (__cdecl *PFN_COMPRESS_FREE)(PVOID UserContext, PVOID Memory);
+
+typedef struct _COMPRESS_ALLOCATION_ROUTINES
+{
+    PFN_COMPRESS_ALLOCATE Allocate;
+    PFN_COMPRESS_FREE Free;
+    PVOID UserContext;
+} COMPRESS_ALLOCATION_ROUTINES, *PCOMPRESS_ALLOCATION_ROUTINES;
+
+typedef enum
+{
+    COMPRESS_INFORMATION_CLASS_INVALID = 0,
+    COMPRESS_INFORMATION_CLASS_BLOCK_SIZE,
+    COMPRESS_INFORMATION_CLASS_LEVEL
+} COMPRESS_INFORMATION_CLASS;
+
+BOOL WINAPI CreateCompressor(DWORD,PCOMPRESS_ALLOCATION_ROUTINES,PCOMPRESSOR_HANDLE);
+BOOL WINAPI SetCompressorInformation(COMPRESSOR_HANDLE,COMPRESS_INFORMATION_CLASS,LPCVOID,SIZE_T);
+BOOL WINAPI QueryCompressorInformation(COMPRESSOR_HANDLE,COMPRESS_INFORMATION_CLASS,PVOID,SIZE_T);
+BOOL WINAPI Compress(COMPRESSOR_HANDLE,LPCVOID,SIZE_T,PVOID,SIZE_T,PSIZE_T);
+BOOL WINAPI ResetCompressor(COMPRESSOR_HANDLE);
+BOOL WINAPI CloseCompressor(COMPRESSOR_HANDLE);
+
+BOOL WINAPI CreateDecompressor(DWORD,PCOMPRESS_ALLOCATION_ROUTINES,PDECOMPRESSOR_HANDLE);
+BOOL WINAPI SetDecompressorInformation(DECOMPRESSOR_HANDLE,COMPRESS_INFORMATION_CLASS,LPCVOID,SIZE_T);
+BOOL WINAPI QueryDecompressorInformation(DECOMPRESSOR_HANDLE,COMPRESS_INFORMATION_CLASS,PVOID,SIZE_T);
+BOOL WINAPI Decompress(DECOMPRESSOR_HANDLE,LPCVOID,SIZE_T,PVOID,SIZE_T,PSIZE_T);
+BOOL WINAPI ResetDecompressor(DECOMPRESSOR_HANDLE);
+BOOL WINAPI CloseDecompressor(DECOMPRESSOR_HANDLE);
+
+#ifdef __cplusplus
+}
+#endif /* defined(__cplusplus) */
+
+#endif /* _COMPRESSAPI_ */
@@ -135,6 +135,15 @@ typedef struct _SecPkgContext_ConnectionInfo
     DWORD dwExchStrength;
 } SecPkgContext_ConnectionInfo, *PSecPkgContext_ConnectionInfo;
 
+#define SSL_SESSION_RECONNECT 1
+
+typedef struct _SecPkgContext_SessionInfo
+{
+    DWORD dwFlags;
+    DWORD cbSessionId;
+    BYTE rgbSessionId[32];
+} SecPkgContext_SessionInfo, *PSecPkgContext_SessionInfo;
+
 #ifdef __cplusplus
 }
 #endif
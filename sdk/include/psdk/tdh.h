@@ -0,0 +1,218 @@
+/*
+ * tdh.h
+ *
+ * This file is part of the ReactOS PSDK package.
+ *
+ * THIS SOFTWARE IS NOT COPYRIGHTED
+ *
+ * This source code is offered for use in the public domain. You may
+ * use, modify or distribute it freely.
+ *
+ * This code is distributed in the hope that it will be useful but
+ * WITHOUT ANY WARRANTY. ALL WARRANTIES, EXPRESS OR IMPLIED ARE HEREBY
+ * DISCLAIMED. This includes but is not limited to warranties of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+#pragma once
+
+#define __TDH_H__
+
+#include <evntcons.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef TDHAPI
+#define TDHAPI ULONG __stdcall
+#endif
+
+typedef enum _TDH_IN_TYPE {
+  TDH_INTYPE_NULL,
+  TDH_INTYPE_UNICODESTRING,
+  TDH_INTYPE_ANSISTRING,
+  TDH_INTYPE_INT8,
+  TDH_INTYPE_UINT8,
+  TDH_INTYPE_INT16,
+  TDH_INTYPE_UINT16,
+  TDH_INTYPE_INT32,
+  TDH_INTYPE_UINT32,
+  TDH_INTYPE_INT64,
+  TDH_INTYPE_UINT64,
+  TDH_INTYPE_FLOAT,
+  TDH_INTYPE_DOUBLE,
+  TDH_INTYPE_BOOLEAN,
+  TDH_INTYPE_BINARY,
+  TDH_INTYPE_GUID,
+  TDH_INTYPE_POINTER,
+  TDH_INTYPE_FILETIME,
+  TDH_INTYPE_SYSTEMTIME,
+  TDH_INTYPE_SID,
+  TDH_INTYPE_HEXINT32,
+  TDH_INTYPE_HEXINT64
+} TDH_IN_TYPE;
+
+typedef enum _TDH_OUT_TYPE {
+  TDH_OUTTYPE_NULL,
+  TDH_OUTTYPE_STRING,
+  TDH_OUTTYPE_DATETIME,
+  TDH_OUTTYPE_BYTE,
+  TDH_OUTTYPE_UNSIGNEDBYTE,
+  TDH_OUTTYPE_SHORT,
+  TDH_OUTTYPE_UNSIGNEDSHORT,
+  TDH_OUTTYPE_INT,
+  TDH_OUTTYPE_UNSIGNEDINT,
+  TDH_OUTTYPE_LONG,
+  TDH_OUTTYPE_UNSIGNEDLONG,
+  TDH_OUTTYPE_FLOAT,
+  TDH_OUTTYPE_DOUBLE,
+  TDH_OUTTYPE_BOOLEAN,
+  TDH_OUTTYPE_GUID,
+  TDH_OUTTYPE_HEXBINARY,
+  TDH_OUTTYPE_HEXINT8,
+  TDH_OUTTYPE_HEXINT16,
+  TDH_OUTTYPE_HEXINT32,
+  TDH_OUTTYPE_HEXINT64,
+  TDH_OUTTYPE_PID,
+  TDH_OUTTYPE_TID,
+  TDH_OUTTYPE_PORT,
+  TDH_OUTTYPE_IPV4,
+  TDH_OUTTYPE_IPV6,
+  TDH_OUTTYPE_SOCKETADDRESS,
+  TDH_OUTTYPE_CIMDATETIME,
+  TDH_OUTTYPE_ETWTIME,
+  TDH_OUTTYPE_XML,
+  TDH_OUTTYPE_ERRORCODE,
+  TDH_OUTTYPE_WIN32ERROR,
+  TDH_OUTTYPE_NTSTATUS,
+  TDH_OUTTYPE_HRESULT,
+  TDH_OUTTYPE_CULTURE_INSENSITIVE_DATETIME,
+  TDH_OUTTYPE_REDUCEDSTRING = 300,
+  TDH_OUTTYPE_NOPRINT
+} TDH_OUT_TYPE;
+
+typedef enum _DECODING_SOURCE {
+  DecodingSourceXMLFile,
+  DecodingSourceWbem,
+  DecodingSourceWPP,
+  DecodingSourceTlg,
+  DecodingSourceMax
+} DECODING_SOURCE;
+
+typedef enum _TEMPLATE_FLAGS {
+  TEMPLATE_EVENT_DATA = 1,
+  TEMPLATE_USER_DATA = 2
+} TEMPLATE_FLAGS;
+
+typedef enum _PROPERTY_FLAGS {
+  PropertyStruct = 0x1,
+  PropertyParamLength = 0x2,
+  PropertyParamCount = 0x4,
+  PropertyWBEMXmlFragment = 0x8,
+  PropertyParamFixedLength = 0x10
+} PROPERTY_FLAGS;
+
+typedef struct _EVENT_PROPERTY_INFO {
+  PROPERTY_FLAGS Flags;
+  ULONG NameOffset;
+  _ANONYMOUS_UNION union {
+    struct _nonStructType {
+      USHORT InType;
+      USHORT OutType;
+      ULONG MapNameOffset;
+    } nonStructType;
+    struct _structType {
+      USHORT StructStartIndex;
+      USHORT NumOfStructMembers;
+      ULONG padding;
+    } structType;
+  } DUMMYUNIONNAME;
+  _ANONYMOUS_UNION union {
+    USHORT count;
+    USHORT countPropertyIndex;
+  } DUMMYUNIONNAME2;
+  _ANONYMOUS_UNION union {
+    USHORT length;
+    USHORT lengthPropertyIndex;
+  } DUMMYUNIONNAME3;
+  ULONG Reserved;
+} EVENT_PROPERTY_INFO, *PEVENT_PROPERTY_INFO;
+
+typedef struct _TRACE_EVENT_INFO {
+  GUID ProviderGuid;
+  GUID EventGuid;
+  EVENT_DESCRIPTOR EventDescriptor;
+  DECODING_SOURCE DecodingSource;
+  ULONG ProviderNameOffset;
+  ULONG LevelNameOffset;
+  ULONG ChannelNameOffset;
+  ULONG KeywordsNameOffset;
+  ULONG TaskNameOffset;
+  ULONG OpcodeNameOffset;
+  ULONG EventMessageOffset;
+  ULONG ProviderMessageOffset;
+  ULONG BinaryXMLOffset;
+  ULONG BinaryXMLSize;
+  ULONG ActivityIDNameOffset;
+  ULONG RelatedActivityIDNameOffset;
+  ULONG PropertyCount;
+  ULONG TopLevelPropertyCount;
+  TEMPLATE_FLAGS Flags;
+  EVENT_PROPERTY_INFO EventPropertyInfoArray[ANYSIZE_ARRAY];
+} TRACE_EVENT_INFO, *PTRACE_EVENT_INFO;
+
+typedef struct _PROPERTY_DATA_DESCRIPTOR {
+  ULONGLONG PropertyName;
+  ULONG ArrayIndex;
+  ULONG Reserved;
+} PROPERTY_DATA_DESCRIPTOR, *PPROPERTY_DATA_DESCRIPTOR;
+
+typedef enum _TDH_CONTEXT_TYPE {
+  TDH_CONTEXT_WPP_TMFFILE,
+  TDH_CONTEXT_WPP_TMFSEARCHPATH,
+  TDH_CONTEXT_WPP_GMT,
+  TDH_CONTEXT_POINTERSIZE,
+  TDH_CONTEXT_MAXIMUM
+} TDH_CONTEXT_TYPE;
+
+typedef struct _TDH_CONTEXT {
+  ULONGLONG ParameterValue;
+  TDH_CONTEXT_TYPE ParameterType;
+  ULONG ParameterSize;
+} TDH_CONTEXT, *PTDH_CONTEXT;
+
+TDHAPI
+TdhGetEventInformation(
+  _In_ PEVENT_RECORD Event,
+  _In_ ULONG TdhContextCount,
+  _In_reads_opt_(TdhContextCount) PTDH_CONTEXT TdhContext,
+  _Out_writes_bytes_opt_(*BufferSize) PTRACE_EVENT_INFO Buffer,
+  _Inout_ PULONG BufferSize);
+
+TDHAPI
+TdhGetPropertySize(
+  _In_ PEVENT_RECORD pEvent,
+  _In_ ULONG TdhContextCount,
+  _In_reads_opt_(TdhContextCount) PTDH_CONTEXT pTdhContext,
+  _In_ ULONG PropertyDataCount,
+  _In_reads_(PropertyDataCount) PPROPERTY_DATA_DESCRIPTOR pPropertyData,
+  _Out_ ULONG *pPropertySize);
+
+TDHAPI
+TdhGetProperty(
+  _In_ PEVENT_RECORD pEvent,
+  _In_ ULONG TdhContextCount,
+  _In_reads_opt_(TdhContextCount) PTDH_CONTEXT pTdhContext,
+  _In_ ULONG PropertyDataCount,
+  _In_reads_(PropertyDataCount) PPROPERTY_DATA_DESCRIPTOR pPropertyData,
+  _In_ ULONG BufferSize,
+  _Out_writes_bytes_(BufferSize) PBYTE pBuffer);
+
+#define TEI_PROVIDER_NAME(info) ((PWSTR)((info)->ProviderNameOffset ? (PBYTE)(info) + (info)->ProviderNameOffset : NULL))
+#define TEI_EVENT_MESSAGE(info) ((PWSTR)((info)->EventMessageOffset ? (PBYTE)(info) + (info)->EventMessageOffset : NULL))
+
+#ifdef __cplusplus
+}
+#endif
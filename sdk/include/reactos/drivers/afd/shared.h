@@ -59,6 +59,22 @@ typedef struct _AFD_POLL_INFO {
     AFD_HANDLE			        Handles[1];
 } AFD_POLL_INFO, *PAFD_POLL_INFO;
 
+/* Poll groups are opened as AFD handles without a transport */
+typedef struct _AFD_POLL_GROUP_INFO {
+    SOCKET				Handle;
+    ULONG				Events;
+    ULONG_PTR				Context;
+} AFD_POLL_GROUP_INFO, *PAFD_POLL_GROUP_INFO;
+
+typedef struct _AFD_POLL_GROUP_EVENT {
+    ULONG_PTR				Context;
+    ULONG				Events;
+} AFD_POLL_GROUP_EVENT, *PAFD_POLL_GROUP_EVENT;
+
+typedef struct _AFD_POLL_GROUP_WAIT_INFO {
+    ULONG				AfdFlags;
+} AFD_POLL_GROUP_WAIT_INFO, *PAFD_POLL_GROUP_WAIT_INFO;
+
 typedef struct _AFD_ACCEPT_DATA {
     ULONG				UseSAN;
     ULONG				SequenceNumber;
@@ -261,6 +277,9 @@ typedef struct _AFD_TDI_HANDLE_DATA
 #define AFD_DEFER_ACCEPT		35
 #define AFD_GET_PENDING_CONNECT_DATA	41
 #define AFD_VALIDATE_GROUP		42
+#define AFD_POLL_GROUP_ADD		50
+#define AFD_POLL_GROUP_REMOVE		51
+#define AFD_POLL_GROUP_WAIT		52
 
 /* AFD IOCTLs */
 
@@ -336,6 +355,12 @@ typedef struct _AFD_TDI_HANDLE_DATA
   _AFD_CONTROL_CODE(AFD_ENUM_NETWORK_EVENTS, METHOD_NEITHER)
 #define IOCTL_AFD_VALIDATE_GROUP \
   _AFD_CONTROL_CODE(AFD_VALIDATE_GROUP, METHOD_NEITHER)
+#define IOCTL_AFD_POLL_GROUP_ADD \
+  _AFD_CONTROL_CODE(AFD_POLL_GROUP_ADD, METHOD_BUFFERED)
+#define IOCTL_AFD_POLL_GROUP_REMOVE \
+  _AFD_CONTROL_CODE(AFD_POLL_GROUP_REMOVE, METHOD_BUFFERED)
+#define IOCTL_AFD_POLL_GROUP_WAIT \
+  _AFD_CONTROL_CODE(AFD_POLL_GROUP_WAIT, METHOD_BUFFERED)
 
 typedef struct _AFD_SOCKET_INFORMATION {
     BOOL CommandChannel;
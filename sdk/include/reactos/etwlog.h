@@ -0,0 +1,99 @@
+#pragma once
+
+/*
+ * Layout of the buffers written to .etl files by the user-mode loggers in
+ * ntext and read back by the consumers in sechost. Buffers, header records
+ * and event records follow the NT WMI_BUFFER_HEADER/SYSTEM_TRACE_HEADER/
+ * EVENT_HEADER layout, so that other .etl readers can walk the files.
+ */
+
+#define ETW_RECORD_ALIGNMENT            8
+#define ETW_ALIGN_RECORD(Size)          (((Size) + ETW_RECORD_ALIGNMENT - 1) & ~(ETW_RECORD_ALIGNMENT - 1))
+
+/* WMI_BUFFER_HEADER.BufferType */
+#define ETW_BUFFER_TYPE_GENERIC         0
+#define ETW_BUFFER_TYPE_HEADER          4
+
+/* WMI_BUFFER_HEADER.BufferFlag */
+#define ETW_BUFFER_FLAG_NORMAL          0x0000
+#define ETW_BUFFER_FLAG_EVENTS_LOST     0x0002
+
+/* WMI_BUFFER_HEADER.State, in memory only */
+#define ETW_BUFFER_STATE_FREE           0
+#define ETW_BUFFER_STATE_CLOSED         1
+
+/* HeaderType of the records found in the buffers */
+#define TRACE_HEADER_TYPE_SYSTEM32      1
+#define TRACE_HEADER_TYPE_SYSTEM64      2
+#define TRACE_HEADER_TYPE_EVENT_HEADER32 18
+#define TRACE_HEADER_TYPE_EVENT_HEADER64 19
+
+#define TRACE_HEADER_MARKER_FLAGS       0xC0
+#define TRACE_HEADER_VERSION            2
+
+#ifdef _WIN64
+#define TRACE_HEADER_TYPE_SYSTEM        TRACE_HEADER_TYPE_SYSTEM64
+#define TRACE_HEADER_TYPE_EVENT_HEADER  TRACE_HEADER_TYPE_EVENT_HEADER64
+#else
+#define TRACE_HEADER_TYPE_SYSTEM        TRACE_HEADER_TYPE_SYSTEM32
+#define TRACE_HEADER_TYPE_EVENT_HEADER  TRACE_HEADER_TYPE_EVENT_HEADER32
+#endif
+
+/* EVENT_HEADER.HeaderType as stored in the buffers */
+#define ETW_EVENT_HEADER_MARKER(Type)   ((USHORT)((TRACE_HEADER_MARKER_FLAGS << 8) | (Type)))
+
+/* TRACE_LOGFILE_HEADER.VersionDetail.SubVersion/SubMinorVersion */
+#define ETW_LOGFILE_SUBVERSION          1
+#define ETW_LOGFILE_SUBMINORVERSION     8
+
+typedef struct _WMI_BUFFER_HEADER
+{
+    ULONG BufferSize;
+    ULONG SavedOffset;
+    volatile LONG CurrentOffset;
+    volatile LONG ReferenceCount;
+    LARGE_INTEGER TimeStamp;
+    LONGLONG SequenceNumber;
+    ULONG64 ClockType;
+    ETW_BUFFER_CONTEXT ClientContext;
+    volatile LONG State;
+    ULONG Offset;
+    USHORT BufferFlag;
+    USHORT BufferType;
+    ULONG64 Padding1[2];
+} WMI_BUFFER_HEADER, *PWMI_BUFFER_HEADER;
+
+C_ASSERT(sizeof(WMI_BUFFER_HEADER) == 72);
+
+typedef struct _SYSTEM_TRACE_HEADER
+{
+    USHORT Version;
+    UCHAR HeaderType;
+    UCHAR Flags;
+    USHORT Size;
+    USHORT HookId;
+    ULONG ThreadId;
+    ULONG ProcessId;
+    LARGE_INTEGER SystemTime;
+    ULONG KernelTime;
+    ULONG UserTime;
+} SYSTEM_TRACE_HEADER, *PSYSTEM_TRACE_HEADER;
+
+C_ASSERT(sizeof(SYSTEM_TRACE_HEADER) == 32);
+
+/* Extended data items follow the EVENT_HEADER, each padded to 8 bytes */
+typedef struct _ETW_EXTENDED_ITEM_HEADER
+{
+    USHORT Reserved1;
+    USHORT ExtType;
+    USHORT Linkage;
+    USHORT DataSize;
+} ETW_EXTENDED_ITEM_HEADER, *PETW_EXTENDED_ITEM_HEADER;
+
+/* Raw clock and system time at the start of the session, used to convert
+ * performance counter time stamps */
+typedef struct _ETW_REF_CLOCK
+{
+    LARGE_INTEGER StartTime;
+    LARGE_INTEGER StartPerfClock;
+} ETW_REF_CLOCK, *PETW_REF_CLOCK;
@@ -364,7 +364,8 @@ typedef enum _TIMER_TYPE {
 
 typedef enum _WAIT_TYPE {
   WaitAll,
-  WaitAny
+  WaitAny,
+  WaitNotification
 } WAIT_TYPE;
 
 #ifndef MIDL_PASS
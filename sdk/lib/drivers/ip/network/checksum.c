@@ -11,6 +11,10 @@
 
 #include "precomp.h"
 
+#if defined(_M_AMD64)
+#include <emmintrin.h>
+#endif
+
 
 ULONG ChecksumFold(
   ULONG Sum)
@@ -24,6 +28,16 @@ ULONG ChecksumFold(
   return Sum;
 }
 
+static ULONG ChecksumFold64(
+  ULONGLONG Sum)
+{
+  /* Fold 64-bit sum to 32 bits, keeping the end-around carries */
+  Sum = (Sum & 0xFFFFFFFF) + (Sum >> 32);
+  Sum = (Sum & 0xFFFFFFFF) + (Sum >> 32);
+
+  return (ULONG)Sum;
+}
+
 ULONG ChecksumCompute(
   PVOID Data,
   UINT Count,
@@ -36,24 +50,124 @@ ULONG ChecksumCompute(
  *     Seed  = Previously calculated checksum (if any)
  * RETURNS:
  *     Checksum of buffer
+ * NOTES:
+ *     The buffer is summed 32 bits at a time into a 64-bit accumulator
+ *     (16 bytes at a time with SSE2 on amd64), so carries only need to be
+ *     folded back in once at the end. The result is in memory order, like
+ *     the seed, and is not folded to 16 bits
  */
 {
-  register ULONG Sum = Seed;
+#if defined(_M_IX86)
+  /* Unrolled 32-bit add with carry, see i386/checksum.S */
+  return csum_partial(Data, Count, Seed);
+#else
+  PUCHAR Buffer = Data;
+  ULONGLONG Sum = 0;
+  BOOLEAN Odd;
+  ULONG Result;
+
+  if (Count == 0)
+    return Seed;
+
+  /* Sum from an even address so that no word straddles two loads. The
+     leading byte is then the high half of its word, which swaps the bytes
+     of the folded sum; they are swapped back below */
+  Odd = ((ULONG_PTR)Buffer & 1) != 0;
+  if (Odd)
+    {
+      Sum = (ULONG)*Buffer << 8;
+      Buffer++;
+      Count--;
+    }
 
-  while (Count > 1)
+  /* Add one word to get to a 4-byte boundary */
+  if (((ULONG_PTR)Buffer & 2) && Count >= 2)
     {
-      Sum += *(PUSHORT)Data;
+      Sum += *(PUSHORT)Buffer;
+      Buffer += 2;
+      Count -= 2;
+    }
+
+#if defined(_M_AMD64)
+  if (Count >= 64)
+    {
+      __m128i Zero = _mm_setzero_si128();
+      __m128i Low = Zero, High = Zero;
+      __m128i Block;
+      ULONGLONG Lanes[2];
+
+      /* Widen each 32-bit lane to 64 bits before adding it. Every lane
+         gets at most 2^34 per iteration, so nothing can overflow */
+      do
+        {
+          Block = _mm_loadu_si128((__m128i *)Buffer);
+          Low = _mm_add_epi64(Low, _mm_unpacklo_epi32(Block, Zero));
+          High = _mm_add_epi64(High, _mm_unpackhi_epi32(Block, Zero));
+          Block = _mm_loadu_si128((__m128i *)(Buffer + 16));
+          Low = _mm_add_epi64(Low, _mm_unpacklo_epi32(Block, Zero));
+          High = _mm_add_epi64(High, _mm_unpackhi_epi32(Block, Zero));
+          Block = _mm_loadu_si128((__m128i *)(Buffer + 32));
+          Low = _mm_add_epi64(Low, _mm_unpacklo_epi32(Block, Zero));
+          High = _mm_add_epi64(High, _mm_unpackhi_epi32(Block, Zero));
+          Block = _mm_loadu_si128((__m128i *)(Buffer + 48));
+          Low = _mm_add_epi64(Low, _mm_unpacklo_epi32(Block, Zero));
+          High = _mm_add_epi64(High, _mm_unpackhi_epi32(Block, Zero));
+          Buffer += 64;
+          Count -= 64;
+        }
+      while (Count >= 64);
+
+      _mm_storeu_si128((__m128i *)Lanes, _mm_add_epi64(Low, High));
+      Sum += Lanes[0];
+      Sum += Lanes[1];
+    }
+#endif
+
+  while (Count >= 16)
+    {
+      Sum += ((PULONG)Buffer)[0];
+      Sum += ((PULONG)Buffer)[1];
+      Sum += ((PULONG)Buffer)[2];
+      Sum += ((PULONG)Buffer)[3];
+      Buffer += 16;
+      Count -= 16;
+    }
+
+  while (Count >= 4)
+    {
+      Sum += *(PULONG)Buffer;
+      Buffer += 4;
+      Count -= 4;
+    }
+
+  if (Count >= 2)
+    {
+      Sum += *(PUSHORT)Buffer;
+      Buffer += 2;
       Count -= 2;
-      Data = (PVOID)((ULONG_PTR) Data + 2);
     }
 
   /* Add left-over byte, if any */
   if (Count > 0)
     {
-      Sum += *(PUCHAR)Data;
+      Sum += *Buffer;
     }
 
-  return Sum;
+  Result = ChecksumFold(ChecksumFold64(Sum));
+  if (Odd)
+    {
+      Result = ((Result & 0xFF) << 8) | (Result >> 8);
+    }
+
+  /* Add the seed with its end-around carry */
+  Result += Seed;
+  if (Result < Seed)
+    {
+      Result++;
+    }
+
+  return Result;
+#endif
 }
 
 ULONG
@@ -62,44 +176,15 @@ UDPv4ChecksumCalculate(
   PUCHAR PacketBuffer,
   ULONG DataLength)
 {
-  ULONG Sum = 0;
-  USHORT TmpSum;
-  ULONG i;
-  BOOLEAN Pad;
-
-  /* Pad the data if needed */
-  Pad = (DataLength & 1);
-  if (Pad)
-      DataLength++;
-
-  /* Add from the UDP header and data */
-  for (i = 0; i < DataLength; i += 2)
-  {
-       TmpSum = ((PacketBuffer[i] << 8) & 0xFF00) +
-                ((Pad && i == DataLength - 2) ? 0 : (PacketBuffer[i+1] & 0x00FF));
-       Sum += TmpSum;
-  }
-
-  /* Add the source address */
-  for (i = 0; i < sizeof(IPv4_RAW_ADDRESS); i += 2)
-  {
-       TmpSum = ((((PUCHAR)&IPHeader->SrcAddr)[i] << 8) & 0xFF00) +
-                (((PUCHAR)&IPHeader->SrcAddr)[i+1] & 0x00FF);
-       Sum += TmpSum;
-  }
-
-  /* Add the destination address */
-  for (i = 0; i < sizeof(IPv4_RAW_ADDRESS); i += 2)
-  {
-       TmpSum = ((((PUCHAR)&IPHeader->DstAddr)[i] << 8) & 0xFF00) +
-                (((PUCHAR)&IPHeader->DstAddr)[i+1] & 0x00FF);
-       Sum += TmpSum;
-  }
-
-  /* Add the proto number and length */
-  Sum += IPPROTO_UDP + (DataLength - (Pad ? 1 : 0));
-
-  /* Fold the checksum and return the one's complement */
-  return ~ChecksumFold(Sum);
-}
+  ULONG Sum;
 
+  /* Sum the pseudo header in memory order, like the data */
+  Sum = (IPHeader->SrcAddr & 0xFFFF) + (IPHeader->SrcAddr >> 16) +
+        (IPHeader->DstAddr & 0xFFFF) + (IPHeader->DstAddr >> 16) +
+        WH2N(IPPROTO_UDP) + WH2N((USHORT)DataLength);
+
+  Sum = ChecksumFold(ChecksumCompute(PacketBuffer, DataLength, Sum));
+
+  /* Callers expect the one's complement in host order */
+  return ~(ULONG)WN2H((USHORT)Sum);
+}
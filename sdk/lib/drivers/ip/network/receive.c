@@ -461,6 +461,11 @@ VOID ProcessFragment(
     /* FIXME: Assumes IPv4 */
     IPInitializePacket(&Datagram, IP_ADDRESS_V4);
 
+    /* A datagram that came in one piece keeps what the miniport
+       found about its checksums */
+    if (IPDR->FragmentListHead.Flink == IPDR->FragmentListHead.Blink)
+      Datagram.Flags = IPPacket->Flags & IP_PACKET_FLAG_CHECKSUM_OK;
+
     Success = ReassembleDatagram(&Datagram, IPDR);
 
     FreeIPDR(IPDR);
@@ -611,8 +616,9 @@ VOID IPv4Receive(PIP_INTERFACE IF, PIP_PACKET IPPacket)
         return;
     }
 
-    /* Checksum IPv4 header */
-    if (!IPv4CorrectChecksum(IPPacket->Header, IPPacket->HeaderSize)) {
+    /* Checksum IPv4 header, unless the miniport already did */
+    if (!(IPPacket->Flags & IP_PACKET_FLAG_IP_CHECKSUM_OK) &&
+        !IPv4CorrectChecksum(IPPacket->Header, IPPacket->HeaderSize)) {
         TI_DbgPrint(MIN_TRACE, ("Datagram received with bad checksum. Checksum field (0x%X)\n",
 	      WN2H(((PIPv4_HEADER)IPPacket->Header)->Checksum)));
         /* Discard packet */
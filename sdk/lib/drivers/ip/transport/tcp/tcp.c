@@ -177,7 +177,10 @@ VOID TCPReceive(PIP_INTERFACE Interface, PIP_PACKET IPPacket)
                            IPPacket->TotalSize,
                            IPPacket->HeaderSize));
     
-    LibIPInsertPacket(Interface->TCPContext, IPPacket->Header, IPPacket->TotalSize);
+    LibIPInsertPacket(Interface->TCPContext,
+                      IPPacket->Header,
+                      IPPacket->TotalSize,
+                      (IPPacket->Flags & IP_PACKET_FLAG_TCP_CHECKSUM_OK) != 0);
 }
 
 NTSTATUS TCPStartup(VOID)
@@ -112,6 +112,18 @@
 #if (LWIP_TCP && (TCP_WND > 0xffff))
   #error "If you want to use TCP, TCP_WND must fit in an u16_t, so, you have to reduce it in your lwipopts.h"
 #endif
+#if (LWIP_TCP && !LWIP_WND_SCALE && ((TCP_WND_MAX > 0xffff) || (TCP_SND_BUF_MAX > 0xffff)))
+  #error "If you want to use TCP windows or send buffers larger than 0xffff, you have to define LWIP_WND_SCALE=1 in your lwipopts.h"
+#endif
+#if (LWIP_TCP && LWIP_WND_SCALE && ((TCP_RCV_SCALE > 14) || ((TCP_WND_MAX >> TCP_RCV_SCALE) > 0xffff)))
+  #error "If you want to use TCP window scaling, TCP_RCV_SCALE must be at most 14 and large enough for TCP_WND_MAX, so, you have to change it in your lwipopts.h"
+#endif
+#if (LWIP_TCP && ((TCP_WND_MAX < TCP_WND) || (TCP_SND_BUF_MAX < TCP_SND_BUF)))
+  #error "If you want to use TCP, TCP_WND_MAX and TCP_SND_BUF_MAX must not be smaller than TCP_WND and TCP_SND_BUF, so, you have to change them in your lwipopts.h"
+#endif
+#if (LWIP_TCP && LWIP_TCP_SACK && !TCP_QUEUE_OOSEQ)
+  #error "If you want to use TCP selective acknowledgements, you have to define TCP_QUEUE_OOSEQ=1 in your lwipopts.h"
+#endif
 #if (LWIP_TCP && (TCP_SND_QUEUELEN > 0xffff))
   #error "If you want to use TCP, TCP_SND_QUEUELEN must fit in an u16_t, so, you have to reduce it in your lwipopts.h"
 #endif
@@ -261,8 +273,8 @@
 #if TCP_SND_BUF < (2 * TCP_MSS)
   #error "lwip_sanity_check: WARNING: TCP_SND_BUF must be at least as much as (2 * TCP_MSS) for things to work smoothly. If you know what you are doing, define LWIP_DISABLE_TCP_SANITY_CHECKS to 1 to disable this error."
 #endif
-#if TCP_SND_QUEUELEN < (2 * (TCP_SND_BUF / TCP_MSS))
-  #error "lwip_sanity_check: WARNING: TCP_SND_QUEUELEN must be at least as much as (2 * TCP_SND_BUF/TCP_MSS) for things to work. If you know what you are doing, define LWIP_DISABLE_TCP_SANITY_CHECKS to 1 to disable this error."
+#if TCP_SND_QUEUELEN < (2 * (TCP_SND_BUF_MAX / TCP_MSS))
+  #error "lwip_sanity_check: WARNING: TCP_SND_QUEUELEN must be at least as much as (2 * TCP_SND_BUF_MAX/TCP_MSS) for things to work. If you know what you are doing, define LWIP_DISABLE_TCP_SANITY_CHECKS to 1 to disable this error."
 #endif
 #if TCP_SNDLOWAT >= TCP_SND_BUF
   #error "lwip_sanity_check: WARNING: TCP_SNDLOWAT must be less than TCP_SND_BUF. If you know what you are doing, define LWIP_DISABLE_TCP_SANITY_CHECKS to 1 to disable this error."
@@ -830,6 +830,50 @@ pbuf_dechain(struct pbuf *p)
   return ((tail_gone > 0) ? NULL : q);
 }
 
+#if TCP_QUEUE_OOSEQ && LWIP_WND_SCALE
+/**
+ * Split a pbuf chain whose total length overflowed 16 bits (as created by
+ * pbuf_cat() when TCP passes more than 64 KB of reassembled data at once)
+ * into a first part of at most 0xffff bytes and the rest.
+ *
+ * @param p pbuf chain to split, its tot_len fields are corrected
+ * @param rest set to the remaining chain, or NULL if there is none
+ */
+void
+pbuf_split_64k(struct pbuf *p, struct pbuf **rest)
+{
+  *rest = NULL;
+  if ((p != NULL) && (p->next != NULL)) {
+    u16_t tot_len_front = p->len;
+    struct pbuf *i = p;
+    struct pbuf *r = p->next;
+
+    /* continue until the total length (summed up as u16_t) overflows */
+    while ((r != NULL) && ((u16_t)(tot_len_front + r->len) >= tot_len_front)) {
+      tot_len_front += r->len;
+      i = r;
+      r = r->next;
+    }
+    /* i now points to the last pbuf of the first part */
+    i->next = NULL;
+
+    if (r != NULL) {
+      /* the rest keeps its tot_len, only the first part has to be fixed */
+      for (i = p; i != NULL; i = i->next) {
+        i->tot_len -= r->tot_len;
+        LWIP_ASSERT("tot_len/len mismatch in last pbuf",
+                    (i->next != NULL) || (i->tot_len == i->len));
+      }
+      if (p->flags & PBUF_FLAG_TCP_FIN) {
+        r->flags |= PBUF_FLAG_TCP_FIN;
+      }
+      /* reference counts do not change: the caller now owns both parts */
+      *rest = r;
+    }
+  }
+}
+#endif /* TCP_QUEUE_OOSEQ && LWIP_WND_SCALE */
+
 /**
  *
  * Create PBUF_RAM copies of pbufs.
@@ -69,12 +69,25 @@ static u16_t tcplen;
 static u8_t recv_flags;
 static struct pbuf *recv_data;
 
+#if LWIP_TCP_SACK
+/* SACK blocks of the segment being processed, in host byte order */
+static u8_t tcp_sack_num;
+static u32_t tcp_sack_left[LWIP_TCP_MAX_SACK_NUM];
+static u32_t tcp_sack_right[LWIP_TCP_MAX_SACK_NUM];
+#endif /* LWIP_TCP_SACK */
+
 struct tcp_pcb *tcp_input_pcb;
 
 /* Forward declarations. */
 static err_t tcp_process(struct tcp_pcb *pcb);
 static void tcp_receive(struct tcp_pcb *pcb);
 static void tcp_parseopt(struct tcp_pcb *pcb);
+static void tcp_rcv_tune_start(struct tcp_pcb *pcb);
+static void tcp_rcv_tune(struct tcp_pcb *pcb);
+static void tcp_snd_buf_tune(struct tcp_pcb *pcb);
+#if LWIP_TCP_SACK
+static void tcp_sack_update(struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_SACK */
 
 static err_t tcp_listen_input(struct tcp_pcb_listen *pcb);
 static err_t tcp_timewait_input(struct tcp_pcb *pcb);
@@ -128,8 +141,9 @@ tcp_input(struct pbuf *p, struct netif *inp)
   }
 
 #if CHECKSUM_CHECK_TCP
-  /* Verify TCP checksum. */
-  if (inet_chksum_pseudo(p, ip_current_src_addr(), ip_current_dest_addr(),
+  /* Verify TCP checksum, unless the link layer already did. */
+  if (!(p->flags & PBUF_FLAG_TCP_CHKSUM_OK) &&
+      inet_chksum_pseudo(p, ip_current_src_addr(), ip_current_dest_addr(),
       IP_PROTO_TCP, p->tot_len) != 0) {
       LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_input: packet discarded due to failing checksum 0x%04"X16_F"\n",
         inet_chksum_pseudo(p, ip_current_src_addr(), ip_current_dest_addr(),
@@ -329,8 +343,12 @@ tcp_input(struct pbuf *p, struct netif *inp)
         /* If the application has registered a "sent" function to be
            called when new send buffer space is available, we call it
            now. */
-        if (pcb->acked > 0) {
-          TCP_EVENT_SENT(pcb, pcb->acked, err);
+        while (pcb->acked > 0) {
+          /* the sent callback takes a 16-bit length, report large acks
+             in pieces */
+          u16_t acked16 = TCPWND_MIN16(pcb->acked);
+          pcb->acked -= acked16;
+          TCP_EVENT_SENT(pcb, acked16, err);
           if (err == ERR_ABRT) {
             goto aborted;
           }
@@ -346,17 +364,44 @@ tcp_input(struct pbuf *p, struct netif *inp)
             goto aborted;
           }
 
+#if TCP_QUEUE_OOSEQ && LWIP_WND_SCALE
+          /* data reassembled from the ooseq queue may be larger than a
+             pbuf chain can describe, pass it up in pieces */
+          while (recv_data != NULL) {
+            struct pbuf *rest = NULL;
+            pbuf_split_64k(recv_data, &rest);
+#endif /* TCP_QUEUE_OOSEQ && LWIP_WND_SCALE */
+
           /* Notify application that data has been received. */
           TCP_EVENT_RECV(pcb, recv_data, ERR_OK, err);
           if (err == ERR_ABRT) {
+#if TCP_QUEUE_OOSEQ && LWIP_WND_SCALE
+            if (rest != NULL) {
+              pbuf_free(rest);
+            }
+#endif /* TCP_QUEUE_OOSEQ && LWIP_WND_SCALE */
             goto aborted;
           }
 
           /* If the upper layer can't receive this data, store it */
           if (err != ERR_OK) {
+#if TCP_QUEUE_OOSEQ && LWIP_WND_SCALE
+            if (rest != NULL) {
+              pbuf_cat(recv_data, rest);
+            }
+#endif /* TCP_QUEUE_OOSEQ && LWIP_WND_SCALE */
             pcb->refused_data = recv_data;
             LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_input: keep incoming packet, because pcb is \"full\"\n"));
+#if TCP_QUEUE_OOSEQ && LWIP_WND_SCALE
+            break;
+          } else {
+            /* Upper layer received the data, go on with the rest if > 64K */
+            recv_data = rest;
+#endif /* TCP_QUEUE_OOSEQ && LWIP_WND_SCALE */
+          }
+#if TCP_QUEUE_OOSEQ && LWIP_WND_SCALE
           }
+#endif /* TCP_QUEUE_OOSEQ && LWIP_WND_SCALE */
         }
 
         /* If a FIN segment was received, we call the callback
@@ -368,7 +413,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
           } else {
             /* correct rcv_wnd as the application won't call tcp_recved()
                for the FIN's seqno */
-            if (pcb->rcv_wnd != TCP_WND) {
+            if (pcb->rcv_wnd != pcb->rcv_wnd_max) {
               pcb->rcv_wnd++;
             }
             TCP_EVENT_CLOSED(pcb, err);
@@ -485,7 +530,6 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
     npcb->rcv_ann_right_edge = npcb->rcv_nxt;
     npcb->snd_wnd = tcphdr->wnd;
     npcb->snd_wnd_max = tcphdr->wnd;
-    npcb->ssthresh = npcb->snd_wnd;
     npcb->snd_wl1 = seqno - 1;/* initialise to seqno-1 to force window update */
     npcb->callback_arg = pcb->callback_arg;
 #if LWIP_CALLBACK_API
@@ -499,6 +543,9 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
 
     /* Parse any options in the SYN. */
     tcp_parseopt(npcb);
+    /* the window scale of the peer is known now */
+    npcb->ssthresh = LWIP_TCP_INITIAL_SSTHRESH(npcb);
+    tcp_rcv_tune_start(npcb);
 #if TCP_CALCULATE_EFF_SEND_MSS
     npcb->mss = tcp_eff_send_mss(npcb->mss, &(npcb->remote_ip));
 #endif /* TCP_CALCULATE_EFF_SEND_MSS */
@@ -644,9 +691,10 @@ tcp_process(struct tcp_pcb *pcb)
       pcb->mss = tcp_eff_send_mss(pcb->mss, &(pcb->remote_ip));
 #endif /* TCP_CALCULATE_EFF_SEND_MSS */
 
-      /* Set ssthresh again after changing pcb->mss (already set in tcp_connect
-       * but for the default value of pcb->mss) */
-      pcb->ssthresh = pcb->mss * 10;
+      /* Set ssthresh again now that the window scale of the peer is known
+       * (already set in tcp_connect but for the default value of pcb->mss) */
+      pcb->ssthresh = LWIP_TCP_INITIAL_SSTHRESH(pcb);
+      tcp_rcv_tune_start(pcb);
 
       pcb->cwnd = ((pcb->cwnd == 1) ? (pcb->mss * 2) : pcb->mss);
       LWIP_ASSERT("pcb->snd_queuelen > 0", (pcb->snd_queuelen > 0));
@@ -684,7 +732,7 @@ tcp_process(struct tcp_pcb *pcb)
     if (flags & TCP_ACK) {
       /* expected ACK number? */
       if (TCP_SEQ_BETWEEN(ackno, pcb->lastack+1, pcb->snd_nxt)) {
-        u16_t old_cwnd;
+        tcpwnd_size_t old_cwnd;
         pcb->state = ESTABLISHED;
         LWIP_DEBUGF(TCP_DEBUG, ("TCP connection established %"U16_F" -> %"U16_F".\n", inseg.tcphdr->src, inseg.tcphdr->dest));
 #if LWIP_CALLBACK_API
@@ -856,6 +904,10 @@ tcp_receive(struct tcp_pcb *pcb)
   u32_t right_wnd_edge;
   u16_t new_tot_len;
   int found_dupack = 0;
+  tcpwnd_size_t snd_wnd;
+#if TCP_QUEUE_OOSEQ
+  int had_ooseq;
+#endif /* TCP_QUEUE_OOSEQ */
 #if TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS
   u32_t ooseq_blen;
   u16_t ooseq_qlen;
@@ -865,16 +917,23 @@ tcp_receive(struct tcp_pcb *pcb)
 
   if (flags & TCP_ACK) {
     right_wnd_edge = pcb->snd_wnd + pcb->snd_wl2;
+    snd_wnd = SND_WND_SCALE(pcb, (tcpwnd_size_t)tcphdr->wnd);
+
+#if LWIP_TCP_SACK
+    if (tcp_sack_num > 0) {
+      tcp_sack_update(pcb);
+    }
+#endif /* LWIP_TCP_SACK */
 
     /* Update window. */
     if (TCP_SEQ_LT(pcb->snd_wl1, seqno) ||
        (pcb->snd_wl1 == seqno && TCP_SEQ_LT(pcb->snd_wl2, ackno)) ||
-       (pcb->snd_wl2 == ackno && tcphdr->wnd > pcb->snd_wnd)) {
-      pcb->snd_wnd = tcphdr->wnd;
+       (pcb->snd_wl2 == ackno && snd_wnd > pcb->snd_wnd)) {
+      pcb->snd_wnd = snd_wnd;
       /* keep track of the biggest window announced by the remote host to calculate
          the maximum segment size */
-      if (pcb->snd_wnd_max < tcphdr->wnd) {
-        pcb->snd_wnd_max = tcphdr->wnd;
+      if (pcb->snd_wnd_max < snd_wnd) {
+        pcb->snd_wnd_max = snd_wnd;
       }
       pcb->snd_wl1 = seqno;
       pcb->snd_wl2 = ackno;
@@ -888,10 +947,10 @@ tcp_receive(struct tcp_pcb *pcb)
         /* stop persist timer */
           pcb->persist_backoff = 0;
       }
-      LWIP_DEBUGF(TCP_WND_DEBUG, ("tcp_receive: window update %"U16_F"\n", pcb->snd_wnd));
+      LWIP_DEBUGF(TCP_WND_DEBUG, ("tcp_receive: window update %"TCPWNDSIZE_F"\n", pcb->snd_wnd));
 #if TCP_WND_DEBUG
     } else {
-      if (pcb->snd_wnd != tcphdr->wnd) {
+      if (pcb->snd_wnd != snd_wnd) {
         LWIP_DEBUGF(TCP_WND_DEBUG, 
                     ("tcp_receive: no window update lastack %"U32_F" ackno %"
                      U32_F" wl1 %"U32_F" seqno %"U32_F" wl2 %"U32_F"\n",
@@ -938,9 +997,12 @@ tcp_receive(struct tcp_pcb *pcb)
               if (pcb->dupacks > 3) {
                 /* Inflate the congestion window, but not if it means that
                    the value overflows. */
-                if ((u16_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
-                  pcb->cwnd += pcb->mss;
-                }
+                TCP_WND_INC(pcb->cwnd, pcb->mss);
+#if LWIP_TCP_SACK
+                /* each further dupack means a segment left the network,
+                   use it to fill the next hole the SACK blocks show */
+                tcp_rexmit_sack_hole(pcb);
+#endif /* LWIP_TCP_SACK */
               } else if (pcb->dupacks == 3) {
                 /* Do fast retransmit */
                 tcp_rexmit_fast(pcb);
@@ -957,12 +1019,30 @@ tcp_receive(struct tcp_pcb *pcb)
     } else if (TCP_SEQ_BETWEEN(ackno, pcb->lastack+1, pcb->snd_nxt)){
       /* We come here when the ACK acknowledges new data. */
 
+      /* Update the send buffer space. */
+      pcb->acked = (tcpwnd_size_t)(ackno - pcb->lastack);
+
       /* Reset the "IN Fast Retransmit" flag, since we are no longer
          in fast retransmit. Also reset the congestion window to the
          slow start threshold. */
       if (pcb->flags & TF_INFR) {
-        pcb->flags &= ~TF_INFR;
-        pcb->cwnd = pcb->ssthresh;
+#if LWIP_TCP_SACK
+        if ((pcb->flags & TF_SACK) && TCP_SEQ_LT(ackno, pcb->recover)) {
+          /* Partial ACK: more segments sent before the loss are still
+             missing, stay in fast recovery (RFC 6675). Deflate the
+             window by the data that left the network. */
+          if (pcb->cwnd > pcb->acked) {
+            pcb->cwnd -= pcb->acked;
+          } else {
+            pcb->cwnd = 0;
+          }
+          TCP_WND_INC(pcb->cwnd, pcb->mss);
+        } else
+#endif /* LWIP_TCP_SACK */
+        {
+          pcb->flags &= ~TF_INFR;
+          pcb->cwnd = pcb->ssthresh;
+        }
       }
 
       /* Reset the number of retransmissions. */
@@ -971,29 +1051,27 @@ tcp_receive(struct tcp_pcb *pcb)
       /* Reset the retransmission time-out. */
       pcb->rto = (pcb->sa >> 3) + pcb->sv;
 
-      /* Update the send buffer space. Diff between the two can never exceed 64K? */
-      pcb->acked = (u16_t)(ackno - pcb->lastack);
-
+      tcp_snd_buf_tune(pcb);
       pcb->snd_buf += pcb->acked;
 
       /* Reset the fast retransmit variables. */
       pcb->dupacks = 0;
       pcb->lastack = ackno;
+#if LWIP_TCP_SACK
+      if (TCP_SEQ_LT(pcb->sack_high, ackno)) {
+        pcb->sack_high = ackno;
+      }
+#endif /* LWIP_TCP_SACK */
 
       /* Update the congestion control variables (cwnd and
          ssthresh). */
-      if (pcb->state >= ESTABLISHED) {
+      if ((pcb->state >= ESTABLISHED) && !(pcb->flags & TF_INFR)) {
         if (pcb->cwnd < pcb->ssthresh) {
-          if ((u16_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
-            pcb->cwnd += pcb->mss;
-          }
-          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: slow start cwnd %"U16_F"\n", pcb->cwnd));
+          TCP_WND_INC(pcb->cwnd, pcb->mss);
+          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: slow start cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
         } else {
-          u16_t new_cwnd = (pcb->cwnd + pcb->mss * pcb->mss / pcb->cwnd);
-          if (new_cwnd > pcb->cwnd) {
-            pcb->cwnd = new_cwnd;
-          }
-          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: congestion avoidance cwnd %"U16_F"\n", pcb->cwnd));
+          TCP_WND_INC(pcb->cwnd, (tcpwnd_size_t)LWIP_MAX(1, pcb->mss * pcb->mss / pcb->cwnd));
+          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: congestion avoidance cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
         }
       }
       LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_receive: ACK for %"U32_F", unacked->seqno %"U32_F":%"U32_F"\n",
@@ -1041,6 +1119,13 @@ tcp_receive(struct tcp_pcb *pcb)
         pcb->rtime = 0;
 
       pcb->polltmr = 0;
+
+#if LWIP_TCP_SACK
+      if (pcb->flags & TF_INFR) {
+        /* a partial ACK points at the next hole */
+        tcp_rexmit_sack_hole(pcb);
+      }
+#endif /* LWIP_TCP_SACK */
     } else {
       /* Fix bug bug #21582: out of sequence ACK, didn't really ack anything */
       pcb->acked = 0;
@@ -1218,6 +1303,9 @@ tcp_receive(struct tcp_pcb *pcb)
            we have to trim the end of the segment and update rcv_nxt
            and pass the data to the application. */
         tcplen = TCP_TCPLEN(&inseg);
+#if TCP_QUEUE_OOSEQ
+        had_ooseq = (pcb->ooseq != NULL);
+#endif /* TCP_QUEUE_OOSEQ */
 
         if (tcplen > pcb->rcv_wnd) {
           LWIP_DEBUGF(TCP_INPUT_DEBUG, 
@@ -1230,7 +1318,7 @@ tcp_receive(struct tcp_pcb *pcb)
             TCPH_FLAGS_SET(inseg.tcphdr, TCPH_FLAGS(inseg.tcphdr) &~ TCP_FIN);
           }
           /* Adjust length of segment to fit in the window. */
-          inseg.len = pcb->rcv_wnd;
+          inseg.len = (u16_t)pcb->rcv_wnd;
           if (TCPH_FLAGS(inseg.tcphdr) & TCP_SYN) {
             inseg.len -= 1;
           }
@@ -1360,13 +1448,22 @@ tcp_receive(struct tcp_pcb *pcb)
         }
 #endif /* TCP_QUEUE_OOSEQ */
 
+        tcp_rcv_tune(pcb);
 
         /* Acknowledge the segment(s). */
-        tcp_ack(pcb);
+#if TCP_QUEUE_OOSEQ
+        if (had_ooseq) {
+          /* the segment filled (part of) a hole, tell the sender at
+             once, together with the blocks that are still missing */
+          tcp_ack_now(pcb);
+        } else
+#endif /* TCP_QUEUE_OOSEQ */
+        {
+          tcp_ack(pcb);
+        }
 
       } else {
         /* We get here if the incoming segment is out-of-sequence. */
-        tcp_send_empty_ack(pcb);
 #if TCP_QUEUE_OOSEQ
         /* We queue the segment on the ->ooseq queue. */
         if (pcb->ooseq == NULL) {
@@ -1513,7 +1610,14 @@ tcp_receive(struct tcp_pcb *pcb)
           }
         }
 #endif /* TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS */
+#if LWIP_TCP_SACK
+        /* report the block holding this segment first */
+        pcb->rcv_sack_recent = seqno;
+#endif /* LWIP_TCP_SACK */
 #endif /* TCP_QUEUE_OOSEQ */
+        /* Acknowledge after queueing, so that the SACK blocks already
+           cover this segment. */
+        tcp_send_empty_ack(pcb);
       }
     } else {
       /* The incoming segment is not withing the window. */
@@ -1530,11 +1634,116 @@ tcp_receive(struct tcp_pcb *pcb)
   }
 }
 
+/**
+ * Starts a new receive window measurement: tcp_rcv_tune() looks at the
+ * time it took the remote host to fill the current window.
+ *
+ * @param pcb the tcp_pcb to measure
+ */
+static void
+tcp_rcv_tune_start(struct tcp_pcb *pcb)
+{
+  pcb->rcv_tune_seq = pcb->rcv_nxt + pcb->rcv_wnd_max;
+  pcb->rcv_tune_ticks = tcp_ticks;
+}
+
+/**
+ * Receive window auto-tuning. If the remote host sent a whole window
+ * within about one round-trip time, the window and not the path limits
+ * the transfer, so the window is doubled, up to TCP_WND_MAX (or 64K if
+ * the remote host does not scale windows).
+ *
+ * @param pcb the tcp_pcb that received in-sequence data
+ */
+static void
+tcp_rcv_tune(struct tcp_pcb *pcb)
+{
+  tcpwnd_size_t limit, inc;
+
+  if (TCP_SEQ_LT(pcb->rcv_nxt, pcb->rcv_tune_seq)) {
+    return;
+  }
+
+  limit = TCP_WND_LIMIT(pcb);
+  if ((pcb->rcv_wnd_max < limit) &&
+      ((u32_t)(tcp_ticks - pcb->rcv_tune_ticks) <= (u32_t)LWIP_MAX(pcb->sa >> 3, 1))) {
+    inc = LWIP_MIN(pcb->rcv_wnd_max, limit - pcb->rcv_wnd_max);
+    pcb->rcv_wnd_max += inc;
+    pcb->rcv_wnd += inc;
+    tcp_update_rcv_ann_wnd(pcb);
+    LWIP_DEBUGF(TCP_WND_DEBUG, ("tcp_rcv_tune: window %"TCPWNDSIZE_F"\n", pcb->rcv_wnd_max));
+  }
+  tcp_rcv_tune_start(pcb);
+}
+
+/**
+ * Send buffer auto-tuning: keep room for two windows of data, so that the
+ * application can queue the next window while the current one is in
+ * flight. The buffer grows up to TCP_SND_BUF_MAX and never shrinks.
+ *
+ * @param pcb the tcp_pcb that received an ACK for new data
+ */
+static void
+tcp_snd_buf_tune(struct tcp_pcb *pcb)
+{
+  tcpwnd_size_t wnd = LWIP_MIN(pcb->cwnd, pcb->snd_wnd_max);
+
+  if (wnd > TCP_SND_BUF_MAX / 2) {
+    wnd = TCP_SND_BUF_MAX;
+  } else {
+    wnd *= 2;
+  }
+  if (wnd > pcb->snd_buf_max) {
+    pcb->snd_buf += wnd - pcb->snd_buf_max;
+    pcb->snd_buf_max = wnd;
+  }
+}
+
+#if LWIP_TCP_SACK
+/**
+ * Marks the unacknowledged segments covered by the SACK blocks of the
+ * incoming segment and keeps track of the highest sequence number SACKed.
+ *
+ * @param pcb the tcp_pcb for which a segment arrived
+ */
+static void
+tcp_sack_update(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg;
+  u32_t left, right, seg_seqno;
+  u8_t i;
+
+  for (i = 0; i < tcp_sack_num; i++) {
+    left = tcp_sack_left[i];
+    right = tcp_sack_right[i];
+    /* ignore duplicate SACKs and blocks for data we never sent */
+    if (TCP_SEQ_LEQ(left, ackno) || TCP_SEQ_GEQ(left, right) ||
+        TCP_SEQ_GT(right, pcb->snd_nxt)) {
+      continue;
+    }
+    /* the unacked queue is sorted by sequence number */
+    for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+      seg_seqno = ntohl(seg->tcphdr->seqno);
+      if (TCP_SEQ_GEQ(seg_seqno, right)) {
+        break;
+      }
+      if (TCP_SEQ_GEQ(seg_seqno, left) &&
+          TCP_SEQ_LEQ(seg_seqno + TCP_TCPLEN(seg), right)) {
+        seg->flags |= TF_SEG_SACKED;
+      }
+    }
+    if (TCP_SEQ_GT(right, pcb->sack_high)) {
+      pcb->sack_high = right;
+    }
+  }
+}
+#endif /* LWIP_TCP_SACK */
+
 /**
  * Parses the options contained in the incoming segment. 
  *
  * Called from tcp_listen_input() and tcp_process().
- * Currently, only the MSS option is supported!
+ * Supported are MSS, timestamps, window scale and SACK.
  *
  * @param pcb the tcp_pcb for which a segment arrived
  */
@@ -1547,6 +1756,13 @@ tcp_parseopt(struct tcp_pcb *pcb)
 #if LWIP_TCP_TIMESTAMPS
   u32_t tsval;
 #endif
+#if LWIP_TCP_SACK
+  u8_t i, n;
+#endif
+
+#if LWIP_TCP_SACK
+  tcp_sack_num = 0;
+#endif /* LWIP_TCP_SACK */
 
   opts = (u8_t *)tcphdr + TCP_HLEN;
 
@@ -1579,6 +1795,61 @@ tcp_parseopt(struct tcp_pcb *pcb)
         /* Advance to next option */
         c += 0x04;
         break;
+#if LWIP_WND_SCALE
+      case 0x03:
+        LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: WND_SCALE\n"));
+        if (opts[c + 1] != 0x03 || c + 0x03 > max_c) {
+          /* Bad length */
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+          return;
+        }
+        /* Only a SYN may carry the option, and only the first one counts */
+        if ((flags & TCP_SYN) && !(pcb->flags & TF_WND_SCALE)) {
+          pcb->snd_scale = LWIP_MIN(opts[c + 2], 14);
+          pcb->rcv_scale = TCP_RCV_SCALE;
+          pcb->flags |= TF_WND_SCALE;
+        }
+        /* Advance to next option */
+        c += 0x03;
+        break;
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK
+      case 0x04:
+        LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: SACK_PERM\n"));
+        if (opts[c + 1] != 0x02 || c + 0x02 > max_c) {
+          /* Bad length */
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+          return;
+        }
+        if (flags & TCP_SYN) {
+          pcb->flags |= TF_SACK;
+        }
+        /* Advance to next option */
+        c += 0x02;
+        break;
+      case 0x05:
+        LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: SACK\n"));
+        if (opts[c + 1] < 0x0A || ((opts[c + 1] - 2) & 7) != 0 ||
+            c + opts[c + 1] > max_c) {
+          /* Bad length */
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+          return;
+        }
+        if (!(flags & TCP_SYN) && (pcb->flags & TF_SACK)) {
+          n = LWIP_MIN((opts[c + 1] - 2) >> 3, LWIP_TCP_MAX_SACK_NUM);
+          for (i = 0; i < n; i++) {
+            u8_t *block = &opts[c + 2 + (i << 3)];
+            tcp_sack_left[i] = ((u32_t)block[0] << 24) | ((u32_t)block[1] << 16) |
+              ((u32_t)block[2] << 8) | block[3];
+            tcp_sack_right[i] = ((u32_t)block[4] << 24) | ((u32_t)block[5] << 16) |
+              ((u32_t)block[6] << 8) | block[7];
+          }
+          tcp_sack_num = n;
+        }
+        /* Advance to next option */
+        c += opts[c + 1];
+        break;
+#endif /* LWIP_TCP_SACK */
 #if LWIP_TCP_TIMESTAMPS
       case 0x08:
         LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: TS\n"));
@@ -105,7 +105,7 @@ tcp_output_alloc_header(struct tcp_pcb *pcb, u16_t optlen, u16_t datalen,
     tcphdr->seqno = seqno_be;
     tcphdr->ackno = htonl(pcb->rcv_nxt);
     TCPH_HDRLEN_FLAGS_SET(tcphdr, (5 + optlen / 4), TCP_ACK);
-    tcphdr->wnd = htons(pcb->rcv_ann_wnd);
+    tcphdr->wnd = htons(TCPWND_MIN16(RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd)));
     tcphdr->chksum = 0;
     tcphdr->urgp = 0;
 
@@ -306,7 +306,7 @@ tcp_write_checks(struct tcp_pcb *pcb, u16_t len)
 
   /* fail on too much data */
   if (len > pcb->snd_buf) {
-    LWIP_DEBUGF(TCP_OUTPUT_DEBUG | 3, ("tcp_write: too much data (len=%"U16_F" > snd_buf=%"U16_F")\n",
+    LWIP_DEBUGF(TCP_OUTPUT_DEBUG | 3, ("tcp_write: too much data (len=%"U16_F" > snd_buf=%"TCPWNDSIZE_F")\n",
       len, pcb->snd_buf));
     pcb->flags |= TF_NAGLEMEMERR;
     return ERR_MEM;
@@ -370,7 +370,7 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
 #endif /* TCP_CHECKSUM_ON_COPY */
   err_t err;
   /* don't allocate segments bigger than half the maximum window we ever received */
-  u16_t mss_local = LWIP_MIN(pcb->mss, pcb->snd_wnd_max/2);
+  u16_t mss_local = (u16_t)LWIP_MIN(pcb->mss, pcb->snd_wnd_max/2);
 
 #if LWIP_NETIF_TX_SINGLE_PBUF
   /* Always copy to try to create single pbufs for TX */
@@ -742,6 +742,24 @@ tcp_enqueue_flags(struct tcp_pcb *pcb, u8_t flags)
 
   if (flags & TCP_SYN) {
     optflags = TF_SEG_OPTS_MSS;
+    /* A <SYN,ACK> (sent in state SYN_RCVD) may only carry the window scale,
+       SACK permitted and timestamp options if the <SYN> carried them. An
+       active open offers all of them. */
+#if LWIP_WND_SCALE
+    if ((pcb->state != SYN_RCVD) || (pcb->flags & TF_WND_SCALE)) {
+      optflags |= TF_SEG_OPTS_WND_SCALE;
+    }
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK
+    if ((pcb->state != SYN_RCVD) || (pcb->flags & TF_SACK)) {
+      optflags |= TF_SEG_OPTS_SACK_PERM;
+    }
+#endif /* LWIP_TCP_SACK */
+#if LWIP_TCP_TIMESTAMPS
+    if (pcb->state != SYN_RCVD) {
+      optflags |= TF_SEG_OPTS_TS;
+    }
+#endif /* LWIP_TCP_TIMESTAMPS */
   }
 #if LWIP_TCP_TIMESTAMPS
   if ((pcb->flags & TF_TIMESTAMP)) {
@@ -834,6 +852,47 @@ tcp_build_timestamp_option(struct tcp_pcb *pcb, u32_t *opts)
 }
 #endif
 
+#if LWIP_TCP_SACK
+/* Collect the SACK blocks describing the ooseq queue (RFC 2018): adjacent
+ * segments are merged into one block and the block holding the most
+ * recently received segment is reported first.
+ *
+ * @param pcb tcp_pcb
+ * @param blocks where to store the left and right edges, in network order
+ * @param max maximum number of blocks that fit into the segment
+ * @return number of blocks stored
+ */
+static u8_t
+tcp_build_sack_blocks(struct tcp_pcb *pcb, u32_t *blocks, u8_t max)
+{
+  struct tcp_seg *seg;
+  u32_t left, right;
+  u8_t n = 0, recent, pass;
+
+  for (pass = 0; pass < 2; pass++) {
+    seg = pcb->ooseq;
+    while ((seg != NULL) && (n < max)) {
+      /* ooseq headers are kept in host byte order */
+      left = seg->tcphdr->seqno;
+      right = left + TCP_TCPLEN(seg);
+      for (seg = seg->next; (seg != NULL) && (seg->tcphdr->seqno == right); seg = seg->next) {
+        right += TCP_TCPLEN(seg);
+      }
+      recent = TCP_SEQ_BETWEEN(pcb->rcv_sack_recent, left, right - 1);
+      if ((pass == 0) == (recent != 0)) {
+        blocks[2 * n] = htonl(left);
+        blocks[2 * n + 1] = htonl(right);
+        n++;
+        if (pass == 0) {
+          break;
+        }
+      }
+    }
+  }
+  return n;
+}
+#endif /* LWIP_TCP_SACK */
+
 /** Send an ACK without data.
  *
  * @param pcb Protocol control block for the TCP connection to send the ACK
@@ -844,12 +903,27 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   struct pbuf *p;
   struct tcp_hdr *tcphdr;
   u8_t optlen = 0;
+#if LWIP_TCP_SACK
+  u32_t sack_blocks[2 * LWIP_TCP_MAX_SACK_NUM];
+  u8_t sack_num = 0;
+  u8_t i;
+#endif /* LWIP_TCP_SACK */
 
 #if LWIP_TCP_TIMESTAMPS
   if (pcb->flags & TF_TIMESTAMP) {
     optlen = LWIP_TCP_OPT_LENGTH(TF_SEG_OPTS_TS);
   }
 #endif
+#if LWIP_TCP_SACK
+  if ((pcb->flags & TF_SACK) && (pcb->ooseq != NULL)) {
+    /* 40 bytes of options at most, 4 for the option header, 8 per block */
+    sack_num = tcp_build_sack_blocks(pcb, sack_blocks,
+      (u8_t)LWIP_MIN((40 - optlen - 4) / 8, LWIP_TCP_MAX_SACK_NUM));
+    if (sack_num > 0) {
+      optlen += 4 + 8 * sack_num;
+    }
+  }
+#endif /* LWIP_TCP_SACK */
 
   p = tcp_output_alloc_header(pcb, optlen, 0, htonl(pcb->snd_nxt));
   if (p == NULL) {
@@ -870,6 +944,16 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
     tcp_build_timestamp_option(pcb, (u32_t *)(tcphdr + 1));
   }
 #endif 
+#if LWIP_TCP_SACK
+  if (sack_num > 0) {
+    u32_t *opts = (u32_t *)(void *)((u8_t *)(tcphdr + 1) + optlen - 4 - 8 * sack_num);
+    /* Pad with two NOP options to keep the blocks aligned */
+    *opts++ = htonl(0x01010500 | (2 + 8 * sack_num));
+    for (i = 0; i < 2 * sack_num; i++) {
+      *opts++ = sack_blocks[i];
+    }
+  }
+#endif /* LWIP_TCP_SACK */
 
 #if CHECKSUM_GEN_TCP
   tcphdr->chksum = inet_chksum_pseudo(p, &(pcb->local_ip), &(pcb->remote_ip),
@@ -945,13 +1029,13 @@ tcp_output(struct tcp_pcb *pcb)
 #endif /* TCP_OUTPUT_DEBUG */
 #if TCP_CWND_DEBUG
   if (seg == NULL) {
-    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_output: snd_wnd %"U16_F
-                                 ", cwnd %"U16_F", wnd %"U32_F
+    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_output: snd_wnd %"TCPWNDSIZE_F
+                                 ", cwnd %"TCPWNDSIZE_F", wnd %"U32_F
                                  ", seg == NULL, ack %"U32_F"\n",
                                  pcb->snd_wnd, pcb->cwnd, wnd, pcb->lastack));
   } else {
     LWIP_DEBUGF(TCP_CWND_DEBUG, 
-                ("tcp_output: snd_wnd %"U16_F", cwnd %"U16_F", wnd %"U32_F
+                ("tcp_output: snd_wnd %"TCPWNDSIZE_F", cwnd %"TCPWNDSIZE_F", wnd %"U32_F
                  ", effwnd %"U32_F", seq %"U32_F", ack %"U32_F"\n",
                  pcb->snd_wnd, pcb->cwnd, wnd,
                  ntohl(seg->tcphdr->seqno) - pcb->lastack + seg->len,
@@ -975,7 +1059,7 @@ tcp_output(struct tcp_pcb *pcb)
       break;
     }
 #if TCP_CWND_DEBUG
-    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_output: snd_wnd %"U16_F", cwnd %"U16_F", wnd %"U32_F", effwnd %"U32_F", seq %"U32_F", ack %"U32_F", i %"S16_F"\n",
+    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_output: snd_wnd %"TCPWNDSIZE_F", cwnd %"TCPWNDSIZE_F", wnd %"U32_F", effwnd %"U32_F", seq %"U32_F", ack %"U32_F", i %"S16_F"\n",
                             pcb->snd_wnd, pcb->cwnd, wnd,
                             ntohl(seg->tcphdr->seqno) + seg->len -
                             pcb->lastack,
@@ -1060,7 +1144,12 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
   seg->tcphdr->ackno = htonl(pcb->rcv_nxt);
 
   /* advertise our receive window size in this TCP segment */
-  seg->tcphdr->wnd = htons(pcb->rcv_ann_wnd);
+  if (TCPH_FLAGS(seg->tcphdr) & TCP_SYN) {
+    /* the window field of a SYN is never scaled (RFC 7323 2.2) */
+    seg->tcphdr->wnd = htons(TCPWND_MIN16(pcb->rcv_ann_wnd));
+  } else {
+    seg->tcphdr->wnd = htons(TCPWND_MIN16(RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd)));
+  }
 
   pcb->rcv_ann_right_edge = pcb->rcv_nxt + pcb->rcv_ann_wnd;
 
@@ -1077,6 +1166,20 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
     *opts = TCP_BUILD_MSS_OPTION(mss);
     opts += 1;
   }
+#if LWIP_WND_SCALE
+  if (seg->flags & TF_SEG_OPTS_WND_SCALE) {
+    /* Pad with one NOP option to make everything nicely aligned */
+    *opts = PP_HTONL(0x01030300 | TCP_RCV_SCALE);
+    opts += 1;
+  }
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK
+  if (seg->flags & TF_SEG_OPTS_SACK_PERM) {
+    /* Pad with two NOP options to make everything nicely aligned */
+    *opts = PP_HTONL(0x01010402);
+    opts += 1;
+  }
+#endif /* LWIP_TCP_SACK */
 #if LWIP_TCP_TIMESTAMPS
   pcb->ts_lastacksent = pcb->rcv_nxt;
 
@@ -1212,7 +1315,7 @@ tcp_rst(u32_t seqno, u32_t ackno,
   tcphdr->seqno = htonl(seqno);
   tcphdr->ackno = htonl(ackno);
   TCPH_HDRLEN_FLAGS_SET(tcphdr, TCP_HLEN/4, TCP_RST | TCP_ACK);
-  tcphdr->wnd = PP_HTONS(TCP_WND);
+  tcphdr->wnd = PP_HTONS(TCPWND_MIN16(TCP_WND));
   tcphdr->chksum = 0;
   tcphdr->urgp = 0;
 
@@ -1254,6 +1357,14 @@ tcp_rexmit_rto(struct tcp_pcb *pcb)
   pcb->unacked = NULL;
   /* last unsent hasn't changed, no need to reset unsent_oversize */
 
+#if LWIP_TCP_SACK
+  /* After a timeout, SACK information must not be trusted (RFC 2018 8) */
+  for (seg = pcb->unsent; seg != NULL; seg = seg->next) {
+    seg->flags &= ~TF_SEG_SACKED;
+  }
+  pcb->sack_high = pcb->lastack;
+#endif /* LWIP_TCP_SACK */
+
   /* increment number of retransmissions */
   ++pcb->nrtx;
 
@@ -1265,27 +1376,23 @@ tcp_rexmit_rto(struct tcp_pcb *pcb)
 }
 
 /**
- * Requeue the first unacked segment for retransmission
+ * Requeue an unacked segment for retransmission
  *
- * Called by tcp_receive() for fast retramsmit.
- *
- * @param pcb the tcp_pcb for which to retransmit the first unacked segment
+ * @param pcb the tcp_pcb the segment belongs to
+ * @param seg the segment to move from the unacked to the unsent queue
  */
 void
-tcp_rexmit(struct tcp_pcb *pcb)
+tcp_rexmit_seg(struct tcp_pcb *pcb, struct tcp_seg *seg)
 {
-  struct tcp_seg *seg;
   struct tcp_seg **cur_seg;
 
-  if (pcb->unacked == NULL) {
-    return;
-  }
-
-  /* Move the first unacked segment to the unsent queue */
-  /* Keep the unsent queue sorted. */
-  seg = pcb->unacked;
-  pcb->unacked = seg->next;
+  /* Remove the segment from the unacked queue */
+  for (cur_seg = &(pcb->unacked); (*cur_seg != NULL) && (*cur_seg != seg);
+       cur_seg = &((*cur_seg)->next));
+  LWIP_ERROR("tcp_rexmit_seg: segment not on unacked", *cur_seg != NULL, return;);
+  *cur_seg = seg->next;
 
+  /* Move it to the unsent queue, keeping the unsent queue sorted. */
   cur_seg = &(pcb->unsent);
   while (*cur_seg &&
     TCP_SEQ_LT(ntohl((*cur_seg)->tcphdr->seqno), ntohl(seg->tcphdr->seqno))) {
@@ -1300,8 +1407,6 @@ tcp_rexmit(struct tcp_pcb *pcb)
   }
 #endif /* TCP_OVERSIZE */
 
-  ++pcb->nrtx;
-
   /* Don't take any rtt measurements after retransmitting. */
   pcb->rttest = 0;
 
@@ -1311,6 +1416,25 @@ tcp_rexmit(struct tcp_pcb *pcb)
      and thus tcp_output directly returns. */
 }
 
+/**
+ * Requeue the first unacked segment for retransmission
+ *
+ * Called by tcp_receive() for fast retramsmit.
+ *
+ * @param pcb the tcp_pcb for which to retransmit the first unacked segment
+ */
+void
+tcp_rexmit(struct tcp_pcb *pcb)
+{
+  if (pcb->unacked == NULL) {
+    return;
+  }
+
+  tcp_rexmit_seg(pcb, pcb->unacked);
+
+  ++pcb->nrtx;
+}
+
 
 /**
  * Handle retransmission after three dupacks received
@@ -1327,6 +1451,11 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
                  "), fast retransmit %"U32_F"\n",
                  (u16_t)pcb->dupacks, pcb->lastack,
                  ntohl(pcb->unacked->tcphdr->seqno)));
+#if LWIP_TCP_SACK
+    /* fast recovery ends when everything sent so far is acknowledged */
+    pcb->recover = pcb->snd_nxt;
+    pcb->sack_rexmit = ntohl(pcb->unacked->tcphdr->seqno) + TCP_TCPLEN(pcb->unacked);
+#endif /* LWIP_TCP_SACK */
     tcp_rexmit(pcb);
 
     /* Set ssthresh to half of the minimum of the current
@@ -1340,7 +1469,7 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
     /* The minimum value for ssthresh should be 2 MSS */
     if (pcb->ssthresh < 2*pcb->mss) {
       LWIP_DEBUGF(TCP_FR_DEBUG, 
-                  ("tcp_receive: The minimum value for ssthresh %"U16_F
+                  ("tcp_receive: The minimum value for ssthresh %"TCPWNDSIZE_F
                    " should be min 2 mss %"U16_F"...\n",
                    pcb->ssthresh, 2*pcb->mss));
       pcb->ssthresh = 2*pcb->mss;
@@ -1351,6 +1480,42 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
   } 
 }
 
+#if LWIP_TCP_SACK
+/**
+ * Retransmit the next hole during fast recovery: the first unacked segment
+ * that was neither SACKed nor retransmitted yet and that is either at the
+ * left edge of the window or below data the remote host already SACKed
+ * (a simplified form of the RFC 6675 loss recovery).
+ *
+ * @param pcb the tcp_pcb in fast recovery
+ */
+void
+tcp_rexmit_sack_hole(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg;
+  u32_t seqno;
+
+  if (!(pcb->flags & TF_SACK) || !(pcb->flags & TF_INFR)) {
+    return;
+  }
+
+  /* the unacked queue is sorted by sequence number */
+  for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+    seqno = ntohl(seg->tcphdr->seqno);
+    if ((seqno != pcb->lastack) && TCP_SEQ_GEQ(seqno, pcb->sack_high)) {
+      /* nothing above has been SACKed, so it is not known to be lost */
+      break;
+    }
+    if (!(seg->flags & TF_SEG_SACKED) && TCP_SEQ_GEQ(seqno, pcb->sack_rexmit)) {
+      LWIP_DEBUGF(TCP_FR_DEBUG, ("tcp_rexmit_sack_hole: %"U32_F"\n", seqno));
+      pcb->sack_rexmit = seqno + TCP_TCPLEN(seg);
+      tcp_rexmit_seg(pcb, seg);
+      return;
+    }
+  }
+}
+#endif /* LWIP_TCP_SACK */
+
 
 /**
  * Send keepalive packets to keep a connection active although
@@ -43,8 +43,11 @@ typedef ULONG_PTR mem_ptr_t;
 /* Endianness */
 #define BYTE_ORDER LITTLE_ENDIAN
 
-/* Checksum calculation algorithm choice */
-#define LWIP_CHKSUM_ALGORITHM 3
+/* Checksums are calculated by the IP library, see rosip.c */
+u16_t
+LibIPChecksum(void *dataptr, int len);
+
+#define LWIP_CHKSUM LibIPChecksum
 
 /* Diagnostics */
 #define LWIP_PLATFORM_DIAG(x) (DbgPrint x)
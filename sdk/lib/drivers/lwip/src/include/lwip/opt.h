@@ -923,6 +923,16 @@
 #define TCP_WND                         (4 * TCP_MSS)
 #endif 
 
+/**
+ * TCP_WND_MAX: The largest receive window a connection may grow to. Every
+ * connection starts with TCP_WND and doubles its window whenever the remote
+ * host sends a whole window within one round-trip time. Windows larger than
+ * 0xffff need LWIP_WND_SCALE and are only used if the remote host agrees.
+ */
+#ifndef TCP_WND_MAX
+#define TCP_WND_MAX                     TCP_WND
+#endif
+
 /**
  * TCP_MAXRTX: Maximum number of retransmissions of data segments.
  */
@@ -977,12 +987,21 @@
 #define TCP_SND_BUF                     (2 * TCP_MSS)
 #endif
 
+/**
+ * TCP_SND_BUF_MAX: The largest sender buffer a connection may grow to. Every
+ * connection starts with TCP_SND_BUF and grows its buffer to twice the
+ * congestion window while the application keeps the buffer full.
+ */
+#ifndef TCP_SND_BUF_MAX
+#define TCP_SND_BUF_MAX                 TCP_SND_BUF
+#endif
+
 /**
  * TCP_SND_QUEUELEN: TCP sender buffer space (pbufs). This must be at least
- * as much as (2 * TCP_SND_BUF/TCP_MSS) for things to work.
+ * as much as (2 * TCP_SND_BUF_MAX/TCP_MSS) for things to work.
  */
 #ifndef TCP_SND_QUEUELEN
-#define TCP_SND_QUEUELEN                ((4 * (TCP_SND_BUF) + (TCP_MSS - 1))/(TCP_MSS))
+#define TCP_SND_QUEUELEN                ((4 * (TCP_SND_BUF_MAX) + (TCP_MSS - 1))/(TCP_MSS))
 #endif
 
 /**
@@ -1060,6 +1079,25 @@
 #define LWIP_TCP_TIMESTAMPS             0
 #endif
 
+/**
+ * LWIP_WND_SCALE==1: support the TCP window scale option (RFC 7323).
+ * TCP_RCV_SCALE is the shift count announced for our receive window, it
+ * must be large enough for (TCP_WND_MAX >> TCP_RCV_SCALE) to fit in 16 bits.
+ */
+#ifndef LWIP_WND_SCALE
+#define LWIP_WND_SCALE                  0
+#define TCP_RCV_SCALE                   0
+#endif
+
+/**
+ * LWIP_TCP_SACK==1: support selective acknowledgements (RFC 2018). ACKs
+ * describe the data queued out of sequence (needs TCP_QUEUE_OOSEQ), and
+ * fast recovery retransmits the holes reported by the remote host.
+ */
+#ifndef LWIP_TCP_SACK
+#define LWIP_TCP_SACK                   0
+#endif
+
 /**
  * TCP_WND_UPDATE_THRESHOLD: difference in window to trigger an
  * explicit window update
@@ -69,6 +69,9 @@ err_t            tcp_send_empty_ack(struct tcp_pcb *pcb);
 void             tcp_rexmit  (struct tcp_pcb *pcb);
 void             tcp_rexmit_rto  (struct tcp_pcb *pcb);
 void             tcp_rexmit_fast (struct tcp_pcb *pcb);
+#if LWIP_TCP_SACK
+void             tcp_rexmit_sack_hole(struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_SACK */
 u32_t            tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb);
 err_t            tcp_process_refused_data(struct tcp_pcb *pcb);
 
@@ -113,6 +116,39 @@ err_t            tcp_process_refused_data(struct tcp_pcb *pcb);
 /* Length of the TCP header, excluding options. */
 #define TCP_HLEN 20
 
+/* Window scaling: the window field of a segment is shifted by snd_scale
+   when received and by rcv_scale when sent (RFC 7323) */
+#if LWIP_WND_SCALE
+#define SND_WND_SCALE(pcb, wnd) (((wnd) << (pcb)->snd_scale))
+#define RCV_WND_SCALE(pcb, wnd) (((wnd) >> (pcb)->rcv_scale))
+#define TCP_WND_LIMIT(pcb) (((pcb)->flags & TF_WND_SCALE) ? \
+                            (tcpwnd_size_t)TCP_WND_MAX : \
+                            (tcpwnd_size_t)LWIP_MIN(TCP_WND_MAX, 0xffff))
+#else /* LWIP_WND_SCALE */
+#define SND_WND_SCALE(pcb, wnd) (wnd)
+#define RCV_WND_SCALE(pcb, wnd) (wnd)
+#define TCP_WND_LIMIT(pcb) ((tcpwnd_size_t)TCP_WND_MAX)
+#endif /* LWIP_WND_SCALE */
+
+/** Clamp a window to the 16 bits of the window field */
+#define TCPWND_MIN16(x) ((u16_t)LWIP_MIN((x), 0xFFFF))
+
+/** Increase a window without wrapping around */
+#define TCP_WND_INC(wnd, inc) do { \
+    if ((tcpwnd_size_t)((wnd) + (inc)) >= (wnd)) { \
+      (wnd) = (tcpwnd_size_t)((wnd) + (inc)); \
+    } else { \
+      (wnd) = (tcpwnd_size_t)-1; \
+    } \
+  } while (0)
+
+/** Initial slow start threshold: as large as the peer could announce, so
+   that slow start runs until the first loss */
+#define LWIP_TCP_INITIAL_SSTHRESH(pcb) ((tcpwnd_size_t)SND_WND_SCALE(pcb, 0xffff))
+
+/** Number of SACK blocks kept from a received segment */
+#define LWIP_TCP_MAX_SACK_NUM 4
+
 #ifndef TCP_TMR_INTERVAL
 #define TCP_TMR_INTERVAL       250  /* The TCP timer interval in milliseconds. */
 #endif /* TCP_TMR_INTERVAL */
@@ -292,12 +328,18 @@ struct tcp_seg {
 #define TF_SEG_OPTS_TS          (u8_t)0x02U /* Include timestamp option. */
 #define TF_SEG_DATA_CHECKSUMMED (u8_t)0x04U /* ALL data (not the header) is
                                                checksummed into 'chksum' */
+#define TF_SEG_OPTS_WND_SCALE   (u8_t)0x08U /* Include window scale option. */
+#define TF_SEG_OPTS_SACK_PERM   (u8_t)0x10U /* Include SACK permitted option. */
+#define TF_SEG_SACKED           (u8_t)0x20U /* Unacked segment SACKed by the
+                                               remote host */
   struct tcp_hdr *tcphdr;  /* the TCP header */
 };
 
 #define LWIP_TCP_OPT_LENGTH(flags)              \
-  (flags & TF_SEG_OPTS_MSS ? 4  : 0) +          \
-  (flags & TF_SEG_OPTS_TS  ? 12 : 0)
+  ((flags) & TF_SEG_OPTS_MSS       ? 4  : 0) +  \
+  ((flags) & TF_SEG_OPTS_TS        ? 12 : 0) +  \
+  ((flags) & TF_SEG_OPTS_WND_SCALE ? 4  : 0) +  \
+  ((flags) & TF_SEG_OPTS_SACK_PERM ? 4  : 0)
 
 /** This returns a TCP header option for MSS in an u32_t */
 #define TCP_BUILD_MSS_OPTION(mss) htonl(0x02040000 | ((mss) & 0xFFFF))
@@ -68,6 +68,16 @@
 
 #define TCP_SND_BUF                     TCP_WND
 
+/* Connections start with the 64K window and send buffer above and tune
+ * them up to the sizes below, which needs window scaling */
+#define LWIP_WND_SCALE                  1
+
+#define TCP_RCV_SCALE                   7
+
+#define TCP_WND_MAX                     (4 * 1024 * 1024)
+
+#define TCP_SND_BUF_MAX                 (4 * 1024 * 1024)
+
 #define TCP_MAXRTX                      8
 
 #define TCP_SYNMAXRTX                   4
@@ -76,6 +86,8 @@
 
 #define LWIP_TCP_TIMESTAMPS             1
 
+#define LWIP_TCP_SACK                   1
+
 #define LWIP_CALLBACK_API               1
 
 #define LWIP_NETIF_API                  1
@@ -90,6 +102,9 @@
 
 #define ICMP_STATS                      0
 
+/* The IP library validates the IP header before lwIP sees the packet */
+#define CHECKSUM_CHECK_IP               0
+
 #define PPP_SUPPORT                     0
 
 #define PPPOE_SUPPORT                   0
@@ -4,6 +4,8 @@
 
 #include "rosip.h"
 
+#include <checksum.h>
+
 #include <debug.h>
 
 typedef struct netif* PNETIF;
@@ -11,7 +13,8 @@ typedef struct netif* PNETIF;
 void
 LibIPInsertPacket(void *ifarg,
                   const void *const data,
-                  const u32_t size)
+                  const u32_t size,
+                  const BOOLEAN ChecksumValid)
 {
     struct pbuf *p;
 
@@ -27,10 +30,21 @@ LibIPInsertPacket(void *ifarg,
 
         RtlCopyMemory(p->payload, data, p->len);
 
+        /* The miniport validated the TCP checksum already */
+        if (ChecksumValid)
+            p->flags |= PBUF_FLAG_TCP_CHKSUM_OK;
+
         ((PNETIF)ifarg)->input(p, (PNETIF)ifarg);
     }
 }
 
+u16_t
+LibIPChecksum(void *dataptr, int len)
+{
+    /* lwIP wants the folded sum in memory order, as the IP library computes it */
+    return (u16_t)ChecksumFold(ChecksumCompute(dataptr, len, 0));
+}
+
 void
 LibIPInitialize(void)
 {
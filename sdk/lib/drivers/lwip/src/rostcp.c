@@ -478,8 +478,9 @@ LibTCPSendCallback(void *arg)
 {
     struct lwip_callback_msg *msg = arg;
     PTCP_PCB pcb = msg->Input.Send.Connection->SocketContext;
-    ULONG SendLength;
-    UCHAR SendFlags;
+    ULONG SendLength, ChunkLength, Sent;
+    UCHAR SendFlags, ChunkFlags;
+    err_t Error;
 
     ASSERT(msg);
 
@@ -512,21 +513,43 @@ LibTCPSendCallback(void *arg)
         SendFlags |= TCP_WRITE_FLAG_MORE;
     }
 
-    msg->Output.Send.Error = tcp_write(pcb,
-                                       msg->Input.Send.Data,
-                                       SendLength,
-                                       SendFlags);
-    if (msg->Output.Send.Error == ERR_OK)
+    /* The send buffer grows past 64K but tcp_write takes a 16-bit length,
+     * so queue the data in pieces */
+    Sent = 0;
+    Error = ERR_OK;
+    while (Sent < SendLength)
+    {
+        ChunkLength = min(SendLength - Sent, 0xFFFF);
+        ChunkFlags = SendFlags;
+        if (Sent + ChunkLength < SendLength)
+            ChunkFlags |= TCP_WRITE_FLAG_MORE;
+
+        Error = tcp_write(pcb,
+                          (PUCHAR)msg->Input.Send.Data + Sent,
+                          (u16_t)ChunkLength,
+                          ChunkFlags);
+        if (Error != ERR_OK)
+            break;
+
+        Sent += ChunkLength;
+    }
+
+    if (Sent != 0)
     {
         /* Queued successfully so try to send it */
-        tcp_output((PTCP_PCB)msg->Input.Send.Connection->SocketContext);
-        msg->Output.Send.Information = SendLength;
+        tcp_output(pcb);
+        msg->Output.Send.Error = ERR_OK;
+        msg->Output.Send.Information = Sent;
     }
-    else if (msg->Output.Send.Error == ERR_MEM)
+    else if (Error == ERR_MEM)
     {
         /* The queue is too long */
         msg->Output.Send.Error = ERR_INPROGRESS;
     }
+    else
+    {
+        msg->Output.Send.Error = Error;
+    }
 
 done:
     KeSetEvent(&msg->Event, IO_NO_INCREMENT, FALSE);
@@ -0,0 +1,176 @@
+#include "test_chksum.h"
+
+#include "lwip/inet_chksum.h"
+#include "lwip/pbuf.h"
+#include "lwip/def.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* big enough for a maximum sized buffer at every offset from 0 to 15 */
+static u8_t chksum_data[0x10000 + 16];
+
+/* helper functions */
+
+/** Byte-wise sum as in RFC 1071, returned in the same form as inet_chksum() */
+static u16_t
+chksum_reference(const u8_t *data, u32_t len)
+{
+  u32_t acc = 0;
+  u32_t i;
+
+  for (i = 0; i + 1 < len; i += 2) {
+    acc += ((u32_t)data[i] << 8) | data[i + 1];
+  }
+  if (len & 1) {
+    acc += (u32_t)data[len - 1] << 8;
+  }
+  while (acc >> 16) {
+    acc = (acc & 0xffff) + (acc >> 16);
+  }
+  return htons((u16_t)~acc);
+}
+
+/* Setups/teardown functions */
+
+static void
+chksum_setup(void)
+{
+  u32_t seed = 0x12345678;
+  size_t i;
+
+  /* deterministic noise, so failures can be reproduced */
+  for (i = 0; i < sizeof(chksum_data); i++) {
+    seed = seed * 1103515245 + 12345;
+    chksum_data[i] = (u8_t)(seed >> 16);
+  }
+}
+
+static void
+chksum_teardown(void)
+{
+}
+
+
+/* Test functions */
+
+/** Every start alignment and every short length must give the byte-wise sum */
+START_TEST(test_chksum_alignment)
+{
+  static const u32_t long_lens[] = { 1499, 1500, 9000, 0xfffe, 0xffff };
+  u32_t offset, len;
+  size_t i;
+  LWIP_UNUSED_ARG(_i);
+
+  for (offset = 0; offset < 16; offset++) {
+    for (len = 0; len <= 600; len++) {
+      EXPECT(inet_chksum(&chksum_data[offset], (u16_t)len) ==
+             chksum_reference(&chksum_data[offset], len));
+    }
+    for (i = 0; i < sizeof(long_lens) / sizeof(long_lens[0]); i++) {
+      len = long_lens[i];
+      EXPECT(inet_chksum(&chksum_data[offset], (u16_t)len) ==
+             chksum_reference(&chksum_data[offset], len));
+    }
+  }
+}
+END_TEST
+
+/** All-ones data carries out of every word, the sum must survive that */
+START_TEST(test_chksum_carries)
+{
+  u32_t offset;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(chksum_data, 0xff, sizeof(chksum_data));
+  for (offset = 0; offset < 4; offset++) {
+    EXPECT(inet_chksum(&chksum_data[offset], 0xffff) ==
+           chksum_reference(&chksum_data[offset], 0xffff));
+    EXPECT(inet_chksum(&chksum_data[offset], 0xfffe) ==
+           chksum_reference(&chksum_data[offset], 0xfffe));
+  }
+}
+END_TEST
+
+/** Data followed by its own checksum must verify as 0 */
+START_TEST(test_chksum_verify)
+{
+  u16_t chksum;
+  u16_t len;
+  LWIP_UNUSED_ARG(_i);
+
+  for (len = 2; len <= 2000; len += 2) {
+    chksum = inet_chksum(&chksum_data[1], len);
+    memcpy(&chksum_data[1 + len], &chksum, sizeof(chksum));
+    EXPECT(inet_chksum(&chksum_data[1], len + sizeof(chksum)) == 0);
+  }
+}
+END_TEST
+
+/** Pbuf chains with odd sized and odd aligned parts sum like one buffer */
+START_TEST(test_chksum_pbuf_chain)
+{
+  static const u16_t part_lens[] = { 1, 3, 2, 7, 64, 5, 1, 1, 1460, 33, 0x1000, 9 };
+  struct pbuf *p = NULL;
+  struct pbuf *q;
+  u32_t offset = 3;
+  u32_t total = 0;
+  size_t i;
+  LWIP_UNUSED_ARG(_i);
+
+  for (i = 0; i < sizeof(part_lens) / sizeof(part_lens[0]); i++) {
+    q = pbuf_alloc(PBUF_RAW, part_lens[i], PBUF_REF);
+    EXPECT_RET(q != NULL);
+    q->payload = &chksum_data[offset + total];
+    total += part_lens[i];
+    if (p == NULL) {
+      p = q;
+    } else {
+      pbuf_cat(p, q);
+    }
+    EXPECT(inet_chksum_pbuf(p) == chksum_reference(&chksum_data[offset], total));
+  }
+  pbuf_free(p);
+}
+END_TEST
+
+/** Reports how fast large buffers are summed, and checks the result */
+START_TEST(test_chksum_throughput)
+{
+  const u32_t rounds = 2000;
+  u16_t expected, chksum = 0;
+  clock_t start, ticks;
+  u32_t i;
+  LWIP_UNUSED_ARG(_i);
+
+  expected = chksum_reference(chksum_data, 0xffff);
+
+  start = clock();
+  for (i = 0; i < rounds; i++) {
+    chksum |= inet_chksum(chksum_data, 0xffff) ^ expected;
+  }
+  ticks = clock() - start;
+  EXPECT(chksum == 0);
+
+  if (ticks > 0) {
+    printf("inet_chksum: %.0f MB/s over %u KB buffers\n",
+           (double)rounds * 0xffff * CLOCKS_PER_SEC / ticks / (1024 * 1024), 0xffff / 1024 + 1);
+  }
+}
+END_TEST
+
+
+/** Create the suite including all tests for this module */
+Suite *
+chksum_suite(void)
+{
+  TFun tests[] = {
+    test_chksum_alignment,
+    test_chksum_carries,
+    test_chksum_verify,
+    test_chksum_pbuf_chain,
+    test_chksum_throughput
+  };
+  return create_suite("CHKSUM", tests, sizeof(tests)/sizeof(TFun), chksum_setup, chksum_teardown);
+}
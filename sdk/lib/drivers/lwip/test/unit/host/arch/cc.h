@@ -0,0 +1,46 @@
+/* Host port of the lwIP binding header, used to run the unit tests */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* mem_trim() must trim the buffer without relocating it.
+ * Like the ReactOS port, we just return the buffer passed in unchanged */
+#define mem_trim(_m_, _s_) (_m_)
+
+/* Unsigned int types */
+typedef uint8_t u8_t;
+typedef uint16_t u16_t;
+typedef uint32_t u32_t;
+
+/* Signed int types */
+typedef int8_t s8_t;
+typedef int16_t s16_t;
+typedef int32_t s32_t;
+
+/* Memory pointer */
+typedef uintptr_t mem_ptr_t;
+
+/* Printf formatters */
+#define U16_F "hu"
+#define S16_F "hd"
+#define X16_F "hx"
+#define U32_F "u"
+#define S32_F "d"
+#define X32_F "x"
+#define SZT_F "zu"
+
+/* Endianness */
+#undef BYTE_ORDER
+#define BYTE_ORDER LITTLE_ENDIAN
+
+/* Diagnostics */
+#define LWIP_PLATFORM_DIAG(x) do { printf x; } while (0)
+#define LWIP_PLATFORM_ASSERT(x) do { fprintf(stderr, "Assertion \"%s\" failed at line %d in %s\n", x, __LINE__, __FILE__); abort(); } while (0)
+
+/* Compiler hints for packing structures */
+#define PACK_STRUCT_STRUCT __attribute__((packed))
+#define PACK_STRUCT_FIELD(x) x
+#define PACK_STRUCT_BEGIN
+#define PACK_STRUCT_END
@@ -0,0 +1,4 @@
+/* Host port of the lwIP binding header, used to run the unit tests */
+
+#define PERF_START
+#define PERF_STOP(x)
@@ -0,0 +1,18 @@
+/* Host port of the lwIP binding header, used to run the unit tests.
+ * The tests run the raw API in a single thread, so there is nothing to lock. */
+
+typedef int sys_sem_t;
+typedef int sys_mbox_t;
+typedef int sys_prot_t;
+typedef u32_t sys_thread_t;
+
+#define sys_jiffies() sys_now()
+
+/* NULL definitions */
+#define SYS_MBOX_NULL 0
+#define SYS_SEM_NULL 0
+
+#define sys_sem_valid(sem) 0
+#define sys_sem_set_invalid(sem)
+#define sys_mbox_valid(mbox) 0
+#define sys_mbox_set_invalid(mbox)
@@ -0,0 +1,171 @@
+/* The part of the check framework the lwIP unit tests use, see check.h */
+
+#include "check.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+struct TCase {
+  TCase *next;
+  const char *name;
+  SFun setup;
+  SFun teardown;
+  TFun test;
+};
+
+struct Suite {
+  Suite *next;
+  const char *name;
+  TCase *tcases;
+};
+
+struct SRunner {
+  Suite *suites;
+  int tests_run;
+  int tests_failed;
+};
+
+static int check_failures;
+
+void
+_check_expr(int result, const char *file, int line, const char *msg)
+{
+  if (!result) {
+    printf("%s:%d: %s\n", file, line, msg);
+    check_failures++;
+  }
+}
+
+static void *
+check_alloc(size_t size)
+{
+  void *p = calloc(1, size);
+  if (p == NULL) {
+    fprintf(stderr, "out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+Suite *
+suite_create(const char *name)
+{
+  Suite *s = (Suite *)check_alloc(sizeof(Suite));
+  s->name = name;
+  return s;
+}
+
+TCase *
+tcase_create(const char *name)
+{
+  TCase *tc = (TCase *)check_alloc(sizeof(TCase));
+  tc->name = name;
+  return tc;
+}
+
+void
+tcase_add_checked_fixture(TCase *tc, SFun setup, SFun teardown)
+{
+  tc->setup = setup;
+  tc->teardown = teardown;
+}
+
+void
+tcase_add_test(TCase *tc, TFun tf)
+{
+  tc->test = tf;
+}
+
+void
+suite_add_tcase(Suite *s, TCase *tc)
+{
+  TCase **last = &s->tcases;
+
+  while (*last != NULL) {
+    last = &(*last)->next;
+  }
+  *last = tc;
+}
+
+SRunner *
+srunner_create(Suite *s)
+{
+  SRunner *sr = (SRunner *)check_alloc(sizeof(SRunner));
+  sr->suites = s;
+  return sr;
+}
+
+void
+srunner_add_suite(SRunner *sr, Suite *s)
+{
+  Suite **last = &sr->suites;
+
+  while (*last != NULL) {
+    last = &(*last)->next;
+  }
+  *last = s;
+}
+
+void
+srunner_set_fork_status(SRunner *sr, enum fork_status fstat)
+{
+  (void)sr;
+  (void)fstat;
+}
+
+void
+srunner_run_all(SRunner *sr, enum print_output print_mode)
+{
+  Suite *s;
+  TCase *tc;
+  int i, failures;
+
+  for (s = sr->suites; s != NULL; s = s->next) {
+    for (tc = s->tcases, i = 0; tc != NULL; tc = tc->next, i++) {
+      failures = check_failures;
+      if (tc->setup != NULL) {
+        tc->setup();
+      }
+      tc->test(0);
+      if (tc->teardown != NULL) {
+        tc->teardown();
+      }
+      sr->tests_run++;
+      if (check_failures != failures) {
+        sr->tests_failed++;
+      }
+      if (print_mode >= CK_VERBOSE || check_failures != failures) {
+        printf("%s:%s:%d: %s\n", s->name, tc->name, i,
+               check_failures != failures ? "Failed" : "Passed");
+      }
+    }
+  }
+  if (print_mode >= CK_MINIMAL) {
+    printf("%d%%: Checks: %d, Failures: %d\n",
+           sr->tests_run ? 100 * (sr->tests_run - sr->tests_failed) / sr->tests_run : 100,
+           sr->tests_run, sr->tests_failed);
+  }
+}
+
+int
+srunner_ntests_failed(SRunner *sr)
+{
+  return sr->tests_failed;
+}
+
+void
+srunner_free(SRunner *sr)
+{
+  Suite *s, *snext;
+  TCase *tc, *tcnext;
+
+  for (s = sr->suites; s != NULL; s = snext) {
+    snext = s->next;
+    for (tc = s->tcases; tc != NULL; tc = tcnext) {
+      tcnext = tc->next;
+      free(tc);
+    }
+    free(s);
+  }
+  free(sr);
+}
@@ -0,0 +1,44 @@
+#ifndef __LWIP_HOST_CHECK_H__
+#define __LWIP_HOST_CHECK_H__
+
+/* The part of the check framework the lwIP unit tests use. Every test runs
+ * in-process (CK_NOFORK), so a crashing test ends the run. */
+
+#include <stddef.h>
+
+typedef void (*TFun)(int _i);
+typedef void (*SFun)(void);
+
+typedef struct TCase TCase;
+typedef struct Suite Suite;
+typedef struct SRunner SRunner;
+
+enum fork_status { CK_FORK_GETENV, CK_NOFORK, CK_FORK };
+enum print_output { CK_SILENT, CK_MINIMAL, CK_NORMAL, CK_VERBOSE };
+
+#define START_TEST(__testname) static void __testname(int _i) {
+#define END_TEST }
+
+#define fail_unless(expr, ...) \
+  _check_expr(!!(expr), __FILE__, __LINE__, "Assertion '" #expr "' failed")
+#define fail_if(expr, ...) \
+  _check_expr(!(expr), __FILE__, __LINE__, "Failure '" #expr "' occurred")
+#define fail(...) \
+  _check_expr(0, __FILE__, __LINE__, "Failed")
+
+void _check_expr(int result, const char *file, int line, const char *msg);
+
+Suite *suite_create(const char *name);
+TCase *tcase_create(const char *name);
+void tcase_add_checked_fixture(TCase *tc, SFun setup, SFun teardown);
+void tcase_add_test(TCase *tc, TFun tf);
+void suite_add_tcase(Suite *s, TCase *tc);
+
+SRunner *srunner_create(Suite *s);
+void srunner_add_suite(SRunner *sr, Suite *s);
+void srunner_set_fork_status(SRunner *sr, enum fork_status fstat);
+void srunner_run_all(SRunner *sr, enum print_output print_mode);
+int srunner_ntests_failed(SRunner *sr);
+void srunner_free(SRunner *sr);
+
+#endif /* __LWIP_HOST_CHECK_H__ */
@@ -0,0 +1 @@
+/* Included by lwip_check.h, the options are in lwipopts.h */
@@ -0,0 +1,22 @@
+/* The unit tests run with the options of the driver, plus the statistics
+ * the tests use to check for leaked memory. The pools keep no statistics
+ * when they are allocated from the heap. */
+
+#include "../../../src/include/lwipopts.h"
+
+#undef MEMP_MEM_MALLOC
+#define MEMP_MEM_MALLOC                 0
+
+/* Pools big enough for the windows the driver tunes up to */
+#define MEMP_NUM_TCP_SEG                TCP_SND_QUEUELEN
+
+#define PBUF_POOL_SIZE                  4096
+
+#undef LWIP_STATS
+#define LWIP_STATS                      1
+
+#undef TCP_STATS
+#define TCP_STATS                       1
+
+#undef MEMP_STATS
+#define MEMP_STATS                      1
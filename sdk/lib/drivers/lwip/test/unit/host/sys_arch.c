@@ -0,0 +1,37 @@
+/* Host port of the lwIP system functions, used to run the unit tests.
+ * The tests drive the timers themselves, so time stands still. */
+
+#include "lwip/sys.h"
+#include "lwip/tcpip.h"
+#include "lwip/tcp_impl.h"
+#include "lwip/timers.h"
+
+void
+sys_init(void)
+{
+}
+
+u32_t
+sys_now(void)
+{
+  return 0;
+}
+
+void
+sys_timeouts_init(void)
+{
+}
+
+void
+tcp_timer_needed(void)
+{
+}
+
+err_t
+tcpip_callback_with_block(tcpip_callback_fn function, void *ctx, u8_t block)
+{
+  LWIP_UNUSED_ARG(function);
+  LWIP_UNUSED_ARG(ctx);
+  LWIP_UNUSED_ARG(block);
+  return ERR_OK;
+}
@@ -0,0 +1,33 @@
+#include "../lwip_check.h"
+
+#include "../tcp/test_tcp_oos.h"
+#include "../tcp/test_tcp_wnd.h"
+
+#include "lwip/init.h"
+
+/* The suites that build with the options of the driver, lwip_unittests.c
+ * lists all of them */
+int main()
+{
+  int number_failed;
+  SRunner *sr;
+  size_t i;
+  suite_getter_fn* suites[] = {
+    tcp_oos_suite,
+    tcp_wnd_suite
+  };
+  size_t num = sizeof(suites)/sizeof(void*);
+  LWIP_ASSERT("No suites defined", num > 0);
+
+  lwip_init();
+
+  sr = srunner_create((suites[0])());
+  for(i = 1; i < num; i++) {
+    srunner_add_suite(sr, ((suite_getter_fn*)suites[i])());
+  }
+
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
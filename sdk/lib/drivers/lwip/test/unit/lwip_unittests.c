@@ -3,7 +3,9 @@
 #include "udp/test_udp.h"
 #include "tcp/test_tcp.h"
 #include "tcp/test_tcp_oos.h"
+#include "tcp/test_tcp_wnd.h"
 #include "core/test_mem.h"
+#include "core/test_chksum.h"
 #include "core/test_pbuf.h"
 #include "etharp/test_etharp.h"
 #include "dhcp/test_dhcp.h"
@@ -20,7 +22,9 @@ int main()
     udp_suite,
     tcp_suite,
     tcp_oos_suite,
+    tcp_wnd_suite,
     mem_suite,
+    chksum_suite,
     pbuf_suite,
     etharp_suite,
     dhcp_suite
@@ -452,7 +452,8 @@ START_TEST(test_tcp_recv_ooseq_FIN_INSEQ)
 }
 END_TEST
 
-static char data_full_wnd[TCP_WND];
+/* the segments overrunning the window start up to TCP_MSS past it */
+static char data_full_wnd[TCP_WND + 2 * TCP_MSS];
 
 /** create multiple segments and pass them to tcp_input with the first segment missing
  * to simulate overruning the rxwin with ooseq queueing enabled */
@@ -0,0 +1,849 @@
+#include "test_tcp_wnd.h"
+
+#include "lwip/tcp_impl.h"
+#include "lwip/stats.h"
+#include "tcp_helper.h"
+
+#include <string.h>
+
+#if !LWIP_STATS || !TCP_STATS || !MEMP_STATS
+#error "This tests needs TCP- and MEMP-statistics enabled"
+#endif
+#if !LWIP_WND_SCALE || !LWIP_TCP_SACK
+#error "This tests needs LWIP_WND_SCALE and LWIP_TCP_SACK enabled"
+#endif
+
+/* the segment size used by the sender tests */
+#define TEST_SEG_LEN 100
+
+static u8_t tx_data[6 * TEST_SEG_LEN];
+static u8_t rx_data[0x4000];
+static u32_t test_tcp_wnd_accepted;
+
+/* helper functions */
+
+/** Free the copied packets and reset the tx counters */
+static void
+tcp_wnd_reset_tx(struct test_tcp_txcounters* txcounters)
+{
+  if (txcounters->tx_packets != NULL) {
+    pbuf_free(txcounters->tx_packets);
+    txcounters->tx_packets = NULL;
+  }
+  txcounters->num_tx_calls = 0;
+  txcounters->num_tx_bytes = 0;
+}
+
+/** Get the TCP header of a sent packet (by index) or NULL */
+static struct tcp_hdr*
+tcp_wnd_tx_tcphdr(struct test_tcp_txcounters* txcounters, int index)
+{
+  struct pbuf* q = txcounters->tx_packets;
+  int i;
+
+  /* every packet was copied into a single pbuf of the chain */
+  for (i = 0; (i < index) && (q != NULL); i++) {
+    q = q->next;
+  }
+  if ((q == NULL) || (q->len < IP_HLEN + TCP_HLEN)) {
+    return NULL;
+  }
+  return (struct tcp_hdr*)((u8_t*)q->payload + IP_HLEN);
+}
+
+/** Find an option in a TCP header, returns a pointer to its kind byte or NULL */
+static u8_t*
+tcp_wnd_find_option(struct tcp_hdr* tcphdr, u8_t kind)
+{
+  u8_t* opts = (u8_t*)(tcphdr + 1);
+  int optlen = TCPH_HDRLEN(tcphdr) * 4 - TCP_HLEN;
+  int c = 0;
+
+  while (c < optlen) {
+    if (opts[c] == 0x00) {
+      break;
+    } else if (opts[c] == 0x01) {
+      c++;
+    } else if (opts[c] == kind) {
+      return &opts[c];
+    } else if ((c + 1 >= optlen) || (opts[c + 1] < 2)) {
+      break;
+    } else {
+      c += opts[c + 1];
+    }
+  }
+  return NULL;
+}
+
+/** Read a 32 bit value in network order from an unaligned option */
+static u32_t
+tcp_wnd_get_u32(const u8_t* p)
+{
+  return ((u32_t)p[0] << 24) | ((u32_t)p[1] << 16) | ((u32_t)p[2] << 8) | p[3];
+}
+
+/** Build a SACK option (preceded by two NOPs) for up to 4 blocks */
+static u8_t
+tcp_wnd_sack_option(u8_t* opts, const u32_t* blocks, u8_t num)
+{
+  u8_t i, c = 0;
+
+  opts[c++] = 0x01;
+  opts[c++] = 0x01;
+  opts[c++] = 0x05;
+  opts[c++] = (u8_t)(2 + 8 * num);
+  for (i = 0; i < 2 * num; i++) {
+    opts[c++] = (u8_t)(blocks[i] >> 24);
+    opts[c++] = (u8_t)(blocks[i] >> 16);
+    opts[c++] = (u8_t)(blocks[i] >> 8);
+    opts[c++] = (u8_t)blocks[i];
+  }
+  return c;
+}
+
+/** Create an ACK with SACK blocks for the pcb (seqno rcv_nxt) */
+static struct pbuf*
+tcp_wnd_create_sack(struct tcp_pcb* pcb, u32_t ackno, const u32_t* blocks, u8_t num)
+{
+  u8_t opts[4 + 8 * LWIP_TCP_MAX_SACK_NUM];
+  u8_t optlen = tcp_wnd_sack_option(opts, blocks, num);
+
+  return tcp_create_segment_opts(&pcb->remote_ip, &pcb->local_ip, pcb->remote_port,
+    pcb->local_port, NULL, 0, pcb->rcv_nxt, ackno, TCP_ACK, TCP_WND, opts, optlen);
+}
+
+static err_t
+test_tcp_wnd_accept(void* arg, struct tcp_pcb* pcb, err_t err)
+{
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(pcb);
+  LWIP_UNUSED_ARG(err);
+  test_tcp_wnd_accepted++;
+  return ERR_OK;
+}
+
+/** recv callback that checks the rx_data pattern and gives the window back */
+static err_t
+test_tcp_wnd_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err)
+{
+  struct test_tcp_counters* counters = (struct test_tcp_counters*)arg;
+  struct pbuf* q;
+  u32_t len = 0;
+  u16_t i;
+  LWIP_UNUSED_ARG(err);
+
+  if (p == NULL) {
+    counters->close_calls++;
+    return ERR_OK;
+  }
+  for (q = p; q != NULL; q = q->next) {
+    len += q->len;
+    for (i = 0; i < q->len; i++) {
+      if (((u8_t*)q->payload)[i] != (u8_t)counters->recved_bytes) {
+        EXPECT(((u8_t*)q->payload)[i] == (u8_t)counters->recved_bytes);
+        break;
+      }
+      counters->recved_bytes++;
+    }
+  }
+  /* tot_len must not have wrapped: nothing bigger than 64K reaches the application */
+  EXPECT(len == p->tot_len);
+  counters->recv_calls++;
+  tcp_recved(pcb, p->tot_len);
+  pbuf_free(p);
+  return ERR_OK;
+}
+
+/* Setups/teardown functions */
+
+static void
+tcp_wnd_setup(void)
+{
+  u32_t i;
+
+  for (i = 0; i < sizeof(tx_data); i++) {
+    tx_data[i] = (u8_t)i;
+  }
+  for (i = 0; i < sizeof(rx_data); i++) {
+    rx_data[i] = (u8_t)i;
+  }
+  test_tcp_wnd_accepted = 0;
+  tcp_ticks = 0;
+  tcp_remove_all();
+}
+
+static void
+tcp_wnd_teardown(void)
+{
+  tcp_remove_all();
+  netif_list = NULL;
+  netif_default = NULL;
+}
+
+
+/* Test functions */
+
+/** A SYN with window scale and SACK permitted options: both are agreed
+ * on in the SYN|ACK and the window of the ACK is scaled */
+START_TEST(test_tcp_wnd_scale_passive_open)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct tcp_pcb *lpcb, *pcb;
+  struct tcp_hdr* tcphdr;
+  struct pbuf* p;
+  u8_t* opt;
+  /* MSS 1460, window scale 3, SACK permitted */
+  u8_t syn_opts[] = {0x02, 0x04, 0x05, 0xb4, 0x01, 0x03, 0x03, 0x03, 0x01, 0x01, 0x04, 0x02};
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  /* initialize local vars */
+  IP4_ADDR(&local_ip,  192, 168,   1, 1);
+  IP4_ADDR(&remote_ip, 192, 168,   1, 2);
+  IP4_ADDR(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  txcounters.copy_tx_packets = 1;
+
+  lpcb = tcp_new();
+  EXPECT_RET(lpcb != NULL);
+  err = tcp_bind(lpcb, &local_ip, local_port);
+  EXPECT_RET(err == ERR_OK);
+  lpcb = tcp_listen(lpcb);
+  EXPECT_RET(lpcb != NULL);
+  tcp_accept(lpcb, test_tcp_wnd_accept);
+
+  p = tcp_create_segment_opts(&remote_ip, &local_ip, remote_port, local_port, NULL, 0,
+    0x1000, 0, TCP_SYN, 0xffff, syn_opts, sizeof(syn_opts));
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+
+  pcb = tcp_active_pcbs;
+  EXPECT_RET(pcb != NULL);
+  EXPECT(pcb->state == SYN_RCVD);
+  EXPECT(pcb->flags & TF_WND_SCALE);
+  EXPECT(pcb->flags & TF_SACK);
+  EXPECT(pcb->snd_scale == 3);
+  EXPECT(pcb->rcv_scale == TCP_RCV_SCALE);
+  /* the window of a SYN is never scaled */
+  EXPECT(pcb->snd_wnd == 0xffff);
+
+  EXPECT_RET(txcounters.num_tx_calls == 1);
+  tcphdr = tcp_wnd_tx_tcphdr(&txcounters, 0);
+  EXPECT_RET(tcphdr != NULL);
+  EXPECT(TCPH_FLAGS(tcphdr) == (TCP_SYN | TCP_ACK));
+  EXPECT(ntohs(tcphdr->wnd) == TCPWND_MIN16(pcb->rcv_ann_wnd));
+  opt = tcp_wnd_find_option(tcphdr, 0x03);
+  EXPECT(opt != NULL);
+  if (opt != NULL) {
+    EXPECT(opt[1] == 3);
+    EXPECT(opt[2] == TCP_RCV_SCALE);
+  }
+  EXPECT(tcp_wnd_find_option(tcphdr, 0x04) != NULL);
+  tcp_wnd_reset_tx(&txcounters);
+
+  /* complete the handshake, windows are scaled from now on */
+  p = tcp_create_segment_opts(&remote_ip, &local_ip, remote_port, local_port, NULL, 0,
+    0x1001, pcb->snd_nxt, TCP_ACK, 1000, NULL, 0);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->state == ESTABLISHED);
+  EXPECT(test_tcp_wnd_accepted == 1);
+  EXPECT(pcb->snd_wnd == 8000);
+
+  tcp_abort(pcb);
+  tcp_wnd_reset_tx(&txcounters);
+  err = tcp_close(lpcb);
+  EXPECT(err == ERR_OK);
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 0);
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB_LISTEN].used == 0);
+}
+END_TEST
+
+/** A SYN without options: no scaling, no SACK and the window stays below 64K */
+START_TEST(test_tcp_wnd_scale_not_offered)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct tcp_pcb *lpcb, *pcb;
+  struct tcp_hdr* tcphdr;
+  struct pbuf* p;
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  /* initialize local vars */
+  IP4_ADDR(&local_ip,  192, 168,   1, 1);
+  IP4_ADDR(&remote_ip, 192, 168,   1, 2);
+  IP4_ADDR(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  txcounters.copy_tx_packets = 1;
+
+  lpcb = tcp_new();
+  EXPECT_RET(lpcb != NULL);
+  err = tcp_bind(lpcb, &local_ip, local_port);
+  EXPECT_RET(err == ERR_OK);
+  lpcb = tcp_listen(lpcb);
+  EXPECT_RET(lpcb != NULL);
+  tcp_accept(lpcb, test_tcp_wnd_accept);
+
+  p = tcp_create_segment_opts(&remote_ip, &local_ip, remote_port, local_port, NULL, 0,
+    0x1000, 0, TCP_SYN, 0xffff, NULL, 0);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+
+  pcb = tcp_active_pcbs;
+  EXPECT_RET(pcb != NULL);
+  EXPECT(!(pcb->flags & TF_WND_SCALE));
+  EXPECT(!(pcb->flags & TF_SACK));
+  EXPECT(TCP_WND_LIMIT(pcb) <= 0xffff);
+
+  EXPECT_RET(txcounters.num_tx_calls == 1);
+  tcphdr = tcp_wnd_tx_tcphdr(&txcounters, 0);
+  EXPECT_RET(tcphdr != NULL);
+  /* options are only answered, never offered in a SYN|ACK */
+  EXPECT(tcp_wnd_find_option(tcphdr, 0x03) == NULL);
+  EXPECT(tcp_wnd_find_option(tcphdr, 0x04) == NULL);
+
+  tcp_abort(pcb);
+  tcp_wnd_reset_tx(&txcounters);
+  err = tcp_close(lpcb);
+  EXPECT(err == ERR_OK);
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 0);
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB_LISTEN].used == 0);
+}
+END_TEST
+
+/** Out-of-sequence data is reported in SACK blocks, the block containing
+ * the most recent segment first */
+START_TEST(test_tcp_sack_blocks)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  struct tcp_hdr* tcphdr;
+  struct pbuf* p;
+  u8_t* opt;
+  u32_t base;
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  LWIP_UNUSED_ARG(_i);
+
+  /* initialize local vars */
+  IP4_ADDR(&local_ip,  192, 168,   1, 1);
+  IP4_ADDR(&remote_ip, 192, 168,   1, 2);
+  IP4_ADDR(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  txcounters.copy_tx_packets = 1;
+  memset(&counters, 0, sizeof(counters));
+
+  /* create and initialize the pcb */
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, local_port, remote_port);
+  tcp_recv(pcb, test_tcp_wnd_recv);
+  pcb->flags |= TF_SACK;
+  pcb->rcv_nxt = 0x8000;
+  base = pcb->rcv_nxt;
+
+  /* [16..24) arrives, [0..16) is missing */
+  p = tcp_create_rx_segment(pcb, &rx_data[16], 8, 16, 0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT_RET(txcounters.num_tx_calls == 1);
+  tcphdr = tcp_wnd_tx_tcphdr(&txcounters, 0);
+  EXPECT_RET(tcphdr != NULL);
+  opt = tcp_wnd_find_option(tcphdr, 0x05);
+  EXPECT_RET(opt != NULL);
+  EXPECT(opt[1] == 10);
+  EXPECT(tcp_wnd_get_u32(&opt[2]) == base + 16);
+  EXPECT(tcp_wnd_get_u32(&opt[6]) == base + 24);
+  tcp_wnd_reset_tx(&txcounters);
+
+  /* [32..40) arrives, reported before the older block */
+  p = tcp_create_rx_segment(pcb, &rx_data[32], 8, 32, 0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT_RET(txcounters.num_tx_calls == 1);
+  tcphdr = tcp_wnd_tx_tcphdr(&txcounters, 0);
+  EXPECT_RET(tcphdr != NULL);
+  opt = tcp_wnd_find_option(tcphdr, 0x05);
+  EXPECT_RET(opt != NULL);
+  EXPECT_RET(opt[1] == 18);
+  EXPECT(tcp_wnd_get_u32(&opt[2]) == base + 32);
+  EXPECT(tcp_wnd_get_u32(&opt[6]) == base + 40);
+  EXPECT(tcp_wnd_get_u32(&opt[10]) == base + 16);
+  EXPECT(tcp_wnd_get_u32(&opt[14]) == base + 24);
+  tcp_wnd_reset_tx(&txcounters);
+
+  /* [24..32) fills the gap between the blocks, they are merged */
+  p = tcp_create_rx_segment(pcb, &rx_data[24], 8, 24, 0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT_RET(txcounters.num_tx_calls == 1);
+  tcphdr = tcp_wnd_tx_tcphdr(&txcounters, 0);
+  EXPECT_RET(tcphdr != NULL);
+  opt = tcp_wnd_find_option(tcphdr, 0x05);
+  EXPECT_RET(opt != NULL);
+  EXPECT(opt[1] == 10);
+  EXPECT(tcp_wnd_get_u32(&opt[2]) == base + 16);
+  EXPECT(tcp_wnd_get_u32(&opt[6]) == base + 40);
+  tcp_wnd_reset_tx(&txcounters);
+  EXPECT(counters.recv_calls == 0);
+
+  /* the missing data arrives, everything is acknowledged at once */
+  p = tcp_create_rx_segment(pcb, &rx_data[0], 16, 0, 0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->ooseq == NULL);
+  EXPECT(pcb->rcv_nxt == base + 40);
+  EXPECT(counters.recved_bytes == 40);
+  EXPECT_RET(txcounters.num_tx_calls == 1);
+  tcphdr = tcp_wnd_tx_tcphdr(&txcounters, 0);
+  EXPECT_RET(tcphdr != NULL);
+  EXPECT(tcp_wnd_find_option(tcphdr, 0x05) == NULL);
+  tcp_wnd_reset_tx(&txcounters);
+
+  /* make sure the pcb is freed */
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 1);
+  tcp_abort(pcb);
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 0);
+  tcp_wnd_reset_tx(&txcounters);
+}
+END_TEST
+
+/** Two segments are lost: the first is sent by fast retransmit, the second
+ * as soon as the SACK blocks show the hole. A partial ACK does not end fast
+ * recovery, the ACK for everything does. */
+START_TEST(test_tcp_sack_rexmit_holes)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  struct tcp_hdr* tcphdr;
+  struct pbuf* p;
+  u32_t s, blocks[4];
+  err_t err;
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  LWIP_UNUSED_ARG(_i);
+
+  /* initialize local vars */
+  IP4_ADDR(&local_ip,  192, 168,   1, 1);
+  IP4_ADDR(&remote_ip, 192, 168,   1, 2);
+  IP4_ADDR(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  txcounters.copy_tx_packets = 1;
+  memset(&counters, 0, sizeof(counters));
+
+  /* create and initialize the pcb */
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, local_port, remote_port);
+  pcb->flags |= TF_SACK | TF_NODELAY;
+  pcb->mss = TEST_SEG_LEN;
+  /* disable initial congestion window (we don't send a SYN here...) */
+  pcb->cwnd = pcb->snd_wnd;
+  s = pcb->lastack;
+
+  /* send 6 segments */
+  err = tcp_write(pcb, tx_data, sizeof(tx_data), TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT_RET(txcounters.num_tx_calls == 6);
+  tcp_wnd_reset_tx(&txcounters);
+
+  /* segments 0 and 2 are lost, 1, 3 and 4 arrive */
+  blocks[0] = s + 1 * TEST_SEG_LEN;
+  blocks[1] = s + 2 * TEST_SEG_LEN;
+  p = tcp_wnd_create_sack(pcb, s, blocks, 1);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->dupacks == 1);
+  EXPECT(pcb->unacked->next->flags & TF_SEG_SACKED);
+
+  blocks[0] = s + 3 * TEST_SEG_LEN;
+  blocks[1] = s + 4 * TEST_SEG_LEN;
+  blocks[2] = s + 1 * TEST_SEG_LEN;
+  blocks[3] = s + 2 * TEST_SEG_LEN;
+  p = tcp_wnd_create_sack(pcb, s, blocks, 2);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->dupacks == 2);
+  EXPECT_RET(txcounters.num_tx_calls == 0);
+
+  /* 3rd duplicate ACK: fast retransmit of segment 0 */
+  blocks[1] = s + 5 * TEST_SEG_LEN;
+  p = tcp_wnd_create_sack(pcb, s, blocks, 2);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->flags & TF_INFR);
+  EXPECT_RET(txcounters.num_tx_calls == 1);
+  tcphdr = tcp_wnd_tx_tcphdr(&txcounters, 0);
+  EXPECT_RET(tcphdr != NULL);
+  EXPECT(ntohl(tcphdr->seqno) == s);
+  tcp_wnd_reset_tx(&txcounters);
+
+  /* segment 5 arrives, the next dupack fills the hole at segment 2 */
+  blocks[1] = s + 6 * TEST_SEG_LEN;
+  p = tcp_wnd_create_sack(pcb, s, blocks, 2);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT_RET(txcounters.num_tx_calls == 1);
+  tcphdr = tcp_wnd_tx_tcphdr(&txcounters, 0);
+  EXPECT_RET(tcphdr != NULL);
+  EXPECT(ntohl(tcphdr->seqno) == s + 2 * TEST_SEG_LEN);
+  tcp_wnd_reset_tx(&txcounters);
+
+  /* no more holes: nothing is sent */
+  p = tcp_wnd_create_sack(pcb, s, blocks, 2);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT_RET(txcounters.num_tx_calls == 0);
+
+  /* partial ACK for the retransmitted segment 0 */
+  p = tcp_wnd_create_sack(pcb, s + 2 * TEST_SEG_LEN, blocks, 1);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->flags & TF_INFR);
+  EXPECT(pcb->lastack == s + 2 * TEST_SEG_LEN);
+  EXPECT_RET(txcounters.num_tx_calls == 0);
+
+  /* the retransmitted segment 2 arrives, everything is acknowledged */
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, s + sizeof(tx_data) - pcb->lastack, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(!(pcb->flags & TF_INFR));
+  /* deflated to ssthresh, then one step of congestion avoidance */
+  EXPECT(pcb->cwnd >= pcb->ssthresh);
+  EXPECT(pcb->cwnd <= pcb->ssthresh + pcb->mss);
+  EXPECT(pcb->unacked == NULL);
+  EXPECT(pcb->unsent == NULL);
+
+  /* make sure the pcb is freed */
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 1);
+  tcp_abort(pcb);
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 0);
+  tcp_wnd_reset_tx(&txcounters);
+}
+END_TEST
+
+/** The receive window is doubled when a whole window arrives within one
+ * round-trip time and kept when the sender is slower */
+START_TEST(test_tcp_rcv_wnd_autotune)
+{
+  struct netif netif;
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  struct pbuf* p;
+  tcpwnd_size_t wnd, sent;
+  u16_t len;
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  LWIP_UNUSED_ARG(_i);
+
+  /* initialize local vars */
+  IP4_ADDR(&local_ip,  192, 168,   1, 1);
+  IP4_ADDR(&remote_ip, 192, 168,   1, 2);
+  IP4_ADDR(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, NULL, &local_ip, &netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  /* create and initialize the pcb */
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, local_port, remote_port);
+  tcp_recv(pcb, test_tcp_wnd_recv);
+  pcb->flags |= TF_WND_SCALE;
+  pcb->rcv_scale = TCP_RCV_SCALE;
+  pcb->rcv_nxt = 0x8000;
+  /* start measuring like the handshake does */
+  pcb->rcv_tune_seq = pcb->rcv_nxt + pcb->rcv_wnd_max;
+  pcb->rcv_tune_ticks = tcp_ticks;
+  wnd = pcb->rcv_wnd_max;
+  EXPECT_RET(wnd == TCP_WND);
+
+  /* a whole window within the same tick */
+  for (sent = 0; sent < wnd; sent += len) {
+    /* keep the pattern going when the window is no multiple of 256 */
+    len = (u16_t)LWIP_MIN(sizeof(rx_data) - 0x100, wnd - sent);
+    p = tcp_create_rx_segment(pcb, &rx_data[counters.recved_bytes & 0xff], len, 0, 0, TCP_ACK);
+    EXPECT_RET(p != NULL);
+    test_tcp_input(p, &netif);
+  }
+  EXPECT(counters.recved_bytes == wnd);
+  EXPECT(pcb->rcv_wnd_max == LWIP_MIN(2 * wnd, TCP_WND_LIMIT(pcb)));
+  EXPECT(pcb->rcv_wnd == pcb->rcv_wnd_max);
+
+  /* a slow sender does not grow the window */
+  wnd = pcb->rcv_wnd_max;
+  tcp_ticks += 10;
+  for (sent = 0; sent < wnd; sent += len) {
+    /* keep the pattern going when the window is no multiple of 256 */
+    len = (u16_t)LWIP_MIN(sizeof(rx_data) - 0x100, wnd - sent);
+    p = tcp_create_rx_segment(pcb, &rx_data[counters.recved_bytes & 0xff], len, 0, 0, TCP_ACK);
+    EXPECT_RET(p != NULL);
+    test_tcp_input(p, &netif);
+  }
+  EXPECT(pcb->rcv_wnd_max == wnd);
+  EXPECT(pcb->rcv_wnd == wnd);
+
+  /* make sure the pcb is freed */
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 1);
+  tcp_abort(pcb);
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 0);
+}
+END_TEST
+
+/** The send buffer grows to two windows as the congestion window and the
+ * window of the remote host open, up to TCP_SND_BUF_MAX, and keeps its size
+ * when the congestion window closes again */
+START_TEST(test_tcp_snd_buf_autotune)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  struct pbuf* p;
+  err_t err;
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  LWIP_UNUSED_ARG(_i);
+
+  /* initialize local vars */
+  IP4_ADDR(&local_ip,  192, 168,   1, 1);
+  IP4_ADDR(&remote_ip, 192, 168,   1, 2);
+  IP4_ADDR(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  /* create and initialize the pcb */
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, local_port, remote_port);
+  pcb->flags |= TF_NODELAY;
+  pcb->mss = TCP_MSS;
+  /* the congestion window has opened further than any window below */
+  pcb->cwnd = TCP_SND_BUF_MAX;
+  EXPECT_RET(pcb->snd_buf_max == TCP_SND_BUF);
+  EXPECT_RET(tcp_sndbuf(pcb) == TCP_SND_BUF);
+
+  /* without window scaling, the buffer holds two 64K windows */
+  err = tcp_write(pcb, rx_data, sizeof(rx_data), TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT(tcp_sndbuf(pcb) == TCP_SND_BUF - sizeof(rx_data));
+  p = tcp_create_rx_segment_wnd(pcb, NULL, 0, 0, sizeof(rx_data), TCP_ACK, 0xffff);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->unacked == NULL);
+  EXPECT(pcb->snd_buf_max == 2 * 0xffff);
+  EXPECT(tcp_sndbuf(pcb) == pcb->snd_buf_max);
+
+  /* a scaled window of 1M takes the buffer to 2M */
+  pcb->flags |= TF_WND_SCALE;
+  pcb->snd_scale = 7;
+  err = tcp_write(pcb, rx_data, sizeof(rx_data), TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  p = tcp_create_rx_segment_wnd(pcb, NULL, 0, 0, sizeof(rx_data), TCP_ACK, 0x100000 >> 7);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->snd_wnd_max == 0x100000);
+  EXPECT(pcb->snd_buf_max == LWIP_MIN(0x200000, TCP_SND_BUF_MAX));
+  EXPECT(tcp_sndbuf(pcb) == pcb->snd_buf_max);
+
+  /* more than half of TCP_SND_BUF_MAX takes it to the limit */
+  err = tcp_write(pcb, rx_data, sizeof(rx_data), TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  p = tcp_create_rx_segment_wnd(pcb, NULL, 0, 0, sizeof(rx_data), TCP_ACK, 0xffff);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->snd_buf_max == TCP_SND_BUF_MAX);
+  EXPECT(tcp_sndbuf(pcb) == TCP_SND_BUF_MAX);
+
+  /* after a loss, the congestion window is small but the buffer stays */
+  pcb->cwnd = pcb->ssthresh = 2 * pcb->mss;
+  err = tcp_write(pcb, rx_data, 2 * pcb->mss, TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  p = tcp_create_rx_segment_wnd(pcb, NULL, 0, 0, 2 * pcb->mss, TCP_ACK, 0xffff);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->unacked == NULL);
+  EXPECT(pcb->snd_buf_max == TCP_SND_BUF_MAX);
+  EXPECT(tcp_sndbuf(pcb) == TCP_SND_BUF_MAX);
+
+  /* make sure the pcb is freed */
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 1);
+  tcp_abort(pcb);
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 0);
+}
+END_TEST
+
+/** A bulk transfer to a remote host with a scaled window that ACKs every
+ * other segment: slow start and the send buffer take the data in flight
+ * beyond 64K and every byte is sent once and acknowledged */
+START_TEST(test_tcp_snd_throughput)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  struct pbuf* p;
+  err_t err;
+  u32_t start, total, written, len, ack, flight, max_flight;
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  LWIP_UNUSED_ARG(_i);
+
+  /* initialize local vars */
+  IP4_ADDR(&local_ip,  192, 168,   1, 1);
+  IP4_ADDR(&remote_ip, 192, 168,   1, 2);
+  IP4_ADDR(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  /* create and initialize the pcb like the handshake does */
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, local_port, remote_port);
+  pcb->flags |= TF_WND_SCALE | TF_NODELAY;
+  pcb->snd_scale = 7;
+  pcb->mss = TCP_MSS;
+  pcb->snd_wnd = pcb->snd_wnd_max = SND_WND_SCALE(pcb, 0x4000);
+  pcb->ssthresh = LWIP_TCP_INITIAL_SSTHRESH(pcb);
+  pcb->cwnd = 2 * pcb->mss;
+
+  start = pcb->lastack;
+  total = 2 * TCP_SND_BUF_MAX;
+  written = 0;
+  max_flight = 0;
+  while (pcb->lastack - start < total) {
+    /* the application fills the send buffer */
+    while ((written < total) && (tcp_sndbuf(pcb) > 0)) {
+      len = LWIP_MIN(LWIP_MIN(sizeof(rx_data), total - written), tcp_sndbuf(pcb));
+      err = tcp_write(pcb, rx_data, (u16_t)len, TCP_WRITE_FLAG_COPY);
+      EXPECT_RET(err == ERR_OK);
+      written += len;
+    }
+    err = tcp_output(pcb);
+    EXPECT_RET(err == ERR_OK);
+    flight = pcb->snd_nxt - pcb->lastack;
+    EXPECT_RET(flight > 0);
+    EXPECT(flight <= pcb->snd_wnd);
+    max_flight = LWIP_MAX(max_flight, flight);
+
+    /* the remote host ACKs every other segment of the flight */
+    for (ack = 0; ack < flight; ) {
+      len = LWIP_MIN(2 * pcb->mss, flight - ack);
+      p = tcp_create_rx_segment_wnd(pcb, NULL, 0, 0, len, TCP_ACK, 0x4000);
+      EXPECT_RET(p != NULL);
+      test_tcp_input(p, &netif);
+      ack += len;
+    }
+  }
+  EXPECT(written == total);
+  EXPECT(pcb->lastack - start == total);
+  EXPECT(pcb->unacked == NULL);
+  EXPECT(pcb->unsent == NULL);
+  EXPECT(pcb->nrtx == 0);
+  /* every byte was sent once, with headers of 40 bytes plus options */
+  EXPECT(txcounters.num_tx_bytes >= total + (total / pcb->mss) * 40);
+  EXPECT(txcounters.num_tx_bytes < total + (total / pcb->mss + 1) * 60);
+  /* more than a window without scaling was in flight */
+  EXPECT(max_flight > 0x10000);
+  EXPECT(pcb->snd_buf_max > 2 * 0xffff);
+  EXPECT(tcp_sndbuf(pcb) == pcb->snd_buf_max);
+
+  /* make sure the pcb is freed */
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 1);
+  tcp_abort(pcb);
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 0);
+}
+END_TEST
+
+/** More than 64K of out-of-sequence data is passed to the application in
+ * pieces that fit into a pbuf */
+START_TEST(test_tcp_recv_ooseq_64k)
+{
+#if (TCP_WND_MAX >= 0x20000) && !TCP_OOSEQ_MAX_BYTES && !TCP_OOSEQ_MAX_PBUFS && (PBUF_POOL_SIZE * PBUF_POOL_BUFSIZE > 0x18000)
+  struct netif netif;
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  struct pbuf* p;
+  u32_t i;
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+
+  /* initialize local vars */
+  IP4_ADDR(&local_ip,  192, 168,   1, 1);
+  IP4_ADDR(&remote_ip, 192, 168,   1, 2);
+  IP4_ADDR(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, NULL, &local_ip, &netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  /* create and initialize the pcb */
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, local_port, remote_port);
+  tcp_recv(pcb, test_tcp_wnd_recv);
+  pcb->flags |= TF_WND_SCALE;
+  pcb->rcv_scale = TCP_RCV_SCALE;
+  pcb->rcv_nxt = 0x8000;
+  pcb->rcv_wnd = pcb->rcv_wnd_max = pcb->rcv_ann_wnd = 0x20000;
+  pcb->rcv_tune_seq = pcb->rcv_nxt + pcb->rcv_wnd_max;
+
+  /* 4 segments of 16K arrive with the first one missing */
+  for (i = 1; i < 5; i++) {
+    p = tcp_create_rx_segment(pcb, rx_data, sizeof(rx_data), i * sizeof(rx_data), 0, TCP_ACK);
+    EXPECT_RET(p != NULL);
+    test_tcp_input(p, &netif);
+    EXPECT(counters.recv_calls == 0);
+  }
+
+  /* the missing segment makes 80K available at once */
+  p = tcp_create_rx_segment(pcb, rx_data, sizeof(rx_data), 0, 0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->ooseq == NULL);
+  EXPECT(counters.recved_bytes == 5 * sizeof(rx_data));
+  EXPECT(counters.recv_calls >= 2);
+
+  /* make sure the pcb is freed */
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 1);
+  tcp_abort(pcb);
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 0);
+#endif /* (TCP_WND_MAX >= 0x20000) && !TCP_OOSEQ_MAX_BYTES && !TCP_OOSEQ_MAX_PBUFS && ... */
+  LWIP_UNUSED_ARG(_i);
+}
+END_TEST
+
+
+/** Create the suite including all tests for this module */
+Suite *
+tcp_wnd_suite(void)
+{
+  TFun tests[] = {
+    test_tcp_wnd_scale_passive_open,
+    test_tcp_wnd_scale_not_offered,
+    test_tcp_sack_blocks,
+    test_tcp_sack_rexmit_holes,
+    test_tcp_rcv_wnd_autotune,
+    test_tcp_snd_buf_autotune,
+    test_tcp_snd_throughput,
+    test_tcp_recv_ooseq_64k
+  };
+  return create_suite("TCP_WND", tests, sizeof(tests)/sizeof(TFun), tcp_wnd_setup, tcp_wnd_teardown);
+}
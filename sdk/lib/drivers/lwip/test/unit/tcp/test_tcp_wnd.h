@@ -0,0 +1,8 @@
+#ifndef __TEST_TCP_WND_H__
+#define __TEST_TCP_WND_H__
+
+#include "../lwip_check.h"
+
+Suite *tcp_wnd_suite(void);
+
+#endif
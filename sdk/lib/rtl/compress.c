@@ -270,6 +270,888 @@ RtlpWorkSpaceSizeLZNT1(USHORT Engine,
 }
 
 
+/* XPRESS and XPRESS Huffman, as described in [MS-XCA] */
+
+#define XPRESS_MIN_MATCH        3
+#define XPRESS_MAX_OFFSET       8192
+#define XPRESS_HUFF_MAX_OFFSET  65535
+#define XPRESS_HUFF_BLOCK_SIZE  65536
+#define XPRESS_HUFF_SYMBOLS     512
+#define XPRESS_HUFF_MAX_BITS    15
+#define XPRESS_HUFF_TABLE_BITS  12
+#define XPRESS_HASH_BITS        13
+#define XPRESS_HASH_SIZE        (1 << XPRESS_HASH_BITS)
+#define XPRESS_NO_POSITION      0xFFFFFFFF
+#define XPRESS_MAX_DEPTH        16
+
+#define TAG_XPRESS              'pXtR'
+
+/* Match finder state, laid out at the start of the compression workspace */
+typedef struct _XPRESS_MATCHER
+{
+    PULONG Head;
+    PULONG Chain;           /* NULL for the standard engine */
+    ULONG ChainMask;
+    ULONG MaxOffset;
+} XPRESS_MATCHER, *PXPRESS_MATCHER;
+
+/* Scratch space for building one block's Huffman code */
+typedef struct _XPRESS_HUFF_ENCODER
+{
+    ULONG Tokens[XPRESS_HUFF_BLOCK_SIZE + 1];
+    ULONG Frequency[XPRESS_HUFF_SYMBOLS];
+    USHORT Code[XPRESS_HUFF_SYMBOLS];
+    UCHAR Length[XPRESS_HUFF_SYMBOLS];
+    ULONG Weight[2 * XPRESS_HUFF_SYMBOLS];
+    USHORT Parent[2 * XPRESS_HUFF_SYMBOLS];
+    USHORT Heap[XPRESS_HUFF_SYMBOLS];
+    USHORT Leaf[XPRESS_HUFF_SYMBOLS];
+} XPRESS_HUFF_ENCODER, *PXPRESS_HUFF_ENCODER;
+
+/* Decoding tables for one block, kept in the fragment workspace */
+typedef struct _XPRESS_HUFF_DECODER
+{
+    USHORT Table[1 << XPRESS_HUFF_TABLE_BITS];    /* Symbol << 4 | length, 0 for long codes */
+    USHORT Sorted[XPRESS_HUFF_SYMBOLS];
+    ULONG FirstCode[XPRESS_HUFF_MAX_BITS + 1];
+    ULONG Count[XPRESS_HUFF_MAX_BITS + 1];
+    ULONG Index[XPRESS_HUFF_MAX_BITS + 1];
+} XPRESS_HUFF_DECODER, *PXPRESS_HUFF_DECODER;
+
+/* 16-bit words of the Huffman bit stream, interleaved with extra length bytes */
+typedef struct _XPRESS_BIT_WRITER
+{
+    ULONG Bits;
+    ULONG BitCount;
+    PUCHAR NextBits;
+    PUCHAR NextBits2;
+    PUCHAR NextByte;
+} XPRESS_BIT_WRITER, *PXPRESS_BIT_WRITER;
+
+#define XPRESS_HASH(p) \
+    ((((ULONG)(p)[0] | ((ULONG)(p)[1] << 8) | ((ULONG)(p)[2] << 16)) * 2654435761U) >> (32 - XPRESS_HASH_BITS))
+
+static ULONG
+RtlpXpressWorkSpaceSize(USHORT Format, USHORT Engine)
+{
+    ULONG Size = sizeof(XPRESS_MATCHER) + XPRESS_HASH_SIZE * sizeof(ULONG);
+
+    if (Format == COMPRESSION_FORMAT_XPRESS_HUFF)
+    {
+        Size += sizeof(XPRESS_HUFF_ENCODER);
+        if (Engine == COMPRESSION_ENGINE_MAXIMUM)
+            Size += (XPRESS_HUFF_MAX_OFFSET + 1) * sizeof(ULONG);
+    }
+    else if (Engine == COMPRESSION_ENGINE_MAXIMUM)
+    {
+        Size += XPRESS_MAX_OFFSET * sizeof(ULONG);
+    }
+
+    return Size;
+}
+
+static PXPRESS_MATCHER
+RtlpXpressInitMatcher(PUCHAR WorkSpace, USHORT Engine, ULONG MaxOffset, ULONG ChainSize)
+{
+    PXPRESS_MATCHER Matcher = (PXPRESS_MATCHER)WorkSpace;
+
+    Matcher->Head = (PULONG)(Matcher + 1);
+    Matcher->Chain = NULL;
+    Matcher->ChainMask = ChainSize - 1;
+    Matcher->MaxOffset = MaxOffset;
+
+    if (Engine == COMPRESSION_ENGINE_MAXIMUM)
+        Matcher->Chain = Matcher->Head + XPRESS_HASH_SIZE;
+
+    RtlFillMemory(Matcher->Head, XPRESS_HASH_SIZE * sizeof(ULONG), 0xFF);
+    return Matcher;
+}
+
+/* Position right after the last hash chain or table entry */
+static PUCHAR
+RtlpXpressMatcherEnd(PXPRESS_MATCHER Matcher)
+{
+    if (Matcher->Chain)
+        return (PUCHAR)(Matcher->Chain + Matcher->ChainMask + 1);
+
+    return (PUCHAR)(Matcher->Head + XPRESS_HASH_SIZE);
+}
+
+/* find the longest match for src[pos] and make pos the newest hash entry */
+static ULONG
+RtlpXpressFindMatch(PXPRESS_MATCHER Matcher, PUCHAR Src, ULONG Pos, ULONG MaxLength, PULONG Offset)
+{
+    ULONG Hash, Candidate, Length, Best = 0, Depth;
+    PUCHAR Scan = Src + Pos;
+
+    if (MaxLength < XPRESS_MIN_MATCH)
+        return 0;
+
+    Hash = XPRESS_HASH(Scan);
+    Candidate = Matcher->Head[Hash];
+    Matcher->Head[Hash] = Pos;
+
+    if (!Matcher->Chain)
+    {
+        /* standard engine: only look at the newest position with this hash */
+        if (Candidate == XPRESS_NO_POSITION || Pos - Candidate > Matcher->MaxOffset)
+            return 0;
+
+        for (Length = 0; Length < MaxLength && Src[Candidate + Length] == Scan[Length]; Length++);
+
+        if (Length < XPRESS_MIN_MATCH)
+            return 0;
+
+        *Offset = Pos - Candidate;
+        return Length;
+    }
+
+    Matcher->Chain[Pos & Matcher->ChainMask] = Candidate;
+
+    for (Depth = XPRESS_MAX_DEPTH;
+         Depth > 0 && Candidate != XPRESS_NO_POSITION && Pos - Candidate <= Matcher->MaxOffset;
+         Depth--)
+    {
+        if (Src[Candidate + Best] == Scan[Best])
+        {
+            for (Length = 0; Length < MaxLength && Src[Candidate + Length] == Scan[Length]; Length++);
+
+            if (Length > Best)
+            {
+                Best = Length;
+                *Offset = Pos - Candidate;
+                if (Best == MaxLength)
+                    break;
+            }
+        }
+
+        Length = Matcher->Chain[Candidate & Matcher->ChainMask];
+        if (Length >= Candidate)
+            break;
+        Candidate = Length;
+    }
+
+    return (Best >= XPRESS_MIN_MATCH) ? Best : 0;
+}
+
+/* add the positions covered by a match to the hash chains */
+static VOID
+RtlpXpressSkipMatch(PXPRESS_MATCHER Matcher, PUCHAR Src, ULONG Pos, ULONG Length, ULONG End)
+{
+    ULONG Hash;
+
+    if (!Matcher->Chain)
+        return;
+
+    for (Pos++, Length--; Length > 0 && Pos + XPRESS_MIN_MATCH <= End; Pos++, Length--)
+    {
+        Hash = XPRESS_HASH(Src + Pos);
+        Matcher->Chain[Pos & Matcher->ChainMask] = Matcher->Head[Hash];
+        Matcher->Head[Hash] = Pos;
+    }
+}
+
+static NTSTATUS
+RtlpCompressBufferXpress(UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst_size,
+                         ULONG *final_size, USHORT engine, UCHAR *workspace)
+{
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size;
+    UCHAR *flags_pos, *nibble_pos = NULL;
+    ULONG flags = 0, flag_count = 0;
+    ULONG pos = 0, length, offset, token;
+    PXPRESS_MATCHER matcher;
+
+    matcher = RtlpXpressInitMatcher(workspace, engine, XPRESS_MAX_OFFSET, XPRESS_MAX_OFFSET);
+
+    if (dst_size < sizeof(ULONG))
+        return STATUS_BUFFER_TOO_SMALL;
+    flags_pos = dst_cur;
+    dst_cur += sizeof(ULONG);
+
+    while (pos < src_size)
+    {
+        /* a literal or match needs at most 10 bytes plus the next flags */
+        if ((ULONG)(dst_end - dst_cur) < 10 + sizeof(ULONG))
+            return STATUS_BUFFER_TOO_SMALL;
+
+        if (flag_count == 32)
+        {
+            *(ULONG UNALIGNED *)flags_pos = flags;
+            flags_pos = dst_cur;
+            dst_cur += sizeof(ULONG);
+            flag_count = 0;
+        }
+
+        length = 0;
+        if (src_size - pos >= XPRESS_MIN_MATCH)
+            length = RtlpXpressFindMatch(matcher, src, pos, src_size - pos, &offset);
+
+        flag_count++;
+        if (!length)
+        {
+            flags <<= 1;
+            *dst_cur++ = src[pos++];
+            continue;
+        }
+
+        flags = (flags << 1) | 1;
+        RtlpXpressSkipMatch(matcher, src, pos, length, src_size);
+        pos += length;
+
+        length -= XPRESS_MIN_MATCH;
+        token = (offset - 1) << 3;
+        if (length < 7)
+        {
+            *(USHORT UNALIGNED *)dst_cur = (USHORT)(token | length);
+            dst_cur += sizeof(USHORT);
+            continue;
+        }
+
+        *(USHORT UNALIGNED *)dst_cur = (USHORT)(token | 7);
+        dst_cur += sizeof(USHORT);
+
+        /* lengths of 10 and more share a byte of nibbles with the next such match */
+        token = min(length - 7, 15);
+        if (!nibble_pos)
+        {
+            nibble_pos = dst_cur;
+            *dst_cur++ = (UCHAR)token;
+        }
+        else
+        {
+            *nibble_pos |= (UCHAR)(token << 4);
+            nibble_pos = NULL;
+        }
+
+        if (token < 15)
+            continue;
+
+        if (length - 7 - 15 < 255)
+        {
+            *dst_cur++ = (UCHAR)(length - 7 - 15);
+        }
+        else if (length < 0x10000)
+        {
+            *dst_cur++ = 255;
+            *(USHORT UNALIGNED *)dst_cur = (USHORT)length;
+            dst_cur += sizeof(USHORT);
+        }
+        else
+        {
+            *dst_cur++ = 255;
+            *(USHORT UNALIGNED *)dst_cur = 0;
+            dst_cur += sizeof(USHORT);
+            *(ULONG UNALIGNED *)dst_cur = length;
+            dst_cur += sizeof(ULONG);
+        }
+    }
+
+    /* unused flags are set, so the decoder finds a match at the end of input */
+    if (flag_count == 32)
+    {
+        *(ULONG UNALIGNED *)flags_pos = flags;
+        if ((ULONG)(dst_end - dst_cur) < sizeof(ULONG))
+            return STATUS_BUFFER_TOO_SMALL;
+        flags_pos = dst_cur;
+        dst_cur += sizeof(ULONG);
+        flag_count = 0;
+    }
+
+    if (flag_count)
+        *(ULONG UNALIGNED *)flags_pos = (flags << (32 - flag_count)) | ((1U << (32 - flag_count)) - 1);
+    else
+        *(ULONG UNALIGNED *)flags_pos = 0xFFFFFFFF;
+
+    if (final_size)
+        *final_size = dst_cur - dst;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+RtlpDecompressBufferXpress(UCHAR *dst, ULONG dst_size, UCHAR *src, ULONG src_size,
+                           ULONG *final_size)
+{
+    UCHAR *src_cur = src, *src_end = src + src_size;
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size;
+    UCHAR *nibble_pos = NULL;
+    ULONG flags = 0, flag_count = 0;
+    ULONG length, offset;
+
+    while (dst_cur < dst_end)
+    {
+        if (!flag_count)
+        {
+            if (src_cur == src_end)
+                break;
+            if ((ULONG)(src_end - src_cur) < sizeof(ULONG))
+                return STATUS_BAD_COMPRESSION_BUFFER;
+            flags = *(ULONG UNALIGNED *)src_cur;
+            src_cur += sizeof(ULONG);
+            flag_count = 32;
+        }
+        flag_count--;
+
+        if (!(flags & (1U << flag_count)))
+        {
+            if (src_cur == src_end)
+                return STATUS_BAD_COMPRESSION_BUFFER;
+            *dst_cur++ = *src_cur++;
+            continue;
+        }
+
+        /* a match flag at the end of input terminates the stream */
+        if (src_cur == src_end)
+            break;
+        if ((ULONG)(src_end - src_cur) < sizeof(USHORT))
+            return STATUS_BAD_COMPRESSION_BUFFER;
+
+        length = *(USHORT UNALIGNED *)src_cur;
+        src_cur += sizeof(USHORT);
+        offset = (length >> 3) + 1;
+        length &= 7;
+
+        if (length == 7)
+        {
+            if (!nibble_pos)
+            {
+                if (src_cur == src_end)
+                    return STATUS_BAD_COMPRESSION_BUFFER;
+                nibble_pos = src_cur++;
+                length = *nibble_pos & 0xF;
+            }
+            else
+            {
+                length = *nibble_pos >> 4;
+                nibble_pos = NULL;
+            }
+
+            if (length == 15)
+            {
+                if (src_cur == src_end)
+                    return STATUS_BAD_COMPRESSION_BUFFER;
+                length = *src_cur++;
+                if (length == 255)
+                {
+                    if ((ULONG)(src_end - src_cur) < sizeof(USHORT))
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+                    length = *(USHORT UNALIGNED *)src_cur;
+                    src_cur += sizeof(USHORT);
+                    if (!length)
+                    {
+                        if ((ULONG)(src_end - src_cur) < sizeof(ULONG))
+                            return STATUS_BAD_COMPRESSION_BUFFER;
+                        length = *(ULONG UNALIGNED *)src_cur;
+                        src_cur += sizeof(ULONG);
+                    }
+                    if (length < 15 + 7)
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+                    length -= 15 + 7;
+                }
+                length += 15;
+            }
+            length += 7;
+        }
+        length += XPRESS_MIN_MATCH;
+
+        if (offset > (ULONG)(dst_cur - dst))
+            return STATUS_BAD_COMPRESSION_BUFFER;
+
+        /* partial decompression is no error */
+        length = min(length, (ULONG)(dst_end - dst_cur));
+        if (offset >= length)
+        {
+            memcpy(dst_cur, dst_cur - offset, length);
+            dst_cur += length;
+        }
+        else
+        {
+            while (length--)
+            {
+                *dst_cur = *(dst_cur - offset);
+                dst_cur++;
+            }
+        }
+    }
+
+    if (final_size)
+        *final_size = dst_cur - dst;
+
+    return STATUS_SUCCESS;
+}
+
+static VOID
+RtlpXpressHuffHeapDown(PXPRESS_HUFF_ENCODER Encoder, ULONG Count, ULONG Index)
+{
+    PUSHORT Heap = Encoder->Heap;
+    USHORT Node = Heap[Index];
+    ULONG Child;
+
+    while ((Child = 2 * Index + 1) < Count)
+    {
+        if (Child + 1 < Count && Encoder->Weight[Heap[Child + 1]] < Encoder->Weight[Heap[Child]])
+            Child++;
+        if (Encoder->Weight[Node] <= Encoder->Weight[Heap[Child]])
+            break;
+        Heap[Index] = Heap[Child];
+        Index = Child;
+    }
+    Heap[Index] = Node;
+}
+
+/* build code lengths of at most 15 bits, flattening the frequencies until they fit */
+static VOID
+RtlpXpressHuffBuildLengths(PXPRESS_HUFF_ENCODER Encoder)
+{
+    ULONG Symbol, Leaves, Count, Next, Node, MaxLength, Shift = 0, Weight;
+    UCHAR Depth[2 * XPRESS_HUFF_SYMBOLS];
+
+    for (;;)
+    {
+        Leaves = 0;
+        for (Symbol = 0; Symbol < XPRESS_HUFF_SYMBOLS; Symbol++)
+        {
+            Encoder->Length[Symbol] = 0;
+            if (!Encoder->Frequency[Symbol])
+                continue;
+
+            Weight = Encoder->Frequency[Symbol] >> Shift;
+            Encoder->Weight[Leaves] = Weight ? Weight : 1;
+            Encoder->Leaf[Leaves] = (USHORT)Symbol;
+            Encoder->Heap[Leaves] = (USHORT)Leaves;
+            Leaves++;
+        }
+
+        /* the caller makes sure at least two symbols are used */
+        Count = Leaves;
+        for (Node = Count / 2; Node-- > 0;)
+            RtlpXpressHuffHeapDown(Encoder, Count, Node);
+
+        for (Next = Leaves; Count > 1; Next++)
+        {
+            Node = Encoder->Heap[0];
+            Encoder->Heap[0] = Encoder->Heap[--Count];
+            RtlpXpressHuffHeapDown(Encoder, Count, 0);
+
+            Encoder->Weight[Next] = Encoder->Weight[Node] + Encoder->Weight[Encoder->Heap[0]];
+            Encoder->Parent[Node] = (USHORT)Next;
+            Encoder->Parent[Encoder->Heap[0]] = (USHORT)Next;
+            Encoder->Heap[0] = (USHORT)Next;
+            RtlpXpressHuffHeapDown(Encoder, Count, 0);
+        }
+
+        /* parents always come after their children */
+        MaxLength = 0;
+        Depth[Next - 1] = 0;
+        for (Node = Next - 1; Node-- > 0;)
+        {
+            Depth[Node] = Depth[Encoder->Parent[Node]] + 1;
+            if (Node < Leaves && Depth[Node] > MaxLength)
+                MaxLength = Depth[Node];
+        }
+
+        if (MaxLength <= XPRESS_HUFF_MAX_BITS)
+            break;
+        Shift++;
+    }
+
+    for (Node = 0; Node < Leaves; Node++)
+        Encoder->Length[Encoder->Leaf[Node]] = Depth[Node];
+}
+
+/* assign canonical codes: shorter codes first, then by symbol */
+static VOID
+RtlpXpressHuffMakeCodes(PXPRESS_HUFF_ENCODER Encoder)
+{
+    ULONG Count[XPRESS_HUFF_MAX_BITS + 1] = { 0 };
+    ULONG Next[XPRESS_HUFF_MAX_BITS + 1];
+    ULONG Symbol, Length, Code = 0;
+
+    for (Symbol = 0; Symbol < XPRESS_HUFF_SYMBOLS; Symbol++)
+        Count[Encoder->Length[Symbol]]++;
+
+    Count[0] = 0;
+    for (Length = 1; Length <= XPRESS_HUFF_MAX_BITS; Length++)
+    {
+        Code = (Code + Count[Length - 1]) << 1;
+        Next[Length] = Code;
+    }
+
+    for (Symbol = 0; Symbol < XPRESS_HUFF_SYMBOLS; Symbol++)
+    {
+        Length = Encoder->Length[Symbol];
+        if (Length)
+            Encoder->Code[Symbol] = (USHORT)Next[Length]++;
+    }
+}
+
+static VOID
+RtlpXpressWriteBits(PXPRESS_BIT_WRITER Writer, ULONG Value, ULONG Count)
+{
+    Writer->Bits = (Writer->Bits << Count) | Value;
+    Writer->BitCount += Count;
+
+    if (Writer->BitCount > 16)
+    {
+        Writer->BitCount -= 16;
+        *(USHORT UNALIGNED *)Writer->NextBits = (USHORT)(Writer->Bits >> Writer->BitCount);
+        Writer->NextBits = Writer->NextBits2;
+        Writer->NextBits2 = Writer->NextByte;
+        Writer->NextByte += sizeof(USHORT);
+    }
+}
+
+static ULONG
+RtlpXpressHighBit(ULONG Value)
+{
+    ULONG Bit = 0;
+
+    while (Value >>= 1)
+        Bit++;
+
+    return Bit;
+}
+
+static NTSTATUS
+RtlpCompressBufferXpressHuff(UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst_size,
+                             ULONG *final_size, USHORT engine, UCHAR *workspace)
+{
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size;
+    ULONG pos = 0, block_end, tokens, token, length, offset, symbol, bits, used, i;
+    PXPRESS_HUFF_ENCODER encoder;
+    PXPRESS_MATCHER matcher;
+    XPRESS_BIT_WRITER writer;
+    BOOLEAN last;
+
+    matcher = RtlpXpressInitMatcher(workspace, engine, XPRESS_HUFF_MAX_OFFSET, XPRESS_HUFF_MAX_OFFSET + 1);
+    encoder = (PXPRESS_HUFF_ENCODER)RtlpXpressMatcherEnd(matcher);
+
+    do
+    {
+        /* split the block into literals and matches, which may not leave the block.
+           A full block is never the last one, the end of stream symbol needs to be
+           in a block the decoder still reads */
+        block_end = pos + min(src_size - pos, XPRESS_HUFF_BLOCK_SIZE);
+        last = (block_end - pos < XPRESS_HUFF_BLOCK_SIZE);
+
+        RtlZeroMemory(encoder->Frequency, sizeof(encoder->Frequency));
+        for (tokens = 0; pos < block_end; tokens++)
+        {
+            /* a match of 3 bytes at offset 1 would be coded as symbol 256, which
+               at the end of input can't be told apart from the end of stream */
+            length = RtlpXpressFindMatch(matcher, src, pos, block_end - pos, &offset);
+            if (!length || (length == XPRESS_MIN_MATCH && offset == 1))
+            {
+                encoder->Tokens[tokens] = src[pos];
+                encoder->Frequency[src[pos]]++;
+                pos++;
+                continue;
+            }
+
+            RtlpXpressSkipMatch(matcher, src, pos, length, src_size);
+            pos += length;
+            length -= XPRESS_MIN_MATCH;
+
+            encoder->Tokens[tokens] = (offset << 16) | length;
+            encoder->Frequency[256 + (RtlpXpressHighBit(offset) << 4) + min(length, 15)]++;
+        }
+
+        /* symbol 256 at the very end of the input marks the end of the stream */
+        if (last)
+            encoder->Frequency[256]++;
+
+        /* a code needs at least two symbols */
+        for (i = 0, used = 0; i < XPRESS_HUFF_SYMBOLS; i++)
+            used += (encoder->Frequency[i] != 0);
+        for (i = 0; used < 2; i++)
+        {
+            if (!encoder->Frequency[i])
+            {
+                encoder->Frequency[i] = 1;
+                used++;
+            }
+        }
+
+        RtlpXpressHuffBuildLengths(encoder);
+        RtlpXpressHuffMakeCodes(encoder);
+
+        if ((ULONG)(dst_end - dst_cur) < 256 + 2 * sizeof(USHORT))
+            return STATUS_BUFFER_TOO_SMALL;
+
+        for (i = 0; i < 256; i++)
+            dst_cur[i] = encoder->Length[2 * i] | (encoder->Length[2 * i + 1] << 4);
+
+        writer.Bits = 0;
+        writer.BitCount = 0;
+        writer.NextBits = dst_cur + 256;
+        writer.NextBits2 = writer.NextBits + sizeof(USHORT);
+        writer.NextByte = writer.NextBits2 + sizeof(USHORT);
+
+        for (i = 0; i < tokens; i++)
+        {
+            /* a match needs at most two words of bits and three bytes */
+            if (dst_end - writer.NextByte < 7)
+                return STATUS_BUFFER_TOO_SMALL;
+
+            token = encoder->Tokens[i];
+            if (token < 256)
+            {
+                RtlpXpressWriteBits(&writer, encoder->Code[token], encoder->Length[token]);
+                continue;
+            }
+
+            offset = token >> 16;
+            length = token & 0xFFFF;
+            bits = RtlpXpressHighBit(offset);
+            symbol = 256 + (bits << 4) + min(length, 15);
+            RtlpXpressWriteBits(&writer, encoder->Code[symbol], encoder->Length[symbol]);
+
+            if (length >= 15)
+            {
+                if (length - 15 < 255)
+                {
+                    *writer.NextByte++ = (UCHAR)(length - 15);
+                }
+                else
+                {
+                    *writer.NextByte++ = 255;
+                    *(USHORT UNALIGNED *)writer.NextByte = (USHORT)length;
+                    writer.NextByte += sizeof(USHORT);
+                }
+            }
+
+            if (bits)
+                RtlpXpressWriteBits(&writer, offset - (1 << bits), bits);
+        }
+
+        if (dst_end - writer.NextByte < 2)
+            return STATUS_BUFFER_TOO_SMALL;
+        if (last)
+            RtlpXpressWriteBits(&writer, encoder->Code[256], encoder->Length[256]);
+
+        *(USHORT UNALIGNED *)writer.NextBits = (USHORT)(writer.Bits << (16 - writer.BitCount));
+        *(USHORT UNALIGNED *)writer.NextBits2 = 0;
+        dst_cur = writer.NextByte;
+    } while (!last);
+
+    if (final_size)
+        *final_size = dst_cur - dst;
+
+    return STATUS_SUCCESS;
+}
+
+/* build the lookup tables for a block, FALSE if the code lengths are over-subscribed */
+static BOOLEAN
+RtlpXpressHuffBuildDecoder(PXPRESS_HUFF_DECODER Decoder, UCHAR *table)
+{
+    ULONG NextCode[XPRESS_HUFF_MAX_BITS + 1], NextIndex[XPRESS_HUFF_MAX_BITS + 1];
+    ULONG Symbol, Length, Code, Fill, Index;
+    UCHAR Lengths[XPRESS_HUFF_SYMBOLS];
+
+    RtlZeroMemory(Decoder->Count, sizeof(Decoder->Count));
+    for (Symbol = 0; Symbol < XPRESS_HUFF_SYMBOLS; Symbol++)
+    {
+        Lengths[Symbol] = (table[Symbol / 2] >> (4 * (Symbol & 1))) & 0xF;
+        Decoder->Count[Lengths[Symbol]]++;
+    }
+
+    Code = 0;
+    Index = 0;
+    Decoder->Count[0] = 0;
+    for (Length = 1; Length <= XPRESS_HUFF_MAX_BITS; Length++)
+    {
+        Code <<= 1;
+        Decoder->FirstCode[Length] = NextCode[Length] = Code;
+        Decoder->Index[Length] = NextIndex[Length] = Index;
+        Code += Decoder->Count[Length];
+        Index += Decoder->Count[Length];
+        if (Code > (1U << Length))
+            return FALSE;
+    }
+
+    /* codes longer than the table are left to RtlpXpressHuffDecodeLong */
+    RtlZeroMemory(Decoder->Table, sizeof(Decoder->Table));
+    for (Symbol = 0; Symbol < XPRESS_HUFF_SYMBOLS; Symbol++)
+    {
+        Length = Lengths[Symbol];
+        if (!Length)
+            continue;
+
+        Decoder->Sorted[NextIndex[Length]++] = (USHORT)Symbol;
+        Code = NextCode[Length]++;
+        if (Length > XPRESS_HUFF_TABLE_BITS)
+            continue;
+
+        Fill = 1 << (XPRESS_HUFF_TABLE_BITS - Length);
+        Code <<= XPRESS_HUFF_TABLE_BITS - Length;
+        while (Fill--)
+            Decoder->Table[Code + Fill] = (USHORT)((Symbol << 4) | Length);
+    }
+
+    return TRUE;
+}
+
+/* decode a symbol with a code longer than the lookup table, 0 if there is none */
+static ULONG
+RtlpXpressHuffDecodeLong(PXPRESS_HUFF_DECODER Decoder, ULONG NextBits)
+{
+    ULONG Length, Code;
+
+    for (Length = XPRESS_HUFF_TABLE_BITS + 1; Length <= XPRESS_HUFF_MAX_BITS; Length++)
+    {
+        Code = (NextBits >> (32 - Length)) - Decoder->FirstCode[Length];
+        if (Code < Decoder->Count[Length])
+            return (Decoder->Sorted[Decoder->Index[Length] + Code] << 4) | Length;
+    }
+
+    return 0;
+}
+
+static NTSTATUS
+RtlpDecompressBufferXpressHuff(UCHAR *dst, ULONG dst_size, UCHAR *src, ULONG src_size,
+                               ULONG *final_size, UCHAR *workspace)
+{
+    PXPRESS_HUFF_DECODER decoder = (PXPRESS_HUFF_DECODER)workspace;
+    UCHAR *src_cur = src, *src_end = src + src_size;
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size, *block_end;
+    ULONG next_bits, entry, symbol, length, offset;
+    LONG extra_bits;
+
+/* the two words read ahead may lie past the end of a truncated stream */
+#define XPRESS_REFILL() \
+    if (extra_bits < 0) \
+    { \
+        if (src_end - src_cur >= 2) \
+            next_bits |= (ULONG)*(USHORT UNALIGNED *)src_cur << -extra_bits; \
+        src_cur += 2; \
+        extra_bits += 16; \
+    }
+
+    while (dst_cur < dst_end && src_cur < src_end)
+    {
+        if ((ULONG)(src_end - src_cur) < 256 + 2 * sizeof(USHORT))
+            return STATUS_BAD_COMPRESSION_BUFFER;
+        if (!RtlpXpressHuffBuildDecoder(decoder, src_cur))
+            return STATUS_BAD_COMPRESSION_BUFFER;
+        src_cur += 256;
+
+        next_bits = ((ULONG)*(USHORT UNALIGNED *)src_cur << 16) | *(USHORT UNALIGNED *)(src_cur + 2);
+        src_cur += 2 * sizeof(USHORT);
+        extra_bits = 16;
+
+        block_end = dst_cur + min(XPRESS_HUFF_BLOCK_SIZE, (ULONG)(dst_end - dst_cur));
+        while (dst_cur < block_end)
+        {
+            entry = decoder->Table[next_bits >> (32 - XPRESS_HUFF_TABLE_BITS)];
+            if (!entry)
+            {
+                entry = RtlpXpressHuffDecodeLong(decoder, next_bits);
+                if (!entry)
+                    return STATUS_BAD_COMPRESSION_BUFFER;
+            }
+
+            next_bits <<= entry & 0xF;
+            extra_bits -= entry & 0xF;
+            XPRESS_REFILL();
+
+            symbol = entry >> 4;
+            if (symbol < 256)
+            {
+                *dst_cur++ = (UCHAR)symbol;
+                continue;
+            }
+
+            if (symbol == 256 && src_cur >= src_end)
+                goto out;
+
+            /* the read ahead words must not be past the end any more */
+            if (src_cur > src_end)
+                return STATUS_BAD_COMPRESSION_BUFFER;
+
+            symbol -= 256;
+            length = symbol & 0xF;
+            symbol >>= 4;
+
+            if (length == 15)
+            {
+                if (src_cur == src_end)
+                    return STATUS_BAD_COMPRESSION_BUFFER;
+                length = *src_cur++;
+                if (length == 255)
+                {
+                    if ((ULONG)(src_end - src_cur) < sizeof(USHORT))
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+                    length = *(USHORT UNALIGNED *)src_cur;
+                    src_cur += sizeof(USHORT);
+                    if (!length)
+                    {
+                        if ((ULONG)(src_end - src_cur) < sizeof(ULONG))
+                            return STATUS_BAD_COMPRESSION_BUFFER;
+                        length = *(ULONG UNALIGNED *)src_cur;
+                        src_cur += sizeof(ULONG);
+                    }
+                    if (length < 15)
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+                    length -= 15;
+                }
+                length += 15;
+            }
+            length += XPRESS_MIN_MATCH;
+
+            offset = 1;
+            if (symbol)
+            {
+                offset = (next_bits >> (32 - symbol)) + (1 << symbol);
+                next_bits <<= symbol;
+                extra_bits -= symbol;
+                XPRESS_REFILL();
+            }
+
+            if (offset > (ULONG)(dst_cur - dst))
+                return STATUS_BAD_COMPRESSION_BUFFER;
+
+            /* partial decompression is no error */
+            length = min(length, (ULONG)(dst_end - dst_cur));
+            if (offset >= length)
+            {
+                memcpy(dst_cur, dst_cur - offset, length);
+                dst_cur += length;
+            }
+            else
+            {
+                while (length--)
+                {
+                    *dst_cur = *(dst_cur - offset);
+                    dst_cur++;
+                }
+            }
+        }
+    }
+
+#undef XPRESS_REFILL
+
+out:
+    if (final_size)
+        *final_size = dst_cur - dst;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+RtlpWorkSpaceSizeXpress(USHORT Format,
+                        USHORT Engine,
+                        PULONG BufferAndWorkSpaceSize,
+                        PULONG FragmentWorkSpaceSize)
+{
+    if (Engine != COMPRESSION_ENGINE_STANDARD && Engine != COMPRESSION_ENGINE_MAXIMUM)
+        return STATUS_NOT_SUPPORTED;
+
+    *BufferAndWorkSpaceSize = RtlpXpressWorkSpaceSize(Format, Engine);
+    *FragmentWorkSpaceSize = (Format == COMPRESSION_FORMAT_XPRESS_HUFF) ? sizeof(XPRESS_HUFF_DECODER) : 0;
+    return STATUS_SUCCESS;
+}
+
+
 /*
  * @implemented
  */
@@ -284,7 +1166,7 @@ RtlCompressBuffer(IN USHORT CompressionFormatAndEngine,
                   IN PVOID WorkSpace)
 {
    USHORT Format = CompressionFormatAndEngine & COMPRESSION_FORMAT_MASK;
-   /* USHORT Engine = CompressionFormatAndEngine & COMPRESSION_ENGINE_MASK; */
+   USHORT Engine = CompressionFormatAndEngine & COMPRESSION_ENGINE_MASK;
 
    if ((Format == COMPRESSION_FORMAT_NONE) ||
          (Format == COMPRESSION_FORMAT_DEFAULT))
@@ -299,6 +1181,35 @@ RtlCompressBuffer(IN USHORT CompressionFormatAndEngine,
                                      FinalCompressedSize,
                                      WorkSpace));
 
+   if ((Format == COMPRESSION_FORMAT_XPRESS) ||
+         (Format == COMPRESSION_FORMAT_XPRESS_HUFF))
+   {
+      /* The workspace holds the match finder, see RtlGetCompressionWorkSpaceSize */
+      if (!WorkSpace)
+         return(STATUS_INVALID_PARAMETER);
+
+      if ((Engine != COMPRESSION_ENGINE_STANDARD) &&
+            (Engine != COMPRESSION_ENGINE_MAXIMUM))
+         return(STATUS_NOT_SUPPORTED);
+
+      if (Format == COMPRESSION_FORMAT_XPRESS)
+         return(RtlpCompressBufferXpress(UncompressedBuffer,
+                                         UncompressedBufferSize,
+                                         CompressedBuffer,
+                                         CompressedBufferSize,
+                                         FinalCompressedSize,
+                                         Engine,
+                                         WorkSpace));
+
+      return(RtlpCompressBufferXpressHuff(UncompressedBuffer,
+                                          UncompressedBufferSize,
+                                          CompressedBuffer,
+                                          CompressedBufferSize,
+                                          FinalCompressedSize,
+                                          Engine,
+                                          WorkSpace));
+   }
+
    return(STATUS_UNSUPPORTED_COMPRESSION);
 }
 
@@ -357,6 +1268,20 @@ RtlDecompressFragment(IN USHORT format,
             return lznt1_decompress(uncompressed, uncompressed_size, compressed,
                                     compressed_size, offset, final_size, workspace);
 
+        /* XPRESS streams can only be decoded from the start */
+        case COMPRESSION_FORMAT_XPRESS:
+            if (offset)
+                return STATUS_NOT_SUPPORTED;
+            return RtlpDecompressBufferXpress(uncompressed, uncompressed_size, compressed,
+                                              compressed_size, final_size);
+
+        case COMPRESSION_FORMAT_XPRESS_HUFF:
+            if (offset)
+                return STATUS_NOT_SUPPORTED;
+            if (!workspace) return STATUS_ACCESS_VIOLATION;
+            return RtlpDecompressBufferXpressHuff(uncompressed, uncompressed_size, compressed,
+                                                  compressed_size, final_size, workspace);
+
         case COMPRESSION_FORMAT_NONE:
         case COMPRESSION_FORMAT_DEFAULT:
             return STATUS_INVALID_PARAMETER;
@@ -378,8 +1303,23 @@ RtlDecompressBuffer(IN USHORT CompressionFormat,
                     IN ULONG CompressedBufferSize,
                     OUT PULONG FinalUncompressedSize)
 {
-    return RtlDecompressFragment(CompressionFormat, UncompressedBuffer, UncompressedBufferSize,
-                                 CompressedBuffer, CompressedBufferSize, 0, FinalUncompressedSize, NULL);
+    PVOID WorkSpace;
+    NTSTATUS Status;
+
+    if ((CompressionFormat & ~COMPRESSION_ENGINE_MAXIMUM) != COMPRESSION_FORMAT_XPRESS_HUFF)
+        return RtlDecompressFragment(CompressionFormat, UncompressedBuffer, UncompressedBufferSize,
+                                     CompressedBuffer, CompressedBufferSize, 0, FinalUncompressedSize, NULL);
+
+    /* Callers that decompress often should pass their own workspace to RtlDecompressFragment */
+    WorkSpace = RtlpAllocateMemory(sizeof(XPRESS_HUFF_DECODER), TAG_XPRESS);
+    if (!WorkSpace)
+        return STATUS_NO_MEMORY;
+
+    Status = RtlDecompressFragment(CompressionFormat, UncompressedBuffer, UncompressedBufferSize,
+                                   CompressedBuffer, CompressedBufferSize, 0, FinalUncompressedSize, WorkSpace);
+
+    RtlpFreeMemory(WorkSpace, TAG_XPRESS);
+    return Status;
 }
 
 /*
@@ -417,6 +1357,13 @@ RtlGetCompressionWorkSpaceSize(IN USHORT CompressionFormatAndEngine,
                                     CompressBufferAndWorkSpaceSize,
                                     CompressFragmentWorkSpaceSize));
 
+   if ((Format == COMPRESSION_FORMAT_XPRESS) ||
+         (Format == COMPRESSION_FORMAT_XPRESS_HUFF))
+      return(RtlpWorkSpaceSizeXpress(Format,
+                                     Engine,
+                                     CompressBufferAndWorkSpaceSize,
+                                     CompressFragmentWorkSpaceSize));
+
    return(STATUS_UNSUPPORTED_COMPRESSION);
 }
 
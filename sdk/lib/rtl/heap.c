@@ -1596,6 +1596,9 @@ RtlDestroyHeap(HANDLE HeapPtr) /* [in] Handle of heap */
     if (RtlpGetMode() == UserMode &&
         HeapPtr == NtCurrentPeb()->ProcessHeap) return HeapPtr;
 
+    /* Release the front end heap, its cached blocks go away with the segments */
+    RtlpDestroyLowFragHeap(Heap);
+
     /* Free up all big allocations */
     Current = Heap->VirtualAllocdBlocks.Flink;
     while (Current != &Heap->VirtualAllocdBlocks)
@@ -2017,6 +2020,16 @@ RtlAllocateHeap(IN PVOID HeapPtr,
 
     Index = AllocationSize >> HEAP_ENTRY_SHIFT;
 
+    /* Small plain blocks are served by the front end heap when it's enabled */
+    if (Heap->FrontEndHeapType == HEAP_FRONT_END_LFH &&
+        Index < HEAP_LFH_BUCKETS &&
+        EntryFlags == HEAP_ENTRY_BUSY &&
+        !(Flags & HEAP_NO_SERIALIZE))
+    {
+        InUseEntry = RtlpLowFragHeapAllocate(Heap, Flags, Size, Index);
+        if (InUseEntry) return InUseEntry + 1;
+    }
+
     /* Acquire the lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -2229,7 +2242,10 @@ BOOLEAN NTAPI RtlFreeHeap(
         /* Check this entry, fail if it's invalid */
         if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY) ||
             (((ULONG_PTR)Ptr & 0x7) != 0) ||
-            (HeapEntry->SegmentOffset >= HEAP_SEGMENTS))
+            (HeapEntry->SegmentOffset >= HEAP_SEGMENTS) ||
+            (Heap->FrontEndHeapType == HEAP_FRONT_END_LFH &&
+             HeapEntry->SmallTagIndex == HEAP_LFH_CACHED_BLOCK &&
+             !(HeapEntry->Flags & HEAP_ENTRY_EXTRA_PRESENT)))
         {
             /* This is an invalid block */
             DPRINT1("HEAP: Trying to free an invalid address %p!\n", Ptr);
@@ -2246,6 +2262,14 @@ BOOLEAN NTAPI RtlFreeHeap(
     }
     _SEH2_END;
 
+    /* Small blocks are cached by the front end heap when it's enabled */
+    if (Heap->FrontEndHeapType == HEAP_FRONT_END_LFH &&
+        !(Flags & HEAP_NO_SERIALIZE) &&
+        RtlpLowFragHeapFree(Heap, HeapEntry))
+    {
+        return TRUE;
+    }
+
     /* Lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -3040,6 +3064,10 @@ ULONG NTAPI
 RtlCompactHeap(HANDLE Heap,
 		ULONG Flags)
 {
+   /* Give blocks cached by the front end back, so they can coalesce */
+   if (Heap && !(((PHEAP)Heap)->ForceFlags & HEAP_FLAG_PAGE_ALLOCS))
+       RtlpFlushLowFragHeap((PHEAP)Heap);
+
    UNIMPLEMENTED;
    return 0;
 }
@@ -3988,6 +4016,8 @@ RtlSetHeapInformation(IN HANDLE HeapHandle OPTIONAL,
                       IN PVOID HeapInformation,
                       IN SIZE_T HeapInformationLength)
 {
+    PHEAP Heap = (PHEAP)HeapHandle;
+
     /* Setting heap information is not really supported except for enabling LFH */
     if (HeapInformationClass == HeapCompatibilityInformation)
     {
@@ -3999,13 +4029,15 @@ RtlSetHeapInformation(IN HANDLE HeapHandle OPTIONAL,
         }
 
         /* Check for a special magic value for enabling LFH */
-        if (*(PULONG)HeapInformation != 2)
+        if (*(PULONG)HeapInformation != HEAP_FRONT_END_LFH)
         {
             return STATUS_UNSUCCESSFUL;
         }
 
-        DPRINT1("RtlSetHeapInformation() needs to enable LFH\n");
-        return STATUS_SUCCESS;
+        if (!Heap)
+            return STATUS_INVALID_PARAMETER;
+
+        return RtlpActivateLowFragHeap(Heap);
     }
 
     return STATUS_SUCCESS;
@@ -55,6 +55,19 @@
 /* Segment flags */
 #define HEAP_USER_ALLOCATED    0x1
 
+/* Front end heap types, as reported by HeapCompatibilityInformation */
+#define HEAP_FRONT_END_NONE         0
+#define HEAP_FRONT_END_LOOKASIDE    1
+#define HEAP_FRONT_END_LFH          2
+
+/* Low fragmentation heap definitions */
+#define HEAP_LFH_BUCKETS            HEAP_FREELISTS
+#define HEAP_LFH_MAX_SLOTS          32
+#define HEAP_LFH_SUBSEGMENT_SIZE    0x1000
+#define HEAP_LFH_MIN_BATCH          4
+#define HEAP_LFH_MAX_BATCH          32
+#define HEAP_LFH_CACHED_BLOCK       0xCF
+
 /* A handy inline to distinguis normal heap, special "debug heap" and special "page heap" */
 FORCEINLINE BOOLEAN
 RtlpHeapIsSpecial(ULONG Flags)
@@ -278,6 +291,25 @@ typedef struct _HEAP_SEGMENT
     HEAP_SEGMENT_MEMBERS;
 } HEAP_SEGMENT, *PHEAP_SEGMENT;
 
+/* One affinity slot of the low fragmentation heap. Every size class
+   has its own lock-free list of cached blocks, and slots are padded
+   to a cache line so threads bound to different slots never share one */
+typedef struct _HEAP_LFH_AFFINITY_SLOT
+{
+    SLIST_HEADER Buckets[HEAP_LFH_BUCKETS];
+} HEAP_LFH_AFFINITY_SLOT, *PHEAP_LFH_AFFINITY_SLOT;
+
+C_ASSERT((sizeof(HEAP_LFH_AFFINITY_SLOT) % 64) == 0);
+
+typedef struct _HEAP_LFH
+{
+    PHEAP Heap;
+    SIZE_T ReserveSize;
+    ULONG SlotMask;
+    ULONG Reserved;
+    DECLSPEC_ALIGN(64) HEAP_LFH_AFFINITY_SLOT Slots[ANYSIZE_ARRAY];
+} HEAP_LFH, *PHEAP_LFH;
+
 typedef struct _HEAP_UCR_DESCRIPTOR
 {
     LIST_ENTRY ListEntry;
@@ -343,6 +375,26 @@ RtlpValidateHeapEntry(PHEAP Heap, PHEAP_ENTRY HeapEntry);
 BOOLEAN NTAPI
 RtlpValidateHeapHeaders(PHEAP Heap, BOOLEAN Recalculate);
 
+/* heaplfh.c */
+NTSTATUS NTAPI
+RtlpActivateLowFragHeap(PHEAP Heap);
+
+VOID NTAPI
+RtlpDestroyLowFragHeap(PHEAP Heap);
+
+VOID NTAPI
+RtlpFlushLowFragHeap(PHEAP Heap);
+
+PHEAP_ENTRY NTAPI
+RtlpLowFragHeapAllocate(PHEAP Heap,
+                        ULONG Flags,
+                        SIZE_T Size,
+                        SIZE_T Index);
+
+BOOLEAN NTAPI
+RtlpLowFragHeapFree(PHEAP Heap,
+                    PHEAP_ENTRY HeapEntry);
+
 /* heapdbg.c */
 HANDLE NTAPI
 RtlDebugCreateHeap(ULONG Flags,
@@ -0,0 +1,293 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS system libraries
+ * FILE:            lib/rtl/heaplfh.c
+ * PURPOSE:         RTL Low Fragmentation Heap (front end heap)
+ */
+
+/* Useful references:
+   http://illmatics.com/Understanding_the_LFH.pdf
+*/
+
+/* The low fragmentation heap sits in front of the back end allocator
+   in heap.c. Small blocks are grouped into size classes (one class per
+   heap entry granularity, the same indexing as the dedicated free lists),
+   and every class has a lock-free list of cached blocks per affinity slot.
+
+   Blocks handed out by the front end are ordinary busy back end blocks, so
+   RtlSizeHeap, RtlReAllocateHeap, heap walking and validation keep working
+   unchanged. When a slot runs out of blocks of a class, a whole batch (a
+   "subsegment" of about a page worth of blocks) is carved out of the back end
+   under a single acquisition of the heap lock. Freed blocks go back into the
+   slot of the freeing thread until the slot is full, after which they are
+   returned to the back end. */
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl.h>
+#include <heap.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/* FUNCTIONS *****************************************************************/
+
+FORCEINLINE
+PHEAP_LFH_AFFINITY_SLOT
+RtlpLowFragHeapGetSlot(PHEAP_LFH Lfh)
+{
+    ULONG_PTR ThreadId = (ULONG_PTR)NtCurrentTeb()->ClientId.UniqueThread;
+
+    /* Thread IDs are multiples of 4, spread them over the slots */
+    return &Lfh->Slots[(ThreadId >> 2) & Lfh->SlotMask];
+}
+
+FORCEINLINE
+USHORT
+RtlpLowFragHeapBatchSize(SIZE_T Index)
+{
+    SIZE_T Count = HEAP_LFH_SUBSEGMENT_SIZE / (Index << HEAP_ENTRY_SHIFT);
+
+    if (Count < HEAP_LFH_MIN_BATCH) Count = HEAP_LFH_MIN_BATCH;
+    if (Count > HEAP_LFH_MAX_BATCH) Count = HEAP_LFH_MAX_BATCH;
+
+    return (USHORT)Count;
+}
+
+NTSTATUS NTAPI
+RtlpActivateLowFragHeap(PHEAP Heap)
+{
+    PHEAP_LFH Lfh = NULL;
+    SIZE_T Size;
+    ULONG Slots, i, j;
+    NTSTATUS Status;
+
+    /* The front end is only provided for user mode heaps */
+    if (RtlpGetMode() != UserMode)
+        return STATUS_NOT_SUPPORTED;
+
+    /* It can't be used on unserialized heaps, nor on heaps doing per-block checks */
+    if ((Heap->Flags & (HEAP_NO_SERIALIZE | HEAP_TAIL_CHECKING_ENABLED | HEAP_FREE_CHECKING_ENABLED)) ||
+        (Heap->ForceFlags & HEAP_FLAG_PAGE_ALLOCS) ||
+        RtlpHeapIsSpecial(Heap->Flags))
+    {
+        DPRINT1("HEAP: LFH can't be enabled on heap %p with flags %x\n", Heap, Heap->Flags);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    /* Nothing to do if it's already there */
+    if (Heap->FrontEndHeapType == HEAP_FRONT_END_LFH)
+        return STATUS_SUCCESS;
+
+    /* One slot per processor, rounded up to a power of two */
+    for (Slots = 1; Slots < NtCurrentPeb()->NumberOfProcessors && Slots < HEAP_LFH_MAX_SLOTS; Slots <<= 1);
+
+    Size = FIELD_OFFSET(HEAP_LFH, Slots) + Slots * sizeof(HEAP_LFH_AFFINITY_SLOT);
+    Status = ZwAllocateVirtualMemory(NtCurrentProcess(),
+                                     (PVOID *)&Lfh,
+                                     0,
+                                     &Size,
+                                     MEM_RESERVE | MEM_COMMIT,
+                                     PAGE_READWRITE);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("HEAP: Failed to allocate the LFH for heap %p, Status 0x%08X\n", Heap, Status);
+        return Status;
+    }
+
+    Lfh->Heap = Heap;
+    Lfh->ReserveSize = Size;
+    Lfh->SlotMask = Slots - 1;
+
+    for (i = 0; i < Slots; i++)
+    {
+        for (j = 0; j < HEAP_LFH_BUCKETS; j++)
+            RtlInitializeSListHead(&Lfh->Slots[i].Buckets[j]);
+    }
+
+    RtlEnterHeapLock(Heap->LockVariable, TRUE);
+
+    /* Somebody could have been faster */
+    if (Heap->FrontEndHeapType == HEAP_FRONT_END_LFH)
+    {
+        RtlLeaveHeapLock(Heap->LockVariable);
+
+        Size = 0;
+        ZwFreeVirtualMemory(NtCurrentProcess(), (PVOID *)&Lfh, &Size, MEM_RELEASE);
+        return STATUS_SUCCESS;
+    }
+
+    /* Publish the front end before its type, so readers of the type always see it */
+    InterlockedExchangePointer(&Heap->FrontEndHeap, Lfh);
+    Heap->FrontEndHeapType = HEAP_FRONT_END_LFH;
+
+    RtlLeaveHeapLock(Heap->LockVariable);
+
+    DPRINT("HEAP: LFH enabled on heap %p with %lu slots\n", Heap, Slots);
+    return STATUS_SUCCESS;
+}
+
+VOID NTAPI
+RtlpDestroyLowFragHeap(PHEAP Heap)
+{
+    PVOID BaseAddress = Heap->FrontEndHeap;
+    SIZE_T Size = 0;
+
+    if (Heap->FrontEndHeapType != HEAP_FRONT_END_LFH) return;
+
+    /* Cached blocks live in the heap segments, which go away with the heap */
+    Heap->FrontEndHeapType = HEAP_FRONT_END_NONE;
+    Heap->FrontEndHeap = NULL;
+
+    ZwFreeVirtualMemory(NtCurrentProcess(), &BaseAddress, &Size, MEM_RELEASE);
+}
+
+VOID NTAPI
+RtlpFlushLowFragHeap(PHEAP Heap)
+{
+    PHEAP_LFH Lfh = (PHEAP_LFH)Heap->FrontEndHeap;
+    PSLIST_ENTRY ListEntry, NextEntry;
+    PHEAP_ENTRY HeapEntry;
+    ULONG i, j;
+
+    if (Heap->FrontEndHeapType != HEAP_FRONT_END_LFH) return;
+
+    RtlEnterHeapLock(Heap->LockVariable, TRUE);
+
+    for (i = 0; i <= Lfh->SlotMask; i++)
+    {
+        for (j = 0; j < HEAP_LFH_BUCKETS; j++)
+        {
+            ListEntry = RtlInterlockedFlushSList(&Lfh->Slots[i].Buckets[j]);
+
+            while (ListEntry)
+            {
+                NextEntry = ListEntry->Next;
+
+                /* Give the block back to the back end */
+                HeapEntry = (PHEAP_ENTRY)ListEntry - 1;
+                HeapEntry->SmallTagIndex = 0;
+                RtlFreeHeap(Heap, HEAP_NO_SERIALIZE, ListEntry);
+
+                ListEntry = NextEntry;
+            }
+        }
+    }
+
+    RtlLeaveHeapLock(Heap->LockVariable);
+}
+
+static
+PHEAP_ENTRY
+RtlpLowFragHeapRefill(PHEAP Heap,
+                      PSLIST_HEADER Bucket,
+                      ULONG Flags,
+                      SIZE_T Size,
+                      SIZE_T Index)
+{
+    PHEAP_ENTRY FirstEntry = NULL, HeapEntry;
+    USHORT Count, i;
+    PVOID Ptr;
+
+    /* Allocations below are done with the lock held, and must not raise */
+    Flags &= ~(HEAP_GENERATE_EXCEPTIONS | HEAP_ZERO_MEMORY);
+    Flags |= HEAP_NO_SERIALIZE;
+
+    Count = RtlpLowFragHeapBatchSize(Index);
+
+    RtlEnterHeapLock(Heap->LockVariable, TRUE);
+
+    /* Carve a batch of blocks of this class. They come out of the same free
+       block of the back end most of the time, so they are also adjacent */
+    for (i = 0; i < Count; i++)
+    {
+        Ptr = RtlAllocateHeap(Heap, Flags, Size);
+        if (!Ptr) break;
+
+        HeapEntry = (PHEAP_ENTRY)Ptr - 1;
+
+        if (!FirstEntry)
+        {
+            /* The first one goes to the caller */
+            FirstEntry = HeapEntry;
+        }
+        else
+        {
+            HeapEntry->SmallTagIndex = HEAP_LFH_CACHED_BLOCK;
+            RtlInterlockedPushEntrySList(Bucket, (PSLIST_ENTRY)Ptr);
+        }
+    }
+
+    RtlLeaveHeapLock(Heap->LockVariable);
+
+    return FirstEntry;
+}
+
+PHEAP_ENTRY NTAPI
+RtlpLowFragHeapAllocate(PHEAP Heap,
+                        ULONG Flags,
+                        SIZE_T Size,
+                        SIZE_T Index)
+{
+    PHEAP_LFH Lfh = (PHEAP_LFH)Heap->FrontEndHeap;
+    PSLIST_HEADER Bucket;
+    PSLIST_ENTRY ListEntry;
+    PHEAP_ENTRY HeapEntry;
+
+    ASSERT(Index < HEAP_LFH_BUCKETS);
+
+    Bucket = &RtlpLowFragHeapGetSlot(Lfh)->Buckets[Index];
+
+    /* Fast path: take a cached block without touching the heap lock */
+    ListEntry = RtlInterlockedPopEntrySList(Bucket);
+    if (ListEntry)
+    {
+        HeapEntry = (PHEAP_ENTRY)ListEntry - 1;
+        ASSERT(HeapEntry->SmallTagIndex == HEAP_LFH_CACHED_BLOCK);
+        HeapEntry->SmallTagIndex = 0;
+    }
+    else
+    {
+        /* Slot is empty for this class, get a new batch from the back end */
+        HeapEntry = RtlpLowFragHeapRefill(Heap, Bucket, Flags, Size, Index);
+        if (!HeapEntry) return NULL;
+    }
+
+    /* Size class may be shared by several request sizes */
+    HeapEntry->UnusedBytes = (UCHAR)((HeapEntry->Size << HEAP_ENTRY_SHIFT) - Size);
+
+    if (Flags & HEAP_ZERO_MEMORY)
+        RtlZeroMemory(HeapEntry + 1, Size);
+
+    return HeapEntry;
+}
+
+BOOLEAN NTAPI
+RtlpLowFragHeapFree(PHEAP Heap,
+                    PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_LFH Lfh = (PHEAP_LFH)Heap->FrontEndHeap;
+    PSLIST_HEADER Bucket;
+    SIZE_T Index = HeapEntry->Size;
+
+    /* Only plain small blocks are cached */
+    if (Index >= HEAP_LFH_BUCKETS ||
+        HeapEntry->SmallTagIndex != 0 ||
+        (HeapEntry->Flags & ~(HEAP_ENTRY_BUSY | HEAP_ENTRY_LAST_ENTRY)))
+    {
+        return FALSE;
+    }
+
+    Bucket = &RtlpLowFragHeapGetSlot(Lfh)->Buckets[Index];
+
+    /* Let the back end have it if this slot holds enough of the class already */
+    if (RtlQueryDepthSList(Bucket) >= 2 * RtlpLowFragHeapBatchSize(Index))
+        return FALSE;
+
+    HeapEntry->SmallTagIndex = HEAP_LFH_CACHED_BLOCK;
+    RtlInterlockedPushEntrySList(Bucket, (PSLIST_ENTRY)(HeapEntry + 1));
+
+    return TRUE;
+}
+
+/* EOF */
@@ -0,0 +1,274 @@
+/*
+ * PROJECT:     ReactOS Runtime Library
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Host round trip and throughput test for the RTL compression codecs
+ *
+ * The compression API of cabiext is a thin layer over RtlCompressBuffer and
+ * RtlDecompressFragment, so this exercises its codecs without a Windows
+ * target:
+ *
+ *   compress_test             round trips, [MS-XCA] examples, corrupt input
+ *   compress_test -b [file]   throughput on a file, or a generated corpus
+ */
+
+#include "rtl.h"
+
+#include <stdio.h>
+#include <time.h>
+
+static const USHORT Formats[] =
+{
+    COMPRESSION_FORMAT_LZNT1,
+    COMPRESSION_FORMAT_XPRESS,
+    COMPRESSION_FORMAT_XPRESS | COMPRESSION_ENGINE_MAXIMUM,
+    COMPRESSION_FORMAT_XPRESS_HUFF,
+    COMPRESSION_FORMAT_XPRESS_HUFF | COMPRESSION_ENGINE_MAXIMUM,
+};
+
+#define FORMAT_COUNT (sizeof(Formats) / sizeof(Formats[0]))
+
+/* [MS-XCA] 3.1 and 3.2 */
+static const UCHAR Alphabet[] =
+{
+    0x3f, 0x00, 0x00, 0x00, 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l',
+    'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z'
+};
+
+static const UCHAR Abc[] =
+{
+    0xff, 0xff, 0xff, 0x1f, 0x61, 0x62, 0x63, 0x17, 0x00, 0x0f, 0xff, 0x26, 0x01
+};
+
+static int Failures;
+
+#define CHECK(cond, ...) \
+    do \
+    { \
+        if (!(cond)) \
+        { \
+            printf(__VA_ARGS__); \
+            Failures++; \
+        } \
+    } while (0)
+
+static ULONG Random(void)
+{
+    static ULONG Seed = 12345;
+
+    Seed = Seed * 1103515245 + 12345;
+    return Seed >> 8;
+}
+
+static void Fill(PUCHAR Buffer, ULONG Size, ULONG Kind)
+{
+    ULONG i;
+
+    for (i = 0; i < Size; i++)
+    {
+        switch (Kind)
+        {
+            case 0:
+                Buffer[i] = (UCHAR)Random();
+                break;
+            case 1:
+                Buffer[i] = Random() % 3;
+                break;
+            case 2:
+                Buffer[i] = (i % 97) < 50 ? 'a' : (UCHAR)Random();
+                break;
+            default:
+                Buffer[i] = i > 100 ? Buffer[i - 1 - Random() % 100] : Random() % 4;
+                break;
+        }
+    }
+}
+
+static void TestExamples(void)
+{
+    UCHAR Output[512], Expected[300];
+    ULONG Size, i;
+    NTSTATUS Status;
+
+    Status = RtlDecompressBuffer(COMPRESSION_FORMAT_XPRESS, Output, sizeof(Output),
+                                 (PUCHAR)Alphabet, sizeof(Alphabet), &Size);
+    CHECK(Status == STATUS_SUCCESS && Size == 26 && !memcmp(Output, "abcdefghijklmnopqrstuvwxyz", 26),
+          "MS-XCA 3.1: status 0x%x, size %u\n", Status, Size);
+
+    for (i = 0; i < sizeof(Expected); i++)
+        Expected[i] = "abc"[i % 3];
+    Status = RtlDecompressBuffer(COMPRESSION_FORMAT_XPRESS, Output, sizeof(Output),
+                                 (PUCHAR)Abc, sizeof(Abc), &Size);
+    CHECK(Status == STATUS_SUCCESS && Size == sizeof(Expected) && !memcmp(Output, Expected, Size),
+          "MS-XCA 3.2: status 0x%x, size %u\n", Status, Size);
+}
+
+static void TestRoundTrip(ULONG Iterations)
+{
+    static UCHAR Input[300000], Compressed[400000], Output[300000 + 16];
+    ULONG Iteration, Size, Kind, Capacity, WorkSize, FragmentWorkSize, CompressedSize, OutputSize, Cut;
+    PVOID WorkSpace, FragmentWorkSpace;
+    USHORT Format;
+    NTSTATUS Status;
+
+    for (Iteration = 0; Iteration < Iterations; Iteration++)
+    {
+        Format = Formats[Iteration % FORMAT_COUNT];
+        Size = Random() % (Iteration % 50 == 0 ? sizeof(Input) : 5000);
+        Kind = Random() % 4;
+        Fill(Input, Size, Kind);
+
+        RtlGetCompressionWorkSpaceSize(Format, &WorkSize, &FragmentWorkSize);
+        WorkSpace = malloc(WorkSize);
+        FragmentWorkSpace = malloc(FragmentWorkSize ? FragmentWorkSize : 1);
+
+        /* A third of the buffers are too small on purpose */
+        Capacity = Random() % 3 == 0 ? Size / 2 + 10 : sizeof(Compressed);
+        Status = RtlCompressBuffer(Format, Input, Size, Compressed, Capacity, 4096,
+                                   &CompressedSize, WorkSpace);
+        if (Status == STATUS_BUFFER_TOO_SMALL || Status == STATUS_BUFFER_ALL_ZEROS)
+            goto Next;
+        CHECK(Status == STATUS_SUCCESS, "format 0x%x, %u bytes: compress status 0x%x\n",
+              Format, Size, Status);
+        if (Status != STATUS_SUCCESS)
+            goto Next;
+
+        /* The decoder must stop at the output size and not write past it */
+        memset(Output, 0xcc, Size + 16);
+        Status = RtlDecompressFragment(Format, Output, Size, Compressed, CompressedSize, 0,
+                                       &OutputSize, FragmentWorkSpace);
+        CHECK(Status == STATUS_SUCCESS && OutputSize == Size && !memcmp(Output, Input, Size) &&
+              Output[Size] == 0xcc,
+              "format 0x%x, %u bytes of kind %u: status 0x%x, size %u\n",
+              Format, Size, Kind, Status, OutputSize);
+
+        /* Truncated and corrupt streams must fail cleanly */
+        if (CompressedSize > 4)
+        {
+            Cut = Random() % CompressedSize;
+            RtlDecompressFragment(Format, Output, Size, Compressed, Cut, 0, &OutputSize, FragmentWorkSpace);
+            Compressed[Random() % CompressedSize] ^= 1 << (Random() % 8);
+            RtlDecompressFragment(Format, Output, Size, Compressed, CompressedSize, 0, &OutputSize,
+                                  FragmentWorkSpace);
+            RtlDecompressFragment(Format, Output, Size / 2, Compressed, CompressedSize, 0, &OutputSize,
+                                  FragmentWorkSpace);
+        }
+
+Next:
+        free(WorkSpace);
+        free(FragmentWorkSpace);
+    }
+}
+
+static double Now(void)
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return Time.tv_sec + Time.tv_nsec * 1e-9;
+}
+
+/* Text, repeated binary records and noise, 8 MB in all */
+static PUCHAR MakeCorpus(ULONG *Size)
+{
+    ULONG Length = 8 * 1024 * 1024, i = 0, Line = 0;
+    PUCHAR Corpus = malloc(Length);
+
+    while (i < Length / 2)
+    {
+        i += snprintf((char *)Corpus + i, Length / 2 - i, "%u: static NTSTATUS Function%u(ULONG Value)\n",
+                      Line, Line % 37);
+        Line++;
+    }
+    for (; i < Length * 3 / 4; i++)
+        Corpus[i] = (i % 64) < 48 ? (UCHAR)(i / 64 * 7) : (UCHAR)Random();
+    for (; i < Length; i++)
+        Corpus[i] = (UCHAR)Random();
+
+    *Size = Length;
+    return Corpus;
+}
+
+static void Benchmark(const char *FileName)
+{
+    PUCHAR Input, Compressed, Output;
+    ULONG Size, WorkSize, FragmentWorkSize, CompressedSize, OutputSize, i;
+    PVOID WorkSpace, FragmentWorkSpace;
+    double Start, Middle, End;
+    NTSTATUS Status;
+    FILE *File;
+    long Length;
+
+    if (FileName)
+    {
+        File = fopen(FileName, "rb");
+        if (!File)
+        {
+            printf("Cannot open %s\n", FileName);
+            Failures++;
+            return;
+        }
+        fseek(File, 0, SEEK_END);
+        Length = ftell(File);
+        fseek(File, 0, SEEK_SET);
+        Size = (ULONG)Length;
+        Input = malloc(Size + 1);
+        Size = (ULONG)fread(Input, 1, Size, File);
+        fclose(File);
+    }
+    else
+        Input = MakeCorpus(&Size);
+
+    Compressed = malloc(Size * 2 + 1024);
+    Output = malloc(Size + 16);
+
+    for (i = 0; i < FORMAT_COUNT; i++)
+    {
+        RtlGetCompressionWorkSpaceSize(Formats[i], &WorkSize, &FragmentWorkSize);
+        WorkSpace = malloc(WorkSize);
+        FragmentWorkSpace = malloc(FragmentWorkSize ? FragmentWorkSize : 1);
+
+        Start = Now();
+        Status = RtlCompressBuffer(Formats[i], Input, Size, Compressed, Size * 2 + 1024, 4096,
+                                   &CompressedSize, WorkSpace);
+        Middle = Now();
+        if (Status == STATUS_SUCCESS)
+            Status = RtlDecompressFragment(Formats[i], Output, Size, Compressed, CompressedSize, 0,
+                                           &OutputSize, FragmentWorkSpace);
+        End = Now();
+
+        CHECK(Status == STATUS_SUCCESS && OutputSize == Size && !memcmp(Output, Input, Size),
+              "format 0x%03x: round trip failed, status 0x%x\n", Formats[i], Status);
+        if (Status == STATUS_SUCCESS)
+        {
+            printf("format 0x%03x: %u -> %u bytes (%.1f%%), compress %.1f MB/s, decompress %.1f MB/s\n",
+                   Formats[i], Size, CompressedSize, 100.0 * CompressedSize / (Size ? Size : 1),
+                   Size / 1e6 / (Middle - Start), Size / 1e6 / (End - Middle));
+        }
+
+        free(WorkSpace);
+        free(FragmentWorkSpace);
+    }
+
+    free(Input);
+    free(Compressed);
+    free(Output);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "-b"))
+    {
+        Benchmark(argc > 2 ? argv[2] : NULL);
+    }
+    else
+    {
+        TestExamples();
+        TestRoundTrip(3000);
+    }
+
+    if (Failures)
+        printf("%d failures\n", Failures);
+    else
+        printf("All tests passed\n");
+    return Failures ? 1 : 0;
+}
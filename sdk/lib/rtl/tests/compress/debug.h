@@ -0,0 +1,3 @@
+/* Stand-in for debug.h to build compress.c on the host */
+#define DPRINT(...)
+#define DPRINT1(...)
@@ -0,0 +1,79 @@
+/*
+ * PROJECT:     ReactOS Runtime Library
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Stand-in for rtl.h to build compress.c on the host
+ */
+
+#ifndef RTL_HOST_H
+#define RTL_HOST_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t UCHAR, *PUCHAR, BYTE;
+typedef uint16_t USHORT, *PUSHORT, WORD;
+typedef uint32_t ULONG, *PULONG, DWORD;
+typedef int32_t LONG, NTSTATUS;
+typedef uint64_t ULONGLONG;
+typedef int64_t LONGLONG;
+typedef size_t SIZE_T, ULONG_PTR;
+typedef char CHAR;
+typedef int BOOLEAN;
+typedef void VOID, *PVOID;
+typedef struct _COMPRESSED_DATA_INFO COMPRESSED_DATA_INFO, *PCOMPRESSED_DATA_INFO;
+
+#define IN
+#define OUT
+#define OPTIONAL
+#define NTAPI
+#define NTSYSAPI
+#define UNALIGNED
+#define FORCEINLINE static inline
+#define TRUE 1
+#define FALSE 0
+
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+#define RtlFillMemory(d, l, f) memset(d, f, l)
+#define RtlZeroMemory(d, l) memset(d, 0, l)
+#define RtlCopyMemory memcpy
+#define RtlMoveMemory memmove
+
+#define NT_SUCCESS(s) ((NTSTATUS)(s) >= 0)
+#define STATUS_SUCCESS                  ((NTSTATUS)0x00000000)
+#define STATUS_BUFFER_ALL_ZEROS         ((NTSTATUS)0x00000117)
+#define STATUS_NOT_IMPLEMENTED          ((NTSTATUS)0xC0000002)
+#define STATUS_ACCESS_VIOLATION         ((NTSTATUS)0xC0000005)
+#define STATUS_INVALID_PARAMETER        ((NTSTATUS)0xC000000D)
+#define STATUS_NO_MEMORY                ((NTSTATUS)0xC0000017)
+#define STATUS_BUFFER_TOO_SMALL         ((NTSTATUS)0xC0000023)
+#define STATUS_NOT_SUPPORTED            ((NTSTATUS)0xC00000BB)
+#define STATUS_INVALID_USER_BUFFER      ((NTSTATUS)0xC00000E8)
+#define STATUS_BAD_COMPRESSION_BUFFER   ((NTSTATUS)0xC0000242)
+#define STATUS_UNSUPPORTED_COMPRESSION  ((NTSTATUS)0xC000025F)
+
+#define COMPRESSION_FORMAT_NONE         0x0000
+#define COMPRESSION_FORMAT_DEFAULT      0x0001
+#define COMPRESSION_FORMAT_LZNT1        0x0002
+#define COMPRESSION_FORMAT_XPRESS       0x0003
+#define COMPRESSION_FORMAT_XPRESS_HUFF  0x0004
+#define COMPRESSION_ENGINE_STANDARD     0x0000
+#define COMPRESSION_ENGINE_MAXIMUM      0x0100
+#define COMPRESSION_ENGINE_HIBER        0x0200
+
+#define UNIMPLEMENTED
+#define ASSERT(x)
+
+static inline PVOID RtlpAllocateMemory(ULONG Bytes, ULONG Tag) { return malloc(Bytes); }
+static inline VOID RtlpFreeMemory(PVOID Mem, ULONG Tag) { free(Mem); }
+
+NTSTATUS RtlCompressBuffer(USHORT, PUCHAR, ULONG, PUCHAR, ULONG, ULONG, PULONG, PVOID);
+NTSTATUS RtlDecompressBuffer(USHORT, PUCHAR, ULONG, PUCHAR, ULONG, PULONG);
+NTSTATUS RtlDecompressFragment(USHORT, PUCHAR, ULONG, PUCHAR, ULONG, ULONG, PULONG, PVOID);
+NTSTATUS RtlGetCompressionWorkSpaceSize(USHORT, PULONG, PULONG);
+
+#endif /* RTL_HOST_H */
@@ -41,6 +41,7 @@ struct queue_timer
 {
     struct timer_queue *q;
     struct list entry;
+    ULONG heap_index;           /* position in q->heap, HEAP_INDEX_NONE if not armed */
     ULONG runcount;             /* number of callbacks pending execution */
     WAITORTIMERCALLBACKFUNC callback;
     PVOID param;
@@ -55,7 +56,11 @@ struct timer_queue
 {
     DWORD magic;
     RTL_CRITICAL_SECTION cs;
-    struct list timers;         /* sorted by expiration time */
+    struct list timers;         /* all timers of the queue, in no particular order */
+    struct queue_timer **heap;  /* armed timers, 4-ary min-heap on the expiration time */
+    ULONG heap_count;
+    ULONG heap_size;            /* always at least the number of timers */
+    ULONG num_timers;
     BOOL quit;                  /* queue should be deleted; once set, never unset */
     HANDLE event;
     HANDLE thread;
@@ -63,6 +68,85 @@ struct timer_queue
 
 #define EXPIRE_NEVER (~(ULONGLONG) 0)
 #define TIMER_QUEUE_MAGIC  0x516d6954   /* TimQ */
+#define HEAP_INDEX_NONE (~(ULONG) 0)
+#define HEAP_ARITY 4
+
+/* The armed timers are kept in a 4-ary heap, so that arming, rearming and
+   cancelling a timer are O(log n) instead of a walk of a sorted list. A
+   wider node makes the tree shallower and keeps the children of a node in
+   the same cache line. */
+
+static void queue_heap_set(struct timer_queue *q, ULONG index, struct queue_timer *t)
+{
+    q->heap[index] = t;
+    t->heap_index = index;
+}
+
+static void queue_heap_sift_up(struct timer_queue *q, ULONG index)
+{
+    struct queue_timer *t = q->heap[index];
+
+    while (index)
+    {
+        ULONG parent = (index - 1) / HEAP_ARITY;
+        if (q->heap[parent]->expire <= t->expire)
+            break;
+        queue_heap_set(q, index, q->heap[parent]);
+        index = parent;
+    }
+    queue_heap_set(q, index, t);
+}
+
+static void queue_heap_sift_down(struct timer_queue *q, ULONG index)
+{
+    struct queue_timer *t = q->heap[index];
+
+    for (;;)
+    {
+        ULONG child = index * HEAP_ARITY + 1, last, i, smallest;
+
+        if (child >= q->heap_count)
+            break;
+
+        last = min(child + HEAP_ARITY, q->heap_count);
+        for (smallest = child, i = child + 1; i < last; i++)
+        {
+            if (q->heap[i]->expire < q->heap[smallest]->expire)
+                smallest = i;
+        }
+
+        if (t->expire <= q->heap[smallest]->expire)
+            break;
+        queue_heap_set(q, index, q->heap[smallest]);
+        index = smallest;
+    }
+    queue_heap_set(q, index, t);
+}
+
+static void queue_heap_remove(struct timer_queue *q, struct queue_timer *t)
+{
+    ULONG index = t->heap_index;
+    struct queue_timer *last;
+
+    if (index == HEAP_INDEX_NONE)
+        return;
+
+    t->heap_index = HEAP_INDEX_NONE;
+    last = q->heap[--q->heap_count];
+    if (last == t)
+        return;
+
+    queue_heap_set(q, index, last);
+    if (index && q->heap[(index - 1) / HEAP_ARITY]->expire > last->expire)
+        queue_heap_sift_up(q, index);
+    else
+        queue_heap_sift_down(q, index);
+}
+
+static inline struct queue_timer *queue_heap_head(struct timer_queue *q)
+{
+    return q->heap_count ? q->heap[0] : NULL;
+}
 
 static void queue_remove_timer(struct queue_timer *t)
 {
@@ -74,7 +158,9 @@ static void queue_remove_timer(struct queue_timer *t)
     assert(t->runcount == 0);
     assert(t->destroy);
 
+    queue_heap_remove(q, t);
     list_remove(&t->entry);
+    q->num_timers--;
     if (t->event)
         NtSetEvent(t->event, NULL);
     RtlFreeHeap(RtlGetProcessHeap(), 0, t);
@@ -111,38 +197,73 @@ static inline ULONGLONG queue_current_time(void)
     return now.QuadPart * 1000 / freq.QuadPart;
 }
 
-static void queue_add_timer(struct queue_timer *t, ULONGLONG time,
+static BOOL queue_reserve_timer(struct timer_queue *q)
+{
+    /* We MUST hold the queue cs while calling this function.  The heap
+       always has room for every timer of the queue, so that arming one
+       never needs to allocate.  */
+    struct queue_timer **heap;
+    ULONG size;
+
+    if (q->num_timers < q->heap_size)
+        return TRUE;
+
+    size = max(q->heap_size * 2, 16);
+    if (q->heap)
+        heap = RtlReAllocateHeap(RtlGetProcessHeap(), 0, q->heap, size * sizeof(*heap));
+    else
+        heap = RtlAllocateHeap(RtlGetProcessHeap(), 0, size * sizeof(*heap));
+    if (!heap)
+        return FALSE;
+
+    q->heap = heap;
+    q->heap_size = size;
+    return TRUE;
+}
+
+static void queue_arm_timer(struct queue_timer *t, ULONGLONG time,
                             BOOL set_event)
 {
     /* We MUST hold the queue cs while calling this function.  */
     struct timer_queue *q = t->q;
-    struct list *ptr = &q->timers;
 
     assert(!q->quit || (t->destroy && time == EXPIRE_NEVER));
 
-    if (time != EXPIRE_NEVER)
-        LIST_FOR_EACH(ptr, &q->timers)
-        {
-            struct queue_timer *cur = LIST_ENTRY(ptr, struct queue_timer, entry);
-            if (time < cur->expire)
-                break;
-        }
-    list_add_before(ptr, &t->entry);
-
+    queue_heap_remove(q, t);
     t->expire = time;
 
-    /* If we insert at the head of the list, we need to expire sooner
+    /* Timers which never expire don't need to be in the heap.  */
+    if (time == EXPIRE_NEVER)
+        return;
+
+    assert(q->heap_count < q->heap_size);
+    q->heap[q->heap_count] = t;
+    queue_heap_sift_up(q, q->heap_count++);
+
+    /* If we insert at the head of the heap, we need to expire sooner
        than expected.  */
-    if (set_event && &t->entry == list_head(&q->timers))
+    if (set_event && t->heap_index == 0)
         NtSetEvent(q->event, NULL);
 }
 
+static void queue_add_timer(struct queue_timer *t, ULONGLONG time,
+                            BOOL set_event)
+{
+    /* We MUST hold the queue cs while calling this function, and have
+       reserved room for the timer with queue_reserve_timer.  */
+    struct timer_queue *q = t->q;
+
+    list_add_tail(&q->timers, &t->entry);
+    q->num_timers++;
+    t->heap_index = HEAP_INDEX_NONE;
+    queue_arm_timer(t, time, set_event);
+}
+
 static inline void queue_move_timer(struct queue_timer *t, ULONGLONG time,
                                     BOOL set_event)
 {
     /* We MUST hold the queue cs while calling this function.  */
-    list_remove(&t->entry);
-    queue_add_timer(t, time, set_event);
+    queue_arm_timer(t, time, set_event);
 }
 
 static void queue_timer_expire(struct timer_queue *q)
@@ -150,10 +271,9 @@ static void queue_timer_expire(struct timer_queue *q)
     struct queue_timer *t = NULL;
 
     RtlEnterCriticalSection(&q->cs);
-    if (list_head(&q->timers))
+    if ((t = queue_heap_head(q)))
     {
         ULONGLONG now, next;
-        t = LIST_ENTRY(list_head(&q->timers), struct queue_timer, entry);
         if (!t->destroy && t->expire <= ((now = queue_current_time())))
         {
             ++t->runcount;
@@ -196,16 +316,12 @@ static ULONG queue_get_timeout(struct timer_queue *q)
     ULONG timeout = INFINITE;
 
     RtlEnterCriticalSection(&q->cs);
-    if (list_head(&q->timers))
+    if ((t = queue_heap_head(q)))
     {
-        t = LIST_ENTRY(list_head(&q->timers), struct queue_timer, entry);
-        assert(!t->destroy || t->expire == EXPIRE_NEVER);
+        ULONGLONG time = queue_current_time();
+        assert(!t->destroy && t->expire != EXPIRE_NEVER);
 
-        if (t->expire != EXPIRE_NEVER)
-        {
-            ULONGLONG time = queue_current_time();
-            timeout = t->expire < time ? 0 : (ULONG)(t->expire - time);
-        }
+        timeout = t->expire < time ? 0 : (ULONG)(t->expire - time);
     }
     RtlLeaveCriticalSection(&q->cs);
 
@@ -250,6 +366,8 @@ static DWORD WINAPI timer_queue_thread_proc(LPVOID p)
     NtClose(q->event);
     RtlDeleteCriticalSection(&q->cs);
     q->magic = 0;
+    if (q->heap)
+        RtlFreeHeap(RtlGetProcessHeap(), 0, q->heap);
     RtlFreeHeap(RtlGetProcessHeap(), 0, q);
     RtlpExitThreadFunc(STATUS_SUCCESS);
     return 0;
@@ -266,7 +384,7 @@ static void queue_destroy_timer(struct queue_timer *t)
         queue_remove_timer(t);
     else
         /* Make sure no destroyed timer masks an active timer at the head
-           of the sorted list.  */
+           of the heap.  */
         queue_move_timer(t, EXPIRE_NEVER, FALSE);
 }
 
@@ -291,6 +409,10 @@ NTSTATUS WINAPI RtlCreateTimerQueue(PHANDLE NewTimerQueue)
 
     RtlInitializeCriticalSection(&q->cs);
     list_init(&q->timers);
+    q->heap = NULL;
+    q->heap_count = 0;
+    q->heap_size = 0;
+    q->num_timers = 0;
     q->quit = FALSE;
     q->magic = TIMER_QUEUE_MAGIC;
     status = NtCreateEvent(&q->event, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
@@ -451,6 +573,8 @@ NTSTATUS WINAPI RtlCreateTimer(HANDLE TimerQueue, PHANDLE NewTimer,
     RtlEnterCriticalSection(&q->cs);
     if (q->quit)
         status = STATUS_INVALID_HANDLE;
+    else if (!queue_reserve_timer(q))
+        status = STATUS_NO_MEMORY;
     else
         queue_add_timer(t, queue_current_time() + DueTime, TRUE);
     RtlLeaveCriticalSection(&q->cs);
@@ -20,12 +20,14 @@
 #include <string.h>
 #if !defined(_WIN32)
 # include <dirent.h>
+# include <pthread.h>
 # include <sys/stat.h>
 # include <sys/types.h>
 #endif
 #include "cabinet.h"
 #include "raw.h"
 #include "mszip.h"
+#include "lzx.h"
 
 #if defined(_WIN32)
 #define GetSizeOfFile(handle) _GetSizeOfFile(handle)
@@ -327,9 +329,11 @@ CCabinet::CCabinet()
     CriteriaListHead = NULL;
     CriteriaListTail = NULL;
 
-    Codec          = NULL;
-    CodecId        = -1;
-    CodecSelected  = false;
+    Codec            = NULL;
+    CodecId          = -1;
+    CodecSelected    = false;
+    CompressionLevel = 0;
+    CodecDataNode    = NULL;
 
     OutputBuffer = NULL;
     InputBuffer  = NULL;
@@ -337,6 +341,19 @@ CCabinet::CCabinet()
     BlockIsSplit = false;
     ScratchFile  = NULL;
 
+    FolderSizeThreshold = 0;
+    CurrentFolderSize   = 0;
+    ThreadCount         = 0;
+    ThreadCodecs        = NULL;
+    PendingBlocks       = NULL;
+    PendingCount        = 0;
+    PendingMax          = 0;
+    TaskStart           = NULL;
+    TaskCount           = 0;
+    NextTask            = 0;
+    TotalUncompBytes    = 0;
+    TotalCompBytes      = 0;
+
     FolderUncompSize = 0;
     BytesLeftInBlock = 0;
     ReuseBlock       = false;
@@ -605,6 +622,8 @@ bool CCabinet::SetCompressionCodec(char* CodecName)
         SelectCodec(CAB_CODEC_RAW);
     else if( !strcasecmp(CodecName, "mszip") )
         SelectCodec(CAB_CODEC_MSZIP);
+    else if( !strcasecmp(CodecName, "lzx") )
+        SelectCodec(CAB_CODEC_LZX);
     else
     {
         printf("ERROR: Invalid codec specified!\n");
@@ -733,7 +752,7 @@ ULONG CCabinet::Open()
         ULONG BytesRead;
         ULONG Size;
 
-        OutputBuffer = AllocateMemory(CAB_BLOCKSIZE + 12);    // This should be enough
+        OutputBuffer = AllocateMemory(CAB_MAXCOMPSIZE);
         if (!OutputBuffer)
             return CAB_STATUS_NOMEMORY;
 
@@ -1031,6 +1050,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
     PUCHAR CurrentBuffer;
     FILEHANDLE DestFile;
     PCFFILE_NODE File;
+    PCFDATA_NODE NextDataNode;
     CFDATA CFData;
     ULONG Status;
     bool Skip;
@@ -1059,6 +1079,10 @@ ULONG CCabinet::ExtractFile(char* FileName)
             SelectCodec(CAB_CODEC_MSZIP);
             break;
 
+        case CAB_COMP_LZX:
+            SelectCodec(CAB_CODEC_LZX);
+            break;
+
         default:
             return CAB_STATUS_UNSUPPCOMP;
     }
@@ -1142,7 +1166,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
 #endif
     SetAttributesOnFile(DestName, File->File.Attributes);
 
-    Buffer = (PUCHAR)AllocateMemory(CAB_BLOCKSIZE + 12); // This should be enough
+    Buffer = (PUCHAR)AllocateMemory(CAB_MAXCOMPSIZE);
     if (!Buffer)
     {
         CloseFile(DestFile);
@@ -1153,6 +1177,18 @@ ULONG CCabinet::ExtractFile(char* FileName)
     /* Call OnExtract event handler */
     OnExtract(&File->File, FileName);
 
+    /* A solid codec must have seen all blocks before the first one of the file */
+    if (Codec->IsSolid())
+    {
+        Status = SeekDataBlock(File->DataBlock);
+        if (Status != CAB_STATUS_SUCCESS)
+        {
+            CloseFile(DestFile);
+            FreeMemory(Buffer);
+            return Status;
+        }
+    }
+
     /* Search to start of file */
 #if defined(_WIN32)
     Offset = SetFilePointer(FileHandle,
@@ -1184,6 +1220,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
     Skip = true;
 
     ReuseBlock = (CurrentDataNode == File->DataBlock);
+    NextDataNode = File->DataBlock;
     if (Size > 0)
     {
         do
@@ -1216,7 +1253,13 @@ ULONG CCabinet::ExtractFile(char* FileName)
                         CFData.CompSize,
                         CFData.UncompSize));
 
-                    ASSERT(CFData.CompSize <= CAB_BLOCKSIZE + 12);
+                    if (TotalBytesRead + CFData.CompSize > CAB_MAXCOMPSIZE)
+                    {
+                        CloseFile(DestFile);
+                        FreeMemory(Buffer);
+                        DPRINT(MIN_TRACE, ("Data block is too large (%u bytes).\n", CFData.CompSize));
+                        return CAB_STATUS_INVALID_CAB;
+                    }
 
                     BytesToRead = CFData.CompSize;
 
@@ -1322,6 +1365,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
                             (UINT)File->DataBlock->UncompOffset));
 
                         CurrentDataNode = File->DataBlock;
+                        NextDataNode = File->DataBlock;
                         ReuseBlock = true;
 
                         RestartSearch = true;
@@ -1330,6 +1374,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
 
                 DPRINT(MAX_TRACE, ("TotalBytesRead (%u).\n", (UINT)TotalBytesRead));
 
+                BytesToWrite = CFData.UncompSize;
                 Status = Codec->Uncompress(OutputBuffer, Buffer, TotalBytesRead, &BytesToWrite);
                 if (Status != CS_SUCCESS)
                 {
@@ -1351,6 +1396,12 @@ ULONG CCabinet::ExtractFile(char* FileName)
                 }
 
                 BytesLeftInBlock = BytesToWrite;
+
+                if (NextDataNode)
+                {
+                    CodecDataNode = NextDataNode;
+                    NextDataNode  = NextDataNode->Next;
+                }
             }
             else
             {
@@ -1397,6 +1448,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
                 }
 #endif
 
+                NextDataNode = CurrentDataNode->Next;
                 ReuseBlock = false;
             }
 
@@ -1476,22 +1528,162 @@ void CCabinet::SelectCodec(LONG Id)
         delete Codec;
     }
 
+    CodecDataNode = NULL;
+
+    Codec = CreateCodec(Id);
+    if (!Codec)
+        return;
+
+    CodecId       = Id;
+    CodecSelected = true;
+}
+
+
+void CCabinet::SetCompressionLevel(ULONG Level)
+/*
+ * FUNCTION: Sets the compression level
+ * ARGUMENTS:
+ *     Level = Compression level from 1 (fastest) to 9 (smallest), 0 for the codec default
+ */
+{
+    CompressionLevel = Level;
+
+    if (CodecSelected)
+        Codec->SetLevel(Level);
+}
+
+
+CCABCodec* CCabinet::CreateCodec(LONG Id)
+/*
+ * FUNCTION: Creates a codec engine
+ * ARGUMENTS:
+ *     Id = Codec identifier
+ * RETURNS:
+ *     Pointer to codec, NULL if the codec is not supported
+ */
+{
+    CCABCodec* NewCodec;
+
     switch (Id)
     {
         case CAB_CODEC_RAW:
-            Codec = new CRawCodec();
+            NewCodec = new CRawCodec();
             break;
 
         case CAB_CODEC_MSZIP:
-            Codec = new CMSZipCodec();
+            NewCodec = new CMSZipCodec();
+            break;
+
+        case CAB_CODEC_LZX:
+            NewCodec = new CLZXCodec();
             break;
 
         default:
-            return;
+            return NULL;
     }
 
-    CodecId       = Id;
-    CodecSelected = true;
+    NewCodec->SetLevel(CompressionLevel);
+    return NewCodec;
+}
+
+
+ULONG CCabinet::SeekDataBlock(PCFDATA_NODE DataNode)
+/*
+ * FUNCTION: Prepares the solid codec for uncompressing a data block
+ * ARGUMENTS:
+ *     DataNode = Pointer to data block node in the current folder
+ * RETURNS:
+ *     Status of operation
+ * NOTES:
+ *     If the codec just uncompressed the block, it is left in OutputBuffer
+ *     for reuse. Otherwise the codec is restarted and made to uncompress
+ *     every block before it in the folder
+ */
+{
+    PCFDATA_NODE Node;
+    CFDATA CFData;
+    ULONG BytesRead;
+    ULONG Length;
+    ULONG Status;
+    PUCHAR Buffer;
+
+    CurrentDataNode = NULL;
+
+    if (CodecDataNode != NULL)
+    {
+        if (CodecDataNode == DataNode)
+        {
+            CurrentDataNode  = DataNode;
+            BytesLeftInBlock = DataNode->Data.UncompSize;
+            return CAB_STATUS_SUCCESS;
+        }
+
+        if (CodecDataNode->Next == DataNode)
+            return CAB_STATUS_SUCCESS;
+    }
+
+    DPRINT(MAX_TRACE, ("Restarting codec for block at (0x%X).\n", (UINT)DataNode->AbsoluteOffset));
+
+    Codec->Reset(CurrentFolderNode->Folder.CompressionType);
+    CodecDataNode = NULL;
+
+    Buffer = (PUCHAR)AllocateMemory(CAB_MAXCOMPSIZE);
+    if (!Buffer)
+    {
+        DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
+        return CAB_STATUS_NOMEMORY;
+    }
+
+    for (Node = CurrentFolderNode->DataListHead; Node != DataNode; Node = Node->Next)
+    {
+        if (!Node || Node->Data.UncompSize == 0 || Node->Data.CompSize > CAB_MAXCOMPSIZE)
+        {
+            FreeMemory(Buffer);
+            return CAB_STATUS_INVALID_CAB;
+        }
+
+#if defined(_WIN32)
+        if (SetFilePointer(FileHandle, Node->AbsoluteOffset, NULL, FILE_BEGIN) == INVALID_SET_FILE_POINTER)
+        {
+            DPRINT(MIN_TRACE, ("SetFilePointer() failed, error code is %u.\n", (UINT)GetLastError()));
+            FreeMemory(Buffer);
+            return CAB_STATUS_INVALID_CAB;
+        }
+#else
+        if (fseek(FileHandle, (off_t)Node->AbsoluteOffset, SEEK_SET) != 0)
+        {
+            DPRINT(MIN_TRACE, ("fseek() failed.\n"));
+            FreeMemory(Buffer);
+            return CAB_STATUS_INVALID_CAB;
+        }
+#endif
+
+        if (((Status = ReadBlock(&CFData, sizeof(CFDATA), &BytesRead)) != CAB_STATUS_SUCCESS) ||
+            (BytesRead != sizeof(CFDATA)) ||
+            ((Status = ReadBlock(Buffer, Node->Data.CompSize, &BytesRead)) != CAB_STATUS_SUCCESS) ||
+            (BytesRead != Node->Data.CompSize))
+        {
+            DPRINT(MIN_TRACE, ("Cannot read from file (%u).\n", (UINT)Status));
+            FreeMemory(Buffer);
+            return CAB_STATUS_INVALID_CAB;
+        }
+
+        Length = Node->Data.UncompSize;
+        Status = Codec->Uncompress(OutputBuffer, Buffer, Node->Data.CompSize, &Length);
+        if (Status != CS_SUCCESS || Length != Node->Data.UncompSize)
+        {
+            DPRINT(MID_TRACE, ("Cannot uncompress block.\n"));
+            FreeMemory(Buffer);
+            if (Status == CS_NOMEMORY)
+                return CAB_STATUS_NOMEMORY;
+            return CAB_STATUS_INVALID_CAB;
+        }
+
+        CodecDataNode = Node;
+    }
+
+    FreeMemory(Buffer);
+    return CAB_STATUS_SUCCESS;
 }
 
 
@@ -1510,8 +1702,8 @@ ULONG CCabinet::NewCabinet()
 
     CurrentDiskNumber = 0;
 
-    OutputBuffer = AllocateMemory(CAB_BLOCKSIZE + 12); // This should be enough
-    InputBuffer  = AllocateMemory(CAB_BLOCKSIZE + 12); // This should be enough
+    OutputBuffer = AllocateMemory(CAB_MAXCOMPSIZE);
+    InputBuffer  = AllocateMemory(CAB_MAXCOMPSIZE);
     if ((!OutputBuffer) || (!InputBuffer))
     {
         DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
@@ -1520,6 +1712,35 @@ ULONG CCabinet::NewCabinet()
     CurrentIBuffer     = InputBuffer;
     CurrentIBufferSize = 0;
 
+    /* Queue for compressing blocks on several threads */
+    if (ThreadCount == 0)
+    {
+#if defined(_WIN32)
+        SYSTEM_INFO SystemInfo;
+
+        GetSystemInfo(&SystemInfo);
+        ThreadCount = SystemInfo.dwNumberOfProcessors;
+#else
+        LONG Processors = sysconf(_SC_NPROCESSORS_ONLN);
+        ThreadCount = (Processors > 0) ? (ULONG)Processors : 1;
+#endif
+    }
+
+    PendingMax    = ThreadCount * CAB_PENDING_PER_THREAD;
+    PendingCount  = 0;
+    PendingBlocks = (PCAB_PENDING_BLOCK)AllocateMemory(PendingMax * sizeof(CAB_PENDING_BLOCK));
+    TaskStart     = (PULONG)AllocateMemory((PendingMax + 1) * sizeof(ULONG));
+    ThreadCodecs  = (CCABCodec**)AllocateMemory(ThreadCount * sizeof(CCABCodec*));
+    if ((!PendingBlocks) || (!TaskStart) || (!ThreadCodecs))
+    {
+        DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
+        return CAB_STATUS_NOMEMORY;
+    }
+    memset(ThreadCodecs, 0, ThreadCount * sizeof(CCABCodec*));
+
+    TotalUncompBytes = 0;
+    TotalCompBytes   = 0;
+
     CABHeader.Signature     = CAB_SIGNATURE;
     CABHeader.Reserved1     = 0;            // Not used
     CABHeader.CabinetSize   = 0;            // Not yet known
@@ -1619,6 +1840,10 @@ ULONG CCabinet::NewFolder()
             CurrentFolderNode->Folder.CompressionType = CAB_COMP_MSZIP;
             break;
 
+        case CAB_CODEC_LZX:
+            CurrentFolderNode->Folder.CompressionType = CAB_COMP_LZX | (LZX_WINDOW_BITS << 8);
+            break;
+
         default:
             return CAB_STATUS_UNSUPPCOMP;
     }
@@ -1635,6 +1860,8 @@ ULONG CCabinet::NewFolder()
 
     LastBlockStart = 0;
 
+    CurrentFolderSize = 0;
+
     return CAB_STATUS_SUCCESS;
 }
 
@@ -1648,6 +1875,7 @@ ULONG CCabinet::WriteFileToScratchStorage(PCFFILE_NODE FileNode)
  *     Status of operation
  */
 {
+    PCFFOLDER_NODE FolderNode;
     ULONG BytesToRead;
     ULONG BytesRead;
     ULONG Status;
@@ -1689,6 +1917,31 @@ ULONG CCabinet::WriteFileToScratchStorage(PCFFILE_NODE FileNode)
             CreateNewFolder = false;
         }
 
+        /* Move on to the folder the file was added to if it comes later */
+        for (FolderNode = CurrentFolderNode->Next; FolderNode != NULL; FolderNode = FolderNode->Next)
+        {
+            if (FolderNode != FileNode->FolderNode)
+                continue;
+
+            /* The last block of a folder is never shared with the next one */
+            if (CurrentIBufferSize > 0)
+            {
+                Status = WriteDataBlock();
+                if (Status != CAB_STATUS_SUCCESS)
+                    return Status;
+            }
+
+            if (PendingCount == 0 && CurrentFolderNode->Codec)
+            {
+                delete CurrentFolderNode->Codec;
+                CurrentFolderNode->Codec = NULL;
+            }
+
+            CurrentFolderNode = FolderNode;
+            LastBlockStart = 0;
+            break;
+        }
+
         /* Call OnAdd event handler */
         OnAdd(&FileNode->File, FileNode->FileName);
 
@@ -1696,10 +1949,13 @@ ULONG CCabinet::WriteFileToScratchStorage(PCFFILE_NODE FileNode)
 
         FileNode->File.FileOffset        = CurrentFolderNode->UncompOffset;
         CurrentFolderNode->UncompOffset += TotalBytesLeft;
-        FileNode->File.FileControlID     = (USHORT)(NextFolderNumber - 1);
+        FileNode->File.FileControlID     = 0;
         CurrentFolderNode->Commit        = true;
         PrevCabinetNumber                = CurrentDiskNumber;
 
+        for (FolderNode = FolderListHead; FolderNode != CurrentFolderNode; FolderNode = FolderNode->Next)
+            FileNode->File.FileControlID++;
+
         Size = sizeof(CFFILE) + (ULONG)strlen(GetFileName(FileNode->FileName)) + 1;
         CABHeader.FileTableOffset += Size;
         TotalFileSize += Size;
@@ -1778,9 +2034,26 @@ ULONG CCabinet::WriteDisk(ULONG MoreDisks)
  *     Status of operation
  */
 {
+    PCFFOLDER_NODE FolderNode;
     PCFFILE_NODE FileNode;
     ULONG Status;
 
+    /* Folders are created while the directive file is parsed, so start
+       writing in the folder of the first file if nothing is stored yet */
+    if ((FileListHead != NULL) &&
+        (CurrentFolderNode->Folder.DataBlockCount == 0) &&
+        (CurrentIBufferSize == 0) && (CurrentOBufferSize == 0))
+    {
+        for (FolderNode = FolderListHead; FolderNode != CurrentFolderNode; FolderNode = FolderNode->Next)
+        {
+            if (FolderNode == FileListHead->FolderNode)
+            {
+                CurrentFolderNode = FolderNode;
+                break;
+            }
+        }
+    }
+
     ContinueFile = false;
     FileNode = FileListHead;
     while (FileNode != NULL)
@@ -1867,6 +2140,11 @@ ULONG CCabinet::CommitDisk(ULONG MoreDisks)
     PCFFOLDER_NODE FolderNode;
     ULONG Status;
 
+    /* Compress the blocks still waiting in the queue */
+    Status = FlushDataBlocks();
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
     OnCabinetName(CurrentDiskNumber, CabinetName);
 
     /* Create file, fail if it already exists */
@@ -1987,17 +2265,48 @@ ULONG CCabinet::CloseCabinet()
  */
 {
     ULONG Status;
+    ULONG i;
 
     DestroyFileNodes();
 
     DestroyFolderNodes();
 
+    CodecDataNode = NULL;
+
     if (InputBuffer)
     {
         FreeMemory(InputBuffer);
         InputBuffer = NULL;
     }
 
+#ifndef CAB_READ_ONLY
+    if (ThreadCodecs)
+    {
+        /* The first thread uses the cabinet codec */
+        for (i = 1; i < ThreadCount; i++)
+        {
+            if (ThreadCodecs[i])
+                delete ThreadCodecs[i];
+        }
+        FreeMemory(ThreadCodecs);
+        ThreadCodecs = NULL;
+    }
+
+    if (PendingBlocks)
+    {
+        FreeMemory(PendingBlocks);
+        PendingBlocks = NULL;
+    }
+
+    if (TaskStart)
+    {
+        FreeMemory(TaskStart);
+        TaskStart = NULL;
+    }
+
+    PendingCount = 0;
+#endif /* CAB_READ_ONLY */
+
     if (OutputBuffer)
     {
         FreeMemory(OutputBuffer);
@@ -2074,7 +2383,6 @@ ULONG CCabinet::AddFile(char* FileName)
         return CAB_STATUS_NOMEMORY;
     }
 
-    FileNode->FolderNode = CurrentFolderNode;
     FileNode->FileName = NewFileName;
 
     /* FIXME: Check for and handle large files (>= 2GB) */
@@ -2086,6 +2394,20 @@ ULONG CCabinet::AddFile(char* FileName)
         return CAB_STATUS_CANNOT_READ;
     }
 
+    /* Start a new folder when the current one is full, so folders
+       are small enough to be compressed in parallel */
+    if ((FolderSizeThreshold > 0) && (CurrentFolderSize >= FolderSizeThreshold))
+    {
+        if (NewFolder() != CAB_STATUS_SUCCESS)
+        {
+            CloseFile(SrcFile);
+            return CAB_STATUS_NOMEMORY;
+        }
+    }
+
+    FileNode->FolderNode = CurrentFolderNode;
+    CurrentFolderSize += FileNode->File.FileSize;
+
     if (GetFileTimes(SrcFile, FileNode) != CAB_STATUS_SUCCESS)
     {
         DPRINT(MIN_TRACE, ("Cannot read file times.\n"));
@@ -2262,6 +2584,48 @@ void CCabinet::SetMaxDiskSize(ULONG Size)
     MaxDiskSize = Size;
 }
 
+void CCabinet::SetThreadCount(ULONG Count)
+/*
+ * FUNCTION: Sets the number of threads used for compression
+ * ARGUMENTS:
+ *     Count = Number of threads (0 means one per processor)
+ */
+{
+    ThreadCount = Count;
+}
+
+ULONG CCabinet::GetThreadCount()
+/*
+ * FUNCTION: Returns the number of threads used for compression
+ * RETURNS:
+ *     Number of threads, 0 if it is not known yet
+ */
+{
+    return ThreadCount;
+}
+
+void CCabinet::SetFolderSizeThreshold(ULONG Size)
+/*
+ * FUNCTION: Sets the size at which a new folder is started
+ * ARGUMENTS:
+ *     Size = Uncompressed size of the files in a folder (0 means no limit)
+ */
+{
+    FolderSizeThreshold = Size;
+}
+
+void CCabinet::GetCompressionStatistics(ULONGLONG* UncompSize, ULONGLONG* CompSize)
+/*
+ * FUNCTION: Returns how much data has been compressed
+ * ARGUMENTS:
+ *     UncompSize = Address of buffer to place number of bytes compressed
+ *     CompSize   = Address of buffer to place number of bytes they compressed to
+ */
+{
+    *UncompSize = TotalUncompBytes;
+    *CompSize   = TotalCompBytes;
+}
+
 #endif /* CAB_READ_ONLY */
 
 
@@ -2873,6 +3237,8 @@ void CCabinet::DestroyFolderNodes()
     {
         PrevNode = NextNode->Next;
         DestroyDataNodes(NextNode);
+        if (NextNode->Codec)
+            delete NextNode->Codec;
         FreeMemory(NextNode);
         NextNode = PrevNode;
     }
@@ -2915,6 +3281,8 @@ void CCabinet::DestroyDeletedFolderNodes()
             }
 
             DestroyDataNodes(CurNode);
+            if (CurNode->Codec)
+                delete CurNode->Codec;
             FreeMemory(CurNode);
 
             TotalFolderSize -= sizeof(CFFOLDER);
@@ -3551,17 +3919,58 @@ ULONG CCabinet::WriteDataBlock()
     ULONG Status;
     ULONG BytesWritten;
     PCFDATA_NODE DataNode;
+    PCAB_PENDING_BLOCK Block;
+    CCABCodec* FolderCodec;
+
+    /* Without a disk size limit, blocks are queued and compressed on
+       several threads. Blocks must be split at the right size otherwise */
+    if ((PendingBlocks != NULL) && (MaxDiskSize == 0) && (!BlockIsSplit))
+    {
+        Block = &PendingBlocks[PendingCount++];
+        Block->FolderNode  = CurrentFolderNode;
+        Block->InputLength = CurrentIBufferSize;
+        memcpy(Block->Input, InputBuffer, CurrentIBufferSize);
+
+        LastBlockStart += CurrentIBufferSize;
+
+        CurrentIBufferSize = 0;
+        CurrentIBuffer     = InputBuffer;
+
+        if (PendingCount == PendingMax)
+            return FlushDataBlocks();
+
+        return CAB_STATUS_SUCCESS;
+    }
+
+    Status = FlushDataBlocks();
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
 
     if (!BlockIsSplit)
     {
-        Status = Codec->Compress(OutputBuffer,
+        FolderCodec = GetFolderCodec(CurrentFolderNode);
+        if (!FolderCodec)
+        {
+            DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
+            return CAB_STATUS_NOMEMORY;
+        }
+
+        Status = FolderCodec->Compress(OutputBuffer,
             InputBuffer,
             CurrentIBufferSize,
             &TotalCompSize);
+        if (Status != CS_SUCCESS)
+        {
+            DPRINT(MIN_TRACE, ("Cannot compress block (%u).\n", (UINT)Status));
+            return (Status == CS_NOMEMORY) ? CAB_STATUS_NOMEMORY : CAB_STATUS_FAILURE;
+        }
 
         DPRINT(MAX_TRACE, ("Block compressed. CurrentIBufferSize (%u)  TotalCompSize(%u).\n",
             (UINT)CurrentIBufferSize, (UINT)TotalCompSize));
 
+        TotalUncompBytes += CurrentIBufferSize;
+        TotalCompBytes   += TotalCompSize;
+
         CurrentOBuffer     = OutputBuffer;
         CurrentOBufferSize = TotalCompSize;
     }
@@ -3628,6 +4037,277 @@ ULONG CCabinet::WriteDataBlock()
     return CAB_STATUS_SUCCESS;
 }
 
+
+CCABCodec* CCabinet::GetFolderCodec(PCFFOLDER_NODE FolderNode)
+/*
+ * FUNCTION: Returns the codec to compress the blocks of a folder with
+ * ARGUMENTS:
+ *     FolderNode = Pointer to folder node
+ * RETURNS:
+ *     Pointer to codec, NULL if there was not enough free memory
+ * NOTES:
+ *     Solid codecs keep state for the whole folder, so each folder
+ *     gets its own codec. Other codecs are shared
+ */
+{
+    if (!Codec->IsSolid())
+        return Codec;
+
+    if (!FolderNode->Codec)
+    {
+        FolderNode->Codec = CreateCodec(CodecId);
+        if (FolderNode->Codec)
+            FolderNode->Codec->Reset(FolderNode->Folder.CompressionType);
+    }
+
+    return FolderNode->Codec;
+}
+
+
+typedef struct _CAB_WORKER
+{
+    CCabinet* Cabinet;
+    ULONG Index;
+} CAB_WORKER, *PCAB_WORKER;
+
+#if defined(_WIN32)
+static DWORD WINAPI CompressThread(LPVOID Parameter)
+#else
+static void* CompressThread(void* Parameter)
+#endif
+/*
+ * FUNCTION: Entry point of compression threads
+ * ARGUMENTS:
+ *     Parameter = Pointer to CAB_WORKER structure
+ */
+{
+    PCAB_WORKER Worker = (PCAB_WORKER)Parameter;
+
+    Worker->Cabinet->CompressPendingBlocks(Worker->Index);
+    return 0;
+}
+
+
+void CCabinet::CompressPendingBlocks(ULONG ThreadIndex)
+/*
+ * FUNCTION: Compresses queued data blocks until there are no tasks left
+ * ARGUMENTS:
+ *     ThreadIndex = Zero based index of the calling thread
+ * NOTES:
+ *     A task is one block, or all queued blocks of a folder for solid
+ *     codecs. Tasks are handed out in order, so one thread at a time
+ *     uses a folder codec
+ */
+{
+    PCFFOLDER_NODE FolderNode;
+    CCABCodec* TaskCodec;
+    ULONG Task;
+    ULONG i;
+
+    for (;;)
+    {
+#if defined(_WIN32)
+        Task = (ULONG)InterlockedIncrement(&NextTask) - 1;
+#else
+        Task = (ULONG)__sync_fetch_and_add(&NextTask, 1);
+#endif
+        if (Task >= TaskCount)
+            break;
+
+        FolderNode = PendingBlocks[TaskStart[Task]].FolderNode;
+        if (Codec->IsSolid())
+            TaskCodec = GetFolderCodec(FolderNode);
+        else
+            TaskCodec = ThreadCodecs[ThreadIndex];
+
+        for (i = TaskStart[Task]; i < TaskStart[Task + 1]; i++)
+        {
+            if (!TaskCodec)
+            {
+                PendingBlocks[i].Status = CS_NOMEMORY;
+                continue;
+            }
+
+            PendingBlocks[i].Status = TaskCodec->Compress(PendingBlocks[i].Output,
+                                                          PendingBlocks[i].Input,
+                                                          PendingBlocks[i].InputLength,
+                                                          &PendingBlocks[i].OutputLength);
+        }
+
+        /* No more blocks will be added to folders before the current one */
+        if (Codec->IsSolid() && FolderNode != CurrentFolderNode && FolderNode->Codec)
+        {
+            delete FolderNode->Codec;
+            FolderNode->Codec = NULL;
+        }
+    }
+}
+
+
+ULONG CCabinet::FlushDataBlocks()
+/*
+ * FUNCTION: Compresses queued data blocks and writes them to the scratch file
+ * RETURNS:
+ *     Status of operation
+ * NOTES:
+ *     Blocks are written in the order they were queued, so the
+ *     cabinet is the same for any number of threads
+ */
+{
+    CAB_WORKER Workers[64];
+#if defined(_WIN32)
+    HANDLE Threads[64];
+#else
+    pthread_t Threads[64];
+#endif
+    PCFFOLDER_NODE FolderNode;
+    ULONG Started = 0;
+    ULONG Count;
+    ULONG Status;
+    ULONG i;
+
+    if (PendingCount == 0)
+        return CAB_STATUS_SUCCESS;
+
+    TaskCount = 0;
+    for (i = 0; i < PendingCount; i++)
+    {
+        if ((i == 0) || (!Codec->IsSolid()) ||
+            (PendingBlocks[i].FolderNode != PendingBlocks[i - 1].FolderNode))
+            TaskStart[TaskCount++] = i;
+    }
+    TaskStart[TaskCount] = PendingCount;
+    NextTask = 0;
+
+    Count = ThreadCount;
+    if (Count > TaskCount)
+        Count = TaskCount;
+    if (Count > sizeof(Workers) / sizeof(Workers[0]))
+        Count = sizeof(Workers) / sizeof(Workers[0]);
+
+    /* Codecs that are not solid have no state, but are not thread safe either */
+    if (!Codec->IsSolid())
+    {
+        ThreadCodecs[0] = Codec;
+        for (i = 1; i < Count; i++)
+        {
+            if (!ThreadCodecs[i])
+                ThreadCodecs[i] = CreateCodec(CodecId);
+            if (!ThreadCodecs[i])
+                Count = i;
+        }
+    }
+
+    for (i = 1; i < Count; i++)
+    {
+        Workers[i].Cabinet = this;
+        Workers[i].Index   = i;
+#if defined(_WIN32)
+        Threads[i] = CreateThread(NULL, 0, CompressThread, &Workers[i], 0, NULL);
+        if (!Threads[i])
+            break;
+#else
+        if (pthread_create(&Threads[i], NULL, CompressThread, &Workers[i]) != 0)
+            break;
+#endif
+        Started++;
+    }
+
+    /* The calling thread is the first worker */
+    CompressPendingBlocks(0);
+
+    for (i = 1; i <= Started; i++)
+    {
+#if defined(_WIN32)
+        WaitForSingleObject(Threads[i], INFINITE);
+        CloseHandle(Threads[i]);
+#else
+        pthread_join(Threads[i], NULL);
+#endif
+    }
+
+    DPRINT(MAX_TRACE, ("Compressed %u blocks in %u tasks on %u threads.\n",
+        (UINT)PendingCount, (UINT)TaskCount, (UINT)(Started + 1)));
+
+    for (i = 0; i < PendingCount; i++)
+    {
+        if (PendingBlocks[i].Status != CS_SUCCESS)
+        {
+            DPRINT(MIN_TRACE, ("Cannot compress block (%u).\n", (UINT)PendingBlocks[i].Status));
+            PendingCount = 0;
+            if (PendingBlocks[i].Status == CS_NOMEMORY)
+                return CAB_STATUS_NOMEMORY;
+            return CAB_STATUS_FAILURE;
+        }
+
+        Status = StoreDataBlock(&PendingBlocks[i]);
+        if (Status != CAB_STATUS_SUCCESS)
+        {
+            PendingCount = 0;
+            return Status;
+        }
+    }
+
+    PendingCount = 0;
+
+    /* Free the state of solid codecs for folders that are complete */
+    for (FolderNode = FolderListHead; FolderNode != NULL; FolderNode = FolderNode->Next)
+    {
+        if (FolderNode != CurrentFolderNode && FolderNode->Codec)
+        {
+            delete FolderNode->Codec;
+            FolderNode->Codec = NULL;
+        }
+    }
+
+    return CAB_STATUS_SUCCESS;
+}
+
+
+ULONG CCabinet::StoreDataBlock(PCAB_PENDING_BLOCK Block)
+/*
+ * FUNCTION: Writes a compressed block from the queue to the scratch file
+ * ARGUMENTS:
+ *     Block = Pointer to compressed block
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    PCFDATA_NODE DataNode;
+    ULONG BytesWritten;
+    ULONG Status;
+
+    DataNode = NewDataNode(Block->FolderNode);
+    if (!DataNode)
+    {
+        DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
+        return CAB_STATUS_NOMEMORY;
+    }
+
+    DataNode->Data.Checksum   = 0;
+    DataNode->Data.CompSize   = (USHORT)Block->OutputLength;
+    DataNode->Data.UncompSize = (USHORT)Block->InputLength;
+    DataNode->ScratchFilePosition = ScratchFile->Position();
+
+    DPRINT(MAX_TRACE, ("Writing block. CompSize (%u)  UncompSize (%u).\n",
+        DataNode->Data.CompSize,
+        DataNode->Data.UncompSize));
+
+    Status = ScratchFile->WriteBlock(&DataNode->Data, Block->Output, &BytesWritten);
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
+    DiskSize += sizeof(CFDATA) + BytesWritten;
+
+    Block->FolderNode->TotalFolderSize += (BytesWritten + sizeof(CFDATA));
+    Block->FolderNode->Folder.DataBlockCount++;
+
+    TotalUncompBytes += Block->InputLength;
+    TotalCompBytes   += Block->OutputLength;
+
+    return CAB_STATUS_SUCCESS;
+}
+
 #if !defined(_WIN32)
 
 void CCabinet::ConvertDateAndTime(time_t* Time,
@@ -102,6 +102,7 @@ extern ULONG DebugTraceLevel;
 #define CAB_SIGNATURE        0x4643534D // "MSCF"
 #define CAB_VERSION          0x0103
 #define CAB_BLOCKSIZE        32768
+#define CAB_MAXCOMPSIZE      (CAB_BLOCKSIZE + 6144) // Largest CFDATA payload
 
 #define CAB_COMP_MASK        0x00FF
 #define CAB_COMP_NONE        0x0000
@@ -200,6 +201,8 @@ typedef struct _CFDATA_NODE
     CFDATA         Data;
 } CFDATA_NODE, *PCFDATA_NODE;
 
+class CCABCodec;
+
 typedef struct _CFFOLDER_NODE
 {
     struct _CFFOLDER_NODE *Next;
@@ -212,6 +215,7 @@ typedef struct _CFFOLDER_NODE
     ULONG         Index;
     bool             Commit;           // true if the folder should be committed
     bool             Delete;           // true if marked for deletion
+    CCABCodec       *Codec;            // Codec state for solid codecs
     CFFOLDER         Folder;
 } CFFOLDER_NODE, *PCFFOLDER_NODE;
 
@@ -273,11 +277,18 @@ public:
                            void* InputBuffer,
                            ULONG InputLength,
                            PULONG OutputLength) = 0;
-    /* Uncompresses a data block */
+    /* Uncompresses a data block. OutputLength holds the uncompressed
+       size from the CFDATA entry on input */
     virtual ULONG Uncompress(void* OutputBuffer,
                              void* InputBuffer,
                              ULONG InputLength,
                              PULONG OutputLength) = 0;
+    /* Returns true if blocks depend on the blocks before them in the folder */
+    virtual bool IsSolid() { return false; }
+    /* Sets the compression level, 0 for the default */
+    virtual void SetLevel(ULONG Level) {};
+    /* Starts a new folder */
+    virtual void Reset(USHORT CompressionType) {};
 };
 
 
@@ -298,6 +309,20 @@ public:
 
 #ifndef CAB_READ_ONLY
 
+/* A data block waiting to be compressed on the thread pool */
+typedef struct _CAB_PENDING_BLOCK
+{
+    PCFFOLDER_NODE FolderNode;          // Folder the block belongs to
+    ULONG InputLength;
+    ULONG OutputLength;
+    ULONG Status;                       // Codec status code
+    UCHAR Input[CAB_BLOCKSIZE];
+    UCHAR Output[CAB_MAXCOMPSIZE];
+} CAB_PENDING_BLOCK, *PCAB_PENDING_BLOCK;
+
+/* Blocks queued per compression thread before they are compressed */
+#define CAB_PENDING_PER_THREAD 32
+
 class CCFDATAStorage
 {
 public:
@@ -371,6 +396,8 @@ public:
     void DestroySearchCriteria();
     /* Returns whether we have search criteria */
     bool HasSearchCriteria();
+    /* Sets the compression level, 0 for the codec default */
+    void SetCompressionLevel(ULONG Level);
 
 #ifndef CAB_READ_ONLY
     /* Creates a simple cabinet based on the search criteria data */
@@ -397,6 +424,16 @@ public:
     ULONG AddFile(char* FileName);
     /* Sets the maximum size of the current disk */
     void SetMaxDiskSize(ULONG Size);
+    /* Sets the number of compression threads, 0 for one per processor */
+    void SetThreadCount(ULONG Count);
+    /* Returns the number of compression threads */
+    ULONG GetThreadCount();
+    /* Starts a new folder when the current one holds this many bytes, 0 for never */
+    void SetFolderSizeThreshold(ULONG Size);
+    /* Returns the number of bytes compressed and what they compressed to */
+    void GetCompressionStatistics(ULONGLONG* UncompSize, ULONGLONG* CompSize);
+    /* Compresses queued data blocks. Called on each compression thread */
+    void CompressPendingBlocks(ULONG ThreadIndex);
 #endif /* CAB_READ_ONLY */
 
     /* Default event handlers */
@@ -433,7 +470,12 @@ private:
     ULONG ComputeChecksum(void* Buffer, ULONG Size, ULONG Seed);
     ULONG ReadBlock(void* Buffer, ULONG Size, PULONG BytesRead);
     bool MatchFileNamePattern(char* FileName, char* Pattern);
+    CCABCodec* CreateCodec(LONG Id);
+    ULONG SeekDataBlock(PCFDATA_NODE DataNode);
 #ifndef CAB_READ_ONLY
+    CCABCodec* GetFolderCodec(PCFFOLDER_NODE FolderNode);
+    ULONG FlushDataBlocks();
+    ULONG StoreDataBlock(PCAB_PENDING_BLOCK Block);
     ULONG InitCabinetHeader();
     ULONG WriteCabinetHeader(bool MoreDisks);
     ULONG WriteFolderEntries();
@@ -481,6 +523,8 @@ private:
     CCABCodec *Codec;
     LONG CodecId;
     bool CodecSelected;
+    ULONG CompressionLevel;
+    PCFDATA_NODE CodecDataNode;         // Last block uncompressed by a solid codec
     void* InputBuffer;
     void* CurrentIBuffer;               // Current offset in input buffer
     ULONG CurrentIBufferSize;   // Bytes left in input buffer
@@ -505,6 +549,18 @@ private:
     ULONG TotalBytesLeft;
     bool BlockIsSplit;                  // true if current data block is split
     ULONG NextFolderNumber;     // Zero based folder number
+    ULONG FolderSizeThreshold;
+    ULONG CurrentFolderSize;            // Bytes of files added to the current folder
+    ULONG ThreadCount;
+    CCABCodec **ThreadCodecs;           // Codec for each thread, for codecs that are not solid
+    PCAB_PENDING_BLOCK PendingBlocks;
+    ULONG PendingCount;
+    ULONG PendingMax;
+    PULONG TaskStart;                   // First pending block of each task
+    ULONG TaskCount;
+    volatile LONG NextTask;
+    ULONGLONG TotalUncompBytes;
+    ULONGLONG TotalCompBytes;
 #endif /* CAB_READ_ONLY */
 };
 
@@ -904,6 +904,8 @@ ULONG CDFParser::PerformSetCommand()
         SetType = stMaxDiskSize;
     else if (strcasecmp(CurrentString, "InfFileName") == 0)
         SetType = stInfFileName;
+    else if (strcasecmp(CurrentString, "FolderSizeThreshold") == 0)
+        SetType = stFolderSizeThreshold;
     else
         return CAB_STATUS_FAILURE;
 
@@ -935,7 +937,12 @@ ULONG CDFParser::PerformSetCommand()
     else if (!IsNextToken(TokenEqual, true))
             return CAB_STATUS_FAILURE;
 
-    if (SetType != stMaxDiskSize)
+    if (SetType == stFolderSizeThreshold)
+    {
+        if (!IsNextToken(TokenInteger, true))
+            return CAB_STATUS_FAILURE;
+    }
+    else if (SetType != stMaxDiskSize)
     {
         if (!IsNextToken(TokenString, true))
             return CAB_STATUS_FAILURE;
@@ -968,6 +975,11 @@ ULONG CDFParser::PerformSetCommand()
             DoInfFileName(CurrentString);
             return CAB_STATUS_SUCCESS;
 
+        case stFolderSizeThreshold:
+            FolderSizeThreshold = CurrentInteger;
+            SetFolderSizeThreshold(CurrentInteger);
+            return CAB_STATUS_SUCCESS;
+
         default:
             return CAB_STATUS_FAILURE;
     }
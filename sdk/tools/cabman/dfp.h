@@ -45,7 +45,8 @@ typedef enum
     stDiskLabel,
     stDiskLabelTemplate,
     stMaxDiskSize,
-    stInfFileName
+    stInfFileName,
+    stFolderSizeThreshold
 } SETTYPE;
 
 
@@ -0,0 +1,1468 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS cabinet manager
+ * FILE:        tools/cabman/lzx.cxx
+ * PURPOSE:     CAB codec for LZX compressed data
+ * NOTES:       The encoder writes one verbatim block per CFDATA block (or an
+ *              uncompressed block when that is smaller) and never lets a match
+ *              cross the end of a block, so every CFDATA block can be decoded
+ *              on its own once the blocks before it in the folder have been.
+ *              The decoder also reads aligned offset blocks and blocks that
+ *              span several CFDATA blocks, as written by MAKECAB.
+ */
+#include <stdio.h>
+#include "lzx.h"
+
+
+/* Format tables. These are constant so codecs can be used on several threads */
+
+static const UCHAR ExtraBits[LZX_MAX_POSITION_SLOTS + 1] =
+{
+     0,  0,  0,  0,  1,  1,  2,  2,  3,  3,  4,  4,  5,  5,  6,  6,
+     7,  7,  8,  8,  9,  9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14,
+    15, 15, 16, 16, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17,
+    17, 17, 17
+};
+
+static const ULONG PositionBase[LZX_MAX_POSITION_SLOTS + 1] =
+{
+          0,       1,       2,       3,       4,       6,       8,      12,
+         16,      24,      32,      48,      64,      96,     128,     192,
+        256,     384,     512,     768,    1024,    1536,    2048,    3072,
+       4096,    6144,    8192,   12288,   16384,   24576,   32768,   49152,
+      65536,   98304,  131072,  196608,  262144,  393216,  524288,  655360,
+     786432,  917504, 1048576, 1179648, 1310720, 1441792, 1572864, 1703936,
+    1835008, 1966080, 2097152
+};
+
+/* Match finder settings for compression levels 1 to 9 */
+static const struct
+{
+    USHORT MaxChain;
+    USHORT NiceLength;
+    bool Lazy;
+} LevelTable[9] =
+{
+    {    4,   8, false },
+    {    8,  16, false },
+    {   16,  32, false },
+    {   16,  32, true  },
+    {   32,  64, true  },
+    {   64, 128, true  },
+    {  128, 160, true  },
+    {  512, 257, true  },
+    { 2048, 257, true  },
+};
+
+#define LZX_DEFAULT_LEVEL   6
+#define LZX_NO_SYMBOL       0xFFFFFFFF
+
+
+/* Bitstream helpers. LZX packs bits MSB first into 16-bit little endian words */
+
+typedef struct _LZX_BIT_WRITER
+{
+    PUCHAR Output;
+    ULONG MaxLength;
+    ULONG Length;
+    ULONG Buffer;
+    ULONG Count;        // Bits in Buffer not yet written
+    bool Overflow;
+} LZX_BIT_WRITER, *PLZX_BIT_WRITER;
+
+typedef struct _LZX_BIT_READER
+{
+    PUCHAR Input;
+    ULONG Length;
+    ULONG Position;
+    ULONG Buffer;       // Bits left aligned
+    ULONG Count;
+    bool Error;
+} LZX_BIT_READER, *PLZX_BIT_READER;
+
+
+static void WriteBits(PLZX_BIT_WRITER Writer, ULONG Value, ULONG Bits)
+/*
+ * FUNCTION: Writes up to 16 bits to a bitstream
+ * ARGUMENTS:
+ *     Writer = Pointer to bitstream
+ *     Value  = Bits to write
+ *     Bits   = Number of bits to write
+ */
+{
+    ULONG Word;
+
+    Writer->Buffer = (Writer->Buffer << Bits) | Value;
+    Writer->Count += Bits;
+    if (Writer->Count >= 16)
+    {
+        Writer->Count -= 16;
+        Word = Writer->Buffer >> Writer->Count;
+        if (Writer->Length + 2 > Writer->MaxLength)
+        {
+            Writer->Overflow = true;
+            return;
+        }
+        Writer->Output[Writer->Length++] = (UCHAR)Word;
+        Writer->Output[Writer->Length++] = (UCHAR)(Word >> 8);
+    }
+}
+
+
+static void WriteLongBits(PLZX_BIT_WRITER Writer, ULONG Value, ULONG Bits)
+/*
+ * FUNCTION: Writes up to 32 bits to a bitstream
+ * ARGUMENTS:
+ *     Writer = Pointer to bitstream
+ *     Value  = Bits to write
+ *     Bits   = Number of bits to write
+ */
+{
+    if (Bits > 16)
+    {
+        WriteBits(Writer, Value >> 16, Bits - 16);
+        Value &= 0xFFFF;
+        Bits = 16;
+    }
+    WriteBits(Writer, Value, Bits);
+}
+
+
+static void FlushBits(PLZX_BIT_WRITER Writer)
+/*
+ * FUNCTION: Pads a bitstream to the next 16-bit boundary
+ * ARGUMENTS:
+ *     Writer = Pointer to bitstream
+ */
+{
+    if (Writer->Count > 0)
+        WriteBits(Writer, 0, 16 - Writer->Count);
+}
+
+
+static void EnsureBits(PLZX_BIT_READER Reader, ULONG Bits)
+/*
+ * FUNCTION: Makes sure that a number of bits (at most 17) are buffered
+ * ARGUMENTS:
+ *     Reader = Pointer to bitstream
+ *     Bits   = Number of bits needed
+ * NOTES:
+ *     Zeros are read past the end of the input. The caller checks
+ *     that no more bits were consumed than there were in the input
+ */
+{
+    ULONG Word;
+
+    while (Reader->Count < Bits)
+    {
+        Word = 0;
+        if (Reader->Position + 1 < Reader->Length)
+            Word = Reader->Input[Reader->Position] | (Reader->Input[Reader->Position + 1] << 8);
+        else if (Reader->Position < Reader->Length)
+            Word = Reader->Input[Reader->Position];
+        Reader->Position += 2;
+        Reader->Buffer |= Word << (16 - Reader->Count);
+        Reader->Count += 16;
+    }
+}
+
+
+static ULONG ReadBits(PLZX_BIT_READER Reader, ULONG Bits)
+/*
+ * FUNCTION: Reads up to 16 bits from a bitstream
+ * ARGUMENTS:
+ *     Reader = Pointer to bitstream
+ *     Bits   = Number of bits to read
+ * RETURNS:
+ *     The bits read
+ */
+{
+    ULONG Value;
+
+    if (Bits == 0)
+        return 0;
+
+    EnsureBits(Reader, Bits);
+    Value = Reader->Buffer >> (32 - Bits);
+    Reader->Buffer <<= Bits;
+    Reader->Count -= Bits;
+    return Value;
+}
+
+
+static ULONG ReadLongBits(PLZX_BIT_READER Reader, ULONG Bits)
+/*
+ * FUNCTION: Reads up to 32 bits from a bitstream
+ * ARGUMENTS:
+ *     Reader = Pointer to bitstream
+ *     Bits   = Number of bits to read
+ * RETURNS:
+ *     The bits read
+ */
+{
+    ULONG Value;
+
+    if (Bits <= 16)
+        return ReadBits(Reader, Bits);
+
+    Value = ReadBits(Reader, Bits - 16) << 16;
+    return Value | ReadBits(Reader, 16);
+}
+
+
+static ULONG DecodeSymbol(PLZX_BIT_READER Reader, PLZX_DECODE_TABLE Table)
+/*
+ * FUNCTION: Reads a Huffman coded symbol from a bitstream
+ * ARGUMENTS:
+ *     Reader = Pointer to bitstream
+ *     Table  = Decoding table for the Huffman tree
+ * RETURNS:
+ *     The symbol read
+ */
+{
+    USHORT Entry;
+
+    if (Table->Bits == 0)
+    {
+        Reader->Error = true;
+        return 0;
+    }
+
+    EnsureBits(Reader, 16);
+    Entry = Table->Entry[Reader->Buffer >> (32 - Table->Bits)];
+    if (Entry == 0)
+    {
+        Reader->Error = true;
+        return 0;
+    }
+    Reader->Buffer <<= (Entry & 0x1F);
+    Reader->Count -= (Entry & 0x1F);
+    return Entry >> 5;
+}
+
+
+/* Huffman trees */
+
+static int CompareKeys(const void* Key1, const void* Key2)
+{
+    ULONG A = *(const ULONG*)Key1;
+    ULONG B = *(const ULONG*)Key2;
+
+    return (A < B) ? -1 : (A > B);
+}
+
+
+static void BuildLengths(const ULONG* Frequencies, ULONG Count, PUCHAR Lengths, ULONG MaxLength)
+/*
+ * FUNCTION: Builds a length limited Huffman code
+ * ARGUMENTS:
+ *     Frequencies = Number of times each symbol is used
+ *     Count       = Number of symbols
+ *     Lengths     = Address of buffer to place code lengths (0 for unused symbols)
+ *     MaxLength   = Longest code allowed
+ * NOTES:
+ *     Symbols are sorted by frequency and then by value, so the code
+ *     only depends on the frequencies. A code is never made for a single
+ *     symbol, as LZX trees must be complete
+ */
+{
+    ULONG Scaled[LZX_MAINTREE_SYMBOLS];
+    ULONG Keys[LZX_MAINTREE_SYMBOLS];
+    ULONG Weight[LZX_MAINTREE_SYMBOLS * 2];
+    ULONG Parent[LZX_MAINTREE_SYMBOLS * 2];
+    ULONG Depth[LZX_MAINTREE_SYMBOLS * 2];
+    ULONG Used, Leaf, Node, Next, Pick[2], Longest, i, j;
+
+    for (i = 0; i < Count; i++)
+        Scaled[i] = Frequencies[i];
+
+    for (;;)
+    {
+        memset(Lengths, 0, Count);
+
+        Used = 0;
+        for (i = 0; i < Count; i++)
+        {
+            if (Scaled[i] > 0)
+                Keys[Used++] = (Scaled[i] << 10) | i;
+        }
+
+        if (Used == 0)
+            return;
+
+        if (Used == 1)
+        {
+            i = Keys[0] & 0x3FF;
+            Lengths[i] = 1;
+            Lengths[(i == 0) ? 1 : 0] = 1;
+            return;
+        }
+
+        qsort(Keys, Used, sizeof(ULONG), CompareKeys);
+
+        /* Leaves come in order of weight, and so do the nodes made from them */
+        for (i = 0; i < Used; i++)
+            Weight[i] = Keys[i] >> 10;
+
+        Leaf = 0;
+        Node = Used;
+        for (Next = Used; Next < Used * 2 - 1; Next++)
+        {
+            for (j = 0; j < 2; j++)
+            {
+                if (Leaf < Used && (Node >= Next || Weight[Leaf] <= Weight[Node]))
+                    Pick[j] = Leaf++;
+                else
+                    Pick[j] = Node++;
+            }
+            Weight[Next] = Weight[Pick[0]] + Weight[Pick[1]];
+            Parent[Pick[0]] = Next;
+            Parent[Pick[1]] = Next;
+        }
+
+        /* Parents always come after their children */
+        Depth[Next - 1] = 0;
+        Longest = 0;
+        for (i = Next - 1; i-- > 0;)
+        {
+            Depth[i] = Depth[Parent[i]] + 1;
+            if (i < Used)
+            {
+                Lengths[Keys[i] & 0x3FF] = (UCHAR)Depth[i];
+                if (Depth[i] > Longest)
+                    Longest = Depth[i];
+            }
+        }
+
+        if (Longest <= MaxLength)
+            return;
+
+        /* Flatten the distribution and try again */
+        for (i = 0; i < Count; i++)
+        {
+            if (Scaled[i] > 0)
+                Scaled[i] = (Scaled[i] >> 1) | 1;
+        }
+    }
+}
+
+
+static void MakeCodes(const UCHAR* Lengths, ULONG Count, PUSHORT Codes)
+/*
+ * FUNCTION: Assigns canonical Huffman codes
+ * ARGUMENTS:
+ *     Lengths = Code lengths
+ *     Count   = Number of symbols
+ *     Codes   = Address of buffer to place the codes
+ */
+{
+    ULONG Code = 0, Bits, i;
+
+    for (Bits = 1; Bits <= LZX_MAX_CODE_LENGTH; Bits++)
+    {
+        for (i = 0; i < Count; i++)
+        {
+            if (Lengths[i] == Bits)
+                Codes[i] = (USHORT)Code++;
+        }
+        Code <<= 1;
+    }
+}
+
+
+static bool BuildDecodeTable(PLZX_DECODE_TABLE Table, const UCHAR* Lengths, ULONG Count)
+/*
+ * FUNCTION: Builds a lookup table for decoding a Huffman tree
+ * ARGUMENTS:
+ *     Table   = Address of table to build
+ *     Lengths = Code lengths
+ *     Count   = Number of symbols
+ * RETURNS:
+ *     false if the code lengths do not describe a prefix code
+ */
+{
+    ULONG Code = 0, Bits, First, Fill, i;
+
+    Table->Bits = 0;
+    for (i = 0; i < Count; i++)
+    {
+        if (Lengths[i] > Table->Bits)
+            Table->Bits = Lengths[i];
+    }
+
+    /* An empty tree is valid as long as it is not used */
+    if (Table->Bits == 0)
+        return true;
+
+    memset(Table->Entry, 0, sizeof(USHORT) << Table->Bits);
+
+    for (Bits = 1; Bits <= Table->Bits; Bits++)
+    {
+        for (i = 0; i < Count; i++)
+        {
+            if (Lengths[i] != Bits)
+                continue;
+
+            if (Code >= (1U << Bits))
+                return false;
+
+            First = Code << (Table->Bits - Bits);
+            for (Fill = 1 << (Table->Bits - Bits); Fill > 0; Fill--)
+                Table->Entry[First++] = (USHORT)((i << 5) | Bits);
+            Code++;
+        }
+        Code <<= 1;
+    }
+    return true;
+}
+
+
+static void WriteTreeLengths(PLZX_BIT_WRITER Writer,
+                             const UCHAR* PrevLengths,
+                             const UCHAR* Lengths,
+                             ULONG Count)
+/*
+ * FUNCTION: Writes the code lengths of part of a tree, coded with a pretree
+ * ARGUMENTS:
+ *     Writer      = Pointer to bitstream
+ *     PrevLengths = Code lengths used in the previous block
+ *     Lengths     = Code lengths to write
+ *     Count       = Number of code lengths
+ */
+{
+    UCHAR Symbol[LZX_MAINTREE_SYMBOLS];
+    UCHAR Extra[LZX_MAINTREE_SYMBOLS];
+    UCHAR Delta[LZX_MAINTREE_SYMBOLS];
+    ULONG Frequencies[LZX_PRETREE_SYMBOLS];
+    UCHAR PreLengths[LZX_PRETREE_SYMBOLS];
+    USHORT PreCodes[LZX_PRETREE_SYMBOLS];
+    ULONG Items = 0, Run, Size, i;
+
+    memset(Frequencies, 0, sizeof(Frequencies));
+
+    for (i = 0; i < Count;)
+    {
+        for (Run = 1; i + Run < Count && Lengths[i + Run] == Lengths[i]; Run++);
+
+        if (Lengths[i] == 0 && Run >= 4)
+        {
+            /* Runs of zeros */
+            while (Run >= 20)
+            {
+                Size = (Run < 51) ? Run : 51;
+                Symbol[Items] = 18;
+                Extra[Items++] = (UCHAR)(Size - 20);
+                Frequencies[18]++;
+                i += Size;
+                Run -= Size;
+            }
+            if (Run >= 4)
+            {
+                Symbol[Items] = 17;
+                Extra[Items++] = (UCHAR)(Run - 4);
+                Frequencies[17]++;
+                i += Run;
+            }
+        }
+        else if (Run >= 4)
+        {
+            /* Runs of the same length */
+            Size = (Run < 5) ? Run : 5;
+            Symbol[Items] = 19;
+            Extra[Items] = (UCHAR)(Size - 4);
+            Delta[Items] = (UCHAR)((PrevLengths[i] + 17 - Lengths[i]) % 17);
+            Frequencies[19]++;
+            Frequencies[Delta[Items++]]++;
+            i += Size;
+        }
+        else
+        {
+            Symbol[Items] = (UCHAR)((PrevLengths[i] + 17 - Lengths[i]) % 17);
+            Frequencies[Symbol[Items++]]++;
+            i++;
+        }
+    }
+
+    BuildLengths(Frequencies, LZX_PRETREE_SYMBOLS, PreLengths, LZX_MAX_PRETREE_LENGTH);
+    MakeCodes(PreLengths, LZX_PRETREE_SYMBOLS, PreCodes);
+
+    for (i = 0; i < LZX_PRETREE_SYMBOLS; i++)
+        WriteBits(Writer, PreLengths[i], 4);
+
+    for (i = 0; i < Items; i++)
+    {
+        WriteBits(Writer, PreCodes[Symbol[i]], PreLengths[Symbol[i]]);
+        switch (Symbol[i])
+        {
+            case 17:
+                WriteBits(Writer, Extra[i], 4);
+                break;
+            case 18:
+                WriteBits(Writer, Extra[i], 5);
+                break;
+            case 19:
+                WriteBits(Writer, Extra[i], 1);
+                WriteBits(Writer, PreCodes[Delta[i]], PreLengths[Delta[i]]);
+                break;
+        }
+    }
+}
+
+
+static ULONG GetPositionSlot(ULONG Offset)
+/*
+ * FUNCTION: Returns the position slot of a formatted offset (distance + 2)
+ */
+{
+    ULONG Bit;
+
+    if (Offset < 4)
+        return Offset;
+    if (Offset >= 262144)
+        return 34 + (Offset >> 17);
+
+    for (Bit = 2; (Offset >> (Bit + 1)) != 0; Bit++);
+    return 2 * Bit + ((Offset >> (Bit - 1)) & 1);
+}
+
+
+static ULONG FormatMatch(ULONG Distance,
+                         ULONG Length,
+                         PULONG R,
+                         PULONG Footer,
+                         PULONG FooterBits,
+                         PULONG LengthSymbol)
+/*
+ * FUNCTION: Converts a match to LZX symbols
+ * ARGUMENTS:
+ *     Distance     = Match distance
+ *     Length       = Match length
+ *     R            = Repeated offsets, updated for the match
+ *     Footer       = Address of buffer to place the position footer
+ *     FooterBits   = Address of buffer to place the size of the footer
+ *     LengthSymbol = Address of buffer to place the length tree symbol
+ * RETURNS:
+ *     The main tree symbol
+ */
+{
+    ULONG Slot, Header;
+
+    *Footer = 0;
+    *FooterBits = 0;
+
+    if (Distance == R[0])
+    {
+        Slot = 0;
+    }
+    else if (Distance == R[1])
+    {
+        Slot = 1;
+        R[1] = R[0];
+        R[0] = Distance;
+    }
+    else if (Distance == R[2])
+    {
+        Slot = 2;
+        R[2] = R[0];
+        R[0] = Distance;
+    }
+    else
+    {
+        Slot = GetPositionSlot(Distance + 2);
+        *Footer = Distance + 2 - PositionBase[Slot];
+        *FooterBits = ExtraBits[Slot];
+        R[2] = R[1];
+        R[1] = R[0];
+        R[0] = Distance;
+    }
+
+    Header = Length - LZX_MIN_MATCH;
+    *LengthSymbol = LZX_NO_SYMBOL;
+    if (Header >= LZX_NUM_PRIMARY_LENGTHS)
+    {
+        *LengthSymbol = Header - LZX_NUM_PRIMARY_LENGTHS;
+        Header = LZX_NUM_PRIMARY_LENGTHS;
+    }
+
+    return LZX_NUM_CHARS + (Slot << 3) + Header;
+}
+
+
+static void TranslateE8(PUCHAR Data, ULONG Length, ULONG Position, LONG FileSize, bool Encode)
+/*
+ * FUNCTION: Converts E8 (CALL) targets between relative and absolute form
+ * ARGUMENTS:
+ *     Data     = Pointer to frame
+ *     Length   = Length of frame
+ *     Position = Uncompressed offset of frame in the folder
+ *     FileSize = Translation size
+ *     Encode   = true to make targets absolute, false to make them relative
+ */
+{
+    LONG Current, Value;
+    ULONG i;
+
+    if (Length <= 10)
+        return;
+
+    for (i = 0; i < Length - 10;)
+    {
+        if (Data[i] != 0xE8)
+        {
+            i++;
+            continue;
+        }
+
+        Current = (LONG)(Position + i);
+        Value = (LONG)(Data[i + 1] | (Data[i + 2] << 8) | (Data[i + 3] << 16) | ((ULONG)Data[i + 4] << 24));
+        if (Value >= -Current && Value < FileSize)
+        {
+            if (Encode)
+                Value = (Value < FileSize - Current) ? Value + Current : Value - FileSize;
+            else
+                Value = (Value >= 0) ? Value - Current : Value + FileSize;
+
+            Data[i + 1] = (UCHAR)Value;
+            Data[i + 2] = (UCHAR)(Value >> 8);
+            Data[i + 3] = (UCHAR)(Value >> 16);
+            Data[i + 4] = (UCHAR)(Value >> 24);
+        }
+        i += 5;
+    }
+}
+
+
+/* CLZXCodec */
+
+CLZXCodec::CLZXCodec()
+/*
+ * FUNCTION: Default constructor
+ */
+{
+    Buffer = NULL;
+    Prev = NULL;
+    Head = NULL;
+    TokenDistance = NULL;
+    TokenValue = NULL;
+    Window = NULL;
+    MainTable = NULL;
+    LengthTable = NULL;
+    AlignedTable = NULL;
+    PreTable = NULL;
+    WindowSize = 0;
+
+    SetLevel(0);
+    Reset(CAB_COMP_LZX | (LZX_WINDOW_BITS << 8));
+}
+
+
+CLZXCodec::~CLZXCodec()
+/*
+ * FUNCTION: Default destructor
+ */
+{
+    FreeBuffers();
+}
+
+
+void CLZXCodec::FreeBuffers()
+/*
+ * FUNCTION: Frees the encoder and decoder buffers
+ */
+{
+    if (Buffer) FreeMemory(Buffer);
+    if (Prev) FreeMemory(Prev);
+    if (Head) FreeMemory(Head);
+    if (TokenDistance) FreeMemory(TokenDistance);
+    if (TokenValue) FreeMemory(TokenValue);
+    if (Window) FreeMemory(Window);
+    if (MainTable) FreeMemory(MainTable);
+    if (LengthTable) FreeMemory(LengthTable);
+    if (AlignedTable) FreeMemory(AlignedTable);
+    if (PreTable) FreeMemory(PreTable);
+
+    Buffer = NULL;
+    Prev = NULL;
+    Head = NULL;
+    TokenDistance = NULL;
+    TokenValue = NULL;
+    Window = NULL;
+    MainTable = NULL;
+    LengthTable = NULL;
+    AlignedTable = NULL;
+    PreTable = NULL;
+}
+
+
+void CLZXCodec::SetLevel(ULONG Level)
+/*
+ * FUNCTION: Sets the compression level
+ * ARGUMENTS:
+ *     Level = Compression level from 1 (fastest) to 9 (smallest), 0 for the default
+ */
+{
+    if (Level == 0)
+        Level = LZX_DEFAULT_LEVEL;
+    if (Level > 9)
+        Level = 9;
+
+    MaxChain = LevelTable[Level - 1].MaxChain;
+    NiceLength = LevelTable[Level - 1].NiceLength;
+    Lazy = LevelTable[Level - 1].Lazy;
+}
+
+
+void CLZXCodec::Reset(USHORT CompressionType)
+/*
+ * FUNCTION: Starts a new folder
+ * ARGUMENTS:
+ *     CompressionType = Compression type of the folder, with the window size
+ */
+{
+    ULONG Bits = LZX_COMP_WINDOW(CompressionType);
+
+    if (Bits < LZX_MIN_WINDOW_BITS || Bits > LZX_MAX_WINDOW_BITS)
+    {
+        DPRINT(MID_TRACE, ("Bad LZX window size (%u).\n", (UINT)Bits));
+        Bits = LZX_WINDOW_BITS;
+        BadStream = true;
+    }
+    else
+        BadStream = false;
+
+    if ((1U << Bits) != WindowSize)
+        FreeBuffers();
+
+    WindowBits = Bits;
+    WindowSize = 1 << Bits;
+    if (Bits == 21)
+        MainSymbols = LZX_NUM_CHARS + 50 * 8;
+    else if (Bits == 20)
+        MainSymbols = LZX_NUM_CHARS + 42 * 8;
+    else
+        MainSymbols = LZX_NUM_CHARS + Bits * 2 * 8;
+
+    R0 = R1 = R2 = 1;
+    memset(MainLengths, 0, sizeof(MainLengths));
+    memset(LengthLengths, 0, sizeof(LengthLengths));
+    HeaderDone = false;
+    FrameCount = 0;
+    StreamPosition = 0;
+
+    BufferEnd = 0;
+    InsertPosition = 0;
+    TokenCount = 0;
+    if (Head)
+        memset(Head, 0xFF, LZX_HASH_SIZE * sizeof(LONG));
+
+    WindowPosition = 0;
+    BlockType = 0;
+    BlockLength = 0;
+    BlockRemaining = 0;
+    E8FileSize = 0;
+    E8Started = false;
+    memset(AlignedLengths, 0, sizeof(AlignedLengths));
+}
+
+
+bool CLZXCodec::InitializeEncoder()
+/*
+ * FUNCTION: Allocates the encoder buffers
+ * RETURNS:
+ *     false if there is not enough free memory
+ */
+{
+    Buffer = (PUCHAR)AllocateMemory(WindowSize * 2);
+    Prev = (LONG*)AllocateMemory(WindowSize * 2 * sizeof(LONG));
+    Head = (LONG*)AllocateMemory(LZX_HASH_SIZE * sizeof(LONG));
+    TokenDistance = (PULONG)AllocateMemory(CAB_BLOCKSIZE * sizeof(ULONG));
+    TokenValue = (PUSHORT)AllocateMemory(CAB_BLOCKSIZE * sizeof(USHORT));
+    if (!Buffer || !Prev || !Head || !TokenDistance || !TokenValue)
+    {
+        DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
+        FreeBuffers();
+        return false;
+    }
+
+    memset(Head, 0xFF, LZX_HASH_SIZE * sizeof(LONG));
+    return true;
+}
+
+
+void CLZXCodec::InsertHashes(ULONG Position)
+/*
+ * FUNCTION: Adds all positions before a position to the hash chains
+ * ARGUMENTS:
+ *     Position = Position in buffer
+ */
+{
+    ULONG Hash;
+
+    while (InsertPosition < Position && InsertPosition + 3 <= BufferEnd)
+    {
+        Hash = ((Buffer[InsertPosition] << 16) | (Buffer[InsertPosition + 1] << 8) |
+                Buffer[InsertPosition + 2]) * 2654435761U >> (32 - LZX_HASH_BITS);
+        Prev[InsertPosition] = Head[Hash];
+        Head[Hash] = (LONG)InsertPosition;
+        InsertPosition++;
+    }
+}
+
+
+ULONG CLZXCodec::FindMatch(ULONG Position, ULONG MaxLength, PULONG Distance)
+/*
+ * FUNCTION: Finds the longest match for a position
+ * ARGUMENTS:
+ *     Position  = Position in buffer
+ *     MaxLength = Longest match allowed
+ *     Distance  = Address of buffer to place the match distance
+ * RETURNS:
+ *     Length of the match, 0 if there is none
+ */
+{
+    PUCHAR Scan = Buffer + Position;
+    PUCHAR Match;
+    LONG Candidate, Limit;
+    ULONG Hash, Chain, Length, Best = 2;
+
+    if (MaxLength < 3)
+        return 0;
+
+    /* Matches may not reach further back than the window size - 3 */
+    Limit = (Position > WindowSize - 3) ? (LONG)(Position - (WindowSize - 3)) : 0;
+
+    Hash = ((Scan[0] << 16) | (Scan[1] << 8) | Scan[2]) * 2654435761U >> (32 - LZX_HASH_BITS);
+    Candidate = Head[Hash];
+
+    for (Chain = MaxChain; Candidate >= Limit && Chain > 0; Chain--)
+    {
+        Match = Buffer + Candidate;
+        if (Match[Best] == Scan[Best] && Match[0] == Scan[0] && Match[1] == Scan[1])
+        {
+            for (Length = 2; Length < MaxLength && Match[Length] == Scan[Length]; Length++);
+
+            if (Length > Best && (Length > 3 || Position - Candidate <= LZX_TOO_FAR))
+            {
+                Best = Length;
+                *Distance = Position - Candidate;
+                if (Best >= NiceLength || Best >= MaxLength)
+                    break;
+            }
+        }
+        Candidate = Prev[Candidate];
+    }
+
+    return (Best >= 3) ? Best : 0;
+}
+
+
+void CLZXCodec::ParseFrame(ULONG Start, ULONG Length)
+/*
+ * FUNCTION: Splits a frame into literals and matches
+ * ARGUMENTS:
+ *     Start  = Position of frame in buffer
+ *     Length = Length of frame
+ */
+{
+    ULONG End = Start + Length;
+    ULONG Position = Start;
+    ULONG MatchLength, MaxLength, Distance = 0;
+    ULONG PrevLength = 0, PrevDistance = 0;
+    bool Pending = false;
+
+    TokenCount = 0;
+
+    while (Position < End)
+    {
+        InsertHashes(Position);
+
+        MaxLength = End - Position;
+        if (MaxLength > LZX_MAX_MATCH)
+            MaxLength = LZX_MAX_MATCH;
+
+        MatchLength = 0;
+        if (!Pending || PrevLength < NiceLength)
+            MatchLength = FindMatch(Position, MaxLength, &Distance);
+
+        if (!Lazy)
+        {
+            if (MatchLength > 0)
+            {
+                TokenDistance[TokenCount] = Distance;
+                TokenValue[TokenCount++] = (USHORT)MatchLength;
+                Position += MatchLength;
+            }
+            else
+            {
+                TokenDistance[TokenCount] = 0;
+                TokenValue[TokenCount++] = Buffer[Position++];
+            }
+            continue;
+        }
+
+        /* Take the match at the previous position unless this one is longer */
+        if (Pending && PrevLength > 0 && MatchLength <= PrevLength)
+        {
+            TokenDistance[TokenCount] = PrevDistance;
+            TokenValue[TokenCount++] = (USHORT)PrevLength;
+            Position += PrevLength - 1;
+            Pending = false;
+            continue;
+        }
+
+        if (Pending)
+        {
+            TokenDistance[TokenCount] = 0;
+            TokenValue[TokenCount++] = Buffer[Position - 1];
+        }
+
+        Pending = true;
+        PrevLength = MatchLength;
+        PrevDistance = Distance;
+        Position++;
+    }
+
+    if (Pending)
+    {
+        TokenDistance[TokenCount] = 0;
+        TokenValue[TokenCount++] = Buffer[End - 1];
+    }
+}
+
+
+bool CLZXCodec::EncodeVerbatim(PUCHAR Output, ULONG MaxLength, PULONG Length, ULONG FrameLength)
+/*
+ * FUNCTION: Writes the parsed frame as a verbatim block
+ * ARGUMENTS:
+ *     Output      = Pointer to buffer to place compressed data
+ *     MaxLength   = Size of buffer
+ *     Length      = Address of buffer to place size of compressed data
+ *     FrameLength = Length of frame
+ * RETURNS:
+ *     false if the block does not fit in the buffer. The trees and
+ *     repeated offsets of the stream are only updated if it does
+ */
+{
+    ULONG MainFrequencies[LZX_MAINTREE_SYMBOLS];
+    ULONG LengthFrequencies[LZX_NUM_SECONDARY_LENGTHS];
+    UCHAR NewMainLengths[LZX_MAINTREE_SYMBOLS];
+    UCHAR NewLengthLengths[LZX_NUM_SECONDARY_LENGTHS];
+    USHORT MainCodes[LZX_MAINTREE_SYMBOLS];
+    USHORT LengthCodes[LZX_NUM_SECONDARY_LENGTHS];
+    ULONG R[3], Symbol, Footer, FooterBits, LengthSymbol, i;
+    LZX_BIT_WRITER Writer;
+
+    memset(MainFrequencies, 0, sizeof(MainFrequencies));
+    memset(LengthFrequencies, 0, sizeof(LengthFrequencies));
+
+    R[0] = R0; R[1] = R1; R[2] = R2;
+    for (i = 0; i < TokenCount; i++)
+    {
+        if (TokenDistance[i] == 0)
+        {
+            MainFrequencies[TokenValue[i]]++;
+            continue;
+        }
+
+        Symbol = FormatMatch(TokenDistance[i], TokenValue[i], R, &Footer, &FooterBits, &LengthSymbol);
+        MainFrequencies[Symbol]++;
+        if (LengthSymbol != LZX_NO_SYMBOL)
+            LengthFrequencies[LengthSymbol]++;
+    }
+
+    /* The decoder only starts E8 translation once 0xE8 has a code */
+    if (MainFrequencies[0xE8] == 0)
+        MainFrequencies[0xE8] = 1;
+
+    BuildLengths(MainFrequencies, MainSymbols, NewMainLengths, LZX_MAX_CODE_LENGTH);
+    BuildLengths(LengthFrequencies, LZX_NUM_SECONDARY_LENGTHS, NewLengthLengths, LZX_MAX_CODE_LENGTH);
+    MakeCodes(NewMainLengths, MainSymbols, MainCodes);
+    MakeCodes(NewLengthLengths, LZX_NUM_SECONDARY_LENGTHS, LengthCodes);
+
+    Writer.Output = Output;
+    Writer.MaxLength = MaxLength;
+    Writer.Length = 0;
+    Writer.Buffer = 0;
+    Writer.Count = 0;
+    Writer.Overflow = false;
+
+    if (!HeaderDone)
+    {
+        WriteBits(&Writer, 1, 1);
+        WriteLongBits(&Writer, LZX_E8_FILESIZE, 32);
+    }
+
+    WriteBits(&Writer, LZX_BLOCKTYPE_VERBATIM, 3);
+    WriteBits(&Writer, FrameLength >> 8, 16);
+    WriteBits(&Writer, FrameLength & 0xFF, 8);
+
+    WriteTreeLengths(&Writer, MainLengths, NewMainLengths, LZX_NUM_CHARS);
+    WriteTreeLengths(&Writer, MainLengths + LZX_NUM_CHARS, NewMainLengths + LZX_NUM_CHARS,
+                     MainSymbols - LZX_NUM_CHARS);
+    WriteTreeLengths(&Writer, LengthLengths, NewLengthLengths, LZX_NUM_SECONDARY_LENGTHS);
+
+    R[0] = R0; R[1] = R1; R[2] = R2;
+    for (i = 0; i < TokenCount && !Writer.Overflow; i++)
+    {
+        if (TokenDistance[i] == 0)
+        {
+            WriteBits(&Writer, MainCodes[TokenValue[i]], NewMainLengths[TokenValue[i]]);
+            continue;
+        }
+
+        Symbol = FormatMatch(TokenDistance[i], TokenValue[i], R, &Footer, &FooterBits, &LengthSymbol);
+        WriteBits(&Writer, MainCodes[Symbol], NewMainLengths[Symbol]);
+        if (LengthSymbol != LZX_NO_SYMBOL)
+            WriteBits(&Writer, LengthCodes[LengthSymbol], NewLengthLengths[LengthSymbol]);
+        if (FooterBits > 0)
+            WriteLongBits(&Writer, Footer, FooterBits);
+    }
+
+    FlushBits(&Writer);
+    if (Writer.Overflow)
+        return false;
+
+    memcpy(MainLengths, NewMainLengths, sizeof(MainLengths));
+    memcpy(LengthLengths, NewLengthLengths, sizeof(LengthLengths));
+    R0 = R[0]; R1 = R[1]; R2 = R[2];
+
+    *Length = Writer.Length;
+    return true;
+}
+
+
+ULONG CLZXCodec::EncodeUncompressed(PUCHAR Output, PUCHAR Frame, ULONG FrameLength)
+/*
+ * FUNCTION: Writes a frame as an uncompressed block
+ * ARGUMENTS:
+ *     Output      = Pointer to buffer to place compressed data
+ *     Frame       = Pointer to frame, after E8 translation
+ *     FrameLength = Length of frame
+ * RETURNS:
+ *     Size of compressed data
+ */
+{
+    LZX_BIT_WRITER Writer;
+    ULONG R[3], i;
+
+    Writer.Output = Output;
+    Writer.MaxLength = CAB_MAXCOMPSIZE;
+    Writer.Length = 0;
+    Writer.Buffer = 0;
+    Writer.Count = 0;
+    Writer.Overflow = false;
+
+    if (!HeaderDone)
+    {
+        WriteBits(&Writer, 1, 1);
+        WriteLongBits(&Writer, LZX_E8_FILESIZE, 32);
+    }
+
+    WriteBits(&Writer, LZX_BLOCKTYPE_UNCOMPRESSED, 3);
+    WriteBits(&Writer, FrameLength >> 8, 16);
+    WriteBits(&Writer, FrameLength & 0xFF, 8);
+
+    /* Align to 16 bits. 16 bits of padding are used if already aligned */
+    if (Writer.Count == 0)
+        WriteBits(&Writer, 0, 16);
+    else
+        FlushBits(&Writer);
+
+    R[0] = R0; R[1] = R1; R[2] = R2;
+    for (i = 0; i < 3; i++)
+    {
+        Output[Writer.Length++] = (UCHAR)R[i];
+        Output[Writer.Length++] = (UCHAR)(R[i] >> 8);
+        Output[Writer.Length++] = (UCHAR)(R[i] >> 16);
+        Output[Writer.Length++] = (UCHAR)(R[i] >> 24);
+    }
+
+    memcpy(Output + Writer.Length, Frame, FrameLength);
+    Writer.Length += FrameLength;
+
+    /* Uncompressed blocks are padded to an even length */
+    if (FrameLength & 1)
+        Output[Writer.Length++] = 0;
+
+    return Writer.Length;
+}
+
+
+ULONG CLZXCodec::Compress(void* OutputBuffer,
+                          void* InputBuffer,
+                          ULONG InputLength,
+                          PULONG OutputLength)
+/*
+ * FUNCTION: Compresses data in a buffer
+ * ARGUMENTS:
+ *     OutputBuffer = Pointer to buffer to place compressed data
+ *                    (at least CAB_MAXCOMPSIZE bytes)
+ *     InputBuffer  = Pointer to buffer with data to be compressed
+ *     InputLength  = Length of input buffer (at most CAB_BLOCKSIZE bytes)
+ *     OutputLength = Address of buffer to place size of compressed data
+ */
+{
+    ULONG Delta, HeaderBits, MaxLength, i;
+    PUCHAR Frame;
+
+    DPRINT(MAX_TRACE, ("InputLength (%u).\n", (UINT)InputLength));
+
+    if (InputLength == 0 || InputLength > CAB_BLOCKSIZE)
+        return CS_BADSTREAM;
+
+    if (!Buffer && !InitializeEncoder())
+        return CS_NOMEMORY;
+
+    /* Keep the last window of data at the start of the buffer */
+    if (BufferEnd + InputLength > WindowSize * 2)
+    {
+        Delta = BufferEnd - WindowSize;
+        memmove(Buffer, Buffer + Delta, WindowSize);
+        for (i = 0; i < LZX_HASH_SIZE; i++)
+            Head[i] = (Head[i] >= (LONG)Delta) ? Head[i] - (LONG)Delta : -1;
+        for (i = 0; i < WindowSize; i++)
+            Prev[i] = (Prev[i + Delta] >= (LONG)Delta) ? Prev[i + Delta] - (LONG)Delta : -1;
+        BufferEnd -= Delta;
+        InsertPosition -= Delta;
+    }
+
+    Frame = Buffer + BufferEnd;
+    memcpy(Frame, InputBuffer, InputLength);
+    if (FrameCount < LZX_E8_MAX_FRAMES)
+        TranslateE8(Frame, InputLength, StreamPosition, LZX_E8_FILESIZE, true);
+    BufferEnd += InputLength;
+
+    ParseFrame(BufferEnd - InputLength, InputLength);
+
+    /* Use a verbatim block if it is not larger than an uncompressed one */
+    HeaderBits = (HeaderDone ? 0 : 33) + 27;
+    MaxLength = (HeaderBits / 16 + 1) * 2 + 12 + InputLength + (InputLength & 1);
+    if (!EncodeVerbatim((PUCHAR)OutputBuffer, MaxLength, OutputLength, InputLength))
+        *OutputLength = EncodeUncompressed((PUCHAR)OutputBuffer, Frame, InputLength);
+
+    HeaderDone = true;
+    FrameCount++;
+    StreamPosition += InputLength;
+
+    return CS_SUCCESS;
+}
+
+
+bool CLZXCodec::InitializeDecoder()
+/*
+ * FUNCTION: Allocates the decoder buffers
+ * RETURNS:
+ *     false if there is not enough free memory
+ */
+{
+    Window = (PUCHAR)AllocateMemory(WindowSize);
+    MainTable = (PLZX_DECODE_TABLE)AllocateMemory(sizeof(LZX_DECODE_TABLE));
+    LengthTable = (PLZX_DECODE_TABLE)AllocateMemory(sizeof(LZX_DECODE_TABLE));
+    AlignedTable = (PLZX_DECODE_TABLE)AllocateMemory(sizeof(LZX_DECODE_TABLE));
+    PreTable = (PLZX_DECODE_TABLE)AllocateMemory(sizeof(LZX_DECODE_TABLE));
+    if (!Window || !MainTable || !LengthTable || !AlignedTable || !PreTable)
+    {
+        DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
+        FreeBuffers();
+        return false;
+    }
+
+    memset(Window, 0, WindowSize);
+    MainTable->Bits = 0;
+    LengthTable->Bits = 0;
+    AlignedTable->Bits = 0;
+    return true;
+}
+
+
+static bool ReadTreeLengths(PLZX_BIT_READER Reader,
+                            PLZX_DECODE_TABLE PreTable,
+                            PUCHAR Lengths,
+                            ULONG Count)
+/*
+ * FUNCTION: Reads the code lengths of part of a tree, coded with a pretree
+ * ARGUMENTS:
+ *     Reader   = Pointer to bitstream
+ *     PreTable = Buffer for the pretree decoding table
+ *     Lengths  = Code lengths of the previous block, updated in place
+ *     Count    = Number of code lengths
+ * RETURNS:
+ *     false if the code lengths are bad
+ */
+{
+    UCHAR PreLengths[LZX_PRETREE_SYMBOLS];
+    ULONG Symbol, Run, Value, i;
+
+    for (i = 0; i < LZX_PRETREE_SYMBOLS; i++)
+        PreLengths[i] = (UCHAR)ReadBits(Reader, 4);
+    if (!BuildDecodeTable(PreTable, PreLengths, LZX_PRETREE_SYMBOLS))
+        return false;
+
+    for (i = 0; i < Count && !Reader->Error;)
+    {
+        Symbol = DecodeSymbol(Reader, PreTable);
+        if (Symbol == 17 || Symbol == 18)
+        {
+            Run = (Symbol == 17) ? ReadBits(Reader, 4) + 4 : ReadBits(Reader, 5) + 20;
+            Value = 0;
+        }
+        else if (Symbol == 19)
+        {
+            Run = ReadBits(Reader, 1) + 4;
+            Symbol = DecodeSymbol(Reader, PreTable);
+            if (Symbol > 16)
+                return false;
+            Value = (Lengths[i] + 17 - Symbol) % 17;
+        }
+        else
+        {
+            Run = 1;
+            Value = (Lengths[i] + 17 - Symbol) % 17;
+        }
+
+        if (i + Run > Count)
+            return false;
+        while (Run-- > 0)
+            Lengths[i++] = (UCHAR)Value;
+    }
+
+    return !Reader->Error;
+}
+
+
+ULONG CLZXCodec::DecodeFrame(PUCHAR Input, ULONG InputLength, ULONG FrameLength)
+/*
+ * FUNCTION: Decodes a frame into the window
+ * ARGUMENTS:
+ *     Input       = Pointer to compressed data
+ *     InputLength = Length of compressed data
+ *     FrameLength = Length of frame
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    LZX_BIT_READER Reader;
+    ULONG Run, End, Symbol, Length, Slot, Extra, Offset, Source, i;
+
+    Reader.Input = Input;
+    Reader.Length = InputLength;
+    Reader.Position = 0;
+    Reader.Buffer = 0;
+    Reader.Count = 0;
+    Reader.Error = false;
+
+    if (!HeaderDone)
+    {
+        if (ReadBits(&Reader, 1))
+            E8FileSize = ReadLongBits(&Reader, 32);
+        HeaderDone = true;
+    }
+
+    while (FrameLength > 0)
+    {
+        if (BlockRemaining == 0)
+        {
+            BlockType = ReadBits(&Reader, 3);
+            BlockLength = ReadBits(&Reader, 16) << 8;
+            BlockLength |= ReadBits(&Reader, 8);
+            BlockRemaining = BlockLength;
+
+            switch (BlockType)
+            {
+                case LZX_BLOCKTYPE_ALIGNED:
+                    for (i = 0; i < LZX_ALIGNED_SYMBOLS; i++)
+                        AlignedLengths[i] = (UCHAR)ReadBits(&Reader, 3);
+                    if (!BuildDecodeTable(AlignedTable, AlignedLengths, LZX_ALIGNED_SYMBOLS))
+                        return CS_BADSTREAM;
+                    /* Fall through */
+
+                case LZX_BLOCKTYPE_VERBATIM:
+                    if (!ReadTreeLengths(&Reader, PreTable, MainLengths, LZX_NUM_CHARS) ||
+                        !ReadTreeLengths(&Reader, PreTable, MainLengths + LZX_NUM_CHARS,
+                                         MainSymbols - LZX_NUM_CHARS) ||
+                        !BuildDecodeTable(MainTable, MainLengths, MainSymbols))
+                        return CS_BADSTREAM;
+                    if (MainLengths[0xE8] != 0)
+                        E8Started = true;
+                    if (!ReadTreeLengths(&Reader, PreTable, LengthLengths, LZX_NUM_SECONDARY_LENGTHS) ||
+                        !BuildDecodeTable(LengthTable, LengthLengths, LZX_NUM_SECONDARY_LENGTHS))
+                        return CS_BADSTREAM;
+                    break;
+
+                case LZX_BLOCKTYPE_UNCOMPRESSED:
+                    E8Started = true;
+                    /* Skip to the next 16-bit boundary, or 16 bits if already there */
+                    EnsureBits(&Reader, 16);
+                    if (Reader.Count > 16)
+                        Reader.Position -= 2;
+                    Reader.Buffer = 0;
+                    Reader.Count = 0;
+                    if (Reader.Position + 12 > InputLength)
+                        return CS_BADSTREAM;
+                    for (i = 0; i < 3; i++)
+                    {
+                        Offset = Input[Reader.Position] | (Input[Reader.Position + 1] << 8) |
+                                 (Input[Reader.Position + 2] << 16) | ((ULONG)Input[Reader.Position + 3] << 24);
+                        Reader.Position += 4;
+                        if (i == 0) R0 = Offset;
+                        else if (i == 1) R1 = Offset;
+                        else R2 = Offset;
+                    }
+                    break;
+
+                default:
+                    DPRINT(MID_TRACE, ("Bad LZX block type (%u).\n", (UINT)BlockType));
+                    return CS_BADSTREAM;
+            }
+
+            if (Reader.Error || BlockLength == 0)
+                return CS_BADSTREAM;
+        }
+
+        Run = (BlockRemaining < FrameLength) ? BlockRemaining : FrameLength;
+        End = WindowPosition + Run;
+
+        if (BlockType == LZX_BLOCKTYPE_UNCOMPRESSED)
+        {
+            if (Reader.Position + Run > InputLength)
+                return CS_BADSTREAM;
+            memcpy(Window + WindowPosition, Input + Reader.Position, Run);
+            Reader.Position += Run;
+            WindowPosition = End;
+
+            /* Uncompressed blocks are padded to an even length */
+            if (Run == BlockRemaining && (BlockLength & 1))
+            {
+                if (Reader.Position >= InputLength)
+                    return CS_BADSTREAM;
+                Reader.Position++;
+            }
+        }
+        else
+        {
+            while (WindowPosition < End)
+            {
+                Symbol = DecodeSymbol(&Reader, MainTable);
+                if (Reader.Error)
+                    return CS_BADSTREAM;
+
+                if (Symbol < LZX_NUM_CHARS)
+                {
+                    Window[WindowPosition++] = (UCHAR)Symbol;
+                    continue;
+                }
+
+                Symbol -= LZX_NUM_CHARS;
+                Length = Symbol & 7;
+                if (Length == LZX_NUM_PRIMARY_LENGTHS)
+                    Length += DecodeSymbol(&Reader, LengthTable);
+                Length += LZX_MIN_MATCH;
+
+                Slot = Symbol >> 3;
+                if (Slot > 2)
+                {
+                    Extra = ExtraBits[Slot];
+                    Offset = PositionBase[Slot] - 2;
+                    if (BlockType == LZX_BLOCKTYPE_ALIGNED && Extra >= 3)
+                    {
+                        Offset += ReadLongBits(&Reader, Extra - 3) << 3;
+                        Offset += DecodeSymbol(&Reader, AlignedTable);
+                    }
+                    else
+                        Offset += ReadLongBits(&Reader, Extra);
+                    R2 = R1;
+                    R1 = R0;
+                    R0 = Offset;
+                }
+                else if (Slot == 1)
+                {
+                    Offset = R1;
+                    R1 = R0;
+                    R0 = Offset;
+                }
+                else if (Slot == 2)
+                {
+                    Offset = R2;
+                    R2 = R0;
+                    R0 = Offset;
+                }
+                else
+                    Offset = R0;
+
+                /* Matches never cross the end of a frame */
+                if (Reader.Error || WindowPosition + Length > End || Offset == 0)
+                    return CS_BADSTREAM;
+
+                Source = (WindowPosition - Offset) & (WindowSize - 1);
+                while (Length-- > 0)
+                {
+                    Window[WindowPosition++] = Window[Source];
+                    Source = (Source + 1) & (WindowSize - 1);
+                }
+            }
+        }
+
+        BlockRemaining -= Run;
+        FrameLength -= Run;
+    }
+
+    /* Check that the bits we used were really there */
+    if (Reader.Position * 8 - Reader.Count > InputLength * 8)
+        return CS_BADSTREAM;
+
+    return CS_SUCCESS;
+}
+
+
+ULONG CLZXCodec::Uncompress(void* OutputBuffer,
+                            void* InputBuffer,
+                            ULONG InputLength,
+                            PULONG OutputLength)
+/*
+ * FUNCTION: Uncompresses data in a buffer
+ * ARGUMENTS:
+ *     OutputBuffer = Pointer to buffer to place uncompressed data
+ *     InputBuffer  = Pointer to buffer with data to be uncompressed
+ *     InputLength  = Length of input buffer
+ *     OutputLength = Uncompressed size of the block. Receives the
+ *                    size of the uncompressed data
+ */
+{
+    ULONG FrameLength = *OutputLength;
+    ULONG Start, Status;
+
+    DPRINT(MAX_TRACE, ("InputLength (%u).\n", (UINT)InputLength));
+
+    if (BadStream || FrameLength == 0 || FrameLength > CAB_BLOCKSIZE)
+        return CS_BADSTREAM;
+
+    if (!Window && !InitializeDecoder())
+        return CS_NOMEMORY;
+
+    /* Frames do not wrap around the end of the window */
+    if (WindowPosition == WindowSize)
+        WindowPosition = 0;
+    if (WindowPosition + FrameLength > WindowSize)
+        return CS_BADSTREAM;
+
+    Start = WindowPosition;
+    Status = DecodeFrame((PUCHAR)InputBuffer, InputLength, FrameLength);
+    if (Status != CS_SUCCESS)
+    {
+        /* The rest of the folder cannot be decoded either */
+        BadStream = true;
+        return Status;
+    }
+
+    memcpy(OutputBuffer, Window + Start, FrameLength);
+    if (E8FileSize != 0 && E8Started && FrameCount < LZX_E8_MAX_FRAMES)
+        TranslateE8((PUCHAR)OutputBuffer, FrameLength, StreamPosition, (LONG)E8FileSize, false);
+
+    FrameCount++;
+    StreamPosition += FrameLength;
+    *OutputLength = FrameLength;
+
+    return CS_SUCCESS;
+}
+
+/* EOF */
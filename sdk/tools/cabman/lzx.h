@@ -0,0 +1,122 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS cabinet manager
+ * FILE:        tools/cabman/lzx.h
+ * PURPOSE:     CAB codec for LZX compressed data
+ */
+
+#pragma once
+
+#include "cabinet.h"
+
+/* Window used for new folders. The window size is stored
+   in bits 8-12 of the folder compression type */
+#define LZX_WINDOW_BITS             21
+#define LZX_MIN_WINDOW_BITS         15
+#define LZX_MAX_WINDOW_BITS         21
+#define LZX_COMP_WINDOW(Type)       (((Type) >> 8) & 0x1F)
+
+#define LZX_MIN_MATCH               2
+#define LZX_MAX_MATCH               257
+#define LZX_NUM_CHARS               256
+#define LZX_NUM_PRIMARY_LENGTHS     7
+#define LZX_NUM_SECONDARY_LENGTHS   249
+#define LZX_PRETREE_SYMBOLS         20
+#define LZX_ALIGNED_SYMBOLS         8
+#define LZX_MAX_POSITION_SLOTS      50
+#define LZX_MAINTREE_SYMBOLS        (LZX_NUM_CHARS + LZX_MAX_POSITION_SLOTS * 8)
+#define LZX_MAX_CODE_LENGTH         16
+#define LZX_MAX_PRETREE_LENGTH      15
+
+#define LZX_BLOCKTYPE_VERBATIM      1
+#define LZX_BLOCKTYPE_ALIGNED       2
+#define LZX_BLOCKTYPE_UNCOMPRESSED  3
+
+/* Translation size for E8 (CALL) instructions, the one MAKECAB uses */
+#define LZX_E8_FILESIZE             12000000
+/* E8 translation is only done in the first 32768 frames of a folder */
+#define LZX_E8_MAX_FRAMES           32768
+
+/* Match finder */
+#define LZX_HASH_BITS               18
+#define LZX_HASH_SIZE               (1 << LZX_HASH_BITS)
+#define LZX_TOO_FAR                 65536   // Farthest 3 byte match worth coding
+
+typedef struct _LZX_DECODE_TABLE
+{
+    ULONG Bits;                             // Longest code in the table
+    USHORT Entry[1 << LZX_MAX_CODE_LENGTH]; // (Symbol << 5) | Length, 0 if unused
+} LZX_DECODE_TABLE, *PLZX_DECODE_TABLE;
+
+class CLZXCodec : public CCABCodec
+{
+public:
+    /* Default constructor */
+    CLZXCodec();
+    /* Default destructor */
+    virtual ~CLZXCodec();
+    /* Compresses a data block */
+    virtual ULONG Compress(void* OutputBuffer,
+                           void* InputBuffer,
+                           ULONG InputLength,
+                           PULONG OutputLength);
+    /* Uncompresses a data block */
+    virtual ULONG Uncompress(void* OutputBuffer,
+                             void* InputBuffer,
+                             ULONG InputLength,
+                             PULONG OutputLength);
+    /* Blocks depend on the blocks before them in the folder */
+    virtual bool IsSolid() { return true; }
+    /* Sets the compression level */
+    virtual void SetLevel(ULONG Level);
+    /* Starts uncompressing a new folder */
+    virtual void Reset(USHORT CompressionType);
+private:
+    bool InitializeEncoder();
+    void InsertHashes(ULONG Position);
+    ULONG FindMatch(ULONG Position, ULONG MaxLength, PULONG Distance);
+    void ParseFrame(ULONG Start, ULONG Length);
+    bool EncodeVerbatim(PUCHAR Output, ULONG MaxLength, PULONG Length, ULONG FrameLength);
+    ULONG EncodeUncompressed(PUCHAR Output, PUCHAR Frame, ULONG FrameLength);
+    bool InitializeDecoder();
+    ULONG DecodeFrame(PUCHAR Input, ULONG InputLength, ULONG FrameLength);
+    void FreeBuffers();
+    /* Stream state shared by the encoder and the decoder */
+    ULONG WindowBits;
+    ULONG WindowSize;
+    ULONG MainSymbols;                  // 256 + 8 * number of position slots
+    ULONG R0, R1, R2;                   // Repeated offsets
+    UCHAR MainLengths[LZX_MAINTREE_SYMBOLS];
+    UCHAR LengthLengths[LZX_NUM_SECONDARY_LENGTHS];
+    bool HeaderDone;                    // E8 header written or read
+    ULONG FrameCount;
+    ULONG StreamPosition;               // Uncompressed offset of the frame
+    /* Encoder */
+    ULONG MaxChain;                     // Match candidates to try
+    ULONG NiceLength;                   // Stop searching at this length
+    bool Lazy;                          // Try a match at the next byte first
+    PUCHAR Buffer;                      // Window followed by the current frame
+    LONG* Prev;                         // Hash chains, by position in Buffer
+    LONG* Head;                         // Hash chain heads
+    ULONG BufferEnd;
+    ULONG InsertPosition;               // Next position to insert in the chains
+    ULONG TokenCount;
+    PULONG TokenDistance;               // 0 for literals
+    PUSHORT TokenValue;                 // Literal or match length
+    /* Decoder */
+    PUCHAR Window;
+    ULONG WindowPosition;
+    ULONG BlockType;
+    ULONG BlockLength;
+    ULONG BlockRemaining;
+    ULONG E8FileSize;
+    bool E8Started;
+    bool BadStream;
+    UCHAR AlignedLengths[LZX_ALIGNED_SYMBOLS];
+    PLZX_DECODE_TABLE MainTable;
+    PLZX_DECODE_TABLE LengthTable;
+    PLZX_DECODE_TABLE AlignedTable;
+    PLZX_DECODE_TABLE PreTable;
+};
+
+/* EOF */
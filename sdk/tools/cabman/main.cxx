@@ -16,6 +16,12 @@
 #include <stdio.h>
 #include "cabman.h"
 
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
 
 #if DBG
 
@@ -52,6 +58,22 @@ char* Pad(char* Str, char PadChar, ULONG Length)
 }
 
 
+static ULONG GetMilliseconds()
+/*
+ * FUNCTION: Returns a millisecond tick count for timing operations
+ */
+{
+#if defined(_WIN32)
+    return GetTickCount();
+#else
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (ULONG)(tv.tv_sec * 1000 + tv.tv_usec / 1000);
+#endif
+}
+
+
 char* Date2Str(char* Str, USHORT Date)
 /*
  * FUNCTION: Converts a DOS style date to a string
@@ -192,8 +214,8 @@ void CCABManager::Usage()
 {
     printf("ReactOS Cabinet Manager\n\n");
     printf("CABMAN [-D | -E] [-A] [-L dir] cabinet [filename ...]\n");
-    printf("CABMAN [-M mode] -C dirfile [-I] [-RC file] [-P dir]\n");
-    printf("CABMAN [-M mode] -S cabinet filename [...]\n");
+    printf("CABMAN [-M mode] [-Z level] [-J count] -C dirfile [-I] [-RC file] [-P dir]\n");
+    printf("CABMAN [-M mode] [-Z level] [-J count] -S cabinet filename [...]\n");
     printf("  cabinet   Cabinet file.\n");
     printf("  filename  Name of the file to add to or extract from the cabinet.\n");
     printf("            Wild cards and multiple filenames\n");
@@ -209,15 +231,19 @@ void CCABManager::Usage()
     printf("  -I        Don't create the cabinet, only the .inf file.\n");
     printf("  -L dir    Location to place extracted or generated files\n");
     printf("            (default is current directory).\n");
+    printf("  -J count  Number of threads used to compress data blocks\n");
+    printf("            (default is the number of processors).\n");
     printf("  -M mode   Specify the compression method to use:\n");
     printf("               raw    - No compression\n");
     printf("               mszip  - MsZip compression (default)\n");
+    printf("               lzx    - LZX compression\n");
     printf("  -N        Don't create the .inf file, only the cabinet.\n");
     printf("  -RC       Specify file to put in cabinet reserved area\n");
     printf("            (size must be less than 64KB).\n");
     printf("  -S        Create simple cabinet.\n");
     printf("  -P dir    Files in the .dff are relative to this directory.\n");
     printf("  -V        Verbose mode (prints more messages).\n");
+    printf("  -Z level  Compression level from 1 (fastest) to 9 (smallest).\n");
 }
 
 bool CCABManager::ParseCmdline(int argc, char* argv[])
@@ -279,6 +305,18 @@ bool CCABManager::ParseCmdline(int argc, char* argv[])
 
                     break;
 
+                case 'j':
+                case 'J':
+                    if (argv[i][2] == 0)
+                    {
+                        i++;
+                        SetThreadCount(i < argc ? atoi(&argv[i][0]) : 0);
+                    }
+                    else
+                        SetThreadCount(atoi(&argv[i][2]));
+
+                    break;
+
                 case 'm':
                 case 'M':
                     // Set the compression codec (only affects compression, not decompression)
@@ -351,6 +389,18 @@ bool CCABManager::ParseCmdline(int argc, char* argv[])
                     Verbose = true;
                     break;
 
+                case 'z':
+                case 'Z':
+                    if (argv[i][2] == 0)
+                    {
+                        i++;
+                        SetCompressionLevel(i < argc ? atoi(&argv[i][0]) : 0);
+                    }
+                    else
+                        SetCompressionLevel(atoi(&argv[i][2]));
+
+                    break;
+
                 default:
                     printf("ERROR: Bad parameter %s.\n", argv[i]);
                     return false;
@@ -555,11 +605,34 @@ bool CCABManager::ExtractFromCabinet()
 }
 
 
+void CCABManager::PrintStatistics(ULONG StartTime)
+/*
+ * FUNCTION: Display how much data was compressed and how long it took
+ * ARGUMENTS:
+ *     StartTime = Tick count from before the cabinet was created
+ */
+{
+    ULONGLONG UncompSize;
+    ULONGLONG CompSize;
+
+    GetCompressionStatistics(&UncompSize, &CompSize);
+
+    printf("\nCompressed %llu bytes into %llu bytes in %u ms using %u thread(s).\n",
+           (unsigned long long)UncompSize,
+           (unsigned long long)CompSize,
+           (UINT)(GetMilliseconds() - StartTime),
+           (UINT)GetThreadCount());
+}
+
+
 bool CCABManager::Run()
 /*
  * FUNCTION: Process cabinet
  */
 {
+    ULONG StartTime;
+    bool Result;
+
     if (Verbose)
     {
         printf("ReactOS Cabinet Manager\n\n");
@@ -568,7 +641,11 @@ bool CCABManager::Run()
     switch (Mode)
     {
         case CM_MODE_CREATE:
-            return CreateCabinet();
+            StartTime = GetMilliseconds();
+            Result = CreateCabinet();
+            if (Result && Verbose)
+                PrintStatistics(StartTime);
+            return Result;
 
         case CM_MODE_DISPLAY:
             return DisplayCabinet();
@@ -577,7 +654,11 @@ bool CCABManager::Run()
             return ExtractFromCabinet();
 
         case CM_MODE_CREATE_SIMPLE:
-            return CreateSimpleCabinet();
+            StartTime = GetMilliseconds();
+            Result = CreateSimpleCabinet();
+            if (Result && Verbose)
+                PrintStatistics(StartTime);
+            return Result;
 
         default:
             break;
@@ -41,6 +41,7 @@ CMSZipCodec::CMSZipCodec()
     ZStream.zalloc = MSZipAlloc;
     ZStream.zfree  = MSZipFree;
     ZStream.opaque = (voidpf)0;
+    Level          = Z_DEFAULT_COMPRESSION;
 }
 
 
@@ -52,6 +53,20 @@ CMSZipCodec::~CMSZipCodec()
 }
 
 
+void CMSZipCodec::SetLevel(ULONG Level)
+/*
+ * FUNCTION: Sets the deflate level used for compression
+ * ARGUMENTS:
+ *     Level = Compression level from 1 to 9, 0 for the zlib default
+ */
+{
+    if (Level == 0 || Level > 9)
+        this->Level = Z_DEFAULT_COMPRESSION;
+    else
+        this->Level = (int)Level;
+}
+
+
 ULONG CMSZipCodec::Compress(void* OutputBuffer,
                             void* InputBuffer,
                             ULONG InputLength,
@@ -79,7 +94,7 @@ ULONG CMSZipCodec::Compress(void* OutputBuffer,
 
     /* WindowBits is passed < 0 to tell that there is no zlib header */
     Status = deflateInit2(&ZStream,
-                          Z_DEFAULT_COMPRESSION,
+                          Level,
                           Z_DEFLATED,
                           -MAX_WBITS,
                           8, /* memLevel */
@@ -32,8 +32,11 @@ public:
                              void* InputBuffer,
                              ULONG InputLength,
                              PULONG OutputLength);
+    /* Sets the deflate level */
+    virtual void SetLevel(ULONG Level);
 private:
     int Status;
+    int Level;        /* Deflate level */
     z_stream ZStream; /* Zlib stream */
 };
 
@@ -0,0 +1,106 @@
+#!/bin/sh
+#
+# PROJECT:     ReactOS cabinet manager
+# LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+# PURPOSE:     Round-trips files through cabinets of every compression method
+#
+# Usage: roundtrip.sh <path to host cabman>
+#
+# Each cabinet is extracted with cabman and, when it is installed, with
+# libarchive's bsdtar as an independent decoder.
+
+CABMAN=$1
+if [ -z "$CABMAN" ] || [ ! -x "$CABMAN" ]; then
+    echo "Usage: $0 <path to host cabman>"
+    exit 2
+fi
+case $CABMAN in
+    /*) ;;
+    *) CABMAN=$PWD/$CABMAN ;;
+esac
+
+WORK=$(mktemp -d) || exit 2
+trap 'rm -rf "$WORK"' EXIT
+FAILED=0
+
+mkdir "$WORK/in"
+cd "$WORK/in" || exit 2
+
+# Random data ends up in uncompressed LZX blocks. The odd sizes get a
+# folder each, so the last block of the folder has an odd length and
+# needs a pad byte.
+for Size in 1 30137 32768 100001 123353; do
+    head -c $Size /dev/urandom > rand$Size.bin
+done
+: > empty.txt
+i=0
+while [ $i -lt 4000 ]; do
+    echo "Line $i of a compressible file"
+    i=$((i + 1))
+done > text.txt
+
+cat > ../files.dff <<DFF
+.Set CabinetNameTemplate="test.cab"
+.Set DiskLabelTemplate="test"
+text.txt 1
+empty.txt 1
+rand1.bin 1
+.New Folder
+rand30137.bin 1
+.New Folder
+rand32768.bin 1
+.New Folder
+rand100001.bin 1
+.New Folder
+rand123353.bin 1
+DFF
+
+Check()
+{
+    for File in *; do
+        if ! cmp -s "$File" "$1/$File"; then
+            echo "FAIL: $2: $File differs"
+            FAILED=1
+        fi
+    done
+}
+
+for Method in raw mszip lzx; do
+    for Threads in 1 3; do
+        Name=$Method-J$Threads
+        Out=$WORK/$Name
+        mkdir "$Out" "$Out/cabman" "$Out/bsdtar"
+
+        if ! "$CABMAN" -M $Method -J $Threads -C ../files.dff -L "$Out" -N > "$Out/log"; then
+            echo "FAIL: $Name: cabman -C"
+            FAILED=1
+            continue
+        fi
+
+        if (cd "$Out/cabman" && "$CABMAN" -E ../test.cab > /dev/null); then
+            Check "$Out/cabman" "$Name cabman -E"
+        else
+            echo "FAIL: $Name: cabman -E"
+            FAILED=1
+        fi
+
+        if command -v bsdtar > /dev/null; then
+            if bsdtar -xf "$Out/test.cab" -C "$Out/bsdtar"; then
+                Check "$Out/bsdtar" "$Name bsdtar"
+            else
+                echo "FAIL: $Name: bsdtar"
+                FAILED=1
+            fi
+        fi
+    done
+
+    if ! cmp -s "$WORK/$Method-J1/test.cab" "$WORK/$Method-J3/test.cab"; then
+        echo "FAIL: $Method: the cabinet depends on the thread count"
+        FAILED=1
+    fi
+done
+
+if [ $FAILED -eq 0 ]; then
+    echo "All round trips passed"
+fi
+exit $FAILED
@@ -0,0 +1,152 @@
+/*
+ * PROJECT:         Win32 subsystem
+ * LICENSE:         See COPYING in the top level directory
+ * FILE:            win32ss/gdi/dib/amd64/dib32bpp_blendrow.s
+ * PURPOSE:         SSE2 optimised 32bpp AlphaBlend row
+ */
+
+#include <asm.inc>
+
+.code64
+
+/*
+ * VOID
+ * DIB_32BPP_BlendRow(PULONG Dst, const ULONG *Src, ULONG Count,
+ *                    ULONG ConstAlpha, ULONG SrcAlpha);
+ *
+ * Blends Count source pixels over the destination, scaling the source by
+ * ConstAlpha and, when SrcAlpha is set, blending with the scaled source
+ * alpha instead of ConstAlpha. x / 255 is computed as (x * 0x8081) >> 23,
+ * which is exact for every product of two bytes.
+ */
+PUBLIC DIB_32BPP_BlendRow
+.PROC DIB_32BPP_BlendRow
+    sub rsp, 72
+    .allocstack 72
+    movdqa xmmword ptr [rsp], xmm6
+    .savexmm128 xmm6, 0
+    movdqa xmmword ptr [rsp + 16], xmm7
+    .savexmm128 xmm7, 16
+    movdqa xmmword ptr [rsp + 32], xmm8
+    .savexmm128 xmm8, 32
+    movdqa xmmword ptr [rsp + 48], xmm9
+    .savexmm128 xmm9, 48
+    .endprolog
+
+    mov r10d, dword ptr [rsp + 112]     /* r10d = SrcAlpha */
+
+    pxor xmm9, xmm9                     /* xmm9 = 0 */
+    pcmpeqw xmm8, xmm8
+    psrlw xmm8, 8                       /* xmm8 = 255 in each word */
+    mov eax, HEX(8081)
+    movd xmm7, eax
+    pshuflw xmm7, xmm7, 0
+    punpcklqdq xmm7, xmm7               /* xmm7 = 0x8081 in each word */
+    movd xmm6, r9d
+    pshuflw xmm6, xmm6, 0
+    punpcklqdq xmm6, xmm6               /* xmm6 = ConstAlpha in each word */
+
+    cmp r8d, 4
+    jb blendrow_tail
+
+blendrow_loop4:
+    movdqu xmm0, xmmword ptr [rdx]
+    movdqu xmm1, xmmword ptr [rcx]
+    movdqa xmm2, xmm0
+    punpcklbw xmm0, xmm9                /* xmm0 = source pixels 0, 1 */
+    punpckhbw xmm2, xmm9                /* xmm2 = source pixels 2, 3 */
+
+    cmp r9d, 255
+    je blendrow_scaled4
+    pmullw xmm0, xmm6
+    pmullw xmm2, xmm6
+    pmulhuw xmm0, xmm7
+    pmulhuw xmm2, xmm7
+    psrlw xmm0, 7
+    psrlw xmm2, 7
+blendrow_scaled4:
+
+    movdqa xmm4, xmm6
+    movdqa xmm5, xmm6
+    test r10d, r10d
+    jz blendrow_alpha4
+    pshuflw xmm4, xmm0, HEX(FF)
+    pshufhw xmm4, xmm4, HEX(FF)
+    pshuflw xmm5, xmm2, HEX(FF)
+    pshufhw xmm5, xmm5, HEX(FF)
+blendrow_alpha4:
+    movdqa xmm3, xmm8
+    psubw xmm3, xmm4                    /* xmm3 = 255 - alpha, pixels 0, 1 */
+    movdqa xmm4, xmm8
+    psubw xmm4, xmm5                    /* xmm4 = 255 - alpha, pixels 2, 3 */
+
+    movdqa xmm5, xmm1
+    punpcklbw xmm1, xmm9
+    punpckhbw xmm5, xmm9
+    pmullw xmm1, xmm3
+    pmullw xmm5, xmm4
+    pmulhuw xmm1, xmm7
+    pmulhuw xmm5, xmm7
+    psrlw xmm1, 7
+    psrlw xmm5, 7
+
+    packuswb xmm1, xmm5
+    packuswb xmm0, xmm2
+    paddusb xmm0, xmm1
+    movdqu xmmword ptr [rcx], xmm0
+
+    add rdx, 16
+    add rcx, 16
+    sub r8d, 4
+    cmp r8d, 4
+    jae blendrow_loop4
+
+blendrow_tail:
+    test r8d, r8d
+    jz blendrow_done
+
+blendrow_loop1:
+    movd xmm0, dword ptr [rdx]
+    movd xmm1, dword ptr [rcx]
+    punpcklbw xmm0, xmm9
+
+    cmp r9d, 255
+    je blendrow_scaled1
+    pmullw xmm0, xmm6
+    pmulhuw xmm0, xmm7
+    psrlw xmm0, 7
+blendrow_scaled1:
+
+    movdqa xmm4, xmm6
+    test r10d, r10d
+    jz blendrow_alpha1
+    pshuflw xmm4, xmm0, HEX(FF)
+blendrow_alpha1:
+    movdqa xmm3, xmm8
+    psubw xmm3, xmm4
+
+    punpcklbw xmm1, xmm9
+    pmullw xmm1, xmm3
+    pmulhuw xmm1, xmm7
+    psrlw xmm1, 7
+
+    packuswb xmm1, xmm1
+    packuswb xmm0, xmm0
+    paddusb xmm0, xmm1
+    movd dword ptr [rcx], xmm0
+
+    add rdx, 4
+    add rcx, 4
+    dec r8d
+    jnz blendrow_loop1
+
+blendrow_done:
+    movdqa xmm6, xmmword ptr [rsp]
+    movdqa xmm7, xmmword ptr [rsp + 16]
+    movdqa xmm8, xmmword ptr [rsp + 32]
+    movdqa xmm9, xmmword ptr [rsp + 48]
+    add rsp, 72
+    ret
+.ENDP
+
+END
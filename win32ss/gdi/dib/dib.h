@@ -122,6 +122,7 @@ BOOLEAN DIB_32BPP_BitBltSrcCopy(PBLTINFO);
 BOOLEAN DIB_32BPP_TransparentBlt(SURFOBJ*,SURFOBJ*,RECTL*,RECTL*,XLATEOBJ*,ULONG);
 BOOLEAN DIB_32BPP_ColorFill(SURFOBJ*, RECTL*, ULONG);
 BOOLEAN DIB_32BPP_AlphaBlend(SURFOBJ*, SURFOBJ*, RECTL*, RECTL*, CLIPOBJ*, XLATEOBJ*, BLENDOBJ*);
+VOID DIB_32BPP_BlendRow(PULONG, const ULONG*, ULONG, ULONG, ULONG);
 
 BOOLEAN DIB_XXBPP_StretchBlt(SURFOBJ*,SURFOBJ*,SURFOBJ*,SURFOBJ*,RECTL*,RECTL*,POINTL*,BRUSHOBJ*,POINTL*,XLATEOBJ*,ROP4);
 BOOLEAN DIB_XXBPP_FloodFillSolid(SURFOBJ*, BRUSHOBJ*, RECTL*, POINTL*, ULONG, UINT);
@@ -133,6 +134,42 @@ extern unsigned char altnotmask[2];
 
 ULONG DIB_DoRop(ULONG Rop, ULONG Dest, ULONG Source, ULONG Pattern);
 
+/* Steps a source coordinate by Num / Den per destination pixel, giving
+   Start + n * Num / Den for pixel n without dividing. */
+typedef struct _DIB_DDA
+{
+  LONG Pos;
+  LONG Step;
+  LONG Frac;
+  LONG StepFrac;
+  LONG Den;
+  LONG Dir;
+} DIB_DDA;
+
+static __inline VOID
+DIB_DdaInit(DIB_DDA *Dda, LONG Start, LONG Num, LONG Den)
+{
+  /* Rounds toward zero like the division it replaces */
+  Dda->Dir = (Num < 0) ? -1 : 1;
+  Dda->Pos = Start;
+  Dda->Step = Num / Den;
+  Dda->Frac = 0;
+  Dda->StepFrac = (Num < 0) ? -(Num % Den) : Num % Den;
+  Dda->Den = Den;
+}
+
+static __inline VOID
+DIB_DdaStep(DIB_DDA *Dda)
+{
+  Dda->Pos += Dda->Step;
+  Dda->Frac += Dda->StepFrac;
+  if (Dda->Frac >= Dda->Den)
+  {
+    Dda->Frac -= Dda->Den;
+    Dda->Pos += Dda->Dir;
+  }
+}
+
 #define DIB_GetSource(SourceSurf,sx,sy,ColorTranslation)    \
   XLATEOBJ_iXlate(ColorTranslation,                         \
     DibFunctionsForBitmapFormat[SourceSurf->iBitmapFormat]. \
@@ -341,6 +341,95 @@ Clamp8(ULONG val)
   return (val > 255) ? 255 : (UCHAR)val;
 }
 
+/* x / 255, exact for every product of two bytes */
+#define DIV255(x) (((x) * 0x8081) >> 23)
+
+#define BLEND_CHUNK 64
+
+#ifndef _M_AMD64
+VOID
+DIB_32BPP_BlendRow(PULONG Dst, const ULONG *Src, ULONG Count,
+                   ULONG ConstAlpha, ULONG SrcAlpha)
+{
+  NICEPIXEL32 DstPixel, SrcPixel;
+  ULONG Alpha;
+
+  while (Count--)
+  {
+    SrcPixel.ul = *Src++;
+    if (ConstAlpha != 255)
+    {
+      SrcPixel.col.red = DIV255(SrcPixel.col.red * ConstAlpha);
+      SrcPixel.col.green = DIV255(SrcPixel.col.green * ConstAlpha);
+      SrcPixel.col.blue = DIV255(SrcPixel.col.blue * ConstAlpha);
+      SrcPixel.col.alpha = DIV255(SrcPixel.col.alpha * ConstAlpha);
+    }
+    Alpha = 255 - (SrcAlpha ? SrcPixel.col.alpha : ConstAlpha);
+
+    DstPixel.ul = *Dst;
+    DstPixel.col.red = Clamp8(DIV255(DstPixel.col.red * Alpha) + SrcPixel.col.red);
+    DstPixel.col.green = Clamp8(DIV255(DstPixel.col.green * Alpha) + SrcPixel.col.green);
+    DstPixel.col.blue = Clamp8(DIV255(DstPixel.col.blue * Alpha) + SrcPixel.col.blue);
+    DstPixel.col.alpha = Clamp8(DIV255(DstPixel.col.alpha * Alpha) + SrcPixel.col.alpha);
+    *Dst++ = DstPixel.ul;
+  }
+}
+#endif
+
+/* Same format source without translation: blend whole rows at a time */
+static BOOLEAN
+DIB_32BPP_AlphaBlendRows(SURFOBJ* Dest, SURFOBJ* Source, RECTL* DestRect,
+                         RECTL* SourceRect, BLENDFUNCTION BlendFunc)
+{
+  LONG DstWidth = DestRect->right - DestRect->left;
+  LONG DstHeight = DestRect->bottom - DestRect->top;
+  LONG SrcWidth = SourceRect->right - SourceRect->left;
+  ULONG SrcAlpha = (BlendFunc.AlphaFormat & AC_SRC_ALPHA) != 0;
+  ULONG Buffer[BLEND_CHUNK];
+  PULONG Dst, SrcLine;
+  DIB_DDA DdaX, DdaY;
+  LONG Rows, Cols, Count, i;
+
+  if (DstWidth <= 0 || DstHeight <= 0)
+    return TRUE;
+
+  Dst = (PULONG)((ULONG_PTR)Dest->pvScan0 + (DestRect->top * Dest->lDelta) +
+    (DestRect->left << 2));
+
+  DIB_DdaInit(&DdaY, SourceRect->top, SourceRect->bottom - SourceRect->top, DstHeight);
+  for (Rows = 0; Rows < DstHeight; Rows++)
+  {
+    SrcLine = (PULONG)((ULONG_PTR)Source->pvScan0 + DdaY.Pos * Source->lDelta);
+
+    if (SrcWidth == DstWidth)
+    {
+      DIB_32BPP_BlendRow(Dst, SrcLine + SourceRect->left, DstWidth,
+                         BlendFunc.SourceConstantAlpha, SrcAlpha);
+    }
+    else
+    {
+      /* Stretch the source row in chunks, then blend each chunk */
+      DIB_DdaInit(&DdaX, SourceRect->left, SrcWidth, DstWidth);
+      for (Cols = 0; Cols < DstWidth; Cols += Count)
+      {
+        Count = min(DstWidth - Cols, BLEND_CHUNK);
+        for (i = 0; i < Count; i++)
+        {
+          Buffer[i] = SrcLine[DdaX.Pos];
+          DIB_DdaStep(&DdaX);
+        }
+        DIB_32BPP_BlendRow(Dst + Cols, Buffer, Count,
+                           BlendFunc.SourceConstantAlpha, SrcAlpha);
+      }
+    }
+
+    Dst = (PULONG)((ULONG_PTR)Dst + Dest->lDelta);
+    DIB_DdaStep(&DdaY);
+  }
+
+  return TRUE;
+}
+
 BOOLEAN
 DIB_32BPP_AlphaBlend(SURFOBJ* Dest, SURFOBJ* Source, RECTL* DestRect,
                      RECTL* SourceRect, CLIPOBJ* ClipRegion,
@@ -379,9 +468,15 @@ DIB_32BPP_AlphaBlend(SURFOBJ* Dest, SURFOBJ* Source, RECTL* DestRect,
     return FALSE;
   }
 
+  SrcBpp = BitsPerFormat(Source->iBitmapFormat);
+  if (SrcBpp == 32 &&
+      (ColorTranslation == NULL || (ColorTranslation->flXlate & XO_TRIVIAL)))
+  {
+    return DIB_32BPP_AlphaBlendRows(Dest, Source, DestRect, SourceRect, BlendFunc);
+  }
+
   Dst = (PULONG)((ULONG_PTR)Dest->pvScan0 + (DestRect->top * Dest->lDelta) +
     (DestRect->left << 2));
-  SrcBpp = BitsPerFormat(Source->iBitmapFormat);
 
   Rows = 0;
    SrcY = SourceRect->top;
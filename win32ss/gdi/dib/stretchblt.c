@@ -13,6 +13,77 @@
 #define NDEBUG
 #include <debug.h>
 
+/* SRCCOPY between surfaces of the same format: copy pixels row by row
+   instead of going through GetPixel/PutPixel */
+static BOOLEAN
+DIB_StretchBltSrcCopy(SURFOBJ *DestSurf, SURFOBJ *SourceSurf,
+                      RECTL *DestRect, RECTL *SourceRect)
+{
+  LONG DstWidth = DestRect->right - DestRect->left;
+  LONG DstHeight = DestRect->bottom - DestRect->top;
+  LONG SrcWidth = SourceRect->right - SourceRect->left;
+  ULONG Bpp = BitsPerFormat(DestSurf->iBitmapFormat) >> 3;
+  PBYTE DestLine, SourceLine;
+  DIB_DDA DdaX, DdaY;
+  LONG DesX, DesY;
+
+  DestLine = (PBYTE)DestSurf->pvScan0 + DestRect->top * DestSurf->lDelta +
+             DestRect->left * Bpp;
+
+  DIB_DdaInit(&DdaY, SourceRect->top, SourceRect->bottom - SourceRect->top, DstHeight);
+  for (DesY = 0; DesY < DstHeight; DesY++)
+  {
+    SourceLine = (PBYTE)SourceSurf->pvScan0 + DdaY.Pos * SourceSurf->lDelta;
+
+    if (SrcWidth == DstWidth)
+    {
+      RtlCopyMemory(DestLine, SourceLine + SourceRect->left * Bpp, DstWidth * Bpp);
+    }
+    else
+    {
+      DIB_DdaInit(&DdaX, SourceRect->left, SrcWidth, DstWidth);
+      switch (Bpp)
+      {
+        case 1:
+          for (DesX = 0; DesX < DstWidth; DesX++)
+          {
+            DestLine[DesX] = SourceLine[DdaX.Pos];
+            DIB_DdaStep(&DdaX);
+          }
+          break;
+        case 2:
+          for (DesX = 0; DesX < DstWidth; DesX++)
+          {
+            ((PUSHORT)DestLine)[DesX] = ((PUSHORT)SourceLine)[DdaX.Pos];
+            DIB_DdaStep(&DdaX);
+          }
+          break;
+        case 3:
+          for (DesX = 0; DesX < DstWidth; DesX++)
+          {
+            DestLine[DesX * 3] = SourceLine[DdaX.Pos * 3];
+            DestLine[DesX * 3 + 1] = SourceLine[DdaX.Pos * 3 + 1];
+            DestLine[DesX * 3 + 2] = SourceLine[DdaX.Pos * 3 + 2];
+            DIB_DdaStep(&DdaX);
+          }
+          break;
+        default:
+          for (DesX = 0; DesX < DstWidth; DesX++)
+          {
+            ((PULONG)DestLine)[DesX] = ((PULONG)SourceLine)[DdaX.Pos];
+            DIB_DdaStep(&DdaX);
+          }
+          break;
+      }
+    }
+
+    DestLine += DestSurf->lDelta;
+    DIB_DdaStep(&DdaY);
+  }
+
+  return TRUE;
+}
+
 BOOLEAN DIB_XXBPP_StretchBlt(SURFOBJ *DestSurf, SURFOBJ *SourceSurf, SURFOBJ *MaskSurf,
                             SURFOBJ *PatternSurface,
                             RECTL *DestRect, RECTL *SourceRect,
@@ -44,6 +115,7 @@ BOOLEAN DIB_XXBPP_StretchBlt(SURFOBJ *DestSurf, SURFOBJ *SourceSurf, SURFOBJ *Ma
   PFN_DIB_GetPixel fnMask_GetPixel = NULL;
 
   LONG PatternX = 0, PatternY = 0;
+  DIB_DDA DdaX, DdaY;
 
   BOOL UsesSource = ROP4_USES_SOURCE(ROP);
   BOOL UsesPattern = ROP4_USES_PATTERN(ROP);
@@ -75,6 +147,21 @@ BOOLEAN DIB_XXBPP_StretchBlt(SURFOBJ *DestSurf, SURFOBJ *SourceSurf, SURFOBJ *Ma
   SrcHeight = SourceRect->bottom - SourceRect->top;
   SrcWidth = SourceRect->right - SourceRect->left;
 
+  if (DstWidth <= 0 || DstHeight <= 0)
+    return TRUE;
+
+  if (ROP == ROP4_SRCCOPY && !MaskSurf &&
+      DestSurf->iBitmapFormat == SourceSurf->iBitmapFormat &&
+      BitsPerFormat(DestSurf->iBitmapFormat) >= 8 &&
+      (ColorTranslation == NULL || (ColorTranslation->flXlate & XO_TRIVIAL)) &&
+      SrcWidth > 0 && SrcHeight > 0 &&
+      SourceRect->left >= 0 && SourceRect->top >= 0 &&
+      SourceRect->right <= SourceSurf->sizlBitmap.cx &&
+      SourceRect->bottom <= SourceCy)
+  {
+    return DIB_StretchBltSrcCopy(DestSurf, SourceSurf, DestRect, SourceRect);
+  }
+
   /* FIXME: MaskOrigin? */
 
   switch(DestSurf->iBitmapFormat)
@@ -107,6 +194,7 @@ BOOLEAN DIB_XXBPP_StretchBlt(SURFOBJ *DestSurf, SURFOBJ *SourceSurf, SURFOBJ *Ma
   }
 
 
+  DIB_DdaInit(&DdaY, SourceRect->top, SrcHeight, DstHeight);
   for (DesY = DestRect->top; DesY < DestRect->bottom; DesY++)
   {
     if (PatternSurface)
@@ -118,15 +206,17 @@ BOOLEAN DIB_XXBPP_StretchBlt(SURFOBJ *DestSurf, SURFOBJ *SourceSurf, SURFOBJ *Ma
       }
     }
     if (UsesSource)
-      sy = SourceRect->top+(DesY - DestRect->top) * SrcHeight / DstHeight;
+      sy = DdaY.Pos;
+    DIB_DdaInit(&DdaX, SourceRect->left, SrcWidth, DstWidth);
 
     for (DesX = DestRect->left; DesX < DestRect->right; DesX++)
     {
       CanDraw = TRUE;
+      sx = DdaX.Pos;
+      DIB_DdaStep(&DdaX);
 
       if (fnMask_GetPixel)
       {
-        sx = SourceRect->left+(DesX - DestRect->left) * SrcWidth / DstWidth;
         if (sx < 0 || sy < 0 ||
           MaskSurf->sizlBitmap.cx < sx || MaskCy < sy ||
           fnMask_GetPixel(MaskSurf, sx, sy) != 0)
@@ -137,7 +227,6 @@ BOOLEAN DIB_XXBPP_StretchBlt(SURFOBJ *DestSurf, SURFOBJ *SourceSurf, SURFOBJ *Ma
 
       if (UsesSource && CanDraw)
       {
-        sx = SourceRect->left+(DesX - DestRect->left) * SrcWidth / DstWidth;
         if (sx >= 0 && sy >= 0 &&
           SourceSurf->sizlBitmap.cx > sx && SourceCy > sy)
         {
@@ -171,6 +260,7 @@ BOOLEAN DIB_XXBPP_StretchBlt(SURFOBJ *DestSurf, SURFOBJ *SourceSurf, SURFOBJ *Ma
       PatternY++;
       PatternY %= PatternSurface->sizlBitmap.cy;
     }
+    DIB_DdaStep(&DdaY);
   }
 
   return TRUE;
@@ -23,9 +23,18 @@ typedef struct _FONT_ENTRY_COLL_MEM
     FONT_ENTRY_MEM *Entry;
 } FONT_ENTRY_COLL_MEM, *PFONT_ENTRY_COLL_MEM;
 
+typedef struct _FONT_CACHE_FACE *PFONT_CACHE_FACE;
+
 typedef struct _FONT_CACHE_ENTRY
 {
-    LIST_ENTRY ListEntry;
+    LIST_ENTRY ListEntry;               /* In the LRU segment of the face */
+    struct _FONT_CACHE_ENTRY *HashNext; /* In the hash bucket */
+    PFONT_CACHE_FACE Segment;
+    ULONG Hash;
+    LONG RefCount;                      /* One for the cache, one per user */
+    ULONG LastUse;                      /* Cache clock at the last hit */
+    ULONG Placed;                       /* Cache clock when it got its LRU place */
+    SIZE_T Size;                        /* Bytes charged to the cache budget */
     int GlyphIndex;
     FT_Face Face;
     FT_BitmapGlyph BitmapGlyph;
@@ -36,6 +45,16 @@ typedef struct _FONT_CACHE_ENTRY
     MATRIX mxWorldToDevice;
 } FONT_CACHE_ENTRY, *PFONT_CACHE_ENTRY;
 
+typedef struct _FONT_CACHE_FACE
+{
+    LIST_ENTRY ListEntry;               /* In the segment list, most recent first */
+    LIST_ENTRY EntryListHead;           /* Cached glyphs, most recent first */
+    FT_Face Face;
+    SIZE_T Size;
+    ULONG LastUse;                      /* Cache clock at the last hit of a glyph */
+    ULONG Placed;                       /* Cache clock when it got its LRU place */
+} FONT_CACHE_FACE;
+
 
 /*
  * FONTSUBST_... --- constants for font substitutes
@@ -88,10 +88,31 @@ static BOOL             g_RenderingEnabled = TRUE;
 #define ASSERT_FREETYPE_LOCK_NOT_HELD() \
     ASSERT(g_FreeTypeLock->Owner != KeGetCurrentThread())
 
-#define MAX_FONT_CACHE 256
+/* The glyph cache is a hash table split into shards. Lookups only take the
+   shard lock shared, the segments and the size budget have their own lock.
+   Hits do not reorder the LRU lists, they stamp the glyph and its face with
+   the cache clock, which ticks once per insertion. Evictions read the stamps. */
+#define FONT_CACHE_SHARDS       16
+#define FONT_CACHE_BUCKETS      64      /* per shard */
+#define FONT_CACHE_MAX_SIZE     (4 * 1024 * 1024)
+
+typedef struct _FONT_CACHE_SHARD
+{
+    EX_PUSH_LOCK Lock;
+    PFONT_CACHE_ENTRY Buckets[FONT_CACHE_BUCKETS];
+} FONT_CACHE_SHARD, *PFONT_CACHE_SHARD;
+
+static FONT_CACHE_SHARD g_FontCacheShards[FONT_CACHE_SHARDS];
+static LIST_ENTRY g_FontCacheFaceListHead;
+static SIZE_T g_FontCacheSize;
+static ULONG g_FontCacheClock;
+static PFAST_MUTEX g_FontCacheLock;
+
+#define IntLockFontCache() \
+    ExEnterCriticalRegionAndAcquireFastMutexUnsafe(g_FontCacheLock)
 
-static LIST_ENTRY g_FontCacheListHead;
-static UINT g_FontCacheNumEntries;
+#define IntUnLockFontCache() \
+    ExReleaseFastMutexUnsafeAndLeaveCriticalRegion(g_FontCacheLock)
 
 static PWCHAR g_ElfScripts[32] =   /* These are in the order of the fsCsb[0] bits */
 {
@@ -253,38 +274,131 @@ SharedFace_AddRef(PSHARED_FACE Ptr)
     ++Ptr->RefCount;
 }
 
+static PFONT_CACHE_SHARD
+FontCacheShard(ULONG Hash)
+{
+    return &g_FontCacheShards[Hash % FONT_CACHE_SHARDS];
+}
+
+static PFONT_CACHE_ENTRY *
+FontCacheBucket(PFONT_CACHE_SHARD Shard, ULONG Hash)
+{
+    return &Shard->Buckets[(Hash / FONT_CACHE_SHARDS) % FONT_CACHE_BUCKETS];
+}
+
+static void
+FreeCachedEntry(PFONT_CACHE_ENTRY Entry)
+{
+    /* Only pool memory is released, this does not need the FreeType lock */
+    FT_Done_Glyph((FT_Glyph)Entry->BitmapGlyph);
+    ExFreePoolWithTag(Entry, TAG_FONT);
+}
+
+VOID APIENTRY
+ftGdiGlyphCacheRelease(PFONT_CACHE_ENTRY Entry)
+{
+    if (InterlockedDecrement(&Entry->RefCount) == 0)
+        FreeCachedEntry(Entry);
+}
+
 static void
 RemoveCachedEntry(PFONT_CACHE_ENTRY Entry)
 {
-    ASSERT_FREETYPE_LOCK_HELD();
+    PFONT_CACHE_SHARD Shard = FontCacheShard(Entry->Hash);
+    PFONT_CACHE_ENTRY *Link;
+    PFONT_CACHE_FACE Segment = Entry->Segment;
+
+    ASSERT(g_FontCacheLock->Owner == KeGetCurrentThread());
+
+    ExAcquirePushLockExclusive(&Shard->Lock);
+    for (Link = FontCacheBucket(Shard, Entry->Hash); *Link != Entry; Link = &(*Link)->HashNext)
+        ASSERT(*Link != NULL);
+    *Link = Entry->HashNext;
+    ExReleasePushLockExclusive(&Shard->Lock);
 
-    FT_Done_Glyph((FT_Glyph)Entry->BitmapGlyph);
     RemoveEntryList(&Entry->ListEntry);
-    ExFreePoolWithTag(Entry, TAG_FONT);
-    g_FontCacheNumEntries--;
-    ASSERT(g_FontCacheNumEntries <= MAX_FONT_CACHE);
+    Segment->Size -= Entry->Size;
+    g_FontCacheSize -= Entry->Size;
+
+    if (IsListEmpty(&Segment->EntryListHead))
+    {
+        RemoveEntryList(&Segment->ListEntry);
+        ExFreePoolWithTag(Segment, TAG_FONT);
+    }
+
+    /* Users that still hold the entry free it when they are done */
+    ftGdiGlyphCacheRelease(Entry);
+}
+
+/* Whether something was hit after it got its LRU place. Whatever was moved
+   during this trim (placed at Now) stays put, so hits cannot keep it going. */
+#define FONT_CACHE_USED_SINCE_PLACED(Ptr, Now) \
+    ((Ptr)->Placed != (Now) && (LONG)((Ptr)->LastUse - (Ptr)->Placed) > 0)
+
+/* Evicts glyphs of the least recently used faces until Size more bytes fit.
+   Faces and glyphs that were hit since they got their place are moved to the
+   front instead, which is when the LRU order catches up with the hits. */
+static void
+TrimFontCache(SIZE_T Size, ULONG Now)
+{
+    PFONT_CACHE_FACE Segment;
+    PFONT_CACHE_ENTRY Entry;
+
+    ASSERT(g_FontCacheLock->Owner == KeGetCurrentThread());
+
+    while (g_FontCacheSize + Size > FONT_CACHE_MAX_SIZE &&
+           !IsListEmpty(&g_FontCacheFaceListHead))
+    {
+        Segment = CONTAINING_RECORD(g_FontCacheFaceListHead.Blink, FONT_CACHE_FACE, ListEntry);
+        if (FONT_CACHE_USED_SINCE_PLACED(Segment, Now))
+        {
+            Segment->Placed = Now;
+            RemoveEntryList(&Segment->ListEntry);
+            InsertHeadList(&g_FontCacheFaceListHead, &Segment->ListEntry);
+            continue;
+        }
+
+        Entry = CONTAINING_RECORD(Segment->EntryListHead.Blink, FONT_CACHE_ENTRY, ListEntry);
+        if (FONT_CACHE_USED_SINCE_PLACED(Entry, Now))
+        {
+            Entry->Placed = Now;
+            RemoveEntryList(&Entry->ListEntry);
+            InsertHeadList(&Segment->EntryListHead, &Entry->ListEntry);
+            continue;
+        }
+
+        RemoveCachedEntry(Entry);
+    }
 }
 
 static void
 RemoveCacheEntries(FT_Face Face)
 {
-    PLIST_ENTRY CurrentEntry, NextEntry;
-    PFONT_CACHE_ENTRY FontEntry;
+    PLIST_ENTRY CurrentEntry;
+    PFONT_CACHE_FACE Segment;
 
     ASSERT_FREETYPE_LOCK_HELD();
 
-    for (CurrentEntry = g_FontCacheListHead.Flink;
-         CurrentEntry != &g_FontCacheListHead;
-         CurrentEntry = NextEntry)
+    IntLockFontCache();
+    for (CurrentEntry = g_FontCacheFaceListHead.Flink;
+         CurrentEntry != &g_FontCacheFaceListHead;
+         CurrentEntry = CurrentEntry->Flink)
     {
-        FontEntry = CONTAINING_RECORD(CurrentEntry, FONT_CACHE_ENTRY, ListEntry);
-        NextEntry = CurrentEntry->Flink;
+        Segment = CONTAINING_RECORD(CurrentEntry, FONT_CACHE_FACE, ListEntry);
+        if (Segment->Face != Face)
+            continue;
 
-        if (FontEntry->Face == Face)
+        /* The segment is freed with its last glyph */
+        while (Segment->EntryListHead.Flink != Segment->EntryListHead.Blink)
         {
-            RemoveCachedEntry(FontEntry);
+            RemoveCachedEntry(CONTAINING_RECORD(Segment->EntryListHead.Flink,
+                                                FONT_CACHE_ENTRY, ListEntry));
         }
+        RemoveCachedEntry(CONTAINING_RECORD(Segment->EntryListHead.Flink,
+                                            FONT_CACHE_ENTRY, ListEntry));
+        break;
     }
+    IntUnLockFontCache();
 }
 
 static void SharedMem_Release(PSHARED_MEM Ptr)
@@ -662,8 +776,9 @@ InitFontSupport(VOID)
     ULONG ulError;
 
     InitializeListHead(&g_FontListHead);
-    InitializeListHead(&g_FontCacheListHead);
-    g_FontCacheNumEntries = 0;
+    InitializeListHead(&g_FontCacheFaceListHead);
+    g_FontCacheSize = 0;
+    g_FontCacheClock = 0;
     /* Fast Mutexes must be allocated from non paged pool */
     g_FontListLock = ExAllocatePoolWithTag(NonPagedPool, sizeof(FAST_MUTEX), TAG_INTERNAL_SYNC);
     if (g_FontListLock == NULL)
@@ -679,6 +794,13 @@ InitFontSupport(VOID)
     }
     ExInitializeFastMutex(g_FreeTypeLock);
 
+    g_FontCacheLock = ExAllocatePoolWithTag(NonPagedPool, sizeof(FAST_MUTEX), TAG_INTERNAL_SYNC);
+    if (g_FontCacheLock == NULL)
+    {
+        return FALSE;
+    }
+    ExInitializeFastMutex(g_FontCacheLock);
+
     ulError = FT_Init_FreeType(&g_FreeTypeLibrary);
     if (ulError)
     {
@@ -3130,7 +3252,32 @@ SameScaleMatrix(
             FLOATOBJ_Equal(&pmx1->efM22, &pmx2->efM22));
 }
 
-FT_BitmapGlyph APIENTRY
+static ULONG
+FontCacheHash(
+    FT_Face Face,
+    INT GlyphIndex,
+    INT Height,
+    FT_Render_Mode RenderMode,
+    PMATRIX pmx)
+{
+    const BYTE *pb = (const BYTE *)&pmx->efM11;
+    ULONG Hash = (ULONG)((ULONG_PTR)Face >> 4);
+    SIZE_T i;
+
+    Hash = Hash * 31 + GlyphIndex;
+    Hash = Hash * 31 + Height;
+    Hash = Hash * 31 + RenderMode;
+
+    /* efM11, efM12, efM21 and efM22 are laid out next to each other */
+    for (i = 0; i < 4 * sizeof(FLOATOBJ); i++)
+        Hash = Hash * 31 + pb[i];
+
+    return Hash ^ (Hash >> 16);
+}
+
+/* Returns a referenced entry, release it with ftGdiGlyphCacheRelease.
+   This does not need the FreeType lock. */
+PFONT_CACHE_ENTRY APIENTRY
 ftGdiGlyphCacheGet(
     FT_Face Face,
     INT GlyphIndex,
@@ -3138,32 +3285,41 @@ ftGdiGlyphCacheGet(
     FT_Render_Mode RenderMode,
     PMATRIX pmx)
 {
-    PLIST_ENTRY CurrentEntry;
+    ULONG Hash = FontCacheHash(Face, GlyphIndex, Height, RenderMode, pmx);
+    PFONT_CACHE_SHARD Shard = FontCacheShard(Hash);
     PFONT_CACHE_ENTRY FontEntry;
+    ULONG Now = *(volatile ULONG *)&g_FontCacheClock;
 
-    ASSERT_FREETYPE_LOCK_HELD();
+    KeEnterCriticalRegion();
+    ExAcquirePushLockShared(&Shard->Lock);
 
-    for (CurrentEntry = g_FontCacheListHead.Flink;
-         CurrentEntry != &g_FontCacheListHead;
-         CurrentEntry = CurrentEntry->Flink)
+    for (FontEntry = *FontCacheBucket(Shard, Hash);
+         FontEntry != NULL;
+         FontEntry = FontEntry->HashNext)
     {
-        FontEntry = CONTAINING_RECORD(CurrentEntry, FONT_CACHE_ENTRY, ListEntry);
-        if ((FontEntry->Face == Face) &&
+        if ((FontEntry->Hash == Hash) &&
+            (FontEntry->Face == Face) &&
             (FontEntry->GlyphIndex == GlyphIndex) &&
             (FontEntry->Height == Height) &&
             (FontEntry->RenderMode == RenderMode) &&
             (SameScaleMatrix(&FontEntry->mxWorldToDevice, pmx)))
+        {
+            InterlockedIncrement(&FontEntry->RefCount);
+
+            /* A hashed entry keeps its segment alive while the shard lock is held.
+               Racing hits store nearly the same clock, whichever store lands will do. */
+            if (FontEntry->LastUse != Now)
+                FontEntry->LastUse = Now;
+            if (FontEntry->Segment->LastUse != Now)
+                FontEntry->Segment->LastUse = Now;
             break;
+        }
     }
 
-    if (CurrentEntry == &g_FontCacheListHead)
-    {
-        return NULL;
-    }
+    ExReleasePushLockShared(&Shard->Lock);
+    KeLeaveCriticalRegion();
 
-    RemoveEntryList(CurrentEntry);
-    InsertHeadList(&g_FontCacheListHead, CurrentEntry);
-    return FontEntry->BitmapGlyph;
+    return FontEntry;
 }
 
 /* no cache */
@@ -3208,7 +3364,8 @@ ftGdiGlyphSet(
     return BitmapGlyph;
 }
 
-FT_BitmapGlyph APIENTRY
+/* Returns a referenced entry, release it with ftGdiGlyphCacheRelease */
+PFONT_CACHE_ENTRY APIENTRY
 ftGdiGlyphCacheSet(
     FT_Face Face,
     INT GlyphIndex,
@@ -3219,9 +3376,13 @@ ftGdiGlyphCacheSet(
 {
     FT_Glyph GlyphCopy;
     INT error;
-    PFONT_CACHE_ENTRY NewEntry;
+    PFONT_CACHE_ENTRY NewEntry, *Bucket;
+    PFONT_CACHE_FACE Segment;
+    PFONT_CACHE_SHARD Shard;
+    PLIST_ENTRY CurrentEntry;
     FT_Bitmap AlignedBitmap;
     FT_BitmapGlyph BitmapGlyph;
+    ULONG Now;
 
     ASSERT_FREETYPE_LOCK_HELD();
 
@@ -3262,6 +3423,14 @@ ftGdiGlyphCacheSet(
     FT_Bitmap_Done(GlyphSlot->library, &BitmapGlyph->bitmap);
     BitmapGlyph->bitmap = AlignedBitmap;
 
+    NewEntry->HashNext = NULL;
+    NewEntry->Segment = NULL;
+    NewEntry->Hash = FontCacheHash(Face, GlyphIndex, Height, RenderMode, pmx);
+    NewEntry->RefCount = 1;
+    NewEntry->LastUse = 0;
+    NewEntry->Placed = 0;
+    NewEntry->Size = sizeof(FONT_CACHE_ENTRY) + sizeof(FT_BitmapGlyphRec) +
+                     (SIZE_T)abs(AlignedBitmap.pitch) * AlignedBitmap.rows;
     NewEntry->GlyphIndex = GlyphIndex;
     NewEntry->Face = Face;
     NewEntry->BitmapGlyph = BitmapGlyph;
@@ -3269,14 +3438,66 @@ ftGdiGlyphCacheSet(
     NewEntry->RenderMode = RenderMode;
     NewEntry->mxWorldToDevice = *pmx;
 
-    InsertHeadList(&g_FontCacheListHead, &NewEntry->ListEntry);
-    if (++g_FontCacheNumEntries > MAX_FONT_CACHE)
+    /* Glyphs bigger than a quarter of the cache are handed out uncached, so
+     * one of them never evicts most of the other faces' glyphs */
+    if (NewEntry->Size > FONT_CACHE_MAX_SIZE / 4)
+        return NewEntry;
+
+    IntLockFontCache();
+
+    /* Hits from now on stamp the next tick, so they count as after this placement */
+    Now = g_FontCacheClock++;
+
+    TrimFontCache(NewEntry->Size, Now);
+
+    for (CurrentEntry = g_FontCacheFaceListHead.Flink;
+         CurrentEntry != &g_FontCacheFaceListHead;
+         CurrentEntry = CurrentEntry->Flink)
     {
-        NewEntry = CONTAINING_RECORD(g_FontCacheListHead.Blink, FONT_CACHE_ENTRY, ListEntry);
-        RemoveCachedEntry(NewEntry);
+        Segment = CONTAINING_RECORD(CurrentEntry, FONT_CACHE_FACE, ListEntry);
+        if (Segment->Face == Face)
+            break;
     }
 
-    return BitmapGlyph;
+    if (CurrentEntry == &g_FontCacheFaceListHead)
+    {
+        Segment = ExAllocatePoolWithTag(PagedPool, sizeof(FONT_CACHE_FACE), TAG_FONT);
+        if (!Segment)
+        {
+            IntUnLockFontCache();
+            return NewEntry;
+        }
+        InitializeListHead(&Segment->EntryListHead);
+        Segment->Face = Face;
+        Segment->Size = 0;
+        Segment->LastUse = Now;
+    }
+    else
+    {
+        RemoveEntryList(&Segment->ListEntry);
+    }
+    Segment->Placed = Now;
+    InsertHeadList(&g_FontCacheFaceListHead, &Segment->ListEntry);
+
+    /* One reference for the cache and one for the caller */
+    NewEntry->RefCount = 2;
+    NewEntry->Segment = Segment;
+    NewEntry->LastUse = Now;
+    NewEntry->Placed = Now;
+    InsertHeadList(&Segment->EntryListHead, &NewEntry->ListEntry);
+    Segment->Size += NewEntry->Size;
+    g_FontCacheSize += NewEntry->Size;
+
+    Shard = FontCacheShard(NewEntry->Hash);
+    Bucket = FontCacheBucket(Shard, NewEntry->Hash);
+    ExAcquirePushLockExclusive(&Shard->Lock);
+    NewEntry->HashNext = *Bucket;
+    *Bucket = NewEntry;
+    ExReleasePushLockExclusive(&Shard->Lock);
+
+    IntUnLockFontCache();
+
+    return NewEntry;
 }
 
 
@@ -4229,6 +4450,7 @@ TextIntGetTextExtentPoint(PDC dc,
     FT_Face face;
     FT_GlyphSlot glyph;
     FT_BitmapGlyph realglyph;
+    PFONT_CACHE_ENTRY CacheEntry;
     INT error, glyph_index, i, previous;
     ULONGLONG TotalWidth64 = 0;
     BOOL use_kerning;
@@ -4272,13 +4494,18 @@ TextIntGetTextExtentPoint(PDC dc,
     {
         glyph_index = get_glyph_index_flagged(face, *String, GTEF_INDICES, fl);
 
+        realglyph = NULL;
         if (EmuBold || EmuItalic)
-            realglyph = NULL;
+            CacheEntry = NULL;
         else
-            realglyph = ftGdiGlyphCacheGet(face, glyph_index, plf->lfHeight,
-                                           RenderMode, pmxWorldToDevice);
+            CacheEntry = ftGdiGlyphCacheGet(face, glyph_index, plf->lfHeight,
+                                            RenderMode, pmxWorldToDevice);
 
-        if (EmuBold || EmuItalic || !realglyph)
+        if (CacheEntry)
+        {
+            realglyph = CacheEntry->BitmapGlyph;
+        }
+        else
         {
             if (EmuItalic)
                 error = FT_Load_Glyph(face, glyph_index, FT_LOAD_NO_BITMAP);
@@ -4301,12 +4528,14 @@ TextIntGetTextExtentPoint(PDC dc,
             }
             else
             {
-                realglyph = ftGdiGlyphCacheSet(face,
-                                               glyph_index,
-                                               plf->lfHeight,
-                                               pmxWorldToDevice,
-                                               glyph,
-                                               RenderMode);
+                CacheEntry = ftGdiGlyphCacheSet(face,
+                                                glyph_index,
+                                                plf->lfHeight,
+                                                pmxWorldToDevice,
+                                                glyph,
+                                                RenderMode);
+                if (CacheEntry)
+                    realglyph = CacheEntry->BitmapGlyph;
             }
 
             if (!realglyph)
@@ -4336,7 +4565,11 @@ TextIntGetTextExtentPoint(PDC dc,
         }
 
         /* Bold and italic do not use the cache */
-        if (EmuBold || EmuItalic)
+        if (CacheEntry)
+        {
+            ftGdiGlyphCacheRelease(CacheEntry);
+        }
+        else
         {
             FT_Done_Glyph((FT_Glyph)realglyph);
         }
@@ -5854,6 +6087,14 @@ ScaleLong(LONG lValue, PFLOATOBJ pef)
     return lValue;
 }
 
+/* A glyph of the string, resolved while holding the FreeType lock */
+typedef struct _TEXT_GLYPH
+{
+    FT_BitmapGlyph BitmapGlyph;
+    PFONT_CACHE_ENTRY CacheEntry;   /* NULL if the glyph is not cached */
+    FT_Pos Kerning;
+} TEXT_GLYPH, *PTEXT_GLYPH;
+
 BOOL
 APIENTRY
 IntExtTextOutW(
@@ -5903,8 +6144,12 @@ IntExtTextOutW(
     FLOATOBJ Scale;
     LOGFONTW *plf;
     BOOL EmuBold, EmuItalic;
-    int thickness;
+    int thickness, position;
     BOOL bResult;
+    PFONT_CACHE_ENTRY CacheEntry;
+    TEXT_GLYPH GlyphBuffer[32];
+    PTEXT_GLYPH Glyphs;
+    INT Resolved;
 
     /* Check if String is valid */
     if ((Count > 0xFFFF) || (Count > 0 && String == NULL))
@@ -6106,12 +6351,17 @@ IntExtTextOutW(
         {
             glyph_index = get_glyph_index_flagged(face, *TempText, ETO_GLYPH_INDEX, fuOptions);
 
+            realglyph = NULL;
             if (EmuBold || EmuItalic)
-                realglyph = NULL;
+                CacheEntry = NULL;
+            else
+                CacheEntry = ftGdiGlyphCacheGet(face, glyph_index, plf->lfHeight,
+                                                RenderMode, pmxWorldToDevice);
+            if (CacheEntry)
+            {
+                realglyph = CacheEntry->BitmapGlyph;
+            }
             else
-                realglyph = ftGdiGlyphCacheGet(face, glyph_index, plf->lfHeight,
-                                               RenderMode, pmxWorldToDevice);
-            if (!realglyph)
             {
                 if (EmuItalic)
                     error = FT_Load_Glyph(face, glyph_index, FT_LOAD_NO_BITMAP);
@@ -6133,12 +6383,14 @@ IntExtTextOutW(
                 }
                 else
                 {
-                    realglyph = ftGdiGlyphCacheSet(face,
-                                                   glyph_index,
-                                                   plf->lfHeight,
-                                                   pmxWorldToDevice,
-                                                   glyph,
-                                                   RenderMode);
+                    CacheEntry = ftGdiGlyphCacheSet(face,
+                                                    glyph_index,
+                                                    plf->lfHeight,
+                                                    pmxWorldToDevice,
+                                                    glyph,
+                                                    RenderMode);
+                    if (CacheEntry)
+                        realglyph = CacheEntry->BitmapGlyph;
                 }
                 if (!realglyph)
                 {
@@ -6158,11 +6410,16 @@ IntExtTextOutW(
 
             TextWidth += realglyph->root.advance.x >> 10;
 
-            if (EmuBold || EmuItalic)
+            if (CacheEntry)
+            {
+                ftGdiGlyphCacheRelease(CacheEntry);
+                CacheEntry = NULL;
+            }
+            else
             {
                 FT_Done_Glyph((FT_Glyph)realglyph);
-                realglyph = NULL;
             }
+            realglyph = NULL;
 
             previous = glyph_index;
             TempText++;
@@ -6320,21 +6577,39 @@ IntExtTextOutW(
     bResult = TRUE;
 
     /*
-     * The main rendering loop.
+     * Resolve the glyphs while holding the FreeType lock, so that the
+     * rendering loop below can run without it.
      */
-    TextLeft = RealXStart;
-    TextTop = YStart;
-    BackgroundLeft = (RealXStart + 32) >> 6;
-    for (i = 0; i < Count; ++i)
+    Glyphs = GlyphBuffer;
+    if (Count > (INT)ARRAYSIZE(GlyphBuffer))
+    {
+        Glyphs = ExAllocatePoolWithTag(PagedPool, Count * sizeof(TEXT_GLYPH), GDITAG_TEXT);
+        if (!Glyphs)
+        {
+            IntUnLockFreeType();
+            EXLATEOBJ_vCleanup(&exloRGB2Dst);
+            EXLATEOBJ_vCleanup(&exloDst2RGB);
+            bResult = FALSE;
+            goto Cleanup;
+        }
+    }
+
+    previous = 0;
+    for (Resolved = 0; Resolved < Count; ++Resolved)
     {
-        glyph_index = get_glyph_index_flagged(face, String[i], ETO_GLYPH_INDEX, fuOptions);
+        glyph_index = get_glyph_index_flagged(face, String[Resolved], ETO_GLYPH_INDEX, fuOptions);
 
+        realglyph = NULL;
         if (EmuBold || EmuItalic)
-            realglyph = NULL;
+            CacheEntry = NULL;
+        else
+            CacheEntry = ftGdiGlyphCacheGet(face, glyph_index, plf->lfHeight,
+                                            RenderMode, pmxWorldToDevice);
+        if (CacheEntry)
+        {
+            realglyph = CacheEntry->BitmapGlyph;
+        }
         else
-            realglyph = ftGdiGlyphCacheGet(face, glyph_index, plf->lfHeight,
-                                           RenderMode, pmxWorldToDevice);
-        if (!realglyph)
         {
             if (EmuItalic)
                 error = FT_Load_Glyph(face, glyph_index, FT_LOAD_NO_BITMAP);
@@ -6358,12 +6633,14 @@ IntExtTextOutW(
             }
             else
             {
-                realglyph = ftGdiGlyphCacheSet(face,
-                                               glyph_index,
-                                               plf->lfHeight,
-                                               pmxWorldToDevice,
-                                               glyph,
-                                               RenderMode);
+                CacheEntry = ftGdiGlyphCacheSet(face,
+                                                glyph_index,
+                                                plf->lfHeight,
+                                                pmxWorldToDevice,
+                                                glyph,
+                                                RenderMode);
+                if (CacheEntry)
+                    realglyph = CacheEntry->BitmapGlyph;
             }
             if (!realglyph)
             {
@@ -6373,13 +6650,45 @@ IntExtTextOutW(
             }
         }
 
-        /* retrieve kerning distance and move pen position */
+        Glyphs[Resolved].BitmapGlyph = realglyph;
+        Glyphs[Resolved].CacheEntry = CacheEntry;
+        Glyphs[Resolved].Kerning = 0;
+
+        /* retrieve kerning distance */
         if (use_kerning && previous && glyph_index && NULL == Dx)
         {
             FT_Vector delta;
             FT_Get_Kerning(face, previous, glyph_index, 0, &delta);
-            TextLeft += delta.x;
+            Glyphs[Resolved].Kerning = delta.x;
         }
+
+        previous = glyph_index;
+    }
+
+    if (!face->units_per_EM)
+    {
+        position = 0;
+    }
+    else
+    {
+        position = face->underline_position *
+            face->size->metrics.y_ppem / face->units_per_EM;
+    }
+
+    IntUnLockFreeType();
+
+    /*
+     * The main rendering loop.
+     */
+    TextLeft = RealXStart;
+    TextTop = YStart;
+    BackgroundLeft = (RealXStart + 32) >> 6;
+    for (i = 0; i < Resolved; ++i)
+    {
+        realglyph = Glyphs[i].BitmapGlyph;
+
+        /* move pen position */
+        TextLeft += Glyphs[i].Kerning;
         DPRINT("TextLeft: %I64d\n", TextLeft);
         DPRINT("TextTop: %lu\n", TextTop);
         DPRINT("Advance: %d\n", realglyph->root.advance.x);
@@ -6441,7 +6750,6 @@ IntExtTextOutW(
             if ( !HSourceGlyph )
             {
                 DPRINT1("WARNING: EngCreateBitmap() failed!\n");
-                // FT_Done_Glyph(realglyph);
                 bResult = FALSE;
                 break;
             }
@@ -6504,16 +6812,7 @@ IntExtTextOutW(
 
         if (plf->lfUnderline)
         {
-            int i, position;
-            if (!face->units_per_EM)
-            {
-                position = 0;
-            }
-            else
-            {
-                position = face->underline_position *
-                    face->size->metrics.y_ppem / face->units_per_EM;
-            }
+            int i;
             for (i = -thickness / 2; i < -thickness / 2 + thickness; ++i)
             {
                 EngLineTo(SurfObj,
@@ -6567,20 +6866,22 @@ IntExtTextOutW(
             TextTop -= Dx[2 * i + 1] << 6;
         }
 
-        previous = glyph_index;
-
-        if (EmuBold || EmuItalic)
-        {
-            FT_Done_Glyph((FT_Glyph)realglyph);
-            realglyph = NULL;
-        }
     }
 
     if (pdcattr->flTextAlign & TA_UPDATECP) {
         pdcattr->ptlCurrent.x = DestRect.right - dc->ptlDCOrig.x;
     }
 
-    IntUnLockFreeType();
+    /* Bold and italic do not use the cache */
+    for (i = 0; i < Resolved; ++i)
+    {
+        if (Glyphs[i].CacheEntry)
+            ftGdiGlyphCacheRelease(Glyphs[i].CacheEntry);
+        else
+            FT_Done_Glyph((FT_Glyph)Glyphs[i].BitmapGlyph);
+    }
+    if (Glyphs != GlyphBuffer)
+        ExFreePoolWithTag(Glyphs, GDITAG_TEXT);
 
     EXLATEOBJ_vCleanup(&exloRGB2Dst);
     EXLATEOBJ_vCleanup(&exloDst2RGB);
@@ -118,6 +118,35 @@ ExReleasePushLockExclusive(PEX_PUSH_LOCK PushLock)
     }
 }
 
+FORCEINLINE
+VOID
+ExAcquirePushLockShared(PEX_PUSH_LOCK PushLock)
+{
+    /* Try acquiring the lock while it is free */
+    if (InterlockedCompareExchangePointer(&PushLock->Ptr,
+                                          (PVOID)(EX_PUSH_LOCK_LOCK | EX_PUSH_LOCK_SHARE_INC),
+                                          NULL))
+    {
+        /* Someone holds it, use the slow path */
+        ExfAcquirePushLockShared(PushLock);
+    }
+}
+
+FORCEINLINE
+VOID
+ExReleasePushLockShared(PEX_PUSH_LOCK PushLock)
+{
+    /* Try releasing the lock if we are the only sharer */
+    if (InterlockedCompareExchangePointer(&PushLock->Ptr,
+                                          NULL,
+                                          (PVOID)(EX_PUSH_LOCK_LOCK | EX_PUSH_LOCK_SHARE_INC)) !=
+        (PVOID)(EX_PUSH_LOCK_LOCK | EX_PUSH_LOCK_SHARE_INC))
+    {
+        /* There are other sharers or waiters, use the slow path */
+        ExfReleasePushLockShared(PushLock);
+    }
+}
+
 FORCEINLINE
 VOID
 _ExInitializePushLock(PEX_PUSH_LOCK Lock)
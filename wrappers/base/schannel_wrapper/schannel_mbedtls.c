@@ -34,12 +34,15 @@
  #include "schannel.h"
  #include "wine/debug.h"
  #include "wine/library.h"
+ #include "wine/list.h"
 #endif
 
 WINE_DEFAULT_DEBUG_CHANNEL(schannel);
 
 #if defined(SONAME_LIBMBEDTLS) && !defined(HAVE_SECURITY_SECURITY_H) && !defined(SONAME_LIBGNUTLS)
 
+#include <string.h>
+
 #include <mbedtls/ssl.h>
 #include <mbedtls/net_sockets.h>
 
@@ -47,6 +50,12 @@ WINE_DEFAULT_DEBUG_CHANNEL(schannel);
 #include <mbedtls/ctr_drbg.h>
 #include <mbedtls/md_internal.h>
 #include <mbedtls/ssl_internal.h>
+#include <mbedtls/ssl_ticket.h>
+
+/* servers hand out session tickets only when mbedTLS is built with both */
+#if defined(MBEDTLS_SSL_SRV_C) && defined(MBEDTLS_SSL_TICKET_C)
+ #define ROS_SCHAN_SERVER_TICKETS
+#endif
 
 #define ROS_SCHAN_IS_BLOCKING(read_len)          ((read_len & 0xFFF00000) == 0xCCC00000)
 #define ROS_SCHAN_IS_BLOCKING_MARSHALL(read_len) ((read_len & 0x000FFFFF) |  0xCCC00000)
@@ -68,15 +77,52 @@ WINE_DEFAULT_DEBUG_CHANNEL(schannel);
  #endif
 #endif
 
+/* seeding a random generator and building a configuration is expensive, so
+   every session of a credential handle shares the ones of the credential */
 typedef struct
 {
-    mbedtls_ssl_context      ssl;
     mbedtls_ssl_config       conf;
     mbedtls_entropy_context  entropy;
     mbedtls_ctr_drbg_context ctr_drbg;
+#ifdef ROS_SCHAN_SERVER_TICKETS
+    mbedtls_ssl_ticket_context ticket;
+#endif
+    CRITICAL_SECTION         lock;    /* the generator and ticket keys are not thread-safe */
+    LONG                     ref;     /* one for the handle, one for each session */
+    DWORD                    session_lifespan;
+    CRITICAL_SECTION         cache_lock;
+    struct list              session_cache;
+    unsigned int             session_cache_count;
+} MBEDTLS_CREDENTIALS, *PMBEDTLS_CREDENTIALS;
+
+typedef struct
+{
+    mbedtls_ssl_context      ssl;
+    MBEDTLS_CREDENTIALS     *cred;
+    char                    *target;
     struct schan_transport  *transport;
+    BOOL                     offered;   /* a cached session was offered to the server */
+    BOOL                     resumed;   /* and the server took it */
+    unsigned char            offered_master[48];
 } MBEDTLS_SESSION, *PMBEDTLS_SESSION;
 
+/* client sessions that can be resumed with an abbreviated handshake; every
+   credential keeps its own, by target and in most recently used order, so a
+   session is never offered on behalf of another credential */
+typedef struct
+{
+    struct list              entry;
+    char                    *target;
+    DWORD                    expiry;
+    mbedtls_ssl_session      session;
+} MBEDTLS_CACHED_SESSION, *PMBEDTLS_CACHED_SESSION;
+
+#define SCHAN_SESSION_CACHE_SIZE        64
+#define SCHAN_SESSION_DEFAULT_LIFESPAN  (10 * 60 * 60 * 1000) /* ten hours, as in Windows */
+#define SCHAN_TICKET_LIFETIME           (24 * 60 * 60)
+
+static void schan_session_cache_flush(MBEDTLS_CREDENTIALS *c);
+
 /* custom `net_recv` callback adapter, mbedTLS uses it in mbedtls_ssl_read for
    pulling data from the underlying win32 net stack */
 static int schan_pull_adapter(void *session, unsigned char *buff, size_t buff_len)
@@ -185,51 +231,284 @@ static void schan_imp_debug(void *ctx, int level, const char *file, int line, co
     WARN("MBEDTLS schan_imp_debug: %s:%04d: %s\n", file, line, str);
 }
 
+/* `f_rng` callback for the configuration of a credential, serializes the
+   sessions that are handshaking at the same time on its generator */
+static int schan_drbg_random(void *p_rng, unsigned char *output, size_t output_len)
+{
+    MBEDTLS_CREDENTIALS *c = p_rng;
+    int ret;
+
+    EnterCriticalSection(&c->lock);
+    ret = mbedtls_ctr_drbg_random(&c->ctr_drbg, output, output_len);
+    LeaveCriticalSection(&c->lock);
+
+    return ret;
+}
+
+#ifdef ROS_SCHAN_SERVER_TICKETS
+static int schan_ticket_write(void *p_ticket, const mbedtls_ssl_session *session,
+                              unsigned char *start, const unsigned char *end,
+                              size_t *tlen, uint32_t *lifetime)
+{
+    MBEDTLS_CREDENTIALS *c = p_ticket;
+    int ret;
+
+    EnterCriticalSection(&c->lock);
+    ret = mbedtls_ssl_ticket_write(&c->ticket, session, start, end, tlen, lifetime);
+    LeaveCriticalSection(&c->lock);
+
+    return ret;
+}
+
+static int schan_ticket_parse(void *p_ticket, mbedtls_ssl_session *session,
+                              unsigned char *buf, size_t len)
+{
+    MBEDTLS_CREDENTIALS *c = p_ticket;
+    int ret;
+
+    EnterCriticalSection(&c->lock);
+    ret = mbedtls_ssl_ticket_parse(&c->ticket, session, buf, len);
+    LeaveCriticalSection(&c->lock);
+
+    return ret;
+}
+#endif
+
+static void schan_release_credentials(MBEDTLS_CREDENTIALS *c)
+{
+    if (InterlockedDecrement(&c->ref))
+        return;
+
+    TRACE("MBEDTLS schan_release_credentials: freeing %p\n", c);
+
+    schan_session_cache_flush(c);
+    DeleteCriticalSection(&c->cache_lock);
+
+#ifdef ROS_SCHAN_SERVER_TICKETS
+    mbedtls_ssl_ticket_free(&c->ticket);
+#endif
+    mbedtls_ssl_config_free(&c->conf);
+    mbedtls_ctr_drbg_free(&c->ctr_drbg);
+    mbedtls_entropy_free(&c->entropy);
+    DeleteCriticalSection(&c->lock);
+
+    HeapFree(GetProcessHeap(), 0, c);
+}
+
+/* the session cache must be locked by the caller of these */
+static void schan_session_cache_free_entry(MBEDTLS_CREDENTIALS *c, MBEDTLS_CACHED_SESSION *cached)
+{
+    list_remove(&cached->entry);
+    c->session_cache_count--;
+
+    mbedtls_ssl_session_free(&cached->session);
+    HeapFree(GetProcessHeap(), 0, cached->target);
+    HeapFree(GetProcessHeap(), 0, cached);
+}
+
+static MBEDTLS_CACHED_SESSION *schan_session_cache_find(MBEDTLS_CREDENTIALS *c, const char *target)
+{
+    MBEDTLS_CACHED_SESSION *cached;
+
+    LIST_FOR_EACH_ENTRY(cached, &c->session_cache, MBEDTLS_CACHED_SESSION, entry)
+    {
+        if (strcmp(cached->target, target))
+            continue;
+
+        if ((LONG)(GetTickCount() - cached->expiry) >= 0)
+        {
+            TRACE("MBEDTLS cached session for %s expired\n", target);
+            schan_session_cache_free_entry(c, cached);
+            return NULL;
+        }
+
+        return cached;
+    }
+
+    return NULL;
+}
+
+static BOOL schan_session_is_resumable(const mbedtls_ssl_session *session)
+{
+#if defined(MBEDTLS_SSL_SESSION_TICKETS) && defined(MBEDTLS_SSL_CLI_C)
+    if (session->ticket_len)
+        return TRUE;
+#endif
+    return session->id_len != 0;
+}
+
+static BOOL schan_session_equal(const mbedtls_ssl_session *a, const mbedtls_ssl_session *b)
+{
+    if (a->id_len != b->id_len || memcmp(a->id, b->id, a->id_len))
+        return FALSE;
+
+#if defined(MBEDTLS_SSL_SESSION_TICKETS) && defined(MBEDTLS_SSL_CLI_C)
+    /* servers may hand out a new ticket when resuming */
+    if (a->ticket_len != b->ticket_len || (a->ticket_len && memcmp(a->ticket, b->ticket, a->ticket_len)))
+        return FALSE;
+#endif
+
+    return TRUE;
+}
+
+/* offer the last session of the credential with this target to the server */
+static void schan_session_cache_resume(MBEDTLS_SESSION *s)
+{
+    MBEDTLS_CREDENTIALS *c = s->cred;
+    MBEDTLS_CACHED_SESSION *cached;
+    int ret;
+
+    EnterCriticalSection(&c->cache_lock);
+
+    if ((cached = schan_session_cache_find(c, s->target)))
+    {
+        if ((ret = mbedtls_ssl_set_session(&s->ssl, &cached->session)))
+        {
+            WARN("MBEDTLS mbedtls_ssl_set_session failed with -%#x\n", -ret);
+        }
+        else
+        {
+            TRACE("MBEDTLS resuming session for %s\n", s->target);
+
+            /* a full handshake never ends up with the master secret of the
+               session we offered, an abbreviated one always does */
+            memcpy(s->offered_master, cached->session.master, sizeof(s->offered_master));
+            s->offered = TRUE;
+
+            list_remove(&cached->entry);
+            list_add_head(&c->session_cache, &cached->entry);
+        }
+    }
+
+    LeaveCriticalSection(&c->cache_lock);
+}
+
+/* remember the session of a completed client handshake */
+static void schan_session_cache_store(MBEDTLS_SESSION *s)
+{
+    MBEDTLS_CREDENTIALS *c = s->cred;
+    MBEDTLS_CACHED_SESSION *cached, *entry;
+    DWORD lifespan = c->session_lifespan ? c->session_lifespan : SCHAN_SESSION_DEFAULT_LIFESPAN;
+    int ret;
+
+    if (!s->ssl.session || !schan_session_is_resumable(s->ssl.session))
+        return;
+
+    EnterCriticalSection(&c->cache_lock);
+
+    /* after an abbreviated handshake the cached session is still the right one */
+    if ((cached = schan_session_cache_find(c, s->target)) &&
+        schan_session_equal(&cached->session, s->ssl.session))
+    {
+        list_remove(&cached->entry);
+        list_add_head(&c->session_cache, &cached->entry);
+        LeaveCriticalSection(&c->cache_lock);
+        return;
+    }
+
+    LeaveCriticalSection(&c->cache_lock);
+
+    /* copying the session parses the peer certificate again, keep it out of the lock */
+    entry = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*entry));
+    if (!entry)
+        return;
+
+    mbedtls_ssl_session_init(&entry->session);
+
+    entry->target = HeapAlloc(GetProcessHeap(), 0, strlen(s->target) + 1);
+    if (!entry->target || (ret = mbedtls_ssl_get_session(&s->ssl, &entry->session)))
+    {
+        WARN("MBEDTLS could not cache the session for %s\n", s->target);
+        mbedtls_ssl_session_free(&entry->session);
+        HeapFree(GetProcessHeap(), 0, entry->target);
+        HeapFree(GetProcessHeap(), 0, entry);
+        return;
+    }
+
+    strcpy(entry->target, s->target);
+    entry->expiry = GetTickCount() + lifespan;
+
+    EnterCriticalSection(&c->cache_lock);
+
+    if ((cached = schan_session_cache_find(c, s->target)))
+        schan_session_cache_free_entry(c, cached);
+    else if (c->session_cache_count >= SCHAN_SESSION_CACHE_SIZE)
+        schan_session_cache_free_entry(c, LIST_ENTRY(list_tail(&c->session_cache), MBEDTLS_CACHED_SESSION, entry));
+
+    list_add_head(&c->session_cache, &entry->entry);
+    c->session_cache_count++;
+
+    TRACE("MBEDTLS cached session for %s in %p (%u cached)\n", s->target, c, c->session_cache_count);
+
+    LeaveCriticalSection(&c->cache_lock);
+}
+
+static void schan_session_cache_remove(MBEDTLS_CREDENTIALS *c, const char *target)
+{
+    MBEDTLS_CACHED_SESSION *cached;
+
+    EnterCriticalSection(&c->cache_lock);
+
+    if ((cached = schan_session_cache_find(c, target)))
+        schan_session_cache_free_entry(c, cached);
+
+    LeaveCriticalSection(&c->cache_lock);
+}
+
+static void schan_session_cache_flush(MBEDTLS_CREDENTIALS *c)
+{
+    MBEDTLS_CACHED_SESSION *cached, *next;
+
+    EnterCriticalSection(&c->cache_lock);
+
+    LIST_FOR_EACH_ENTRY_SAFE(cached, next, &c->session_cache, MBEDTLS_CACHED_SESSION, entry)
+        schan_session_cache_free_entry(c, cached);
+
+    LeaveCriticalSection(&c->cache_lock);
+}
+
 BOOL schan_imp_create_session(schan_imp_session *session, schan_credentials *cred)
 {
-    MBEDTLS_SESSION *s = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(MBEDTLS_SESSION));
+    MBEDTLS_CREDENTIALS *c = cred->credentials;
+    MBEDTLS_SESSION *s;
+    int ret;
 
     WARN("MBEDTLS schan_imp_create_session: %p %p %p\n", session, *session, cred);
 
-    if (!(*session = (schan_imp_session)s))
+    if (!c)
     {
-        ERR("Not enough memory to create session\n");
+        ERR("No MBEDTLS credentials to create the session with\n");
         return FALSE;
     }
 
-    TRACE("MBEDTLS init entropy\n");
-    mbedtls_entropy_init(&s->entropy);
+    s = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(MBEDTLS_SESSION));
 
-    TRACE("MBEDTLS init random - change static entropy private data\n");
-    mbedtls_ctr_drbg_init(&s->ctr_drbg);
-    mbedtls_ctr_drbg_seed(&s->ctr_drbg, mbedtls_entropy_func, &s->entropy, NULL, 0);
+    if (!(*session = (schan_imp_session)s))
+    {
+        ERR("Not enough memory to create session\n");
+        return FALSE;
+    }
 
     WARN("MBEDTLS init ssl\n");
     mbedtls_ssl_init(&s->ssl);
 
-    WARN("MBEDTLS init conf\n");
-    mbedtls_ssl_config_init(&s->conf);
-    mbedtls_ssl_config_defaults(&s->conf, MBEDTLS_SSL_IS_CLIENT,
-                                          MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
-
     TRACE("MBEDTLS set BIO callbacks\n");
     mbedtls_ssl_set_bio(&s->ssl, s, schan_push_adapter, schan_pull_adapter, NULL);
 
-    TRACE("MBEDTLS set endpoint to %s\n", (cred->credential_use & SECPKG_CRED_INBOUND) ? "server" : "client");
-    mbedtls_ssl_conf_endpoint(&s->conf,   (cred->credential_use & SECPKG_CRED_INBOUND) ? MBEDTLS_SSL_IS_SERVER :
-                                                                                         MBEDTLS_SSL_IS_CLIENT);
-
-    TRACE("MBEDTLS set authmode\n");
-    mbedtls_ssl_conf_authmode(&s->conf, MBEDTLS_SSL_VERIFY_NONE);
+    TRACE("MBEDTLS setup with the %s configuration of %p\n",
+          (c->conf.endpoint == MBEDTLS_SSL_IS_SERVER) ? "server" : "client", c);
 
-    TRACE("MBEDTLS set rng\n");
-    mbedtls_ssl_conf_rng(&s->conf, mbedtls_ctr_drbg_random, &s->ctr_drbg);
-
-    TRACE("MBEDTLS set dbg\n");
-    mbedtls_ssl_conf_dbg(&s->conf, schan_imp_debug, stdout);
+    if ((ret = mbedtls_ssl_setup(&s->ssl, &c->conf)))
+    {
+        ERR("MBEDTLS mbedtls_ssl_setup failed with -%#x\n", -ret);
+        mbedtls_ssl_free(&s->ssl);
+        HeapFree(GetProcessHeap(), 0, s);
+        *session = NULL;
+        return FALSE;
+    }
 
-    TRACE("MBEDTLS setup\n");
-    mbedtls_ssl_setup(&s->ssl, &s->conf);
+    InterlockedIncrement(&c->ref);
+    s->cred = c;
 
     TRACE("MBEDTLS schan_imp_create_session END!\n");
     return TRUE;
@@ -244,9 +523,9 @@ void schan_imp_dispose_session(schan_imp_session session)
     //ssl_close_notify(&s->ssl);
 
     mbedtls_ssl_free(&s->ssl);
-    mbedtls_ctr_drbg_free(&s->ctr_drbg);
-    mbedtls_entropy_free(&s->entropy);
-    mbedtls_ssl_config_free(&s->conf);
+    schan_release_credentials(s->cred);
+
+    HeapFree(GetProcessHeap(), 0, s->target);
 
     /* safely overwrite the freed context with zeroes */
     HeapFree(GetProcessHeap(), HEAP_ZERO_MEMORY, s);
@@ -273,6 +552,16 @@ void schan_imp_set_session_target(schan_imp_session session, const char *target)
      * sends a non-fatal alert which preemptively forces mbedTLS to close connection. */
 
     mbedtls_ssl_set_hostname(&s->ssl, target);
+
+    /* the target names the client session cache entries */
+    if (s->ssl.conf->endpoint != MBEDTLS_SSL_IS_CLIENT || s->target || !*target)
+        return;
+
+    if (!(s->target = HeapAlloc(GetProcessHeap(), 0, strlen(target) + 1)))
+        return;
+
+    strcpy(s->target, target);
+    schan_session_cache_resume(s);
 }
 
 SECURITY_STATUS schan_imp_handshake(schan_imp_session session)
@@ -288,7 +577,12 @@ SECURITY_STATUS schan_imp_handshake(schan_imp_session session)
         TRACE("Received ERR_NET_WANT_READ/WRITE... let's try again!\n");
         return SEC_I_CONTINUE_NEEDED;
     }
-    else if (err == MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE)
+
+    /* do not offer a session the server did not like to it again */
+    if (err != 0 && s->target)
+        schan_session_cache_remove(s->cred, s->target);
+
+    if (err == MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE)
     {
         ERR("schan_imp_handshake: SSL Feature unavailable...\n");
         return SEC_E_UNSUPPORTED_FUNCTION;
@@ -299,9 +593,16 @@ SECURITY_STATUS schan_imp_handshake(schan_imp_session session)
         return SEC_E_INTERNAL_ERROR;
     }
 
+    s->resumed = s->offered && s->ssl.session &&
+                 !memcmp(s->ssl.session->master, s->offered_master, sizeof(s->offered_master));
+
+    if (s->target)
+        schan_session_cache_store(s);
+
     WARN("schan_imp_handshake: Handshake completed!\n");
-    WARN("schan_imp_handshake: Protocol is %s, Cipher suite is %s\n", mbedtls_ssl_get_version(&s->ssl),
-                                                                      mbedtls_ssl_get_ciphersuite(&s->ssl));
+    WARN("schan_imp_handshake: Protocol is %s, Cipher suite is %s, session %s\n", mbedtls_ssl_get_version(&s->ssl),
+                                                                                  mbedtls_ssl_get_ciphersuite(&s->ssl),
+                                                                                  s->resumed ? "resumed" : "new");
     return SEC_E_OK;
 }
 
@@ -569,13 +870,30 @@ SECURITY_STATUS schan_imp_get_connection_info(schan_imp_session session,
 
     TRACE("MBEDTLS schan_imp_get_connection_info %p %p.\n", session, info);
 
-    info->dwProtocol       = schannel_get_protocol(&s->ssl, &s->conf);
+    info->dwProtocol       = schannel_get_protocol(&s->ssl, s->ssl.conf);
     info->aiCipher         = schannel_get_cipher_algid(ciphersuite_id);
     info->dwCipherStrength = schannel_get_cipher_key_size(ciphersuite_id);
     info->aiHash           = schannel_get_mac_algid(ciphersuite_id);
     info->dwHashStrength   = schannel_get_mac_key_size(ciphersuite_id);
     info->aiExch           = schannel_get_kx_algid(ciphersuite_id);
-    info->dwExchStrength   = schannel_get_kx_key_size(&s->ssl, &s->conf, ciphersuite_id);
+    info->dwExchStrength   = schannel_get_kx_key_size(&s->ssl, s->ssl.conf, ciphersuite_id);
+
+    return SEC_E_OK;
+}
+
+SECURITY_STATUS schan_imp_get_session_info(schan_imp_session session,
+                                           SecPkgContext_SessionInfo *info)
+{
+    MBEDTLS_SESSION *s = (MBEDTLS_SESSION *)session;
+
+    TRACE("MBEDTLS schan_imp_get_session_info %p %p.\n", session, info);
+
+    if (!s->ssl.session)
+        return SEC_E_INTERNAL_ERROR;
+
+    info->dwFlags     = s->resumed ? SSL_SESSION_RECONNECT : 0;
+    info->cbSessionId = min(s->ssl.session->id_len, sizeof(info->rgbSessionId));
+    memcpy(info->rgbSessionId, s->ssl.session->id, info->cbSessionId);
 
     return SEC_E_OK;
 }
@@ -699,16 +1017,86 @@ SECURITY_STATUS schan_imp_recv(schan_imp_session session, void *buffer,
 
 BOOL schan_imp_allocate_certificate_credentials(schan_credentials *c)
 {
+    MBEDTLS_CREDENTIALS *cred;
+    int endpoint = (c->credential_use & SECPKG_CRED_INBOUND) ? MBEDTLS_SSL_IS_SERVER :
+                                                                MBEDTLS_SSL_IS_CLIENT;
+    int ret;
+
     TRACE("MBEDTLS schan_imp_allocate_certificate_credentials %p %p %d\n", c, c->credentials, c->credential_use);
 
-    /* in our case credentials aren't really used for anything, so just stub them */
     c->credentials = NULL;
+
+    if (!(cred = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(MBEDTLS_CREDENTIALS))))
+    {
+        ERR("Not enough memory to create credentials\n");
+        return FALSE;
+    }
+
+    InitializeCriticalSection(&cred->lock);
+    InitializeCriticalSection(&cred->cache_lock);
+    list_init(&cred->session_cache);
+    cred->ref = 1;
+    cred->session_lifespan = c->session_lifespan;
+
+    TRACE("MBEDTLS init entropy and random\n");
+    mbedtls_entropy_init(&cred->entropy);
+    mbedtls_ctr_drbg_init(&cred->ctr_drbg);
+    mbedtls_ssl_config_init(&cred->conf);
+#ifdef ROS_SCHAN_SERVER_TICKETS
+    mbedtls_ssl_ticket_init(&cred->ticket);
+#endif
+
+    if ((ret = mbedtls_ctr_drbg_seed(&cred->ctr_drbg, mbedtls_entropy_func, &cred->entropy, NULL, 0)))
+    {
+        ERR("MBEDTLS mbedtls_ctr_drbg_seed failed with -%#x\n", -ret);
+        goto fail;
+    }
+
+    TRACE("MBEDTLS init conf, endpoint is %s\n", (endpoint == MBEDTLS_SSL_IS_SERVER) ? "server" : "client");
+    if ((ret = mbedtls_ssl_config_defaults(&cred->conf, endpoint,
+                                           MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT)))
+    {
+        ERR("MBEDTLS mbedtls_ssl_config_defaults failed with -%#x\n", -ret);
+        goto fail;
+    }
+
+    mbedtls_ssl_conf_authmode(&cred->conf, MBEDTLS_SSL_VERIFY_NONE);
+    mbedtls_ssl_conf_rng(&cred->conf, schan_drbg_random, cred);
+    mbedtls_ssl_conf_dbg(&cred->conf, schan_imp_debug, stdout);
+
+#ifdef ROS_SCHAN_SERVER_TICKETS
+    /* clients resume with a ticket sealed under a key of this credential,
+       mbedTLS rotates the key every ticket lifetime */
+    if (endpoint == MBEDTLS_SSL_IS_SERVER)
+    {
+        if ((ret = mbedtls_ssl_ticket_setup(&cred->ticket, schan_drbg_random, cred,
+                                            MBEDTLS_CIPHER_AES_256_GCM, SCHAN_TICKET_LIFETIME)))
+        {
+            ERR("MBEDTLS mbedtls_ssl_ticket_setup failed with -%#x\n", -ret);
+            goto fail;
+        }
+
+        mbedtls_ssl_conf_session_tickets_cb(&cred->conf, schan_ticket_write, schan_ticket_parse, cred);
+    }
+#endif
+
+    c->credentials = cred;
     return TRUE;
+
+fail:
+    schan_release_credentials(cred);
+    return FALSE;
 }
 
 void schan_imp_free_certificate_credentials(schan_credentials *c)
 {
     TRACE("MBEDTLS schan_imp_free_certificate_credentials %p %p %d\n", c, c->credentials, c->credential_use);
+
+    /* sessions that still use them hold their own reference */
+    if (c->credentials)
+        schan_release_credentials(c->credentials);
+
+    c->credentials = NULL;
 }
 
 BOOL schan_imp_init(void)
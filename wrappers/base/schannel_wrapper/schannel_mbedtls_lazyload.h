@@ -57,6 +57,18 @@ MAKE_FUNCPTR(mbedtls_cipher_info_from_type)
 MAKE_FUNCPTR(mbedtls_md_info_from_type)
 MAKE_FUNCPTR(mbedtls_pk_get_bitlen)
 MAKE_FUNCPTR(mbedtls_ctr_drbg_seed)
+MAKE_FUNCPTR(mbedtls_ssl_get_session)
+MAKE_FUNCPTR(mbedtls_ssl_set_session)
+MAKE_FUNCPTR(mbedtls_ssl_session_init)
+MAKE_FUNCPTR(mbedtls_ssl_session_free)
+#ifdef ROS_SCHAN_SERVER_TICKETS
+MAKE_FUNCPTR(mbedtls_ssl_conf_session_tickets_cb)
+MAKE_FUNCPTR(mbedtls_ssl_ticket_init)
+MAKE_FUNCPTR(mbedtls_ssl_ticket_setup)
+MAKE_FUNCPTR(mbedtls_ssl_ticket_write)
+MAKE_FUNCPTR(mbedtls_ssl_ticket_parse)
+MAKE_FUNCPTR(mbedtls_ssl_ticket_free)
+#endif
 
 #undef MAKE_FUNCPTR
 
@@ -112,6 +124,18 @@ BOOL schan_imp_init(void)
     LOAD_FUNCPTR(mbedtls_md_info_from_type)
     LOAD_FUNCPTR(mbedtls_pk_get_bitlen)
     LOAD_FUNCPTR(mbedtls_ctr_drbg_seed)
+    LOAD_FUNCPTR(mbedtls_ssl_get_session)
+    LOAD_FUNCPTR(mbedtls_ssl_set_session)
+    LOAD_FUNCPTR(mbedtls_ssl_session_init)
+    LOAD_FUNCPTR(mbedtls_ssl_session_free)
+#ifdef ROS_SCHAN_SERVER_TICKETS
+    LOAD_FUNCPTR(mbedtls_ssl_conf_session_tickets_cb)
+    LOAD_FUNCPTR(mbedtls_ssl_ticket_init)
+    LOAD_FUNCPTR(mbedtls_ssl_ticket_setup)
+    LOAD_FUNCPTR(mbedtls_ssl_ticket_write)
+    LOAD_FUNCPTR(mbedtls_ssl_ticket_parse)
+    LOAD_FUNCPTR(mbedtls_ssl_ticket_free)
+#endif
 
 #undef LOAD_FUNCPTR
 
@@ -171,4 +195,16 @@ void schan_imp_deinit(void)
 #define mbedtls_cipher_info_from_type   pmbedtls_cipher_info_from_type
 #define mbedtls_md_info_from_type       pmbedtls_md_info_from_type
 #define mbedtls_pk_get_bitlen           pmbedtls_pk_get_bitlen
-#define mbedtls_ctr_drbg_seed           pmbedtls_ctr_drbg_seed
\ No newline at end of file
+#define mbedtls_ctr_drbg_seed           pmbedtls_ctr_drbg_seed
+#define mbedtls_ssl_get_session         pmbedtls_ssl_get_session
+#define mbedtls_ssl_set_session         pmbedtls_ssl_set_session
+#define mbedtls_ssl_session_init        pmbedtls_ssl_session_init
+#define mbedtls_ssl_session_free        pmbedtls_ssl_session_free
+#ifdef ROS_SCHAN_SERVER_TICKETS
+#define mbedtls_ssl_conf_session_tickets_cb pmbedtls_ssl_conf_session_tickets_cb
+#define mbedtls_ssl_ticket_init         pmbedtls_ssl_ticket_init
+#define mbedtls_ssl_ticket_setup        pmbedtls_ssl_ticket_setup
+#define mbedtls_ssl_ticket_write        pmbedtls_ssl_ticket_write
+#define mbedtls_ssl_ticket_parse        pmbedtls_ssl_ticket_parse
+#define mbedtls_ssl_ticket_free         pmbedtls_ssl_ticket_free
+#endif
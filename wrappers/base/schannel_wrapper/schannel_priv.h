@@ -63,6 +63,7 @@ typedef struct schan_credentials
     ULONG credential_use;
     void *credentials;
     DWORD enabled_protocols;
+    DWORD session_lifespan;
 } schan_credentials;
 
 struct schan_transport;
@@ -101,6 +102,8 @@ extern unsigned int schan_imp_get_session_cipher_block_size(schan_imp_session se
 extern unsigned int schan_imp_get_max_message_size(schan_imp_session session) DECLSPEC_HIDDEN;
 extern SECURITY_STATUS schan_imp_get_connection_info(schan_imp_session session,
                                                      SecPkgContext_ConnectionInfo *info) DECLSPEC_HIDDEN;
+extern SECURITY_STATUS schan_imp_get_session_info(schan_imp_session session,
+                                                  SecPkgContext_SessionInfo *info) DECLSPEC_HIDDEN;
 extern SECURITY_STATUS schan_imp_get_session_peer_certificate(schan_imp_session session, HCERTSTORE,
                                                               PCCERT_CONTEXT *cert) DECLSPEC_HIDDEN;
 extern SECURITY_STATUS schan_imp_send(schan_imp_session session, const void *buffer,
@@ -416,6 +416,7 @@ static SECURITY_STATUS schan_AcquireClientCredentials(const SCHANNEL_CRED *schan
     if (handle == SCHAN_INVALID_HANDLE) goto fail;
 
     creds->credential_use = SECPKG_CRED_OUTBOUND;
+    creds->session_lifespan = schanCred ? schanCred->dwSessionLifespan : 0;
     if (!schan_imp_allocate_certificate_credentials(creds))
     {
         schan_free_handle(handle, SCHAN_HANDLE_CRED);
@@ -458,6 +459,7 @@ static SECURITY_STATUS schan_AcquireServerCredentials(const SCHANNEL_CRED *schan
         creds = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*creds));
         if (!creds) return SEC_E_INSUFFICIENT_MEMORY;
         creds->credential_use = SECPKG_CRED_INBOUND;
+        creds->session_lifespan = schanCred->dwSessionLifespan;
 
         handle = schan_alloc_handle(creds, SCHAN_HANDLE_CRED);
         if (handle == SCHAN_INVALID_HANDLE)
@@ -466,6 +468,13 @@ static SECURITY_STATUS schan_AcquireServerCredentials(const SCHANNEL_CRED *schan
             return SEC_E_INTERNAL_ERROR;
         }
 
+        if (!schan_imp_allocate_certificate_credentials(creds))
+        {
+            schan_free_handle(handle, SCHAN_HANDLE_CRED);
+            HeapFree(GetProcessHeap(), 0, creds);
+            return SEC_E_INTERNAL_ERROR;
+        }
+
         phCredential->dwLower = handle;
         phCredential->dwUpper = 0;
 
@@ -524,8 +533,7 @@ SECURITY_STATUS SEC_ENTRY schan_FreeCredentialsHandle(
     creds = schan_free_handle(phCredential->dwLower, SCHAN_HANDLE_CRED);
     if (!creds) return SEC_E_INVALID_HANDLE;
 
-    if (creds->credential_use == SECPKG_CRED_OUTBOUND)
-        schan_imp_free_certificate_credentials(creds);
+    schan_imp_free_certificate_credentials(creds);
     HeapFree(GetProcessHeap(), 0, creds);
 
     return SEC_E_OK;
@@ -1005,6 +1013,11 @@ SECURITY_STATUS SEC_ENTRY schan_QueryContextAttributesW(
             SecPkgContext_ConnectionInfo *info = buffer;
             return schan_imp_get_connection_info(ctx->session, info);
         }
+        case SECPKG_ATTR_SESSION_INFO:
+        {
+            SecPkgContext_SessionInfo *info = buffer;
+            return schan_imp_get_session_info(ctx->session, info);
+        }
 
         default:
             FIXME("Unhandled attribute %#x\n", attribute);
@@ -1027,6 +1040,8 @@ SECURITY_STATUS SEC_ENTRY schan_QueryContextAttributesA(
             return schan_QueryContextAttributesW(context_handle, attribute, buffer);
         case SECPKG_ATTR_CONNECTION_INFO:
             return schan_QueryContextAttributesW(context_handle, attribute, buffer);
+        case SECPKG_ATTR_SESSION_INFO:
+            return schan_QueryContextAttributesW(context_handle, attribute, buffer);
 
         default:
             FIXME("Unhandled attribute %#x\n", attribute);
@@ -12,3 +12,15 @@
 22 cdecl FDICopy(long ptr ptr long ptr ptr ptr)
 23 cdecl FDIDestroy(long)
 24 cdecl FDITruncateCabinet(long ptr long)
+30 stdcall CreateCompressor(long ptr ptr)
+31 stdcall SetCompressorInformation(ptr long ptr long)
+32 stdcall QueryCompressorInformation(ptr long ptr long)
+33 stdcall Compress(ptr ptr long ptr long ptr)
+34 stdcall ResetCompressor(ptr)
+35 stdcall CloseCompressor(ptr)
+40 stdcall CreateDecompressor(long ptr ptr)
+41 stdcall SetDecompressorInformation(ptr long ptr long)
+42 stdcall QueryDecompressorInformation(ptr long ptr long)
+43 stdcall Decompress(ptr ptr long ptr long ptr)
+44 stdcall ResetDecompressor(ptr)
+45 stdcall CloseDecompressor(ptr)
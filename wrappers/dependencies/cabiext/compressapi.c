@@ -0,0 +1,527 @@
+/*
+ * Compression API (Windows 8)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * NOTES
+ *
+ * The compressors are thin wrappers around RtlCompressBuffer and
+ * RtlDecompressFragment, so only the algorithms ntdll knows about
+ * (XPRESS and XPRESS Huffman) are available; MSZIP and LZMS fail with
+ * ERROR_NOT_SUPPORTED.  The ntdll workspace is allocated once per handle
+ * through the caller's allocation routines and reused by every call.
+ *
+ * Without COMPRESS_RAW a buffer is framed like the native buffer mode: a
+ * 24 byte header with the signature, the algorithm, the uncompressed size
+ * and the size of the stream that follows it.  Decompress takes the output
+ * size from it, so the caller can ask how much room it needs.
+ *
+ * sdk/lib/rtl/tests/compress has a host round trip and throughput test of
+ * the codecs underneath.
+ */
+
+#include <ntstatus.h>
+#include "cabinet.h"
+
+#include <winternl.h>
+#include <compressapi.h>
+
+#define COMPRESSOR_MAGIC    0x43505243  /* 'CRPC' */
+#define DECOMPRESSOR_MAGIC  0x44505243  /* 'CRPD' */
+#define BUFFER_SIGNATURE    0x0a51e5c0
+
+typedef struct
+{
+    DWORD  signature;
+    BYTE   algorithm;
+    BYTE   reserved[3];
+    UINT64 uncompressed_size;
+    UINT64 compressed_size;     /* of the stream after the header */
+} BUFFER_HEADER;
+
+C_ASSERT( sizeof(BUFFER_HEADER) == 24 );
+
+typedef struct
+{
+    DWORD magic;
+    DWORD algorithm;
+    BOOL  raw;
+    DWORD block_size;
+    DWORD level;
+    COMPRESS_ALLOCATION_ROUTINES routines;
+    void *workspace;
+    ULONG workspace_size;
+} COMPRESSOR;
+
+static PVOID __cdecl default_alloc( PVOID context, SIZE_T size )
+{
+    return HeapAlloc( GetProcessHeap(), 0, size );
+}
+
+static VOID __cdecl default_free( PVOID context, PVOID mem )
+{
+    HeapFree( GetProcessHeap(), 0, mem );
+}
+
+static USHORT get_format( const COMPRESSOR *handle )
+{
+    USHORT format = (handle->algorithm == COMPRESS_ALGORITHM_XPRESS_HUFF) ?
+                    COMPRESSION_FORMAT_XPRESS_HUFF : COMPRESSION_FORMAT_XPRESS;
+
+    return format | (handle->level ? COMPRESSION_ENGINE_MAXIMUM : COMPRESSION_ENGINE_STANDARD);
+}
+
+/* worst case size of a compressed stream, header not included */
+static SIZE_T get_bound( DWORD algorithm, SIZE_T size )
+{
+    if (algorithm == COMPRESS_ALGORITHM_XPRESS_HUFF)
+        return size + size / 2 + (size / 65536 + 2) * 264;
+
+    return size + (size / 32 + 1) * 4 + 4;
+}
+
+static COMPRESSOR *get_handle( HANDLE handle, DWORD magic )
+{
+    COMPRESSOR *compressor = handle;
+
+    if (!compressor || compressor->magic != magic)
+    {
+        SetLastError( ERROR_INVALID_HANDLE );
+        return NULL;
+    }
+    return compressor;
+}
+
+static BOOL create_handle( DWORD algorithm, PCOMPRESS_ALLOCATION_ROUTINES routines,
+                           HANDLE *ret, DWORD magic )
+{
+    COMPRESSOR *handle;
+    DWORD algo = algorithm & ~COMPRESS_RAW;
+
+    if (!ret)
+    {
+        SetLastError( ERROR_INVALID_PARAMETER );
+        return FALSE;
+    }
+    *ret = NULL;
+
+    if (algo <= COMPRESS_ALGORITHM_NULL || algo >= COMPRESS_ALGORITHM_MAX ||
+        (algorithm & ~(COMPRESS_RAW | 0xff)))
+    {
+        SetLastError( ERROR_INVALID_PARAMETER );
+        return FALSE;
+    }
+    if (algo != COMPRESS_ALGORITHM_XPRESS && algo != COMPRESS_ALGORITHM_XPRESS_HUFF)
+    {
+        FIXME( "algorithm %u not supported\n", algo );
+        SetLastError( ERROR_NOT_SUPPORTED );
+        return FALSE;
+    }
+    if (routines && (!routines->Allocate || !routines->Free))
+    {
+        SetLastError( ERROR_INVALID_PARAMETER );
+        return FALSE;
+    }
+
+    if (routines)
+        handle = routines->Allocate( routines->UserContext, sizeof(*handle) );
+    else
+        handle = default_alloc( NULL, sizeof(*handle) );
+    if (!handle)
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return FALSE;
+    }
+
+    handle->magic = magic;
+    handle->algorithm = algo;
+    handle->raw = (algorithm & COMPRESS_RAW) != 0;
+    handle->block_size = 0;
+    handle->level = 0;
+    handle->routines.Allocate = routines ? routines->Allocate : default_alloc;
+    handle->routines.Free = routines ? routines->Free : default_free;
+    handle->routines.UserContext = routines ? routines->UserContext : NULL;
+    handle->workspace = NULL;
+    handle->workspace_size = 0;
+
+    *ret = handle;
+    return TRUE;
+}
+
+static BOOL close_handle( COMPRESSOR *handle )
+{
+    if (!handle) return FALSE;
+
+    handle->magic = 0;
+    if (handle->workspace)
+        handle->routines.Free( handle->routines.UserContext, handle->workspace );
+    handle->routines.Free( handle->routines.UserContext, handle );
+    return TRUE;
+}
+
+/* the workspace size depends on the engine, so it is (re)allocated on first use */
+static BOOL ensure_workspace( COMPRESSOR *handle, BOOL compress )
+{
+    ULONG buffer_size, fragment_size, size;
+    NTSTATUS status;
+
+    status = RtlGetCompressionWorkSpaceSize( get_format( handle ), &buffer_size, &fragment_size );
+    if (status != STATUS_SUCCESS)
+    {
+        SetLastError( RtlNtStatusToDosError( status ) );
+        return FALSE;
+    }
+
+    size = compress ? buffer_size : fragment_size;
+    if (!size || size <= handle->workspace_size) return TRUE;
+
+    if (handle->workspace)
+        handle->routines.Free( handle->routines.UserContext, handle->workspace );
+    handle->workspace_size = 0;
+
+    handle->workspace = handle->routines.Allocate( handle->routines.UserContext, size );
+    if (!handle->workspace)
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return FALSE;
+    }
+    handle->workspace_size = size;
+    return TRUE;
+}
+
+static BOOL set_information( COMPRESSOR *handle, COMPRESS_INFORMATION_CLASS class,
+                             LPCVOID info, SIZE_T size )
+{
+    DWORD value;
+
+    if (!handle) return FALSE;
+
+    if (!info || size < sizeof(DWORD))
+    {
+        SetLastError( ERROR_INVALID_PARAMETER );
+        return FALSE;
+    }
+    value = *(const DWORD *)info;
+
+    switch (class)
+    {
+    case COMPRESS_INFORMATION_CLASS_BLOCK_SIZE:
+        handle->block_size = value;
+        return TRUE;
+
+    case COMPRESS_INFORMATION_CLASS_LEVEL:
+        if (value > 1)
+        {
+            SetLastError( ERROR_INVALID_PARAMETER );
+            return FALSE;
+        }
+        handle->level = value;
+        return TRUE;
+
+    default:
+        SetLastError( ERROR_INVALID_PARAMETER );
+        return FALSE;
+    }
+}
+
+static BOOL query_information( COMPRESSOR *handle, COMPRESS_INFORMATION_CLASS class,
+                               PVOID info, SIZE_T size )
+{
+    if (!handle) return FALSE;
+
+    if (!info || size < sizeof(DWORD))
+    {
+        SetLastError( ERROR_INVALID_PARAMETER );
+        return FALSE;
+    }
+
+    switch (class)
+    {
+    case COMPRESS_INFORMATION_CLASS_BLOCK_SIZE:
+        *(DWORD *)info = handle->block_size;
+        return TRUE;
+
+    case COMPRESS_INFORMATION_CLASS_LEVEL:
+        *(DWORD *)info = handle->level;
+        return TRUE;
+
+    default:
+        SetLastError( ERROR_INVALID_PARAMETER );
+        return FALSE;
+    }
+}
+
+/***********************************************************************
+ *		CreateCompressor (CABINET.30)
+ */
+BOOL WINAPI CreateCompressor( DWORD algorithm, PCOMPRESS_ALLOCATION_ROUTINES routines,
+                              PCOMPRESSOR_HANDLE handle )
+{
+    TRACE( "(%#x, %p, %p)\n", algorithm, routines, handle );
+
+    return create_handle( algorithm, routines, (HANDLE *)handle, COMPRESSOR_MAGIC );
+}
+
+/***********************************************************************
+ *		SetCompressorInformation (CABINET.31)
+ */
+BOOL WINAPI SetCompressorInformation( COMPRESSOR_HANDLE handle, COMPRESS_INFORMATION_CLASS class,
+                                      LPCVOID info, SIZE_T size )
+{
+    TRACE( "(%p, %d, %p, %lu)\n", handle, class, info, (ULONG)size );
+
+    return set_information( get_handle( handle, COMPRESSOR_MAGIC ), class, info, size );
+}
+
+/***********************************************************************
+ *		QueryCompressorInformation (CABINET.32)
+ */
+BOOL WINAPI QueryCompressorInformation( COMPRESSOR_HANDLE handle, COMPRESS_INFORMATION_CLASS class,
+                                        PVOID info, SIZE_T size )
+{
+    TRACE( "(%p, %d, %p, %lu)\n", handle, class, info, (ULONG)size );
+
+    return query_information( get_handle( handle, COMPRESSOR_MAGIC ), class, info, size );
+}
+
+/***********************************************************************
+ *		Compress (CABINET.33)
+ *
+ * Compresses a whole buffer in one call.
+ *
+ * RETURNS
+ *   Success: TRUE, the compressed size is stored in *compressed_size.
+ *   Failure: FALSE.  If the output buffer is too small the last error is
+ *            ERROR_INSUFFICIENT_BUFFER and *compressed_size receives a
+ *            size that is large enough for any input of this length.
+ */
+BOOL WINAPI Compress( COMPRESSOR_HANDLE handle, LPCVOID uncompressed, SIZE_T uncompressed_size,
+                      PVOID compressed, SIZE_T compressed_buffer_size, PSIZE_T compressed_size )
+{
+    COMPRESSOR *compressor = get_handle( handle, COMPRESSOR_MAGIC );
+    SIZE_T header_size, bound;
+    BUFFER_HEADER *header;
+    ULONG final_size = 0;
+    NTSTATUS status;
+
+    TRACE( "(%p, %p, %lu, %p, %lu, %p)\n", handle, uncompressed, (ULONG)uncompressed_size,
+           compressed, (ULONG)compressed_buffer_size, compressed_size );
+
+    if (!compressor) return FALSE;
+    if (!compressed_size || (!uncompressed && uncompressed_size) ||
+        (!compressed && compressed_buffer_size))
+    {
+        SetLastError( ERROR_INVALID_PARAMETER );
+        return FALSE;
+    }
+
+    /* ntdll takes ULONG sizes */
+    if (uncompressed_size > MAXULONG)
+    {
+        SetLastError( ERROR_INVALID_PARAMETER );
+        return FALSE;
+    }
+
+    header_size = compressor->raw ? 0 : sizeof(BUFFER_HEADER);
+    bound = header_size + get_bound( compressor->algorithm, uncompressed_size );
+
+    if (compressed_buffer_size <= header_size)
+    {
+        *compressed_size = bound;
+        SetLastError( ERROR_INSUFFICIENT_BUFFER );
+        return FALSE;
+    }
+
+    if (!ensure_workspace( compressor, TRUE )) return FALSE;
+
+    status = RtlCompressBuffer( get_format( compressor ), (PUCHAR)uncompressed, uncompressed_size,
+                                (PUCHAR)compressed + header_size,
+                                min( compressed_buffer_size - header_size, MAXULONG ),
+                                0, &final_size, compressor->workspace );
+    if (status == STATUS_BUFFER_TOO_SMALL)
+    {
+        *compressed_size = bound;
+        SetLastError( ERROR_INSUFFICIENT_BUFFER );
+        return FALSE;
+    }
+    if (status != STATUS_SUCCESS)
+    {
+        SetLastError( RtlNtStatusToDosError( status ) );
+        return FALSE;
+    }
+
+    if (!compressor->raw)
+    {
+        header = compressed;
+        header->signature = BUFFER_SIGNATURE;
+        header->algorithm = compressor->algorithm;
+        header->reserved[0] = header->reserved[1] = header->reserved[2] = 0;
+        header->uncompressed_size = uncompressed_size;
+        header->compressed_size = final_size;
+    }
+
+    *compressed_size = header_size + final_size;
+    return TRUE;
+}
+
+/***********************************************************************
+ *		ResetCompressor (CABINET.34)
+ */
+BOOL WINAPI ResetCompressor( COMPRESSOR_HANDLE handle )
+{
+    TRACE( "(%p)\n", handle );
+
+    /* every Compress call starts a new stream, there is no state to drop */
+    return get_handle( handle, COMPRESSOR_MAGIC ) != NULL;
+}
+
+/***********************************************************************
+ *		CloseCompressor (CABINET.35)
+ */
+BOOL WINAPI CloseCompressor( COMPRESSOR_HANDLE handle )
+{
+    TRACE( "(%p)\n", handle );
+
+    return close_handle( get_handle( handle, COMPRESSOR_MAGIC ) );
+}
+
+/***********************************************************************
+ *		CreateDecompressor (CABINET.40)
+ */
+BOOL WINAPI CreateDecompressor( DWORD algorithm, PCOMPRESS_ALLOCATION_ROUTINES routines,
+                                PDECOMPRESSOR_HANDLE handle )
+{
+    TRACE( "(%#x, %p, %p)\n", algorithm, routines, handle );
+
+    return create_handle( algorithm, routines, (HANDLE *)handle, DECOMPRESSOR_MAGIC );
+}
+
+/***********************************************************************
+ *		SetDecompressorInformation (CABINET.41)
+ */
+BOOL WINAPI SetDecompressorInformation( DECOMPRESSOR_HANDLE handle, COMPRESS_INFORMATION_CLASS class,
+                                        LPCVOID info, SIZE_T size )
+{
+    TRACE( "(%p, %d, %p, %lu)\n", handle, class, info, (ULONG)size );
+
+    return set_information( get_handle( handle, DECOMPRESSOR_MAGIC ), class, info, size );
+}
+
+/***********************************************************************
+ *		QueryDecompressorInformation (CABINET.42)
+ */
+BOOL WINAPI QueryDecompressorInformation( DECOMPRESSOR_HANDLE handle, COMPRESS_INFORMATION_CLASS class,
+                                          PVOID info, SIZE_T size )
+{
+    TRACE( "(%p, %d, %p, %lu)\n", handle, class, info, (ULONG)size );
+
+    return query_information( get_handle( handle, DECOMPRESSOR_MAGIC ), class, info, size );
+}
+
+/***********************************************************************
+ *		Decompress (CABINET.43)
+ *
+ * Decompresses a buffer produced by Compress.
+ *
+ * NOTES
+ *   In buffer mode the output size is known from the header; passing a
+ *   NULL output buffer queries it through ERROR_INSUFFICIENT_BUFFER.  Raw
+ *   streams carry no size, the caller has to provide enough room.
+ */
+BOOL WINAPI Decompress( DECOMPRESSOR_HANDLE handle, LPCVOID compressed, SIZE_T compressed_size,
+                        PVOID uncompressed, SIZE_T uncompressed_buffer_size,
+                        PSIZE_T uncompressed_size )
+{
+    COMPRESSOR *decompressor = get_handle( handle, DECOMPRESSOR_MAGIC );
+    const BUFFER_HEADER *header;
+    SIZE_T header_size, stream_size, expected;
+    ULONG final_size = 0;
+    NTSTATUS status;
+
+    TRACE( "(%p, %p, %lu, %p, %lu, %p)\n", handle, compressed, (ULONG)compressed_size,
+           uncompressed, (ULONG)uncompressed_buffer_size, uncompressed_size );
+
+    if (!decompressor) return FALSE;
+    if (!compressed || (!uncompressed && uncompressed_buffer_size) ||
+        compressed_size > MAXULONG)
+    {
+        SetLastError( ERROR_INVALID_PARAMETER );
+        return FALSE;
+    }
+
+    expected = uncompressed_buffer_size;
+    header_size = 0;
+    stream_size = compressed_size;
+    if (!decompressor->raw)
+    {
+        header = compressed;
+        header_size = sizeof(*header);
+        if (compressed_size < header_size || header->signature != BUFFER_SIGNATURE ||
+            header->algorithm != decompressor->algorithm || header->uncompressed_size > MAXULONG ||
+            header->compressed_size > compressed_size - header_size)
+        {
+            SetLastError( ERROR_BAD_COMPRESSION_BUFFER );
+            return FALSE;
+        }
+        expected = (SIZE_T)header->uncompressed_size;
+        stream_size = (SIZE_T)header->compressed_size;
+        if (uncompressed_buffer_size < expected)
+        {
+            if (uncompressed_size) *uncompressed_size = expected;
+            SetLastError( ERROR_INSUFFICIENT_BUFFER );
+            return FALSE;
+        }
+    }
+
+    if (!ensure_workspace( decompressor, FALSE )) return FALSE;
+
+    status = RtlDecompressFragment( get_format( decompressor ), uncompressed,
+                                    min( expected, MAXULONG ),
+                                    (PUCHAR)compressed + header_size, stream_size,
+                                    0, &final_size, decompressor->workspace );
+    if (status != STATUS_SUCCESS)
+    {
+        SetLastError( RtlNtStatusToDosError( status ) );
+        return FALSE;
+    }
+    if (!decompressor->raw && final_size != expected)
+    {
+        SetLastError( ERROR_BAD_COMPRESSION_BUFFER );
+        return FALSE;
+    }
+
+    if (uncompressed_size) *uncompressed_size = final_size;
+    return TRUE;
+}
+
+/***********************************************************************
+ *		ResetDecompressor (CABINET.44)
+ */
+BOOL WINAPI ResetDecompressor( DECOMPRESSOR_HANDLE handle )
+{
+    TRACE( "(%p)\n", handle );
+
+    return get_handle( handle, DECOMPRESSOR_MAGIC ) != NULL;
+}
+
+/***********************************************************************
+ *		CloseDecompressor (CABINET.45)
+ */
+BOOL WINAPI CloseDecompressor( DECOMPRESSOR_HANDLE handle )
+{
+    TRACE( "(%p)\n", handle );
+
+    return close_handle( get_handle( handle, DECOMPRESSOR_MAGIC ) );
+}
@@ -91,6 +91,50 @@ static inline float to_sRGB_component(float f)
     return 1.055f * powf(f, 1.0f/2.4f) - 0.055f;
 }
 
+/* srgb_thresholds[i] is the smallest linear value that encodes to i or more
+ * with (BYTE)floorf(to_sRGB_component(f) * 255.0f + 0.51f). Threads racing
+ * to fill it write the same values. */
+static float srgb_thresholds[256];
+static BOOL srgb_thresholds_ready;
+
+static void init_srgb_thresholds(void)
+{
+    union { UINT bits; float f; } lo, hi, mid;
+    UINT i;
+
+    if (srgb_thresholds_ready) return;
+
+    /* Non-negative floats order like their bit patterns */
+    for (i = 1; i < 256; i++)
+    {
+        lo.f = 0.0f;
+        hi.f = 1.0f;
+        while (lo.bits < hi.bits)
+        {
+            mid.bits = lo.bits + (hi.bits - lo.bits) / 2;
+            if (floorf(to_sRGB_component(mid.f) * 255.0f + 0.51f) >= i)
+                hi.bits = mid.bits;
+            else
+                lo.bits = mid.bits + 1;
+        }
+        srgb_thresholds[i] = lo.f;
+    }
+
+    srgb_thresholds_ready = TRUE;
+}
+
+/* Encodes a linear value to an 8-bit sRGB value without powf, clamping the
+ * values outside of [0, 1] */
+static inline BYTE to_sRGB_byte(float f)
+{
+    UINT i = 0, step;
+
+    for (step = 128; step; step >>= 1)
+        if (f >= srgb_thresholds[i + step]) i += step;
+
+    return i;
+}
+
 #if 0 /* FIXME: enable once needed */
 static inline float from_sRGB_component(float f)
 {
@@ -138,786 +182,484 @@ static inline FormatConverter *impl_from_IWICFormatConverter(IWICFormatConverter
     return CONTAINING_RECORD(iface, FormatConverter, IWICFormatConverter_iface);
 }
 
-static HRESULT copypixels_to_32bppBGRA(struct FormatConverter *This, const WICRect *prc,
-    UINT cbStride, UINT cbBufferSize, BYTE *pbBuffer, enum pixelformat source_format)
-{
-    switch (source_format)
-    {
-    case format_1bppIndexed:
-    case format_BlackWhite:
-        if (prc)
-        {
-            HRESULT res;
-            INT x, y;
-            BYTE *srcdata;
-            UINT srcstride, srcdatasize;
-            const BYTE *srcrow;
-            const BYTE *srcbyte;
-            BYTE *dstrow;
-            DWORD *dstpixel;
-            WICColor colors[2];
-            IWICPalette *palette;
-            UINT actualcolors;
-
-            res = PaletteImpl_Create(&palette);
-            if (FAILED(res)) return res;
-
-            if (source_format == format_1bppIndexed)
-                res = IWICBitmapSource_CopyPalette(This->source, palette);
-            else
-                res = IWICPalette_InitializePredefined(palette, WICBitmapPaletteTypeFixedBW, FALSE);
-
-            if (SUCCEEDED(res))
-                res = IWICPalette_GetColors(palette, 2, colors, &actualcolors);
-
-            IWICPalette_Release(palette);
-            if (FAILED(res)) return res;
-
-            srcstride = (prc->Width+7)/8;
-            srcdatasize = srcstride * prc->Height;
-
-            srcdata = HeapAlloc(GetProcessHeap(), 0, srcdatasize);
-            if (!srcdata) return E_OUTOFMEMORY;
-
-            res = IWICBitmapSource_CopyPixels(This->source, prc, srcstride, srcdatasize, srcdata);
-
-            if (SUCCEEDED(res))
-            {
-                srcrow = srcdata;
-                dstrow = pbBuffer;
-                for (y=0; y<prc->Height; y++) {
-                    srcbyte = srcrow;
-                    dstpixel=(DWORD*)dstrow;
-                    for (x=0; x<prc->Width; x+=8) {
-                        BYTE srcval;
-                        srcval=*srcbyte++;
-                        *dstpixel++ = colors[srcval>>7&1];
-                        if (x+1 < prc->Width) *dstpixel++ = colors[srcval>>6&1];
-                        if (x+2 < prc->Width) *dstpixel++ = colors[srcval>>5&1];
-                        if (x+3 < prc->Width) *dstpixel++ = colors[srcval>>4&1];
-                        if (x+4 < prc->Width) *dstpixel++ = colors[srcval>>3&1];
-                        if (x+5 < prc->Width) *dstpixel++ = colors[srcval>>2&1];
-                        if (x+6 < prc->Width) *dstpixel++ = colors[srcval>>1&1];
-                        if (x+7 < prc->Width) *dstpixel++ = colors[srcval&1];
-                    }
-                    srcrow += srcstride;
-                    dstrow += cbStride;
-                }
-            }
-
-            HeapFree(GetProcessHeap(), 0, srcdata);
-
-            return res;
-        }
-        return S_OK;
-    case format_2bppIndexed:
-    case format_2bppGray:
-        if (prc)
-        {
-            HRESULT res;
-            INT x, y;
-            BYTE *srcdata;
-            UINT srcstride, srcdatasize;
-            const BYTE *srcrow;
-            const BYTE *srcbyte;
-            BYTE *dstrow;
-            DWORD *dstpixel;
-            WICColor colors[4];
-            IWICPalette *palette;
-            UINT actualcolors;
-
-            res = PaletteImpl_Create(&palette);
-            if (FAILED(res)) return res;
-
-            if (source_format == format_2bppIndexed)
-                res = IWICBitmapSource_CopyPalette(This->source, palette);
-            else
-                res = IWICPalette_InitializePredefined(palette, WICBitmapPaletteTypeFixedGray4, FALSE);
-
-            if (SUCCEEDED(res))
-                res = IWICPalette_GetColors(palette, 4, colors, &actualcolors);
-
-            IWICPalette_Release(palette);
-            if (FAILED(res)) return res;
-
-            srcstride = (prc->Width+3)/4;
-            srcdatasize = srcstride * prc->Height;
-
-            srcdata = HeapAlloc(GetProcessHeap(), 0, srcdatasize);
-            if (!srcdata) return E_OUTOFMEMORY;
-
-            res = IWICBitmapSource_CopyPixels(This->source, prc, srcstride, srcdatasize, srcdata);
-
-            if (SUCCEEDED(res))
-            {
-                srcrow = srcdata;
-                dstrow = pbBuffer;
-                for (y=0; y<prc->Height; y++) {
-                    srcbyte = srcrow;
-                    dstpixel=(DWORD*)dstrow;
-                    for (x=0; x<prc->Width; x+=4) {
-                        BYTE srcval;
-                        srcval=*srcbyte++;
-                        *dstpixel++ = colors[srcval>>6];
-                        if (x+1 < prc->Width) *dstpixel++ = colors[srcval>>4&0x3];
-                        if (x+2 < prc->Width) *dstpixel++ = colors[srcval>>2&0x3];
-                        if (x+3 < prc->Width) *dstpixel++ = colors[srcval&0x3];
-                    }
-                    srcrow += srcstride;
-                    dstrow += cbStride;
-                }
-            }
-
-            HeapFree(GetProcessHeap(), 0, srcdata);
-
-            return res;
-        }
-        return S_OK;
-    case format_4bppIndexed:
-    case format_4bppGray:
-        if (prc)
-        {
-            HRESULT res;
-            INT x, y;
-            BYTE *srcdata;
-            UINT srcstride, srcdatasize;
-            const BYTE *srcrow;
-            const BYTE *srcbyte;
-            BYTE *dstrow;
-            DWORD *dstpixel;
-            WICColor colors[16];
-            IWICPalette *palette;
-            UINT actualcolors;
-
-            res = PaletteImpl_Create(&palette);
-            if (FAILED(res)) return res;
-
-            if (source_format == format_4bppIndexed)
-                res = IWICBitmapSource_CopyPalette(This->source, palette);
-            else
-                res = IWICPalette_InitializePredefined(palette, WICBitmapPaletteTypeFixedGray16, FALSE);
-
-            if (SUCCEEDED(res))
-                res = IWICPalette_GetColors(palette, 16, colors, &actualcolors);
-
-            IWICPalette_Release(palette);
-            if (FAILED(res)) return res;
-
-            srcstride = (prc->Width+1)/2;
-            srcdatasize = srcstride * prc->Height;
-
-            srcdata = HeapAlloc(GetProcessHeap(), 0, srcdatasize);
-            if (!srcdata) return E_OUTOFMEMORY;
-
-            res = IWICBitmapSource_CopyPixels(This->source, prc, srcstride, srcdatasize, srcdata);
-
-            if (SUCCEEDED(res))
-            {
-                srcrow = srcdata;
-                dstrow = pbBuffer;
-                for (y=0; y<prc->Height; y++) {
-                    srcbyte = srcrow;
-                    dstpixel=(DWORD*)dstrow;
-                    for (x=0; x<prc->Width; x+=2) {
-                        BYTE srcval;
-                        srcval=*srcbyte++;
-                        *dstpixel++ = colors[srcval>>4];
-                        if (x+1 < prc->Width) *dstpixel++ = colors[srcval&0xf];
-                    }
-                    srcrow += srcstride;
-                    dstrow += cbStride;
-                }
-            }
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_AMD64)
+#define HAVE_SSE2_ROWS
+extern void CDECL convert_row_24to32_sse2(BYTE *dst, const BYTE *src, UINT count, BOOL swap) DECLSPEC_HIDDEN;
+extern void CDECL convert_row_swap_rb_sse2(BYTE *dst, const BYTE *src, UINT count) DECLSPEC_HIDDEN;
+extern void CDECL convert_row_premultiply_sse2(BYTE *dst, const BYTE *src, UINT count) DECLSPEC_HIDDEN;
+extern void CDECL convert_row_gray8_sse2(BYTE *dst, const BYTE *src, UINT count) DECLSPEC_HIDDEN;
 
-            HeapFree(GetProcessHeap(), 0, srcdata);
-
-            return res;
-        }
-        return S_OK;
-    case format_8bppGray:
-        if (prc)
-        {
-            HRESULT res;
-            INT x, y;
-            BYTE *srcdata;
-            UINT srcstride, srcdatasize;
-            const BYTE *srcrow;
-            const BYTE *srcbyte;
-            BYTE *dstrow;
-            DWORD *dstpixel;
-
-            srcstride = prc->Width;
-            srcdatasize = srcstride * prc->Height;
-
-            srcdata = HeapAlloc(GetProcessHeap(), 0, srcdatasize);
-            if (!srcdata) return E_OUTOFMEMORY;
-
-            res = IWICBitmapSource_CopyPixels(This->source, prc, srcstride, srcdatasize, srcdata);
-
-            if (SUCCEEDED(res))
-            {
-                srcrow = srcdata;
-                dstrow = pbBuffer;
-                for (y=0; y<prc->Height; y++) {
-                    srcbyte = srcrow;
-                    dstpixel=(DWORD*)dstrow;
-                    for (x=0; x<prc->Width; x++)
-                    {
-                        *dstpixel++ = 0xff000000|(*srcbyte<<16)|(*srcbyte<<8)|*srcbyte;
-                        srcbyte++;
-                    }
-                    srcrow += srcstride;
-                    dstrow += cbStride;
-                }
-            }
-
-            HeapFree(GetProcessHeap(), 0, srcdata);
-
-            return res;
-        }
-        return S_OK;
-    case format_8bppIndexed:
-        if (prc)
-        {
-            HRESULT res;
-            INT x, y;
-            BYTE *srcdata;
-            UINT srcstride, srcdatasize;
-            const BYTE *srcrow;
-            const BYTE *srcbyte;
-            BYTE *dstrow;
-            DWORD *dstpixel;
-            WICColor colors[256];
-            IWICPalette *palette;
-            UINT actualcolors;
+static BOOL use_sse2;
+#endif
 
-            res = PaletteImpl_Create(&palette);
-            if (FAILED(res)) return res;
+/* Source bytes converted per band; the band and its 32bpp output should
+ * stay in the second level cache until the band is finished. */
+#define CONVERT_BAND_SIZE 0x10000
 
-            res = IWICBitmapSource_CopyPalette(This->source, palette);
-            if (SUCCEEDED(res))
-                res = IWICPalette_GetColors(palette, 256, colors, &actualcolors);
+/* Converts count pixels of a row to 32bpp BGRA. When the source is 32bpp
+ * the conversion runs in place, with dst equal to src. */
+typedef void (*convert_row_func)(BYTE *dst, const BYTE *src, UINT count, const WICColor *colors);
 
-            IWICPalette_Release(palette);
+static void convert_row_1bpp(BYTE *dst, const BYTE *src, UINT count, const WICColor *colors)
+{
+    DWORD *dstpixel = (DWORD *)dst;
+    UINT x;
 
-            if (FAILED(res)) return res;
+    for (x = 0; x < count; x++)
+        dstpixel[x] = colors[src[x >> 3] >> (7 - (x & 7)) & 1];
+}
 
-            srcstride = prc->Width;
-            srcdatasize = srcstride * prc->Height;
+static void convert_row_2bpp(BYTE *dst, const BYTE *src, UINT count, const WICColor *colors)
+{
+    DWORD *dstpixel = (DWORD *)dst;
+    UINT x;
 
-            srcdata = HeapAlloc(GetProcessHeap(), 0, srcdatasize);
-            if (!srcdata) return E_OUTOFMEMORY;
+    for (x = 0; x < count; x++)
+        dstpixel[x] = colors[src[x >> 2] >> (6 - 2 * (x & 3)) & 0x3];
+}
 
-            res = IWICBitmapSource_CopyPixels(This->source, prc, srcstride, srcdatasize, srcdata);
+static void convert_row_4bpp(BYTE *dst, const BYTE *src, UINT count, const WICColor *colors)
+{
+    DWORD *dstpixel = (DWORD *)dst;
+    UINT x;
 
-            if (SUCCEEDED(res))
-            {
-                srcrow = srcdata;
-                dstrow = pbBuffer;
-                for (y=0; y<prc->Height; y++) {
-                    srcbyte = srcrow;
-                    dstpixel=(DWORD*)dstrow;
-                    for (x=0; x<prc->Width; x++)
-                        *dstpixel++ = colors[*srcbyte++];
-                    srcrow += srcstride;
-                    dstrow += cbStride;
-                }
-            }
+    for (x = 0; x < count; x++)
+        dstpixel[x] = colors[src[x >> 1] >> (4 - 4 * (x & 1)) & 0xf];
+}
 
-            HeapFree(GetProcessHeap(), 0, srcdata);
+static void convert_row_8bpp(BYTE *dst, const BYTE *src, UINT count, const WICColor *colors)
+{
+    DWORD *dstpixel = (DWORD *)dst;
+    UINT x;
 
-            return res;
-        }
-        return S_OK;
-    case format_16bppGray:
-        if (prc)
-        {
-            HRESULT res;
-            INT x, y;
-            BYTE *srcdata;
-            UINT srcstride, srcdatasize;
-            const BYTE *srcrow;
-            const BYTE *srcbyte;
-            BYTE *dstrow;
-            DWORD *dstpixel;
+    for (x = 0; x + 4 <= count; x += 4)
+    {
+        dstpixel[x] = colors[src[x]];
+        dstpixel[x + 1] = colors[src[x + 1]];
+        dstpixel[x + 2] = colors[src[x + 2]];
+        dstpixel[x + 3] = colors[src[x + 3]];
+    }
+    for (; x < count; x++)
+        dstpixel[x] = colors[src[x]];
+}
 
-            srcstride = prc->Width * 2;
-            srcdatasize = srcstride * prc->Height;
+static void convert_row_gray8(BYTE *dst, const BYTE *src, UINT count, const WICColor *colors)
+{
+    DWORD *dstpixel = (DWORD *)dst;
+    UINT x = 0;
 
-            srcdata = HeapAlloc(GetProcessHeap(), 0, srcdatasize);
-            if (!srcdata) return E_OUTOFMEMORY;
+#ifdef HAVE_SSE2_ROWS
+    if (use_sse2)
+    {
+        x = count & ~15;
+        convert_row_gray8_sse2(dst, src, x);
+    }
+#endif
+    for (; x < count; x++)
+        dstpixel[x] = 0xff000000 | (src[x] << 16) | (src[x] << 8) | src[x];
+}
 
-            res = IWICBitmapSource_CopyPixels(This->source, prc, srcstride, srcdatasize, srcdata);
+static void convert_row_gray16(BYTE *dst, const BYTE *src, UINT count, const WICColor *colors)
+{
+    DWORD *dstpixel = (DWORD *)dst;
+    UINT x;
 
-            if (SUCCEEDED(res))
-            {
-                srcrow = srcdata;
-                dstrow = pbBuffer;
-                for (y=0; y<prc->Height; y++) {
-                    srcbyte = srcrow;
-                    dstpixel=(DWORD*)dstrow;
-                    for (x=0; x<prc->Width; x++)
-                    {
-                        srcbyte++;
-                        *dstpixel++ = 0xff000000|(*srcbyte<<16)|(*srcbyte<<8)|*srcbyte;
-                        srcbyte++;
-                    }
-                    srcrow += srcstride;
-                    dstrow += cbStride;
-                }
-            }
+    for (x = 0; x < count; x++)
+    {
+        BYTE gray = src[2 * x + 1];
+        dstpixel[x] = 0xff000000 | (gray << 16) | (gray << 8) | gray;
+    }
+}
 
-            HeapFree(GetProcessHeap(), 0, srcdata);
+static void convert_row_bgr555(BYTE *dst, const BYTE *src, UINT count, const WICColor *colors)
+{
+    const WORD *srcpixel = (const WORD *)src;
+    DWORD *dstpixel = (DWORD *)dst;
+    UINT x;
 
-            return res;
-        }
-        return S_OK;
-    case format_16bppBGR555:
-        if (prc)
-        {
-            HRESULT res;
-            INT x, y;
-            BYTE *srcdata;
-            UINT srcstride, srcdatasize;
-            const BYTE *srcrow;
-            const WORD *srcpixel;
-            BYTE *dstrow;
-            DWORD *dstpixel;
+    for (x = 0; x < count; x++)
+    {
+        WORD srcval = srcpixel[x];
+        dstpixel[x] = 0xff000000 | /* constant 255 alpha */
+                      ((srcval << 9) & 0xf80000) | /* r */
+                      ((srcval << 4) & 0x070000) | /* r - 3 bits */
+                      ((srcval << 6) & 0x00f800) | /* g */
+                      ((srcval << 1) & 0x000700) | /* g - 3 bits */
+                      ((srcval << 3) & 0x0000f8) | /* b */
+                      ((srcval >> 2) & 0x000007);  /* b - 3 bits */
+    }
+}
 
-            srcstride = 2 * prc->Width;
-            srcdatasize = srcstride * prc->Height;
+static void convert_row_bgr565(BYTE *dst, const BYTE *src, UINT count, const WICColor *colors)
+{
+    const WORD *srcpixel = (const WORD *)src;
+    DWORD *dstpixel = (DWORD *)dst;
+    UINT x;
 
-            srcdata = HeapAlloc(GetProcessHeap(), 0, srcdatasize);
-            if (!srcdata) return E_OUTOFMEMORY;
+    for (x = 0; x < count; x++)
+    {
+        WORD srcval = srcpixel[x];
+        dstpixel[x] = 0xff000000 | /* constant 255 alpha */
+                      ((srcval << 8) & 0xf80000) | /* r */
+                      ((srcval << 3) & 0x070000) | /* r - 3 bits */
+                      ((srcval << 5) & 0x00fc00) | /* g */
+                      ((srcval >> 1) & 0x000300) | /* g - 2 bits */
+                      ((srcval << 3) & 0x0000f8) | /* b */
+                      ((srcval >> 2) & 0x000007);  /* b - 3 bits */
+    }
+}
 
-            res = IWICBitmapSource_CopyPixels(This->source, prc, srcstride, srcdatasize, srcdata);
+static void convert_row_bgra5551(BYTE *dst, const BYTE *src, UINT count, const WICColor *colors)
+{
+    const WORD *srcpixel = (const WORD *)src;
+    DWORD *dstpixel = (DWORD *)dst;
+    UINT x;
 
-            if (SUCCEEDED(res))
-            {
-                srcrow = srcdata;
-                dstrow = pbBuffer;
-                for (y=0; y<prc->Height; y++) {
-                    srcpixel=(const WORD*)srcrow;
-                    dstpixel=(DWORD*)dstrow;
-                    for (x=0; x<prc->Width; x++) {
-                        WORD srcval;
-                        srcval=*srcpixel++;
-                        *dstpixel++=0xff000000 | /* constant 255 alpha */
-                                    ((srcval << 9) & 0xf80000) | /* r */
-                                    ((srcval << 4) & 0x070000) | /* r - 3 bits */
-                                    ((srcval << 6) & 0x00f800) | /* g */
-                                    ((srcval << 1) & 0x000700) | /* g - 3 bits */
-                                    ((srcval << 3) & 0x0000f8) | /* b */
-                                    ((srcval >> 2) & 0x000007);  /* b - 3 bits */
-                    }
-                    srcrow += srcstride;
-                    dstrow += cbStride;
-                }
-            }
+    for (x = 0; x < count; x++)
+    {
+        WORD srcval = srcpixel[x];
+        dstpixel[x] = ((srcval & 0x8000) ? 0xff000000 : 0) | /* alpha */
+                      ((srcval << 9) & 0xf80000) | /* r */
+                      ((srcval << 4) & 0x070000) | /* r - 3 bits */
+                      ((srcval << 6) & 0x00f800) | /* g */
+                      ((srcval << 1) & 0x000700) | /* g - 3 bits */
+                      ((srcval << 3) & 0x0000f8) | /* b */
+                      ((srcval >> 2) & 0x000007);  /* b - 3 bits */
+    }
+}
 
-            HeapFree(GetProcessHeap(), 0, srcdata);
+static void convert_row_24bpp(BYTE *dst, const BYTE *src, UINT count, BOOL swap)
+{
+    UINT x = 0;
 
-            return res;
-        }
-        return S_OK;
-    case format_16bppBGR565:
-        if (prc)
-        {
-            HRESULT res;
-            INT x, y;
-            BYTE *srcdata;
-            UINT srcstride, srcdatasize;
-            const BYTE *srcrow;
-            const WORD *srcpixel;
-            BYTE *dstrow;
-            DWORD *dstpixel;
+#ifdef HAVE_SSE2_ROWS
+    /* The SIMD code reads one byte past its last pixel */
+    if (use_sse2 && count > 4)
+    {
+        x = (count - 1) & ~3;
+        convert_row_24to32_sse2(dst, src, x, swap);
+    }
+#endif
+    for (; x < count; x++)
+    {
+        dst[4 * x] = src[3 * x + (swap ? 2 : 0)]; /* blue */
+        dst[4 * x + 1] = src[3 * x + 1]; /* green */
+        dst[4 * x + 2] = src[3 * x + (swap ? 0 : 2)]; /* red */
+        dst[4 * x + 3] = 255; /* alpha */
+    }
+}
 
-            srcstride = 2 * prc->Width;
-            srcdatasize = srcstride * prc->Height;
+static void convert_row_bgr24(BYTE *dst, const BYTE *src, UINT count, const WICColor *colors)
+{
+    convert_row_24bpp(dst, src, count, FALSE);
+}
 
-            srcdata = HeapAlloc(GetProcessHeap(), 0, srcdatasize);
-            if (!srcdata) return E_OUTOFMEMORY;
+static void convert_row_rgb24(BYTE *dst, const BYTE *src, UINT count, const WICColor *colors)
+{
+    convert_row_24bpp(dst, src, count, TRUE);
+}
 
-            res = IWICBitmapSource_CopyPixels(This->source, prc, srcstride, srcdatasize, srcdata);
+static void convert_row_set_alpha(BYTE *dst, const BYTE *src, UINT count, const WICColor *colors)
+{
+    UINT x;
 
-            if (SUCCEEDED(res))
-            {
-                srcrow = srcdata;
-                dstrow = pbBuffer;
-                for (y=0; y<prc->Height; y++) {
-                    srcpixel=(const WORD*)srcrow;
-                    dstpixel=(DWORD*)dstrow;
-                    for (x=0; x<prc->Width; x++) {
-                        WORD srcval;
-                        srcval=*srcpixel++;
-                        *dstpixel++=0xff000000 | /* constant 255 alpha */
-                                    ((srcval << 8) & 0xf80000) | /* r */
-                                    ((srcval << 3) & 0x070000) | /* r - 3 bits */
-                                    ((srcval << 5) & 0x00fc00) | /* g */
-                                    ((srcval >> 1) & 0x000300) | /* g - 2 bits */
-                                    ((srcval << 3) & 0x0000f8) | /* b */
-                                    ((srcval >> 2) & 0x000007);  /* b - 3 bits */
-                    }
-                    srcrow += srcstride;
-                    dstrow += cbStride;
-                }
-            }
+    for (x = 0; x < count; x++)
+        dst[4 * x + 3] = 0xff;
+}
 
-            HeapFree(GetProcessHeap(), 0, srcdata);
+static void convert_row_unpremultiply(BYTE *dst, const BYTE *src, UINT count, const WICColor *colors)
+{
+    UINT x;
 
-            return res;
-        }
-        return S_OK;
-    case format_16bppBGRA5551:
-        if (prc)
+    for (x = 0; x < count; x++, dst += 4)
+    {
+        BYTE alpha = dst[3];
+        if (alpha != 0 && alpha != 255)
         {
-            HRESULT res;
-            INT x, y;
-            BYTE *srcdata;
-            UINT srcstride, srcdatasize;
-            const BYTE *srcrow;
-            const WORD *srcpixel;
-            BYTE *dstrow;
-            DWORD *dstpixel;
-
-            srcstride = 2 * prc->Width;
-            srcdatasize = srcstride * prc->Height;
-
-            srcdata = HeapAlloc(GetProcessHeap(), 0, srcdatasize);
-            if (!srcdata) return E_OUTOFMEMORY;
-
-            res = IWICBitmapSource_CopyPixels(This->source, prc, srcstride, srcdatasize, srcdata);
-
-            if (SUCCEEDED(res))
-            {
-                srcrow = srcdata;
-                dstrow = pbBuffer;
-                for (y=0; y<prc->Height; y++) {
-                    srcpixel=(const WORD*)srcrow;
-                    dstpixel=(DWORD*)dstrow;
-                    for (x=0; x<prc->Width; x++) {
-                        WORD srcval;
-                        srcval=*srcpixel++;
-                        *dstpixel++=((srcval & 0x8000) ? 0xff000000 : 0) | /* alpha */
-                                    ((srcval << 9) & 0xf80000) | /* r */
-                                    ((srcval << 4) & 0x070000) | /* r - 3 bits */
-                                    ((srcval << 6) & 0x00f800) | /* g */
-                                    ((srcval << 1) & 0x000700) | /* g - 3 bits */
-                                    ((srcval << 3) & 0x0000f8) | /* b */
-                                    ((srcval >> 2) & 0x000007);  /* b - 3 bits */
-                    }
-                    srcrow += srcstride;
-                    dstrow += cbStride;
-                }
-            }
-
-            HeapFree(GetProcessHeap(), 0, srcdata);
-
-            return res;
+            dst[0] = dst[0] * 255 / alpha;
+            dst[1] = dst[1] * 255 / alpha;
+            dst[2] = dst[2] * 255 / alpha;
         }
-        return S_OK;
-    case format_24bppBGR:
-        if (prc)
-        {
-            HRESULT res;
-            INT x, y;
-            BYTE *srcdata;
-            UINT srcstride, srcdatasize;
-            const BYTE *srcrow;
-            const BYTE *srcpixel;
-            BYTE *dstrow;
-            BYTE *dstpixel;
-
-            srcstride = 3 * prc->Width;
-            srcdatasize = srcstride * prc->Height;
-
-            srcdata = HeapAlloc(GetProcessHeap(), 0, srcdatasize);
-            if (!srcdata) return E_OUTOFMEMORY;
-
-            res = IWICBitmapSource_CopyPixels(This->source, prc, srcstride, srcdatasize, srcdata);
-
-            if (SUCCEEDED(res))
-            {
-                srcrow = srcdata;
-                dstrow = pbBuffer;
-                for (y=0; y<prc->Height; y++) {
-                    srcpixel=srcrow;
-                    dstpixel=dstrow;
-                    for (x=0; x<prc->Width; x++) {
-                        *dstpixel++=*srcpixel++; /* blue */
-                        *dstpixel++=*srcpixel++; /* green */
-                        *dstpixel++=*srcpixel++; /* red */
-                        *dstpixel++=255; /* alpha */
-                    }
-                    srcrow += srcstride;
-                    dstrow += cbStride;
-                }
-            }
+    }
+}
 
-            HeapFree(GetProcessHeap(), 0, srcdata);
+static void convert_row_rgb48(BYTE *dst, const BYTE *src, UINT count, const WICColor *colors)
+{
+    DWORD *dstpixel = (DWORD *)dst;
+    UINT x;
 
-            return res;
-        }
-        return S_OK;
-    case format_24bppRGB:
-        if (prc)
-        {
-            HRESULT res;
-            INT x, y;
-            BYTE *srcdata;
-            UINT srcstride, srcdatasize;
-            const BYTE *srcrow;
-            const BYTE *srcpixel;
-            BYTE *dstrow;
-            BYTE *dstpixel;
-            BYTE tmppixel[3];
+    /* Keep the high byte of each little endian channel */
+    for (x = 0; x < count; x++, src += 6)
+        dstpixel[x] = 0xff000000 | src[1] << 16 | src[3] << 8 | src[5];
+}
 
-            srcstride = 3 * prc->Width;
-            srcdatasize = srcstride * prc->Height;
+static void convert_row_rgba64(BYTE *dst, const BYTE *src, UINT count, const WICColor *colors)
+{
+    DWORD *dstpixel = (DWORD *)dst;
+    UINT x;
 
-            srcdata = HeapAlloc(GetProcessHeap(), 0, srcdatasize);
-            if (!srcdata) return E_OUTOFMEMORY;
+    for (x = 0; x < count; x++, src += 8)
+        dstpixel[x] = src[7] << 24 | src[1] << 16 | src[3] << 8 | src[5];
+}
 
-            res = IWICBitmapSource_CopyPixels(This->source, prc, srcstride, srcdatasize, srcdata);
+static void convert_row_cmyk(BYTE *dst, const BYTE *src, UINT count, const WICColor *colors)
+{
+    UINT x;
 
-            if (SUCCEEDED(res))
-            {
-                srcrow = srcdata;
-                dstrow = pbBuffer;
-                for (y=0; y<prc->Height; y++) {
-                    srcpixel=srcrow;
-                    dstpixel=dstrow;
-                    for (x=0; x<prc->Width; x++) {
-                        tmppixel[0]=*srcpixel++; /* red */
-                        tmppixel[1]=*srcpixel++; /* green */
-                        tmppixel[2]=*srcpixel++; /* blue */
+    for (x = 0; x < count; x++, dst += 4)
+    {
+        BYTE c = dst[0], m = dst[1], y = dst[2], k = dst[3];
+        dst[0] = (255 - y) * (255 - k) / 255; /* blue */
+        dst[1] = (255 - m) * (255 - k) / 255; /* green */
+        dst[2] = (255 - c) * (255 - k) / 255; /* red */
+        dst[3] = 255; /* alpha */
+    }
+}
 
-                        *dstpixel++=tmppixel[2]; /* blue */
-                        *dstpixel++=tmppixel[1]; /* green */
-                        *dstpixel++=tmppixel[0]; /* red */
-                        *dstpixel++=255; /* alpha */
-                    }
-                    srcrow += srcstride;
-                    dstrow += cbStride;
-                }
-            }
+/* Post processing of converted 32bpp rows, always in place */
 
-            HeapFree(GetProcessHeap(), 0, srcdata);
+static void convert_row_swap_rb(BYTE *dst, const BYTE *src, UINT count, const WICColor *colors)
+{
+    UINT x = 0;
+    BYTE temp;
 
-            return res;
-        }
-        return S_OK;
-    case format_32bppBGR:
-        if (prc)
-        {
-            HRESULT res;
-            INT x, y;
+#ifdef HAVE_SSE2_ROWS
+    if (use_sse2)
+    {
+        x = count & ~3;
+        convert_row_swap_rb_sse2(dst, dst, x);
+    }
+#endif
+    for (; x < count; x++)
+    {
+        temp = dst[4 * x + 2];
+        dst[4 * x + 2] = dst[4 * x];
+        dst[4 * x] = temp;
+    }
+}
 
-            res = IWICBitmapSource_CopyPixels(This->source, prc, cbStride, cbBufferSize, pbBuffer);
-            if (FAILED(res)) return res;
+static void convert_row_premultiply(BYTE *dst, const BYTE *src, UINT count, const WICColor *colors)
+{
+    UINT x = 0;
 
-            /* set all alpha values to 255 */
-            for (y=0; y<prc->Height; y++)
-                for (x=0; x<prc->Width; x++)
-                    pbBuffer[cbStride*y+4*x+3] = 0xff;
-        }
-        return S_OK;
-    case format_32bppBGRA:
-        if (prc)
-            return IWICBitmapSource_CopyPixels(This->source, prc, cbStride, cbBufferSize, pbBuffer);
-        return S_OK;
-    case format_32bppPBGRA:
-        if (prc)
+#ifdef HAVE_SSE2_ROWS
+    if (use_sse2)
+    {
+        x = count & ~3;
+        convert_row_premultiply_sse2(dst, dst, x);
+    }
+#endif
+    for (; x < count; x++)
+    {
+        BYTE alpha = dst[4 * x + 3];
+        if (alpha != 255)
         {
-            HRESULT res;
-            INT x, y;
+            dst[4 * x] = dst[4 * x] * alpha / 255;
+            dst[4 * x + 1] = dst[4 * x + 1] * alpha / 255;
+            dst[4 * x + 2] = dst[4 * x + 2] * alpha / 255;
+        }
+    }
+}
 
-            res = IWICBitmapSource_CopyPixels(This->source, prc, cbStride, cbBufferSize, pbBuffer);
-            if (FAILED(res)) return res;
+static void convert_row_swap_rb_premultiply(BYTE *dst, const BYTE *src, UINT count, const WICColor *colors)
+{
+    convert_row_swap_rb(dst, dst, count, colors);
+    convert_row_premultiply(dst, dst, count, colors);
+}
 
-            for (y=0; y<prc->Height; y++)
-                for (x=0; x<prc->Width; x++)
-                {
-                    BYTE alpha = pbBuffer[cbStride*y+4*x+3];
-                    if (alpha != 0 && alpha != 255)
-                    {
-                        pbBuffer[cbStride*y+4*x] = pbBuffer[cbStride*y+4*x] * 255 / alpha;
-                        pbBuffer[cbStride*y+4*x+1] = pbBuffer[cbStride*y+4*x+1] * 255 / alpha;
-                        pbBuffer[cbStride*y+4*x+2] = pbBuffer[cbStride*y+4*x+2] * 255 / alpha;
-                    }
-                }
-        }
-        return S_OK;
-    case format_48bppRGB:
-        if (prc)
-        {
-            HRESULT res;
-            INT x, y;
-            BYTE *srcdata;
-            UINT srcstride, srcdatasize;
-            const BYTE *srcrow;
-            const BYTE *srcpixel;
-            BYTE *dstrow;
-            DWORD *dstpixel;
+struct bgra_conversion {
+    enum pixelformat format;
+    UINT bpp;
+    convert_row_func convert;
+    UINT colors; /* palette entries used by the row function */
+    WICBitmapPaletteType palette; /* WICBitmapPaletteTypeCustom for the source palette */
+};
 
-            srcstride = 6 * prc->Width;
-            srcdatasize = srcstride * prc->Height;
+static const struct bgra_conversion bgra_conversions[] = {
+    {format_1bppIndexed, 1, convert_row_1bpp, 2, WICBitmapPaletteTypeCustom},
+    {format_2bppIndexed, 2, convert_row_2bpp, 4, WICBitmapPaletteTypeCustom},
+    {format_4bppIndexed, 4, convert_row_4bpp, 16, WICBitmapPaletteTypeCustom},
+    {format_8bppIndexed, 8, convert_row_8bpp, 256, WICBitmapPaletteTypeCustom},
+    {format_BlackWhite, 1, convert_row_1bpp, 2, WICBitmapPaletteTypeFixedBW},
+    {format_2bppGray, 2, convert_row_2bpp, 4, WICBitmapPaletteTypeFixedGray4},
+    {format_4bppGray, 4, convert_row_4bpp, 16, WICBitmapPaletteTypeFixedGray16},
+    {format_8bppGray, 8, convert_row_gray8},
+    {format_16bppGray, 16, convert_row_gray16},
+    {format_16bppBGR555, 16, convert_row_bgr555},
+    {format_16bppBGR565, 16, convert_row_bgr565},
+    {format_16bppBGRA5551, 16, convert_row_bgra5551},
+    {format_24bppBGR, 24, convert_row_bgr24},
+    {format_24bppRGB, 24, convert_row_rgb24},
+    {format_32bppBGR, 32, convert_row_set_alpha},
+    {format_32bppBGRA, 32, NULL},
+    {format_32bppPBGRA, 32, convert_row_unpremultiply},
+    {format_48bppRGB, 48, convert_row_rgb48},
+    {format_64bppRGBA, 64, convert_row_rgba64},
+    {format_32bppCMYK, 32, convert_row_cmyk},
+};
 
-            srcdata = HeapAlloc(GetProcessHeap(), 0, srcdatasize);
-            if (!srcdata) return E_OUTOFMEMORY;
+static const struct bgra_conversion *get_bgra_conversion(enum pixelformat format)
+{
+    UINT i;
 
-            res = IWICBitmapSource_CopyPixels(This->source, prc, srcstride, srcdatasize, srcdata);
+    for (i = 0; i < ARRAY_SIZE(bgra_conversions); i++)
+        if (bgra_conversions[i].format == format) return &bgra_conversions[i];
 
-            if (SUCCEEDED(res))
-            {
-                srcrow = srcdata;
-                dstrow = pbBuffer;
-                for (y=0; y<prc->Height; y++) {
-                    srcpixel=srcrow;
-                    dstpixel=(DWORD*)dstrow;
-                    for (x=0; x<prc->Width; x++) {
-                        BYTE red, green, blue;
-                        srcpixel++; red = *srcpixel++;
-                        srcpixel++; green = *srcpixel++;
-                        srcpixel++; blue = *srcpixel++;
-                        *dstpixel++=0xff000000|red<<16|green<<8|blue;
-                    }
-                    srcrow += srcstride;
-                    dstrow += cbStride;
-                }
-            }
+    return NULL;
+}
 
-            HeapFree(GetProcessHeap(), 0, srcdata);
+static HRESULT get_conversion_colors(struct FormatConverter *This,
+    const struct bgra_conversion *conversion, WICColor *colors)
+{
+    IWICPalette *palette;
+    UINT actualcolors;
+    HRESULT res;
 
-            return res;
-        }
+    res = PaletteImpl_Create(&palette);
+    if (FAILED(res)) return res;
+
+    if (conversion->palette == WICBitmapPaletteTypeCustom)
+        res = IWICBitmapSource_CopyPalette(This->source, palette);
+    else
+        res = IWICPalette_InitializePredefined(palette, conversion->palette, FALSE);
+
+    if (SUCCEEDED(res))
+        res = IWICPalette_GetColors(palette, conversion->colors, colors, &actualcolors);
+
+    IWICPalette_Release(palette);
+    return res;
+}
+
+/* Converts prc to 32bpp BGRA, then applies post to the rows, if given. The
+ * source is read in bands of CONVERT_BAND_SIZE bytes, and every band is
+ * converted and post processed while it is still in the cache. 32bpp
+ * sources are read straight into the destination and converted in place. */
+static HRESULT convert_to_32bpp(struct FormatConverter *This, const WICRect *prc,
+    UINT cbStride, UINT cbBufferSize, BYTE *pbBuffer,
+    const struct bgra_conversion *conversion, convert_row_func post)
+{
+    WICColor colors[256];
+    UINT srcstride;
+    BYTE *srcdata = NULL, *dstrow;
+    INT rows, y, i;
+    WICRect band;
+    HRESULT res;
+
+    if (!prc)
         return S_OK;
-    case format_64bppRGBA:
-        if (prc)
-        {
-            HRESULT res;
-            INT x, y;
-            BYTE *srcdata;
-            UINT srcstride, srcdatasize;
-            const BYTE *srcrow;
-            const BYTE *srcpixel;
-            BYTE *dstrow;
-            DWORD *dstpixel;
 
-            srcstride = 8 * prc->Width;
-            srcdatasize = srcstride * prc->Height;
+    if (!conversion->convert && !post)
+        return IWICBitmapSource_CopyPixels(This->source, prc, cbStride, cbBufferSize, pbBuffer);
 
-            srcdata = HeapAlloc(GetProcessHeap(), 0, srcdatasize);
-            if (!srcdata) return E_OUTOFMEMORY;
+    if (prc->Width < 0 || prc->Height < 0)
+        return E_INVALIDARG;
 
-            res = IWICBitmapSource_CopyPixels(This->source, prc, srcstride, srcdatasize, srcdata);
+    /* Fail before any band is written */
+    if (prc->Height &&
+        (cbStride < 4 * prc->Width || cbStride * (prc->Height - 1) + 4 * prc->Width > cbBufferSize))
+        return E_INVALIDARG;
 
-            if (SUCCEEDED(res))
-            {
-                srcrow = srcdata;
-                dstrow = pbBuffer;
-                for (y=0; y<prc->Height; y++) {
-                    srcpixel=srcrow;
-                    dstpixel=(DWORD*)dstrow;
-                    for (x=0; x<prc->Width; x++) {
-                        BYTE red, green, blue, alpha;
-                        srcpixel++; red = *srcpixel++;
-                        srcpixel++; green = *srcpixel++;
-                        srcpixel++; blue = *srcpixel++;
-                        srcpixel++; alpha = *srcpixel++;
-                        *dstpixel++=alpha<<24|red<<16|green<<8|blue;
-                    }
-                    srcrow += srcstride;
-                    dstrow += cbStride;
-                }
-            }
+    if (conversion->colors)
+    {
+        memset(colors, 0, sizeof(colors));
+        res = get_conversion_colors(This, conversion, colors);
+        if (FAILED(res)) return res;
+    }
 
-            HeapFree(GetProcessHeap(), 0, srcdata);
+    srcstride = (prc->Width * conversion->bpp + 7) / 8;
+    rows = srcstride ? max(CONVERT_BAND_SIZE / srcstride, 1) : prc->Height;
+    rows = min(rows, prc->Height);
 
-            return res;
-        }
-        return S_OK;
-    case format_32bppCMYK:
-        if (prc)
-        {
-            HRESULT res;
-            UINT x, y;
+    if (conversion->bpp != 32)
+    {
+        srcdata = HeapAlloc(GetProcessHeap(), 0, srcstride * max(rows, 1));
+        if (!srcdata) return E_OUTOFMEMORY;
+    }
 
-            res = IWICBitmapSource_CopyPixels(This->source, prc, cbStride, cbBufferSize, pbBuffer);
-            if (FAILED(res)) return res;
+    band.X = prc->X;
+    band.Width = prc->Width;
+    res = S_OK;
 
-            for (y=0; y<prc->Height; y++)
-                for (x=0; x<prc->Width; x++)
-                {
-                    BYTE *pixel = pbBuffer+cbStride*y+4*x;
-                    BYTE c=pixel[0], m=pixel[1], y=pixel[2], k=pixel[3];
-                    pixel[0] = (255-y)*(255-k)/255; /* blue */
-                    pixel[1] = (255-m)*(255-k)/255; /* green */
-                    pixel[2] = (255-c)*(255-k)/255; /* red */
-                    pixel[3] = 255; /* alpha */
-                }
+    for (y = 0; y < prc->Height && SUCCEEDED(res); y += band.Height)
+    {
+        dstrow = pbBuffer + cbStride * y;
+        band.Y = prc->Y + y;
+        band.Height = min(rows, prc->Height - y);
+
+        if (srcdata)
+            res = IWICBitmapSource_CopyPixels(This->source, &band, srcstride,
+                srcstride * band.Height, srcdata);
+        else
+            res = IWICBitmapSource_CopyPixels(This->source, &band, cbStride,
+                cbBufferSize - cbStride * y, dstrow);
+        if (FAILED(res)) break;
+
+        for (i = 0; i < band.Height; i++, dstrow += cbStride)
+        {
+            if (srcdata)
+                conversion->convert(dstrow, srcdata + srcstride * i, prc->Width, colors);
+            else if (conversion->convert)
+                conversion->convert(dstrow, dstrow, prc->Width, colors);
+
+            if (post)
+                post(dstrow, dstrow, prc->Width, colors);
         }
-        return S_OK;
-    default:
-        return WINCODEC_ERR_UNSUPPORTEDOPERATION;
     }
+
+    HeapFree(GetProcessHeap(), 0, srcdata);
+    return res;
 }
 
-static HRESULT copypixels_to_32bppRGBA(struct FormatConverter *This, const WICRect *prc,
+static HRESULT copypixels_to_32bppBGRA(struct FormatConverter *This, const WICRect *prc,
     UINT cbStride, UINT cbBufferSize, BYTE *pbBuffer, enum pixelformat source_format)
 {
-    HRESULT hr;
+    const struct bgra_conversion *conversion = get_bgra_conversion(source_format);
 
-    switch (source_format)
-    {
-    case format_32bppRGB:
-        if (prc)
-        {
-            INT x, y;
+    if (!conversion)
+        return WINCODEC_ERR_UNSUPPORTEDOPERATION;
 
-            hr = IWICBitmapSource_CopyPixels(This->source, prc, cbStride, cbBufferSize, pbBuffer);
-            if (FAILED(hr)) return hr;
+    return convert_to_32bpp(This, prc, cbStride, cbBufferSize, pbBuffer, conversion, NULL);
+}
 
-            /* set all alpha values to 255 */
-            for (y=0; y<prc->Height; y++)
-                for (x=0; x<prc->Width; x++)
-                    pbBuffer[cbStride*y+4*x+3] = 0xff;
-        }
-        return S_OK;
+/* The RGBA order formats convert like their BGRA order counterparts, with
+ * red and blue swapped for the others, and are optionally premultiplied. */
+static HRESULT convert_to_32bppRGBA(struct FormatConverter *This, const WICRect *prc,
+    UINT cbStride, UINT cbBufferSize, BYTE *pbBuffer, enum pixelformat source_format,
+    BOOL premultiply)
+{
+    const struct bgra_conversion *conversion;
+    convert_row_func post;
 
+    switch (source_format)
+    {
+    case format_32bppRGB:
+        conversion = get_bgra_conversion(format_32bppBGR);
+        post = NULL;
+        break;
     case format_32bppRGBA:
-        if (prc)
-            return IWICBitmapSource_CopyPixels(This->source, prc, cbStride, cbBufferSize, pbBuffer);
-        return S_OK;
-
+        conversion = get_bgra_conversion(format_32bppBGRA);
+        post = premultiply ? convert_row_premultiply : NULL;
+        break;
     case format_32bppPRGBA:
-        if (prc)
-        {
-            INT x, y;
+        conversion = get_bgra_conversion(format_32bppPBGRA);
+        post = premultiply ? convert_row_premultiply : NULL;
+        break;
+    default:
+        conversion = get_bgra_conversion(source_format);
+        post = premultiply ? convert_row_swap_rb_premultiply : convert_row_swap_rb;
+        break;
+    }
 
-            hr = IWICBitmapSource_CopyPixels(This->source, prc, cbStride, cbBufferSize, pbBuffer);
-            if (FAILED(hr)) return hr;
+    if (!conversion)
+        return WINCODEC_ERR_UNSUPPORTEDOPERATION;
 
-            for (y=0; y<prc->Height; y++)
-                for (x=0; x<prc->Width; x++)
-                {
-                    BYTE alpha = pbBuffer[cbStride*y+4*x+3];
-                    if (alpha != 0 && alpha != 255)
-                    {
-                        pbBuffer[cbStride*y+4*x] = pbBuffer[cbStride*y+4*x] * 255 / alpha;
-                        pbBuffer[cbStride*y+4*x+1] = pbBuffer[cbStride*y+4*x+1] * 255 / alpha;
-                        pbBuffer[cbStride*y+4*x+2] = pbBuffer[cbStride*y+4*x+2] * 255 / alpha;
-                    }
-                }
-        }
-        return S_OK;
+    return convert_to_32bpp(This, prc, cbStride, cbBufferSize, pbBuffer, conversion, post);
+}
 
-    default:
-        hr = copypixels_to_32bppBGRA(This, prc, cbStride, cbBufferSize, pbBuffer, source_format);
-        if (SUCCEEDED(hr) && prc)
-              reverse_bgr8(4, pbBuffer, prc->Width, prc->Height, cbStride);
-        return hr;
-    }
+static HRESULT copypixels_to_32bppRGBA(struct FormatConverter *This, const WICRect *prc,
+    UINT cbStride, UINT cbBufferSize, BYTE *pbBuffer, enum pixelformat source_format)
+{
+    return convert_to_32bppRGBA(This, prc, cbStride, cbBufferSize, pbBuffer, source_format, FALSE);
 }
 
 static HRESULT copypixels_to_32bppBGR(struct FormatConverter *This, const WICRect *prc,
@@ -955,7 +697,7 @@ static HRESULT copypixels_to_32bppRGB(struct FormatConverter *This, const WICRec
 static HRESULT copypixels_to_32bppPBGRA(struct FormatConverter *This, const WICRect *prc,
     UINT cbStride, UINT cbBufferSize, BYTE *pbBuffer, enum pixelformat source_format)
 {
-    HRESULT hr;
+    const struct bgra_conversion *conversion;
 
     switch (source_format)
     {
@@ -964,32 +706,17 @@ static HRESULT copypixels_to_32bppPBGRA(struct FormatConverter *This, const WICR
             return IWICBitmapSource_CopyPixels(This->source, prc, cbStride, cbBufferSize, pbBuffer);
         return S_OK;
     default:
-        hr = copypixels_to_32bppBGRA(This, prc, cbStride, cbBufferSize, pbBuffer, source_format);
-        if (SUCCEEDED(hr) && prc)
-        {
-            INT x, y;
-
-            for (y=0; y<prc->Height; y++)
-                for (x=0; x<prc->Width; x++)
-                {
-                    BYTE alpha = pbBuffer[cbStride*y+4*x+3];
-                    if (alpha != 255)
-                    {
-                        pbBuffer[cbStride*y+4*x] = pbBuffer[cbStride*y+4*x] * alpha / 255;
-                        pbBuffer[cbStride*y+4*x+1] = pbBuffer[cbStride*y+4*x+1] * alpha / 255;
-                        pbBuffer[cbStride*y+4*x+2] = pbBuffer[cbStride*y+4*x+2] * alpha / 255;
-                    }
-                }
-        }
-        return hr;
+        conversion = get_bgra_conversion(source_format);
+        if (!conversion)
+            return WINCODEC_ERR_UNSUPPORTEDOPERATION;
+        return convert_to_32bpp(This, prc, cbStride, cbBufferSize, pbBuffer,
+            conversion, convert_row_premultiply);
     }
 }
 
 static HRESULT copypixels_to_32bppPRGBA(struct FormatConverter *This, const WICRect *prc,
     UINT cbStride, UINT cbBufferSize, BYTE *pbBuffer, enum pixelformat source_format)
 {
-    HRESULT hr;
-
     switch (source_format)
     {
     case format_32bppPRGBA:
@@ -997,24 +724,7 @@ static HRESULT copypixels_to_32bppPRGBA(struct FormatConverter *This, const WICR
             return IWICBitmapSource_CopyPixels(This->source, prc, cbStride, cbBufferSize, pbBuffer);
         return S_OK;
     default:
-        hr = copypixels_to_32bppRGBA(This, prc, cbStride, cbBufferSize, pbBuffer, source_format);
-        if (SUCCEEDED(hr) && prc)
-        {
-            INT x, y;
-
-            for (y=0; y<prc->Height; y++)
-                for (x=0; x<prc->Width; x++)
-                {
-                    BYTE alpha = pbBuffer[cbStride*y+4*x+3];
-                    if (alpha != 255)
-                    {
-                        pbBuffer[cbStride*y+4*x] = pbBuffer[cbStride*y+4*x] * alpha / 255;
-                        pbBuffer[cbStride*y+4*x+1] = pbBuffer[cbStride*y+4*x+1] * alpha / 255;
-                        pbBuffer[cbStride*y+4*x+2] = pbBuffer[cbStride*y+4*x+2] * alpha / 255;
-                    }
-                }
-        }
-        return hr;
+        return convert_to_32bppRGBA(This, prc, cbStride, cbBufferSize, pbBuffer, source_format, TRUE);
     }
 }
 
@@ -1107,7 +817,7 @@ static HRESULT copypixels_to_24bppBGR(struct FormatConverter *This, const WICRec
 
                     for (x = 0; x < prc->Width; x++)
                     {
-                        BYTE gray = (BYTE)floorf(to_sRGB_component(gray_float[x]) * 255.0f + 0.51f);
+                        BYTE gray = to_sRGB_byte(gray_float[x]);
                         *bgr++ = gray;
                         *bgr++ = gray;
                         *bgr++ = gray;
@@ -1326,7 +1036,7 @@ static HRESULT copypixels_to_8bppGray(struct FormatConverter *This, const WICRec
                     BYTE *dstpixel = dst;
 
                     for (x=0; x < prc->Width; x++)
-                        *dstpixel++ = (BYTE)floorf(to_sRGB_component(*srcpixel++) * 255.0f + 0.51f);
+                        *dstpixel++ = to_sRGB_byte(*srcpixel++);
 
                     src += srcstride;
                     dst += cbStride;
@@ -1362,8 +1072,7 @@ static HRESULT copypixels_to_8bppGray(struct FormatConverter *This, const WICRec
             {
                 float gray = (bgr[2] * 0.2126f + bgr[1] * 0.7152f + bgr[0] * 0.0722f) / 255.0f;
 
-                gray = to_sRGB_component(gray) * 255.0f;
-                dst[x] = (BYTE)floorf(gray + 0.51f);
+                dst[x] = to_sRGB_byte(gray);
                 bgr += 3;
             }
             src += srcstride;
@@ -1819,6 +1528,11 @@ HRESULT FormatConverter_CreateInstance(REFIID iid, void** ppv)
     InitializeCriticalSection(&This->lock);
     This->lock.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": FormatConverter.lock");
 
+    init_srgb_thresholds();
+#ifdef HAVE_SSE2_ROWS
+    use_sse2 = IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE);
+#endif
+
     ret = IWICFormatConverter_QueryInterface(&This->IWICFormatConverter_iface, iid, ppv);
     IWICFormatConverter_Release(&This->IWICFormatConverter_iface);
 
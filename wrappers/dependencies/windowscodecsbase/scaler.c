@@ -20,6 +20,7 @@
 #include "config.h"
 
 #include <stdarg.h>
+#include <math.h>
 
 #define COBJMACROS
 
@@ -33,6 +34,18 @@
 
 WINE_DEFAULT_DEBUG_CHANNEL(wincodecs);
 
+/* Coefficients of a separable filter for one direction. Destination pixel i
+ * is the weighted sum of source pixels start[i] to start[i] + taps - 1, with
+ * the weights at coeffs + i * taps in 2.14 fixed point. */
+typedef struct ScalerFilter {
+    UINT taps;
+    UINT *start;
+    SHORT *coeffs;
+} ScalerFilter;
+
+typedef void (*scale_row_h_func)(SHORT*,const BYTE*,const UINT*,const SHORT*,UINT,UINT);
+typedef void (*scale_row_v_func)(BYTE*,SHORT* const*,const SHORT*,UINT,UINT,BOOL);
+
 typedef struct BitmapScaler {
     IWICBitmapScaler IWICBitmapScaler_iface;
     LONG ref;
@@ -44,6 +57,15 @@ typedef struct BitmapScaler {
     UINT bpp;
     void (*fn_get_required_source_rect)(struct BitmapScaler*,UINT,UINT,WICRect*);
     void (*fn_copy_scanline)(struct BitmapScaler*,UINT,UINT,UINT,BYTE**,UINT,UINT,BYTE*);
+    ScalerFilter filter_x, filter_y; /* filtered modes only */
+    BOOL premultiplied;
+    scale_row_h_func fn_scale_row_h;
+    scale_row_v_func fn_scale_row_v;
+    SHORT *rows;        /* filter_y.taps horizontally scaled source rows */
+    INT *row_index;     /* source row held by each of them, or -1 */
+    SHORT **row_ptrs;
+    BYTE *band;         /* source rows read by one CopyPixels call */
+    UINT band_rows;
     CRITICAL_SECTION lock; /* must be held when initialized */
 } BitmapScaler;
 
@@ -57,6 +79,333 @@ static inline BitmapScaler *impl_from_IMILBitmapScaler(IMILBitmapScaler *iface)
     return CONTAINING_RECORD(iface, BitmapScaler, IMILBitmapScaler_iface);
 }
 
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_AMD64)
+extern void CDECL scale_row_h_sse2(SHORT *dst, const BYTE *src, const UINT *start,
+    const SHORT *coeffs, UINT taps, UINT count) DECLSPEC_HIDDEN;
+extern void CDECL scale_row_v_sse2(BYTE *dst, SHORT * const *rows,
+    const SHORT *coeffs, UINT taps, UINT count, BOOL premultiplied) DECLSPEC_HIDDEN;
+#endif
+
+#define FILTER_SHIFT 14
+#define FILTER_ONE (1 << FILTER_SHIFT)
+#define MAX_BAND_ROWS 16
+
+/* Horizontal pass: 8-bit BGRA to 16-bit intermediates with 6 fraction bits */
+static void scale_row_h(SHORT *dst, const BYTE *src, const UINT *start,
+    const SHORT *coeffs, UINT taps, UINT count)
+{
+    UINT x, k;
+
+    for (x = 0; x < count; x++, dst += 4)
+    {
+        const BYTE *pixel = src + start[x] * 4;
+        INT sum[4] = { 0, 0, 0, 0 };
+
+        for (k = 0; k < taps; k++, pixel += 4, coeffs++)
+        {
+            sum[0] += pixel[0] * *coeffs;
+            sum[1] += pixel[1] * *coeffs;
+            sum[2] += pixel[2] * *coeffs;
+            sum[3] += pixel[3] * *coeffs;
+        }
+
+        for (k = 0; k < 4; k++)
+            dst[k] = (sum[k] + (1 << 7)) >> 8;
+    }
+}
+
+static inline BYTE clamp_byte(INT value)
+{
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+/* Vertical pass: 16-bit intermediates back to 8-bit BGRA. Premultiplied
+ * color can not exceed alpha, which the negative lobes of cubic filters
+ * would otherwise allow. */
+static void scale_row_v(BYTE *dst, SHORT * const *rows, const SHORT *coeffs,
+    UINT taps, UINT count, BOOL premultiplied)
+{
+    UINT i, k;
+
+    for (i = 0; i < count * 4; i += 4, dst += 4)
+    {
+        INT sum[4] = { 0, 0, 0, 0 };
+
+        for (k = 0; k < taps; k++)
+        {
+            sum[0] += rows[k][i] * coeffs[k];
+            sum[1] += rows[k][i + 1] * coeffs[k];
+            sum[2] += rows[k][i + 2] * coeffs[k];
+            sum[3] += rows[k][i + 3] * coeffs[k];
+        }
+
+        dst[3] = clamp_byte((sum[3] + (1 << 19)) >> 20);
+        for (k = 0; k < 3; k++)
+        {
+            dst[k] = clamp_byte((sum[k] + (1 << 19)) >> 20);
+            if (premultiplied && dst[k] > dst[3]) dst[k] = dst[3];
+        }
+    }
+}
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_AMD64)
+/* The assembler handles pixel pairs in the vertical pass */
+static void scale_row_v_simd(BYTE *dst, SHORT * const *rows, const SHORT *coeffs,
+    UINT taps, UINT count, BOOL premultiplied)
+{
+    SHORT *last[64];
+    UINT k, pairs = count & ~1u;
+
+    if (pairs)
+        scale_row_v_sse2(dst, rows, coeffs, taps, pairs, premultiplied);
+
+    if (count & 1)
+    {
+        if (taps > ARRAY_SIZE(last))
+        {
+            SHORT **tail = HeapAlloc(GetProcessHeap(), 0, taps * sizeof(*tail));
+            if (!tail) return;
+            for (k = 0; k < taps; k++) tail[k] = rows[k] + pairs * 4;
+            scale_row_v(dst + pairs * 4, tail, coeffs, taps, 1, premultiplied);
+            HeapFree(GetProcessHeap(), 0, tail);
+            return;
+        }
+        for (k = 0; k < taps; k++) last[k] = rows[k] + pairs * 4;
+        scale_row_v(dst + pairs * 4, last, coeffs, taps, 1, premultiplied);
+    }
+}
+#endif
+
+static double filter_linear(double x)
+{
+    x = fabs(x);
+    return x < 1.0 ? 1.0 - x : 0.0;
+}
+
+/* Keys cubic with a = -0.5 */
+static double filter_cubic(double x)
+{
+    x = fabs(x);
+    if (x < 1.0) return (1.5 * x - 2.5) * x * x + 1.0;
+    if (x < 2.0) return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+    return 0.0;
+}
+
+/* Computes the weights of destination pixel i on source pixels first to last,
+ * clamping the taps that fall outside of the source to its edges. Returns the
+ * number of weights. */
+static UINT filter_weights(WICBitmapInterpolationMode mode, UINT src_size, UINT dst_size,
+    UINT i, double *weights, INT *first)
+{
+    double scale = (double)src_size / dst_size;
+    double center, radius, stretch, w;
+    INT j, j0, j1, lo, hi;
+
+    if (mode == WICBitmapInterpolationModeFant)
+    {
+        /* Area average over the footprint of the destination pixel */
+        double left = i * scale, right = (i + 1) * scale;
+        j0 = (INT)floor(left);
+        j1 = (INT)ceil(right) - 1;
+        stretch = radius = center = 0.0;
+    }
+    else
+    {
+        /* Only HighQualityCubic widens the kernel when shrinking */
+        stretch = (mode == WICBitmapInterpolationModeHighQualityCubic && scale > 1.0) ? scale : 1.0;
+        radius = (mode == WICBitmapInterpolationModeLinear ? 1.0 : 2.0) * stretch;
+        center = (i + 0.5) * scale - 0.5;
+        j0 = (INT)floor(center - radius) + 1;
+        j1 = (INT)ceil(center + radius) - 1;
+    }
+
+    lo = max(j0, 0);
+    hi = min(j1, (INT)src_size - 1);
+    if (hi < lo) lo = hi = min(max(j0, 0), (INT)src_size - 1);
+    if (!weights) return hi - lo + 1;
+
+    memset(weights, 0, (hi - lo + 1) * sizeof(*weights));
+    for (j = j0; j <= j1; j++)
+    {
+        if (mode == WICBitmapInterpolationModeFant)
+            w = min(j + 1.0, (i + 1) * scale) - max((double)j, i * scale);
+        else if (mode == WICBitmapInterpolationModeLinear)
+            w = filter_linear((j - center) / stretch);
+        else
+            w = filter_cubic((j - center) / stretch);
+
+        weights[min(max(j, lo), hi) - lo] += w;
+    }
+
+    *first = lo;
+    return hi - lo + 1;
+}
+
+static BOOL init_filter(ScalerFilter *filter, WICBitmapInterpolationMode mode,
+    UINT src_size, UINT dst_size)
+{
+    double *weights, total, largest;
+    UINT i, k, taps = 0, count;
+    INT first, offset, sum, peak;
+
+    for (i = 0; i < dst_size; i++)
+        taps = max(taps, filter_weights(mode, src_size, dst_size, i, NULL, NULL));
+
+    filter->taps = taps;
+    filter->start = HeapAlloc(GetProcessHeap(), 0, dst_size * sizeof(UINT));
+    filter->coeffs = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, dst_size * taps * sizeof(SHORT));
+    weights = HeapAlloc(GetProcessHeap(), 0, taps * sizeof(double));
+    if (!filter->start || !filter->coeffs || !weights)
+    {
+        HeapFree(GetProcessHeap(), 0, weights);
+        return FALSE;
+    }
+
+    for (i = 0; i < dst_size; i++)
+    {
+        SHORT *coeffs = filter->coeffs + i * taps;
+
+        count = filter_weights(mode, src_size, dst_size, i, weights, &first);
+
+        /* Keep the whole window inside of the source */
+        filter->start[i] = min((UINT)first, src_size - taps);
+        offset = first - filter->start[i];
+
+        total = 0.0;
+        for (k = 0; k < count; k++) total += weights[k];
+        if (total == 0.0) total = weights[0] = 1.0;
+
+        sum = 0;
+        peak = 0;
+        largest = 0.0;
+        for (k = 0; k < count; k++)
+        {
+            coeffs[offset + k] = (SHORT)floor(weights[k] / total * FILTER_ONE + 0.5);
+            sum += coeffs[offset + k];
+            if (fabs(weights[k]) > largest)
+            {
+                largest = fabs(weights[k]);
+                peak = offset + k;
+            }
+        }
+        /* Flat areas must stay flat */
+        coeffs[peak] += FILTER_ONE - sum;
+    }
+
+    HeapFree(GetProcessHeap(), 0, weights);
+    return TRUE;
+}
+
+static void free_filter_state(BitmapScaler *This)
+{
+    HeapFree(GetProcessHeap(), 0, This->filter_x.start);
+    HeapFree(GetProcessHeap(), 0, This->filter_x.coeffs);
+    HeapFree(GetProcessHeap(), 0, This->filter_y.start);
+    HeapFree(GetProcessHeap(), 0, This->filter_y.coeffs);
+    HeapFree(GetProcessHeap(), 0, This->rows);
+    HeapFree(GetProcessHeap(), 0, This->row_index);
+    HeapFree(GetProcessHeap(), 0, This->row_ptrs);
+    HeapFree(GetProcessHeap(), 0, This->band);
+    memset(&This->filter_x, 0, sizeof(This->filter_x));
+    memset(&This->filter_y, 0, sizeof(This->filter_y));
+    This->rows = NULL;
+    This->row_index = NULL;
+    This->row_ptrs = NULL;
+    This->band = NULL;
+}
+
+static HRESULT init_filter_state(BitmapScaler *This)
+{
+    UINT i;
+
+    if (!init_filter(&This->filter_x, This->mode, This->src_width, This->width) ||
+        !init_filter(&This->filter_y, This->mode, This->src_height, This->height))
+        return E_OUTOFMEMORY;
+
+    This->band_rows = min(This->filter_y.taps, MAX_BAND_ROWS);
+    This->rows = HeapAlloc(GetProcessHeap(), 0,
+        (SIZE_T)This->filter_y.taps * This->width * 4 * sizeof(SHORT));
+    This->row_index = HeapAlloc(GetProcessHeap(), 0, This->filter_y.taps * sizeof(INT));
+    This->row_ptrs = HeapAlloc(GetProcessHeap(), 0, This->filter_y.taps * sizeof(SHORT*));
+    This->band = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)This->band_rows * This->src_width * 4);
+    if (!This->rows || !This->row_index || !This->row_ptrs || !This->band)
+        return E_OUTOFMEMORY;
+
+    for (i = 0; i < This->filter_y.taps; i++)
+        This->row_index[i] = -1;
+
+    This->fn_scale_row_h = scale_row_h;
+    This->fn_scale_row_v = scale_row_v;
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_AMD64)
+    if (IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE))
+    {
+        This->fn_scale_row_h = scale_row_h_sse2;
+        This->fn_scale_row_v = scale_row_v_simd;
+    }
+#endif
+
+    return S_OK;
+}
+
+/* Produces the destination rows of rc. Source rows are read in bands and
+ * scaled horizontally once; they stay cached for the following rows, so
+ * copying the image one scanline at a time from top to bottom reads each
+ * source row only once. */
+static HRESULT filter_copy_pixels(BitmapScaler *This, const WICRect *rc,
+    UINT stride, BYTE *buffer)
+{
+    UINT taps = This->filter_y.taps;
+    UINT src_stride = This->src_width * 4;
+    UINT row_size = This->width * 4;
+    UINT y, k, row, first, count;
+    WICRect band_rect;
+    HRESULT hr;
+
+    for (y = 0; y < rc->Height; y++)
+    {
+        UINT dst_y = rc->Y + y;
+
+        first = This->filter_y.start[dst_y];
+        for (row = first; row < first + taps; )
+        {
+            if (This->row_index[row % taps] == row)
+            {
+                row++;
+                continue;
+            }
+
+            count = min(first + taps - row, This->band_rows);
+            band_rect.X = 0;
+            band_rect.Y = row;
+            band_rect.Width = This->src_width;
+            band_rect.Height = count;
+            hr = IWICBitmapSource_CopyPixels(This->source, &band_rect, src_stride,
+                src_stride * count, This->band);
+            if (FAILED(hr))
+            {
+                for (k = 0; k < taps; k++) This->row_index[k] = -1;
+                return hr;
+            }
+
+            for (k = 0; k < count; k++, row++)
+            {
+                This->fn_scale_row_h(This->rows + (row % taps) * row_size,
+                    This->band + k * src_stride, This->filter_x.start,
+                    This->filter_x.coeffs, This->filter_x.taps, This->width);
+                This->row_index[row % taps] = row;
+            }
+        }
+
+        for (k = 0; k < taps; k++)
+            This->row_ptrs[k] = This->rows + ((first + k) % taps) * row_size + rc->X * 4;
+
+        This->fn_scale_row_v(buffer + stride * y, This->row_ptrs,
+            This->filter_y.coeffs + dst_y * taps, taps, rc->Width, This->premultiplied);
+    }
+
+    return S_OK;
+}
+
 static HRESULT WINAPI BitmapScaler_QueryInterface(IWICBitmapScaler *iface, REFIID iid,
     void **ppv)
 {
@@ -108,6 +457,7 @@ static ULONG WINAPI BitmapScaler_Release(IWICBitmapScaler *iface)
         This->lock.DebugInfo->Spare[0] = 0;
         DeleteCriticalSection(&This->lock);
         if (This->source) IWICBitmapSource_Release(This->source);
+        free_filter_state(This);
         HeapFree(GetProcessHeap(), 0, This);
     }
 
@@ -259,6 +609,12 @@ static HRESULT WINAPI BitmapScaler_CopyPixels(IWICBitmapScaler *iface,
         goto end;
     }
 
+    if (This->filter_y.taps)
+    {
+        hr = filter_copy_pixels(This, &dest_rect, cbStride, pbBuffer);
+        goto end;
+    }
+
     /* MSDN recommends calling CopyPixels once for each scanline from top to
      * bottom, and claims codecs optimize for this. Ideally, when called in this
      * way, we should avoid requesting a scanline from the source more than
@@ -353,6 +709,33 @@ static HRESULT WINAPI BitmapScaler_Initialize(IWICBitmapScaler *iface,
     {
         switch (mode)
         {
+        case WICBitmapInterpolationModeLinear:
+        case WICBitmapInterpolationModeCubic:
+        case WICBitmapInterpolationModeFant:
+        case WICBitmapInterpolationModeHighQualityCubic:
+            if (IsEqualGUID(&src_pixelformat, &GUID_WICPixelFormat32bppBGRA) ||
+                IsEqualGUID(&src_pixelformat, &GUID_WICPixelFormat32bppBGR) ||
+                IsEqualGUID(&src_pixelformat, &GUID_WICPixelFormat32bppPBGRA))
+            {
+                IWICBitmapSource_AddRef(pISource);
+                This->source = pISource;
+            }
+            else
+            {
+                hr = WICConvertBitmapSource(&GUID_WICPixelFormat32bppBGRA,
+                    pISource, &This->source);
+                This->bpp = 32;
+            }
+            This->premultiplied = IsEqualGUID(&src_pixelformat, &GUID_WICPixelFormat32bppPBGRA);
+            if (SUCCEEDED(hr))
+                hr = init_filter_state(This);
+            if (FAILED(hr))
+            {
+                free_filter_state(This);
+                if (This->source) IWICBitmapSource_Release(This->source);
+                This->source = NULL;
+            }
+            break;
         default:
             FIXME("unsupported mode %i\n", mode);
             /* fall-through */
@@ -529,6 +912,14 @@ HRESULT BitmapScaler_Create(IWICBitmapScaler **scaler)
     This->src_height = 0;
     This->mode = 0;
     This->bpp = 0;
+    memset(&This->filter_x, 0, sizeof(This->filter_x));
+    memset(&This->filter_y, 0, sizeof(This->filter_y));
+    This->premultiplied = FALSE;
+    This->rows = NULL;
+    This->row_index = NULL;
+    This->row_ptrs = NULL;
+    This->band = NULL;
+    This->band_rows = 0;
     InitializeCriticalSection(&This->lock);
     This->lock.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": BitmapScaler.lock");
 
@@ -751,7 +751,7 @@
 @ stdcall TreeSetNamedSecurityInfoW(wstr long long ptr ptr ptr ptr long)
 
 #Win7+
-@ stdcall EnableTraceEx2(int64 ptr long long int64 int64 long ptr)
+@ stdcall EnableTraceEx2(int64 ptr long long int64 int64 long ptr) ntext.EtwEnableTraceEx2
 @ stdcall EventSetInformation(ptr long ptr long) ntext.EtwEventSetInformation
 @ stdcall LsaLookupSids2(ptr long long ptr ptr ptr)
 
@@ -61,7 +61,7 @@ EventWriteStartScenario(
 	return ERROR_SUCCESS;
 }
 
-/* unimplemented*/
+/* Filter and Flags are not supported, the event goes to every session */
 ULONG 
 WINAPI 
 EventWriteEx(
@@ -75,7 +75,7 @@ EventWriteEx(
   _In_opt_  PEVENT_DATA_DESCRIPTOR UserData
 )
 {
-	return ERROR_SUCCESS;
+	return EtwEventWriteTransfer(RegHandle, EventDescriptor, ActivityId, RelatedActivityId, UserDataCount, UserData);
 }
 
 ULONG 
@@ -92,7 +92,24 @@ EnableTraceEx(
   _In_opt_  PEVENT_FILTER_DESCRIPTOR EnableFilterDesc
 )
 {
-	return ERROR_SUCCESS;	
+	ENABLE_TRACE_PARAMETERS Parameters;
+
+	RtlZeroMemory(&Parameters, sizeof(Parameters));
+	Parameters.Version = 1;
+	Parameters.EnableProperty = EnableProperty;
+	if (SourceId)
+		Parameters.SourceId = *SourceId;
+	Parameters.EnableFilterDesc = EnableFilterDesc;
+
+	/* IsEnabled doubles as the control code: 0 disables, 1 enables */
+	return EtwEnableTraceEx2(TraceHandle,
+	                         ProviderId,
+	                         IsEnabled,
+	                         Level,
+	                         MatchAnyKeyword,
+	                         MatchAllKeyword,
+	                         0,
+	                         &Parameters);
 }
 
 /* unimplemented*/
@@ -109,22 +126,6 @@ EventAccessControl(
 	return ERROR_SUCCESS;
 }
 
-ULONG 
-WINAPI
-EnableTraceEx2(
-  _In_     TRACEHANDLE              TraceHandle,
-  _In_     LPCGUID                  ProviderId,
-  _In_     ULONG                    ControlCode,
-  _In_     UCHAR                    Level,
-  _In_     ULONGLONG                MatchAnyKeyword,
-  _In_     ULONGLONG                MatchAllKeyword,
-  _In_     ULONG                    Timeout,
-  _In_opt_ PENABLE_TRACE_PARAMETERS EnableParameters
-)
-{
-	return ERROR_SUCCESS;
-}
-
 /*
  * @implemented
  */
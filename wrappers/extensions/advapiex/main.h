@@ -76,6 +76,28 @@ typedef struct _ENABLE_TRACE_PARAMETERS
     ULONG                            FilterDescCount;
 } ENABLE_TRACE_PARAMETERS, *PENABLE_TRACE_PARAMETERS;
 
+ULONG
+WINAPI
+EtwEnableTraceEx2(
+    TRACEHANDLE TraceHandle,
+    LPCGUID ProviderId,
+    ULONG ControlCode,
+    UCHAR Level,
+    ULONGLONG MatchAnyKeyword,
+    ULONGLONG MatchAllKeyword,
+    ULONG Timeout,
+    PENABLE_TRACE_PARAMETERS EnableParameters);
+
+ULONG
+NTAPI
+EtwEventWriteTransfer(
+    REGHANDLE RegHandle,
+    PCEVENT_DESCRIPTOR EventDescriptor,
+    LPCGUID ActivityId,
+    LPCGUID RelatedActivityId,
+    ULONG UserDataCount,
+    PEVENT_DATA_DESCRIPTOR UserData);
+
 typedef struct _RPC_UNICODE_STRING
 {
     USHORT Length;
@@ -597,7 +597,6 @@ void ConvertOverlappedToEntry(ULONG_PTR lpCompletionKey, LPOVERLAPPED src, LPOVE
     dst->Internal = 0; // we can use the 'Internal' for OCA purposes, but right now we don't do anything.
 }
 
-//Generated by ChatGPT. Thank you AI
 BOOL WINAPI GetQueuedCompletionStatusEx(
     HANDLE hCompletionPort,
     LPOVERLAPPED_ENTRY lpCompletionPortEntries,
@@ -606,179 +605,38 @@ BOOL WINAPI GetQueuedCompletionStatusEx(
     DWORD dwMilliseconds,
     BOOL bAlertable
 ) {
-    DWORD dwBytesTransferred;
-    ULONG_PTR lpCompletionKey;
-    LPOVERLAPPED lpOverlapped;
-	ULONG i;
-	BOOL _bRet;
-	DWORD _uStartTick;
-	DWORD _uResult;
-	DWORD _uTickSpan;
-	//OVERLAPPED_ENTRY _Entry;
-	DWORD kMaxSleepTime;
-	
+	LARGE_INTEGER Time;
+	NTSTATUS Status;
+
     if (!lpCompletionPortEntries || ulCount == 0 || !ulNumEntriesRemoved) {
         SetLastError(ERROR_INVALID_PARAMETER);
         return FALSE;
     }
 
-    *ulNumEntriesRemoved = 0;
-	
-	//_Entry = lpCompletionPortEntries[0];
-	
-        if (bAlertable)
-        {
-            kMaxSleepTime = 10;
-            // 使用 SleepEx 进行等待触发 APC
-            if (dwMilliseconds == INFINITE)
-            {
-                for (;;)
-                {
-					_bRet = GetQueuedCompletionStatus(
-							hCompletionPort,
-							&dwBytesTransferred,
-							&lpCompletionKey,
-							&lpOverlapped,
-							0);
-							
-                    if (_bRet)
-                    {
-						lpCompletionPortEntries[*ulNumEntriesRemoved].lpCompletionKey = lpCompletionKey;
-						lpCompletionPortEntries[*ulNumEntriesRemoved].lpOverlapped = lpOverlapped;
-						lpCompletionPortEntries[*ulNumEntriesRemoved].dwNumberOfBytesTransferred = dwBytesTransferred;
-						(*ulNumEntriesRemoved)++;						
-                        break;
-                    }
-
-                    if (GetLastError() != WAIT_TIMEOUT)
-                    {
-                        return FALSE;
-                    }
-
-                    if (SleepEx(kMaxSleepTime, TRUE) == WAIT_IO_COMPLETION)
-                    {
-                        SetLastError(WAIT_IO_COMPLETION);
-                        return FALSE;
-                    }
-                }
-            }
-			else
-			{				
-				// 使用 WaitForSingleObjectEx 进行等待触发 APC
-				_uStartTick = GetTickCount();
-				for (;;)
-				{
-					_uResult = WaitForSingleObjectEx(hCompletionPort, dwMilliseconds, TRUE);
-					if (_uResult == WAIT_OBJECT_0)
-					{
-						_bRet = GetQueuedCompletionStatus(
-							hCompletionPort,
-							&dwBytesTransferred,
-							&lpCompletionKey,
-							&lpOverlapped,
-							dwMilliseconds
-						);					
-						// 完成端口有数据了
-						// _bRet = GetQueuedCompletionStatus(CompletionPort, &_Entry.dwNumberOfBytesTransferred, &_Entry.lpCompletionKey, &_Entry.lpOverlapped, 0);
-						// if (_bRet)
-						// {
-							// *ulNumEntriesRemoved = 1;
-							// break;
-						// }
-						if (_bRet || lpOverlapped) {
-							lpCompletionPortEntries[*ulNumEntriesRemoved].lpCompletionKey = lpCompletionKey;
-							lpCompletionPortEntries[*ulNumEntriesRemoved].lpOverlapped = lpOverlapped;
-							lpCompletionPortEntries[*ulNumEntriesRemoved].dwNumberOfBytesTransferred = dwBytesTransferred;
-							(*ulNumEntriesRemoved)++;
-
-							// Continue collecting if we haven't hit the desired count yet
-							if (*ulNumEntriesRemoved < ulCount) {
-								dwMilliseconds = 0; // Set timeout to zero after the first iteration
-								continue;
-							}
-						}					
-
-						if (GetLastError() != WAIT_TIMEOUT)
-						{
-							return FALSE;
-						}
-
-						// 无限等待时无脑继续等即可。
-						if (dwMilliseconds == INFINITE)
-						{
-							continue;
-						}
-
-						// 计算剩余等待时间，如果剩余等待时间归零则返回
-						_uTickSpan = GetTickCount() - _uStartTick;
-						if (_uTickSpan >= dwMilliseconds)
-						{
-							SetLastError(WAIT_TIMEOUT);
-							return FALSE;
-						}
-						dwMilliseconds -= _uTickSpan;
-						_uStartTick += _uTickSpan;
-						continue;
-					}
-					else if (_uResult == WAIT_IO_COMPLETION || _uResult == WAIT_TIMEOUT)
-					{
-						// 很奇怪，微软原版遇到 APC唤醒直接会设置 LastError WAIT_IO_COMPLETION
-						// 遇到超时，LastError WAIT_TIMEOUT（注意不是预期的 ERROR_TIMEOUT）不知道是故意还是有意。
-						SetLastError(_uResult);
-						return FALSE;
-					}
-					else if (_uResult == WAIT_ABANDONED)
-					{
-						SetLastError(ERROR_ABANDONED_WAIT_0);
-						return FALSE;
-					}
-					else if (_uResult == WAIT_FAILED)
-					{
-						// LastError
-						return FALSE;
-					}
-					else
-					{
-						// LastError ???
-						return FALSE;
-					}
-				}
-			}
+	/* OVERLAPPED_ENTRY has the layout of FILE_IO_COMPLETION_INFORMATION, so the
+	   packets are dequeued straight into the caller's array in one call */
+	C_ASSERT(sizeof(OVERLAPPED_ENTRY) == sizeof(FILE_IO_COMPLETION_INFORMATION));
 
-            return TRUE;
-        }else{
-			for (i = 0; i < ulCount; i++) {
-				_bRet = GetQueuedCompletionStatus(
-					hCompletionPort,
-					&dwBytesTransferred,
-					&lpCompletionKey,
-					&lpOverlapped,
-					dwMilliseconds
-				);
-
-				if (_bRet || lpOverlapped) {
-					lpCompletionPortEntries[*ulNumEntriesRemoved].lpCompletionKey = lpCompletionKey;
-					lpCompletionPortEntries[*ulNumEntriesRemoved].lpOverlapped = lpOverlapped;
-					lpCompletionPortEntries[*ulNumEntriesRemoved].dwNumberOfBytesTransferred = dwBytesTransferred;
-					(*ulNumEntriesRemoved)++;
-
-					// Continue collecting if we haven't hit the desired count yet
-					if (*ulNumEntriesRemoved < ulCount) {
-						dwMilliseconds = 0; // Set timeout to zero after the first iteration
-						continue;
-					}
-					return TRUE; // All requested entries were retrieved
-				} else {
-					// Error occurred or timeout
-					if (*ulNumEntriesRemoved > 0) {
-						return TRUE; // Partial success
-					}
-					return FALSE; // Complete failure
-				}
-			}			
-		}
+	Status = NtRemoveIoCompletionEx(hCompletionPort,
+	                                (PFILE_IO_COMPLETION_INFORMATION)lpCompletionPortEntries,
+	                                ulCount,
+	                                ulNumEntriesRemoved,
+	                                BaseFormatTimeOut(&Time, dwMilliseconds),
+	                                (BOOLEAN)bAlertable);
+
+	if (Status == STATUS_SUCCESS)
+		return TRUE;
 
-    return TRUE;
+	*ulNumEntriesRemoved = 0;
+
+	if (Status == STATUS_TIMEOUT)
+		SetLastError(WAIT_TIMEOUT);
+	else if (Status == STATUS_USER_APC || Status == STATUS_ALERTED)
+		SetLastError(WAIT_IO_COMPLETION);
+	else
+		BaseSetLastNTError(Status);
+
+	return FALSE;
 }
 
 /******************************************************************************
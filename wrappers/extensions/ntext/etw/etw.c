@@ -95,62 +95,6 @@ WinSqmEventWrite(
   ;
 }
 
-ULONG 
-NTAPI
-EtwEventUnregister(
-  _In_  REGHANDLE RegHandle
-)
-{
-	return ERROR_SUCCESS;
-}
-
-ULONG
-NTAPI
-EtwEventRegister(
-  IN LPCGUID ProviderId,
-  IN PENABLECALLBACK EnableCallback OPTIONAL,
-  IN PVOID CallbackContext OPTIONAL,
-  OUT PREGHANDLE RegHandle)
-{
-	*RegHandle = 0xdeadbeef;
-	return ERROR_SUCCESS;
-}
-
-BOOLEAN 
-NTAPI
-EtwEventEnabled(
-  _In_  REGHANDLE RegHandle,
-  _In_  PCEVENT_DESCRIPTOR EventDescriptor
-)
-{
-	return TRUE;
-}
-
-ULONG
-NTAPI
-EtwEventWrite(
-  IN REGHANDLE RegHandle,
-  IN PCEVENT_DESCRIPTOR EventDescriptor,
-  IN ULONG UserDataCount,
-  IN PEVENT_DATA_DESCRIPTOR UserData)
-{
-	return ERROR_SUCCESS;
-}
-
-ULONG
-NTAPI
-EtwEventWriteFull(
-    REGHANDLE RegHandle,
-    PCEVENT_DESCRIPTOR EventDescriptor,
-    USHORT EventProperty,
-    LPCGUID ActivityId,
-    LPCGUID RelatedActivityId,
-    ULONG UserDataCount,
-    PEVENT_DATA_DESCRIPTOR UserData)
-{
-	return ERROR_SUCCESS;
-}
-
 ULONG
 NTAPI
 EtwWriteUMSecurityEvent (
@@ -459,53 +403,6 @@ EtwTraceMessageVa(
 {
     return ERROR_SUCCESS;
 }
-//Add daqui pra lá
-ULONG
-NTAPI
-EtwpAddLogHeaderToLogFile(
-    IN OUT PWMI_LOGGER_INFORMATION LoggerInfo,
-    IN PVOID              RefClock,
-    IN     ULONG                   Update
-)
-{
-    return ERROR_SUCCESS;
-}
-
-ULONG
-NTAPI
-EtwpFinalizeLogFileHeader(
-    IN PWMI_LOGGER_INFORMATION LoggerInfo
-)
-{
-    return ERROR_SUCCESS;
-}
-
-ULONG 
-NTAPI
-EtwpFlushUmLogger(
-    IN ULONG WnodeSize,
-    IN OUT ULONG *SizeUsed,
-    OUT ULONG *SizeNeeded,
-    IN OUT PWMI_LOGGER_INFORMATION LoggerInfo
-)
-{
-	*SizeNeeded = 10000;
-    return ERROR_SUCCESS;
-}
-
-ULONG
-NTAPI
-EtwpQueryUmLogger(
-    IN ULONG WnodeSize,
-    IN OUT ULONG *SizeUsed,
-    OUT ULONG *SizeNeeded,
-    IN OUT PWMI_LOGGER_INFORMATION LoggerInfo
-)
-{
-	*SizeNeeded = 10000;
-    return ERROR_SUCCESS;
-}
-
 ULONG 
 NTAPI
 EtwpSendWmiKMRequest(
@@ -522,45 +419,6 @@ EtwpSendWmiKMRequest(
 	return ERROR_SUCCESS;
 }
 
-ULONG
-NTAPI
-EtwpStartUmLogger(
-    IN ULONG WnodeSize,
-    IN OUT ULONG *SizeUsed,
-    OUT ULONG *SizeNeeded,
-    IN OUT PWMI_LOGGER_INFORMATION LoggerInfo
-)
-{
-	*SizeNeeded = 10000;
-	return ERROR_SUCCESS;
-}
-
-ULONG
-NTAPI
-EtwpStopUmLogger(
-        IN ULONG WnodeSize,
-        IN OUT ULONG *SizeUsed,
-        OUT ULONG *SizeNeeded,
-        IN OUT PWMI_LOGGER_INFORMATION LoggerInfo
-)
-{
-	*SizeNeeded = 10000;
-	return ERROR_SUCCESS;
-}
-
-ULONG
-NTAPI
-EtwpUpdateUmLogger(
-    IN ULONG WnodeSize,
-    IN OUT ULONG *SizeUsed,
-    OUT ULONG *SizeNeeded,
-    IN OUT PWMI_LOGGER_INFORMATION LoggerInfo
-)
-{
-	*SizeNeeded = 10000;
-	return ERROR_SUCCESS;
-}
-
 BOOLEAN 
 NTAPI
 EtwpIsProcessExiting()
@@ -580,15 +438,6 @@ ULONG NTAPI EtwEventActivityIdControl(ULONG code, GUID *guid)
 }
 
 
-/******************************************************************************
- *                  EtwEventProviderEnabled (NTDLL.@)
- */
-BOOLEAN NTAPI EtwEventProviderEnabled( REGHANDLE handle, UCHAR level, ULONGLONG keyword )
-{
-    DbgPrint("%s, %u, %s: stub\n", handle, level, keyword);
-    return TRUE;
-}
-
 /*********************************************************************
  *                  EtwEventSetInformation   (NTDLL.@)
  */
@@ -599,37 +448,7 @@ ULONG NTAPI EtwEventSetInformation( REGHANDLE handle, EVENT_INFO_CLASS class, vo
     return ERROR_SUCCESS;
 }
 
-/******************************************************************************
- *                  EtwEventWriteString   (NTDLL.@)
- */
-ULONG NTAPI EtwEventWriteString( REGHANDLE handle, UCHAR level, ULONGLONG keyword, PCWSTR string )
-{
-    DbgPrint("%s, %u, %s, %s: stub\n", handle, level,
-          keyword, string);
-    return ERROR_SUCCESS;
-}
-
-/******************************************************************************
- *                  EtwEventWriteTransfer   (NTDLL.@)
- */
-ULONG NTAPI EtwEventWriteTransfer( REGHANDLE handle, PCEVENT_DESCRIPTOR descriptor, LPCGUID activity,
-                                    LPCGUID related, ULONG count, PEVENT_DATA_DESCRIPTOR data )
-{
-    DbgPrint("%s, %p, %s, %s, %u, %p: stub\n", handle, descriptor,
-          activity, related, count, data);
-    return ERROR_SUCCESS;
-}
-
 ULONG NTAPI EtwTraceUserEvent(int a1, int a2, __int64 a3, __int64 *a4, __int64 *a5, int a6, char a7)
 {
 	return 0;
 }
-
-ULONG NTAPI EtwEventWriteNoRegistration (
-    GUID const *ProviderId,
-    EVENT_DESCRIPTOR const *EventDescriptor,
-    ULONG UserDataCount,
-    EVENT_DATA_DESCRIPTOR *UserData) 
-{
-    return 0;
-}
\ No newline at end of file
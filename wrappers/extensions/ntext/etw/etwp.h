@@ -0,0 +1,249 @@
+/*++
+
+Copyright (c) 2026 Shorthorn Project
+
+Module Name:
+
+    etwp.h
+
+Abstract:
+
+    Private definitions of the user-mode event tracing providers and loggers.
+
+Revision History:
+
+--*/
+
+#pragma once
+
+#include <main.h>
+#include <evntcons.h>
+#include <etwlog.h>
+
+#define ETWP_MAX_SESSIONS           8
+#define ETWP_MAX_SESSION_PROVIDERS  32
+#define ETWP_MAX_RINGS              64
+#define ETWP_MAX_RING_BUFFERS       16
+#define ETWP_MIN_RING_BUFFERS       2
+#define ETWP_MIN_BUFFER_SIZE        4       /* KB */
+#define ETWP_DEFAULT_BUFFER_SIZE    64      /* KB */
+#define ETWP_MAX_BUFFER_SIZE        1024    /* KB */
+#define ETWP_MAX_EVENT_SIZE         0xFFF8
+#define ETWP_FLUSH_SPIN_COUNT       1000
+#define ETWP_RETIRE_GRACE_PERIOD    (10 * 10000000LL)   /* 100ns units */
+
+/* EVENT_TRACE_PROPERTIES.Wnode.ClientContext */
+#define ETWP_CLOCK_PERFCOUNTER      1
+#define ETWP_CLOCK_SYSTEMTIME       2
+#define ETWP_CLOCK_CPUCYCLE         3
+
+/* Session handles carry the logger id and a generation count, so that a
+ * stale handle never reaches a session started later in the same slot */
+#define ETWP_SESSION_HANDLE(Session)    (((TRACEHANDLE)(Session)->Generation << 16) | (Session)->LoggerId)
+#define ETWP_HANDLE_SLOT(Handle)        ((ULONG)((Handle) & 0xFFFF) - 1)
+#define ETWP_HANDLE_GENERATION(Handle)  ((ULONG)((Handle) >> 16))
+
+typedef struct _ETWP_ENABLE_INFO
+{
+    UCHAR Level;
+    ULONG EnableProperty;
+    ULONGLONG MatchAnyKeyword;
+    ULONGLONG MatchAllKeyword;
+} ETWP_ENABLE_INFO, *PETWP_ENABLE_INFO;
+
+typedef struct _ETWP_SESSION_PROVIDER
+{
+    GUID ProviderId;
+    ETWP_ENABLE_INFO EnableInfo;
+} ETWP_SESSION_PROVIDER, *PETWP_SESSION_PROVIDER;
+
+typedef struct _ETWP_PROVIDER
+{
+    /* Bit n is set while session slot n has the provider enabled. This is
+     * the only thing a write looks at when nobody listens */
+    volatile LONG EnableMask;
+    LIST_ENTRY ListEntry;
+    GUID ProviderId;
+    PENABLECALLBACK EnableCallback;
+    PVOID CallbackContext;
+    ETWP_ENABLE_INFO EnableInfo[ETWP_MAX_SESSIONS];
+} ETWP_PROVIDER, *PETWP_PROVIDER;
+
+/*
+ * Each ring is a small circle of buffers that writers fill without taking
+ * a lock: they reserve space by moving the CurrentOffset of the current
+ * buffer with an interlocked add, and hold a ReferenceCount on the buffer
+ * while copying. The writer that runs past the end closes the buffer and
+ * moves the ring on to the next free one; the flusher thread writes closed
+ * buffers out once their references are gone and hands them back.
+ */
+typedef struct _ETWP_RING
+{
+    volatile LONG Current;
+    ULONG BufferCount;
+    PWMI_BUFFER_HEADER Buffers[ETWP_MAX_RING_BUFFERS];
+} ETWP_RING, *PETWP_RING;
+
+typedef struct _ETWP_SESSION
+{
+    LIST_ENTRY RetiredEntry;
+    ULONG Slot;
+    USHORT LoggerId;
+    USHORT Generation;
+    volatile LONG Stopping;
+    volatile LONG FlushRequested;
+    volatile LONG EventsLost;
+    ULONG ClockType;
+    ULONG BufferSize;
+    ULONG MaximumEventSize;
+    ULONG RingMask;
+    ULONG BuffersPerRing;
+    HANDLE FlusherThread;
+    HANDLE FlushEvent;
+    HANDLE FlushDoneEvent;
+    LARGE_INTEGER FileOffset;
+    LARGE_INTEGER StopTime;
+    LONGLONG SequenceNumber;
+    ETW_REF_CLOCK RefClock;
+    PVOID BufferMemory;
+    SIZE_T BufferMemorySize;
+    PWMI_BUFFER_HEADER FlushBuffer;
+    WMI_LOGGER_INFORMATION LoggerInfo;
+    ULONG ProviderCount;
+    ETWP_SESSION_PROVIDER Providers[ETWP_MAX_SESSION_PROVIDERS];
+    ETWP_RING Rings[ANYSIZE_ARRAY];
+} ETWP_SESSION, *PETWP_SESSION;
+
+extern RTL_CRITICAL_SECTION EtwpLock;
+extern PETWP_SESSION EtwpSessions[ETWP_MAX_SESSIONS];
+extern LIST_ENTRY EtwpProviderList;
+
+FORCEINLINE
+LONGLONG
+EtwpQueryClock(
+    _In_ ULONG ClockType)
+{
+    LARGE_INTEGER Time;
+
+    if (ClockType == ETWP_CLOCK_PERFCOUNTER)
+    {
+        NtQueryPerformanceCounter(&Time, NULL);
+        return Time.QuadPart;
+    }
+
+    /* The system time is read from the shared user data, without a system call */
+    do
+    {
+        Time.HighPart = SharedUserData->SystemTime.High1Time;
+        Time.LowPart = SharedUserData->SystemTime.LowPart;
+    } while (Time.HighPart != SharedUserData->SystemTime.High2Time);
+
+    return Time.QuadPart;
+}
+
+FORCEINLINE
+BOOLEAN
+EtwpIsEventEnabled(
+    _In_ PETWP_ENABLE_INFO EnableInfo,
+    _In_ UCHAR Level,
+    _In_ ULONGLONG Keyword)
+{
+    if (Level != 0 && EnableInfo->Level != 0 && Level > EnableInfo->Level)
+        return FALSE;
+
+    if (Keyword == 0)
+        return TRUE;
+
+    if (EnableInfo->MatchAnyKeyword != 0 && !(Keyword & EnableInfo->MatchAnyKeyword))
+        return FALSE;
+
+    return (Keyword & EnableInfo->MatchAllKeyword) == EnableInfo->MatchAllKeyword;
+}
+
+/* logger.c */
+
+VOID
+NTAPI
+EtwpInitialize(VOID);
+
+VOID
+NTAPI
+EtwpShutdown(VOID);
+
+PETWP_SESSION
+NTAPI
+EtwpFindSession(
+    _In_ TRACEHANDLE SessionHandle,
+    _In_opt_ PCUNICODE_STRING LoggerName);
+
+ULONG
+NTAPI
+EtwpLogEvent(
+    _In_ PETWP_SESSION Session,
+    _In_ LPCGUID ProviderId,
+    _In_ PCEVENT_DESCRIPTOR EventDescriptor,
+    _In_ USHORT EventProperty,
+    _In_ USHORT Flags,
+    _In_opt_ LPCGUID ActivityId,
+    _In_opt_ LPCGUID RelatedActivityId,
+    _In_ ULONG UserDataCount,
+    _In_reads_opt_(UserDataCount) PEVENT_DATA_DESCRIPTOR UserData);
+
+ULONG
+NTAPI
+EtwpStartUmLogger(
+    IN ULONG WnodeSize,
+    IN OUT ULONG *SizeUsed,
+    OUT ULONG *SizeNeeded,
+    IN OUT PWMI_LOGGER_INFORMATION LoggerInfo);
+
+ULONG
+NTAPI
+EtwpStopUmLogger(
+    IN ULONG WnodeSize,
+    IN OUT ULONG *SizeUsed,
+    OUT ULONG *SizeNeeded,
+    IN OUT PWMI_LOGGER_INFORMATION LoggerInfo);
+
+ULONG
+NTAPI
+EtwpQueryUmLogger(
+    IN ULONG WnodeSize,
+    IN OUT ULONG *SizeUsed,
+    OUT ULONG *SizeNeeded,
+    IN OUT PWMI_LOGGER_INFORMATION LoggerInfo);
+
+ULONG
+NTAPI
+EtwpUpdateUmLogger(
+    IN ULONG WnodeSize,
+    IN OUT ULONG *SizeUsed,
+    OUT ULONG *SizeNeeded,
+    IN OUT PWMI_LOGGER_INFORMATION LoggerInfo);
+
+ULONG
+NTAPI
+EtwpFlushUmLogger(
+    IN ULONG WnodeSize,
+    IN OUT ULONG *SizeUsed,
+    OUT ULONG *SizeNeeded,
+    IN OUT PWMI_LOGGER_INFORMATION LoggerInfo);
+
+/* provider.c */
+
+ULONG
+NTAPI
+EtwpEnableProvider(
+    _In_ TRACEHANDLE SessionHandle,
+    _In_ LPCGUID ProviderId,
+    _In_ ULONG ControlCode,
+    _In_ UCHAR Level,
+    _In_ ULONGLONG MatchAnyKeyword,
+    _In_ ULONGLONG MatchAllKeyword,
+    _In_ ULONG EnableProperty,
+    _In_opt_ PEVENT_FILTER_DESCRIPTOR EnableFilterDesc);
+
+VOID
+NTAPI
+EtwpDisableSessionProviders(
+    _In_ PETWP_SESSION Session);
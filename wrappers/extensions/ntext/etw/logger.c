@@ -0,0 +1,1180 @@
+/*++
+
+Copyright (c) 2026 Shorthorn Project
+
+Module Name:
+
+    logger.c
+
+Abstract:
+
+    User-mode loggers. Events are written to per-processor buffer rings
+    without taking a lock or making a system call, and a flusher thread per
+    session writes the full buffers out to an .etl file.
+
+Revision History:
+
+--*/
+
+#include "etwp.h"
+
+#define NDEBUG
+#include <debug.h>
+
+RTL_CRITICAL_SECTION EtwpLock;
+PETWP_SESSION EtwpSessions[ETWP_MAX_SESSIONS];
+static LIST_ENTRY EtwpRetiredSessions;
+static USHORT EtwpSessionGeneration;
+
+VOID
+NTAPI
+EtwpInitialize(VOID)
+{
+    RtlInitializeCriticalSection(&EtwpLock);
+    InitializeListHead(&EtwpProviderList);
+    InitializeListHead(&EtwpRetiredSessions);
+}
+
+static
+FORCEINLINE
+PETWP_RING
+EtwpCurrentRing(
+    _In_ PETWP_SESSION Session)
+{
+    ULONG ThreadId = HandleToUlong(NtCurrentTeb()->ClientId.UniqueThread);
+
+    /* Asking for the current processor would cost a system call, so the
+     * threads are spread over the rings by id instead. There are at least
+     * as many rings as processors, which keeps them mostly uncontended */
+    return &Session->Rings[(ThreadId >> 2) & Session->RingMask];
+}
+
+static
+VOID
+EtwpCloseBuffer(
+    _In_ PETWP_RING Ring,
+    _In_ LONG Index,
+    _In_ LONG Offset)
+{
+    PWMI_BUFFER_HEADER Buffer = Ring->Buffers[Index];
+    LONG Next;
+
+    Buffer->Offset = Offset;
+    InterlockedExchange(&Buffer->State, ETW_BUFFER_STATE_CLOSED);
+
+    /* If the next buffer is still waiting for the flusher, the writers stay
+     * on the closed one and lose their events until it is handed back */
+    Next = (Index + 1) % Ring->BufferCount;
+    if (Ring->Buffers[Next]->State == ETW_BUFFER_STATE_FREE)
+        InterlockedCompareExchange(&Ring->Current, Next, Index);
+}
+
+static
+PVOID
+EtwpReserveRecord(
+    _In_ PETWP_SESSION Session,
+    _In_ ULONG Size,
+    _Out_ PWMI_BUFFER_HEADER *ReservedBuffer)
+{
+    PWMI_BUFFER_HEADER Buffer;
+    PETWP_RING Ring;
+    LONG Index, Offset;
+    ULONG Attempt;
+
+    Ring = EtwpCurrentRing(Session);
+
+    /* The writer that closes a buffer tries once more in the next one */
+    for (Attempt = 0; Attempt < 2; Attempt++)
+    {
+        Index = Ring->Current;
+        Buffer = Ring->Buffers[Index];
+
+        InterlockedIncrement(&Buffer->ReferenceCount);
+
+        if ((ULONG)Buffer->CurrentOffset < Session->BufferSize)
+        {
+            Offset = InterlockedExchangeAdd(&Buffer->CurrentOffset, Size);
+            if ((ULONG)Offset + Size <= Session->BufferSize)
+            {
+                /* A record that fills the buffer exactly leaves nothing for
+                 * the next writer to run past, so it closes the buffer. Our
+                 * reference keeps the flusher away until it is written */
+                if ((ULONG)Offset + Size == Session->BufferSize)
+                {
+                    EtwpCloseBuffer(Ring, Index, Session->BufferSize);
+                    NtSetEvent(Session->FlushEvent, NULL);
+                }
+
+                *ReservedBuffer = Buffer;
+                return (PUCHAR)Buffer + Offset;
+            }
+
+            /* Exactly one writer runs past the end, it closes the buffer */
+            if ((ULONG)Offset < Session->BufferSize)
+            {
+                EtwpCloseBuffer(Ring, Index, Offset);
+                NtSetEvent(Session->FlushEvent, NULL);
+            }
+        }
+
+        InterlockedDecrement(&Buffer->ReferenceCount);
+
+        if (Ring->Current == Index)
+            break;
+    }
+
+    return NULL;
+}
+
+ULONG
+NTAPI
+EtwpLogEvent(
+    _In_ PETWP_SESSION Session,
+    _In_ LPCGUID ProviderId,
+    _In_ PCEVENT_DESCRIPTOR EventDescriptor,
+    _In_ USHORT EventProperty,
+    _In_ USHORT Flags,
+    _In_opt_ LPCGUID ActivityId,
+    _In_opt_ LPCGUID RelatedActivityId,
+    _In_ ULONG UserDataCount,
+    _In_reads_opt_(UserDataCount) PEVENT_DATA_DESCRIPTOR UserData)
+{
+    PETW_EXTENDED_ITEM_HEADER Item;
+    PWMI_BUFFER_HEADER Buffer;
+    PEVENT_HEADER Header;
+    PUCHAR Data;
+    ULONG Size, i;
+
+    Size = sizeof(EVENT_HEADER);
+    if (RelatedActivityId)
+        Size += sizeof(ETW_EXTENDED_ITEM_HEADER) + sizeof(GUID);
+
+    for (i = 0; i < UserDataCount; i++)
+    {
+        if (UserData[i].Size > Session->MaximumEventSize)
+            return ERROR_ARITHMETIC_OVERFLOW;
+        Size += UserData[i].Size;
+        if (Size > Session->MaximumEventSize)
+            return ERROR_ARITHMETIC_OVERFLOW;
+    }
+
+    Header = EtwpReserveRecord(Session, ETW_ALIGN_RECORD(Size), &Buffer);
+    if (!Header)
+    {
+        InterlockedIncrement(&Session->EventsLost);
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    Header->Size = (USHORT)Size;
+    Header->HeaderType = ETW_EVENT_HEADER_MARKER(TRACE_HEADER_TYPE_EVENT_HEADER);
+    Header->Flags = Flags | EVENT_HEADER_FLAG_PRIVATE_SESSION | EVENT_HEADER_FLAG_NO_CPUTIME |
+                    (sizeof(PVOID) == 8 ? EVENT_HEADER_FLAG_64_BIT_HEADER : EVENT_HEADER_FLAG_32_BIT_HEADER);
+    Header->EventProperty = EventProperty;
+    Header->ThreadId = HandleToUlong(NtCurrentTeb()->ClientId.UniqueThread);
+    Header->ProcessId = HandleToUlong(NtCurrentTeb()->ClientId.UniqueProcess);
+    Header->TimeStamp.QuadPart = EtwpQueryClock(Session->ClockType);
+    Header->ProviderId = *ProviderId;
+    Header->EventDescriptor = *EventDescriptor;
+    Header->ProcessorTime = 0;
+    if (ActivityId)
+        Header->ActivityId = *ActivityId;
+    else
+        RtlZeroMemory(&Header->ActivityId, sizeof(GUID));
+
+    Data = (PUCHAR)(Header + 1);
+
+    if (RelatedActivityId)
+    {
+        Header->Flags |= EVENT_HEADER_FLAG_EXTENDED_INFO;
+
+        Item = (PETW_EXTENDED_ITEM_HEADER)Data;
+        Item->Reserved1 = 0;
+        Item->ExtType = EVENT_HEADER_EXT_TYPE_RELATED_ACTIVITYID;
+        Item->Linkage = 0;
+        Item->DataSize = sizeof(GUID);
+        RtlCopyMemory(Item + 1, RelatedActivityId, sizeof(GUID));
+        Data += sizeof(*Item) + sizeof(GUID);
+    }
+
+    for (i = 0; i < UserDataCount; i++)
+    {
+        RtlCopyMemory(Data, (PVOID)(ULONG_PTR)UserData[i].Ptr, UserData[i].Size);
+        Data += UserData[i].Size;
+    }
+
+    InterlockedDecrement(&Buffer->ReferenceCount);
+    return ERROR_SUCCESS;
+}
+
+static
+VOID
+EtwpWriteLogFile(
+    _In_ PETWP_SESSION Session,
+    _In_ PVOID Data)
+{
+    PWMI_LOGGER_INFORMATION LoggerInfo = &Session->LoggerInfo;
+    IO_STATUS_BLOCK IoStatusBlock;
+    ULONGLONG MaximumFileSize;
+    NTSTATUS Status;
+
+    /* Buffering mode sessions have no file, their buffers are recycled */
+    if (!LoggerInfo->LogFileHandle)
+        return;
+
+    MaximumFileSize = (ULONGLONG)LoggerInfo->MaximumFileSize * 1024 * 1024;
+    if (MaximumFileSize != 0 &&
+        (ULONGLONG)Session->FileOffset.QuadPart + Session->BufferSize > MaximumFileSize)
+    {
+        if (!(LoggerInfo->LogFileMode & EVENT_TRACE_FILE_MODE_CIRCULAR))
+        {
+            LoggerInfo->LogBuffersLost++;
+            return;
+        }
+
+        /* Wrap around behind the header buffer */
+        Session->FileOffset.QuadPart = Session->BufferSize;
+    }
+
+    Status = NtWriteFile(LoggerInfo->LogFileHandle,
+                         NULL,
+                         NULL,
+                         NULL,
+                         &IoStatusBlock,
+                         Data,
+                         Session->BufferSize,
+                         &Session->FileOffset,
+                         NULL);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Writing trace buffer failed: 0x%lx\n", Status);
+        LoggerInfo->LogBuffersLost++;
+        return;
+    }
+
+    Session->FileOffset.QuadPart += Session->BufferSize;
+    LoggerInfo->BuffersWritten++;
+}
+
+static
+VOID
+EtwpWriteBuffer(
+    _In_ PETWP_SESSION Session,
+    _In_ PWMI_BUFFER_HEADER Buffer,
+    _In_ ULONG RingIndex)
+{
+    PWMI_BUFFER_HEADER Flush = Session->FlushBuffer;
+    ULONG Size = Buffer->Offset;
+
+    /* The ring buffer is handed back right away, the staging copy is
+     * turned into the on-disk image */
+    RtlCopyMemory(Flush, Buffer, Size);
+    RtlFillMemory((PUCHAR)Flush + Size, Session->BufferSize - Size, 0xFF);
+
+    Flush->BufferSize = Session->BufferSize;
+    Flush->SavedOffset = Size;
+    Flush->CurrentOffset = Size;
+    Flush->ReferenceCount = 0;
+    Flush->TimeStamp.QuadPart = EtwpQueryClock(Session->ClockType);
+    Flush->SequenceNumber = Session->SequenceNumber++;
+    Flush->ClockType = Session->ClockType;
+    Flush->ClientContext.ProcessorNumber = (UCHAR)RingIndex;
+    Flush->ClientContext.Alignment = ETW_RECORD_ALIGNMENT;
+    Flush->ClientContext.LoggerId = Session->LoggerId;
+    Flush->State = 0;
+    Flush->Offset = Size;
+    Flush->BufferFlag = ETW_BUFFER_FLAG_NORMAL;
+    Flush->BufferType = ETW_BUFFER_TYPE_GENERIC;
+    Flush->Padding1[0] = 0;
+    Flush->Padding1[1] = 0;
+
+    EtwpWriteLogFile(Session, Flush);
+}
+
+static
+VOID
+EtwpResetBuffer(
+    _In_ PWMI_BUFFER_HEADER Buffer)
+{
+    Buffer->Offset = 0;
+    InterlockedExchange(&Buffer->State, ETW_BUFFER_STATE_FREE);
+
+    /* Writers racing with the reset either see the old offset past the end
+     * and give up, or reserve their space in the fresh buffer */
+    InterlockedExchange(&Buffer->CurrentOffset, sizeof(WMI_BUFFER_HEADER));
+}
+
+static
+VOID
+EtwpFlushRing(
+    _In_ PETWP_SESSION Session,
+    _In_ ULONG RingIndex,
+    _In_ BOOLEAN Force)
+{
+    PETWP_RING Ring = &Session->Rings[RingIndex];
+    PWMI_BUFFER_HEADER Buffer;
+    LONG Current, Offset;
+    ULONG i, Spin;
+
+    Current = Ring->Current;
+
+    /* Close a partially filled current buffer the same way a writer does,
+     * by reserving whatever is left in it */
+    if (Force)
+    {
+        Buffer = Ring->Buffers[Current];
+        if (Buffer->CurrentOffset != sizeof(WMI_BUFFER_HEADER))
+        {
+            Offset = InterlockedExchangeAdd(&Buffer->CurrentOffset, Session->BufferSize + 1);
+            if ((ULONG)Offset < Session->BufferSize)
+                EtwpCloseBuffer(Ring, Current, Offset);
+        }
+    }
+
+    /* Oldest first: the buffers following the current one were closed
+     * before it, and the current one is the newest when the ring is full */
+    for (i = 1; i <= Ring->BufferCount; i++)
+    {
+        Buffer = Ring->Buffers[(Current + i) % Ring->BufferCount];
+        if (Buffer->State != ETW_BUFFER_STATE_CLOSED)
+            continue;
+
+        if (Buffer->ReferenceCount != 0)
+        {
+            if (!Force)
+                break;
+
+            for (Spin = 0; Buffer->ReferenceCount != 0 && Spin < ETWP_FLUSH_SPIN_COUNT; Spin++)
+                NtYieldExecution();
+
+            /* A writer died in the middle of its copy */
+            if (Buffer->ReferenceCount != 0)
+            {
+                Session->LoggerInfo.LogBuffersLost++;
+                EtwpResetBuffer(Buffer);
+                continue;
+            }
+        }
+
+        EtwpWriteBuffer(Session, Buffer, RingIndex);
+        EtwpResetBuffer(Buffer);
+    }
+}
+
+static
+VOID
+EtwpFlushSession(
+    _In_ PETWP_SESSION Session,
+    _In_ BOOLEAN Force)
+{
+    ULONG Ring;
+
+    for (Ring = 0; Ring <= Session->RingMask; Ring++)
+        EtwpFlushRing(Session, Ring, Force);
+}
+
+static
+NTSTATUS
+NTAPI
+EtwpFlusherThread(
+    _In_ PVOID Parameter)
+{
+    PETWP_SESSION Session = Parameter;
+    LARGE_INTEGER Timeout;
+    NTSTATUS Status;
+
+    while (!Session->Stopping)
+    {
+        /* Without a flush timer, buffers are written when they are full */
+        Timeout.QuadPart = -10000000LL * Session->LoggerInfo.FlushTimer;
+        Status = NtWaitForSingleObject(Session->FlushEvent,
+                                       FALSE,
+                                       Session->LoggerInfo.FlushTimer ? &Timeout : NULL);
+        if (Session->Stopping)
+            break;
+
+        if (InterlockedExchange(&Session->FlushRequested, FALSE))
+        {
+            EtwpFlushSession(Session, TRUE);
+            NtSetEvent(Session->FlushDoneEvent, NULL);
+            continue;
+        }
+
+        EtwpFlushSession(Session, Status == STATUS_TIMEOUT);
+    }
+
+    /* The final flush is done by whoever stops the session */
+    RtlExitUserThread(STATUS_SUCCESS);
+    return STATUS_SUCCESS;
+}
+
+ULONG
+NTAPI
+EtwpAddLogHeaderToLogFile(
+    IN OUT PWMI_LOGGER_INFORMATION LoggerInfo,
+    IN PETW_REF_CLOCK RefClock,
+    IN ULONG Update)
+{
+    SYSTEM_TIMEOFDAY_INFORMATION TimeOfDay;
+    PTRACE_LOGFILE_HEADER LogfileHeader;
+    PSYSTEM_TRACE_HEADER TraceHeader;
+    PWMI_BUFFER_HEADER Buffer;
+    IO_STATUS_BLOCK IoStatusBlock;
+    LARGE_INTEGER Offset, Counter, Frequency;
+    ULONG BufferSize, RecordSize, MaximumResolution, MinimumResolution, CurrentResolution;
+    PUCHAR Names;
+    NTSTATUS Status;
+
+    BufferSize = LoggerInfo->BufferSize * 1024;
+    RecordSize = sizeof(SYSTEM_TRACE_HEADER) + sizeof(TRACE_LOGFILE_HEADER) +
+                 LoggerInfo->LoggerName.Length + sizeof(WCHAR) +
+                 LoggerInfo->LogFileName.Length + sizeof(WCHAR);
+    if (sizeof(WMI_BUFFER_HEADER) + ETW_ALIGN_RECORD(RecordSize) > BufferSize)
+        return ERROR_BUFFER_OVERFLOW;
+
+    Buffer = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, BufferSize);
+    if (!Buffer)
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    TraceHeader = (PSYSTEM_TRACE_HEADER)(Buffer + 1);
+    LogfileHeader = (PTRACE_LOGFILE_HEADER)(TraceHeader + 1);
+    Names = (PUCHAR)(LogfileHeader + 1);
+
+    RtlFillMemory((PUCHAR)Buffer + sizeof(WMI_BUFFER_HEADER) + ETW_ALIGN_RECORD(RecordSize),
+                  BufferSize - sizeof(WMI_BUFFER_HEADER) - ETW_ALIGN_RECORD(RecordSize),
+                  0xFF);
+
+    Buffer->BufferSize = BufferSize;
+    Buffer->SavedOffset = sizeof(WMI_BUFFER_HEADER) + ETW_ALIGN_RECORD(RecordSize);
+    Buffer->CurrentOffset = Buffer->SavedOffset;
+    Buffer->TimeStamp = RefClock->StartTime;
+    Buffer->ClockType = LoggerInfo->Wnode.ClientContext;
+    Buffer->ClientContext.Alignment = ETW_RECORD_ALIGNMENT;
+    Buffer->ClientContext.LoggerId = (USHORT)LoggerInfo->Wnode.HistoricalContext;
+    Buffer->Offset = Buffer->SavedOffset;
+    Buffer->BufferFlag = ETW_BUFFER_FLAG_NORMAL;
+    Buffer->BufferType = ETW_BUFFER_TYPE_HEADER;
+
+    TraceHeader->Version = TRACE_HEADER_VERSION;
+    TraceHeader->HeaderType = TRACE_HEADER_TYPE_SYSTEM;
+    TraceHeader->Flags = TRACE_HEADER_MARKER_FLAGS;
+    TraceHeader->Size = (USHORT)RecordSize;
+    TraceHeader->HookId = EVENT_TRACE_TYPE_INFO;
+    TraceHeader->ThreadId = HandleToUlong(NtCurrentTeb()->ClientId.UniqueThread);
+    TraceHeader->ProcessId = HandleToUlong(NtCurrentTeb()->ClientId.UniqueProcess);
+    TraceHeader->SystemTime = RefClock->StartPerfClock;
+
+    /* The readers convert time stamps with PerfFreq, which is the clock
+     * frequency of the session */
+    if (LoggerInfo->Wnode.ClientContext == ETWP_CLOCK_PERFCOUNTER)
+    {
+        NtQueryPerformanceCounter(&Counter, &Frequency);
+    }
+    else
+    {
+        Frequency.QuadPart = 10000000;
+    }
+
+    if (!NT_SUCCESS(NtQueryTimerResolution(&MaximumResolution, &MinimumResolution, &CurrentResolution)))
+        CurrentResolution = 156250;
+
+    LogfileHeader->BufferSize = BufferSize;
+    LogfileHeader->VersionDetail.MajorVersion = (UCHAR)NtCurrentPeb()->OSMajorVersion;
+    LogfileHeader->VersionDetail.MinorVersion = (UCHAR)NtCurrentPeb()->OSMinorVersion;
+    LogfileHeader->VersionDetail.SubVersion = ETW_LOGFILE_SUBVERSION;
+    LogfileHeader->VersionDetail.SubMinorVersion = ETW_LOGFILE_SUBMINORVERSION;
+    LogfileHeader->ProviderVersion = NtCurrentPeb()->OSBuildNumber;
+    LogfileHeader->NumberOfProcessors = NtCurrentPeb()->NumberOfProcessors;
+    LogfileHeader->EndTime.QuadPart = 0;
+    LogfileHeader->TimerResolution = CurrentResolution;
+    LogfileHeader->MaximumFileSize = LoggerInfo->MaximumFileSize;
+    LogfileHeader->LogFileMode = LoggerInfo->LogFileMode;
+    LogfileHeader->BuffersWritten = LoggerInfo->BuffersWritten + (Update ? 0 : 1);
+    LogfileHeader->StartBuffers = 1;
+    LogfileHeader->PointerSize = sizeof(PVOID);
+    LogfileHeader->EventsLost = 0;
+    LogfileHeader->CpuSpeedInMHz = 0;
+    LogfileHeader->LoggerName = NULL;
+    LogfileHeader->LogFileName = NULL;
+    NtQuerySystemInformation(SystemCurrentTimeZoneInformation,
+                             &LogfileHeader->TimeZone,
+                             sizeof(LogfileHeader->TimeZone),
+                             NULL);
+    if (NT_SUCCESS(NtQuerySystemInformation(SystemTimeOfDayInformation,
+                                            &TimeOfDay,
+                                            sizeof(TimeOfDay),
+                                            NULL)))
+    {
+        LogfileHeader->BootTime = TimeOfDay.BootTime;
+    }
+    LogfileHeader->PerfFreq = Frequency;
+    LogfileHeader->StartTime = RefClock->StartTime;
+    LogfileHeader->ReservedFlags = LoggerInfo->Wnode.ClientContext;
+    LogfileHeader->BuffersLost = LoggerInfo->LogBuffersLost;
+
+    RtlCopyMemory(Names, LoggerInfo->LoggerName.Buffer, LoggerInfo->LoggerName.Length);
+    Names += LoggerInfo->LoggerName.Length + sizeof(WCHAR);
+    RtlCopyMemory(Names, LoggerInfo->LogFileName.Buffer, LoggerInfo->LogFileName.Length);
+
+    Offset.QuadPart = 0;
+    Status = NtWriteFile(LoggerInfo->LogFileHandle,
+                         NULL,
+                         NULL,
+                         NULL,
+                         &IoStatusBlock,
+                         Buffer,
+                         BufferSize,
+                         &Offset,
+                         NULL);
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Buffer);
+
+    if (!NT_SUCCESS(Status))
+        return RtlNtStatusToDosError(Status);
+
+    if (!Update)
+        LoggerInfo->BuffersWritten++;
+
+    return ERROR_SUCCESS;
+}
+
+ULONG
+NTAPI
+EtwpFinalizeLogFileHeader(
+    IN PWMI_LOGGER_INFORMATION LoggerInfo)
+{
+    TRACE_LOGFILE_HEADER LogfileHeader;
+    IO_STATUS_BLOCK IoStatusBlock;
+    LARGE_INTEGER Offset;
+    NTSTATUS Status;
+
+    /* Only the counters change, patch them into the header record */
+    Offset.QuadPart = sizeof(WMI_BUFFER_HEADER) + sizeof(SYSTEM_TRACE_HEADER);
+    Status = NtReadFile(LoggerInfo->LogFileHandle,
+                        NULL,
+                        NULL,
+                        NULL,
+                        &IoStatusBlock,
+                        &LogfileHeader,
+                        sizeof(LogfileHeader),
+                        &Offset,
+                        NULL);
+    if (!NT_SUCCESS(Status))
+        return RtlNtStatusToDosError(Status);
+
+    LogfileHeader.EndTime.QuadPart = EtwpQueryClock(ETWP_CLOCK_SYSTEMTIME);
+    LogfileHeader.BuffersWritten = LoggerInfo->BuffersWritten;
+    LogfileHeader.EventsLost = LoggerInfo->EventsLost;
+    LogfileHeader.BuffersLost = LoggerInfo->LogBuffersLost;
+
+    Status = NtWriteFile(LoggerInfo->LogFileHandle,
+                         NULL,
+                         NULL,
+                         NULL,
+                         &IoStatusBlock,
+                         &LogfileHeader,
+                         sizeof(LogfileHeader),
+                         &Offset,
+                         NULL);
+    if (!NT_SUCCESS(Status))
+        return RtlNtStatusToDosError(Status);
+
+    return ERROR_SUCCESS;
+}
+
+PETWP_SESSION
+NTAPI
+EtwpFindSession(
+    _In_ TRACEHANDLE SessionHandle,
+    _In_opt_ PCUNICODE_STRING LoggerName)
+{
+    PETWP_SESSION Session;
+    ULONG Slot;
+
+    if (SessionHandle != 0 && SessionHandle != INVALID_PROCESSTRACE_HANDLE)
+    {
+        Slot = ETWP_HANDLE_SLOT(SessionHandle);
+        if (Slot >= ETWP_MAX_SESSIONS)
+            return NULL;
+
+        Session = EtwpSessions[Slot];
+        if (!Session || Session->Generation != ETWP_HANDLE_GENERATION(SessionHandle))
+            return NULL;
+
+        return Session;
+    }
+
+    if (!LoggerName || !LoggerName->Length)
+        return NULL;
+
+    for (Slot = 0; Slot < ETWP_MAX_SESSIONS; Slot++)
+    {
+        Session = EtwpSessions[Slot];
+        if (Session && RtlEqualUnicodeString(&Session->LoggerInfo.LoggerName, LoggerName, TRUE))
+            return Session;
+    }
+
+    return NULL;
+}
+
+static
+VOID
+EtwpQuerySession(
+    _In_ PETWP_SESSION Session,
+    _Inout_ PWMI_LOGGER_INFORMATION LoggerInfo,
+    _In_ BOOLEAN CopyNames)
+{
+    PWMI_LOGGER_INFORMATION Source = &Session->LoggerInfo;
+    ULONG Ring, i, FreeBuffers = 0;
+
+    for (Ring = 0; Ring <= Session->RingMask; Ring++)
+    {
+        for (i = 0; i < Session->BuffersPerRing; i++)
+        {
+            if (Session->Rings[Ring].Buffers[i]->State == ETW_BUFFER_STATE_FREE)
+                FreeBuffers++;
+        }
+    }
+
+    LoggerInfo->Wnode.HistoricalContext = ETWP_SESSION_HANDLE(Session);
+    LoggerInfo->Wnode.ClientContext = Session->ClockType;
+    LoggerInfo->BufferSize = Source->BufferSize;
+    LoggerInfo->MinimumBuffers = Source->MinimumBuffers;
+    LoggerInfo->MaximumBuffers = Source->MaximumBuffers;
+    LoggerInfo->MaximumFileSize = Source->MaximumFileSize;
+    LoggerInfo->LogFileMode = Source->LogFileMode;
+    LoggerInfo->FlushTimer = Source->FlushTimer;
+    LoggerInfo->EnableFlags = Source->EnableFlags;
+    LoggerInfo->AgeLimit = Source->AgeLimit;
+    LoggerInfo->NumberOfBuffers = Source->NumberOfBuffers;
+    LoggerInfo->FreeBuffers = FreeBuffers;
+    LoggerInfo->EventsLost = Session->EventsLost;
+    LoggerInfo->BuffersWritten = Source->BuffersWritten;
+    LoggerInfo->LogBuffersLost = Source->LogBuffersLost;
+    LoggerInfo->RealTimeBuffersLost = 0;
+    LoggerInfo->LoggerThreadId = Source->LoggerThreadId;
+
+    if (CopyNames)
+    {
+        if (LoggerInfo->LoggerName.Buffer)
+            RtlCopyUnicodeString(&LoggerInfo->LoggerName, &Source->LoggerName);
+        if (LoggerInfo->LogFileName.Buffer)
+            RtlCopyUnicodeString(&LoggerInfo->LogFileName, &Source->LogFileName);
+    }
+}
+
+static
+ULONG
+EtwpCreateLogFile(
+    _In_ PETWP_SESSION Session)
+{
+    PWMI_LOGGER_INFORMATION LoggerInfo = &Session->LoggerInfo;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    UNICODE_STRING NtName;
+    HANDLE FileHandle;
+    NTSTATUS Status;
+
+    if (!RtlDosPathNameToNtPathName_U(LoggerInfo->LogFileName.Buffer, &NtName, NULL, NULL))
+        return ERROR_PATH_NOT_FOUND;
+
+    InitializeObjectAttributes(&ObjectAttributes, &NtName, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    Status = NtCreateFile(&FileHandle,
+                          GENERIC_READ | GENERIC_WRITE | SYNCHRONIZE,
+                          &ObjectAttributes,
+                          &IoStatusBlock,
+                          NULL,
+                          FILE_ATTRIBUTE_NORMAL,
+                          FILE_SHARE_READ,
+                          FILE_OVERWRITE_IF,
+                          FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT | FILE_SEQUENTIAL_ONLY,
+                          NULL,
+                          0);
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, NtName.Buffer);
+
+    if (!NT_SUCCESS(Status))
+        return RtlNtStatusToDosError(Status);
+
+    LoggerInfo->LogFileHandle = FileHandle;
+    return ERROR_SUCCESS;
+}
+
+static
+VOID
+EtwpDeleteSession(
+    _In_ PETWP_SESSION Session)
+{
+    if (Session->LoggerInfo.LogFileHandle)
+        NtClose(Session->LoggerInfo.LogFileHandle);
+    if (Session->FlushEvent)
+        NtClose(Session->FlushEvent);
+    if (Session->FlushDoneEvent)
+        NtClose(Session->FlushDoneEvent);
+    if (Session->BufferMemory)
+        NtFreeVirtualMemory(NtCurrentProcess(), &Session->BufferMemory, &Session->BufferMemorySize, MEM_RELEASE);
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Session);
+}
+
+/*
+ * Writers reach a session through EtwpSessions and the provider enable masks
+ * without taking EtwpLock, so one may still be on its way into the rings of a
+ * session that was just stopped. Stopped sessions are kept around for a grace
+ * period before their memory is released.
+ */
+static
+VOID
+EtwpFreeRetiredSessions(VOID)
+{
+    PLIST_ENTRY Entry, Next;
+    PETWP_SESSION Session;
+    LONGLONG Now;
+
+    Now = EtwpQueryClock(ETWP_CLOCK_SYSTEMTIME);
+
+    for (Entry = EtwpRetiredSessions.Flink; Entry != &EtwpRetiredSessions; Entry = Next)
+    {
+        Next = Entry->Flink;
+        Session = CONTAINING_RECORD(Entry, ETWP_SESSION, RetiredEntry);
+
+        if (Now - Session->StopTime.QuadPart > ETWP_RETIRE_GRACE_PERIOD)
+        {
+            RemoveEntryList(Entry);
+            EtwpDeleteSession(Session);
+        }
+    }
+}
+
+static
+ULONG
+EtwpCreateSession(
+    _In_ ULONG Slot,
+    _In_ PWMI_LOGGER_INFORMATION LoggerInfo,
+    _Out_ PETWP_SESSION *CreatedSession)
+{
+    PWMI_LOGGER_INFORMATION SessionInfo;
+    PWMI_BUFFER_HEADER Buffer;
+    PETWP_SESSION Session;
+    CLIENT_ID ClientId;
+    ULONG BufferSize, RingCount, BuffersPerRing, SessionSize, Ring, i;
+    PUCHAR Memory;
+    NTSTATUS Status;
+    ULONG Error;
+
+    BufferSize = LoggerInfo->BufferSize ? LoggerInfo->BufferSize : ETWP_DEFAULT_BUFFER_SIZE;
+    BufferSize = max(BufferSize, ETWP_MIN_BUFFER_SIZE);
+    BufferSize = min(BufferSize, ETWP_MAX_BUFFER_SIZE);
+
+    for (RingCount = 1;
+         RingCount < NtCurrentPeb()->NumberOfProcessors && RingCount < ETWP_MAX_RINGS;
+         RingCount <<= 1);
+
+    BuffersPerRing = LoggerInfo->MinimumBuffers / RingCount;
+    if (LoggerInfo->MaximumBuffers != 0)
+        BuffersPerRing = min(BuffersPerRing, LoggerInfo->MaximumBuffers / RingCount);
+    BuffersPerRing = max(BuffersPerRing, ETWP_MIN_RING_BUFFERS);
+    BuffersPerRing = min(BuffersPerRing, ETWP_MAX_RING_BUFFERS);
+
+    SessionSize = FIELD_OFFSET(ETWP_SESSION, Rings[RingCount]);
+    Session = RtlAllocateHeap(RtlGetProcessHeap(),
+                              HEAP_ZERO_MEMORY,
+                              SessionSize +
+                              LoggerInfo->LoggerName.Length + sizeof(WCHAR) +
+                              LoggerInfo->LogFileName.Length + sizeof(WCHAR));
+    if (!Session)
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    if (++EtwpSessionGeneration == 0)
+        EtwpSessionGeneration = 1;
+
+    Session->Slot = Slot;
+    Session->LoggerId = (USHORT)(Slot + 1);
+    Session->Generation = EtwpSessionGeneration;
+    Session->ClockType = LoggerInfo->Wnode.ClientContext == ETWP_CLOCK_PERFCOUNTER ?
+                         ETWP_CLOCK_PERFCOUNTER : ETWP_CLOCK_SYSTEMTIME;
+    Session->BufferSize = BufferSize * 1024;
+    Session->MaximumEventSize = min(Session->BufferSize - sizeof(WMI_BUFFER_HEADER), ETWP_MAX_EVENT_SIZE);
+    Session->RingMask = RingCount - 1;
+    Session->BuffersPerRing = BuffersPerRing;
+
+    /* The session keeps its own copy of the settings, with the names stored
+     * right after the rings */
+    SessionInfo = &Session->LoggerInfo;
+    *SessionInfo = *LoggerInfo;
+    SessionInfo->Wnode.HistoricalContext = ETWP_SESSION_HANDLE(Session);
+    SessionInfo->Wnode.ClientContext = Session->ClockType;
+    SessionInfo->BufferSize = BufferSize;
+    SessionInfo->MinimumBuffers = RingCount * BuffersPerRing;
+    SessionInfo->MaximumBuffers = RingCount * BuffersPerRing;
+    SessionInfo->LogFileHandle = NULL;
+    SessionInfo->NumberOfBuffers = RingCount * BuffersPerRing;
+    SessionInfo->FreeBuffers = 0;
+    SessionInfo->EventsLost = 0;
+    SessionInfo->BuffersWritten = 0;
+    SessionInfo->LogBuffersLost = 0;
+    SessionInfo->RealTimeBuffersLost = 0;
+    SessionInfo->LoggerThreadId = NULL;
+    SessionInfo->Checksum = NULL;
+    SessionInfo->LoggerExtension = NULL;
+
+    SessionInfo->LoggerName.Buffer = (PWSTR)((PUCHAR)Session + SessionSize);
+    SessionInfo->LoggerName.MaximumLength = LoggerInfo->LoggerName.Length + sizeof(WCHAR);
+    RtlCopyUnicodeString(&SessionInfo->LoggerName, &LoggerInfo->LoggerName);
+
+    SessionInfo->LogFileName.Buffer = (PWSTR)((PUCHAR)SessionInfo->LoggerName.Buffer +
+                                              SessionInfo->LoggerName.MaximumLength);
+    SessionInfo->LogFileName.MaximumLength = LoggerInfo->LogFileName.Length + sizeof(WCHAR);
+    RtlCopyUnicodeString(&SessionInfo->LogFileName, &LoggerInfo->LogFileName);
+
+    /* One allocation holds every ring buffer and the staging buffer of the flusher */
+    Session->BufferMemorySize = (SIZE_T)Session->BufferSize * (RingCount * BuffersPerRing + 1);
+    Status = NtAllocateVirtualMemory(NtCurrentProcess(),
+                                     &Session->BufferMemory,
+                                     0,
+                                     &Session->BufferMemorySize,
+                                     MEM_COMMIT,
+                                     PAGE_READWRITE);
+    if (!NT_SUCCESS(Status))
+    {
+        Session->BufferMemory = NULL;
+        Error = ERROR_NOT_ENOUGH_MEMORY;
+        goto Cleanup;
+    }
+
+    Memory = Session->BufferMemory;
+    for (Ring = 0; Ring < RingCount; Ring++)
+    {
+        Session->Rings[Ring].Current = 0;
+        Session->Rings[Ring].BufferCount = BuffersPerRing;
+
+        for (i = 0; i < BuffersPerRing; i++)
+        {
+            Buffer = (PWMI_BUFFER_HEADER)Memory;
+            Buffer->BufferSize = Session->BufferSize;
+            Buffer->CurrentOffset = sizeof(WMI_BUFFER_HEADER);
+            Buffer->State = ETW_BUFFER_STATE_FREE;
+            Session->Rings[Ring].Buffers[i] = Buffer;
+            Memory += Session->BufferSize;
+        }
+    }
+    Session->FlushBuffer = (PWMI_BUFFER_HEADER)Memory;
+
+    Status = NtCreateEvent(&Session->FlushEvent, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
+    if (NT_SUCCESS(Status))
+        Status = NtCreateEvent(&Session->FlushDoneEvent, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
+    if (!NT_SUCCESS(Status))
+    {
+        Error = RtlNtStatusToDosError(Status);
+        goto Cleanup;
+    }
+
+    Session->RefClock.StartTime.QuadPart = EtwpQueryClock(ETWP_CLOCK_SYSTEMTIME);
+    Session->RefClock.StartPerfClock.QuadPart = EtwpQueryClock(Session->ClockType);
+
+    if (SessionInfo->LogFileName.Length)
+    {
+        Error = EtwpCreateLogFile(Session);
+        if (Error != ERROR_SUCCESS)
+            goto Cleanup;
+
+        Error = EtwpAddLogHeaderToLogFile(SessionInfo, &Session->RefClock, FALSE);
+        if (Error != ERROR_SUCCESS)
+            goto Cleanup;
+
+        Session->FileOffset.QuadPart = Session->BufferSize;
+    }
+
+    Status = RtlCreateUserThread(NtCurrentProcess(),
+                                 NULL,
+                                 FALSE,
+                                 0,
+                                 0,
+                                 0,
+                                 (PTHREAD_START_ROUTINE)EtwpFlusherThread,
+                                 Session,
+                                 &Session->FlusherThread,
+                                 &ClientId);
+    if (!NT_SUCCESS(Status))
+    {
+        Error = RtlNtStatusToDosError(Status);
+        goto Cleanup;
+    }
+
+    SessionInfo->LoggerThreadId = ClientId.UniqueThread;
+
+    *CreatedSession = Session;
+    return ERROR_SUCCESS;
+
+Cleanup:
+    EtwpDeleteSession(Session);
+    return Error;
+}
+
+static
+VOID
+EtwpStopSession(
+    _In_ PETWP_SESSION Session)
+{
+    PWMI_LOGGER_INFORMATION LoggerInfo = &Session->LoggerInfo;
+
+    InterlockedExchange(&Session->Stopping, TRUE);
+    NtSetEvent(Session->FlushEvent, NULL);
+
+    if (Session->FlusherThread)
+    {
+        NtWaitForSingleObject(Session->FlusherThread, FALSE, NULL);
+        NtClose(Session->FlusherThread);
+        Session->FlusherThread = NULL;
+    }
+
+    EtwpFlushSession(Session, TRUE);
+
+    if (LoggerInfo->LogFileHandle)
+    {
+        LoggerInfo->EventsLost = Session->EventsLost;
+        EtwpFinalizeLogFileHeader(LoggerInfo);
+        NtClose(LoggerInfo->LogFileHandle);
+        LoggerInfo->LogFileHandle = NULL;
+    }
+
+    /* A writer that got in before the providers were disabled may still
+     * close a buffer and signal FlushEvent. Closing it here could hand the
+     * handle value to an unrelated object, so the events, the structure and
+     * the buffers all stay until the session is retired */
+    Session->StopTime.QuadPart = EtwpQueryClock(ETWP_CLOCK_SYSTEMTIME);
+}
+
+ULONG
+NTAPI
+EtwpStartUmLogger(
+    IN ULONG WnodeSize,
+    IN OUT ULONG *SizeUsed,
+    OUT ULONG *SizeNeeded,
+    IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
+{
+    PETWP_SESSION Session = NULL;
+    ULONG Slot, Error;
+
+    *SizeNeeded = sizeof(WMI_LOGGER_INFORMATION);
+    if (WnodeSize < sizeof(WMI_LOGGER_INFORMATION))
+        return ERROR_BAD_LENGTH;
+
+    if (!LoggerInfo->LoggerName.Length)
+        return ERROR_INVALID_PARAMETER;
+
+    /* Events are only kept inside the process, in buffers or in a file */
+    if (LoggerInfo->LogFileMode & (EVENT_TRACE_REAL_TIME_MODE |
+                                   EVENT_TRACE_FILE_MODE_APPEND |
+                                   EVENT_TRACE_FILE_MODE_NEWFILE))
+    {
+        return ERROR_NOT_SUPPORTED;
+    }
+
+    if (!LoggerInfo->LogFileName.Length && !(LoggerInfo->LogFileMode & EVENT_TRACE_BUFFERING_MODE))
+        return ERROR_BAD_PATHNAME;
+
+    if ((LoggerInfo->LogFileMode & EVENT_TRACE_FILE_MODE_CIRCULAR) && !LoggerInfo->MaximumFileSize)
+        return ERROR_INVALID_PARAMETER;
+
+    RtlEnterCriticalSection(&EtwpLock);
+
+    EtwpFreeRetiredSessions();
+
+    if (EtwpFindSession(0, &LoggerInfo->LoggerName))
+    {
+        Error = ERROR_ALREADY_EXISTS;
+        goto Quit;
+    }
+
+    for (Slot = 0; Slot < ETWP_MAX_SESSIONS; Slot++)
+    {
+        if (!EtwpSessions[Slot])
+            break;
+    }
+
+    if (Slot == ETWP_MAX_SESSIONS)
+    {
+        Error = ERROR_NO_SYSTEM_RESOURCES;
+        goto Quit;
+    }
+
+    Error = EtwpCreateSession(Slot, LoggerInfo, &Session);
+    if (Error != ERROR_SUCCESS)
+        goto Quit;
+
+    EtwpSessions[Slot] = Session;
+    EtwpQuerySession(Session, LoggerInfo, FALSE);
+    *SizeUsed = sizeof(WMI_LOGGER_INFORMATION);
+
+Quit:
+    RtlLeaveCriticalSection(&EtwpLock);
+    return Error;
+}
+
+ULONG
+NTAPI
+EtwpStopUmLogger(
+    IN ULONG WnodeSize,
+    IN OUT ULONG *SizeUsed,
+    OUT ULONG *SizeNeeded,
+    IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
+{
+    PETWP_SESSION Session;
+
+    *SizeNeeded = sizeof(WMI_LOGGER_INFORMATION);
+    if (WnodeSize < sizeof(WMI_LOGGER_INFORMATION))
+        return ERROR_BAD_LENGTH;
+
+    RtlEnterCriticalSection(&EtwpLock);
+
+    Session = EtwpFindSession(LoggerInfo->Wnode.HistoricalContext, &LoggerInfo->LoggerName);
+    if (!Session)
+    {
+        RtlLeaveCriticalSection(&EtwpLock);
+        return ERROR_WMI_INSTANCE_NOT_FOUND;
+    }
+
+    /* Stop new writes before the last flush */
+    EtwpDisableSessionProviders(Session);
+    EtwpSessions[Session->Slot] = NULL;
+
+    RtlLeaveCriticalSection(&EtwpLock);
+
+    EtwpStopSession(Session);
+    EtwpQuerySession(Session, LoggerInfo, TRUE);
+    *SizeUsed = sizeof(WMI_LOGGER_INFORMATION);
+
+    RtlEnterCriticalSection(&EtwpLock);
+    InsertTailList(&EtwpRetiredSessions, &Session->RetiredEntry);
+    RtlLeaveCriticalSection(&EtwpLock);
+
+    return ERROR_SUCCESS;
+}
+
+ULONG
+NTAPI
+EtwpQueryUmLogger(
+    IN ULONG WnodeSize,
+    IN OUT ULONG *SizeUsed,
+    OUT ULONG *SizeNeeded,
+    IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
+{
+    PETWP_SESSION Session;
+
+    *SizeNeeded = sizeof(WMI_LOGGER_INFORMATION);
+    if (WnodeSize < sizeof(WMI_LOGGER_INFORMATION))
+        return ERROR_BAD_LENGTH;
+
+    RtlEnterCriticalSection(&EtwpLock);
+
+    Session = EtwpFindSession(LoggerInfo->Wnode.HistoricalContext, &LoggerInfo->LoggerName);
+    if (Session)
+        EtwpQuerySession(Session, LoggerInfo, TRUE);
+
+    RtlLeaveCriticalSection(&EtwpLock);
+
+    if (!Session)
+        return ERROR_WMI_INSTANCE_NOT_FOUND;
+
+    *SizeUsed = sizeof(WMI_LOGGER_INFORMATION);
+    return ERROR_SUCCESS;
+}
+
+ULONG
+NTAPI
+EtwpUpdateUmLogger(
+    IN ULONG WnodeSize,
+    IN OUT ULONG *SizeUsed,
+    OUT ULONG *SizeNeeded,
+    IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
+{
+    PETWP_SESSION Session;
+
+    *SizeNeeded = sizeof(WMI_LOGGER_INFORMATION);
+    if (WnodeSize < sizeof(WMI_LOGGER_INFORMATION))
+        return ERROR_BAD_LENGTH;
+
+    RtlEnterCriticalSection(&EtwpLock);
+
+    /* Only the flush timer and the enable flags can change on the fly */
+    Session = EtwpFindSession(LoggerInfo->Wnode.HistoricalContext, &LoggerInfo->LoggerName);
+    if (Session)
+    {
+        Session->LoggerInfo.FlushTimer = LoggerInfo->FlushTimer;
+        Session->LoggerInfo.EnableFlags = LoggerInfo->EnableFlags;
+        NtSetEvent(Session->FlushEvent, NULL);
+        EtwpQuerySession(Session, LoggerInfo, TRUE);
+    }
+
+    RtlLeaveCriticalSection(&EtwpLock);
+
+    if (!Session)
+        return ERROR_WMI_INSTANCE_NOT_FOUND;
+
+    *SizeUsed = sizeof(WMI_LOGGER_INFORMATION);
+    return ERROR_SUCCESS;
+}
+
+ULONG
+NTAPI
+EtwpFlushUmLogger(
+    IN ULONG WnodeSize,
+    IN OUT ULONG *SizeUsed,
+    OUT ULONG *SizeNeeded,
+    IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
+{
+    PETWP_SESSION Session;
+
+    *SizeNeeded = sizeof(WMI_LOGGER_INFORMATION);
+    if (WnodeSize < sizeof(WMI_LOGGER_INFORMATION))
+        return ERROR_BAD_LENGTH;
+
+    RtlEnterCriticalSection(&EtwpLock);
+
+    Session = EtwpFindSession(LoggerInfo->Wnode.HistoricalContext, &LoggerInfo->LoggerName);
+    if (!Session)
+    {
+        RtlLeaveCriticalSection(&EtwpLock);
+        return ERROR_WMI_INSTANCE_NOT_FOUND;
+    }
+
+    /* The flusher thread owns the file, ask it and wait. Holding EtwpLock
+     * keeps the session from being stopped meanwhile */
+    InterlockedExchange(&Session->FlushRequested, TRUE);
+    NtSetEvent(Session->FlushEvent, NULL);
+    NtWaitForSingleObject(Session->FlushDoneEvent, FALSE, NULL);
+
+    EtwpQuerySession(Session, LoggerInfo, TRUE);
+
+    RtlLeaveCriticalSection(&EtwpLock);
+
+    *SizeUsed = sizeof(WMI_LOGGER_INFORMATION);
+    return ERROR_SUCCESS;
+}
+
+VOID
+NTAPI
+EtwpShutdown(VOID)
+{
+    PETWP_SESSION Session;
+    ULONG Slot;
+
+    /* Write out whatever the sessions still hold when the process goes away.
+     * The flusher threads are gone by now, the flush is done inline. A thread
+     * killed while holding the lock leaves the sessions as they are */
+    if (!RtlTryEnterCriticalSection(&EtwpLock))
+        return;
+
+    for (Slot = 0; Slot < ETWP_MAX_SESSIONS; Slot++)
+    {
+        Session = EtwpSessions[Slot];
+        if (!Session)
+            continue;
+
+        EtwpDisableSessionProviders(Session);
+        EtwpSessions[Slot] = NULL;
+        EtwpStopSession(Session);
+    }
+
+    RtlLeaveCriticalSection(&EtwpLock);
+}
@@ -0,0 +1,473 @@
+/*++
+
+Copyright (c) 2026 Shorthorn Project
+
+Module Name:
+
+    provider.c
+
+Abstract:
+
+    Manifest-based event providers. A registration handle is the provider
+    itself, and writing an event nobody listens to costs a single test of
+    its enable mask.
+
+Revision History:
+
+--*/
+
+#include "etwp.h"
+
+#define NDEBUG
+#include <debug.h>
+
+LIST_ENTRY EtwpProviderList;
+
+#define EtwpProviderFromHandle(RegHandle) ((PETWP_PROVIDER)(ULONG_PTR)(RegHandle))
+
+static
+VOID
+EtwpNotifyProvider(
+    _In_ PETWP_PROVIDER Provider,
+    _In_ ULONG IsEnabled,
+    _In_ PETWP_ENABLE_INFO EnableInfo,
+    _In_opt_ PEVENT_FILTER_DESCRIPTOR FilterData)
+{
+    if (!Provider->EnableCallback)
+        return;
+
+    Provider->EnableCallback(&Provider->ProviderId,
+                             IsEnabled,
+                             EnableInfo->Level,
+                             EnableInfo->MatchAnyKeyword,
+                             EnableInfo->MatchAllKeyword,
+                             FilterData,
+                             Provider->CallbackContext);
+}
+
+static
+PETWP_SESSION_PROVIDER
+EtwpFindSessionProvider(
+    _In_ PETWP_SESSION Session,
+    _In_ LPCGUID ProviderId)
+{
+    ULONG i;
+
+    for (i = 0; i < Session->ProviderCount; i++)
+    {
+        if (IsEqualGUID(&Session->Providers[i].ProviderId, ProviderId))
+            return &Session->Providers[i];
+    }
+
+    return NULL;
+}
+
+/* Called with EtwpLock held */
+static
+VOID
+EtwpApplySessions(
+    _Inout_ PETWP_PROVIDER Provider)
+{
+    PETWP_SESSION_PROVIDER Entry;
+    PETWP_SESSION Session;
+    LONG EnableMask = 0;
+    ULONG Slot;
+
+    for (Slot = 0; Slot < ETWP_MAX_SESSIONS; Slot++)
+    {
+        Session = EtwpSessions[Slot];
+        if (!Session)
+            continue;
+
+        Entry = EtwpFindSessionProvider(Session, &Provider->ProviderId);
+        if (!Entry)
+            continue;
+
+        Provider->EnableInfo[Slot] = Entry->EnableInfo;
+        EnableMask |= 1 << Slot;
+    }
+
+    InterlockedExchange(&Provider->EnableMask, EnableMask);
+}
+
+static
+ULONG
+EtwpWriteEvent(
+    _In_ PETWP_PROVIDER Provider,
+    _In_ PCEVENT_DESCRIPTOR EventDescriptor,
+    _In_ USHORT EventProperty,
+    _In_ USHORT Flags,
+    _In_opt_ LPCGUID ActivityId,
+    _In_opt_ LPCGUID RelatedActivityId,
+    _In_ ULONG UserDataCount,
+    _In_reads_opt_(UserDataCount) PEVENT_DATA_DESCRIPTOR UserData)
+{
+    PETWP_SESSION Session;
+    LONG EnableMask;
+    ULONG Slot, Error, Result = ERROR_SUCCESS;
+
+    EnableMask = Provider->EnableMask;
+
+    for (Slot = 0; EnableMask != 0; Slot++, EnableMask >>= 1)
+    {
+        if (!(EnableMask & 1))
+            continue;
+
+        if (!EtwpIsEventEnabled(&Provider->EnableInfo[Slot],
+                                EventDescriptor->Level,
+                                EventDescriptor->Keyword))
+        {
+            continue;
+        }
+
+        /* The session may have been stopped since the mask was read */
+        Session = EtwpSessions[Slot];
+        if (!Session)
+            continue;
+
+        Error = EtwpLogEvent(Session,
+                             &Provider->ProviderId,
+                             EventDescriptor,
+                             EventProperty,
+                             Flags,
+                             ActivityId,
+                             RelatedActivityId,
+                             UserDataCount,
+                             UserData);
+        if (Error != ERROR_SUCCESS)
+            Result = Error;
+    }
+
+    return Result;
+}
+
+ULONG
+NTAPI
+EtwEventRegister(
+  IN LPCGUID ProviderId,
+  IN PENABLECALLBACK EnableCallback OPTIONAL,
+  IN PVOID CallbackContext OPTIONAL,
+  OUT PREGHANDLE RegHandle)
+{
+    PETWP_PROVIDER Provider;
+    ULONG Slot;
+
+    if (!ProviderId || !RegHandle)
+        return ERROR_INVALID_PARAMETER;
+
+    Provider = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*Provider));
+    if (!Provider)
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    Provider->ProviderId = *ProviderId;
+    Provider->EnableCallback = EnableCallback;
+    Provider->CallbackContext = CallbackContext;
+
+    RtlEnterCriticalSection(&EtwpLock);
+
+    InsertTailList(&EtwpProviderList, &Provider->ListEntry);
+    EtwpApplySessions(Provider);
+
+    /* Sessions started before the registration enable the provider now */
+    for (Slot = 0; Slot < ETWP_MAX_SESSIONS; Slot++)
+    {
+        if (Provider->EnableMask & (1 << Slot))
+            EtwpNotifyProvider(Provider, EVENT_CONTROL_CODE_ENABLE_PROVIDER, &Provider->EnableInfo[Slot], NULL);
+    }
+
+    RtlLeaveCriticalSection(&EtwpLock);
+
+    *RegHandle = (REGHANDLE)(ULONG_PTR)Provider;
+    return ERROR_SUCCESS;
+}
+
+ULONG
+NTAPI
+EtwEventUnregister(
+  _In_  REGHANDLE RegHandle
+)
+{
+    PETWP_PROVIDER Provider = EtwpProviderFromHandle(RegHandle);
+
+    if (!Provider)
+        return ERROR_INVALID_HANDLE;
+
+    RtlEnterCriticalSection(&EtwpLock);
+    RemoveEntryList(&Provider->ListEntry);
+    RtlLeaveCriticalSection(&EtwpLock);
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Provider);
+    return ERROR_SUCCESS;
+}
+
+BOOLEAN
+NTAPI
+EtwEventProviderEnabled(
+    REGHANDLE RegHandle,
+    UCHAR Level,
+    ULONGLONG Keyword)
+{
+    PETWP_PROVIDER Provider = EtwpProviderFromHandle(RegHandle);
+    LONG EnableMask;
+    ULONG Slot;
+
+    if (!Provider)
+        return FALSE;
+
+    EnableMask = Provider->EnableMask;
+
+    for (Slot = 0; EnableMask != 0; Slot++, EnableMask >>= 1)
+    {
+        if ((EnableMask & 1) && EtwpIsEventEnabled(&Provider->EnableInfo[Slot], Level, Keyword))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+BOOLEAN
+NTAPI
+EtwEventEnabled(
+  _In_  REGHANDLE RegHandle,
+  _In_  PCEVENT_DESCRIPTOR EventDescriptor
+)
+{
+    PETWP_PROVIDER Provider = EtwpProviderFromHandle(RegHandle);
+
+    if (!Provider || !Provider->EnableMask)
+        return FALSE;
+
+    return EtwEventProviderEnabled(RegHandle, EventDescriptor->Level, EventDescriptor->Keyword);
+}
+
+ULONG
+NTAPI
+EtwEventWrite(
+  IN REGHANDLE RegHandle,
+  IN PCEVENT_DESCRIPTOR EventDescriptor,
+  IN ULONG UserDataCount,
+  IN PEVENT_DATA_DESCRIPTOR UserData)
+{
+    PETWP_PROVIDER Provider = EtwpProviderFromHandle(RegHandle);
+
+    if (!Provider)
+        return ERROR_INVALID_HANDLE;
+
+    if (!Provider->EnableMask)
+        return ERROR_SUCCESS;
+
+    return EtwpWriteEvent(Provider, EventDescriptor, 0, 0, NULL, NULL, UserDataCount, UserData);
+}
+
+ULONG
+NTAPI
+EtwEventWriteFull(
+    REGHANDLE RegHandle,
+    PCEVENT_DESCRIPTOR EventDescriptor,
+    USHORT EventProperty,
+    LPCGUID ActivityId,
+    LPCGUID RelatedActivityId,
+    ULONG UserDataCount,
+    PEVENT_DATA_DESCRIPTOR UserData)
+{
+    PETWP_PROVIDER Provider = EtwpProviderFromHandle(RegHandle);
+
+    if (!Provider)
+        return ERROR_INVALID_HANDLE;
+
+    if (!Provider->EnableMask)
+        return ERROR_SUCCESS;
+
+    return EtwpWriteEvent(Provider,
+                          EventDescriptor,
+                          EventProperty,
+                          0,
+                          ActivityId,
+                          RelatedActivityId,
+                          UserDataCount,
+                          UserData);
+}
+
+/******************************************************************************
+ *                  EtwEventWriteTransfer   (NTDLL.@)
+ */
+ULONG NTAPI EtwEventWriteTransfer( REGHANDLE handle, PCEVENT_DESCRIPTOR descriptor, LPCGUID activity,
+                                    LPCGUID related, ULONG count, PEVENT_DATA_DESCRIPTOR data )
+{
+    PETWP_PROVIDER Provider = EtwpProviderFromHandle(handle);
+
+    if (!Provider)
+        return ERROR_INVALID_HANDLE;
+
+    if (!Provider->EnableMask)
+        return ERROR_SUCCESS;
+
+    return EtwpWriteEvent(Provider, descriptor, 0, 0, activity, related, count, data);
+}
+
+/******************************************************************************
+ *                  EtwEventWriteString   (NTDLL.@)
+ */
+ULONG NTAPI EtwEventWriteString( REGHANDLE handle, UCHAR level, ULONGLONG keyword, PCWSTR string )
+{
+    PETWP_PROVIDER Provider = EtwpProviderFromHandle(handle);
+    EVENT_DESCRIPTOR Descriptor;
+    EVENT_DATA_DESCRIPTOR Data;
+
+    if (!Provider)
+        return ERROR_INVALID_HANDLE;
+
+    if (!Provider->EnableMask)
+        return ERROR_SUCCESS;
+
+    RtlZeroMemory(&Descriptor, sizeof(Descriptor));
+    Descriptor.Level = level;
+    Descriptor.Keyword = keyword;
+
+    /* The string is the whole payload, terminator included */
+    EventDataDescCreate(&Data, string, (ULONG)(wcslen(string) + 1) * sizeof(WCHAR));
+
+    return EtwpWriteEvent(Provider, &Descriptor, 0, EVENT_HEADER_FLAG_STRING_ONLY, NULL, NULL, 1, &Data);
+}
+
+ULONG NTAPI EtwEventWriteNoRegistration (
+    GUID const *ProviderId,
+    EVENT_DESCRIPTOR const *EventDescriptor,
+    ULONG UserDataCount,
+    EVENT_DATA_DESCRIPTOR *UserData)
+{
+    ETWP_PROVIDER Provider;
+
+    if (!ProviderId || !EventDescriptor)
+        return ERROR_INVALID_PARAMETER;
+
+    /* Look the provider up in the sessions as a registration would */
+    RtlZeroMemory(&Provider, sizeof(Provider));
+    Provider.ProviderId = *ProviderId;
+
+    RtlEnterCriticalSection(&EtwpLock);
+    EtwpApplySessions(&Provider);
+    RtlLeaveCriticalSection(&EtwpLock);
+
+    if (!Provider.EnableMask)
+        return ERROR_SUCCESS;
+
+    return EtwpWriteEvent(&Provider, EventDescriptor, 0, 0, NULL, NULL, UserDataCount, UserData);
+}
+
+ULONG
+NTAPI
+EtwpEnableProvider(
+    _In_ TRACEHANDLE SessionHandle,
+    _In_ LPCGUID ProviderId,
+    _In_ ULONG ControlCode,
+    _In_ UCHAR Level,
+    _In_ ULONGLONG MatchAnyKeyword,
+    _In_ ULONGLONG MatchAllKeyword,
+    _In_ ULONG EnableProperty,
+    _In_opt_ PEVENT_FILTER_DESCRIPTOR EnableFilterDesc)
+{
+    PETWP_SESSION_PROVIDER Entry;
+    PETWP_PROVIDER Provider;
+    PETWP_SESSION Session;
+    PLIST_ENTRY ListEntry;
+    ULONG Error = ERROR_SUCCESS;
+
+    if (!ProviderId)
+        return ERROR_INVALID_PARAMETER;
+
+    if (ControlCode > EVENT_CONTROL_CODE_CAPTURE_STATE)
+        return ERROR_INVALID_PARAMETER;
+
+    RtlEnterCriticalSection(&EtwpLock);
+
+    Session = EtwpFindSession(SessionHandle, NULL);
+    if (!Session)
+    {
+        Error = ERROR_INVALID_HANDLE;
+        goto Quit;
+    }
+
+    Entry = EtwpFindSessionProvider(Session, ProviderId);
+
+    switch (ControlCode)
+    {
+        case EVENT_CONTROL_CODE_ENABLE_PROVIDER:
+            if (!Entry)
+            {
+                if (Session->ProviderCount == ETWP_MAX_SESSION_PROVIDERS)
+                {
+                    Error = ERROR_NO_SYSTEM_RESOURCES;
+                    goto Quit;
+                }
+
+                Entry = &Session->Providers[Session->ProviderCount++];
+                Entry->ProviderId = *ProviderId;
+            }
+
+            Entry->EnableInfo.Level = Level;
+            Entry->EnableInfo.EnableProperty = EnableProperty;
+            Entry->EnableInfo.MatchAnyKeyword = MatchAnyKeyword;
+            Entry->EnableInfo.MatchAllKeyword = MatchAllKeyword;
+            break;
+
+        case EVENT_CONTROL_CODE_DISABLE_PROVIDER:
+            if (!Entry)
+                goto Quit;
+
+            *Entry = Session->Providers[--Session->ProviderCount];
+            break;
+
+        case EVENT_CONTROL_CODE_CAPTURE_STATE:
+            if (!Entry)
+                goto Quit;
+            break;
+    }
+
+    for (ListEntry = EtwpProviderList.Flink; ListEntry != &EtwpProviderList; ListEntry = ListEntry->Flink)
+    {
+        Provider = CONTAINING_RECORD(ListEntry, ETWP_PROVIDER, ListEntry);
+        if (!IsEqualGUID(&Provider->ProviderId, ProviderId))
+            continue;
+
+        if (ControlCode == EVENT_CONTROL_CODE_CAPTURE_STATE)
+        {
+            EtwpNotifyProvider(Provider, ControlCode, &Provider->EnableInfo[Session->Slot], EnableFilterDesc);
+            continue;
+        }
+
+        /* The callback sees the settings of the session that changed */
+        EtwpApplySessions(Provider);
+        Provider->EnableInfo[Session->Slot].Level = Level;
+        Provider->EnableInfo[Session->Slot].EnableProperty = EnableProperty;
+        Provider->EnableInfo[Session->Slot].MatchAnyKeyword = MatchAnyKeyword;
+        Provider->EnableInfo[Session->Slot].MatchAllKeyword = MatchAllKeyword;
+        EtwpNotifyProvider(Provider, ControlCode, &Provider->EnableInfo[Session->Slot], EnableFilterDesc);
+    }
+
+Quit:
+    RtlLeaveCriticalSection(&EtwpLock);
+    return Error;
+}
+
+VOID
+NTAPI
+EtwpDisableSessionProviders(
+    _In_ PETWP_SESSION Session)
+{
+    PETWP_PROVIDER Provider;
+    PLIST_ENTRY ListEntry;
+    LONG SessionBit = 1 << Session->Slot;
+
+    for (ListEntry = EtwpProviderList.Flink; ListEntry != &EtwpProviderList; ListEntry = ListEntry->Flink)
+    {
+        Provider = CONTAINING_RECORD(ListEntry, ETWP_PROVIDER, ListEntry);
+        if (!(Provider->EnableMask & SessionBit))
+            continue;
+
+        InterlockedExchange(&Provider->EnableMask, Provider->EnableMask & ~SessionBit);
+        EtwpNotifyProvider(Provider, EVENT_CONTROL_CODE_DISABLE_PROVIDER, &Provider->EnableInfo[Session->Slot], NULL);
+    }
+
+    Session->ProviderCount = 0;
+}
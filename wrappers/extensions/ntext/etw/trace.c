@@ -18,9 +18,7 @@ Revision History:
 
 --*/ 
  
-#include <main.h> 
-#include <wmistr.h>
-#include <evntrace.h>
+#include "etwp.h"
 #include <rtltypes.h>
 
 #define NDEBUG
@@ -148,18 +146,237 @@ EtwRegisterTraceGuidsW(
     return ERROR_SUCCESS;
 }
 
-ULONG WINAPI EtwStartTraceW( PTRACEHANDLE pSessionHandle, LPCWSTR SessionName, PEVENT_TRACE_PROPERTIES Properties )
+/* ControlTrace codes stop at EVENT_TRACE_CONTROL_FLUSH, starting is internal */
+#define ETWP_TRACE_CONTROL_START    ((ULONG)-1)
+
+static
+ULONG
+EtwpCopyTraceName(
+    _In_ PEVENT_TRACE_PROPERTIES Properties,
+    _In_ ULONG Offset,
+    _In_ PCUNICODE_STRING Name,
+    _In_ BOOLEAN Ansi)
+{
+    ULONG Space, Length;
+
+    if (!Offset || Offset >= Properties->Wnode.BufferSize)
+        return 0;
+
+    Space = Properties->Wnode.BufferSize - Offset;
+
+    if (Ansi)
+    {
+        PCHAR Buffer = (PCHAR)Properties + Offset;
+
+        RtlUnicodeToMultiByteN(Buffer, Space - 1, &Length, Name->Buffer, Name->Length);
+        Buffer[Length] = ANSI_NULL;
+    }
+    else
+    {
+        PWCHAR Buffer = (PWCHAR)((PUCHAR)Properties + Offset);
+
+        if (Space < sizeof(WCHAR))
+            return 0;
+
+        Length = min(Name->Length, Space - sizeof(WCHAR)) & ~1;
+        RtlCopyMemory(Buffer, Name->Buffer, Length);
+        Buffer[Length / sizeof(WCHAR)] = UNICODE_NULL;
+    }
+
+    return Length;
+}
+
+/*
+ * Common body of the controller functions: the properties are turned into
+ * a WMI_LOGGER_INFORMATION for the user-mode logger and the result copied
+ * back, names included, in the character set of the caller.
+ */
+static
+ULONG
+EtwpControlTrace(
+    _In_ TRACEHANDLE SessionHandle,
+    _In_opt_ PCUNICODE_STRING SessionName,
+    _Inout_ PEVENT_TRACE_PROPERTIES Properties,
+    _In_ ULONG ControlCode,
+    _In_ BOOLEAN Ansi)
 {
-    DbgPrint("(%p, %s, %p) stub\n", pSessionHandle, SessionName, Properties);
-    if (pSessionHandle) *pSessionHandle = 0xcafe4242;
+    WCHAR LoggerNameBuffer[MAX_PATH], LogFileNameBuffer[MAX_PATH];
+    WMI_LOGGER_INFORMATION LoggerInfo;
+    ANSI_STRING AnsiFileName;
+    UNICODE_STRING FileName;
+    ULONG SizeUsed = 0, SizeNeeded = 0, Error;
+
+    if (!Properties)
+        return ERROR_INVALID_PARAMETER;
+
+    if (Properties->Wnode.BufferSize < sizeof(EVENT_TRACE_PROPERTIES))
+        return ERROR_BAD_LENGTH;
+
+    RtlZeroMemory(&LoggerInfo, sizeof(LoggerInfo));
+    LoggerInfo.Wnode.BufferSize = sizeof(LoggerInfo);
+    LoggerInfo.Wnode.HistoricalContext = SessionHandle;
+    LoggerInfo.Wnode.ClientContext = Properties->Wnode.ClientContext;
+    LoggerInfo.Wnode.Flags = WNODE_FLAG_TRACED_GUID;
+    LoggerInfo.BufferSize = Properties->BufferSize;
+    LoggerInfo.MinimumBuffers = Properties->MinimumBuffers;
+    LoggerInfo.MaximumBuffers = Properties->MaximumBuffers;
+    LoggerInfo.MaximumFileSize = Properties->MaximumFileSize;
+    LoggerInfo.LogFileMode = Properties->LogFileMode;
+    LoggerInfo.FlushTimer = Properties->FlushTimer;
+    LoggerInfo.EnableFlags = Properties->EnableFlags;
+    LoggerInfo.AgeLimit = Properties->AgeLimit;
+
+    LoggerInfo.LoggerName.Buffer = LoggerNameBuffer;
+    LoggerInfo.LoggerName.MaximumLength = sizeof(LoggerNameBuffer);
+    if (SessionName)
+    {
+        if (SessionName->Length >= sizeof(LoggerNameBuffer))
+            return ERROR_BAD_LENGTH;
+        RtlCopyUnicodeString(&LoggerInfo.LoggerName, SessionName);
+    }
+
+    LoggerInfo.LogFileName.Buffer = LogFileNameBuffer;
+    LoggerInfo.LogFileName.MaximumLength = sizeof(LogFileNameBuffer);
+    if (ControlCode == ETWP_TRACE_CONTROL_START && Properties->LogFileNameOffset)
+    {
+        if (Properties->LogFileNameOffset >= Properties->Wnode.BufferSize)
+            return ERROR_INVALID_PARAMETER;
+
+        if (Ansi)
+        {
+            RtlInitAnsiString(&AnsiFileName, (PCSZ)((PUCHAR)Properties + Properties->LogFileNameOffset));
+            if (!NT_SUCCESS(RtlAnsiStringToUnicodeString(&LoggerInfo.LogFileName, &AnsiFileName, FALSE)))
+                return ERROR_BAD_PATHNAME;
+        }
+        else
+        {
+            RtlInitUnicodeString(&FileName, (PCWSTR)((PUCHAR)Properties + Properties->LogFileNameOffset));
+            if (FileName.Length >= sizeof(LogFileNameBuffer))
+                return ERROR_BAD_PATHNAME;
+            RtlCopyUnicodeString(&LoggerInfo.LogFileName, &FileName);
+        }
+    }
+
+    switch (ControlCode)
+    {
+        case ETWP_TRACE_CONTROL_START:
+            Error = EtwpStartUmLogger(sizeof(LoggerInfo), &SizeUsed, &SizeNeeded, &LoggerInfo);
+            break;
+
+        case EVENT_TRACE_CONTROL_QUERY:
+            Error = EtwpQueryUmLogger(sizeof(LoggerInfo), &SizeUsed, &SizeNeeded, &LoggerInfo);
+            break;
+
+        case EVENT_TRACE_CONTROL_STOP:
+            Error = EtwpStopUmLogger(sizeof(LoggerInfo), &SizeUsed, &SizeNeeded, &LoggerInfo);
+            break;
+
+        case EVENT_TRACE_CONTROL_UPDATE:
+            Error = EtwpUpdateUmLogger(sizeof(LoggerInfo), &SizeUsed, &SizeNeeded, &LoggerInfo);
+            break;
+
+        case EVENT_TRACE_CONTROL_FLUSH:
+            Error = EtwpFlushUmLogger(sizeof(LoggerInfo), &SizeUsed, &SizeNeeded, &LoggerInfo);
+            break;
+
+        default:
+            return ERROR_INVALID_PARAMETER;
+    }
+
+    if (Error != ERROR_SUCCESS)
+        return Error;
+
+    Properties->Wnode.HistoricalContext = LoggerInfo.Wnode.HistoricalContext;
+    Properties->Wnode.ClientContext = LoggerInfo.Wnode.ClientContext;
+    Properties->BufferSize = LoggerInfo.BufferSize;
+    Properties->MinimumBuffers = LoggerInfo.MinimumBuffers;
+    Properties->MaximumBuffers = LoggerInfo.MaximumBuffers;
+    Properties->MaximumFileSize = LoggerInfo.MaximumFileSize;
+    Properties->LogFileMode = LoggerInfo.LogFileMode;
+    Properties->FlushTimer = LoggerInfo.FlushTimer;
+    Properties->EnableFlags = LoggerInfo.EnableFlags;
+    Properties->AgeLimit = LoggerInfo.AgeLimit;
+    Properties->NumberOfBuffers = LoggerInfo.NumberOfBuffers;
+    Properties->FreeBuffers = LoggerInfo.FreeBuffers;
+    Properties->EventsLost = LoggerInfo.EventsLost;
+    Properties->BuffersWritten = LoggerInfo.BuffersWritten;
+    Properties->LogBuffersLost = LoggerInfo.LogBuffersLost;
+    Properties->RealTimeBuffersLost = LoggerInfo.RealTimeBuffersLost;
+    Properties->LoggerThreadId = LoggerInfo.LoggerThreadId;
+
+    EtwpCopyTraceName(Properties, Properties->LoggerNameOffset, &LoggerInfo.LoggerName, Ansi);
+    if (ControlCode != ETWP_TRACE_CONTROL_START)
+        EtwpCopyTraceName(Properties, Properties->LogFileNameOffset, &LoggerInfo.LogFileName, Ansi);
+
     return ERROR_SUCCESS;
 }
 
+static
+ULONG
+EtwpControlTraceA(
+    _In_ TRACEHANDLE SessionHandle,
+    _In_opt_ LPCSTR SessionName,
+    _Inout_ PEVENT_TRACE_PROPERTIES Properties,
+    _In_ ULONG ControlCode)
+{
+    UNICODE_STRING Name;
+    ULONG Error;
+
+    if (!SessionName)
+        return EtwpControlTrace(SessionHandle, NULL, Properties, ControlCode, TRUE);
+
+    if (!RtlCreateUnicodeStringFromAsciiz(&Name, SessionName))
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    Error = EtwpControlTrace(SessionHandle, &Name, Properties, ControlCode, TRUE);
+
+    RtlFreeUnicodeString(&Name);
+    return Error;
+}
+
+static
+ULONG
+EtwpControlTraceW(
+    _In_ TRACEHANDLE SessionHandle,
+    _In_opt_ LPCWSTR SessionName,
+    _Inout_ PEVENT_TRACE_PROPERTIES Properties,
+    _In_ ULONG ControlCode)
+{
+    UNICODE_STRING Name;
+
+    if (!SessionName)
+        return EtwpControlTrace(SessionHandle, NULL, Properties, ControlCode, FALSE);
+
+    RtlInitUnicodeString(&Name, SessionName);
+    return EtwpControlTrace(SessionHandle, &Name, Properties, ControlCode, FALSE);
+}
+
+ULONG WINAPI EtwStartTraceW( PTRACEHANDLE pSessionHandle, LPCWSTR SessionName, PEVENT_TRACE_PROPERTIES Properties )
+{
+    ULONG Error;
+
+    if (!pSessionHandle || !SessionName)
+        return ERROR_INVALID_PARAMETER;
+
+    Error = EtwpControlTraceW(0, SessionName, Properties, ETWP_TRACE_CONTROL_START);
+    if (Error == ERROR_SUCCESS)
+        *pSessionHandle = Properties->Wnode.HistoricalContext;
+
+    return Error;
+}
+
 ULONG WINAPI EtwStartTraceA( PTRACEHANDLE pSessionHandle, LPCSTR SessionName, PEVENT_TRACE_PROPERTIES Properties )
 {
-    DbgPrint("(%p, %s, %p) stub\n", pSessionHandle, SessionName, Properties);
-    if (pSessionHandle) *pSessionHandle = 0xcafe4242;
-    return ERROR_SUCCESS;
+    ULONG Error;
+
+    if (!pSessionHandle || !SessionName)
+        return ERROR_INVALID_PARAMETER;
+
+    Error = EtwpControlTraceA(0, SessionName, Properties, ETWP_TRACE_CONTROL_START);
+    if (Error == ERROR_SUCCESS)
+        *pSessionHandle = Properties->Wnode.HistoricalContext;
+
+    return Error;
 }
 
 /******************************************************************************
@@ -177,8 +394,10 @@ EtwControlTraceW(
 	ULONG control 
 )
 {
-    DbgPrint("(%I64x, %s, %p, %d) stub\n", hSession, SessionName, Properties, control);
-    return ERROR_SUCCESS;
+    if (control > EVENT_TRACE_CONTROL_FLUSH)
+        return ERROR_INVALID_PARAMETER;
+
+    return EtwpControlTraceW(hSession, SessionName, Properties, control);
 }
 
 /******************************************************************************
@@ -196,8 +415,10 @@ EtwControlTraceA(
 	ULONG control 
 )
 {
-    DbgPrint("(%I64x, %s, %p, %d) stub\n", hSession, SessionName, Properties, control);
-    return ERROR_SUCCESS;
+    if (control > EVENT_TRACE_CONTROL_FLUSH)
+        return ERROR_INVALID_PARAMETER;
+
+    return EtwpControlTraceA(hSession, SessionName, Properties, control);
 }
 
 /******************************************************************************
@@ -213,10 +434,79 @@ EtwEnableTrace(
 	TRACEHANDLE hSession
 )
 {
-    DbgPrint("(%d, 0x%x, %d, %p, %I64x): stub\n", enable, flag, level,
-            guid, hSession);
+    return EtwpEnableProvider(hSession,
+                              guid,
+                              enable ? EVENT_CONTROL_CODE_ENABLE_PROVIDER : EVENT_CONTROL_CODE_DISABLE_PROVIDER,
+                              (UCHAR)level,
+                              flag,
+                              0,
+                              0,
+                              NULL);
+}
 
-    return ERROR_SUCCESS;
+/******************************************************************************
+ * EtwEnableTraceEx2 [NTDLL.@]
+ */
+ULONG
+WINAPI
+EtwEnableTraceEx2(
+    TRACEHANDLE TraceHandle,
+    LPCGUID ProviderId,
+    ULONG ControlCode,
+    UCHAR Level,
+    ULONGLONG MatchAnyKeyword,
+    ULONGLONG MatchAllKeyword,
+    ULONG Timeout,
+    PENABLE_TRACE_PARAMETERS EnableParameters
+)
+{
+    /* Providers live in this process, enabling never has to wait */
+    UNREFERENCED_PARAMETER(Timeout);
+
+    return EtwpEnableProvider(TraceHandle,
+                              ProviderId,
+                              ControlCode,
+                              Level,
+                              MatchAnyKeyword,
+                              MatchAllKeyword,
+                              EnableParameters ? EnableParameters->EnableProperty : 0,
+                              EnableParameters ? EnableParameters->EnableFilterDesc : NULL);
+}
+
+static
+ULONG
+EtwpQueryAllTraces(
+    _Out_writes_(PropertyArrayCount) PEVENT_TRACE_PROPERTIES *PropertyArray,
+    _In_ ULONG PropertyArrayCount,
+    _Out_ PULONG SessionCount,
+    _In_ BOOLEAN Ansi)
+{
+    TRACEHANDLE Handles[ETWP_MAX_SESSIONS];
+    ULONG Count = 0, Slot, Error;
+
+    if (!PropertyArray || !SessionCount)
+        return ERROR_INVALID_PARAMETER;
+
+    RtlEnterCriticalSection(&EtwpLock);
+    for (Slot = 0; Slot < ETWP_MAX_SESSIONS; Slot++)
+    {
+        if (EtwpSessions[Slot])
+            Handles[Count++] = ETWP_SESSION_HANDLE(EtwpSessions[Slot]);
+    }
+    RtlLeaveCriticalSection(&EtwpLock);
+
+    *SessionCount = 0;
+    for (Slot = 0; Slot < Count && *SessionCount < PropertyArrayCount; Slot++)
+    {
+        /* Sessions stopped meanwhile are left out */
+        Error = EtwpControlTrace(Handles[Slot], NULL, PropertyArray[*SessionCount], EVENT_TRACE_CONTROL_QUERY, Ansi);
+        if (Error == ERROR_SUCCESS)
+            (*SessionCount)++;
+        else if (Error != ERROR_WMI_INSTANCE_NOT_FOUND)
+            return Error;
+    }
+
+    return Count > PropertyArrayCount ? ERROR_MORE_DATA : ERROR_SUCCESS;
 }
 
 /******************************************************************************
@@ -233,10 +523,7 @@ EtwQueryAllTracesW(
 	PULONG psessioncount 
 )
 {
-    DbgPrint("(%p, %d, %p) stub\n", parray, arraycount, psessioncount);
-
-    if (psessioncount) *psessioncount = 0;
-    return ERROR_SUCCESS;
+    return EtwpQueryAllTraces(parray, arraycount, psessioncount, FALSE);
 }
 
 /******************************************************************************
@@ -252,10 +539,7 @@ EtwQueryAllTracesA(
 	PULONG psessioncount 
 )
 {
-    DbgPrint("(%p, %d, %p) stub\n", parray, arraycount, psessioncount);
-
-    if (psessioncount) *psessioncount = 0;
-    return ERROR_SUCCESS;
+    return EtwpQueryAllTraces(parray, arraycount, psessioncount, TRUE);
 }
 
 PVOID
@@ -299,11 +583,11 @@ ULONG
 WINAPI 
 EtwUpdateTraceA(
   _In_    TRACEHANDLE             SessionHandle,
-  _In_    LPCTSTR                 SessionName,
+  _In_    LPCSTR                  SessionName,
   _Inout_ PEVENT_TRACE_PROPERTIES Properties
 )
 {
-    return ERROR_SUCCESS;	
+    return EtwpControlTraceA(SessionHandle, SessionName, Properties, EVENT_TRACE_CONTROL_UPDATE);
 }
 
 ULONG 
@@ -314,16 +598,16 @@ EtwUpdateTraceW(
   _Inout_ PEVENT_TRACE_PROPERTIES Properties
 )
 {
-    return ERROR_SUCCESS;	
+    return EtwpControlTraceW(SessionHandle, SessionName, Properties, EVENT_TRACE_CONTROL_UPDATE);
 }
 
 ULONG WINAPI EtwStopTraceA(
   _In_  TRACEHANDLE             SessionHandle,
-  _In_  LPCTSTR                 SessionName,
+  _In_  LPCSTR                  SessionName,
   _Out_ PEVENT_TRACE_PROPERTIES Properties
 )
 {
-    return ERROR_SUCCESS;	
+    return EtwpControlTraceA(SessionHandle, SessionName, Properties, EVENT_TRACE_CONTROL_STOP);
 }
 
 ULONG WINAPI EtwStopTraceW(
@@ -332,18 +616,18 @@ ULONG WINAPI EtwStopTraceW(
   _Out_ PEVENT_TRACE_PROPERTIES Properties
 )
 {
-    return ERROR_SUCCESS;	
+    return EtwpControlTraceW(SessionHandle, SessionName, Properties, EVENT_TRACE_CONTROL_STOP);
 }
 
 ULONG 
 WINAPI 
 EtwQueryTraceA(
   _In_    TRACEHANDLE             SessionHandle,
-  _In_    LPCTSTR                 SessionName,
+  _In_    LPCSTR                  SessionName,
   _Inout_ PEVENT_TRACE_PROPERTIES Properties
 )
 {
-    return ERROR_SUCCESS;	
+    return EtwpControlTraceA(SessionHandle, SessionName, Properties, EVENT_TRACE_CONTROL_QUERY);
 }
 
 ULONG 
@@ -354,18 +638,18 @@ EtwQueryTraceW(
   _Inout_ PEVENT_TRACE_PROPERTIES Properties
 )
 {
-    return ERROR_SUCCESS;	
+    return EtwpControlTraceW(SessionHandle, SessionName, Properties, EVENT_TRACE_CONTROL_QUERY);
 }
 
 ULONG 
 WINAPI 
 EtwFlushTraceA(
   _In_    TRACEHANDLE             SessionHandle,
-  _In_    LPCTSTR                 SessionName,
+  _In_    LPCSTR                  SessionName,
   _Inout_ PEVENT_TRACE_PROPERTIES Properties
 )
 {
-    return ERROR_SUCCESS;	
+    return EtwpControlTraceA(SessionHandle, SessionName, Properties, EVENT_TRACE_CONTROL_FLUSH);
 }
 
 ULONG WINAPI EtwFlushTraceW(
@@ -374,7 +658,7 @@ ULONG WINAPI EtwFlushTraceW(
   _Inout_ PEVENT_TRACE_PROPERTIES Properties
 )
 {
-    return ERROR_SUCCESS;	
+    return EtwpControlTraceW(SessionHandle, SessionName, Properties, EVENT_TRACE_CONTROL_FLUSH);
 }
 
 ULONG 
@@ -27,6 +27,8 @@ void load_global_options(void);
 void init_locale();
 void NTAPI RtlpInitSRWLock();
 VOID InitializeGlobalKeyedEventHandle();
+VOID NTAPI EtwpInitialize(VOID);
+VOID NTAPI EtwpShutdown(VOID);
 
 /*****************************************************
  *      DllMain
@@ -53,10 +55,12 @@ LdrInitialize(
 		RtlpInitSRWLock(NtCurrentTeb()->ProcessEnvironmentBlock);
 		RtlpInitConditionVariable(NtCurrentTeb()->ProcessEnvironmentBlock);
 		InitializeGlobalKeyedEventHandle();
+		EtwpInitialize();
     }
     else if (dwReason == DLL_PROCESS_DETACH)
     {
        //RtlpCloseKeyedEvent();
+		EtwpShutdown();
     }	
 	
     return TRUE;
@@ -408,41 +408,87 @@ NtCancelIoFileEx(
 	return NtCancelIoFile(handle, io_status);
 }
 
+static UNICODE_STRING NtDllName = RTL_CONSTANT_STRING(L"ntdll.dll");
+static ANSI_STRING NtRemoveIoCompletionExProcName = RTL_CONSTANT_STRING("NtRemoveIoCompletionEx");
+
+typedef NTSTATUS (NTAPI *PNT_REMOVE_IO_COMPLETION_EX)(HANDLE, FILE_IO_COMPLETION_INFORMATION *, ULONG,
+                                                      ULONG *, LARGE_INTEGER *, BOOLEAN);
+
+static PNT_REMOVE_IO_COMPLETION_EX pNtRemoveIoCompletionEx = NULL;
+static BOOL NtRemoveIoCompletionExResolved = FALSE;
+
+/* Dequeues packets one by one, for kernels without the batched system call */
+static
+NTSTATUS
+RemoveIoCompletionLoop(HANDLE handle, FILE_IO_COMPLETION_INFORMATION *info, ULONG count,
+                       ULONG *written, LARGE_INTEGER *timeout, BOOLEAN alertable)
+{
+    LARGE_INTEGER zero = {{0}};
+    NTSTATUS status;
+    ULONG i = 0;
+
+    *written = 0;
+
+    /* The port is signaled while it has packets, so an alertable wait can go on it */
+    if (alertable)
+    {
+        for (;;)
+        {
+            status = NtWaitForSingleObject(handle, TRUE, timeout);
+            if (status != STATUS_WAIT_0) return status;
+
+            status = NtRemoveIoCompletion(handle, &info[0].KeyContext, &info[0].ApcContext,
+                                          &info[0].IoStatusBlock, &zero);
+            if (status != STATUS_TIMEOUT) break;
+
+            /* Somebody else got the packet, wait again */
+        }
+    }
+    else
+    {
+        status = NtRemoveIoCompletion(handle, &info[0].KeyContext, &info[0].ApcContext,
+                                      &info[0].IoStatusBlock, timeout);
+    }
+
+    if (status != STATUS_SUCCESS) return status;
+
+    /* Take whatever else is already there without waiting */
+    for (i = 1; i < count; i++)
+    {
+        if (NtRemoveIoCompletion(handle, &info[i].KeyContext, &info[i].ApcContext,
+                                 &info[i].IoStatusBlock, &zero) != STATUS_SUCCESS)
+            break;
+    }
+
+    *written = i;
+    return STATUS_SUCCESS;
+}
+
 /***********************************************************************
  *             NtRemoveIoCompletionEx (NTDLL.@)
  */
 NTSTATUS WINAPI NtRemoveIoCompletionEx( HANDLE handle, FILE_IO_COMPLETION_INFORMATION *info, ULONG count,
                                         ULONG *written, LARGE_INTEGER *timeout, BOOLEAN alertable )
 {
-    NTSTATUS status;
-    ULONG i = 0;
-	PVOID CompletionKey = 0;
-	PVOID CompletionValue = 0;
-	PIO_STATUS_BLOCK IoStatusBlock = {0};
+    PVOID NtdllHandle;
 
-    for (;;)
+    if (!count) return STATUS_INVALID_PARAMETER;
+
+    /* Use the kernel's batched dequeue when the system provides it */
+    if (!NtRemoveIoCompletionExResolved)
     {
-        while (i < count)
-        {
-			status = NtRemoveIoCompletion(handle, CompletionKey, CompletionValue, IoStatusBlock, timeout);			
-            if(status == STATUS_SUCCESS)
-			{
-				info[i].KeyContext             = CompletionKey;
-				info[i].ApcContext             = CompletionValue;
-				info[i].IoStatusBlock.Information = IoStatusBlock->Information;
-				info[i].IoStatusBlock.Status    = IoStatusBlock->Status;   
-			}				
-			if (status != STATUS_SUCCESS) break;
-            ++i;
-        }
-        if (i || status != STATUS_PENDING)
+        if (NT_SUCCESS(LdrGetDllHandle(NULL, NULL, &NtDllName, &NtdllHandle)))
         {
-            if (status == STATUS_PENDING) status = STATUS_SUCCESS;
-            break;
+            LdrGetProcedureAddress(NtdllHandle,
+                                   &NtRemoveIoCompletionExProcName,
+                                   0,
+                                   (PVOID*)&pNtRemoveIoCompletionEx);
         }
-        status = NtWaitForSingleObject( handle, alertable, timeout );
-        if (status != WAIT_OBJECT_0) break;
+        NtRemoveIoCompletionExResolved = TRUE;
     }
-    *written = i ? i : 1;
-    return status;
-}
\ No newline at end of file
+
+    if (pNtRemoveIoCompletionEx)
+        return pNtRemoveIoCompletionEx(handle, info, count, written, timeout, alertable);
+
+    return RemoveIoCompletionLoop(handle, info, count, written, timeout, alertable);
+}
@@ -1388,6 +1388,7 @@
 @ stdcall EtwControlTraceW(int64 wstr ptr long) 
 @ stdcall EtwCreateTraceInstanceId(ptr ptr)
 @ stdcall EtwEnableTrace(long long long ptr int64)
+@ stdcall EtwEnableTraceEx2(int64 ptr long long int64 int64 long ptr)
 @ stdcall EtwEnumerateTraceGuids(ptr long ptr) 
 @ stdcall EtwFlushTraceA(int64 str ptr)
 @ stdcall EtwFlushTraceW(int64 wstr ptr)
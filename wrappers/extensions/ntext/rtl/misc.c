@@ -50,7 +50,8 @@ RtlRemovePrivileges(
 }
 
 // Required for cabinet.dll Windows 8, which unlocks an useful, next-generation compression API used by programs.
-// Why I think it is fine: The extra parameter "WorkSpace" is application-allocated. The non-Ex API allocates the size automatically and frees automatically. So, only very slight memory penalties exist. The application eventually frees the buffer when it finishes it's decompression operations, so no behavior changes.
+// The workspace is application-allocated, with the fragment workspace size from RtlGetCompressionWorkSpaceSize.
+// XPRESS Huffman keeps its decoding tables there, so handing it on saves RtlDecompressBuffer an allocation per call.
 NTSTATUS 
 NTAPI 
 RtlDecompressBufferEx(
@@ -62,5 +63,8 @@ RtlDecompressBufferEx(
 	PULONG FinalUncompressedSize, 
 	PVOID  WorkSpace
 ) {
-    return RtlDecompressBuffer(CompressionFormat, UncompressedBuffer, UncompressedBufferSize, CompressedBuffer, CompressedBufferSize, FinalUncompressedSize);
+    if (!WorkSpace)
+        return RtlDecompressBuffer(CompressionFormat, UncompressedBuffer, UncompressedBufferSize, CompressedBuffer, CompressedBufferSize, FinalUncompressedSize);
+
+    return RtlDecompressFragment(CompressionFormat, UncompressedBuffer, UncompressedBufferSize, CompressedBuffer, CompressedBufferSize, 0, FinalUncompressedSize, WorkSpace);
 }
\ No newline at end of file
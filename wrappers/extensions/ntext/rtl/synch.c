@@ -121,10 +121,13 @@ RtlpCloseKeyedEvent(VOID)
     GlobalKeyedEventHandle = NULL;
 }
 
+static VOID KexRtlpAllocateWoaHashTable(VOID);
+
 static DWORD NTAPI
 RtlpInitializeWaitOnAddressKeyedEvent( RTL_RUN_ONCE *once, void *param, void **context )
 {
     NtCreateKeyedEvent(&WaitOnAddressKeyedEventHandle, GENERIC_READ|GENERIC_WRITE, NULL, 0);
+    KexRtlpAllocateWoaHashTable();
 	return TRUE; 
 }
 
@@ -1780,22 +1783,37 @@ typedef struct _KEX_RTL_WAIT_ON_ADDRESS_WAIT_BLOCK *PKEX_RTL_WAIT_ON_ADDRESS_WAI
 typedef struct _KEX_RTL_WAIT_ON_ADDRESS_WAIT_BLOCK {
 	//
 	// The address that the thread is waiting on.
+	// The address of the wait block itself is the key the thread waits for
+	// on the wait-on-address keyed event, so no kernel object is created
+	// per wait.
 	//
 	PVOID								Address;
 
 	//
-	// The event handle upon which this thread is waiting.
+	// Links the waiters on the same address together, in the order they
+	// started waiting. The first waiter of an address is the chain head,
+	// and only the chain head is linked into the hash bucket.
 	//
-	HANDLE								EventHandle;
+	LIST_ENTRY							WaitListEntry;
+	LIST_ENTRY							ChainListEntry;
 
 	//
-	// Links to the next and previous RTL_WAIT_ON_ADDRESS_WAIT_BLOCK structure
-	// in the linked list.
+	// Wakers collect the wait blocks they removed from the bucket here, so
+	// they can release them once the bucket lock is no longer held.
+	//
+	PKEX_RTL_WAIT_ON_ADDRESS_WAIT_BLOCK	NextWake;
+
+	BOOLEAN								IsChainHead;
+
 	//
-	PKEX_RTL_WAIT_ON_ADDRESS_WAIT_BLOCK Next;
-	PKEX_RTL_WAIT_ON_ADDRESS_WAIT_BLOCK Previous;
+	// Set by the waker when it took the wait block off the bucket. A waiter
+	// which timed out in the meantime must then consume the release.
+	//
+	volatile BOOLEAN					Removed;
 } KEX_RTL_WAIT_ON_ADDRESS_WAIT_BLOCK;
 
+#define KexRtlWoaCacheLine 64
+
 typedef struct _KEX_RTL_WAIT_ON_ADDRESS_HASH_BUCKET {
 	//
 	// Locks the hash bucket. Threads calling WoA or one of the wake functions
@@ -1805,23 +1823,77 @@ typedef struct _KEX_RTL_WAIT_ON_ADDRESS_HASH_BUCKET {
 	RTL_SRWLOCK							Lock;
 
 	//
-	// This item will be NULL if no threads are waiting on the addresses that
+	// List of the chain heads, one per address somebody waits on.
+	// It is empty if no threads are waiting on the addresses that
 	// fall under this hash bucket.
 	//
-	PKEX_RTL_WAIT_ON_ADDRESS_WAIT_BLOCK	WaitBlocks;
+	LIST_ENTRY							Chains;
+
+	//
+	// Each bucket gets its own cache line, so that waits on unrelated
+	// addresses don't bounce the same line between processors.
+	//
+	UCHAR								Padding[KexRtlWoaCacheLine - sizeof(RTL_SRWLOCK) - sizeof(LIST_ENTRY)];
 } KEX_RTL_WAIT_ON_ADDRESS_HASH_BUCKET, *PKEX_RTL_WAIT_ON_ADDRESS_HASH_BUCKET;
 
+C_ASSERT(sizeof(KEX_RTL_WAIT_ON_ADDRESS_HASH_BUCKET) == KexRtlWoaCacheLine);
+
 //
-// 128 entries is what's used in Windows 8.
-// Perhaps it's a little excessive.
-// The size of this array can be freely adjusted here. The code that uses it
-// will automatically adapt to the changed size.
-// If you change it, it must remain a power of two. Otherwise, the code that
-// hashes addresses will become larger and slower by more than a factor of 2.
-// demo: https://godbolt.org/z/K9q9KheYj
+// 128 entries is what's used in Windows 8. We use that many per processor,
+// up to a limit, since the number of contended addresses grows with the
+// number of threads running at the same time.
+// Both limits must remain powers of two, the hash is masked rather than
+// divided.
+//
+#define KexRtlWoaMinHashEntries 128
+#define KexRtlWoaMaxHashEntries 4096
+
+static DECLSPEC_ALIGN(64) KEX_RTL_WAIT_ON_ADDRESS_HASH_BUCKET KexRtlWaitOnAddressStaticTable[KexRtlWoaMinHashEntries];
+static PKEX_RTL_WAIT_ON_ADDRESS_HASH_BUCKET KexRtlWaitOnAddressHashTable = NULL;
+static ULONG KexRtlWoaHashMask = 0;
+
 //
-#define KexRtlWoaHashEntries 32 // Must be a power of two.
-static KEX_RTL_WAIT_ON_ADDRESS_HASH_BUCKET KexRtlWaitOnAddressHashTable[KexRtlWoaHashEntries] = {0};
+// Called once, from RtlpInitializeWaitOnAddressKeyedEvent.
+//
+static VOID KexRtlpAllocateWoaHashTable(VOID)
+{
+	PKEX_RTL_WAIT_ON_ADDRESS_HASH_BUCKET Table;
+	ULONG Entries;
+	ULONG Index;
+
+	Entries = KexRtlWoaMinHashEntries;
+	while (Entries < KexRtlWoaMaxHashEntries &&
+		   Entries < KexRtlWoaMinHashEntries * NtCurrentTeb()->ProcessEnvironmentBlock->NumberOfProcessors) {
+		Entries <<= 1;
+	}
+
+	//
+	// The process heap only guarantees 8 or 16 byte alignment, allocate one
+	// more bucket so the table can start on a cache line.
+	//
+
+	Table = NULL;
+
+	if (Entries > KexRtlWoaMinHashEntries) {
+		Table = RtlAllocateHeap(RtlGetProcessHeap(), 0, (Entries + 1) * sizeof(*Table));
+	}
+
+	if (Table == NULL) {
+		Table = KexRtlWaitOnAddressStaticTable;
+		Entries = KexRtlWoaMinHashEntries;
+	} else {
+		Table = (PKEX_RTL_WAIT_ON_ADDRESS_HASH_BUCKET)
+			(((ULONG_PTR) Table + KexRtlWoaCacheLine - 1) & ~((ULONG_PTR) KexRtlWoaCacheLine - 1));
+	}
+
+	for (Index = 0; Index < Entries; ++Index) {
+		RtlInitializeSRWLock(&Table[Index].Lock);
+		InitializeListHead(&Table[Index].Chains);
+	}
+
+	KexRtlWoaHashMask = Entries - 1;
+	KexRtlWaitOnAddressHashTable = Table;
+}
 
 #pragma warning(disable:4715) // not all control paths return a value
 static inline BOOLEAN KexRtlpEqualVolatileMemory(
@@ -1842,42 +1914,64 @@ static inline BOOLEAN KexRtlpEqualVolatileMemory(
 static FORCEINLINE PKEX_RTL_WAIT_ON_ADDRESS_HASH_BUCKET KexRtlpGetWoaHashBucket(
 	IN	volatile VOID	*Address)
 {
-    return &KexRtlWaitOnAddressHashTable[
-        (((ULONG_PTR) Address) >> 4) & (KexRtlWoaHashEntries - 1)]; 
-// Improved from VxKex by using & operation instead of % operation, improving performance for debug builds and likely ancient compilers.
+	ULONG_PTR Value = (ULONG_PTR) Address;
+
+	//
+	// Fold in the higher bits too, so that arrays of small objects spread
+	// over the whole table.
+	//
+	return &KexRtlWaitOnAddressHashTable[((Value >> 4) ^ (Value >> 12)) & KexRtlWoaHashMask];
 }
 
 //
+// Finds the chain of waiters for an address.
 // This function must be called while the hash bucket is locked.
 //
-static inline VOID KexRtlpRemoveWoaWaitBlock(
+static inline PKEX_RTL_WAIT_ON_ADDRESS_WAIT_BLOCK KexRtlpFindWoaChain(
 	IN	PKEX_RTL_WAIT_ON_ADDRESS_HASH_BUCKET	HashBucket,
-	IN	PKEX_RTL_WAIT_ON_ADDRESS_WAIT_BLOCK		WaitBlock)
+	IN	volatile VOID							*Address)
 {
-	if (WaitBlock->Previous == NULL) {
-		// this is a signal that we do NOT touch anything
-		return;
-	} else if (WaitBlock->Next == WaitBlock) {
-		// this wait block is the only entry in the list
-		HashBucket->WaitBlocks = NULL;
-	} else {
-		// there's more than one wait block in the list so we have to
-		// remove it "properly"
+	PLIST_ENTRY Entry;
+	PKEX_RTL_WAIT_ON_ADDRESS_WAIT_BLOCK ChainHead;
 
-		if (WaitBlock == HashBucket->WaitBlocks) {
-			// this wait block is at the beginning so we have to update
-			// the pointer in the hash bucket
-			HashBucket->WaitBlocks = WaitBlock->Next;
-		}
+	for (Entry = HashBucket->Chains.Flink; Entry != &HashBucket->Chains; Entry = Entry->Flink) {
+		ChainHead = CONTAINING_RECORD(Entry, KEX_RTL_WAIT_ON_ADDRESS_WAIT_BLOCK, ChainListEntry);
 
-		WaitBlock->Previous->Next = WaitBlock->Next;
-		WaitBlock->Next->Previous = WaitBlock->Previous;
+		if (ChainHead->Address == Address) {
+			return ChainHead;
+		}
 	}
+
+	return NULL;
 }
 
-#  define PopulationCount16 __popcnt16
-#  define PopulationCount __popcnt
-#  define PopulationCount64 __popcnt64
+//
+// This function must be called while the hash bucket is locked.
+//
+static inline VOID KexRtlpRemoveWoaWaitBlock(
+	IN	PKEX_RTL_WAIT_ON_ADDRESS_WAIT_BLOCK		WaitBlock)
+{
+	PKEX_RTL_WAIT_ON_ADDRESS_WAIT_BLOCK NextWaitBlock;
+
+	if (!WaitBlock->IsChainHead) {
+		RemoveEntryList(&WaitBlock->WaitListEntry);
+	} else if (IsListEmpty(&WaitBlock->WaitListEntry)) {
+		// this wait block is the only waiter on its address
+		RemoveEntryList(&WaitBlock->ChainListEntry);
+	} else {
+		// the next waiter in line takes our place in the hash bucket
+		NextWaitBlock = CONTAINING_RECORD(WaitBlock->WaitListEntry.Flink,
+										  KEX_RTL_WAIT_ON_ADDRESS_WAIT_BLOCK,
+										  WaitListEntry);
+
+		RemoveEntryList(&WaitBlock->WaitListEntry);
+		NextWaitBlock->IsChainHead = TRUE;
+		InsertHeadList(&WaitBlock->ChainListEntry, &NextWaitBlock->ChainListEntry);
+		RemoveEntryList(&WaitBlock->ChainListEntry);
+	}
+
+	WaitBlock->Removed = TRUE;
+}
 
 //
 // This function is the implementation of the WaitOnAddress extended API.
@@ -1891,24 +1985,20 @@ NTSTATUS NTAPI RtlWaitOnAddress(
 {
 	NTSTATUS Status;
 	PKEX_RTL_WAIT_ON_ADDRESS_HASH_BUCKET HashBucket;
+	PKEX_RTL_WAIT_ON_ADDRESS_WAIT_BLOCK ChainHead;
 	KEX_RTL_WAIT_ON_ADDRESS_WAIT_BLOCK WaitBlock;
 
-	//ASSERT (PopulationCount(ARRAYSIZE(KexRtlWaitOnAddressHashTable)) == 1);
-	// ASSERT (Address != NULL);
-	// ASSERT (CompareAddress != NULL);
-	
 	if (Address == NULL || CompareAddress == NULL)
 	    return STATUS_INVALID_PARAMETER;
 
-	// ASSERT (AddressSize == 1 || AddressSize == 2 ||
-			// AddressSize == 4 || AddressSize == 8);
-
     if (AddressSize != 4 && AddressSize != 2 &&
         AddressSize != 1 && AddressSize != 8) {
 
         return STATUS_INVALID_PARAMETER;
     }
 
+	RtlRunOnceExecuteOnce(&init_once_woa, RtlpInitializeWaitOnAddressKeyedEvent, NULL, NULL);
+
 	//
 	// Figure out which hash bucket we belong in.
 	//
@@ -1929,71 +2019,61 @@ NTSTATUS NTAPI RtlWaitOnAddress(
 	}
 
 	//
-	// The values are different.
-	// Create the event upon which we will wait.
-	//
-
-	Status = NtCreateEvent(
-		&WaitBlock.EventHandle,
-		SYNCHRONIZE | EVENT_MODIFY_STATE,
-		NULL,
-		NotificationEvent,
-		FALSE);
-
-	//ASSERT (NT_SUCCESS(Status));
-
-	if (!NT_SUCCESS(Status)) {
-		RtlReleaseSRWLockExclusive(&HashBucket->Lock);
-		return Status;
-	}
-
-	//
-	// Add ourselves into the linked list.
+	// Add ourselves to the end of the chain for this address, or start
+	// a new one.
 	//
 
 	WaitBlock.Address = (PVOID) Address;
+	WaitBlock.Removed = FALSE;
+
+	ChainHead = KexRtlpFindWoaChain(HashBucket, Address);
 
-	if (HashBucket->WaitBlocks == NULL) {
-		// No existing wait blocks.
-		WaitBlock.Previous = &WaitBlock;
-		WaitBlock.Next = &WaitBlock;
-		HashBucket->WaitBlocks = &WaitBlock;
+	if (ChainHead == NULL) {
+		WaitBlock.IsChainHead = TRUE;
+		InitializeListHead(&WaitBlock.WaitListEntry);
+		InsertTailList(&HashBucket->Chains, &WaitBlock.ChainListEntry);
 	} else {
-		// One or more wait blocks already exist.
-		// Add ourselves to the end of the list.
-		WaitBlock.Previous = HashBucket->WaitBlocks->Previous;
-		WaitBlock.Next = HashBucket->WaitBlocks;
-		HashBucket->WaitBlocks->Previous->Next = &WaitBlock;
-		HashBucket->WaitBlocks->Previous = &WaitBlock;
+		WaitBlock.IsChainHead = FALSE;
+		InsertTailList(&ChainHead->WaitListEntry, &WaitBlock.WaitListEntry);
 	}
 
+	RtlReleaseSRWLockExclusive(&HashBucket->Lock);
+
 	//
 	// Wait.
 	//
 
-	RtlReleaseSRWLockExclusive(&HashBucket->Lock);
-
-	Status = NtWaitForSingleObject(
-		WaitBlock.EventHandle,
+	Status = NtWaitForKeyedEvent(
+		WaitOnAddressKeyedEventHandle,
+		&WaitBlock,
 		FALSE,
-		Timeout);
-
-	//ASSERT (NT_SUCCESS(Status));
+		(PLARGE_INTEGER) Timeout);
 
-	//
-	// The thread that woke us up is in charge of removing us from the
-	// list. However, if we timed out, there is no such thread, so if the
-	// status from NtWaitForSingleObject is STATUS_TIMEOUT or some other
-	// error code, we have to do that ourselves.
-	//
+	if (Status != STATUS_SUCCESS) {
+		//
+		// The thread that wakes us up is in charge of removing us from the
+		// list. However, if we timed out, there may be no such thread.
+		//
 
-	if (Status == STATUS_TIMEOUT || !NT_SUCCESS(Status)) {
 		RtlAcquireSRWLockExclusive(&HashBucket->Lock);
-		KexRtlpRemoveWoaWaitBlock(HashBucket, &WaitBlock);
+
+		if (!WaitBlock.Removed) {
+			KexRtlpRemoveWoaWaitBlock(&WaitBlock);
+			RtlReleaseSRWLockExclusive(&HashBucket->Lock);
+			return Status;
+		}
+
 		RtlReleaseSRWLockExclusive(&HashBucket->Lock);
+
+		//
+		// A waker got to us first and is about to release our key. It
+		// can't go away before it has paired with a waiter, so take it.
+		//
+
+		NtWaitForKeyedEvent(WaitOnAddressKeyedEventHandle, &WaitBlock, FALSE, NULL);
+		Status = STATUS_SUCCESS;
 	}
 
-	NtClose(WaitBlock.EventHandle);
 	return Status;
 }
 
@@ -2008,80 +2088,75 @@ static VOID RtlpWakeByAddress(
 	IN	BOOLEAN			WakeAll)
 {
 	PKEX_RTL_WAIT_ON_ADDRESS_HASH_BUCKET HashBucket;
+	PKEX_RTL_WAIT_ON_ADDRESS_WAIT_BLOCK ChainHead;
 	PKEX_RTL_WAIT_ON_ADDRESS_WAIT_BLOCK WaitBlock;
+	PKEX_RTL_WAIT_ON_ADDRESS_WAIT_BLOCK WakeList;
+	PLIST_ENTRY Entry;
+
+	//
+	// Nobody ever waited in this process, so there's nobody to wake.
+	//
+
+	if (KexRtlWaitOnAddressHashTable == NULL) {
+		return;
+	}
 
 	HashBucket = KexRtlpGetWoaHashBucket(Address);
 
 	RtlAcquireSRWLockExclusive(&HashBucket->Lock);
 
-	if (HashBucket->WaitBlocks == NULL) {
+	ChainHead = KexRtlpFindWoaChain(HashBucket, Address);
+
+	if (ChainHead == NULL) {
 		RtlReleaseSRWLockExclusive(&HashBucket->Lock);
 		return;
 	}
 
 	//
-	// Traverse the list starting from the beginning.
 	// The API documentation from MS states that threads are woken starting
-	// from the one that first started waiting.
+	// from the one that first started waiting, which is the chain head.
 	//
 
-	WaitBlock = HashBucket->WaitBlocks;
-
-	while (TRUE) {
-		PKEX_RTL_WAIT_ON_ADDRESS_WAIT_BLOCK NextWaitBlock;
-
-		NextWaitBlock = WaitBlock->Next;
+	if (WakeAll) {
+		//
+		// Take the whole chain off the bucket at once.
+		//
 
-		if (WaitBlock->Address == Address) {
-			NTSTATUS Status;
+		RemoveEntryList(&ChainHead->ChainListEntry);
 
-			KexRtlpRemoveWoaWaitBlock(HashBucket, WaitBlock);
+		WakeList = ChainHead;
+		WaitBlock = ChainHead;
 
-			//
-			// Signal to future invocations of KexRtlpRemoveWoaWaitBlock to tell it
-			// that we've already removed this block from the list.
-			// We need to do this due to the possibility of the following situation:
-			//   1. A thread calls WaitOnAddress with a timeout.
-			//   2. NtWaitForSingleObject returns with STATUS_TIMEOUT.
-			//   3. In between the STATUS_TIMEOUT return and when that thread removes
-			//      itself from the list, someone calls WakeByAddress and we get to
-			//      this point in the code.
-			//   4. We remove the list entry from the list.
-			//   5. The other thread that timed out removes the list entry from the
-			//      list a 2nd time and potentially causes corruption.
-			//
-			// It's a rare edge case but the cost to eliminate it is luckily very small.
-			//
-
-			WaitBlock->Previous = NULL;
-			
-			//
-			// Wake up the thread.
-			//
+		for (Entry = ChainHead->WaitListEntry.Flink; Entry != &ChainHead->WaitListEntry; Entry = Entry->Flink) {
+			WaitBlock->Removed = TRUE;
+			WaitBlock->NextWake = CONTAINING_RECORD(Entry, KEX_RTL_WAIT_ON_ADDRESS_WAIT_BLOCK, WaitListEntry);
+			WaitBlock = WaitBlock->NextWake;
+		}
 
-			Status = NtSetEvent(WaitBlock->EventHandle, NULL);
-			//ASSERT (NT_SUCCESS(Status));
+		WaitBlock->Removed = TRUE;
+		WaitBlock->NextWake = NULL;
+	} else {
+		KexRtlpRemoveWoaWaitBlock(ChainHead);
+		ChainHead->NextWake = NULL;
+		WakeList = ChainHead;
+	}
 
-			//
-			// After the call to NtSetEvent, the contents of WaitBlock should be
-			// considered undefined, since when the KexRtlWaitOnAddress call returns
-			// the contents of the stack are no longer defined.
-			//
+	RtlReleaseSRWLockExclusive(&HashBucket->Lock);
 
-			if (!WakeAll) {
-				// we only want to wake this one
-				break;
-			}
-		}
+	//
+	// Release the waiters outside of the lock. A waiter that timed out
+	// meanwhile needs the lock to find out it was removed, and releasing
+	// a keyed event blocks until the waiter is there to take it.
+	// After the release, the contents of the wait block are undefined, since
+	// the stack of the waiter is no longer ours to look at.
+	//
 
-		if (HashBucket->WaitBlocks == NULL || NextWaitBlock == HashBucket->WaitBlocks) {
-			break;
-		}
+	while (WakeList != NULL) {
+		WaitBlock = WakeList;
+		WakeList = WaitBlock->NextWake;
 
-		WaitBlock = NextWaitBlock;
+		NtReleaseKeyedEvent(WaitOnAddressKeyedEventHandle, WaitBlock, FALSE, NULL);
 	}
-
-	RtlReleaseSRWLockExclusive(&HashBucket->Lock);
 }
 
 VOID NTAPI RtlWakeAddressSingle(
@@ -105,6 +105,30 @@ struct timer_queue
 #define THREADPOOL_WORKER_TIMEOUT 5000
 #define MAXIMUM_WAITQUEUE_OBJECTS (MAXIMUM_WAIT_OBJECTS - 1)
 
+/* Number of priority classes, order matches TP_CALLBACK_PRIORITY - high, normal, low. */
+#define THREADPOOL_PRIORITIES 3
+/* Workers beyond this count have no local queue and only use the global queues. */
+#define THREADPOOL_LOCAL_QUEUES 64
+/* Capacity of a local queue, must be a power of two. */
+#define THREADPOOL_DEQUE_SIZE 256
+
+struct threadpool_object;
+
+/* Work-stealing deque of a worker thread (Chase-Lev). Only the owning worker
+ * pushes and pops at the bottom, other workers steal from the top. */
+struct threadpool_deque
+{
+    volatile ULONG          top;
+    volatile ULONG          bottom;
+    struct threadpool_object *items[THREADPOOL_DEQUE_SIZE];
+};
+
+struct threadpool_local_queue
+{
+    BOOL                    in_use;     /* locked via pool->cs */
+    struct threadpool_deque prio[THREADPOOL_PRIORITIES];
+};
+
 /* internal threadpool representation */
 struct threadpool
 {
@@ -112,14 +136,24 @@ struct threadpool
     LONG                    objcount;
     BOOL                    shutdown;
     RTL_CRITICAL_SECTION        cs;
-    /* Pools of work items, locked via .cs, order matches TP_CALLBACK_PRIORITY - high, normal, low. */
-    struct list             pools[3];
-    RTL_CONDITION_VARIABLE  update_event;
+    /* Global injection queues for newly submitted work items, one per priority.
+     * Lock free, workers move whole batches from here into their local queue. */
+    SLIST_HEADER            injection[THREADPOOL_PRIORITIES];
+    /* Local queues of the workers, allocated on first use and kept until the
+     * pool is destroyed, so they can be stolen from without locking. */
+    struct threadpool_local_queue *local_queues[THREADPOOL_LOCAL_QUEUES];
+    LONG                    num_local_queues;
+    /* Queued objects, and queued objects plus running callbacks. */
+    LONG                    num_queued;
+    LONG                    num_busy_workers;
+    /* Idle workers wait on the semaphore, submitters claim one from num_idle_workers
+     * before releasing it. */
+    LONG                    num_idle_workers;
+    HANDLE                  idle_semaphore;
     /* information about worker threads, locked via .cs */
     int                     max_workers;
     int                     min_workers;
     int                     num_workers;
-    int                     num_busy_workers;
     HANDLE                  compl_port;
     TP_POOL_STACK_INFORMATION stack_info;
     /* One-Core-API extension to add ThreadBasePriority */
@@ -141,6 +175,14 @@ struct io_completion
     ULONG_PTR cvalue;
 };
 
+/* 4-ary min-heap of timers or waits, ordered on their timeout */
+struct timeout_heap
+{
+    struct threadpool_object **objects;
+    unsigned int            count;
+    unsigned int            capacity;
+};
+
 /* internal threadpool object representation */
 struct threadpool_object
 {
@@ -160,8 +202,11 @@ struct threadpool_object
     /* information about the group, locked via .group->cs */
     struct list             group_entry;
     BOOL                    is_group_member;
-    /* information about the pool, locked via .pool->cs */
-    struct list             pool_entry;
+    /* link in the global injection queue while queued there */
+    SLIST_ENTRY             queue_entry;
+    /* information about the pool, locked via .lock */
+    RTL_SRWLOCK             lock;
+    BOOL                    queued;
     RTL_CONDITION_VARIABLE  finished_event;
     RTL_CONDITION_VARIABLE  group_finished_event;
 	HANDLE                  completed_event;
@@ -186,7 +231,7 @@ struct threadpool_object
             /* information about the timer, locked via timerqueue.cs */
             BOOL            timer_initialized;
             BOOL            timer_pending;
-            struct list     timer_entry;
+            unsigned int    timer_index;
             BOOL            timer_set;
             ULONGLONG       timeout;
             LONG            period;
@@ -201,6 +246,10 @@ struct threadpool_object
             BOOL            wait_pending;
             struct list     wait_entry;
             ULONGLONG       timeout;
+            /* wait completion packet, when the wait queue uses them */
+            HANDLE          packet;
+            BOOL            packet_busy;
+            unsigned int    timeout_index;
             HANDLE          handle;
 			DWORD           flags;
             RTL_WAITORTIMERCALLBACKFUNC rtl_callback;
@@ -208,7 +257,7 @@ struct threadpool_object
         struct
         {
             PTP_IO_CALLBACK callback;
-            /* locked via .pool->cs */
+            /* locked via .lock */
             unsigned int    pending_count, skipped_count, completion_count, completion_max;
             BOOL            shutting_down;
             struct io_completion *completions;
@@ -252,7 +301,7 @@ static struct
     RTL_CRITICAL_SECTION        cs;
     LONG                    objcount;
     BOOL                    thread_running;
-    struct list             pending_timers;
+    struct timeout_heap     pending;
     RTL_CONDITION_VARIABLE  update_event;
 }
 timerqueue =
@@ -260,7 +309,7 @@ timerqueue =
     { &timerqueue_debug, -1, 0, 0, 0, 0 },      /* cs */
     0,                                          /* objcount */
     FALSE,                                      /* thread_running */
-    LIST_INIT( timerqueue.pending_timers ),     /* pending_timers */
+    { NULL, 0, 0 },                             /* pending */
     RTL_CONDITION_VARIABLE_INIT                 /* update_event */
 };
 
@@ -279,12 +328,21 @@ static struct
     RTL_CRITICAL_SECTION        cs;
     LONG                    num_buckets;
     struct list             buckets;
+    /* used instead of the buckets when the system has wait completion packets */
+    LONG                    objcount;
+    BOOL                    thread_running;
+    HANDLE                  port;
+    struct timeout_heap     timeouts;
 }
 waitqueue =
 {
     { &waitqueue_debug, -1, 0, 0, 0, 0 },       /* cs */
     0,                                          /* num_buckets */
-    LIST_INIT( waitqueue.buckets )              /* buckets */
+    LIST_INIT( waitqueue.buckets ),             /* buckets */
+    0,                                          /* objcount */
+    FALSE,                                      /* thread_running */
+    NULL,                                       /* port */
+    { NULL, 0, 0 }                              /* timeouts */
 };
 
 static RTL_CRITICAL_SECTION_DEBUG waitqueue_debug =
@@ -372,9 +430,12 @@ static inline struct threadpool_instance *impl_from_TP_CALLBACK_INSTANCE( TP_CAL
 
 static void CALLBACK threadpool_worker_proc( void *param );
 static void tp_object_submit( struct threadpool_object *object, BOOL signaled );
+static BOOL tp_object_submit_locked( struct threadpool_object *object, BOOL signaled );
+static void tp_object_prio_queue( struct threadpool_object *object );
 static void tp_object_execute( struct threadpool_object *object, BOOL wait_thread );
 static void tp_object_prepare_shutdown( struct threadpool_object *object );
 static BOOL tp_object_release( struct threadpool_object *object );
+static NTSTATUS tp_new_worker_thread( struct threadpool *pool );
 static struct threadpool *default_threadpool = NULL;
 
 static BOOL array_reserve(void **elements, unsigned int *capacity, unsigned int count, unsigned int size)
@@ -759,15 +820,175 @@ static struct timer_queue *get_timer_queue(HANDLE TimerQueue)
     }
 }
 
+/* Pending timers and waits with a timeout are kept in 4-ary heaps, so arming
+ * and cancelling them is O(log n) instead of a sorted list insertion. A heap
+ * is protected by the lock of the queue it belongs to. */
+#define TIMEOUT_HEAP_ARITY 4
+#define TIMEOUT_HEAP_NONE  (~0u)
+
+static inline ULONGLONG timeout_heap_key( struct threadpool_object *object )
+{
+    return object->type == TP_OBJECT_TYPE_TIMER ? object->u.timer.timeout : object->u.wait.timeout;
+}
+
+static inline void timeout_heap_set( struct timeout_heap *heap, unsigned int index,
+                                     struct threadpool_object *object )
+{
+    heap->objects[index] = object;
+    if (object->type == TP_OBJECT_TYPE_TIMER)
+        object->u.timer.timer_index = index;
+    else
+        object->u.wait.timeout_index = index;
+}
+
+static BOOL timeout_heap_reserve( struct timeout_heap *heap, unsigned int count )
+{
+    if (!heap->objects)
+    {
+        heap->objects = RtlAllocateHeap( RtlProcessHeap(), 0, 16 * sizeof(*heap->objects) );
+        heap->capacity = heap->objects ? 16 : 0;
+    }
+    return heap->objects &&
+           array_reserve( (void **)&heap->objects, &heap->capacity, count, sizeof(*heap->objects) );
+}
+
+static void timeout_heap_sift_up( struct timeout_heap *heap, unsigned int index )
+{
+    struct threadpool_object *object = heap->objects[index];
+
+    while (index)
+    {
+        unsigned int parent = (index - 1) / TIMEOUT_HEAP_ARITY;
+        if (timeout_heap_key( heap->objects[parent] ) <= timeout_heap_key( object ))
+            break;
+        timeout_heap_set( heap, index, heap->objects[parent] );
+        index = parent;
+    }
+    timeout_heap_set( heap, index, object );
+}
+
+static void timeout_heap_sift_down( struct timeout_heap *heap, unsigned int index )
+{
+    struct threadpool_object *object = heap->objects[index];
+
+    for (;;)
+    {
+        unsigned int child = index * TIMEOUT_HEAP_ARITY + 1, last, smallest, i;
+
+        if (child >= heap->count)
+            break;
+
+        last = min( child + TIMEOUT_HEAP_ARITY, heap->count );
+        for (smallest = child, i = child + 1; i < last; i++)
+        {
+            if (timeout_heap_key( heap->objects[i] ) < timeout_heap_key( heap->objects[smallest] ))
+                smallest = i;
+        }
+
+        if (timeout_heap_key( object ) <= timeout_heap_key( heap->objects[smallest] ))
+            break;
+        timeout_heap_set( heap, index, heap->objects[smallest] );
+        index = smallest;
+    }
+    timeout_heap_set( heap, index, object );
+}
+
+/* Room for every object is reserved when it's locked to its queue, so
+ * inserting never fails. */
+static void timeout_heap_insert( struct timeout_heap *heap, struct threadpool_object *object )
+{
+    ASSERT( heap->count < heap->capacity );
+
+    heap->objects[heap->count] = object;
+    timeout_heap_sift_up( heap, heap->count++ );
+}
+
+static void timeout_heap_remove( struct timeout_heap *heap, unsigned int index )
+{
+    struct threadpool_object *last;
+
+    ASSERT( index < heap->count );
+
+    last = heap->objects[--heap->count];
+    if (index == heap->count)
+        return;
+
+    timeout_heap_set( heap, index, last );
+    if (index && timeout_heap_key( heap->objects[(index - 1) / TIMEOUT_HEAP_ARITY] ) > timeout_heap_key( last ))
+        timeout_heap_sift_up( heap, index );
+    else
+        timeout_heap_sift_down( heap, index );
+}
+
+static void timerqueue_add_timer( struct threadpool_object *timer )
+{
+    ASSERT( !timer->u.timer.timer_pending );
+
+    timeout_heap_insert( &timerqueue.pending, timer );
+    timer->u.timer.timer_pending = TRUE;
+}
+
+static void timerqueue_remove_timer( struct threadpool_object *timer )
+{
+    ASSERT( timer->u.timer.timer_pending );
+    ASSERT( timerqueue.pending.objects[timer->u.timer.timer_index] == timer );
+
+    timer->u.timer.timer_pending = FALSE;
+    timeout_heap_remove( &timerqueue.pending, timer->u.timer.timer_index );
+}
+
+/* Earliest deadline (timeout plus window length) of the subtree at index.
+ * Subtrees whose timeouts are all past the current bound can't lower it. */
+static ULONGLONG timerqueue_heap_deadline( unsigned int index, ULONGLONG upper )
+{
+    struct threadpool_object *timer;
+    ULONGLONG deadline;
+    unsigned int i;
+
+    if (index >= timerqueue.pending.count)
+        return upper;
+
+    timer = timerqueue.pending.objects[index];
+    if (timer->u.timer.timeout >= upper)
+        return upper;
+
+    deadline = timer->u.timer.timeout + (ULONGLONG)timer->u.timer.window_length * 10000;
+    if (deadline < upper)
+        upper = deadline;
+
+    for (i = 1; i <= TIMEOUT_HEAP_ARITY; i++)
+        upper = timerqueue_heap_deadline( index * TIMEOUT_HEAP_ARITY + i, upper );
+    return upper;
+}
+
+/* Latest timeout of the subtree at index which is still before upper. */
+static ULONGLONG timerqueue_heap_latest( unsigned int index, ULONGLONG upper, ULONGLONG lower )
+{
+    struct threadpool_object *timer;
+    unsigned int i;
+
+    if (index >= timerqueue.pending.count)
+        return lower;
+
+    timer = timerqueue.pending.objects[index];
+    if (timer->u.timer.timeout >= upper)
+        return lower;
+
+    if (lower == TIMEOUT_INFINITE || timer->u.timer.timeout > lower)
+        lower = timer->u.timer.timeout;
+
+    for (i = 1; i <= TIMEOUT_HEAP_ARITY; i++)
+        lower = timerqueue_heap_latest( index * TIMEOUT_HEAP_ARITY + i, upper, lower );
+    return lower;
+}
+
 /***********************************************************************
  *           timerqueue_thread_proc    (internal)
  */
 static void CALLBACK timerqueue_thread_proc( void *param )
 {
-    ULONGLONG timeout_lower, timeout_upper, new_timeout;
-    struct threadpool_object *other_timer;
+    ULONGLONG timeout_lower, timeout_upper;
     LARGE_INTEGER now, timeout;
-    struct list *ptr;
 
     DbgPrint( "starting timer queue thread\n" );
 	set_thread_name(L"wineoca_threadpool_timerqueue");
@@ -778,17 +999,16 @@ static void CALLBACK timerqueue_thread_proc( void *param )
         NtQuerySystemTime( &now );
 
         /* Check for expired timers. */
-        while ((ptr = list_head( &timerqueue.pending_timers )))
+        while (timerqueue.pending.count)
         {
-            struct threadpool_object *timer = LIST_ENTRY( ptr, struct threadpool_object, u.timer.timer_entry );
+            struct threadpool_object *timer = timerqueue.pending.objects[0];
             ASSERT( timer->type == TP_OBJECT_TYPE_TIMER );
             ASSERT( timer->u.timer.timer_pending );
             if (timer->u.timer.timeout > now.QuadPart)
                 break;
 
             /* Queue a new callback in one of the worker threads. */
-            list_remove( &timer->u.timer.timer_entry );
-            timer->u.timer.timer_pending = FALSE;
+            timerqueue_remove_timer( timer );
             tp_object_submit( timer, FALSE );
 
             /* Insert the timer back into the queue, except it's marked for shutdown. */
@@ -798,34 +1018,15 @@ static void CALLBACK timerqueue_thread_proc( void *param )
                 if (timer->u.timer.timeout <= now.QuadPart)
                     timer->u.timer.timeout = now.QuadPart + 1;
 
-                LIST_FOR_EACH_ENTRY( other_timer, &timerqueue.pending_timers,
-                                     struct threadpool_object, u.timer.timer_entry )
-                {
-                    ASSERT( other_timer->type == TP_OBJECT_TYPE_TIMER );
-                    if (timer->u.timer.timeout < other_timer->u.timer.timeout)
-                        break;
-                }
-                list_add_before( &other_timer->u.timer.timer_entry, &timer->u.timer.timer_entry );
-                timer->u.timer.timer_pending = TRUE;
+                timerqueue_add_timer( timer );
             }
         }
 
-        timeout_lower = TIMEOUT_INFINITE;
-        timeout_upper = TIMEOUT_INFINITE;
-
-        /* Determine next timeout and use the window length to optimize wakeup times. */
-        LIST_FOR_EACH_ENTRY( other_timer, &timerqueue.pending_timers,
-                             struct threadpool_object, u.timer.timer_entry )
-        {
-            ASSERT( other_timer->type == TP_OBJECT_TYPE_TIMER );
-            if (other_timer->u.timer.timeout >= timeout_upper)
-                break;
-
-            timeout_lower = other_timer->u.timer.timeout;
-            new_timeout   = timeout_lower + (ULONGLONG)other_timer->u.timer.window_length * 10000;
-            if (new_timeout < timeout_upper)
-                timeout_upper = new_timeout;
-        }
+        /* Determine next timeout and use the window length to optimize wakeup times:
+         * sleep until the last timer which starts before the earliest deadline, so
+         * that all timers with overlapping windows are fired in a single wakeup. */
+        timeout_upper = timerqueue_heap_deadline( 0, TIMEOUT_INFINITE );
+        timeout_lower = timerqueue_heap_latest( 0, timeout_upper, TIMEOUT_INFINITE );
 
         /* Wait for timer update events or until the next timer expires. */
         if (timerqueue.objcount)
@@ -852,6 +1053,190 @@ static void CALLBACK timerqueue_thread_proc( void *param )
     RtlExitUserThread( 0 );
 }
 
+/***********************************************************************
+ *           tp_deque_push    (internal)
+ *
+ * Pushes an object to the bottom of a local queue, only called by the
+ * owning worker. Fails if the queue is full.
+ */
+static BOOL tp_deque_push( struct threadpool_deque *deque, struct threadpool_object *object )
+{
+    ULONG bottom = deque->bottom;
+
+    if ((LONG)(bottom - deque->top) >= THREADPOOL_DEQUE_SIZE)
+        return FALSE;
+
+    deque->items[bottom & (THREADPOOL_DEQUE_SIZE - 1)] = object;
+
+    /* Publish the item before the new bottom. */
+    InterlockedExchange( (LONG *)&deque->bottom, bottom + 1 );
+    return TRUE;
+}
+
+/***********************************************************************
+ *           tp_deque_pop    (internal)
+ *
+ * Pops the most recently pushed object from a local queue, only called
+ * by the owning worker.
+ */
+static struct threadpool_object *tp_deque_pop( struct threadpool_deque *deque )
+{
+    struct threadpool_object *object;
+    ULONG bottom, top;
+
+    if ((LONG)(deque->bottom - deque->top) <= 0)
+        return NULL;
+
+    /* Reserve the bottom item before looking at top, so that a concurrent
+     * thief either sees the reservation or we see its steal. */
+    bottom = deque->bottom - 1;
+    InterlockedExchange( (LONG *)&deque->bottom, bottom );
+    top = deque->top;
+
+    if ((LONG)(bottom - top) < 0)
+    {
+        deque->bottom = top;
+        return NULL;
+    }
+
+    object = deque->items[bottom & (THREADPOOL_DEQUE_SIZE - 1)];
+    if (bottom != top)
+        return object;
+
+    /* Last item, race against the thieves for it. */
+    if ((ULONG)InterlockedCompareExchange( (LONG *)&deque->top, top + 1, top ) != top)
+        object = NULL;
+    deque->bottom = top + 1;
+    return object;
+}
+
+/***********************************************************************
+ *           tp_deque_steal    (internal)
+ *
+ * Steals the oldest object from the top of another worker's local queue.
+ */
+static struct threadpool_object *tp_deque_steal( struct threadpool_deque *deque )
+{
+    struct threadpool_object *object;
+    ULONG top, bottom;
+
+    top = deque->top;
+    MemoryBarrier();
+    bottom = deque->bottom;
+
+    if ((LONG)(bottom - top) <= 0)
+        return NULL;
+
+    object = deque->items[top & (THREADPOOL_DEQUE_SIZE - 1)];
+    if ((ULONG)InterlockedCompareExchange( (LONG *)&deque->top, top + 1, top ) != top)
+        return NULL;
+
+    return object;
+}
+
+/***********************************************************************
+ *           tp_threadpool_claim_idle    (internal)
+ *
+ * Takes one idle worker off the idle count. The caller is then responsible
+ * for releasing the idle semaphore once, to wake it up.
+ */
+static BOOL tp_threadpool_claim_idle( struct threadpool *pool )
+{
+    LONG idle = pool->num_idle_workers;
+
+    while (idle > 0)
+    {
+        LONG prev = InterlockedCompareExchange( &pool->num_idle_workers, idle - 1, idle );
+        if (prev == idle) return TRUE;
+        idle = prev;
+    }
+
+    return FALSE;
+}
+
+/***********************************************************************
+ *           tp_threadpool_signal    (internal)
+ *
+ * Called after work was queued. Wakes up an idle worker, or starts a new one
+ * if there are more queued and running callbacks than workers.
+ */
+static void tp_threadpool_signal( struct threadpool *pool )
+{
+    if (tp_threadpool_claim_idle( pool ))
+    {
+        NtReleaseSemaphore( pool->idle_semaphore, 1, NULL );
+        return;
+    }
+
+    if (pool->num_busy_workers < pool->num_workers ||
+        pool->num_workers >= pool->max_workers)
+        return;
+
+    RtlEnterCriticalSection( &pool->cs );
+    if (pool->num_busy_workers >= pool->num_workers &&
+        pool->num_workers < pool->max_workers)
+        tp_new_worker_thread( pool );
+    RtlLeaveCriticalSection( &pool->cs );
+}
+
+/***********************************************************************
+ *           tp_local_queue_attach    (internal)
+ *
+ * Assigns a free local queue to the calling worker thread. Returns NULL
+ * if all of them are taken, the worker then only uses the global queues.
+ */
+static struct threadpool_local_queue *tp_local_queue_attach( struct threadpool *pool )
+{
+    struct threadpool_local_queue *local = NULL;
+    LONG i;
+
+    RtlEnterCriticalSection( &pool->cs );
+
+    for (i = 0; i < pool->num_local_queues; ++i)
+    {
+        if (!pool->local_queues[i]->in_use)
+        {
+            local = pool->local_queues[i];
+            break;
+        }
+    }
+
+    if (!local && pool->num_local_queues < THREADPOOL_LOCAL_QUEUES &&
+        (local = RtlAllocateHeap( RtlProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*local) )))
+    {
+        pool->local_queues[pool->num_local_queues] = local;
+        /* Stealers read the count without the lock. */
+        InterlockedIncrement( &pool->num_local_queues );
+    }
+
+    if (local) local->in_use = TRUE;
+
+    RtlLeaveCriticalSection( &pool->cs );
+    return local;
+}
+
+/***********************************************************************
+ *           tp_local_queue_detach    (internal)
+ *
+ * Hands the remaining work of an exiting worker back to the global queues,
+ * pool->cs has to be held.
+ */
+static void tp_local_queue_detach( struct threadpool *pool, struct threadpool_local_queue *local )
+{
+    struct threadpool_object *object;
+    unsigned int i;
+
+    if (!local) return;
+
+    for (i = 0; i < THREADPOOL_PRIORITIES; ++i)
+    {
+        while ((object = tp_deque_pop( &local->prio[i] )))
+            RtlInterlockedPushEntrySList( &pool->injection[i], &object->queue_entry );
+    }
+
+    local->in_use = FALSE;
+}
+
 /***********************************************************************
  *           tp_new_worker_thread    (internal)
  *
@@ -894,6 +1279,13 @@ static NTSTATUS tp_timerqueue_lock( struct threadpool_object *timer )
 
     RtlEnterCriticalSection( &timerqueue.cs );
 
+    /* Make sure that there is room for the timer in the heap. */
+    if (!timeout_heap_reserve( &timerqueue.pending, timerqueue.objcount + 1 ))
+    {
+        RtlLeaveCriticalSection( &timerqueue.cs );
+        return STATUS_NO_MEMORY;
+    }
+
     /* Make sure that the timerqueue thread is running. */
     if (!timerqueue.thread_running)
     {
@@ -931,15 +1323,12 @@ static void tp_timerqueue_unlock( struct threadpool_object *timer )
     {
         /* If timer was pending, remove it. */
         if (timer->u.timer.timer_pending)
-        {
-            list_remove( &timer->u.timer.timer_entry );
-            timer->u.timer.timer_pending = FALSE;
-        }
+            timerqueue_remove_timer( timer );
 
         /* If the last timer object was destroyed, then wake up the thread. */
         if (!--timerqueue.objcount)
         {
-            ASSERT( list_empty( &timerqueue.pending_timers ) );
+            ASSERT( !timerqueue.pending.count );
             RtlWakeAllConditionVariable( &timerqueue.update_event );
         }
 
@@ -990,10 +1379,10 @@ static void CALLBACK waitqueue_thread_proc( void *param )
                 if ((wait->u.wait.flags & (WT_EXECUTEINWAITTHREAD | WT_EXECUTEINIOTHREAD)))
                 {
                     InterlockedIncrement( &wait->refcount );
+                    RtlAcquireSRWLockExclusive( &wait->lock );
                     wait->num_pending_callbacks++;
-                    RtlEnterCriticalSection( &wait->pool->cs );
                     tp_object_execute( wait, TRUE );
-                    RtlLeaveCriticalSection( &wait->pool->cs );
+                    RtlReleaseSRWLockExclusive( &wait->lock );
                     tp_object_release( wait );
                 }
                 else tp_object_submit( wait, FALSE );
@@ -1048,11 +1437,11 @@ static void CALLBACK waitqueue_thread_proc( void *param )
                     }
                     if ((wait->u.wait.flags & (WT_EXECUTEINWAITTHREAD | WT_EXECUTEINIOTHREAD)))
                     {
+                        RtlAcquireSRWLockExclusive( &wait->lock );
                         wait->u.wait.signaled++;
                         wait->num_pending_callbacks++;
-                        RtlEnterCriticalSection( &wait->pool->cs );
                         tp_object_execute( wait, TRUE );
-                        RtlLeaveCriticalSection( &wait->pool->cs );
+                        RtlReleaseSRWLockExclusive( &wait->lock );
                     }
                     else tp_object_submit( wait, TRUE );
                 }
@@ -1070,63 +1459,452 @@ static void CALLBACK waitqueue_thread_proc( void *param )
             }
         }
 
-        /* Try to merge bucket with other threads. */
-        if (waitqueue.num_buckets > 1 && bucket->objcount &&
-            bucket->objcount <= MAXIMUM_WAITQUEUE_OBJECTS * 1 / 3)
-        {
-			struct waitqueue_bucket *other_bucket;
-            LIST_FOR_EACH_ENTRY( other_bucket, &waitqueue.buckets, struct waitqueue_bucket, bucket_entry )
-            {
-                if (other_bucket != bucket && other_bucket->objcount && other_bucket->alertable == bucket->alertable &&
-                    other_bucket->objcount + bucket->objcount <= MAXIMUM_WAITQUEUE_OBJECTS * 2 / 3)
-                {
-                    other_bucket->objcount += bucket->objcount;
-                    bucket->objcount = 0;
+        /* Try to merge bucket with other threads. */
+        if (waitqueue.num_buckets > 1 && bucket->objcount &&
+            bucket->objcount <= MAXIMUM_WAITQUEUE_OBJECTS * 1 / 3)
+        {
+			struct waitqueue_bucket *other_bucket;
+            LIST_FOR_EACH_ENTRY( other_bucket, &waitqueue.buckets, struct waitqueue_bucket, bucket_entry )
+            {
+                if (other_bucket != bucket && other_bucket->objcount && other_bucket->alertable == bucket->alertable &&
+                    other_bucket->objcount + bucket->objcount <= MAXIMUM_WAITQUEUE_OBJECTS * 2 / 3)
+                {
+                    other_bucket->objcount += bucket->objcount;
+                    bucket->objcount = 0;
+
+                    /* Update reserved list. */
+                    LIST_FOR_EACH_ENTRY( wait, &bucket->reserved, struct threadpool_object, u.wait.wait_entry )
+                    {
+                        ASSERT( wait->type == TP_OBJECT_TYPE_WAIT );
+                        wait->u.wait.bucket = other_bucket;
+                    }
+                    list_move_tail( &other_bucket->reserved, &bucket->reserved );
+
+                    /* Update waiting list. */
+                    LIST_FOR_EACH_ENTRY( wait, &bucket->waiting, struct threadpool_object, u.wait.wait_entry )
+                    {
+                        ASSERT( wait->type == TP_OBJECT_TYPE_WAIT );
+                        wait->u.wait.bucket = other_bucket;
+                    }
+                    list_move_tail( &other_bucket->waiting, &bucket->waiting );
+
+                    /* Move bucket to the end, to keep the probability of
+                     * newly added wait objects as small as possible. */
+                    list_remove( &bucket->bucket_entry );
+                    list_add_tail( &waitqueue.buckets, &bucket->bucket_entry );
+
+                    NtSetEvent( other_bucket->update_event, NULL );
+                    break;
+                }
+            }
+        }
+    }
+
+    /* Remove this bucket from the list. */
+    list_remove( &bucket->bucket_entry );
+    if (!--waitqueue.num_buckets)
+        ASSERT( list_empty( &waitqueue.buckets ) );
+
+    RtlLeaveCriticalSection( &waitqueue.cs );
+
+   // DbgPrint( "terminating wait queue thread\n" );
+
+    ASSERT( bucket->objcount == 0 );
+    ASSERT( list_empty( &bucket->reserved ) );
+    ASSERT( list_empty( &bucket->waiting ) );
+    NtClose( bucket->update_event );
+
+    RtlFreeHeap( RtlProcessHeap(), 0, bucket );
+    RtlExitUserThread( 0 );
+}
+
+/* Puts the wait into the reserved list of a bucket with room for it, and
+ * starts a new bucket if there is none. Must be called with waitqueue.cs held. */
+static NTSTATUS tp_waitqueue_lock_bucket( struct threadpool_object *wait )
+{
+    struct waitqueue_bucket *bucket;
+    NTSTATUS status;
+    HANDLE thread;
+    BOOL alertable = (wait->u.wait.flags & WT_EXECUTEINIOTHREAD) != 0;
+
+    /* Try to assign to existing bucket if possible. */
+    LIST_FOR_EACH_ENTRY( bucket, &waitqueue.buckets, struct waitqueue_bucket, bucket_entry )
+    {
+        if (bucket->objcount < MAXIMUM_WAITQUEUE_OBJECTS && bucket->alertable == alertable)
+        {
+            list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
+            wait->u.wait.bucket = bucket;
+            bucket->objcount++;
+            return STATUS_SUCCESS;
+        }
+    }
+
+    /* Create a new bucket and corresponding worker thread. */
+    bucket = RtlAllocateHeap( RtlProcessHeap(), 0, sizeof(*bucket) );
+    if (!bucket)
+        return STATUS_NO_MEMORY;
+
+    bucket->objcount = 0;
+    bucket->alertable = alertable;
+    list_init( &bucket->reserved );
+    list_init( &bucket->waiting );
+
+    status = NtCreateEvent( &bucket->update_event, EVENT_ALL_ACCESS,
+                            NULL, SynchronizationEvent, FALSE );
+    if (status)
+    {
+        RtlFreeHeap( RtlProcessHeap(), 0, bucket );
+        return status;
+    }
+
+    status = RtlCreateUserThread( NtCurrentProcess(), NULL, FALSE, 0, 0, 0,
+                                  (PTHREAD_START_ROUTINE)waitqueue_thread_proc, bucket, &thread, NULL );
+    if (status)
+    {
+        NtClose( bucket->update_event );
+        RtlFreeHeap( RtlProcessHeap(), 0, bucket );
+        return status;
+    }
+
+    list_add_tail( &waitqueue.buckets, &bucket->bucket_entry );
+    waitqueue.num_buckets++;
+
+    list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
+    wait->u.wait.bucket = bucket;
+    bucket->objcount++;
+
+    NtClose( thread );
+    return STATUS_SUCCESS;
+}
+
+/* Waits are delivered through wait completion packets when ntdll has them:
+ * the kernel waits on the handles without a thread, and queues a completion
+ * to the wait queue port once a handle is signaled. A single thread then
+ * serves any number of waits. Otherwise the buckets above are used, with a
+ * thread for every MAXIMUM_WAITQUEUE_OBJECTS waits. */
+#define WAITQUEUE_PACKET_BATCH 64
+
+typedef NTSTATUS (NTAPI *PNT_CREATE_WAIT_COMPLETION_PACKET)(HANDLE *, ACCESS_MASK, OBJECT_ATTRIBUTES *);
+typedef NTSTATUS (NTAPI *PNT_ASSOCIATE_WAIT_COMPLETION_PACKET)(HANDLE, HANDLE, HANDLE, PVOID, PVOID,
+                                                               NTSTATUS, ULONG_PTR, BOOLEAN *);
+typedef NTSTATUS (NTAPI *PNT_CANCEL_WAIT_COMPLETION_PACKET)(HANDLE, BOOLEAN);
+
+static UNICODE_STRING WaitQueueNtDllName = RTL_CONSTANT_STRING(L"ntdll.dll");
+static ANSI_STRING NtCreateWaitCompletionPacketProcName = RTL_CONSTANT_STRING("NtCreateWaitCompletionPacket");
+static ANSI_STRING NtAssociateWaitCompletionPacketProcName = RTL_CONSTANT_STRING("NtAssociateWaitCompletionPacket");
+static ANSI_STRING NtCancelWaitCompletionPacketProcName = RTL_CONSTANT_STRING("NtCancelWaitCompletionPacket");
+
+static PNT_CREATE_WAIT_COMPLETION_PACKET pNtCreateWaitCompletionPacket = NULL;
+static PNT_ASSOCIATE_WAIT_COMPLETION_PACKET pNtAssociateWaitCompletionPacket = NULL;
+static PNT_CANCEL_WAIT_COMPLETION_PACKET pNtCancelWaitCompletionPacket = NULL;
+static BOOL WaitCompletionPacketResolved = FALSE;
+
+/* Must be called with waitqueue.cs held. */
+static BOOL waitqueue_use_packets( void )
+{
+    PVOID NtdllHandle;
+
+    if (!WaitCompletionPacketResolved)
+    {
+        if (NT_SUCCESS(LdrGetDllHandle(NULL, NULL, &WaitQueueNtDllName, &NtdllHandle)))
+        {
+            LdrGetProcedureAddress(NtdllHandle, &NtCreateWaitCompletionPacketProcName, 0,
+                                   (PVOID*)&pNtCreateWaitCompletionPacket);
+            LdrGetProcedureAddress(NtdllHandle, &NtAssociateWaitCompletionPacketProcName, 0,
+                                   (PVOID*)&pNtAssociateWaitCompletionPacket);
+            LdrGetProcedureAddress(NtdllHandle, &NtCancelWaitCompletionPacketProcName, 0,
+                                   (PVOID*)&pNtCancelWaitCompletionPacket);
+        }
+        WaitCompletionPacketResolved = TRUE;
+    }
+
+    return pNtCreateWaitCompletionPacket && pNtAssociateWaitCompletionPacket && pNtCancelWaitCompletionPacket;
+}
+
+static void waitqueue_remove_timeout( struct threadpool_object *wait )
+{
+    if (wait->u.wait.timeout_index == TIMEOUT_HEAP_NONE)
+        return;
+
+    ASSERT( waitqueue.timeouts.objects[wait->u.wait.timeout_index] == wait );
+    timeout_heap_remove( &waitqueue.timeouts, wait->u.wait.timeout_index );
+    wait->u.wait.timeout_index = TIMEOUT_HEAP_NONE;
+}
+
+/* Moves a wait whose handle can't be waited on by a packet, like a mutex,
+ * over to a bucket, which waits on it with a thread. Returns FALSE when no
+ * bucket is available, the wait then stays on the packet and can only time
+ * out. */
+static BOOL waitqueue_packet_to_bucket( struct threadpool_object *wait, ULONGLONG timeout )
+{
+    struct waitqueue_bucket *bucket;
+    NTSTATUS status;
+
+    ASSERT( !wait->u.wait.packet_busy );
+
+    if ((status = tp_waitqueue_lock_bucket( wait )))
+    {
+        DbgPrint( "failed to move wait object %p to a bucket, status %#x.\n", wait, status );
+        return FALSE;
+    }
+
+    waitqueue_remove_timeout( wait );
+    NtClose( wait->u.wait.packet );
+    wait->u.wait.packet = NULL;
+
+    /* If the last wait object left, then wake up the thread. */
+    if (!--waitqueue.objcount)
+        NtSetIoCompletion( waitqueue.port, NULL, NULL, STATUS_SUCCESS, 0 );
+
+    bucket = wait->u.wait.bucket;
+    list_remove( &wait->u.wait.wait_entry );
+    list_add_tail( &bucket->waiting, &wait->u.wait.wait_entry );
+    wait->u.wait.wait_pending = TRUE;
+    wait->u.wait.timeout = timeout;
+
+    NtSetEvent( bucket->update_event, NULL );
+    return TRUE;
+}
+
+/* Starts waiting on the handle. The association holds a reference to the wait
+ * object, which is released together with its completion. When the handle
+ * can't be associated, the wait is moved to a bucket waiting until timeout,
+ * and FALSE is returned. */
+static BOOL waitqueue_associate_packet( struct threadpool_object *wait, ULONGLONG timeout )
+{
+    NTSTATUS status;
+
+    ASSERT( !wait->u.wait.packet_busy );
+
+    InterlockedIncrement( &wait->refcount );
+    wait->u.wait.packet_busy = TRUE;
+
+    status = pNtAssociateWaitCompletionPacket( wait->u.wait.packet, waitqueue.port, wait->u.wait.handle,
+                                               wait, (PVOID)(ULONG_PTR)wait->update_serial,
+                                               STATUS_SUCCESS, 0, NULL );
+    if (!status)
+        return TRUE;
+
+    wait->u.wait.packet_busy = FALSE;
+    tp_object_release( wait );
+
+    /* The wait can still time out if it stays here. */
+    return !waitqueue_packet_to_bucket( wait, timeout );
+}
+
+/* Returns FALSE when the completion already left the port, it's then up to
+ * the wait queue thread to handle it. */
+static BOOL waitqueue_cancel_packet( struct threadpool_object *wait )
+{
+    if (!wait->u.wait.packet_busy)
+        return TRUE;
+
+    if (pNtCancelWaitCompletionPacket( wait->u.wait.packet, TRUE ) != STATUS_SUCCESS)
+        return FALSE;
+
+    wait->u.wait.packet_busy = FALSE;
+    tp_object_release( wait );
+    return TRUE;
+}
+
+static void waitqueue_fire_packet( struct threadpool_object *wait, BOOL signaled )
+{
+    if ((wait->u.wait.flags & (WT_EXECUTEINWAITTHREAD | WT_EXECUTEINIOTHREAD)))
+    {
+        InterlockedIncrement( &wait->refcount );
+        RtlAcquireSRWLockExclusive( &wait->lock );
+        if (signaled) wait->u.wait.signaled++;
+        wait->num_pending_callbacks++;
+        tp_object_execute( wait, TRUE );
+        RtlReleaseSRWLockExclusive( &wait->lock );
+        tp_object_release( wait );
+    }
+    else tp_object_submit( wait, signaled );
+}
+
+/* Handles a completion removed from the wait queue port. */
+static void waitqueue_complete_packet( struct threadpool_object *wait, LONG update_serial )
+{
+    ASSERT( wait->type == TP_OBJECT_TYPE_WAIT );
+    ASSERT( wait->u.wait.packet_busy );
+
+    wait->u.wait.packet_busy = FALSE;
+
+    if (wait->u.wait.wait_pending && wait->update_serial == update_serial)
+    {
+        /* Wait object signaled. */
+        waitqueue_remove_timeout( wait );
+        if ((wait->u.wait.flags & WT_EXECUTEONLYONCE))
+            wait->u.wait.wait_pending = FALSE;
+        else
+            waitqueue_associate_packet( wait, TIMEOUT_INFINITE );
+
+        waitqueue_fire_packet( wait, TRUE );
+    }
+    else if (wait->u.wait.wait_pending)
+    {
+        /* The wait was changed while this completion was on its way. */
+        waitqueue_associate_packet( wait, wait->u.wait.timeout );
+    }
+    else
+        DbgPrint( "wait object %p triggered while object was %s.\n",
+                  wait, wait->u.wait.packet ? "updated" : "destroyed" );
+
+    /* Release the reference held by the association. */
+    tp_object_release( wait );
+}
+
+/***********************************************************************
+ *           waitqueue_packet_thread_proc    (internal)
+ */
+static void CALLBACK waitqueue_packet_thread_proc( void *param )
+{
+    FILE_IO_COMPLETION_INFORMATION info[WAITQUEUE_PACKET_BATCH];
+    struct threadpool_object *wait;
+    LARGE_INTEGER now, timeout, *ptimeout;
+    ULONG count, i;
+    NTSTATUS status;
+
+    DbgPrint( "starting wait queue thread\n" );
+    set_thread_name(L"wineoca_threadpool_waitqueue");
+
+    RtlEnterCriticalSection( &waitqueue.cs );
+
+    for (;;)
+    {
+        NtQuerySystemTime( &now );
+
+        /* Check for waits which timed out. */
+        while (waitqueue.timeouts.count)
+        {
+            wait = waitqueue.timeouts.objects[0];
+            ASSERT( wait->type == TP_OBJECT_TYPE_WAIT );
+            ASSERT( wait->u.wait.wait_pending );
+            if (wait->u.wait.timeout > now.QuadPart)
+                break;
+
+            waitqueue_remove_timeout( wait );
+
+            /* The handle got signaled first, its completion is on the way. */
+            if (!waitqueue_cancel_packet( wait ))
+                continue;
+
+            /* Waits which aren't executed only once keep waiting, without a timeout. */
+            if ((wait->u.wait.flags & WT_EXECUTEONLYONCE))
+                wait->u.wait.wait_pending = FALSE;
+            else
+                waitqueue_associate_packet( wait, TIMEOUT_INFINITE );
+
+            waitqueue_fire_packet( wait, FALSE );
+        }
+
+        if (waitqueue.timeouts.count)
+        {
+            timeout.QuadPart = waitqueue.timeouts.objects[0]->u.wait.timeout;
+            ptimeout = &timeout;
+        }
+        else if (waitqueue.objcount)
+        {
+            ptimeout = NULL;
+        }
+        else
+        {
+            /* All wait objects have been destroyed, if no new wait objects are created
+             * within some amount of time, then we can shutdown this thread. */
+            timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
+            ptimeout = &timeout;
+        }
+
+        /* The wait is alertable for the waits executed in the I/O thread. */
+        RtlLeaveCriticalSection( &waitqueue.cs );
+        status = NtRemoveIoCompletionEx( waitqueue.port, info, ARRAY_SIZE(info), &count, ptimeout, TRUE );
+        RtlEnterCriticalSection( &waitqueue.cs );
+
+        if (status == STATUS_TIMEOUT && !waitqueue.objcount)
+            break;
+        if (status != STATUS_SUCCESS)
+            continue;
+
+        /* Completions without a key only wake up this thread. */
+        for (i = 0; i < count; i++)
+        {
+            if ((wait = info[i].KeyContext))
+                waitqueue_complete_packet( wait, (LONG)(ULONG_PTR)info[i].ApcContext );
+        }
+    }
+
+    waitqueue.thread_running = FALSE;
+    RtlLeaveCriticalSection( &waitqueue.cs );
+
+    RtlExitUserThread( 0 );
+}
+
+/* Must be called with waitqueue.cs held. */
+static NTSTATUS tp_waitqueue_lock_packet( struct threadpool_object *wait )
+{
+    NTSTATUS status;
+    HANDLE thread;
 
-                    /* Update reserved list. */
-                    LIST_FOR_EACH_ENTRY( wait, &bucket->reserved, struct threadpool_object, u.wait.wait_entry )
-                    {
-                        ASSERT( wait->type == TP_OBJECT_TYPE_WAIT );
-                        wait->u.wait.bucket = other_bucket;
-                    }
-                    list_move_tail( &other_bucket->reserved, &bucket->reserved );
+    if (!waitqueue.port && (status = NtCreateIoCompletion( &waitqueue.port,
+            IO_COMPLETION_ALL_ACCESS, NULL, 0 )))
+        return status;
 
-                    /* Update waiting list. */
-                    LIST_FOR_EACH_ENTRY( wait, &bucket->waiting, struct threadpool_object, u.wait.wait_entry )
-                    {
-                        ASSERT( wait->type == TP_OBJECT_TYPE_WAIT );
-                        wait->u.wait.bucket = other_bucket;
-                    }
-                    list_move_tail( &other_bucket->waiting, &bucket->waiting );
+    /* Make sure that there is room for the wait in the heap. */
+    if (!timeout_heap_reserve( &waitqueue.timeouts, waitqueue.objcount + 1 ))
+        return STATUS_NO_MEMORY;
 
-                    /* Move bucket to the end, to keep the probability of
-                     * newly added wait objects as small as possible. */
-                    list_remove( &bucket->bucket_entry );
-                    list_add_tail( &waitqueue.buckets, &bucket->bucket_entry );
+    status = pNtCreateWaitCompletionPacket( &wait->u.wait.packet, MAXIMUM_ALLOWED, NULL );
+    if (status)
+    {
+        wait->u.wait.packet = NULL;
+        return status;
+    }
 
-                    NtSetEvent( other_bucket->update_event, NULL );
-                    break;
-                }
-            }
+    /* Make sure that the wait queue thread is running. */
+    if (!waitqueue.thread_running)
+    {
+        status = RtlCreateUserThread( NtCurrentProcess(), NULL, FALSE, 0, 0, 0,
+                                      (PTHREAD_START_ROUTINE)waitqueue_packet_thread_proc, NULL, &thread, NULL );
+        if (status)
+        {
+            NtClose( wait->u.wait.packet );
+            wait->u.wait.packet = NULL;
+            return status;
         }
+
+        waitqueue.thread_running = TRUE;
+        NtClose( thread );
     }
 
-    /* Remove this bucket from the list. */
-    list_remove( &bucket->bucket_entry );
-    if (!--waitqueue.num_buckets)
-        ASSERT( list_empty( &waitqueue.buckets ) );
+    waitqueue.objcount++;
+    return STATUS_SUCCESS;
+}
 
-    RtlLeaveCriticalSection( &waitqueue.cs );
+/* Restarts or stops a wait after its handle changed. Must be called with
+ * waitqueue.cs held. */
+static void waitqueue_update_packet( struct threadpool_object *wait, ULONGLONG timestamp )
+{
+    waitqueue_remove_timeout( wait );
+    wait->u.wait.wait_pending = wait->u.wait.handle != NULL;
 
-   // DbgPrint( "terminating wait queue thread\n" );
+    /* If the completion of the previous wait is already on its way, the wait
+     * queue thread starts the new wait once it gets it. */
+    wait->u.wait.timeout = timestamp;
+    if (waitqueue_cancel_packet( wait ) && wait->u.wait.wait_pending &&
+        !waitqueue_associate_packet( wait, timestamp ))
+        return;
 
-    ASSERT( bucket->objcount == 0 );
-    ASSERT( list_empty( &bucket->reserved ) );
-    ASSERT( list_empty( &bucket->waiting ) );
-    NtClose( bucket->update_event );
+    if (!wait->u.wait.wait_pending)
+        return;
 
-    RtlFreeHeap( RtlProcessHeap(), 0, bucket );
-    RtlExitUserThread( 0 );
+    if (timestamp != TIMEOUT_INFINITE)
+    {
+        timeout_heap_insert( &waitqueue.timeouts, wait );
+
+        /* Wake up the wait queue thread when the timeout has to be updated. */
+        if (!wait->u.wait.timeout_index)
+            NtSetIoCompletion( waitqueue.port, NULL, NULL, STATUS_SUCCESS, 0 );
+    }
 }
 
 /***********************************************************************
@@ -1134,10 +1912,7 @@ static void CALLBACK waitqueue_thread_proc( void *param )
  */
 static NTSTATUS tp_waitqueue_lock( struct threadpool_object *wait )
 {
-    struct waitqueue_bucket *bucket;
     NTSTATUS status;
-    HANDLE thread;
-	BOOL alertable = (wait->u.wait.flags & WT_EXECUTEINIOTHREAD) != 0;
     ASSERT( wait->type == TP_OBJECT_TYPE_WAIT );
 
     wait->u.wait.signaled       = 0;
@@ -1145,64 +1920,17 @@ static NTSTATUS tp_waitqueue_lock( struct threadpool_object *wait )
     wait->u.wait.wait_pending   = FALSE;
     wait->u.wait.timeout        = 0;
     wait->u.wait.handle         = INVALID_HANDLE_VALUE;
+    wait->u.wait.packet         = NULL;
+    wait->u.wait.packet_busy    = FALSE;
+    wait->u.wait.timeout_index  = TIMEOUT_HEAP_NONE;
 
     RtlEnterCriticalSection( &waitqueue.cs );
 
-    /* Try to assign to existing bucket if possible. */
-    LIST_FOR_EACH_ENTRY( bucket, &waitqueue.buckets, struct waitqueue_bucket, bucket_entry )
-    {
-        if (bucket->objcount < MAXIMUM_WAITQUEUE_OBJECTS && bucket->alertable == alertable)
-        {
-            list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
-            wait->u.wait.bucket = bucket;
-            bucket->objcount++;
-
-            status = STATUS_SUCCESS;
-            goto out;
-        }
-    }
-
-    /* Create a new bucket and corresponding worker thread. */
-    bucket = RtlAllocateHeap( RtlProcessHeap(), 0, sizeof(*bucket) );
-    if (!bucket)
-    {
-        status = STATUS_NO_MEMORY;
-        goto out;
-    }
-
-    bucket->objcount = 0;
-	bucket->alertable = alertable;
-    list_init( &bucket->reserved );
-    list_init( &bucket->waiting );
-
-    status = NtCreateEvent( &bucket->update_event, EVENT_ALL_ACCESS,
-                            NULL, SynchronizationEvent, FALSE );
-    if (status)
-    {
-        RtlFreeHeap( RtlProcessHeap(), 0, bucket );
-        goto out;
-    }
-
-    status = RtlCreateUserThread( NtCurrentProcess(), NULL, FALSE, 0, 0, 0,
-                                  (PTHREAD_START_ROUTINE)waitqueue_thread_proc, bucket, &thread, NULL );
-    if (status == STATUS_SUCCESS)
-    {
-        list_add_tail( &waitqueue.buckets, &bucket->bucket_entry );
-        waitqueue.num_buckets++;
-
-        list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
-        wait->u.wait.bucket = bucket;
-        bucket->objcount++;
-
-        NtClose( thread );
-    }
+    if (waitqueue_use_packets())
+        status = tp_waitqueue_lock_packet( wait );
     else
-    {
-        NtClose( bucket->update_event );
-        RtlFreeHeap( RtlProcessHeap(), 0, bucket );
-    }
+        status = tp_waitqueue_lock_bucket( wait );
 
-out:
     RtlLeaveCriticalSection( &waitqueue.cs );
     return status;
 }
@@ -1215,7 +1943,24 @@ static void tp_waitqueue_unlock( struct threadpool_object *wait )
     ASSERT( wait->type == TP_OBJECT_TYPE_WAIT );
 
     RtlEnterCriticalSection( &waitqueue.cs );
-    if (wait->u.wait.bucket)
+    if (wait->u.wait.packet)
+    {
+        ASSERT( waitqueue.objcount > 0 );
+
+        waitqueue_remove_timeout( wait );
+        wait->u.wait.wait_pending = FALSE;
+        ++wait->update_serial;
+
+        /* A completion which already left the port is dropped by the wait queue thread. */
+        waitqueue_cancel_packet( wait );
+        NtClose( wait->u.wait.packet );
+        wait->u.wait.packet = NULL;
+
+        /* If the last wait object was destroyed, then wake up the thread. */
+        if (!--waitqueue.objcount)
+            NtSetIoCompletion( waitqueue.port, NULL, NULL, STATUS_SUCCESS, 0 );
+    }
+    else if (wait->u.wait.bucket)
     {
         struct waitqueue_bucket *bucket = wait->u.wait.bucket;
         ASSERT( bucket->objcount > 0 );
@@ -1256,7 +2001,7 @@ static void CALLBACK ioqueue_thread_proc( void *param )
 
         if (io && (io->shutdown || io->u.io.shutting_down))
         {
-            RtlEnterCriticalSection( &io->pool->cs );
+            RtlAcquireSRWLockExclusive( &io->lock );
             if (!io->u.io.pending_count)
             {
                 if (io->u.io.skipped_count)
@@ -1267,7 +2012,7 @@ static void CALLBACK ioqueue_thread_proc( void *param )
                 else
                     destroy = TRUE;
             }
-            RtlLeaveCriticalSection( &io->pool->cs );
+            RtlReleaseSRWLockExclusive( &io->lock );
             if (skip) continue;
         }
 
@@ -1280,8 +2025,9 @@ static void CALLBACK ioqueue_thread_proc( void *param )
         }
         else if (io)
         {
+            BOOL queue = FALSE;
 
-            RtlEnterCriticalSection( &io->pool->cs );
+            RtlAcquireSRWLockExclusive( &io->lock );
 			
 			DbgPrint( "pending_count %u.\n", io->u.io.pending_count );
 			
@@ -1292,7 +2038,7 @@ static void CALLBACK ioqueue_thread_proc( void *param )
                         io->u.io.completion_count + 1, sizeof(*io->u.io.completions)))
                 {
                     DbgPrint( "Failed to allocate memory.\n" );
-                    RtlLeaveCriticalSection( &io->pool->cs );
+                    RtlReleaseSRWLockExclusive( &io->lock );
                     continue;
                 }
 
@@ -1300,16 +2046,12 @@ static void CALLBACK ioqueue_thread_proc( void *param )
                 completion->iosb = iosb;
                 completion->cvalue = value;
 
-                tp_object_submit( io, FALSE );
+                queue = tp_object_submit_locked( io, FALSE );
             }
 
-            completion = &io->u.io.completions[io->u.io.completion_count++];
-            completion->iosb = iosb;
-            completion->cvalue = value;
+            RtlReleaseSRWLockExclusive( &io->lock );
 
-            tp_object_submit( io, FALSE );
-
-            RtlLeaveCriticalSection( &io->pool->cs );
+            if (queue) tp_object_prio_queue( io );
         }
 
         if (!ioqueue.objcount)
@@ -1392,11 +2134,19 @@ static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
     IMAGE_NT_HEADERS *nt = RtlImageNtHeader( NtCurrentTeb()->ProcessEnvironmentBlock->ImageBaseAddress );
     struct threadpool *pool;
     unsigned int i;
+    NTSTATUS status;
 
     pool = RtlAllocateHeap( RtlProcessHeap(), 0, sizeof(*pool) );
     if (!pool)
         return STATUS_NO_MEMORY;
 
+    status = NtCreateSemaphore( &pool->idle_semaphore, SEMAPHORE_ALL_ACCESS, NULL, 0, MAXLONG );
+    if (status)
+    {
+        RtlFreeHeap( RtlProcessHeap(), 0, pool );
+        return status;
+    }
+
     pool->refcount              = 1;
     pool->objcount              = 0;
     pool->shutdown              = FALSE;
@@ -1404,14 +2154,17 @@ static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
     RtlInitializeCriticalSection( &pool->cs );
     //pool->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": threadpool.cs");
 
-    for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
-        list_init( &pool->pools[i] );
-    RtlInitializeConditionVariable( &pool->update_event );
+    for (i = 0; i < ARRAY_SIZE(pool->injection); ++i)
+        RtlInitializeSListHead( &pool->injection[i] );
+    memset( pool->local_queues, 0, sizeof(pool->local_queues) );
+    pool->num_local_queues        = 0;
+    pool->num_queued              = 0;
+    pool->num_busy_workers        = 0;
+    pool->num_idle_workers        = 0;
 
     pool->max_workers             = 500;
     pool->min_workers             = 0;
     pool->num_workers             = 0;
-    pool->num_busy_workers        = 0;
     pool->stack_info.StackReserve = nt->OptionalHeader.SizeOfStackReserve;
     pool->stack_info.StackCommit  = nt->OptionalHeader.SizeOfStackCommit;
 	pool->priority = 0;
@@ -1434,7 +2187,10 @@ static void tp_threadpool_shutdown( struct threadpool *pool )
     ASSERT( pool != default_threadpool );
 
     pool->shutdown = TRUE;
-    RtlWakeAllConditionVariable( &pool->update_event );
+
+    /* Workers which are busy see the flag once they run out of work. */
+    while (tp_threadpool_claim_idle( pool ))
+        NtReleaseSemaphore( pool->idle_semaphore, 1, NULL );
 }
 
 /***********************************************************************
@@ -1444,7 +2200,7 @@ static void tp_threadpool_shutdown( struct threadpool *pool )
  */
 static BOOL tp_threadpool_release( struct threadpool *pool )
 {
-    unsigned int i;
+    LONG i;
 
     if (InterlockedDecrement( &pool->refcount ))
         return FALSE;
@@ -1453,8 +2209,12 @@ static BOOL tp_threadpool_release( struct threadpool *pool )
 
     ASSERT( pool->shutdown );
     ASSERT( !pool->objcount );
-    for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
-        ASSERT( list_empty( &pool->pools[i] ) );
+    ASSERT( !pool->num_queued );
+
+    for (i = 0; i < pool->num_local_queues; ++i)
+        RtlFreeHeap( RtlProcessHeap(), 0, pool->local_queues[i] );
+
+    NtClose( pool->idle_semaphore );
 
     //pool->cs.DebugInfo->Spare[0] = 0;
     RtlDeleteCriticalSection( &pool->cs );
@@ -1514,22 +2274,24 @@ static NTSTATUS tp_threadpool_lock( struct threadpool **out, TP_CALLBACK_ENVIRON
         pool = default_threadpool;
     }
 
-    RtlEnterCriticalSection( &pool->cs );
-
-    /* Make sure that the threadpool has at least one thread. */
+    /* Make sure that the threadpool has at least one thread. If a worker
+     * is exiting right now, the next submission starts a new one. */
     if (!pool->num_workers)
-        status = tp_new_worker_thread( pool );
+    {
+        RtlEnterCriticalSection( &pool->cs );
+        if (!pool->num_workers)
+            status = tp_new_worker_thread( pool );
+        RtlLeaveCriticalSection( &pool->cs );
+    }
 
     /* Keep a reference, and increment objcount to ensure that the
      * last thread doesn't terminate. */
     if (status == STATUS_SUCCESS)
     {
         InterlockedIncrement( &pool->refcount );
-        pool->objcount++;
+        InterlockedIncrement( &pool->objcount );
     }
 
-    RtlLeaveCriticalSection( &pool->cs );
-
     if (status != STATUS_SUCCESS)
         return status;
 
@@ -1544,9 +2306,7 @@ static NTSTATUS tp_threadpool_lock( struct threadpool **out, TP_CALLBACK_ENVIRON
  */
 static void tp_threadpool_unlock( struct threadpool *pool )
 {
-    RtlEnterCriticalSection( &pool->cs );
-    pool->objcount--;
-    RtlLeaveCriticalSection( &pool->cs );
+    InterlockedDecrement( &pool->objcount );
     tp_threadpool_release( pool );
 }
 
@@ -1634,7 +2394,9 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
     memset( &object->group_entry, 0, sizeof(object->group_entry) );
     object->is_group_member         = FALSE;
 
-    memset( &object->pool_entry, 0, sizeof(object->pool_entry) );
+    memset( &object->queue_entry, 0, sizeof(object->queue_entry) );
+    RtlInitializeSRWLock( &object->lock );
+    object->queued                  = FALSE;
     RtlInitializeConditionVariable( &object->finished_event );
     RtlInitializeConditionVariable( &object->group_finished_event );
 	object->completed_event         = NULL;
@@ -1658,7 +2420,7 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
             TP_CALLBACK_ENVIRON_V3 *environment_v3 = (TP_CALLBACK_ENVIRON_V3 *)environment;
 
             object->priority = environment_v3->CallbackPriority;
-            ASSERT( object->priority < ARRAY_SIZE(pool->pools) );
+            ASSERT( object->priority < THREADPOOL_PRIORITIES );
         }
 
         if (environment->ActivationContext)
@@ -1695,68 +2457,87 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
         tp_object_release( object );
 }
 
-static void tp_object_prio_queue( struct threadpool_object *object )
-{
-    ++object->pool->num_busy_workers;
-    list_add_tail( &object->pool->pools[object->priority], &object->pool_entry );
-}
-
 /***********************************************************************
- *           tp_object_submit    (internal)
+ *           tp_object_prio_queue    (internal)
  *
- * Submits a threadpool object to the associated threadpool. This
- * function has to be VOID because TpPostWork can never fail on Windows.
+ * Puts an object, with the queue reference already taken, on the global
+ * injection queue of its priority and gets a worker to process it.
  */
-static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
+static void tp_object_prio_queue( struct threadpool_object *object )
 {
     struct threadpool *pool = object->pool;
-    NTSTATUS status = STATUS_UNSUCCESSFUL;
 
-    ASSERT( !object->shutdown );
-    ASSERT( !pool->shutdown );
+    InterlockedIncrement( &pool->num_busy_workers );
+    RtlInterlockedPushEntrySList( &pool->injection[object->priority], &object->queue_entry );
+    InterlockedIncrement( &pool->num_queued );
 
-    RtlEnterCriticalSection( &pool->cs );
+    tp_threadpool_signal( pool );
+}
 
-    /* Start new worker threads if required. */
-    if (pool->num_busy_workers >= pool->num_workers &&
-        pool->num_workers < pool->max_workers)
-        status = tp_new_worker_thread( pool );
+/***********************************************************************
+ *           tp_object_submit_locked    (internal)
+ *
+ * Accounts a new pending callback, object->lock has to be held. Returns
+ * TRUE if the caller has to queue the object with tp_object_prio_queue
+ * after releasing the lock.
+ */
+static BOOL tp_object_submit_locked( struct threadpool_object *object, BOOL signaled )
+{
+    BOOL queue = FALSE;
 
     /* Queue work item and increment refcount. */
     InterlockedIncrement( &object->refcount );
-    if (!object->num_pending_callbacks++)
-        tp_object_prio_queue( object );
+    if (!object->num_pending_callbacks++ && !object->queued)
+    {
+        /* The queue holds its own reference, pending callbacks can be
+         * cancelled while the object is still queued. */
+        InterlockedIncrement( &object->refcount );
+        object->queued = TRUE;
+        queue = TRUE;
+    }
 
     /* Count how often the object was signaled. */
     if (object->type == TP_OBJECT_TYPE_WAIT && signaled)
         object->u.wait.signaled++;
 
-    /* No new thread started - wake up one existing thread. */
-    if (status != STATUS_SUCCESS)
-    {
-        ASSERT( pool->num_workers > 0 );
-        RtlWakeConditionVariable( &pool->update_event );
-    }
+    return queue;
+}
 
-    RtlLeaveCriticalSection( &pool->cs );
+/***********************************************************************
+ *           tp_object_submit    (internal)
+ *
+ * Submits a threadpool object to the associated threadpool. This
+ * function has to be VOID because TpPostWork can never fail on Windows.
+ */
+static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
+{
+    BOOL queue;
+
+    ASSERT( !object->shutdown );
+    ASSERT( !object->pool->shutdown );
+
+    RtlAcquireSRWLockExclusive( &object->lock );
+    queue = tp_object_submit_locked( object, signaled );
+    RtlReleaseSRWLockExclusive( &object->lock );
+
+    if (queue) tp_object_prio_queue( object );
 }
 
 /***********************************************************************
  *           tp_object_cancel    (internal)
  *
- * Cancels all currently pending callbacks for a specific object.
+ * Cancels all currently pending callbacks for a specific object. The
+ * object stays queued, the worker that dequeues it drops it.
  */
 static void tp_object_cancel( struct threadpool_object *object )
 {
-    struct threadpool *pool = object->pool;
     LONG pending_callbacks = 0;
 
-    RtlEnterCriticalSection( &pool->cs );
+    RtlAcquireSRWLockExclusive( &object->lock );
     if (object->num_pending_callbacks)
     {
         pending_callbacks = object->num_pending_callbacks;
         object->num_pending_callbacks = 0;
-        list_remove( &object->pool_entry );
 
         if (object->type == TP_OBJECT_TYPE_WAIT)
             object->u.wait.signaled = 0;
@@ -1766,7 +2547,7 @@ static void tp_object_cancel( struct threadpool_object *object )
         object->u.io.skipped_count += object->u.io.pending_count;
         object->u.io.pending_count = 0;
     }
-    RtlLeaveCriticalSection( &pool->cs );
+    RtlReleaseSRWLockExclusive( &object->lock );
 
     while (pending_callbacks--)
         tp_object_release( object );
@@ -1793,17 +2574,15 @@ static BOOL object_is_finished( struct threadpool_object *object, BOOL group )
  */
 static void tp_object_wait( struct threadpool_object *object, BOOL group_wait )
 {
-    struct threadpool *pool = object->pool;
-
-    RtlEnterCriticalSection( &pool->cs );
+    RtlAcquireSRWLockExclusive( &object->lock );
     while (!object_is_finished( object, group_wait ))
     {
         if (group_wait)
-            RtlSleepConditionVariableCS( &object->group_finished_event, &pool->cs, NULL );
+            RtlSleepConditionVariableSRW( &object->group_finished_event, &object->lock, NULL, 0 );
         else
-            RtlSleepConditionVariableCS( &object->finished_event, &pool->cs, NULL );
+            RtlSleepConditionVariableSRW( &object->finished_event, &object->lock, NULL, 0 );
     }
-    RtlLeaveCriticalSection( &pool->cs );
+    RtlReleaseSRWLockExclusive( &object->lock );
 }
 
 static void tp_ioqueue_unlock( struct threadpool_object *io )
@@ -1880,24 +2659,67 @@ static BOOL tp_object_release( struct threadpool_object *object )
     return TRUE;
 }
 
-static struct list *threadpool_get_next_item( const struct threadpool *pool )
+/***********************************************************************
+ *           threadpool_get_next_item    (internal)
+ *
+ * Finds the next object to process. For each priority, the local queue of
+ * the worker comes first, then the global injection queue, and finally the
+ * local queues of the other workers.
+ */
+static struct threadpool_object *threadpool_get_next_item( struct threadpool *pool,
+                                                           struct threadpool_local_queue *local )
 {
-    struct list *ptr;
+    struct threadpool_object *object, *next;
+    struct threadpool_local_queue *victim;
+    PSLIST_ENTRY entry;
     unsigned int i;
+    LONG j, count;
 
-    for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
+    for (i = 0; i < THREADPOOL_PRIORITIES; ++i)
     {
-        if ((ptr = list_head( &pool->pools[i] )))
-            break;
+        if (local && (object = tp_deque_pop( &local->prio[i] )))
+            return object;
+
+        if ((entry = RtlInterlockedFlushSList( &pool->injection[i] )))
+        {
+            /* The list is newest first. The oldest entry is run now, the
+             * others go to the local queue, so that the owner pops them
+             * oldest first and thieves take the newest ones. */
+            object = CONTAINING_RECORD( entry, struct threadpool_object, queue_entry );
+            count = 0;
+
+            while (object->queue_entry.Next)
+            {
+                next = CONTAINING_RECORD( object->queue_entry.Next, struct threadpool_object, queue_entry );
+
+                if (!local || !tp_deque_push( &local->prio[i], object ))
+                    RtlInterlockedPushEntrySList( &pool->injection[i], &object->queue_entry );
+
+                object = next;
+                count++;
+            }
+
+            /* Let another worker help with the batch. */
+            if (count) tp_threadpool_signal( pool );
+            return object;
+        }
+
+        count = pool->num_local_queues;
+        for (j = 0; j < count; ++j)
+        {
+            victim = pool->local_queues[j];
+            if (victim != local && (object = tp_deque_steal( &victim->prio[i] )))
+                return object;
+        }
     }
 
-    return ptr;
+    return NULL;
 }
 
 /***********************************************************************
  *           tp_object_execute    (internal)
  *
- * Executes a threadpool object callback, object->pool->cs has to be
+ * Executes a threadpool object callback, object->lock has to be
  * held.
  */
 static void tp_object_execute( struct threadpool_object *object, BOOL wait_thread )
@@ -1905,7 +2727,6 @@ static void tp_object_execute( struct threadpool_object *object, BOOL wait_threa
     TP_CALLBACK_INSTANCE *callback_instance;
     struct threadpool_instance instance;
     struct io_completion completion;
-    struct threadpool *pool = object->pool;
     TP_WAIT_RESULT wait_result = 0;
     NTSTATUS status;
 
@@ -1926,7 +2747,7 @@ static void tp_object_execute( struct threadpool_object *object, BOOL wait_threa
     /* Leave critical section and do the actual callback. */
     object->num_associated_callbacks++;
     object->num_running_callbacks++;
-    RtlLeaveCriticalSection( &pool->cs );
+    RtlReleaseSRWLockExclusive( &object->lock );
 	if (wait_thread) RtlLeaveCriticalSection( &waitqueue.cs );
 	
     /* Initialize threadpool instance struct. */
@@ -2032,7 +2853,7 @@ static void tp_object_execute( struct threadpool_object *object, BOOL wait_threa
 
 skip_cleanup:
 	if (wait_thread) RtlEnterCriticalSection( &waitqueue.cs );
-    RtlEnterCriticalSection( &pool->cs );
+    RtlAcquireSRWLockExclusive( &object->lock );
 
     /* Simple callbacks are automatically shutdown after execution. */
     if (object->type == TP_OBJECT_TYPE_SIMPLE)
@@ -2053,46 +2874,86 @@ skip_cleanup:
     }
 }
 
-/***********************************************************************
- *           threadpool_worker_proc    (internal)
- */
 /***********************************************************************
  *           threadpool_worker_proc    (internal)
  */
 static void CALLBACK threadpool_worker_proc( void *param )
 {
     struct threadpool *pool = param;
+    struct threadpool_local_queue *local;
+    struct threadpool_object *object;
     LARGE_INTEGER timeout;
-    struct list *ptr;
+    NTSTATUS status;
 
     DbgPrint( "starting worker thread for pool %p\n", pool );
 	set_thread_name(L"wineoca_threadpool_worker");
-	
-    RtlEnterCriticalSection( &pool->cs );
+
+    local = tp_local_queue_attach( pool );
+
     for (;;)
     {
-        while ((ptr = threadpool_get_next_item( pool )))
+        while ((object = threadpool_get_next_item( pool, local )))
         {
-            struct threadpool_object *object = LIST_ENTRY( ptr, struct threadpool_object, pool_entry );
-            assert( object->num_pending_callbacks > 0 );
+            InterlockedDecrement( &pool->num_queued );
+
+            RtlAcquireSRWLockExclusive( &object->lock );
+            object->queued = FALSE;
+
+            /* Pending callbacks may have been cancelled while the object
+             * was queued, then there is nothing left to do. */
+            if (object->num_pending_callbacks)
+            {
+                /* If further pending callbacks are queued, queue the object
+                 * again, so that other workers can run them concurrently. */
+                if (object->num_pending_callbacks > 1)
+                {
+                    InterlockedIncrement( &object->refcount );
+                    object->queued = TRUE;
+
+                    if (local && tp_deque_push( &local->prio[object->priority], object ))
+                    {
+                        InterlockedIncrement( &pool->num_busy_workers );
+                        InterlockedIncrement( &pool->num_queued );
+                        tp_threadpool_signal( pool );
+                    }
+                    else
+                        tp_object_prio_queue( object );
+                }
 
-            /* If further pending callbacks are queued, move the work item to
-             * the end of the pool list. Otherwise remove it from the pool. */
-            list_remove( &object->pool_entry );
-            if (object->num_pending_callbacks > 1)
-                tp_object_prio_queue( object );
+                tp_object_execute( object, FALSE );
+                RtlReleaseSRWLockExclusive( &object->lock );
 
-            tp_object_execute( object, FALSE );
+                /* Release the reference of the pending callback. */
+                tp_object_release( object );
+            }
+            else
+                RtlReleaseSRWLockExclusive( &object->lock );
 
             assert(pool->num_busy_workers);
-            pool->num_busy_workers--;
+            InterlockedDecrement( &pool->num_busy_workers );
 
+            /* Release the reference of the queue. */
             tp_object_release( object );
         }
 
         /* Shutdown worker thread if requested. */
         if (pool->shutdown)
+        {
+            RtlEnterCriticalSection( &pool->cs );
             break;
+        }
+
+        /* Announce that we are idle, then look for work once more, so that
+         * a submitter either sees us idle or we see its work. */
+        InterlockedIncrement( &pool->num_idle_workers );
+
+        if (pool->num_queued || pool->shutdown)
+        {
+            /* If a submitter already claimed us, consume its wake up. */
+            if (!tp_threadpool_claim_idle( pool ))
+                NtWaitForSingleObject( pool->idle_semaphore, FALSE, NULL );
+            continue;
+        }
 
         /* Wait for new tasks or until the timeout expires. A thread only terminates
          * when no new tasks are available, and the number of threads can be
@@ -2100,14 +2961,27 @@ static void CALLBACK threadpool_worker_proc( void *param )
          * min_workers == 0, then objcount is used to detect if the last thread
          * can be terminated. */
         timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
-        if (RtlSleepConditionVariableCS( &pool->update_event, &pool->cs, &timeout ) == STATUS_TIMEOUT &&
-            !threadpool_get_next_item( pool ) && (pool->num_workers > max( pool->min_workers, 1 ) ||
+        status = NtWaitForSingleObject( pool->idle_semaphore, FALSE, &timeout );
+        if (status != STATUS_TIMEOUT)
+            continue;
+
+        if (!tp_threadpool_claim_idle( pool ))
+        {
+            NtWaitForSingleObject( pool->idle_semaphore, FALSE, NULL );
+            continue;
+        }
+
+        RtlEnterCriticalSection( &pool->cs );
+        if (!pool->num_queued && (pool->num_workers > max( pool->min_workers, 1 ) ||
             (!pool->min_workers && !pool->objcount)))
         {
             break;
         }
+        RtlLeaveCriticalSection( &pool->cs );
     }
+
     pool->num_workers--;
+    tp_local_queue_detach( pool, local );
     RtlLeaveCriticalSection( &pool->cs );
 
     DbgPrint( "terminating worker thread for pool %p\n", pool );
@@ -2311,7 +3185,7 @@ void WINAPI TpCancelAsyncIoOperation( TP_IO *io )
 
     DbgPrint( "%p\n", io );
 
-    RtlEnterCriticalSection( &this->pool->cs );
+    RtlAcquireSRWLockExclusive( &this->lock );
 
     this->u.io.pending_count--;
     if (object_is_finished( this, TRUE ))
@@ -2319,7 +3193,7 @@ void WINAPI TpCancelAsyncIoOperation( TP_IO *io )
     if (object_is_finished( this, FALSE ))
         RtlWakeAllConditionVariable( &this->finished_event );
 
-    RtlLeaveCriticalSection( &this->pool->cs );
+    RtlReleaseSRWLockExclusive( &this->lock );
 }
 
 /***********************************************************************
@@ -2439,7 +3313,6 @@ VOID WINAPI TpDisassociateCallback( TP_CALLBACK_INSTANCE *instance )
 {
     struct threadpool_instance *this = impl_from_TP_CALLBACK_INSTANCE( instance );
     struct threadpool_object *object = this->object;
-    struct threadpool *pool;
 
     DbgPrint( "%p\n", instance );
 
@@ -2452,14 +3325,13 @@ VOID WINAPI TpDisassociateCallback( TP_CALLBACK_INSTANCE *instance )
     if (!this->associated)
         return;
 
-    pool = object->pool;
-    RtlEnterCriticalSection( &pool->cs );
+    RtlAcquireSRWLockExclusive( &object->lock );
 
     object->num_associated_callbacks--;
     if (object_is_finished( object, FALSE ))
         RtlWakeAllConditionVariable( &object->finished_event );
 
-    RtlLeaveCriticalSection( &pool->cs );
+    RtlReleaseSRWLockExclusive( &object->lock );
     this->associated = FALSE;
 }
 
@@ -2583,10 +3455,10 @@ void WINAPI TpReleaseIoCompletion( TP_IO *io )
 
     DbgPrint( "%p\n", io );
 
-    RtlEnterCriticalSection( &this->pool->cs );
+    RtlAcquireSRWLockExclusive( &this->lock );
     this->u.io.shutting_down = TRUE;
     can_destroy = !this->u.io.pending_count && !this->u.io.skipped_count;
-    RtlLeaveCriticalSection( &this->pool->cs );
+    RtlReleaseSRWLockExclusive( &this->lock );
 
     if (can_destroy)
     {
@@ -2701,7 +3573,6 @@ BOOL WINAPI TpSetPoolMinThreads( TP_POOL *pool, DWORD minimum )
 BOOL WINAPI TpSetTimerEx( TP_TIMER *timer, LARGE_INTEGER *timeout, LONG period, LONG window_length )
 {
     struct threadpool_object *this = impl_from_TP_TIMER( timer );
-    struct threadpool_object *other_timer;
     BOOL submit_timer = FALSE;
     ULONGLONG timestamp;
 	BOOL cancelled_timer = FALSE;
@@ -2742,8 +3613,7 @@ BOOL WINAPI TpSetTimerEx( TP_TIMER *timer, LARGE_INTEGER *timeout, LONG period,
     if (this->u.timer.timer_pending)
     {
 		cancelled_timer = TRUE;
-        list_remove( &this->u.timer.timer_entry );
-        this->u.timer.timer_pending = FALSE;
+        timerqueue_remove_timer( this );
     }
 
     /* If the timer was enabled, then add it back to the queue. */
@@ -2753,20 +3623,11 @@ BOOL WINAPI TpSetTimerEx( TP_TIMER *timer, LARGE_INTEGER *timeout, LONG period,
         this->u.timer.period        = period;
         this->u.timer.window_length = window_length;
 
-        LIST_FOR_EACH_ENTRY( other_timer, &timerqueue.pending_timers,
-                             struct threadpool_object, u.timer.timer_entry )
-        {
-            ASSERT( other_timer->type == TP_OBJECT_TYPE_TIMER );
-            if (this->u.timer.timeout < other_timer->u.timer.timeout)
-                break;
-        }
-        list_add_before( &other_timer->u.timer.timer_entry, &this->u.timer.timer_entry );
+        timerqueue_add_timer( this );
 
         /* Wake up the timer thread when the timeout has to be updated. */
-        if (list_head( &timerqueue.pending_timers ) == &this->u.timer.timer_entry )
+        if (!this->u.timer.timer_index)
             RtlWakeAllConditionVariable( &timerqueue.update_event );
-
-        this->u.timer.timer_pending = TRUE;
     }
 
     RtlLeaveCriticalSection( &timerqueue.cs );
@@ -2798,7 +3659,7 @@ BOOL WINAPI TpSetWaitEx( TP_WAIT *wait, HANDLE handle, LARGE_INTEGER *timeout, P
 
     RtlEnterCriticalSection( &waitqueue.cs );
 
-    ASSERT( this->u.wait.bucket );
+    ASSERT( this->u.wait.bucket || this->u.wait.packet );
 	
 	same_handle = this->u.wait.handle == handle;
     this->u.wait.handle = handle;
@@ -2806,7 +3667,6 @@ BOOL WINAPI TpSetWaitEx( TP_WAIT *wait, HANDLE handle, LARGE_INTEGER *timeout, P
     if (handle || this->u.wait.wait_pending)
     {
         struct waitqueue_bucket *bucket = this->u.wait.bucket;
-        list_remove( &this->u.wait.wait_entry );
 		replaced_wait = this->u.wait.wait_pending;
 		
         /* Convert relative timeout to absolute timestamp. */
@@ -2821,7 +3681,18 @@ BOOL WINAPI TpSetWaitEx( TP_WAIT *wait, HANDLE handle, LARGE_INTEGER *timeout, P
             }
         }
 
+        if (!same_handle)
+            ++this->update_serial;
+
+        if (this->u.wait.packet)
+        {
+            waitqueue_update_packet( this, timestamp );
+            RtlLeaveCriticalSection( &waitqueue.cs );
+            return replaced_wait;
+        }
+
         /* Add wait object back into one of the queues. */
+        list_remove( &this->u.wait.wait_entry );
         if (handle)
         {
             list_add_tail( &bucket->waiting, &this->u.wait.wait_entry );
@@ -2835,8 +3706,6 @@ BOOL WINAPI TpSetWaitEx( TP_WAIT *wait, HANDLE handle, LARGE_INTEGER *timeout, P
         }
 
         /* Wake up the wait queue thread. */
-		if (!same_handle)
-            ++this->update_serial;
         NtSetEvent( bucket->update_event, NULL );
     }
 
@@ -2892,11 +3761,11 @@ void WINAPI TpStartAsyncIoOperation( TP_IO *io )
 
     DbgPrint( "%p\n", io );
 
-    RtlEnterCriticalSection( &this->pool->cs );
+    RtlAcquireSRWLockExclusive( &this->lock );
 
     this->u.io.pending_count++;
 
-    RtlLeaveCriticalSection( &this->pool->cs );
+    RtlReleaseSRWLockExclusive( &this->lock );
 }
 
 /***********************************************************************
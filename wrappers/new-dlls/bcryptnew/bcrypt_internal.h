@@ -32,6 +32,31 @@
 
 #define STATUS_AUTH_TAG_MISMATCH         ((NTSTATUS) 0xC000A002)
 
+#ifndef BCRYPT_MESSAGE_BLOCK_LENGTH
+#define BCRYPT_MESSAGE_BLOCK_LENGTH L"MessageBlockLength"
+#endif
+
+/* set by DllMain from CPUID, used to pick the assembly kernels */
+#define CPU_FEATURE_AESNI   0x00000001  /* AES-NI and SSSE3 */
+#define CPU_FEATURE_PCLMUL  0x00000002  /* PCLMULQDQ and SSSE3 */
+#define CPU_FEATURE_SHA     0x00000004  /* SHA extensions and SSE4.1 */
+#define CPU_FEATURE_SSE2    0x00000008
+
+extern ULONG cpu_features DECLSPEC_HIDDEN;
+
+typedef struct
+{
+    ULONG64 len;
+    DWORD h[5];
+    UCHAR buf[64];
+} SHA1_CTX;
+
+void sha1_init(SHA1_CTX *ctx) DECLSPEC_HIDDEN;
+void sha1_update(SHA1_CTX *ctx, const UCHAR *buffer, ULONG len) DECLSPEC_HIDDEN;
+void sha1_finalize(SHA1_CTX *ctx, UCHAR *buffer) DECLSPEC_HIDDEN;
+void sha1_pbkdf2_iterate(const DWORD *inner, const DWORD *outer, DWORD *u, DWORD *t,
+                         ULONG64 count) DECLSPEC_HIDDEN;
+
 typedef struct
 {
     ULONG64 len;
@@ -42,6 +67,8 @@ typedef struct
 void sha256_init(SHA256_CTX *ctx) DECLSPEC_HIDDEN;
 void sha256_update(SHA256_CTX *ctx, const UCHAR *buffer, ULONG len) DECLSPEC_HIDDEN;
 void sha256_finalize(SHA256_CTX *ctx, UCHAR *buffer) DECLSPEC_HIDDEN;
+void sha256_pbkdf2_iterate(const DWORD *inner, const DWORD *outer, DWORD *u, DWORD *t,
+                           ULONG lanes, ULONG64 count) DECLSPEC_HIDDEN;
 
 typedef struct
 {
@@ -67,6 +94,35 @@ void md2_init(MD2_CTX *ctx) DECLSPEC_HIDDEN;
 void md2_update(MD2_CTX *ctx, const unsigned char *buf, ULONG len) DECLSPEC_HIDDEN;
 void md2_finalize(MD2_CTX *ctx, unsigned char *hash) DECLSPEC_HIDDEN;
 
+#define AES_BLOCK_SIZE 16
+#define AES_MAX_ROUNDS 14
+
+/* keep it 16 byte aligned, or the AES-NI kernels are not used */
+struct aes_key
+{
+    UCHAR enc[(AES_MAX_ROUNDS + 1) * AES_BLOCK_SIZE];
+    UCHAR dec[(AES_MAX_ROUNDS + 1) * AES_BLOCK_SIZE];
+    ULONG rounds;
+};
+
+struct ghash_key
+{
+    UCHAR   h[AES_BLOCK_SIZE];
+    ULONG64 hl[16];
+    ULONG64 hh[16];
+};
+
+BOOL aes_set_key(struct aes_key *key, const UCHAR *secret, ULONG len) DECLSPEC_HIDDEN;
+void aes_encrypt_ecb(const struct aes_key *key, const UCHAR *in, UCHAR *out, SIZE_T blocks) DECLSPEC_HIDDEN;
+void aes_decrypt_ecb(const struct aes_key *key, const UCHAR *in, UCHAR *out, SIZE_T blocks) DECLSPEC_HIDDEN;
+void aes_encrypt_cbc(const struct aes_key *key, UCHAR *iv, const UCHAR *in, UCHAR *out, SIZE_T blocks) DECLSPEC_HIDDEN;
+void aes_decrypt_cbc(const struct aes_key *key, UCHAR *iv, const UCHAR *in, UCHAR *out, SIZE_T blocks) DECLSPEC_HIDDEN;
+void aes_encrypt_cfb(const struct aes_key *key, UCHAR *iv, ULONG segment, const UCHAR *in, UCHAR *out, SIZE_T len) DECLSPEC_HIDDEN;
+void aes_decrypt_cfb(const struct aes_key *key, UCHAR *iv, ULONG segment, const UCHAR *in, UCHAR *out, SIZE_T len) DECLSPEC_HIDDEN;
+void aes_encrypt_ctr32(const struct aes_key *key, UCHAR *counter, const UCHAR *in, UCHAR *out, SIZE_T blocks) DECLSPEC_HIDDEN;
+void ghash_set_key(struct ghash_key *key, const UCHAR *h) DECLSPEC_HIDDEN;
+void ghash_update(const struct ghash_key *key, UCHAR *x, const UCHAR *in, SIZE_T blocks) DECLSPEC_HIDDEN;
+
 /* Definitions from advapi32 */
 typedef struct tagMD4_CTX {
     unsigned int buf[4];
@@ -91,18 +147,6 @@ VOID WINAPI MD5Init(MD5_CTX *ctx);
 VOID WINAPI MD5Update(MD5_CTX *ctx, const unsigned char *buf, unsigned int len);
 VOID WINAPI MD5Final(MD5_CTX *ctx);
 
-typedef struct
-{
-   ULONG Unknown[6];
-   ULONG State[5];
-   ULONG Count[2];
-   UCHAR Buffer[64];
-} SHA_CTX;
-
-VOID WINAPI A_SHAInit(SHA_CTX *ctx);
-VOID WINAPI A_SHAUpdate(SHA_CTX *ctx, const UCHAR *buffer, UINT size);
-VOID WINAPI A_SHAFinal(SHA_CTX *ctx, PULONG result);
-
 #define MAGIC_ALG  (('A' << 24) | ('L' << 16) | ('G' << 8) | '0')
 #define MAGIC_HASH (('H' << 24) | ('A' << 16) | ('S' << 8) | 'H')
 #define MAGIC_KEY  (('K' << 24) | ('E' << 16) | ('Y' << 8) | '0')
@@ -147,6 +191,7 @@ enum mode_id
 {
     MODE_ID_ECB,
     MODE_ID_CBC,
+    MODE_ID_CFB,
     MODE_ID_GCM
 };
 
@@ -162,6 +207,7 @@ struct key_symmetric
 {
     enum mode_id mode;
     ULONG        block_size;
+    ULONG        msg_block_len;  /* CFB feedback size */
     UCHAR       *vector;
     ULONG        vector_len;
     UCHAR       *secret;
@@ -221,6 +267,8 @@ struct key_funcs
     NTSTATUS (CDECL *key_import_rsa)( struct key *, UCHAR *, ULONG );
 };
 
+extern const struct key_funcs builtin_key_funcs DECLSPEC_HIDDEN;
+
 #define RtlGenRandom                    SystemFunction036
 
 BOOLEAN WINAPI RtlGenRandom(PVOID,ULONG);
@@ -27,6 +27,9 @@
 #include "wincrypt.h"
 #include "wine/winternl.h"
 #include "bcrypt.h"
+#if defined(__i386__) || defined(__x86_64__)
+#include <intrin.h>
+#endif
 
 #include "bcrypt_internal.h"
 
@@ -39,6 +42,29 @@ static HINSTANCE instance;
 
 static const struct key_funcs *key_funcs;
 
+ULONG cpu_features;
+
+static void init_cpu_features(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    int regs[4];
+
+    __cpuid( regs, 0 );
+    if (regs[0] < 1) return;
+
+    __cpuid( regs, 1 );
+    if (regs[3] & (1 << 26)) cpu_features |= CPU_FEATURE_SSE2;
+    if ((regs[2] & (1 << 9)) && (regs[2] & (1 << 25))) cpu_features |= CPU_FEATURE_AESNI;
+    if ((regs[2] & (1 << 9)) && (regs[2] & (1 << 1))) cpu_features |= CPU_FEATURE_PCLMUL;
+    if (!(regs[2] & (1 << 19))) return;
+
+    __cpuid( regs, 0 );
+    if (regs[0] < 7) return;
+    __cpuidex( regs, 7, 0 );
+    if (regs[1] & (1 << 29)) cpu_features |= CPU_FEATURE_SHA;
+#endif
+}
+
 NTSTATUS WINAPI BCryptAddContextFunction(ULONG table, LPCWSTR context, ULONG iface, LPCWSTR function, ULONG pos)
 {
     FIXME("%08x, %s, %08x, %s, %u: stub\n", table, debugstr_w(context), iface, debugstr_w(function), pos);
@@ -287,7 +313,7 @@ struct hash_impl
         MD2_CTX md2;
         MD4_CTX md4;
         MD5_CTX md5;
-        SHA_CTX sha1;
+        SHA1_CTX sha1;
         SHA256_CTX sha256;
         SHA512_CTX sha512;
     } u;
@@ -310,7 +336,7 @@ static NTSTATUS hash_init( struct hash_impl *hash, enum alg_id alg_id )
         break;
 
     case ALG_ID_SHA1:
-        A_SHAInit( &hash->u.sha1 );
+        sha1_init( &hash->u.sha1 );
         break;
 
     case ALG_ID_SHA256:
@@ -350,7 +376,7 @@ static NTSTATUS hash_update( struct hash_impl *hash, enum alg_id alg_id,
         break;
 
     case ALG_ID_SHA1:
-        A_SHAUpdate( &hash->u.sha1, input, size );
+        sha1_update( &hash->u.sha1, input, size );
         break;
 
     case ALG_ID_SHA256:
@@ -392,7 +418,7 @@ static NTSTATUS hash_finish( struct hash_impl *hash, enum alg_id alg_id,
         break;
 
     case ALG_ID_SHA1:
-        A_SHAFinal( &hash->u.sha1, (ULONG *)output );
+        sha1_finalize( &hash->u.sha1, output );
         break;
 
     case ALG_ID_SHA256:
@@ -525,6 +551,7 @@ static NTSTATUS get_aes_property( enum mode_id mode, const WCHAR *prop, UCHAR *b
         {
         case MODE_ID_ECB: str = BCRYPT_CHAIN_MODE_ECB; break;
         case MODE_ID_CBC: str = BCRYPT_CHAIN_MODE_CBC; break;
+        case MODE_ID_CFB: str = BCRYPT_CHAIN_MODE_CFB; break;
         case MODE_ID_GCM: str = BCRYPT_CHAIN_MODE_GCM; break;
         default: return STATUS_NOT_IMPLEMENTED;
         }
@@ -652,6 +679,11 @@ static NTSTATUS set_alg_property( struct algorithm *alg, const WCHAR *prop, UCHA
                 alg->mode = MODE_ID_CBC;
                 return STATUS_SUCCESS;
             }
+            else if (!wcscmp( (WCHAR *)value, BCRYPT_CHAIN_MODE_CFB ))
+            {
+                alg->mode = MODE_ID_CFB;
+                return STATUS_SUCCESS;
+            }
             else if (!wcscmp( (WCHAR *)value, BCRYPT_CHAIN_MODE_GCM ))
             {
                 alg->mode = MODE_ID_GCM;
@@ -691,6 +723,14 @@ static NTSTATUS get_key_property( const struct key *key, const WCHAR *prop, UCHA
 
     case ALG_ID_AES:
         if (!wcscmp( prop, BCRYPT_AUTH_TAG_LENGTH )) return STATUS_NOT_SUPPORTED;
+        if (!wcscmp( prop, BCRYPT_MESSAGE_BLOCK_LENGTH ))
+        {
+            if (key->u.s.mode != MODE_ID_CFB) return STATUS_NOT_SUPPORTED;
+            *ret_size = sizeof(ULONG);
+            if (size < sizeof(ULONG)) return STATUS_BUFFER_TOO_SMALL;
+            if (buf) *(ULONG *)buf = key->u.s.msg_block_len;
+            return STATUS_SUCCESS;
+        }
         return get_aes_property( key->u.s.mode, prop, buf, size, ret_size );
 
     default:
@@ -986,6 +1026,13 @@ static BOOL is_equal_vector( const UCHAR *vector, ULONG len, const UCHAR *vector
     return !memcmp( vector, vector2, len );
 }
 
+/* CFB works on segments of the message block length, the other modes on whole blocks */
+static ULONG get_message_block_length( const struct key *key )
+{
+    if (key->u.s.mode == MODE_ID_CFB) return key->u.s.msg_block_len;
+    return key->u.s.block_size;
+}
+
 static NTSTATUS key_symmetric_set_vector( struct key *key, UCHAR *vector, ULONG vector_len )
 {
     BOOL needs_reset = (!is_zero_vector( vector, vector_len ) ||
@@ -1093,7 +1140,7 @@ static NTSTATUS key_export( struct key *key, const WCHAR *type, UCHAR *output, U
 static NTSTATUS key_symmetric_encrypt( struct key *key,  UCHAR *input, ULONG input_len, void *padding, UCHAR *iv,
                                        ULONG iv_len, UCHAR *output, ULONG output_len, ULONG *ret_len, ULONG flags )
 {
-    ULONG bytes_left = input_len;
+    ULONG bytes_left = input_len, len;
     UCHAR *buf, *src, *dst;
     NTSTATUS status;
 
@@ -1127,7 +1174,7 @@ static NTSTATUS key_symmetric_encrypt( struct key *key,  UCHAR *input, ULONG inp
 
     if (flags & BCRYPT_BLOCK_PADDING)
         *ret_len = (input_len + key->u.s.block_size) & ~(key->u.s.block_size - 1);
-    else if (input_len & (key->u.s.block_size - 1))
+    else if (input_len & (get_message_block_length( key ) - 1))
         return STATUS_INVALID_BUFFER_SIZE;
 
     if (!output) return STATUS_SUCCESS;
@@ -1135,18 +1182,15 @@ static NTSTATUS key_symmetric_encrypt( struct key *key,  UCHAR *input, ULONG inp
     if (key->u.s.mode == MODE_ID_ECB && iv) return STATUS_INVALID_PARAMETER;
     if ((status = key_symmetric_set_vector( key, iv, iv_len ))) return status;
 
+    /* everything but the padded tail goes to the backend in one call */
     src = input;
     dst = output;
-    while (bytes_left >= key->u.s.block_size)
-    {
-        if ((status = key_funcs->key_symmetric_encrypt( key, src, key->u.s.block_size, dst, key->u.s.block_size )))
-            return status;
-        if (key->u.s.mode == MODE_ID_ECB && (status = key_symmetric_set_vector( key, NULL, 0 )))
-            return status;
-        bytes_left -= key->u.s.block_size;
-        src += key->u.s.block_size;
-        dst += key->u.s.block_size;
-    }
+    len = bytes_left;
+    if (flags & BCRYPT_BLOCK_PADDING) len &= ~(key->u.s.block_size - 1);
+    if (len && (status = key_funcs->key_symmetric_encrypt( key, src, len, dst, len ))) return status;
+    bytes_left -= len;
+    src += len;
+    dst += len;
 
     if (flags & BCRYPT_BLOCK_PADDING)
     {
@@ -1197,7 +1241,7 @@ static NTSTATUS key_symmetric_decrypt( struct key *key, UCHAR *input, ULONG inpu
 
     *ret_len = input_len;
 
-    if (input_len & (key->u.s.block_size - 1)) return STATUS_INVALID_BUFFER_SIZE;
+    if (input_len & (get_message_block_length( key ) - 1)) return STATUS_INVALID_BUFFER_SIZE;
     if (!output) return STATUS_SUCCESS;
     if (flags & BCRYPT_BLOCK_PADDING)
     {
@@ -1212,16 +1256,10 @@ static NTSTATUS key_symmetric_decrypt( struct key *key, UCHAR *input, ULONG inpu
 
     src = input;
     dst = output;
-    while (bytes_left >= key->u.s.block_size)
-    {
-        if ((status = key_funcs->key_symmetric_decrypt( key, src, key->u.s.block_size, dst, key->u.s.block_size )))
-            return status;
-        if (key->u.s.mode == MODE_ID_ECB && (status = key_symmetric_set_vector( key, NULL, 0 )))
-            return status;
-        bytes_left -= key->u.s.block_size;
-        src += key->u.s.block_size;
-        dst += key->u.s.block_size;
-    }
+    if (bytes_left && (status = key_funcs->key_symmetric_decrypt( key, src, bytes_left, dst, bytes_left )))
+        return status;
+    src += bytes_left;
+    dst += bytes_left;
 
     if (flags & BCRYPT_BLOCK_PADDING)
     {
@@ -1467,6 +1505,7 @@ NTSTATUS WINAPI BCryptGenerateSymmetricKey( BCRYPT_ALG_HANDLE algorithm, BCRYPT_
     key->alg_id         = alg->id;
     key->u.s.mode       = alg->mode;
     key->u.s.block_size = block_size;
+    key->u.s.msg_block_len = 1;
 
     if (!(key->u.s.secret = heap_alloc( secret_len )))
     {
@@ -1569,6 +1608,7 @@ static NTSTATUS key_duplicate( struct key *key_orig, struct key *key_copy )
 
         key_copy->u.s.mode       = key_orig->u.s.mode;
         key_copy->u.s.block_size = key_orig->u.s.block_size;
+        key_copy->u.s.msg_block_len = key_orig->u.s.msg_block_len;
         key_copy->u.s.secret     = buffer;
         key_copy->u.s.secret_len = key_orig->u.s.secret_len;
         InitializeCriticalSection( &key_copy->u.s.cs );
@@ -1822,60 +1862,135 @@ NTSTATUS WINAPI BCryptDeriveKeyCapi( BCRYPT_HASH_HANDLE handle, BCRYPT_ALG_HANDL
     return STATUS_SUCCESS;
 }
 
-static NTSTATUS pbkdf2( struct hash *hash, UCHAR *pwd, ULONG pwd_len, UCHAR *salt, ULONG salt_len,
-                        ULONGLONG iterations, ULONG i, UCHAR *dst, ULONG hash_len )
+#define PBKDF2_MAX_LANES        4
+#define PBKDF2_MAX_THREADS      16
+#define PBKDF2_THREAD_MIN_ITERS 1000
+
+struct pbkdf2
+{
+    enum alg_id       alg_id;
+    ULONG             hash_len;
+    const UCHAR      *salt;
+    ULONG             salt_len;
+    ULONGLONG         iterations;
+    UCHAR            *dk;
+    ULONG             dk_len;
+    ULONG             block_count;
+    ULONG             lanes;        /* blocks derived together */
+    ULONG             groups;
+    LONG              next_group;
+    struct hash_impl  inner;        /* HMAC states after the padded key */
+    struct hash_impl  outer;
+};
+
+static void pbkdf2_hmac( const struct pbkdf2 *ctx, struct hash_impl *inner, UCHAR *output )
+{
+    struct hash_impl outer = ctx->outer;
+    UCHAR buffer[MAX_HASH_OUTPUT_BYTES];
+
+    hash_finish( inner, ctx->alg_id, buffer, ctx->hash_len );
+    hash_update( &outer, ctx->alg_id, buffer, ctx->hash_len );
+    hash_finish( &outer, ctx->alg_id, output, ctx->hash_len );
+}
+
+static void pbkdf2_load( DWORD *words, const UCHAR *bytes, ULONG len )
+{
+    ULONG i;
+    for (i = 0; i < len / 4; i++)
+        words[i] = ((DWORD)bytes[4 * i] << 24) | (bytes[4 * i + 1] << 16) | (bytes[4 * i + 2] << 8) | bytes[4 * i + 3];
+}
+
+static void pbkdf2_store( UCHAR *bytes, const DWORD *words, ULONG len )
 {
-    NTSTATUS status = STATUS_INVALID_PARAMETER;
-    UCHAR bytes[4], *buf;
-    ULONG j, k;
+    ULONG i;
+    for (i = 0; i < len; i++) bytes[i] = words[i / 4] >> (24 - 8 * (i % 4));
+}
 
-    if (!(buf = heap_alloc( hash_len ))) return STATUS_NO_MEMORY;
+/* derives blocks first to first + lanes - 1, numbered from 1 */
+static void pbkdf2_group( const struct pbkdf2 *ctx, ULONG first )
+{
+    DWORD u[PBKDF2_MAX_LANES * 8], t[PBKDF2_MAX_LANES * 8];
+    UCHAR buf[MAX_HASH_OUTPUT_BYTES], sum[MAX_HASH_OUTPUT_BYTES], bytes[4];
+    ULONG lanes = min( ctx->lanes, ctx->block_count - first + 1 ), offset, lane, i;
+    struct hash_impl hash;
+    ULONGLONG j;
 
-    for (j = 0; j < iterations; j++)
+    for (lane = 0; lane < lanes; lane++)
     {
-        if (j == 0)
+        /* U_1 = PRF(P, S || INT(i)) */
+        hash = ctx->inner;
+        hash_update( &hash, ctx->alg_id, (UCHAR *)ctx->salt, ctx->salt_len );
+        bytes[0] = ((first + lane) >> 24) & 0xff;
+        bytes[1] = ((first + lane) >> 16) & 0xff;
+        bytes[2] = ((first + lane) >> 8) & 0xff;
+        bytes[3] = (first + lane) & 0xff;
+        hash_update( &hash, ctx->alg_id, bytes, 4 );
+        pbkdf2_hmac( ctx, &hash, buf );
+
+        switch (ctx->alg_id)
         {
-            /* use salt || INT(i) */
-            if ((status = hash_update( &hash->inner, hash->alg_id, salt, salt_len )))
+        case ALG_ID_SHA1:
+        case ALG_ID_SHA256:
+            pbkdf2_load( u + 8 * lane, buf, ctx->hash_len );
+            memcpy( t + 8 * lane, u + 8 * lane, ctx->hash_len );
+            break;
+
+        default:
+            /* U_j = PRF(P, U_{j-1}) starting from the saved midstates */
+            memcpy( sum, buf, ctx->hash_len );
+            for (j = 1; j < ctx->iterations; j++)
             {
-                heap_free( buf );
-                return status;
+                hash = ctx->inner;
+                hash_update( &hash, ctx->alg_id, buf, ctx->hash_len );
+                pbkdf2_hmac( ctx, &hash, buf );
+                for (i = 0; i < ctx->hash_len; i++) sum[i] ^= buf[i];
             }
-            bytes[0] = (i >> 24) & 0xff;
-            bytes[1] = (i >> 16) & 0xff;
-            bytes[2] = (i >> 8) & 0xff;
-            bytes[3] = i & 0xff;
-            status = hash_update( &hash->inner, hash->alg_id, bytes, 4 );
+            offset = (first + lane - 1) * ctx->hash_len;
+            memcpy( ctx->dk + offset, sum, min( ctx->hash_len, ctx->dk_len - offset ) );
+            break;
         }
-        else status = hash_update( &hash->inner, hash->alg_id, buf, hash_len ); /* use U_j */
+    }
 
-        if (status)
-        {
-            heap_free( buf );
-            return status;
-        }
+    switch (ctx->alg_id)
+    {
+    case ALG_ID_SHA1:
+        sha1_pbkdf2_iterate( ctx->inner.u.sha1.h, ctx->outer.u.sha1.h, u, t, ctx->iterations - 1 );
+        break;
 
-        if ((status = hash_finalize( hash, buf, hash_len )))
-        {
-            heap_free( buf );
-            return status;
-        }
+    case ALG_ID_SHA256:
+        sha256_pbkdf2_iterate( ctx->inner.u.sha256.h, ctx->outer.u.sha256.h, u, t, lanes, ctx->iterations - 1 );
+        break;
 
-        if (j == 0) memcpy( dst, buf, hash_len );
-        else for (k = 0; k < hash_len; k++) dst[k] ^= buf[k];
+    default:
+        return;
     }
 
-    heap_free( buf );
-    return status;
+    for (lane = 0; lane < lanes; lane++)
+    {
+        offset = (first + lane - 1) * ctx->hash_len;
+        pbkdf2_store( ctx->dk + offset, t + 8 * lane, min( ctx->hash_len, ctx->dk_len - offset ) );
+    }
+}
+
+static DWORD CALLBACK pbkdf2_thread( void *arg )
+{
+    struct pbkdf2 *ctx = arg;
+    LONG group;
+
+    while ((group = InterlockedIncrement( &ctx->next_group ) - 1) < (LONG)ctx->groups)
+        pbkdf2_group( ctx, group * ctx->lanes + 1 );
+    return 0;
 }
 
 NTSTATUS WINAPI BCryptDeriveKeyPBKDF2( BCRYPT_ALG_HANDLE handle, UCHAR *pwd, ULONG pwd_len, UCHAR *salt, ULONG salt_len,
                                        ULONGLONG iterations, UCHAR *dk, ULONG dk_len, ULONG flags )
 {
     struct algorithm *alg = handle;
-    ULONG hash_len, block_count, bytes_left, i;
-    struct hash *hash;
-    UCHAR *partial;
+    HANDLE threads[PBKDF2_MAX_THREADS - 1];
+    ULONG hash_len, thread_count = 0, i;
+    struct pbkdf2 ctx;
+    struct hash hash;
+    SYSTEM_INFO info;
     NTSTATUS status;
 
     TRACE( "%p, %p, %u, %p, %u, %s, %p, %u, %08x\n", handle, pwd, pwd_len, salt, salt_len,
@@ -1885,39 +2000,56 @@ NTSTATUS WINAPI BCryptDeriveKeyPBKDF2( BCRYPT_ALG_HANDLE handle, UCHAR *pwd, ULO
 
     hash_len = builtin_algorithms[alg->id].hash_length;
     if (dk_len <= 0 || dk_len > ((((ULONGLONG)1) << 32) - 1) * hash_len) return STATUS_INVALID_PARAMETER;
-
-    block_count = 1 + ((dk_len - 1) / hash_len); /* ceil(dk_len / hash_len) */
-    bytes_left = dk_len - (block_count - 1) * hash_len;
-
-    if ((status = hash_create( alg, pwd, pwd_len, BCRYPT_HASH_REUSABLE_FLAG, &hash ))) return status;
-
-    /* full blocks */
-    for (i = 1; i < block_count; i++)
-    {
-        if ((status = pbkdf2( hash, pwd, pwd_len, salt, salt_len, iterations, i, dk + ((i - 1) * hash_len), hash_len )))
+    if (!iterations) return STATUS_INVALID_PARAMETER;
+
+    /* the keyed pads are hashed once, every iteration starts from a copy */
+    memset( &hash, 0, sizeof(hash) );
+    hash.alg_id     = alg->id;
+    hash.flags      = HASH_FLAG_HMAC;
+    hash.secret     = pwd;
+    hash.secret_len = pwd_len;
+    if ((status = hash_prepare( &hash ))) return status;
+
+    ctx.alg_id      = alg->id;
+    ctx.hash_len    = hash_len;
+    ctx.salt        = salt;
+    ctx.salt_len    = salt_len;
+    ctx.iterations  = iterations;
+    ctx.dk          = dk;
+    ctx.dk_len      = dk_len;
+    ctx.block_count = 1 + ((dk_len - 1) / hash_len); /* ceil(dk_len / hash_len) */
+    ctx.lanes       = 1;
+    ctx.next_group  = 0;
+    ctx.inner       = hash.inner;
+    ctx.outer       = hash.outer;
+    SecureZeroMemory( &hash, sizeof(hash) );
+
+    if (alg->id == ALG_ID_SHA256 && ctx.block_count > 1 &&
+        (cpu_features & (CPU_FEATURE_SSE2 | CPU_FEATURE_SHA)) == CPU_FEATURE_SSE2)
+        ctx.lanes = PBKDF2_MAX_LANES;
+    ctx.groups = (ctx.block_count + ctx.lanes - 1) / ctx.lanes;
+
+    /* the blocks are independent, long derivations spread them over the processors */
+    if (ctx.groups > 1 && iterations >= PBKDF2_THREAD_MIN_ITERS)
+    {
+        GetSystemInfo( &info );
+        thread_count = min( min( ctx.groups, info.dwNumberOfProcessors ), PBKDF2_MAX_THREADS ) - 1;
+        for (i = 0; i < thread_count; i++)
         {
-            hash_destroy( hash );
-            return status;
+            if (!(threads[i] = CreateThread( NULL, 0, pbkdf2_thread, &ctx, 0, NULL ))) break;
         }
+        thread_count = i;
     }
 
-    /* final partial block */
-    if (!(partial = heap_alloc( hash_len )))
-    {
-        hash_destroy( hash );
-        return STATUS_NO_MEMORY;
-    }
+    pbkdf2_thread( &ctx );
 
-    if ((status = pbkdf2( hash, pwd, pwd_len, salt, salt_len, iterations, block_count, partial, hash_len )))
+    if (thread_count)
     {
-        hash_destroy( hash );
-        heap_free( partial );
-        return status;
+        WaitForMultipleObjects( thread_count, threads, TRUE, INFINITE );
+        for (i = 0; i < thread_count; i++) CloseHandle( threads[i] );
     }
-    memcpy( dk + ((block_count - 1) * hash_len), partial, bytes_left );
 
-    hash_destroy( hash );
-    heap_free( partial );
+    SecureZeroMemory( &ctx, sizeof(ctx) );
     return STATUS_SUCCESS;
 }
 
@@ -1972,9 +2104,11 @@ BOOL WINAPI DllMain( HINSTANCE hinst, DWORD reason, LPVOID reserved )
     case DLL_PROCESS_ATTACH:
         instance = hinst;
         DisableThreadLibraryCalls( hinst );
+        init_cpu_features();
 #if defined(HAVE_GNUTLS_CIPHER_INIT) && !defined(HAVE_COMMONCRYPTO_COMMONCRYPTOR_H)		
         __wine_init_unix_lib( hinst, reason, NULL, &key_funcs );
 #endif		
+        if (!key_funcs) key_funcs = &builtin_key_funcs;
         break;
     case DLL_PROCESS_DETACH:
         if (reserved) break;
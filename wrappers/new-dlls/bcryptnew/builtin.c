@@ -0,0 +1,461 @@
+/*
+ * Built-in symmetric cipher backend
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ */
+
+/* Used when no gnutls or CommonCrypto backend is available. Only AES is
+ * supported, on top of aes.c, in ECB, CBC, CFB and GCM modes. */
+
+#include <stdarg.h>
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winbase.h"
+#include "bcrypt.h"
+
+#include "bcrypt_internal.h"
+
+#include "wine/debug.h"
+#include "wine/heap.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(bcrypt);
+
+struct key_data
+{
+    struct aes_key   aes;                   /* must stay 16 byte aligned */
+    struct ghash_key ghash;
+    BOOL             ready;                 /* iv holds the chaining state for the current vector */
+    UCHAR            iv[AES_BLOCK_SIZE];    /* chaining value, CFB register or GCM counter */
+    UCHAR            j0[AES_BLOCK_SIZE];    /* GCM pre-counter block */
+    UCHAR            x[AES_BLOCK_SIZE];     /* GHASH accumulator */
+    UCHAR            hash_buf[AES_BLOCK_SIZE];
+    ULONG            hash_len;              /* bytes in hash_buf */
+    UCHAR            stream[AES_BLOCK_SIZE];
+    ULONG            stream_pos;            /* used bytes of the keystream block */
+    BOOL             auth_done;             /* additional data was padded */
+    ULONG64          auth_len;
+    ULONG64          text_len;
+};
+
+static struct key_data *key_data( struct key *key )
+{
+    struct key_data *data;
+    UCHAR zero[AES_BLOCK_SIZE] = {0}, h[AES_BLOCK_SIZE];
+    void *ptr;
+
+    /* created on first use, duplicated keys start without it */
+    if (key->private[0]) return key->private[0];
+
+    if (!(ptr = heap_alloc_zero( sizeof(*data) + 15 ))) return NULL;
+    data = (struct key_data *)(((ULONG_PTR)ptr + 15) & ~(ULONG_PTR)15);
+    if (!aes_set_key( &data->aes, key->u.s.secret, key->u.s.secret_len ))
+    {
+        heap_free( ptr );
+        return NULL;
+    }
+    aes_encrypt_ecb( &data->aes, zero, h, 1 );
+    ghash_set_key( &data->ghash, h );
+
+    key->private[0] = data;
+    key->private[1] = ptr;
+    return data;
+}
+
+static void gcm_hash( struct key_data *data, const UCHAR *in, ULONG len )
+{
+    ULONG count;
+
+    if (data->hash_len)
+    {
+        count = min( len, AES_BLOCK_SIZE - data->hash_len );
+        memcpy( data->hash_buf + data->hash_len, in, count );
+        data->hash_len += count;
+        in += count;
+        len -= count;
+        if (data->hash_len < AES_BLOCK_SIZE) return;
+        ghash_update( &data->ghash, data->x, data->hash_buf, 1 );
+        data->hash_len = 0;
+    }
+    if (len >= AES_BLOCK_SIZE)
+    {
+        ghash_update( &data->ghash, data->x, in, len / AES_BLOCK_SIZE );
+        in += len & ~(AES_BLOCK_SIZE - 1);
+        len &= AES_BLOCK_SIZE - 1;
+    }
+    memcpy( data->hash_buf, in, len );
+    data->hash_len = len;
+}
+
+static void gcm_hash_pad( struct key_data *data )
+{
+    if (!data->hash_len) return;
+    memset( data->hash_buf + data->hash_len, 0, AES_BLOCK_SIZE - data->hash_len );
+    ghash_update( &data->ghash, data->x, data->hash_buf, 1 );
+    data->hash_len = 0;
+}
+
+static void gcm_put_len( UCHAR *buf, ULONG64 len )
+{
+    int i;
+    for (i = 7; i >= 0; i--, len >>= 8) buf[i] = (UCHAR)len;
+}
+
+static void gcm_start( struct key *key, struct key_data *data )
+{
+    UCHAR block[AES_BLOCK_SIZE];
+
+    memset( data->x, 0, sizeof(data->x) );
+    data->hash_len = 0;
+
+    if (key->u.s.vector_len == 12)
+    {
+        memcpy( data->j0, key->u.s.vector, 12 );
+        data->j0[12] = data->j0[13] = data->j0[14] = 0;
+        data->j0[15] = 1;
+    }
+    else
+    {
+        /* other nonce sizes are hashed down to a counter block */
+        gcm_hash( data, key->u.s.vector, key->u.s.vector_len );
+        gcm_hash_pad( data );
+        memset( block, 0, 8 );
+        gcm_put_len( block + 8, (ULONG64)key->u.s.vector_len * 8 );
+        ghash_update( &data->ghash, data->x, block, 1 );
+        memcpy( data->j0, data->x, AES_BLOCK_SIZE );
+        memset( data->x, 0, sizeof(data->x) );
+    }
+
+    memcpy( data->iv, data->j0, AES_BLOCK_SIZE );
+    if (!++data->iv[15] && !++data->iv[14] && !++data->iv[13]) ++data->iv[12];
+
+    data->stream_pos = AES_BLOCK_SIZE;
+    data->auth_done  = FALSE;
+    data->auth_len   = 0;
+    data->text_len   = 0;
+}
+
+static void gcm_crypt( struct key_data *data, const UCHAR *in, UCHAR *out, ULONG len )
+{
+    ULONG blocks;
+
+    while (len && data->stream_pos < AES_BLOCK_SIZE)
+    {
+        *out++ = *in++ ^ data->stream[data->stream_pos++];
+        len--;
+    }
+    if ((blocks = len / AES_BLOCK_SIZE))
+    {
+        aes_encrypt_ctr32( &data->aes, data->iv, in, out, blocks );
+        in += blocks * AES_BLOCK_SIZE;
+        out += blocks * AES_BLOCK_SIZE;
+        len -= blocks * AES_BLOCK_SIZE;
+    }
+    if (len)
+    {
+        memset( data->stream, 0, sizeof(data->stream) );
+        aes_encrypt_ctr32( &data->aes, data->iv, data->stream, data->stream, 1 );
+        for (data->stream_pos = 0; data->stream_pos < len; data->stream_pos++)
+            out[data->stream_pos] = in[data->stream_pos] ^ data->stream[data->stream_pos];
+    }
+}
+
+static struct key_data *get_chaining_state( struct key *key )
+{
+    struct key_data *data;
+
+    if (!(data = key_data( key ))) return NULL;
+    if (data->ready) return data;
+
+    if (key->u.s.mode == MODE_ID_GCM) gcm_start( key, data );
+    else
+    {
+        memset( data->iv, 0, sizeof(data->iv) );
+        if (key->u.s.vector) memcpy( data->iv, key->u.s.vector, min( key->u.s.vector_len, AES_BLOCK_SIZE ) );
+    }
+    data->ready = TRUE;
+    return data;
+}
+
+static NTSTATUS CDECL key_set_property( struct key *key, const WCHAR *prop, UCHAR *value, ULONG size, ULONG flags )
+{
+    if (!wcscmp( prop, BCRYPT_CHAINING_MODE ))
+    {
+        if (!wcscmp( (WCHAR *)value, BCRYPT_CHAIN_MODE_ECB ))
+        {
+            key->u.s.mode = MODE_ID_ECB;
+            return STATUS_SUCCESS;
+        }
+        else if (!wcscmp( (WCHAR *)value, BCRYPT_CHAIN_MODE_CBC ))
+        {
+            key->u.s.mode = MODE_ID_CBC;
+            return STATUS_SUCCESS;
+        }
+        else if (!wcscmp( (WCHAR *)value, BCRYPT_CHAIN_MODE_CFB ))
+        {
+            key->u.s.mode = MODE_ID_CFB;
+            return STATUS_SUCCESS;
+        }
+        else if (!wcscmp( (WCHAR *)value, BCRYPT_CHAIN_MODE_GCM ))
+        {
+            key->u.s.mode = MODE_ID_GCM;
+            return STATUS_SUCCESS;
+        }
+        else
+        {
+            FIXME( "unsupported mode %s\n", debugstr_w((WCHAR *)value) );
+            return STATUS_NOT_IMPLEMENTED;
+        }
+    }
+    if (!wcscmp( prop, BCRYPT_MESSAGE_BLOCK_LENGTH ))
+    {
+        if (size < sizeof(ULONG)) return STATUS_INVALID_PARAMETER;
+        if (*(ULONG *)value != 1 && *(ULONG *)value != key->u.s.block_size) return STATUS_INVALID_PARAMETER;
+        key->u.s.msg_block_len = *(ULONG *)value;
+        return STATUS_SUCCESS;
+    }
+
+    FIXME( "unsupported key property %s\n", debugstr_w(prop) );
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS CDECL key_symmetric_init( struct key *key )
+{
+    switch (key->alg_id)
+    {
+    case ALG_ID_AES:
+        if (key->u.s.secret_len != 16 && key->u.s.secret_len != 24 && key->u.s.secret_len != 32)
+            return STATUS_INVALID_PARAMETER;
+        return STATUS_SUCCESS;
+
+    default:
+        FIXME( "algorithm %u not supported\n", key->alg_id );
+        return STATUS_NOT_SUPPORTED;
+    }
+}
+
+static void CDECL key_symmetric_vector_reset( struct key *key )
+{
+    if (!key->private[0]) return;
+    TRACE( "resetting chaining state\n" );
+    ((struct key_data *)key->private[0])->ready = FALSE;
+}
+
+static NTSTATUS CDECL key_symmetric_set_auth_data( struct key *key, UCHAR *auth_data, ULONG len )
+{
+    struct key_data *data;
+
+    if (!auth_data) return STATUS_SUCCESS;
+    if (key->u.s.mode != MODE_ID_GCM) return STATUS_NOT_SUPPORTED;
+    if (!(data = get_chaining_state( key ))) return STATUS_NO_MEMORY;
+    if (data->auth_done) return STATUS_INVALID_PARAMETER;
+
+    gcm_hash( data, auth_data, len );
+    data->auth_len += len;
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS CDECL key_symmetric_encrypt( struct key *key, const UCHAR *input, ULONG input_len, UCHAR *output, ULONG output_len )
+{
+    struct key_data *data;
+
+    if (!(data = get_chaining_state( key ))) return STATUS_NO_MEMORY;
+
+    switch (key->u.s.mode)
+    {
+    case MODE_ID_ECB:
+        aes_encrypt_ecb( &data->aes, input, output, input_len / AES_BLOCK_SIZE );
+        return STATUS_SUCCESS;
+
+    case MODE_ID_CBC:
+        aes_encrypt_cbc( &data->aes, data->iv, input, output, input_len / AES_BLOCK_SIZE );
+        return STATUS_SUCCESS;
+
+    case MODE_ID_CFB:
+        aes_encrypt_cfb( &data->aes, data->iv, key->u.s.msg_block_len, input, output, input_len );
+        return STATUS_SUCCESS;
+
+    case MODE_ID_GCM:
+        if (!data->auth_done)
+        {
+            gcm_hash_pad( data );
+            data->auth_done = TRUE;
+        }
+        gcm_crypt( data, input, output, input_len );
+        gcm_hash( data, output, input_len );
+        data->text_len += input_len;
+        return STATUS_SUCCESS;
+
+    default:
+        FIXME( "mode %u not supported\n", key->u.s.mode );
+        return STATUS_NOT_SUPPORTED;
+    }
+}
+
+static NTSTATUS CDECL key_symmetric_decrypt( struct key *key, const UCHAR *input, ULONG input_len, UCHAR *output, ULONG output_len )
+{
+    struct key_data *data;
+
+    if (!(data = get_chaining_state( key ))) return STATUS_NO_MEMORY;
+
+    switch (key->u.s.mode)
+    {
+    case MODE_ID_ECB:
+        aes_decrypt_ecb( &data->aes, input, output, input_len / AES_BLOCK_SIZE );
+        return STATUS_SUCCESS;
+
+    case MODE_ID_CBC:
+        aes_decrypt_cbc( &data->aes, data->iv, input, output, input_len / AES_BLOCK_SIZE );
+        return STATUS_SUCCESS;
+
+    case MODE_ID_CFB:
+        aes_decrypt_cfb( &data->aes, data->iv, key->u.s.msg_block_len, input, output, input_len );
+        return STATUS_SUCCESS;
+
+    case MODE_ID_GCM:
+        if (!data->auth_done)
+        {
+            gcm_hash_pad( data );
+            data->auth_done = TRUE;
+        }
+        gcm_hash( data, input, input_len );
+        gcm_crypt( data, input, output, input_len );
+        data->text_len += input_len;
+        return STATUS_SUCCESS;
+
+    default:
+        FIXME( "mode %u not supported\n", key->u.s.mode );
+        return STATUS_NOT_SUPPORTED;
+    }
+}
+
+static NTSTATUS CDECL key_symmetric_get_tag( struct key *key, UCHAR *tag, ULONG len )
+{
+    struct key_data *data;
+    UCHAR block[AES_BLOCK_SIZE];
+    ULONG i;
+
+    if (key->u.s.mode != MODE_ID_GCM) return STATUS_NOT_SUPPORTED;
+    if (len > AES_BLOCK_SIZE) return STATUS_INVALID_PARAMETER;
+    if (!(data = get_chaining_state( key ))) return STATUS_NO_MEMORY;
+
+    gcm_hash_pad( data );
+    gcm_put_len( block, data->auth_len * 8 );
+    gcm_put_len( block + 8, data->text_len * 8 );
+    ghash_update( &data->ghash, data->x, block, 1 );
+
+    aes_encrypt_ecb( &data->aes, data->j0, block, 1 );
+    for (i = 0; i < len; i++) tag[i] = block[i] ^ data->x[i];
+
+    /* the tag ends the message, the next one needs a new nonce anyway */
+    data->ready = FALSE;
+    return STATUS_SUCCESS;
+}
+
+static void CDECL key_symmetric_destroy( struct key *key )
+{
+    if (!key->private[1]) return;
+    SecureZeroMemory( key->private[0], sizeof(struct key_data) );
+    heap_free( key->private[1] );
+}
+
+static NTSTATUS CDECL key_asymmetric_init( struct key *key )
+{
+    FIXME( "asymmetric keys not supported without gnutls\n" );
+    return STATUS_NOT_SUPPORTED;
+}
+
+static NTSTATUS CDECL key_asymmetric_generate( struct key *key )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS CDECL key_asymmetric_decrypt( struct key *key, UCHAR *input, ULONG input_len, UCHAR *output,
+                                              ULONG output_len, ULONG *ret_len )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS CDECL key_asymmetric_duplicate( struct key *key_orig, struct key *key_copy )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS CDECL key_asymmetric_sign( struct key *key, void *padding, UCHAR *input, ULONG input_len, UCHAR *output,
+                                           ULONG output_len, ULONG *ret_len, ULONG flags )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS CDECL key_asymmetric_verify( struct key *key, void *padding, UCHAR *hash, ULONG hash_len,
+                                             UCHAR *signature, ULONG signature_len, DWORD flags )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static void CDECL key_asymmetric_destroy( struct key *key )
+{
+}
+
+static NTSTATUS CDECL key_export_dsa_capi( struct key *key, UCHAR *buf, ULONG len, ULONG *ret_len )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS CDECL key_export_ecc( struct key *key, UCHAR *output, ULONG len, ULONG *ret_len )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS CDECL key_import_dsa_capi( struct key *key, UCHAR *buf, ULONG len )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS CDECL key_import_ecc( struct key *key, UCHAR *input, ULONG len )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS CDECL key_import_rsa( struct key *key, UCHAR *input, ULONG len )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+const struct key_funcs builtin_key_funcs =
+{
+    key_set_property,
+    key_symmetric_init,
+    key_symmetric_vector_reset,
+    key_symmetric_set_auth_data,
+    key_symmetric_encrypt,
+    key_symmetric_decrypt,
+    key_symmetric_get_tag,
+    key_symmetric_destroy,
+    key_asymmetric_init,
+    key_asymmetric_generate,
+    key_asymmetric_decrypt,
+    key_asymmetric_duplicate,
+    key_asymmetric_sign,
+    key_asymmetric_verify,
+    key_asymmetric_destroy,
+    key_export_dsa_capi,
+    key_export_ecc,
+    key_import_dsa_capi,
+    key_import_ecc,
+    key_import_rsa
+};
@@ -621,6 +621,25 @@ static NTSTATUS CDECL key_symmetric_encrypt( struct key *key, const UCHAR *input
     NTSTATUS status;
     int ret;
 
+    if (key->u.s.mode == MODE_ID_ECB)
+    {
+        /* ECB is emulated with CBC, so the chaining restarts for every block */
+        for (; input_len >= key->u.s.block_size; input_len -= key->u.s.block_size)
+        {
+            if ((status = init_cipher_handle( key ))) return status;
+            if ((ret = pgnutls_cipher_encrypt2( key_data(key)->cipher, input, key->u.s.block_size,
+                                                output, key->u.s.block_size )))
+            {
+                pgnutls_perror( ret );
+                return STATUS_INTERNAL_ERROR;
+            }
+            key_symmetric_vector_reset( key );
+            input += key->u.s.block_size;
+            output += key->u.s.block_size;
+        }
+        return STATUS_SUCCESS;
+    }
+
     if ((status = init_cipher_handle( key ))) return status;
 
     if ((ret = pgnutls_cipher_encrypt2( key_data(key)->cipher, input, input_len, output, output_len )))
@@ -636,6 +655,25 @@ static NTSTATUS CDECL key_symmetric_decrypt( struct key *key, const UCHAR *input
     NTSTATUS status;
     int ret;
 
+    if (key->u.s.mode == MODE_ID_ECB)
+    {
+        /* ECB is emulated with CBC, so the chaining restarts for every block */
+        for (; input_len >= key->u.s.block_size; input_len -= key->u.s.block_size)
+        {
+            if ((status = init_cipher_handle( key ))) return status;
+            if ((ret = pgnutls_cipher_decrypt2( key_data(key)->cipher, input, key->u.s.block_size,
+                                                output, key->u.s.block_size )))
+            {
+                pgnutls_perror( ret );
+                return STATUS_INTERNAL_ERROR;
+            }
+            key_symmetric_vector_reset( key );
+            input += key->u.s.block_size;
+            output += key->u.s.block_size;
+        }
+        return STATUS_SUCCESS;
+    }
+
     if ((status = init_cipher_handle( key ))) return status;
 
     if ((ret = pgnutls_cipher_decrypt2( key_data(key)->cipher, input, input_len, output, output_len )))
@@ -0,0 +1,201 @@
+/*
+ * SHA-1 hash
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ */
+
+/* Same structure as sha256.c, the SHA-NI kernel is in shani-x86.S and shani-amd64.S */
+
+#include "bcrypt_internal.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+void CDECL shani_sha1_blocks(DWORD *state, const UCHAR *data, SIZE_T blocks);
+#endif
+
+static DWORD rol(DWORD n, int k) { return (n << k) | (n >> (32-k)); }
+#define F0(b,c,d) (d ^ (b & (c ^ d)))
+#define F1(b,c,d) (b ^ c ^ d)
+#define F2(b,c,d) ((b & c) | (d & (b | c)))
+
+static void processblock(DWORD *state, const UCHAR *buffer)
+{
+    DWORD W[80], t, a, b, c, d, e;
+    int i;
+
+    for (i = 0; i < 16; i++)
+    {
+        W[i]  = (DWORD)buffer[4*i]<<24;
+        W[i] |= (DWORD)buffer[4*i+1]<<16;
+        W[i] |= (DWORD)buffer[4*i+2]<<8;
+        W[i] |= buffer[4*i+3];
+    }
+
+    for (; i < 80; i++)
+        W[i] = rol(W[i-3] ^ W[i-8] ^ W[i-14] ^ W[i-16], 1);
+
+    a = state[0];
+    b = state[1];
+    c = state[2];
+    d = state[3];
+    e = state[4];
+
+    for (i = 0; i < 80; i++)
+    {
+        if (i < 20) t = F0(b,c,d) + 0x5a827999;
+        else if (i < 40) t = F1(b,c,d) + 0x6ed9eba1;
+        else if (i < 60) t = F2(b,c,d) + 0x8f1bbcdc;
+        else t = F1(b,c,d) + 0xca62c1d6;
+        t += rol(a, 5) + e + W[i];
+        e = d;
+        d = c;
+        c = rol(b, 30);
+        b = a;
+        a = t;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+static void processblocks(DWORD *state, const UCHAR *buffer, SIZE_T blocks)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    if (cpu_features & CPU_FEATURE_SHA)
+    {
+        shani_sha1_blocks(state, buffer, blocks);
+        return;
+    }
+#endif
+    for (; blocks; blocks--, buffer += 64)
+        processblock(state, buffer);
+}
+
+static void pad(SHA1_CTX *ctx)
+{
+    ULONG64 r = ctx->len % 64;
+
+    ctx->buf[r++] = 0x80;
+
+    if (r > 56)
+    {
+        memset(ctx->buf + r, 0, 64 - r);
+        r = 0;
+        processblocks(ctx->h, ctx->buf, 1);
+    }
+
+    memset(ctx->buf + r, 0, 56 - r);
+    ctx->len *= 8;
+    ctx->buf[56] = ctx->len >> 56;
+    ctx->buf[57] = ctx->len >> 48;
+    ctx->buf[58] = ctx->len >> 40;
+    ctx->buf[59] = ctx->len >> 32;
+    ctx->buf[60] = ctx->len >> 24;
+    ctx->buf[61] = ctx->len >> 16;
+    ctx->buf[62] = ctx->len >> 8;
+    ctx->buf[63] = ctx->len;
+
+    processblocks(ctx->h, ctx->buf, 1);
+}
+
+void sha1_init(SHA1_CTX *ctx)
+{
+    ctx->len = 0;
+    ctx->h[0] = 0x67452301;
+    ctx->h[1] = 0xefcdab89;
+    ctx->h[2] = 0x98badcfe;
+    ctx->h[3] = 0x10325476;
+    ctx->h[4] = 0xc3d2e1f0;
+}
+
+void sha1_update(SHA1_CTX *ctx, const UCHAR *buffer, ULONG len)
+{
+    const UCHAR *p = buffer;
+    ULONG64 r = ctx->len % 64;
+
+    ctx->len += len;
+    if (r)
+    {
+        if (len < 64 - r)
+        {
+            memcpy(ctx->buf + r, p, len);
+            return;
+        }
+        memcpy(ctx->buf + r, p, 64 - r);
+        len -= 64 - r;
+        p += 64 - r;
+        processblocks(ctx->h, ctx->buf, 1);
+    }
+    if (len >= 64)
+    {
+        processblocks(ctx->h, p, len / 64);
+        p += len & ~63;
+        len &= 63;
+    }
+    memcpy(ctx->buf, p, len);
+}
+
+void sha1_finalize(SHA1_CTX *ctx, UCHAR *buffer)
+{
+    int i;
+
+    pad(ctx);
+    for (i = 0; i < 5; i++)
+    {
+        buffer[4*i]   = ctx->h[i] >> 24;
+        buffer[4*i+1] = ctx->h[i] >> 16;
+        buffer[4*i+2] = ctx->h[i] >> 8;
+        buffer[4*i+3] = ctx->h[i];
+    }
+}
+
+/* Runs the remaining PBKDF2-HMAC-SHA1 iterations, see sha256_pbkdf2_iterate */
+void sha1_pbkdf2_iterate(const DWORD *inner, const DWORD *outer, DWORD *u, DWORD *t, ULONG64 count)
+{
+    UCHAR block[64];
+    DWORD state[5];
+    int i;
+
+    memset(block + 20, 0, 44);
+    block[20] = 0x80;
+    block[62] = ((64 + 20) * 8) >> 8;
+    block[63] = ((64 + 20) * 8) & 0xff;
+
+    while (count--)
+    {
+        for (i = 0; i < 5; i++)
+        {
+            block[4*i]   = u[i] >> 24;
+            block[4*i+1] = u[i] >> 16;
+            block[4*i+2] = u[i] >> 8;
+            block[4*i+3] = u[i];
+        }
+        memcpy(state, inner, sizeof(state));
+        processblocks(state, block, 1);
+        for (i = 0; i < 5; i++)
+        {
+            block[4*i]   = state[i] >> 24;
+            block[4*i+1] = state[i] >> 16;
+            block[4*i+2] = state[i] >> 8;
+            block[4*i+3] = state[i];
+        }
+        memcpy(u, outer, sizeof(state));
+        processblocks(u, block, 1);
+        for (i = 0; i < 5; i++) t[i] ^= u[i];
+    }
+}
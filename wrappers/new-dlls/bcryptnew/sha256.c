@@ -22,6 +22,11 @@
 
 #include "bcrypt_internal.h"
 
+#if defined(__i386__) || defined(__x86_64__)
+void CDECL shani_sha256_blocks(DWORD *state, const UCHAR *data, SIZE_T blocks);
+void CDECL sha256_sse2_x4(DWORD *state, const DWORD *data);
+#endif
+
 static DWORD ror(DWORD n, int k) { return (n >> k) | (n << (32-k)); }
 #define Ch(x,y,z)  (z ^ (x & (y ^ z)))
 #define Maj(x,y,z) ((x & y) | (z & (x | y)))
@@ -42,7 +47,7 @@ static const DWORD K[64] =
   0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
 };
 
-static void processblock(SHA256_CTX *ctx, const UCHAR *buffer)
+static void processblock(DWORD *state, const UCHAR *buffer)
 {
     DWORD W[64], t1, t2, a, b, c, d, e, f, g, h;
     int i;
@@ -58,14 +63,14 @@ static void processblock(SHA256_CTX *ctx, const UCHAR *buffer)
     for (; i < 64; i++)
         W[i] = R1(W[i-2]) + W[i-7] + R0(W[i-15]) + W[i-16];
 
-    a = ctx->h[0];
-    b = ctx->h[1];
-    c = ctx->h[2];
-    d = ctx->h[3];
-    e = ctx->h[4];
-    f = ctx->h[5];
-    g = ctx->h[6];
-    h = ctx->h[7];
+    a = state[0];
+    b = state[1];
+    c = state[2];
+    d = state[3];
+    e = state[4];
+    f = state[5];
+    g = state[6];
+    h = state[7];
 
     for (i = 0; i < 64; i++)
     {
@@ -81,14 +86,27 @@ static void processblock(SHA256_CTX *ctx, const UCHAR *buffer)
         a = t1 + t2;
     }
 
-    ctx->h[0] += a;
-    ctx->h[1] += b;
-    ctx->h[2] += c;
-    ctx->h[3] += d;
-    ctx->h[4] += e;
-    ctx->h[5] += f;
-    ctx->h[6] += g;
-    ctx->h[7] += h;
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+static void processblocks(DWORD *state, const UCHAR *buffer, SIZE_T blocks)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    if (cpu_features & CPU_FEATURE_SHA)
+    {
+        shani_sha256_blocks(state, buffer, blocks);
+        return;
+    }
+#endif
+    for (; blocks; blocks--, buffer += 64)
+        processblock(state, buffer);
 }
 
 static void pad(SHA256_CTX *ctx)
@@ -101,7 +119,7 @@ static void pad(SHA256_CTX *ctx)
     {
         memset(ctx->buf + r, 0, 64 - r);
         r = 0;
-        processblock(ctx, ctx->buf);
+        processblocks(ctx->h, ctx->buf, 1);
     }
 
     memset(ctx->buf + r, 0, 56 - r);
@@ -115,7 +133,7 @@ static void pad(SHA256_CTX *ctx)
     ctx->buf[62] = ctx->len >> 8;
     ctx->buf[63] = ctx->len;
 
-    processblock(ctx, ctx->buf);
+    processblocks(ctx->h, ctx->buf, 1);
 }
 
 void sha256_init(SHA256_CTX *ctx)
@@ -147,10 +165,14 @@ void sha256_update(SHA256_CTX *ctx, const UCHAR *buffer, ULONG len)
         memcpy(ctx->buf + r, p, 64 - r);
         len -= 64 - r;
         p += 64 - r;
-        processblock(ctx, ctx->buf);
+        processblocks(ctx->h, ctx->buf, 1);
+    }
+    if (len >= 64)
+    {
+        processblocks(ctx->h, p, len / 64);
+        p += len & ~63;
+        len &= 63;
     }
-    for (; len >= 64; len -= 64, p += 64)
-        processblock(ctx, p);
     memcpy(ctx->buf, p, len);
 }
 
@@ -167,3 +189,106 @@ void sha256_finalize(SHA256_CTX *ctx, UCHAR *buffer)
         buffer[4*i+3] = ctx->h[i];
     }
 }
+
+static void store_words(UCHAR *buffer, const DWORD *words, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        buffer[4*i]   = words[i] >> 24;
+        buffer[4*i+1] = words[i] >> 16;
+        buffer[4*i+2] = words[i] >> 8;
+        buffer[4*i+3] = words[i];
+    }
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+/* State and block are stored as rows of four lanes, see sha256x4-amd64.S */
+static void pbkdf2_iterate_x4(const DWORD *inner, const DWORD *outer, DWORD *u, DWORD *t,
+                              ULONG lanes, ULONG64 count)
+{
+    DWORD ipad[8][4], opad[8][4], state[8][4], block[16][4], sum[8][4];
+    ULONG i, lane;
+
+    for (i = 0; i < 8; i++)
+    {
+        for (lane = 0; lane < 4; lane++)
+        {
+            ipad[i][lane] = inner[i];
+            opad[i][lane] = outer[i];
+            /* spare lanes repeat the last block, their result is dropped */
+            block[i][lane] = u[8 * min(lane, lanes - 1) + i];
+            sum[i][lane] = t[8 * min(lane, lanes - 1) + i];
+        }
+    }
+    for (i = 8; i < 16; i++) block[i][0] = block[i][1] = block[i][2] = block[i][3] = 0;
+    for (lane = 0; lane < 4; lane++)
+    {
+        block[8][lane] = 0x80000000;
+        block[15][lane] = (64 + 32) * 8;
+    }
+
+    while (count--)
+    {
+        memcpy(state, ipad, sizeof(state));
+        sha256_sse2_x4(&state[0][0], &block[0][0]);
+        memcpy(block, state, sizeof(state));
+        memcpy(state, opad, sizeof(state));
+        sha256_sse2_x4(&state[0][0], &block[0][0]);
+        memcpy(block, state, sizeof(state));
+        for (i = 0; i < 8; i++)
+        {
+            sum[i][0] ^= state[i][0];
+            sum[i][1] ^= state[i][1];
+            sum[i][2] ^= state[i][2];
+            sum[i][3] ^= state[i][3];
+        }
+    }
+
+    for (lane = 0; lane < lanes; lane++)
+        for (i = 0; i < 8; i++) t[8 * lane + i] = sum[i][lane];
+}
+#endif
+
+/* Runs the remaining PBKDF2-HMAC-SHA256 iterations for up to four blocks.
+ * inner and outer are the HMAC states after the padded key, u holds U_1 and
+ * t the running XOR for every block, eight words each. */
+void sha256_pbkdf2_iterate(const DWORD *inner, const DWORD *outer, DWORD *u, DWORD *t,
+                           ULONG lanes, ULONG64 count)
+{
+    UCHAR block[64];
+    DWORD state[8];
+    ULONG64 n;
+    ULONG lane;
+    int i;
+
+#if defined(__i386__) || defined(__x86_64__)
+    /* one SHA-NI stream beats four SSE2 lanes */
+    if (lanes > 1 && (cpu_features & (CPU_FEATURE_SSE2 | CPU_FEATURE_SHA)) == CPU_FEATURE_SSE2)
+    {
+        pbkdf2_iterate_x4(inner, outer, u, t, lanes, count);
+        return;
+    }
+#endif
+
+    /* the message is always the 32 byte U_j or inner hash after a key block */
+    memset(block + 32, 0, 32);
+    block[32] = 0x80;
+    block[62] = ((64 + 32) * 8) >> 8;
+    block[63] = ((64 + 32) * 8) & 0xff;
+
+    for (lane = 0; lane < lanes; lane++, u += 8, t += 8)
+    {
+        for (n = 0; n < count; n++)
+        {
+            store_words(block, u, 8);
+            memcpy(state, inner, sizeof(state));
+            processblocks(state, block, 1);
+            store_words(block, state, 8);
+            memcpy(u, outer, sizeof(state));
+            processblocks(u, block, 1);
+            for (i = 0; i < 8; i++) t[i] ^= u[i];
+        }
+    }
+}
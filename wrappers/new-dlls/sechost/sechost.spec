@@ -28,8 +28,8 @@
 @ stdcall ControlService(long long ptr)
 @ stub ControlServiceExA
 @ stub ControlServiceExW
-@ stdcall ControlTraceA(int64 str ptr long)
-@ stdcall ControlTraceW(int64 wstr ptr long)
+@ stdcall ControlTraceA(int64 str ptr long) ntext.EtwControlTraceA
+@ stdcall ControlTraceW(int64 wstr ptr long) ntext.EtwControlTraceW
 @ stub ConvertSDToStringSDRootDomainW
 @ stdcall ConvertSecurityDescriptorToStringSecurityDescriptorW(ptr long long ptr ptr)
 @ stdcall ConvertSidToStringSidW(ptr ptr)
@@ -85,7 +85,7 @@
 @ stub CredpEncodeCredential
 @ stub CredpEncodeSecret
 @ stdcall DeleteService(long)
-@ stdcall EnableTraceEx2(int64 ptr long long int64 int64 long ptr)
+@ stdcall EnableTraceEx2(int64 ptr long long int64 int64 long ptr) ntext.EtwEnableTraceEx2
 @ stdcall EnumDependentServicesW(long long ptr long ptr ptr)
 @ stdcall EnumServicesStatusExW(long long long long ptr long ptr ptr ptr wstr)
 @ stub EnumerateIdentityProviders
@@ -166,8 +166,8 @@
 @ stdcall OpenServiceW(long wstr long)
 @ stdcall -ret64 OpenTraceW(ptr)
 @ stdcall ProcessTrace(ptr long ptr ptr)
-@ stdcall QueryAllTracesA(ptr long ptr)
-@ stdcall QueryAllTracesW(ptr long ptr)
+@ stdcall QueryAllTracesA(ptr long ptr) ntext.EtwQueryAllTracesA
+@ stdcall QueryAllTracesW(ptr long ptr) ntext.EtwQueryAllTracesW
 @ stub QueryLocalUserServiceName
 @ stdcall QueryServiceConfig2A(long long ptr long ptr)
 @ stdcall QueryServiceConfig2W(long long ptr long ptr)
@@ -198,9 +198,9 @@
 @ stdcall StartServiceCtrlDispatcherA(ptr)
 @ stdcall StartServiceCtrlDispatcherW(ptr)
 @ stdcall StartServiceW(long long ptr)
-@ stdcall StartTraceA(ptr str ptr)
-@ stdcall StartTraceW(ptr wstr ptr)
-@ stdcall StopTraceW(int64 wstr ptr)
+@ stdcall StartTraceA(ptr str ptr) ntext.EtwStartTraceA
+@ stdcall StartTraceW(ptr wstr ptr) ntext.EtwStartTraceW
+@ stdcall StopTraceW(int64 wstr ptr) ntext.EtwStopTraceW
 @ stub SubscribeServiceChangeNotifications
 @ stub TraceQueryInformation
 @ stdcall TraceSetInformation(int64 long ptr long)
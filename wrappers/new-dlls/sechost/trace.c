@@ -21,119 +21,577 @@
  */
 
 #include <stdarg.h>
+#include <stdlib.h>
 #include "windef.h"
 #include "winbase.h"
 #include "wmistr.h"
-#include "evntrace.h"
+#include "evntcons.h"
+#include "etwlog.h"
 
 #include "wine/debug.h"
+#include "wine/heap.h"
+#include "wine/list.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(eventlog);
 
-/******************************************************************************
- *     ControlTraceA   (sechost.@)
- */
-ULONG WINAPI ControlTraceA( TRACEHANDLE handle, const char *session,
-                            EVENT_TRACE_PROPERTIES *properties, ULONG control )
+#define MAX_EXTENDED_ITEMS  8
+#define MAX_BUFFER_SIZE     (64 * 1024 * 1024)
+
+/* an .etl file opened by OpenTraceW */
+struct trace_file
 {
-    FIXME("(%s, %s, %p, %d) stub\n", wine_dbgstr_longlong(handle), debugstr_a(session), properties, control);
-    return ERROR_SUCCESS;
+    struct list entry;
+    HANDLE file;
+    EVENT_TRACE_LOGFILEW *logfile;
+    ULONG buffer_size;
+    ULONG buffer_count;
+    ULONG clock_type;
+    LONGLONG perf_freq;
+    LONGLONG start_time;
+    LONGLONG start_perf_clock;
+    WCHAR *logger_name;
+    WCHAR *logfile_name;
+};
+
+/* a data buffer found in one of the files */
+struct trace_buffer_ref
+{
+    struct trace_file *trace;
+    ULONG trace_index;
+    ULONG index;
+    ULONG ring;
+    LONGLONG sequence;
+};
+
+/* the buffers one ring of a logger wrote to a file, in the order they were
+ * written, and the next event in them */
+struct trace_stream
+{
+    struct trace_buffer_ref *buffers;
+    ULONG count;
+    ULONG current;
+    BYTE *data;
+    BOOL loaded;
+    ULONG offset;
+    ULONG end;
+    const EVENT_HEADER *event;
+    LONGLONG time;
+};
+
+static struct list trace_list = LIST_INIT(trace_list);
+
+static CRITICAL_SECTION trace_cs;
+static CRITICAL_SECTION_DEBUG trace_cs_debug =
+{
+    0, 0, &trace_cs,
+    { &trace_cs_debug.ProcessLocksList,
+      &trace_cs_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": trace_cs") }
+};
+static CRITICAL_SECTION trace_cs = { &trace_cs_debug, -1, 0, 0, 0, 0 };
+
+static struct trace_file *find_trace( TRACEHANDLE handle )
+{
+    struct trace_file *trace, *ret = NULL;
+
+    EnterCriticalSection( &trace_cs );
+    LIST_FOR_EACH_ENTRY( trace, &trace_list, struct trace_file, entry )
+    {
+        if ((TRACEHANDLE)(ULONG_PTR)trace == handle)
+        {
+            ret = trace;
+            break;
+        }
+    }
+    LeaveCriticalSection( &trace_cs );
+    return ret;
 }
 
-/******************************************************************************
- *     ControlTraceW   (sechost.@)
- */
-ULONG WINAPI ControlTraceW( TRACEHANDLE handle, const WCHAR *session,
-                            EVENT_TRACE_PROPERTIES *properties, ULONG control )
+static BOOL read_trace_file( struct trace_file *trace, ULONGLONG offset, void *buffer, ULONG size )
 {
-    FIXME("(%s, %s, %p, %d) stub\n", wine_dbgstr_longlong(handle), debugstr_w(session), properties, control);
-    return ERROR_SUCCESS;
+    OVERLAPPED ovl = { 0 };
+    DWORD read;
+
+    ovl.Offset = (DWORD)offset;
+    ovl.OffsetHigh = (DWORD)(offset >> 32);
+    return ReadFile( trace->file, buffer, size, &read, &ovl ) && read == size;
 }
 
-/******************************************************************************
- *     EnableTraceEx2   (sechost.@)
- */
-ULONG WINAPI EnableTraceEx2( TRACEHANDLE handle, const GUID *provider, ULONG control, UCHAR level,
-                             ULONGLONG match_any, ULONGLONG match_all, ULONG timeout,
-                             ENABLE_TRACE_PARAMETERS *params )
+static WCHAR *copy_trace_name( const WCHAR **name, const WCHAR *end )
 {
-    FIXME("(%s, %s, %u, %u, %s, %s, %u, %p): stub\n", wine_dbgstr_longlong(handle),
-          debugstr_guid(provider), control, level, wine_dbgstr_longlong(match_any),
-          wine_dbgstr_longlong(match_all), timeout, params);
+    const WCHAR *p = *name;
+    WCHAR *ret;
+    SIZE_T len;
 
-    return ERROR_SUCCESS;
+    for (len = 0; p + len < end && p[len]; len++);
+    if (p + len >= end) return NULL;
+
+    if ((ret = heap_alloc( (len + 1) * sizeof(WCHAR) )))
+    {
+        memcpy( ret, p, len * sizeof(WCHAR) );
+        ret[len] = 0;
+    }
+    *name = p + len + 1;
+    return ret;
 }
 
-/******************************************************************************
- *     QueryAllTracesA   (sechost.@)
- */
-ULONG WINAPI QueryAllTracesA( EVENT_TRACE_PROPERTIES **properties, ULONG count, ULONG *ret_count )
+#define COPY_LOGFILE_HEADER(dst, src) \
+    do { \
+        (dst)->BufferSize = (src)->BufferSize; \
+        (dst)->Version = (src)->Version; \
+        (dst)->ProviderVersion = (src)->ProviderVersion; \
+        (dst)->NumberOfProcessors = (src)->NumberOfProcessors; \
+        (dst)->EndTime = (src)->EndTime; \
+        (dst)->TimerResolution = (src)->TimerResolution; \
+        (dst)->MaximumFileSize = (src)->MaximumFileSize; \
+        (dst)->LogFileMode = (src)->LogFileMode; \
+        (dst)->BuffersWritten = (src)->BuffersWritten; \
+        (dst)->LogInstanceGuid = (src)->LogInstanceGuid; \
+        (dst)->TimeZone = (src)->TimeZone; \
+        (dst)->BootTime = (src)->BootTime; \
+        (dst)->PerfFreq = (src)->PerfFreq; \
+        (dst)->StartTime = (src)->StartTime; \
+        (dst)->ReservedFlags = (src)->ReservedFlags; \
+        (dst)->BuffersLost = (src)->BuffersLost; \
+    } while (0)
+
+/* reads the header buffer, written in the layout of the logging process */
+static ULONG read_logfile_header( struct trace_file *trace, EVENT_TRACE_LOGFILEW *logfile )
 {
-    FIXME("(%p, %d, %p) stub\n", properties, count, ret_count);
+    TRACE_LOGFILE_HEADER *header = &logfile->LogfileHeader;
+    SYSTEM_TRACE_HEADER *system;
+    WMI_BUFFER_HEADER buffer_header;
+    const WCHAR *names, *end;
+    LARGE_INTEGER size;
+    BYTE *buffer;
+    ULONG ret = ERROR_BAD_FORMAT;
 
-    if (ret_count) *ret_count = 0;
-    return ERROR_SUCCESS;
+    if (!read_trace_file( trace, 0, &buffer_header, sizeof(buffer_header) ))
+        return GetLastError() ? GetLastError() : ERROR_BAD_FORMAT;
+
+    if (buffer_header.BufferType != ETW_BUFFER_TYPE_HEADER ||
+        buffer_header.BufferSize < sizeof(buffer_header) + sizeof(*system) + sizeof(TRACE_LOGFILE_HEADER64) ||
+        buffer_header.BufferSize > MAX_BUFFER_SIZE ||
+        buffer_header.Offset > buffer_header.BufferSize)
+        return ERROR_BAD_FORMAT;
+
+    if (!(buffer = heap_alloc( buffer_header.BufferSize ))) return ERROR_NOT_ENOUGH_MEMORY;
+    if (!read_trace_file( trace, 0, buffer, buffer_header.BufferSize )) goto done;
+
+    system = (SYSTEM_TRACE_HEADER *)(buffer + sizeof(buffer_header));
+    if (system->Size > buffer_header.Offset - sizeof(buffer_header)) goto done;
+    end = (const WCHAR *)((BYTE *)system + system->Size);
+
+    memset( header, 0, sizeof(*header) );
+    if (system->HeaderType == TRACE_HEADER_TYPE_SYSTEM64)
+    {
+        TRACE_LOGFILE_HEADER64 *header64 = (TRACE_LOGFILE_HEADER64 *)(system + 1);
+        COPY_LOGFILE_HEADER( header, header64 );
+        names = (const WCHAR *)(header64 + 1);
+    }
+    else if (system->HeaderType == TRACE_HEADER_TYPE_SYSTEM32)
+    {
+        TRACE_LOGFILE_HEADER32 *header32 = (TRACE_LOGFILE_HEADER32 *)(system + 1);
+        COPY_LOGFILE_HEADER( header, header32 );
+        names = (const WCHAR *)(header32 + 1);
+    }
+    else goto done;
+
+    if (header->BufferSize != buffer_header.BufferSize) goto done;
+
+    trace->logger_name = copy_trace_name( &names, end );
+    if (trace->logger_name) trace->logfile_name = copy_trace_name( &names, end );
+    header->LoggerName = trace->logger_name;
+    header->LogFileName = trace->logfile_name;
+
+    /* performance counter time stamps are converted with the clock the
+     * logger read when it started */
+    trace->buffer_size = header->BufferSize;
+    trace->clock_type = header->ReservedFlags;
+    trace->perf_freq = header->PerfFreq.QuadPart;
+    trace->start_time = header->StartTime.QuadPart;
+    trace->start_perf_clock = system->SystemTime.QuadPart;
+    if (!trace->perf_freq) trace->clock_type = 2;
+
+    if (!GetFileSizeEx( trace->file, &size )) { ret = GetLastError(); goto done; }
+    trace->buffer_count = (ULONG)(size.QuadPart / trace->buffer_size);
+
+    logfile->CurrentTime = header->StartTime.QuadPart;
+    logfile->BuffersRead = 0;
+    logfile->BufferSize = trace->buffer_size;
+    logfile->Filled = 0;
+    logfile->EventsLost = header->EventsLost;
+    logfile->IsKernelTrace = 0;
+    ret = ERROR_SUCCESS;
+
+done:
+    heap_free( buffer );
+    return ret;
+}
+
+static void free_trace( struct trace_file *trace )
+{
+    if (trace->file != INVALID_HANDLE_VALUE) CloseHandle( trace->file );
+    heap_free( trace->logger_name );
+    heap_free( trace->logfile_name );
+    heap_free( trace );
 }
 
 /******************************************************************************
- *     QueryAllTracesW   (sechost.@)
+ *     OpenTraceW   (sechost.@)
  */
-ULONG WINAPI QueryAllTracesW( EVENT_TRACE_PROPERTIES **properties, ULONG count, ULONG *ret_count )
+TRACEHANDLE WINAPI OpenTraceW( EVENT_TRACE_LOGFILEW *logfile )
 {
-    FIXME("(%p, %d, %p) stub\n", properties, count, ret_count);
+    struct trace_file *trace;
+    ULONG ret;
 
-    if (ret_count) *ret_count = 0;
-    return ERROR_SUCCESS;
+    TRACE( "%p\n", logfile );
+
+    if (!logfile)
+    {
+        SetLastError( ERROR_INVALID_PARAMETER );
+        return INVALID_PROCESSTRACE_HANDLE;
+    }
+
+    if ((logfile->ProcessTraceMode & PROCESS_TRACE_MODE_REAL_TIME) || !logfile->LogFileName)
+    {
+        FIXME( "real time sessions are not supported\n" );
+        SetLastError( ERROR_NOT_SUPPORTED );
+        return INVALID_PROCESSTRACE_HANDLE;
+    }
+
+    if (!(trace = heap_alloc_zero( sizeof(*trace) )))
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return INVALID_PROCESSTRACE_HANDLE;
+    }
+
+    trace->logfile = logfile;
+    trace->file = CreateFileW( logfile->LogFileName, GENERIC_READ,
+                               FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                               NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+    if (trace->file == INVALID_HANDLE_VALUE)
+    {
+        ret = GetLastError();
+        free_trace( trace );
+        SetLastError( ret );
+        return INVALID_PROCESSTRACE_HANDLE;
+    }
+
+    if ((ret = read_logfile_header( trace, logfile )))
+    {
+        free_trace( trace );
+        SetLastError( ret );
+        return INVALID_PROCESSTRACE_HANDLE;
+    }
+
+    EnterCriticalSection( &trace_cs );
+    list_add_tail( &trace_list, &trace->entry );
+    LeaveCriticalSection( &trace_cs );
+
+    return (TRACEHANDLE)(ULONG_PTR)trace;
 }
 
-/******************************************************************************
- *     StartTraceA   (sechost.@)
- */
-ULONG WINAPI StartTraceA( TRACEHANDLE *handle, const char *session, EVENT_TRACE_PROPERTIES *properties )
+static LONGLONG trace_system_time( const struct trace_file *trace, LONGLONG time )
 {
-    FIXME("(%p, %s, %p) stub\n", handle, debugstr_a(session), properties);
-    if (handle) *handle = 0xcafe4242;
-    return ERROR_SUCCESS;
+    LONGLONG delta;
+
+    if (trace->clock_type != 1) return time;
+
+    delta = time - trace->start_perf_clock;
+    return trace->start_time + delta / trace->perf_freq * 10000000 +
+           delta % trace->perf_freq * 10000000 / trace->perf_freq;
 }
 
-/******************************************************************************
- *     StartTraceW   (sechost.@)
- */
-ULONG WINAPI StartTraceW( TRACEHANDLE *handle, const WCHAR *session, EVENT_TRACE_PROPERTIES *properties )
+/* size of the record at the given offset, 0 if it is not one */
+static ULONG trace_record_size( const BYTE *record, ULONG available )
 {
-    FIXME("(%p, %s, %p) stub\n", handle, debugstr_w(session), properties);
-    if (handle) *handle = 0xcafe4242;
-    return ERROR_SUCCESS;
+    ULONG size, min_size;
+
+    if (available < 4 || record[3] != TRACE_HEADER_MARKER_FLAGS) return 0;
+
+    switch (record[2])
+    {
+    case TRACE_HEADER_TYPE_EVENT_HEADER32:
+    case TRACE_HEADER_TYPE_EVENT_HEADER64:
+        size = *(const USHORT *)record;
+        min_size = sizeof(EVENT_HEADER);
+        break;
+    case TRACE_HEADER_TYPE_SYSTEM32:
+    case TRACE_HEADER_TYPE_SYSTEM64:
+        if (available < sizeof(SYSTEM_TRACE_HEADER)) return 0;
+        size = ((const SYSTEM_TRACE_HEADER *)record)->Size;
+        min_size = sizeof(SYSTEM_TRACE_HEADER);
+        break;
+    default:
+        return 0;
+    }
+
+    if (size < min_size || size > available) return 0;
+    return size;
 }
 
-/******************************************************************************
- *     StopTraceW   (sechost.@)
- */
-ULONG WINAPI StopTraceW( TRACEHANDLE handle, const WCHAR *session, EVENT_TRACE_PROPERTIES *properties )
+static int __cdecl compare_buffer_refs( const void *a, const void *b )
 {
-    FIXME("(%s, %s, %p) stub\n", wine_dbgstr_longlong(handle), debugstr_w(session), properties);
-    return ERROR_SUCCESS;
+    const struct trace_buffer_ref *ref1 = a, *ref2 = b;
+
+    if (ref1->trace_index != ref2->trace_index) return ref1->trace_index < ref2->trace_index ? -1 : 1;
+    if (ref1->ring != ref2->ring) return ref1->ring < ref2->ring ? -1 : 1;
+    if (ref1->sequence != ref2->sequence) return ref1->sequence < ref2->sequence ? -1 : 1;
+    return 0;
 }
 
-/******************************************************************************
- *     OpenTraceW   (sechost.@)
- */
-TRACEHANDLE WINAPI OpenTraceW( EVENT_TRACE_LOGFILEW *logfile )
+static BOOL load_stream_buffer( struct trace_stream *stream )
+{
+    const struct trace_buffer_ref *ref = &stream->buffers[stream->current];
+    WMI_BUFFER_HEADER *header = (WMI_BUFFER_HEADER *)stream->data;
+
+    if (!read_trace_file( ref->trace, (ULONGLONG)ref->index * ref->trace->buffer_size,
+                          stream->data, ref->trace->buffer_size ))
+        return FALSE;
+
+    stream->offset = sizeof(*header);
+    stream->end = min( header->Offset, ref->trace->buffer_size );
+    stream->loaded = TRUE;
+    return TRUE;
+}
+
+/* moves the stream to its next event; FALSE if a buffer callback cancelled processing */
+static BOOL next_stream_event( struct trace_stream *stream, LONGLONG end_time )
 {
-    static int once;
+    EVENT_TRACE_LOGFILEW *logfile;
+    struct trace_file *trace;
+    const BYTE *record;
+    ULONG size;
+
+    stream->event = NULL;
+
+    for (;;)
+    {
+        if (stream->loaded)
+        {
+            trace = stream->buffers[stream->current].trace;
+
+            while (stream->offset < stream->end)
+            {
+                record = stream->data + stream->offset;
+                if (!(size = trace_record_size( record, stream->end - stream->offset ))) break;
+                stream->offset += ETW_ALIGN_RECORD( size );
+
+                /* the logfile header and other system records are not events */
+                if (record[2] != TRACE_HEADER_TYPE_EVENT_HEADER32 &&
+                    record[2] != TRACE_HEADER_TYPE_EVENT_HEADER64)
+                    continue;
+
+                stream->time = trace_system_time( trace, ((const EVENT_HEADER *)record)->TimeStamp.QuadPart );
+                if (stream->time > end_time)
+                {
+                    /* the rest of the ring is later still */
+                    stream->loaded = FALSE;
+                    stream->current = stream->count;
+                    return TRUE;
+                }
+
+                stream->event = (const EVENT_HEADER *)record;
+                return TRUE;
+            }
+
+            logfile = trace->logfile;
+            stream->loaded = FALSE;
+            logfile->BuffersRead++;
+            logfile->Filled = stream->end;
+            if (logfile->BufferCallback && !logfile->BufferCallback( logfile )) return FALSE;
+        }
+
+        if (++stream->current >= stream->count)
+        {
+            stream->current = stream->count;
+            return TRUE;
+        }
+        load_stream_buffer( stream );
+    }
+}
+
+static void deliver_event( struct trace_stream *stream )
+{
+    const struct trace_file *trace = stream->buffers[stream->current].trace;
+    EVENT_TRACE_LOGFILEW *logfile = trace->logfile;
+    const EVENT_HEADER *header = stream->event;
+    const WMI_BUFFER_HEADER *buffer = (const WMI_BUFFER_HEADER *)stream->data;
+    EVENT_HEADER_EXTENDED_DATA_ITEM items[MAX_EXTENDED_ITEMS];
+    const ETW_EXTENDED_ITEM_HEADER *item;
+    const BYTE *data = (const BYTE *)(header + 1), *end = (const BYTE *)header + header->Size;
+    EVENT_RECORD record;
+    USHORT count = 0;
+
+    if (header->Flags & EVENT_HEADER_FLAG_EXTENDED_INFO)
+    {
+        do
+        {
+            item = (const ETW_EXTENDED_ITEM_HEADER *)data;
+            if (data + sizeof(*item) > end || data + sizeof(*item) + item->DataSize > end) break;
+
+            memset( &items[count], 0, sizeof(items[count]) );
+            items[count].ExtType = item->ExtType;
+            items[count].DataSize = item->DataSize;
+            items[count].DataPtr = (ULONG_PTR)(item + 1);
+            count++;
+
+            data += sizeof(*item) + ETW_ALIGN_RECORD( item->DataSize );
+        } while (item->Linkage && count < MAX_EXTENDED_ITEMS);
 
-    if (!once++) FIXME("%p: stub\n", logfile);
-    SetLastError(ERROR_ACCESS_DENIED);
-    return INVALID_PROCESSTRACE_HANDLE;
+        if (data > end) data = end;
+    }
+
+    logfile->CurrentTime = stream->time;
+
+    if (logfile->ProcessTraceMode & PROCESS_TRACE_MODE_EVENT_RECORD)
+    {
+        record.EventHeader = *header;
+        if (!(logfile->ProcessTraceMode & PROCESS_TRACE_MODE_RAW_TIMESTAMP))
+            record.EventHeader.TimeStamp.QuadPart = stream->time;
+        record.BufferContext = buffer->ClientContext;
+        record.ExtendedDataCount = count;
+        record.UserDataLength = (USHORT)(end - data);
+        record.ExtendedData = count ? items : NULL;
+        record.UserData = (void *)data;
+        record.UserContext = logfile->Context;
+
+        if (logfile->EventRecordCallback) logfile->EventRecordCallback( &record );
+        return;
+    }
+
+    /* classic consumers get the event in the EVENT_TRACE layout */
+    memset( &logfile->CurrentEvent, 0, sizeof(logfile->CurrentEvent) );
+    logfile->CurrentEvent.Header.Size = (USHORT)(sizeof(EVENT_TRACE_HEADER) + (end - data));
+    logfile->CurrentEvent.Header.Class.Type = header->EventDescriptor.Opcode;
+    logfile->CurrentEvent.Header.Class.Level = header->EventDescriptor.Level;
+    logfile->CurrentEvent.Header.Class.Version = header->EventDescriptor.Version;
+    logfile->CurrentEvent.Header.ThreadId = header->ThreadId;
+    logfile->CurrentEvent.Header.ProcessId = header->ProcessId;
+    logfile->CurrentEvent.Header.TimeStamp.QuadPart =
+        (logfile->ProcessTraceMode & PROCESS_TRACE_MODE_RAW_TIMESTAMP) ? header->TimeStamp.QuadPart : stream->time;
+    logfile->CurrentEvent.Header.Guid = header->ProviderId;
+    logfile->CurrentEvent.Header.ProcessorTime = header->ProcessorTime;
+    logfile->CurrentEvent.MofData = (void *)data;
+    logfile->CurrentEvent.MofLength = (ULONG)(end - data);
+    logfile->CurrentEvent.BufferContext = buffer->ClientContext;
+
+    if (logfile->EventCallback) logfile->EventCallback( &logfile->CurrentEvent );
 }
 
 /******************************************************************************
  *     ProcessTrace   (sechost.@)
+ *
+ * Every ring of a logger writes its buffers in order, so the events of each
+ * ring come out of the files sorted; the rings and files are merged by time.
  */
 ULONG WINAPI ProcessTrace( TRACEHANDLE *handles, ULONG count, FILETIME *start_time, FILETIME *end_time )
 {
-    FIXME("%p %u %p %p: stub\n", handles, count, start_time, end_time);
-    return ERROR_CALL_NOT_IMPLEMENTED;
+    struct trace_file *traces[MAXIMUM_WAIT_OBJECTS];
+    struct trace_buffer_ref *refs = NULL;
+    struct trace_stream *streams = NULL, *next;
+    WMI_BUFFER_HEADER header;
+    LONGLONG start = 0, end = MAXLONGLONG;
+    ULONG total = 0, used = 0, stream_count = 0, max_size = 0, i, j;
+    ULONG ret = ERROR_SUCCESS;
+
+    TRACE( "%p %u %p %p\n", handles, count, start_time, end_time );
+
+    if (!handles || !count || count > MAXIMUM_WAIT_OBJECTS) return ERROR_INVALID_PARAMETER;
+
+    for (i = 0; i < count; i++)
+    {
+        if (!(traces[i] = find_trace( handles[i] ))) return ERROR_INVALID_HANDLE;
+        total += traces[i]->buffer_count;
+        max_size = max( max_size, traces[i]->buffer_size );
+    }
+
+    if (start_time) start = ((LONGLONG)start_time->dwHighDateTime << 32) | start_time->dwLowDateTime;
+    if (end_time) end = ((LONGLONG)end_time->dwHighDateTime << 32) | end_time->dwLowDateTime;
+
+    if (!(refs = heap_alloc( total * sizeof(*refs) ))) return ERROR_NOT_ENOUGH_MEMORY;
+
+    /* buffer 0 holds the logfile header */
+    for (i = 0; i < count; i++)
+    {
+        for (j = 1; j < traces[i]->buffer_count; j++)
+        {
+            if (!read_trace_file( traces[i], (ULONGLONG)j * traces[i]->buffer_size, &header, sizeof(header) ))
+                break;
+            if (header.BufferType != ETW_BUFFER_TYPE_GENERIC || header.BufferSize != traces[i]->buffer_size)
+                continue;
+
+            refs[used].trace = traces[i];
+            refs[used].trace_index = i;
+            refs[used].index = j;
+            refs[used].ring = header.ClientContext.ProcessorNumber;
+            refs[used].sequence = header.SequenceNumber;
+            used++;
+        }
+    }
+
+    qsort( refs, used, sizeof(*refs), compare_buffer_refs );
+
+    for (i = 0; i < used; i++)
+        if (!i || refs[i - 1].trace_index != refs[i].trace_index || refs[i - 1].ring != refs[i].ring)
+            stream_count++;
+
+    if (stream_count && !(streams = heap_alloc_zero( stream_count * sizeof(*streams) )))
+    {
+        ret = ERROR_NOT_ENOUGH_MEMORY;
+        goto done;
+    }
+
+    for (i = 0, j = 0; i < used; i++)
+    {
+        if (i && refs[i - 1].trace_index == refs[i].trace_index && refs[i - 1].ring == refs[i].ring)
+        {
+            streams[j - 1].count++;
+            continue;
+        }
+
+        streams[j].buffers = &refs[i];
+        streams[j].count = 1;
+        streams[j].current = ~0u;
+        if (!(streams[j].data = heap_alloc( max_size )))
+        {
+            ret = ERROR_NOT_ENOUGH_MEMORY;
+            goto done;
+        }
+        j++;
+    }
+
+    for (i = 0; i < stream_count; i++)
+    {
+        if (!next_stream_event( &streams[i], end ))
+        {
+            ret = ERROR_CANCELLED;
+            goto done;
+        }
+    }
+
+    for (;;)
+    {
+        next = NULL;
+        for (i = 0; i < stream_count; i++)
+            if (streams[i].event && (!next || streams[i].time < next->time)) next = &streams[i];
+        if (!next) break;
+
+        if (next->time >= start) deliver_event( next );
+
+        if (!next_stream_event( next, end ))
+        {
+            ret = ERROR_CANCELLED;
+            break;
+        }
+    }
+
+done:
+    for (i = 0; streams && i < stream_count; i++) heap_free( streams[i].data );
+    heap_free( streams );
+    heap_free( refs );
+    return ret;
 }
 
 /******************************************************************************
@@ -141,8 +599,18 @@ ULONG WINAPI ProcessTrace( TRACEHANDLE *handles, ULONG count, FILETIME *start_ti
  */
 ULONG WINAPI CloseTrace( TRACEHANDLE handle )
 {
-    FIXME("%s: stub\n", wine_dbgstr_longlong(handle));
-    return ERROR_INVALID_HANDLE;
+    struct trace_file *trace;
+
+    TRACE( "%s\n", wine_dbgstr_longlong(handle) );
+
+    if (!(trace = find_trace( handle ))) return ERROR_INVALID_HANDLE;
+
+    EnterCriticalSection( &trace_cs );
+    list_remove( &trace->entry );
+    LeaveCriticalSection( &trace_cs );
+
+    free_trace( trace );
+    return ERROR_SUCCESS;
 }
 
 /******************************************************************************
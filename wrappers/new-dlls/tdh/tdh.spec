@@ -13,12 +13,12 @@
 @ stub TdhFormatProperty
 @ stub TdhGetAllEventsInformation
 @ stub TdhGetDecodingParameter
-@ stub TdhGetEventInformation
+@ stdcall TdhGetEventInformation(ptr long ptr ptr ptr)
 @ stub TdhGetEventMapInformation
 @ stub TdhGetManifestEventInformation
-@ stub TdhGetProperty
+@ stdcall TdhGetProperty(ptr long ptr long ptr long ptr)
 @ stub TdhGetPropertyOffsetAndSize
-@ stub TdhGetPropertySize
+@ stdcall TdhGetPropertySize(ptr long ptr long ptr ptr)
 @ stub TdhGetWppMessage
 @ stub TdhGetWppProperty
 @ stdcall TdhLoadManifest(wstr)
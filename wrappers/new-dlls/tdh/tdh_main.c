@@ -23,10 +23,14 @@
 #include "windef.h"
 #include "winbase.h"
 #include "wine/winternl.h"
+#include "tdh.h"
 #include "wine/debug.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(tdh);
 
+static const WCHAR string_property_name[] = {'S','t','r','i','n','g',0};
+static const WCHAR string_event_message[] = {'%','1',0};
+
 ULONG WINAPI TdhLoadManifest(LPWSTR manifest)
 {
     FIXME("(%s): stub\n", debugstr_w(manifest));
@@ -38,3 +42,85 @@ ULONG WINAPI TdhLoadManifestFromBinary(LPWSTR binary)
     FIXME("(%s): stub\n", debugstr_w(binary));
     return STATUS_SUCCESS;
 }
+
+/* There is no manifest to decode events with, only the events written with
+ * EventWriteString can be described: their payload is a single string. */
+static ULONG get_string_property( const EVENT_RECORD *event, ULONG count,
+                                  const PROPERTY_DATA_DESCRIPTOR *data, ULONG *size )
+{
+    if (!event || !data || count != 1) return ERROR_INVALID_PARAMETER;
+    if (!(event->EventHeader.Flags & EVENT_HEADER_FLAG_STRING_ONLY)) return ERROR_NOT_FOUND;
+    if (!data->PropertyName || lstrcmpiW( (const WCHAR *)(ULONG_PTR)data->PropertyName, string_property_name ))
+        return ERROR_NOT_FOUND;
+    if (data->ArrayIndex != ~0u && data->ArrayIndex != 0) return ERROR_INVALID_PARAMETER;
+
+    *size = event->UserDataLength;
+    return ERROR_SUCCESS;
+}
+
+ULONG WINAPI TdhGetEventInformation( EVENT_RECORD *event, ULONG count, TDH_CONTEXT *context,
+                                     TRACE_EVENT_INFO *info, ULONG *size )
+{
+    EVENT_PROPERTY_INFO *property;
+    ULONG needed;
+
+    TRACE( "(%p %u %p %p %p)\n", event, count, context, info, size );
+
+    if (!event || !size) return ERROR_INVALID_PARAMETER;
+    if (!(event->EventHeader.Flags & EVENT_HEADER_FLAG_STRING_ONLY))
+    {
+        FIXME( "no manifest for provider %s\n", debugstr_guid(&event->EventHeader.ProviderId) );
+        return ERROR_NOT_FOUND;
+    }
+
+    needed = sizeof(*info) + sizeof(string_property_name) + sizeof(string_event_message);
+    if (!info || *size < needed)
+    {
+        *size = needed;
+        return ERROR_INSUFFICIENT_BUFFER;
+    }
+
+    memset( info, 0, needed );
+    info->ProviderGuid = event->EventHeader.ProviderId;
+    info->EventDescriptor = event->EventHeader.EventDescriptor;
+    info->DecodingSource = DecodingSourceXMLFile;
+    info->PropertyCount = 1;
+    info->TopLevelPropertyCount = 1;
+    info->Flags = TEMPLATE_EVENT_DATA;
+
+    property = &info->EventPropertyInfoArray[0];
+    property->NameOffset = sizeof(*info);
+    property->nonStructType.InType = TDH_INTYPE_UNICODESTRING;
+    property->nonStructType.OutType = TDH_OUTTYPE_STRING;
+    property->count = 1;
+    memcpy( (BYTE *)info + property->NameOffset, string_property_name, sizeof(string_property_name) );
+
+    info->EventMessageOffset = property->NameOffset + sizeof(string_property_name);
+    memcpy( (BYTE *)info + info->EventMessageOffset, string_event_message, sizeof(string_event_message) );
+
+    *size = needed;
+    return ERROR_SUCCESS;
+}
+
+ULONG WINAPI TdhGetPropertySize( EVENT_RECORD *event, ULONG count, TDH_CONTEXT *context,
+                                 ULONG data_count, PROPERTY_DATA_DESCRIPTOR *data, ULONG *size )
+{
+    TRACE( "(%p %u %p %u %p %p)\n", event, count, context, data_count, data, size );
+
+    if (!size) return ERROR_INVALID_PARAMETER;
+    return get_string_property( event, data_count, data, size );
+}
+
+ULONG WINAPI TdhGetProperty( EVENT_RECORD *event, ULONG count, TDH_CONTEXT *context,
+                             ULONG data_count, PROPERTY_DATA_DESCRIPTOR *data, ULONG size, BYTE *buffer )
+{
+    ULONG needed, ret;
+
+    TRACE( "(%p %u %p %u %p %u %p)\n", event, count, context, data_count, data, size, buffer );
+
+    if ((ret = get_string_property( event, data_count, data, &needed ))) return ret;
+    if (!buffer || size < needed) return ERROR_INSUFFICIENT_BUFFER;
+
+    memcpy( buffer, event->UserData, needed );
+    return ERROR_SUCCESS;
+}
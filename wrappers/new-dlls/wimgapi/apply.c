@@ -0,0 +1,794 @@
+/*
+ * WIM image extraction
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * NOTES
+ *
+ * Files are extracted in the order of their resources in the WIM, so the
+ * image is read sequentially.  Chunks of several resources are decompressed
+ * together on the codec pool while the calling thread reads the next batch,
+ * and decompressed runs are written with overlapped I/O, so the disk, the
+ * pool and the reader all work at the same time.
+ */
+
+#include "wimgapi_private.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(wimgapi);
+
+#define APPLY_SLOTS         3
+#define MAX_TREE_DEPTH      1024
+
+/***********************************************************************
+ * metadata parsing
+ */
+
+struct metadata_buffer
+{
+    const BYTE *data;
+    ULONGLONG   size;
+    ULONGLONG   dentries;       /* parsed so far, bounds looping directory lists */
+};
+
+#include <pshpack1.h>
+typedef struct
+{
+    ULONGLONG length;
+    ULONGLONG unused;
+    BYTE      hash[SHA1_HASH_SIZE];
+    USHORT    name_size;
+} WIM_STREAM_DISK;
+#include <poppack.h>
+
+static BOOL is_valid_name( const WCHAR *name, DWORD len )
+{
+    DWORD i;
+
+    if (!len) return FALSE;
+    if (name[0] == '.' && (len == 1 || (len == 2 && name[1] == '.'))) return FALSE;
+    for (i = 0; i < len; i++)
+        if (!name[i] || name[i] == '\\' || name[i] == '/' || name[i] == ':') return FALSE;
+    return TRUE;
+}
+
+/* parse the entry at offset, returns its length including the stream entries */
+static ULONGLONG parse_dentry( struct metadata_buffer *meta, ULONGLONG offset,
+                              struct wim_dentry *parent, struct wim_dentry **ret )
+{
+    static const WCHAR emptyW[] = {0};
+    WIM_DENTRY_DISK disk;
+    WIM_STREAM_DISK stream;
+    struct wim_dentry *dentry;
+    ULONGLONG length, end;
+    WCHAR *name = NULL;
+    USHORT i;
+
+    *ret = NULL;
+    if (++meta->dentries > meta->size / sizeof(disk)) goto corrupt;
+    if (offset > meta->size || meta->size - offset < sizeof(disk)) goto corrupt;
+    memcpy( &disk, meta->data + offset, sizeof(disk) );
+    if (disk.length < sizeof(disk) || disk.length > meta->size - offset) goto corrupt;
+    if ((disk.name_size & 1) || disk.name_size > disk.length - sizeof(disk)) goto corrupt;
+
+    if (parent)
+    {
+        if (!(name = HeapAlloc( GetProcessHeap(), 0, disk.name_size + sizeof(WCHAR) ))) goto nomem;
+        memcpy( name, meta->data + offset + sizeof(disk), disk.name_size );
+        name[disk.name_size / sizeof(WCHAR)] = 0;
+        if (!is_valid_name( name, disk.name_size / sizeof(WCHAR) ))
+        {
+            WARN( "invalid name %s\n", debugstr_wn( name, disk.name_size / sizeof(WCHAR) ) );
+            HeapFree( GetProcessHeap(), 0, name );
+            goto corrupt;
+        }
+    }
+    dentry = dentry_alloc( parent, name ? name : emptyW );
+    HeapFree( GetProcessHeap(), 0, name );
+    if (!dentry) goto nomem;
+
+    dentry->attributes = disk.attributes;
+    dentry->subdir_offset = disk.subdir_offset;
+    dentry->creation_time = disk.creation_time;
+    dentry->last_access_time = disk.last_access_time;
+    dentry->last_write_time = disk.last_write_time;
+    memcpy( dentry->hash, disk.hash, SHA1_HASH_SIZE );
+    if (disk.attributes & FILE_ATTRIBUTE_REPARSE_POINT) dentry->reparse_tag = disk.u.reparse.tag;
+    *ret = dentry;
+
+    /* alternate data streams follow the entry; an unnamed one holds the file data */
+    length = disk.length;
+    for (i = 0; i < disk.stream_count; i++)
+    {
+        end = offset + length;
+        if (meta->size - end < sizeof(stream)) goto corrupt;
+        memcpy( &stream, meta->data + end, sizeof(stream) );
+        if (stream.length < sizeof(stream) || stream.length > meta->size - end) goto corrupt;
+
+        if (!stream.name_size)
+            memcpy( dentry->hash, stream.hash, SHA1_HASH_SIZE );
+        else
+            FIXME( "ignoring named stream of %s\n", debugstr_w(dentry->name) );
+        length += (stream.length + 7) & ~7;
+        if (length > meta->size - offset) goto corrupt;
+    }
+    return length;
+
+corrupt:
+    SetLastError( ERROR_FILE_CORRUPT );
+    return 0;
+nomem:
+    SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+    return 0;
+}
+
+static BOOL parse_directory( struct metadata_buffer *meta, struct wim_dentry *dir, DWORD depth )
+{
+    struct wim_dentry *child;
+    ULONGLONG offset = dir->subdir_offset, length;
+
+    if (depth > MAX_TREE_DEPTH)
+    {
+        SetLastError( ERROR_FILE_CORRUPT );
+        return FALSE;
+    }
+
+    for (;;)
+    {
+        if (offset > meta->size || meta->size - offset < sizeof(ULONGLONG))
+        {
+            SetLastError( ERROR_FILE_CORRUPT );
+            return FALSE;
+        }
+        memcpy( &length, meta->data + offset, sizeof(length) );
+        /* the list ends with an entry of zero length */
+        if (length <= sizeof(ULONGLONG)) break;
+
+        if (!(length = parse_dentry( meta, offset, dir, &child ))) return FALSE;
+        offset += length;
+
+        if ((child->attributes & FILE_ATTRIBUTE_DIRECTORY) && child->subdir_offset &&
+            !parse_directory( meta, child, depth + 1 ))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+struct wim_dentry *load_metadata( struct wim_file *wim, struct codec_pool *pool, DWORD image )
+{
+    const struct wim_resource *res = &wim->resources[wim->images[image].metadata];
+    struct metadata_buffer meta;
+    struct wim_dentry *root = NULL;
+    DWORD security_size;
+    BYTE *buffer;
+
+    if (res->original_size > MAXLONG || res->original_size < sizeof(DWORD))
+    {
+        SetLastError( ERROR_FILE_CORRUPT );
+        return NULL;
+    }
+    if (!(buffer = HeapAlloc( GetProcessHeap(), 0, res->original_size )))
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return NULL;
+    }
+    if (!read_resource( wim, pool, res, buffer )) goto done;
+
+    meta.data = buffer;
+    meta.size = res->original_size;
+    meta.dentries = 0;
+
+    /* security descriptors come first */
+    security_size = *(DWORD *)buffer;
+    if (security_size < 2 * sizeof(DWORD) || security_size > meta.size)
+    {
+        SetLastError( ERROR_FILE_CORRUPT );
+        goto done;
+    }
+    if (!parse_dentry( &meta, (security_size + 7) & ~7, NULL, &root ) ||
+        (root->subdir_offset && !parse_directory( &meta, root, 0 )))
+    {
+        dentry_free_tree( root );
+        root = NULL;
+    }
+
+done:
+    HeapFree( GetProcessHeap(), 0, buffer );
+    return root;
+}
+
+/***********************************************************************
+ * extraction
+ */
+
+struct apply_target
+{
+    struct apply_target *next_closing;
+    struct wim_dentry   *dentry;
+    WCHAR               *path;
+    HANDLE               file;
+    LONG                 pending;       /* writes in flight */
+};
+
+struct apply_task
+{
+    const struct wim_resource *res;
+    struct apply_target      **targets;
+    DWORD                      target_count;
+    ULONGLONG                 *offsets;     /* absolute chunk offsets */
+    DWORD                      chunks;
+    DWORD                      next_chunk;  /* next chunk to read */
+    SHA_CTX                    sha;
+};
+
+struct apply_context;
+
+struct apply_write
+{
+    OVERLAPPED            ovl;
+    struct apply_context *ctx;
+    struct apply_slot    *slot;
+    struct apply_target  *target;
+    DWORD                 size;
+};
+
+struct apply_slot
+{
+    BYTE               *input;
+    BYTE               *output;
+    struct chunk_job    jobs[WIM_BATCH_CHUNKS];
+    struct apply_task  *owners[WIM_BATCH_CHUNKS];
+    DWORD               chunk_index[WIM_BATCH_CHUNKS];
+    LONG                count;
+    BOOL                busy;           /* being decompressed */
+    struct apply_write *writes;
+    DWORD               write_count;
+    DWORD               write_size;
+    LONG                pending;        /* writes in flight */
+};
+
+struct apply_context
+{
+    struct wim_file     *wim;
+    struct codec_pool   *pool;
+    DWORD                flags;
+    struct apply_target *targets;
+    DWORD                target_count;
+    DWORD                target_size;
+    struct apply_task   *tasks;
+    DWORD                task_count;
+    DWORD                next_task;
+    struct apply_slot    slots[APPLY_SLOTS];
+    struct apply_target *closing;       /* all data issued, waiting for the writes */
+    DWORD                error;
+};
+
+static void set_error( struct apply_context *ctx, DWORD error )
+{
+    if (!ctx->error) ctx->error = error;
+}
+
+static WCHAR *build_path( const WCHAR *dir, const WCHAR *name )
+{
+    SIZE_T dir_len = strlenW( dir ), name_len = strlenW( name );
+    WCHAR *path;
+
+    if (!(path = HeapAlloc( GetProcessHeap(), 0, (dir_len + name_len + 2) * sizeof(WCHAR) ))) return NULL;
+    memcpy( path, dir, dir_len * sizeof(WCHAR) );
+    path[dir_len] = '\\';
+    memcpy( path + dir_len + 1, name, (name_len + 1) * sizeof(WCHAR) );
+    return path;
+}
+
+static DWORD restore_attributes( DWORD attributes )
+{
+    attributes &= FILE_ATTRIBUTE_READONLY | FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM |
+                  FILE_ATTRIBUTE_ARCHIVE | FILE_ATTRIBUTE_TEMPORARY | FILE_ATTRIBUTE_OFFLINE |
+                  FILE_ATTRIBUTE_NOT_CONTENT_INDEXED;
+    return attributes ? attributes : FILE_ATTRIBUTE_NORMAL;
+}
+
+static BOOL is_directory( const struct wim_dentry *dentry )
+{
+    return (dentry->attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+}
+
+/* create the directories and collect the files, in tree order */
+static BOOL create_tree( struct apply_context *ctx, struct wim_dentry *dir, const WCHAR *path )
+{
+    struct wim_dentry *child;
+    struct apply_target *target;
+    WCHAR *child_path;
+
+    for (child = dir->children; child; child = child->next)
+    {
+        if (!(child_path = build_path( path, child->name )))
+        {
+            set_error( ctx, ERROR_NOT_ENOUGH_MEMORY );
+            return FALSE;
+        }
+        if (child->attributes & FILE_ATTRIBUTE_REPARSE_POINT)
+            FIXME( "restoring %s without its reparse data\n", debugstr_w(child_path) );
+
+        if (ctx->target_count == ctx->target_size)
+        {
+            DWORD size = max( 256, ctx->target_size * 2 );
+            struct apply_target *targets;
+
+            if (ctx->targets)
+                targets = HeapReAlloc( GetProcessHeap(), 0, ctx->targets, size * sizeof(*targets) );
+            else
+                targets = HeapAlloc( GetProcessHeap(), 0, size * sizeof(*targets) );
+            if (!targets)
+            {
+                HeapFree( GetProcessHeap(), 0, child_path );
+                set_error( ctx, ERROR_NOT_ENOUGH_MEMORY );
+                return FALSE;
+            }
+            ctx->targets = targets;
+            ctx->target_size = size;
+        }
+        target = &ctx->targets[ctx->target_count++];
+        memset( target, 0, sizeof(*target) );
+        target->dentry = child;
+        target->path = child_path;
+        target->file = INVALID_HANDLE_VALUE;
+
+        if (is_directory( child ))
+        {
+            if (!(ctx->flags & WIM_FLAG_NO_APPLY) && !CreateDirectoryW( child_path, NULL ) &&
+                GetLastError() != ERROR_ALREADY_EXISTS)
+            {
+                WARN( "can't create %s, error %u\n", debugstr_w(child_path), GetLastError() );
+                set_error( ctx, GetLastError() );
+                return FALSE;
+            }
+            if (!create_tree( ctx, child, child_path )) return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static int __cdecl compare_targets( const void *a, const void *b )
+{
+    const struct apply_target *x = *(const struct apply_target * const *)a;
+    const struct apply_target *y = *(const struct apply_target * const *)b;
+
+    return memcmp( x->dentry->hash, y->dentry->hash, SHA1_HASH_SIZE );
+}
+
+static int __cdecl compare_tasks( const void *a, const void *b )
+{
+    const struct apply_task *x = a, *y = b;
+
+    if (x->res->offset < y->res->offset) return -1;
+    return x->res->offset > y->res->offset;
+}
+
+/* one task per resource, with every file that has the same contents */
+static BOOL build_tasks( struct apply_context *ctx, struct apply_target ***sorted_ret )
+{
+    struct apply_target **sorted;
+    struct wim_resource *res;
+    DWORD i, count = 0;
+
+    *sorted_ret = NULL;
+    if (!(sorted = HeapAlloc( GetProcessHeap(), 0, max( ctx->target_count, 1 ) * sizeof(*sorted) )) ||
+        !(ctx->tasks = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                  max( ctx->target_count, 1 ) * sizeof(*ctx->tasks) )))
+    {
+        HeapFree( GetProcessHeap(), 0, sorted );
+        set_error( ctx, ERROR_NOT_ENOUGH_MEMORY );
+        return FALSE;
+    }
+    *sorted_ret = sorted;
+
+    for (i = 0; i < ctx->target_count; i++)
+    {
+        if (is_directory( ctx->targets[i].dentry ) || hash_is_zero( ctx->targets[i].dentry->hash ))
+            continue;
+        sorted[count++] = &ctx->targets[i];
+    }
+    qsort( sorted, count, sizeof(*sorted), compare_targets );
+
+    for (i = 0; i < count; i++)
+    {
+        if (i && !memcmp( sorted[i]->dentry->hash, sorted[i - 1]->dentry->hash, SHA1_HASH_SIZE ))
+        {
+            ctx->tasks[ctx->task_count - 1].target_count++;
+            continue;
+        }
+        if (!(res = wim_find_resource( ctx->wim, sorted[i]->dentry->hash )))
+        {
+            WARN( "no resource for %s\n", debugstr_w(sorted[i]->path) );
+            set_error( ctx, ERROR_FILE_CORRUPT );
+            return FALSE;
+        }
+        ctx->tasks[ctx->task_count].res = res;
+        ctx->tasks[ctx->task_count].targets = &sorted[i];
+        ctx->tasks[ctx->task_count].target_count = 1;
+        ctx->task_count++;
+    }
+
+    qsort( ctx->tasks, ctx->task_count, sizeof(*ctx->tasks), compare_tasks );
+    return TRUE;
+}
+
+static void close_target( struct apply_context *ctx, struct apply_target *target )
+{
+    const struct wim_dentry *dentry = target->dentry;
+
+    if (target->file == INVALID_HANDLE_VALUE) return;
+
+    if (!SetFileTime( target->file, &dentry->creation_time, &dentry->last_access_time,
+                      &dentry->last_write_time ))
+        WARN( "can't set times of %s, error %u\n", debugstr_w(target->path), GetLastError() );
+    CloseHandle( target->file );
+    target->file = INVALID_HANDLE_VALUE;
+
+    /* read-only files can't be written, so the attributes go last */
+    if (!SetFileAttributesW( target->path, restore_attributes( dentry->attributes ) ))
+        set_error( ctx, GetLastError() );
+}
+
+static BOOL open_target( struct apply_context *ctx, struct apply_target *target, ULONGLONG size )
+{
+    LARGE_INTEGER end;
+
+    /* clear attributes that would make CREATE_ALWAYS fail */
+    SetFileAttributesW( target->path, FILE_ATTRIBUTE_NORMAL );
+
+    target->file = CreateFileW( target->path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                                FILE_ATTRIBUTE_NORMAL | (size ? FILE_FLAG_OVERLAPPED : 0), NULL );
+    if (target->file == INVALID_HANDLE_VALUE)
+    {
+        WARN( "can't create %s, error %u\n", debugstr_w(target->path), GetLastError() );
+        set_error( ctx, GetLastError() );
+        return FALSE;
+    }
+
+    /* allocate the whole file up front, the writes may complete out of order */
+    if (size)
+    {
+        end.QuadPart = size;
+        if (!SetFilePointerEx( target->file, end, NULL, FILE_BEGIN ) || !SetEndOfFile( target->file ))
+            WARN( "can't preallocate %s, error %u\n", debugstr_w(target->path), GetLastError() );
+    }
+    return TRUE;
+}
+
+static void CALLBACK write_done( DWORD error, DWORD count, OVERLAPPED *ovl )
+{
+    struct apply_write *write = CONTAINING_RECORD( ovl, struct apply_write, ovl );
+
+    if (error) set_error( write->ctx, error );
+    else if (count != write->size) set_error( write->ctx, ERROR_WRITE_FAULT );
+    write->slot->pending--;
+    write->target->pending--;
+}
+
+/* completion routines only run here, so no locking is needed */
+static void wait_writes( struct apply_context *ctx, struct apply_slot *slot )
+{
+    struct apply_target **ptr, *target;
+
+    while (slot->pending) SleepEx( INFINITE, TRUE );
+
+    for (ptr = &ctx->closing; (target = *ptr);)
+    {
+        if (target->pending)
+        {
+            ptr = &target->next_closing;
+            continue;
+        }
+        *ptr = target->next_closing;
+        close_target( ctx, target );
+    }
+}
+
+static BOOL issue_write( struct apply_context *ctx, struct apply_slot *slot, struct apply_target *target,
+                         ULONGLONG offset, const BYTE *data, DWORD size )
+{
+    struct apply_write *write;
+
+    if (slot->write_count == slot->write_size)
+    {
+        DWORD new_size = max( WIM_BATCH_CHUNKS, slot->write_size * 2 );
+        struct apply_write *writes;
+
+        /* earlier writes of the slot are still in flight, so the array can't move */
+        while (slot->pending) SleepEx( INFINITE, TRUE );
+        if (slot->writes)
+            writes = HeapReAlloc( GetProcessHeap(), 0, slot->writes, new_size * sizeof(*writes) );
+        else
+            writes = HeapAlloc( GetProcessHeap(), 0, new_size * sizeof(*writes) );
+        if (!writes)
+        {
+            set_error( ctx, ERROR_NOT_ENOUGH_MEMORY );
+            return FALSE;
+        }
+        slot->writes = writes;
+        slot->write_size = new_size;
+    }
+
+    write = &slot->writes[slot->write_count++];
+    memset( &write->ovl, 0, sizeof(write->ovl) );
+    write->ovl.Offset = (DWORD)offset;
+    write->ovl.OffsetHigh = offset >> 32;
+    write->ctx = ctx;
+    write->slot = slot;
+    write->target = target;
+    write->size = size;
+
+    if (!WriteFileEx( target->file, data, size, &write->ovl, write_done ))
+    {
+        set_error( ctx, GetLastError() );
+        return FALSE;
+    }
+    slot->pending++;
+    target->pending++;
+    return TRUE;
+}
+
+/* read the compressed chunks of as many resources as fit in the slot */
+static void fill_slot( struct apply_context *ctx, struct apply_slot *slot )
+{
+    struct apply_task *task;
+    struct chunk_job *job;
+    ULONGLONG start;
+    DWORD i, count, used = 0;
+
+    slot->count = 0;
+    slot->write_count = 0;
+
+    while (!ctx->error && ctx->next_task < ctx->task_count && slot->count < WIM_BATCH_CHUNKS)
+    {
+        task = &ctx->tasks[ctx->next_task];
+
+        if (!task->offsets)
+        {
+            for (i = 0; i < task->target_count; i++)
+                if (!open_target( ctx, task->targets[i], task->res->original_size )) return;
+            if (!read_chunk_table( ctx->wim, task->res, &task->offsets, &task->chunks ))
+            {
+                set_error( ctx, GetLastError() );
+                return;
+            }
+            A_SHAInit( &task->sha );
+
+            if (!task->chunks)
+            {
+                for (i = 0; i < task->target_count; i++) close_target( ctx, task->targets[i] );
+                ctx->next_task++;
+                continue;
+            }
+        }
+
+        count = min( WIM_BATCH_CHUNKS - slot->count, task->chunks - task->next_chunk );
+        start = task->offsets[task->next_chunk];
+        if (count && !wim_read( ctx->wim, start, slot->input + used,
+                                task->offsets[task->next_chunk + count] - start ))
+        {
+            set_error( ctx, GetLastError() );
+            return;
+        }
+
+        for (i = 0; i < count; i++)
+        {
+            DWORD index = task->next_chunk + i;
+
+            job = &slot->jobs[slot->count];
+            job->src = slot->input + used;
+            job->src_size = task->offsets[index + 1] - task->offsets[index];
+            job->dst = slot->output + slot->count * WIM_CHUNK_SIZE;
+            job->size = min( WIM_CHUNK_SIZE, task->res->original_size - (ULONGLONG)index * WIM_CHUNK_SIZE );
+            slot->owners[slot->count] = task;
+            slot->chunk_index[slot->count] = index;
+            slot->count++;
+            used += job->src_size;
+        }
+
+        task->next_chunk += count;
+        if (task->next_chunk == task->chunks) ctx->next_task++;
+    }
+}
+
+/* verify the decompressed batch and start writing it out */
+static void complete_slot( struct apply_context *ctx, struct apply_slot *slot )
+{
+    struct apply_task *task;
+    struct chunk_job *job;
+    BYTE hash[SHA1_HASH_SIZE];
+    DWORD i, size;
+    LONG first, last;
+
+    for (first = 0; first < slot->count && !ctx->error; first = last)
+    {
+        task = slot->owners[first];
+
+        /* decompressed chunks of a task are contiguous in the output buffer */
+        size = 0;
+        for (last = first; last < slot->count && slot->owners[last] == task; last++)
+        {
+            job = &slot->jobs[last];
+            if (job->data != job->dst) memcpy( job->dst, job->data, job->size );
+            if (ctx->flags & WIM_FLAG_VERIFY) A_SHAUpdate( &task->sha, job->dst, job->size );
+            size += job->size;
+        }
+
+        if (slot->chunk_index[last - 1] == task->chunks - 1 && (ctx->flags & WIM_FLAG_VERIFY))
+        {
+            A_SHAFinal( &task->sha, (ULONG *)hash );
+            if (memcmp( hash, task->res->hash, SHA1_HASH_SIZE ))
+            {
+                WARN( "hash mismatch for %s\n", debugstr_w(task->targets[0]->path) );
+                set_error( ctx, ERROR_FILE_CORRUPT );
+                break;
+            }
+        }
+
+        for (i = 0; i < task->target_count; i++)
+        {
+            if (!issue_write( ctx, slot, task->targets[i],
+                              (ULONGLONG)slot->chunk_index[first] * WIM_CHUNK_SIZE,
+                              slot->jobs[first].dst, size ))
+                break;
+        }
+
+        if (slot->chunk_index[last - 1] == task->chunks - 1)
+        {
+            for (i = 0; i < task->target_count; i++)
+            {
+                task->targets[i]->next_closing = ctx->closing;
+                ctx->closing = task->targets[i];
+            }
+            HeapFree( GetProcessHeap(), 0, task->offsets );
+            task->offsets = NULL;
+        }
+    }
+    slot->busy = FALSE;
+}
+
+static void extract_files( struct apply_context *ctx )
+{
+    struct apply_slot *slot, *prev;
+    DWORD i, n;
+
+    for (n = 0;; n++)
+    {
+        slot = &ctx->slots[n % APPLY_SLOTS];
+        prev = &ctx->slots[(n + APPLY_SLOTS - 1) % APPLY_SLOTS];
+
+        /* the oldest slot is reused, its writes had two batches to complete */
+        wait_writes( ctx, slot );
+        fill_slot( ctx, slot );
+
+        if (prev->busy)
+        {
+            if (!pool_wait( ctx->pool )) set_error( ctx, ERROR_FILE_CORRUPT );
+            if (ctx->error) prev->busy = FALSE;
+            else complete_slot( ctx, prev );
+        }
+        if (!slot->count || ctx->error) break;
+
+        pool_dispatch( ctx->pool, slot->jobs, slot->count );
+        slot->busy = TRUE;
+    }
+
+    for (i = 0; i < APPLY_SLOTS; i++) wait_writes( ctx, &ctx->slots[i] );
+}
+
+/* directory times last, since creating the files changed them */
+static void finish_directories( struct apply_context *ctx )
+{
+    struct apply_target *target;
+    HANDLE dir;
+    DWORD i;
+
+    for (i = ctx->target_count; i > 0; i--)
+    {
+        target = &ctx->targets[i - 1];
+        if (!is_directory( target->dentry )) continue;
+
+        dir = CreateFileW( target->path, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                           NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL );
+        if (dir != INVALID_HANDLE_VALUE)
+        {
+            SetFileTime( dir, &target->dentry->creation_time, &target->dentry->last_access_time,
+                         &target->dentry->last_write_time );
+            CloseHandle( dir );
+        }
+        SetFileAttributesW( target->path, restore_attributes( target->dentry->attributes ) );
+    }
+}
+
+BOOL apply_image( struct wim_image *image, PCWSTR path, DWORD flags )
+{
+    struct apply_context ctx;
+    struct apply_target **sorted = NULL;
+    struct wim_dentry *root = NULL;
+    DWORD i;
+
+    memset( &ctx, 0, sizeof(ctx) );
+    ctx.wim = image->wim;
+    ctx.flags = flags;
+
+    if (!(ctx.pool = pool_create( ctx.wim->compression, TRUE ))) return FALSE;
+    if (!(root = load_metadata( ctx.wim, ctx.pool, image->index )))
+    {
+        ctx.error = GetLastError();
+        goto done;
+    }
+
+    if (!(flags & WIM_FLAG_NO_APPLY) && !CreateDirectoryW( path, NULL ) &&
+        GetLastError() != ERROR_ALREADY_EXISTS)
+    {
+        ctx.error = GetLastError();
+        goto done;
+    }
+
+    TRACE( "applying image %u to %s\n", image->index + 1, debugstr_w(path) );
+    if (!create_tree( &ctx, root, path )) goto done;
+    if (!build_tasks( &ctx, &sorted )) goto done;
+    if (flags & WIM_FLAG_NO_APPLY) goto done;
+
+    for (i = 0; i < APPLY_SLOTS; i++)
+    {
+        ctx.slots[i].input = HeapAlloc( GetProcessHeap(), 0, WIM_BATCH_CHUNKS * WIM_CHUNK_SIZE );
+        ctx.slots[i].output = HeapAlloc( GetProcessHeap(), 0, WIM_BATCH_CHUNKS * WIM_CHUNK_SIZE );
+        if (!ctx.slots[i].input || !ctx.slots[i].output)
+        {
+            set_error( &ctx, ERROR_NOT_ENOUGH_MEMORY );
+            goto done;
+        }
+    }
+
+    /* empty files have no resource */
+    for (i = 0; i < ctx.target_count && !ctx.error; i++)
+    {
+        struct apply_target *target = &ctx.targets[i];
+
+        if (is_directory( target->dentry ) || !hash_is_zero( target->dentry->hash )) continue;
+        if (open_target( &ctx, target, 0 )) close_target( &ctx, target );
+    }
+
+    if (!ctx.error) extract_files( &ctx );
+    if (!ctx.error) finish_directories( &ctx );
+
+done:
+    for (i = 0; i < ctx.target_count; i++)
+    {
+        if (ctx.targets[i].file != INVALID_HANDLE_VALUE) CloseHandle( ctx.targets[i].file );
+        HeapFree( GetProcessHeap(), 0, ctx.targets[i].path );
+    }
+    for (i = 0; i < ctx.task_count; i++) HeapFree( GetProcessHeap(), 0, ctx.tasks[i].offsets );
+    for (i = 0; i < APPLY_SLOTS; i++)
+    {
+        HeapFree( GetProcessHeap(), 0, ctx.slots[i].input );
+        HeapFree( GetProcessHeap(), 0, ctx.slots[i].output );
+        HeapFree( GetProcessHeap(), 0, ctx.slots[i].writes );
+    }
+    HeapFree( GetProcessHeap(), 0, ctx.tasks );
+    HeapFree( GetProcessHeap(), 0, ctx.targets );
+    HeapFree( GetProcessHeap(), 0, sorted );
+    dentry_free_tree( root );
+    pool_destroy( ctx.pool );
+
+    if (ctx.error)
+    {
+        SetLastError( ctx.error );
+        return FALSE;
+    }
+    return TRUE;
+}
@@ -0,0 +1,404 @@
+/*
+ * WIM image capture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * NOTES
+ *
+ * Security descriptors, alternate data streams, short names, hard links and
+ * reparse data are not captured yet; reparse points are stored as empty
+ * files and directories without their reparse data.
+ */
+
+#include "wimgapi_private.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(wimgapi);
+
+#define PATH_BUFFER_SIZE    32768
+
+struct capture_context
+{
+    struct resource_writer writer;
+    WCHAR                 *path;            /* PATH_BUFFER_SIZE characters */
+    DWORD                  dir_count;
+    DWORD                  file_count;
+    ULONGLONG              total_bytes;
+};
+
+struct wim_dentry *dentry_alloc( struct wim_dentry *parent, const WCHAR *name )
+{
+    struct wim_dentry *dentry;
+    SIZE_T len = strlenW( name );
+
+    if (!(dentry = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*dentry) ))) return NULL;
+    if (!(dentry->name = HeapAlloc( GetProcessHeap(), 0, (len + 1) * sizeof(WCHAR) )))
+    {
+        HeapFree( GetProcessHeap(), 0, dentry );
+        return NULL;
+    }
+    memcpy( dentry->name, name, (len + 1) * sizeof(WCHAR) );
+
+    if ((dentry->parent = parent))
+    {
+        dentry->next = parent->children;
+        parent->children = dentry;
+    }
+    return dentry;
+}
+
+void dentry_free_tree( struct wim_dentry *root )
+{
+    struct wim_dentry *dentry = root, *next;
+
+    /* walk down to the leaves without recursion, freeing on the way back up */
+    while (dentry)
+    {
+        if (dentry->children)
+        {
+            next = dentry->children;
+            dentry->children = NULL;
+            dentry = next;
+            continue;
+        }
+        next = dentry->next ? dentry->next : dentry->parent;
+        if (dentry == root) next = NULL;
+        HeapFree( GetProcessHeap(), 0, dentry->name );
+        HeapFree( GetProcessHeap(), 0, dentry );
+        dentry = next;
+    }
+}
+
+static BOOL is_directory( const struct wim_dentry *dentry )
+{
+    return (dentry->attributes & (FILE_ATTRIBUTE_DIRECTORY | FILE_ATTRIBUTE_REPARSE_POINT)) ==
+           FILE_ATTRIBUTE_DIRECTORY;
+}
+
+/* feed the unnamed stream of the file at ctx->path to the writer */
+static BOOL capture_data( struct capture_context *ctx, struct wim_dentry *dentry )
+{
+    HANDLE file;
+    DWORD room, count, error = 0;
+    BYTE *buffer;
+
+    file = CreateFileW( ctx->path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        WARN( "can't open %s, error %u\n", debugstr_w(ctx->path), GetLastError() );
+        return FALSE;
+    }
+
+    if (!writer_begin( &ctx->writer, dentry->size, 0, dentry->hash, NULL ))
+    {
+        CloseHandle( file );
+        return FALSE;
+    }
+
+    for (;;)
+    {
+        buffer = writer_get_buffer( &ctx->writer, &room );
+        if (!room) break;
+        if (!ReadFile( file, buffer, room, &count, NULL ))
+        {
+            error = GetLastError();
+            break;
+        }
+        /* a file that shrinks is caught by writer_end */
+        if (!count || !writer_commit( &ctx->writer, count )) break;
+    }
+    CloseHandle( file );
+
+    if (writer_end( &ctx->writer )) return TRUE;
+    if (error) SetLastError( error );
+    return FALSE;
+}
+
+static BOOL capture_directory( struct capture_context *ctx, struct wim_dentry *dir, SIZE_T len )
+{
+    static const WCHAR wildcardW[] = {'\\','*',0};
+    WIN32_FIND_DATAW data;
+    struct wim_dentry *child;
+    SIZE_T name_len;
+    HANDLE find;
+    BOOL ret = TRUE;
+
+    if (len + 3 > PATH_BUFFER_SIZE)
+    {
+        SetLastError( ERROR_FILENAME_EXCED_RANGE );
+        return FALSE;
+    }
+    strcpyW( ctx->path + len, wildcardW );
+
+    find = FindFirstFileW( ctx->path, &data );
+    if (find == INVALID_HANDLE_VALUE)
+    {
+        ctx->path[len] = 0;
+        return GetLastError() == ERROR_FILE_NOT_FOUND;
+    }
+
+    do
+    {
+        if (data.cFileName[0] == '.' &&
+            (!data.cFileName[1] || (data.cFileName[1] == '.' && !data.cFileName[2])))
+            continue;
+
+        name_len = strlenW( data.cFileName );
+        if (len + 1 + name_len + 3 > PATH_BUFFER_SIZE)
+        {
+            SetLastError( ERROR_FILENAME_EXCED_RANGE );
+            ret = FALSE;
+            break;
+        }
+        ctx->path[len] = '\\';
+        strcpyW( ctx->path + len + 1, data.cFileName );
+
+        if (!(child = dentry_alloc( dir, data.cFileName )))
+        {
+            SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+            ret = FALSE;
+            break;
+        }
+        child->attributes = data.dwFileAttributes;
+        child->creation_time = data.ftCreationTime;
+        child->last_access_time = data.ftLastAccessTime;
+        child->last_write_time = data.ftLastWriteTime;
+
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)
+        {
+            FIXME( "reparse data of %s not captured\n", debugstr_w(ctx->path) );
+            child->reparse_tag = data.dwReserved0;
+        }
+        else if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            ctx->dir_count++;
+            if (!(ret = capture_directory( ctx, child, len + 1 + name_len ))) break;
+        }
+        else
+        {
+            ctx->file_count++;
+            child->size = ((ULONGLONG)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+            ctx->total_bytes += child->size;
+            if (child->size && !(ret = capture_data( ctx, child ))) break;
+        }
+    }
+    while (FindNextFileW( find, &data ));
+
+    FindClose( find );
+    ctx->path[len] = 0;
+    return ret;
+}
+
+static ULONGLONG dentry_disk_length( const struct wim_dentry *dentry )
+{
+    ULONGLONG len = sizeof(WIM_DENTRY_DISK);
+
+    if (dentry->name[0]) len += (strlenW( dentry->name ) + 1) * sizeof(WCHAR);
+    return (len + 7) & ~7;
+}
+
+/* each directory's children follow each other, ended by an empty entry */
+static void assign_subdir_offsets( struct wim_dentry *dir, ULONGLONG *offset )
+{
+    struct wim_dentry *child;
+
+    dir->subdir_offset = *offset;
+    for (child = dir->children; child; child = child->next) *offset += dentry_disk_length( child );
+    *offset += sizeof(ULONGLONG);
+
+    for (child = dir->children; child; child = child->next)
+        if (is_directory( child )) assign_subdir_offsets( child, offset );
+}
+
+static BYTE *write_dentry( BYTE *ptr, const struct wim_dentry *dentry )
+{
+    WIM_DENTRY_DISK *disk = (WIM_DENTRY_DISK *)ptr;
+
+    disk->length = dentry_disk_length( dentry );
+    disk->attributes = dentry->attributes;
+    disk->security_id = ~0u;
+    disk->subdir_offset = is_directory( dentry ) ? dentry->subdir_offset : 0;
+    disk->creation_time = dentry->creation_time;
+    disk->last_access_time = dentry->last_access_time;
+    disk->last_write_time = dentry->last_write_time;
+    memcpy( disk->hash, dentry->hash, SHA1_HASH_SIZE );
+    if (dentry->attributes & FILE_ATTRIBUTE_REPARSE_POINT) disk->u.reparse.tag = dentry->reparse_tag;
+    disk->name_size = strlenW( dentry->name ) * sizeof(WCHAR);
+    memcpy( disk + 1, dentry->name, disk->name_size );
+    return ptr + disk->length;
+}
+
+static void write_directory( BYTE *buffer, const struct wim_dentry *dir )
+{
+    const struct wim_dentry *child;
+    BYTE *ptr = buffer + dir->subdir_offset;
+
+    for (child = dir->children; child; child = child->next) ptr = write_dentry( ptr, child );
+
+    for (child = dir->children; child; child = child->next)
+        if (is_directory( child )) write_directory( buffer, child );
+}
+
+/* security data without descriptors, the root, and the tree below it */
+static BOOL write_metadata( struct capture_context *ctx, struct wim_dentry *root, DWORD *index )
+{
+    ULONGLONG size;
+    BYTE *buffer;
+    BOOL ret;
+
+    size = 2 * sizeof(DWORD) + dentry_disk_length( root ) + sizeof(ULONGLONG);
+    assign_subdir_offsets( root, &size );
+    if (size > MAXLONG || !(buffer = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, size )))
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return FALSE;
+    }
+
+    ((DWORD *)buffer)[0] = 2 * sizeof(DWORD);   /* total length */
+    ((DWORD *)buffer)[1] = 0;                   /* descriptor count */
+    write_dentry( buffer + 2 * sizeof(DWORD), root );
+    write_directory( buffer, root );
+
+    ret = writer_begin( &ctx->writer, size, RESHDR_FLAG_METADATA, NULL, index ) &&
+          writer_write( &ctx->writer, buffer, size ) &&
+          writer_end( &ctx->writer );
+    HeapFree( GetProcessHeap(), 0, buffer );
+    return ret;
+}
+
+static WCHAR *build_image_xml( const struct capture_context *ctx )
+{
+    static const WCHAR fmtW[] =
+        {'<','D','I','R','C','O','U','N','T','>','%','u','<','/','D','I','R','C','O','U','N','T','>',
+         '<','F','I','L','E','C','O','U','N','T','>','%','u','<','/','F','I','L','E','C','O','U','N','T','>',
+         '<','T','O','T','A','L','B','Y','T','E','S','>','%','I','6','4','u',
+         '<','/','T','O','T','A','L','B','Y','T','E','S','>',
+         '<','H','A','R','D','L','I','N','K','B','Y','T','E','S','>','0',
+         '<','/','H','A','R','D','L','I','N','K','B','Y','T','E','S','>',
+         '<','C','R','E','A','T','I','O','N','T','I','M','E','>',
+         '<','H','I','G','H','P','A','R','T','>','0','x','%','0','8','X','<','/','H','I','G','H','P','A','R','T','>',
+         '<','L','O','W','P','A','R','T','>','0','x','%','0','8','X','<','/','L','O','W','P','A','R','T','>',
+         '<','/','C','R','E','A','T','I','O','N','T','I','M','E','>',
+         '<','L','A','S','T','M','O','D','I','F','I','C','A','T','I','O','N','T','I','M','E','>',
+         '<','H','I','G','H','P','A','R','T','>','0','x','%','0','8','X','<','/','H','I','G','H','P','A','R','T','>',
+         '<','L','O','W','P','A','R','T','>','0','x','%','0','8','X','<','/','L','O','W','P','A','R','T','>',
+         '<','/','L','A','S','T','M','O','D','I','F','I','C','A','T','I','O','N','T','I','M','E','>',0};
+    FILETIME now;
+    WCHAR *xml;
+
+    if (!(xml = HeapAlloc( GetProcessHeap(), 0, (strlenW( fmtW ) + 64) * sizeof(WCHAR) ))) return NULL;
+
+    GetSystemTimeAsFileTime( &now );
+    sprintfW( xml, fmtW, ctx->dir_count, ctx->file_count, ctx->total_bytes,
+              now.dwHighDateTime, now.dwLowDateTime, now.dwHighDateTime, now.dwLowDateTime );
+    return xml;
+}
+
+HANDLE capture_image( struct wim_file *wim, PCWSTR path, DWORD flags )
+{
+    static const WCHAR emptyW[] = {0};
+    struct capture_context ctx;
+    struct wim_resource *saved;
+    struct wim_dentry *root = NULL;
+    struct wim_image *image = NULL;
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    DWORD metadata, saved_count;
+    WCHAR *xml = NULL;
+    SIZE_T len;
+    BOOL ret = FALSE;
+
+    if (!(wim->access & WIM_GENERIC_WRITE))
+    {
+        SetLastError( ERROR_ACCESS_DENIED );
+        return NULL;
+    }
+    if (!GetFileAttributesExW( path, GetFileExInfoStandard, &info )) return NULL;
+    if (!(info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        SetLastError( ERROR_DIRECTORY );
+        return NULL;
+    }
+    len = strlenW( path );
+    while (len && (path[len - 1] == '\\' || path[len - 1] == '/')) len--;
+    if (len + 3 > PATH_BUFFER_SIZE)
+    {
+        SetLastError( ERROR_FILENAME_EXCED_RANGE );
+        return NULL;
+    }
+
+    memset( &ctx, 0, sizeof(ctx) );
+    if (!writer_init( &ctx.writer, wim )) return NULL;
+    if (!(saved = wim_save_resources( wim, &saved_count )) ||
+        !(ctx.path = HeapAlloc( GetProcessHeap(), 0, PATH_BUFFER_SIZE * sizeof(WCHAR) )) ||
+        !(root = dentry_alloc( NULL, emptyW )))
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        goto done;
+    }
+    memcpy( ctx.path, path, len * sizeof(WCHAR) );
+    ctx.path[len] = 0;
+
+    root->attributes = info.dwFileAttributes & ~FILE_ATTRIBUTE_REPARSE_POINT;
+    root->creation_time = info.ftCreationTime;
+    root->last_access_time = info.ftLastAccessTime;
+    root->last_write_time = info.ftLastWriteTime;
+
+    TRACE( "capturing %s\n", debugstr_w(ctx.path) );
+    if (!capture_directory( &ctx, root, len )) goto done;
+    if (!write_metadata( &ctx, root, &metadata )) goto done;
+    if (!writer_flush( &ctx.writer )) goto done;
+
+    if (!(xml = build_image_xml( &ctx )) ||
+        !(image = HeapAlloc( GetProcessHeap(), 0, sizeof(*image) )))
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        goto done;
+    }
+    if (!wim_add_image( wim, metadata, xml )) goto done;
+    xml = NULL;
+
+    if (!wim_write_trailer( wim ))
+    {
+        HeapFree( GetProcessHeap(), 0, wim->images[--wim->image_count].xml );
+        goto done;
+    }
+
+    TRACE( "%u directories, %u files, %s bytes\n", ctx.dir_count, ctx.file_count,
+           wine_dbgstr_longlong( ctx.total_bytes ) );
+
+    image->magic = WIM_IMAGE_MAGIC;
+    image->wim = wim;
+    image->index = wim->image_count - 1;
+    InterlockedIncrement( &wim->refs );
+    ret = TRUE;
+
+done:
+    writer_cleanup( &ctx.writer );
+    if (!ret)
+    {
+        DWORD error = GetLastError();
+
+        /* forget about the resources of the failed capture */
+        if (saved) wim_restore_resources( wim, saved, saved_count );
+        HeapFree( GetProcessHeap(), 0, xml );
+        HeapFree( GetProcessHeap(), 0, image );
+        image = NULL;
+        SetLastError( error );
+    }
+    HeapFree( GetProcessHeap(), 0, saved );
+    HeapFree( GetProcessHeap(), 0, ctx.path );
+    dentry_free_tree( root );
+    return image;
+}
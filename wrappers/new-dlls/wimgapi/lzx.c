@@ -0,0 +1,894 @@
+/*
+ * wimgapi LZX chunk codec
+ *
+ * Copyright 2000-2002 Stuart Caie
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * NOTES
+ *
+ * This is the LZX decoder of cabinet's fdi.c cut down to what WIM files
+ * need.  Every 32 KB chunk is compressed on its own with a 32 KB window, so
+ * a chunk is decoded straight into the output buffer and nothing is kept
+ * from one chunk to the next.  The WIM flavour of the stream differs from
+ * the cabinet one in two places: there is no header telling whether the
+ * E8 call translation was done, it always is with a translation size of
+ * 12000000 bytes, and a block holding the default 32768 bytes only spends
+ * a single bit on its size.
+ *
+ * The encoder follows the one of cabman: a hash chain match finder with one
+ * step of lazy evaluation, and one verbatim block per chunk.  Chunks it
+ * cannot shrink are stored uncompressed by the caller, so it never writes
+ * uncompressed blocks.
+ */
+
+#include "wimgapi_private.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(wimgapi);
+
+#define LZX_MIN_MATCH                2
+#define LZX_NUM_CHARS                256
+#define LZX_BLOCKTYPE_VERBATIM       1
+#define LZX_BLOCKTYPE_ALIGNED        2
+#define LZX_BLOCKTYPE_UNCOMPRESSED   3
+#define LZX_PRETREE_NUM_ELEMENTS     20
+#define LZX_ALIGNED_NUM_ELEMENTS     8
+#define LZX_NUM_PRIMARY_LENGTHS      7
+#define LZX_NUM_SECONDARY_LENGTHS    249
+#define LZX_POSITION_SLOTS           30      /* for the 32 KB window */
+#define LZX_DEFAULT_BLOCK_SIZE       32768
+#define LZX_E8_FILE_SIZE             12000000
+
+#define LZX_PRETREE_MAXSYMBOLS       LZX_PRETREE_NUM_ELEMENTS
+#define LZX_PRETREE_TABLEBITS        6
+#define LZX_MAINTREE_MAXSYMBOLS      (LZX_NUM_CHARS + LZX_POSITION_SLOTS * 8)
+#define LZX_MAINTREE_TABLEBITS       12
+#define LZX_LENGTH_MAXSYMBOLS        (LZX_NUM_SECONDARY_LENGTHS + 1)
+#define LZX_LENGTH_TABLEBITS         12
+#define LZX_ALIGNED_MAXSYMBOLS       LZX_ALIGNED_NUM_ELEMENTS
+#define LZX_ALIGNED_TABLEBITS        7
+#define LZX_LENTABLE_SAFETY          64      /* table decoding overruns are allowed */
+
+#define LZX_DECLARE_TABLE(tbl) \
+    USHORT tbl##_table[(1 << LZX_##tbl##_TABLEBITS) + (LZX_##tbl##_MAXSYMBOLS << 1)]; \
+    BYTE   tbl##_len[LZX_##tbl##_MAXSYMBOLS + LZX_LENTABLE_SAFETY]
+
+struct lzx_decoder
+{
+    LZX_DECLARE_TABLE(PRETREE);
+    LZX_DECLARE_TABLE(MAINTREE);
+    LZX_DECLARE_TABLE(LENGTH);
+    LZX_DECLARE_TABLE(ALIGNED);
+};
+
+#define BUILD_TABLE(lzx,tbl) \
+    make_decode_table( LZX_##tbl##_MAXSYMBOLS, LZX_##tbl##_TABLEBITS, (lzx)->tbl##_len, (lzx)->tbl##_table )
+
+#define READ_HUFFSYM(lzx,bits,tbl) \
+    read_huffsym( bits, (lzx)->tbl##_table, (lzx)->tbl##_len, LZX_##tbl##_TABLEBITS, LZX_##tbl##_MAXSYMBOLS )
+
+struct lzx_bits
+{
+    const BYTE *pos;
+    const BYTE *end;
+    ULONG       buf;
+    int         left;
+};
+
+static const BYTE extra_bits[LZX_POSITION_SLOTS] =
+{
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static const DWORD position_base[LZX_POSITION_SLOTS] =
+{
+    0, 1, 2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128, 192,
+    256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096, 6144, 8192, 12288, 16384, 24576
+};
+
+static void init_bits( struct lzx_bits *bits, const BYTE *pos, const BYTE *end )
+{
+    bits->pos = pos;
+    bits->end = end;
+    bits->buf = 0;
+    bits->left = 0;
+}
+
+static inline void ensure_bits( struct lzx_bits *bits, int count )
+{
+    while (bits->left < count)
+    {
+        /* the stream reads as zeroes past the end of the chunk, overruns
+         * are caught by bits_overrun() instead of on every word */
+        ULONG word = bits->pos + 1 < bits->end ? bits->pos[0] | (bits->pos[1] << 8) : 0;
+
+        bits->buf |= word << (16 - bits->left);
+        bits->left += 16;
+        bits->pos += 2;
+    }
+}
+
+static inline void remove_bits( struct lzx_bits *bits, int count )
+{
+    bits->buf <<= count;
+    bits->left -= count;
+}
+
+static inline ULONG read_bits( struct lzx_bits *bits, int count )
+{
+    ULONG value;
+
+    if (!count) return 0;
+    ensure_bits( bits, count );
+    value = bits->buf >> (32 - count);
+    remove_bits( bits, count );
+    return value;
+}
+
+/* whether bits were consumed that the chunk does not have */
+static BOOL bits_overrun( const struct lzx_bits *bits )
+{
+    return bits->pos > bits->end && (ULONG)(bits->pos - bits->end) * 8 > (ULONG)bits->left;
+}
+
+/* make_decode_table() of fdi.c, coded by David Tritscher */
+static BOOL make_decode_table( ULONG nsyms, ULONG nbits, const BYTE *length, USHORT *table )
+{
+    ULONG sym, leaf, fill, bit_num = 1, pos = 0;
+    ULONG table_mask = 1 << nbits;
+    ULONG bit_mask = table_mask >> 1;       /* don't do 0 length codes */
+    ULONG next_symbol = bit_mask;           /* base of allocation for long codes */
+
+    /* fill entries for codes short enough for a direct mapping */
+    while (bit_num <= nbits)
+    {
+        for (sym = 0; sym < nsyms; sym++)
+        {
+            if (length[sym] != bit_num) continue;
+
+            leaf = pos;
+            if ((pos += bit_mask) > table_mask) return FALSE;
+            for (fill = bit_mask; fill > 0; fill--) table[leaf++] = sym;
+        }
+        bit_mask >>= 1;
+        bit_num++;
+    }
+
+    /* if there are any codes longer than nbits */
+    if (pos != table_mask)
+    {
+        for (sym = pos; sym < table_mask; sym++) table[sym] = 0;
+
+        /* give ourselves room for codes to grow by up to 16 more bits */
+        pos <<= 16;
+        table_mask <<= 16;
+        bit_mask = 1 << 15;
+
+        while (bit_num <= 16)
+        {
+            for (sym = 0; sym < nsyms; sym++)
+            {
+                if (length[sym] != bit_num) continue;
+
+                leaf = pos >> 16;
+                for (fill = 0; fill < bit_num - nbits; fill++)
+                {
+                    /* if this path hasn't been taken yet, 'allocate' two entries */
+                    if (!table[leaf])
+                    {
+                        table[next_symbol << 1] = 0;
+                        table[(next_symbol << 1) + 1] = 0;
+                        table[leaf] = next_symbol++;
+                    }
+                    /* follow the path and select either left or right for next bit */
+                    leaf = table[leaf] << 1;
+                    if ((pos >> (15 - fill)) & 1) leaf++;
+                }
+                table[leaf] = sym;
+
+                if ((pos += bit_mask) > table_mask) return FALSE;
+            }
+            bit_mask >>= 1;
+            bit_num++;
+        }
+    }
+
+    if (pos == table_mask) return TRUE;
+
+    /* either erroneous table, or all elements are 0 */
+    for (sym = 0; sym < nsyms; sym++) if (length[sym]) return FALSE;
+    return TRUE;
+}
+
+static int read_huffsym( struct lzx_bits *bits, const USHORT *table, const BYTE *length,
+                         ULONG nbits, ULONG nsyms )
+{
+    ULONG sym, mask;
+
+    ensure_bits( bits, 16 );
+    if ((sym = table[bits->buf >> (32 - nbits)]) >= nsyms)
+    {
+        mask = 1 << (32 - nbits);
+        do
+        {
+            if (!(mask >>= 1)) return -1;
+            sym = (sym << 1) | ((bits->buf & mask) ? 1 : 0);
+        } while ((sym = table[sym]) >= nsyms);
+    }
+    remove_bits( bits, length[sym] );
+    return sym;
+}
+
+/* reads the code lengths from first to last as deltas to the previous block's */
+static BOOL read_lengths( struct lzx_decoder *lzx, BYTE *lens, ULONG first, ULONG last,
+                          struct lzx_bits *bits )
+{
+    ULONG x, y;
+    int z;
+
+    for (x = 0; x < LZX_PRETREE_NUM_ELEMENTS; x++) lzx->PRETREE_len[x] = read_bits( bits, 4 );
+    if (!BUILD_TABLE( lzx, PRETREE )) return FALSE;
+
+    for (x = first; x < last;)
+    {
+        if ((z = READ_HUFFSYM( lzx, bits, PRETREE )) < 0) return FALSE;
+        if (z == 17)
+        {
+            y = read_bits( bits, 4 ) + 4;
+            while (y--) lens[x++] = 0;
+        }
+        else if (z == 18)
+        {
+            y = read_bits( bits, 5 ) + 20;
+            while (y--) lens[x++] = 0;
+        }
+        else if (z == 19)
+        {
+            y = read_bits( bits, 1 ) + 4;
+            if ((z = READ_HUFFSYM( lzx, bits, PRETREE )) < 0) return FALSE;
+            z = lens[x] - z;
+            if (z < 0) z += 17;
+            while (y--) lens[x++] = z;
+        }
+        else
+        {
+            z = lens[x] - z;
+            if (z < 0) z += 17;
+            lens[x++] = z;
+        }
+    }
+    return TRUE;
+}
+
+static BOOL read_block_header( struct lzx_decoder *lzx, struct lzx_bits *bits, DWORD *type,
+                               DWORD *length, DWORD *R0, DWORD *R1, DWORD *R2 )
+{
+    DWORD i;
+
+    *type = read_bits( bits, 3 );
+    *length = read_bits( bits, 1 ) ? LZX_DEFAULT_BLOCK_SIZE : read_bits( bits, 16 );
+
+    switch (*type)
+    {
+    case LZX_BLOCKTYPE_ALIGNED:
+        for (i = 0; i < LZX_ALIGNED_NUM_ELEMENTS; i++) lzx->ALIGNED_len[i] = read_bits( bits, 3 );
+        if (!BUILD_TABLE( lzx, ALIGNED )) return FALSE;
+        /* fall through, the rest of the header is the verbatim one */
+    case LZX_BLOCKTYPE_VERBATIM:
+        if (!read_lengths( lzx, lzx->MAINTREE_len, 0, LZX_NUM_CHARS, bits )) return FALSE;
+        if (!read_lengths( lzx, lzx->MAINTREE_len, LZX_NUM_CHARS, LZX_MAINTREE_MAXSYMBOLS, bits )) return FALSE;
+        if (!BUILD_TABLE( lzx, MAINTREE )) return FALSE;
+        if (!read_lengths( lzx, lzx->LENGTH_len, 0, LZX_NUM_SECONDARY_LENGTHS, bits )) return FALSE;
+        if (!BUILD_TABLE( lzx, LENGTH )) return FALSE;
+        return !bits_overrun( bits );
+
+    case LZX_BLOCKTYPE_UNCOMPRESSED:
+        /* get up to 16 pad bits into the buffer and align the stream on them */
+        ensure_bits( bits, 16 );
+        if (bits->left > 16) bits->pos -= 2;
+        if (bits->pos > bits->end || bits->end - bits->pos < 12) return FALSE;
+        *R0 = bits->pos[0] | (bits->pos[1] << 8) | (bits->pos[2] << 16) | ((DWORD)bits->pos[3] << 24);
+        *R1 = bits->pos[4] | (bits->pos[5] << 8) | (bits->pos[6] << 16) | ((DWORD)bits->pos[7] << 24);
+        *R2 = bits->pos[8] | (bits->pos[9] << 8) | (bits->pos[10] << 16) | ((DWORD)bits->pos[11] << 24);
+        bits->pos += 12;
+        return TRUE;
+
+    default:
+        return FALSE;
+    }
+}
+
+/* turns the absolute call targets of the compressor back into relative ones */
+static void undo_e8_translation( BYTE *data, DWORD size )
+{
+    BYTE *end = data + size - 10;
+    LONG pos = 0, abs_off, rel_off;
+
+    if (size <= 10) return;
+
+    while (data < end)
+    {
+        if (*data++ != 0xe8)
+        {
+            pos++;
+            continue;
+        }
+
+        abs_off = data[0] | (data[1] << 8) | (data[2] << 16) | ((DWORD)data[3] << 24);
+        if (abs_off >= -pos && abs_off < LZX_E8_FILE_SIZE)
+        {
+            rel_off = abs_off >= 0 ? abs_off - pos : abs_off + LZX_E8_FILE_SIZE;
+            data[0] = (BYTE)rel_off;
+            data[1] = (BYTE)(rel_off >> 8);
+            data[2] = (BYTE)(rel_off >> 16);
+            data[3] = (BYTE)(rel_off >> 24);
+        }
+        data += 4;
+        pos += 5;
+    }
+}
+
+DWORD lzx_decompress_workspace_size(void)
+{
+    return sizeof(struct lzx_decoder);
+}
+
+BOOL lzx_decompress( void *workspace, const BYTE *src, DWORD src_size, BYTE *dst, DWORD dst_size )
+{
+    struct lzx_decoder *lzx = workspace;
+    struct lzx_bits bits;
+    DWORD posn = 0, R0 = 1, R1 = 1, R2 = 1;
+    DWORD type = 0, length = 0, remaining = 0;
+    DWORD match_offset, match_length, slot, extra;
+    int element, footer, aligned;
+    LONG run;
+
+    /* the lengths of the first block are deltas to all zeroes */
+    memset( lzx->MAINTREE_len, 0, sizeof(lzx->MAINTREE_len) );
+    memset( lzx->LENGTH_len, 0, sizeof(lzx->LENGTH_len) );
+    init_bits( &bits, src, src + src_size );
+
+    while (posn < dst_size)
+    {
+        if (!remaining)
+        {
+            if (type == LZX_BLOCKTYPE_UNCOMPRESSED)
+            {
+                /* realign the stream on a word */
+                if (length & 1) bits.pos++;
+                init_bits( &bits, bits.pos, bits.end );
+            }
+            if (!read_block_header( lzx, &bits, &type, &length, &R0, &R1, &R2 ) || !length)
+            {
+                WARN( "invalid block header at %u\n", posn );
+                return FALSE;
+            }
+            remaining = length;
+        }
+
+        run = min( remaining, dst_size - posn );
+        remaining -= run;
+
+        if (type == LZX_BLOCKTYPE_UNCOMPRESSED)
+        {
+            if (bits.end - bits.pos < run) return FALSE;
+            memcpy( dst + posn, bits.pos, run );
+            bits.pos += run;
+            posn += run;
+            continue;
+        }
+
+        while (run > 0)
+        {
+            if ((element = READ_HUFFSYM( lzx, &bits, MAINTREE )) < 0) return FALSE;
+
+            if (element < LZX_NUM_CHARS)
+            {
+                dst[posn++] = element;
+                run--;
+                continue;
+            }
+
+            /* match: LZX_NUM_CHARS + ((slot << 3) | length_header (3 bits)) */
+            element -= LZX_NUM_CHARS;
+            match_length = element & LZX_NUM_PRIMARY_LENGTHS;
+            if (match_length == LZX_NUM_PRIMARY_LENGTHS)
+            {
+                if ((footer = READ_HUFFSYM( lzx, &bits, LENGTH )) < 0) return FALSE;
+                match_length += footer;
+            }
+            match_length += LZX_MIN_MATCH;
+
+            slot = element >> 3;
+            if (slot > 2)
+            {
+                /* not a repeated offset, aligned blocks code the low 3 bits apart */
+                extra = extra_bits[slot];
+                match_offset = position_base[slot] - 2;
+                if (type == LZX_BLOCKTYPE_ALIGNED && extra >= 3)
+                {
+                    match_offset += read_bits( &bits, extra - 3 ) << 3;
+                    if ((aligned = READ_HUFFSYM( lzx, &bits, ALIGNED )) < 0) return FALSE;
+                    match_offset += aligned;
+                }
+                else match_offset += read_bits( &bits, extra );
+
+                R2 = R1; R1 = R0; R0 = match_offset;
+            }
+            else if (slot == 0)
+            {
+                match_offset = R0;
+            }
+            else if (slot == 1)
+            {
+                match_offset = R1;
+                R1 = R0; R0 = match_offset;
+            }
+            else
+            {
+                match_offset = R2;
+                R2 = R0; R0 = match_offset;
+            }
+
+            /* nothing precedes the chunk and nothing follows the buffer */
+            if (!match_offset || match_offset > posn || match_length > dst_size - posn)
+            {
+                WARN( "invalid match %u,%u at %u\n", match_offset, match_length, posn );
+                return FALSE;
+            }
+            for (; match_length; match_length--, posn++, run--) dst[posn] = dst[posn - match_offset];
+        }
+
+        /* a match may run on into the next block */
+        if (run < 0)
+        {
+            if ((DWORD)-run > remaining) return FALSE;
+            remaining += run;
+        }
+        if (bits_overrun( &bits )) return FALSE;
+    }
+
+    undo_e8_translation( dst, dst_size );
+    return TRUE;
+}
+
+/* encoder */
+
+#define LZX_MAX_MATCH                257
+#define LZX_MAX_DISTANCE             32765   /* the largest formatted offset of 30 slots is 32767 */
+#define LZX_MAX_CODE_LENGTH          16
+#define LZX_MAX_PRETREE_LENGTH       15
+#define LZX_HASH_BITS                15
+#define LZX_HASH_SIZE                (1 << LZX_HASH_BITS)
+#define LZX_MAX_CHAIN                64
+#define LZX_NICE_LENGTH              128
+#define LZX_NO_POS                   0xffff
+
+struct lzx_encoder
+{
+    BYTE   data[LZX_DEFAULT_BLOCK_SIZE];     /* the chunk after E8 translation */
+    USHORT head[LZX_HASH_SIZE];
+    USHORT prev[LZX_DEFAULT_BLOCK_SIZE];
+    USHORT value[LZX_DEFAULT_BLOCK_SIZE];    /* literal or match length */
+    USHORT dist[LZX_DEFAULT_BLOCK_SIZE];     /* match distance, 0 for literals */
+    DWORD  count;
+    DWORD  insert;
+};
+
+struct lzx_writer
+{
+    BYTE *pos;
+    BYTE *end;
+    ULONG buf;
+    int   count;
+    BOOL  overflow;
+};
+
+static void put_bits( struct lzx_writer *writer, ULONG value, int count )
+{
+    ULONG word;
+
+    writer->buf = (writer->buf << count) | value;
+    writer->count += count;
+    if (writer->count < 16) return;
+
+    writer->count -= 16;
+    word = writer->buf >> writer->count;
+    if (writer->end - writer->pos < 2)
+    {
+        writer->overflow = TRUE;
+        return;
+    }
+    *writer->pos++ = (BYTE)word;
+    *writer->pos++ = (BYTE)(word >> 8);
+}
+
+static void flush_bits( struct lzx_writer *writer )
+{
+    if (writer->count) put_bits( writer, 0, 16 - writer->count );
+}
+
+static int compare_keys( const void *a, const void *b )
+{
+    ULONG x = *(const ULONG *)a, y = *(const ULONG *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* builds a Huffman code no longer than max_len bits, flattening the
+ * frequencies until it fits; LZX trees must be complete, so a single
+ * symbol gets a partner */
+static void build_lengths( const ULONG *freqs, ULONG count, BYTE *lens, ULONG max_len )
+{
+    ULONG scaled[LZX_MAINTREE_MAXSYMBOLS], keys[LZX_MAINTREE_MAXSYMBOLS];
+    ULONG weight[LZX_MAINTREE_MAXSYMBOLS * 2], parent[LZX_MAINTREE_MAXSYMBOLS * 2];
+    ULONG depth[LZX_MAINTREE_MAXSYMBOLS * 2];
+    ULONG used, leaf, node, next, pick[2], longest, i, j;
+
+    memcpy( scaled, freqs, count * sizeof(*freqs) );
+
+    for (;;)
+    {
+        memset( lens, 0, count );
+        for (i = used = 0; i < count; i++)
+            if (scaled[i]) keys[used++] = (scaled[i] << 10) | i;
+
+        if (!used) return;
+        if (used == 1)
+        {
+            i = keys[0] & 0x3ff;
+            lens[i] = 1;
+            lens[i ? 0 : 1] = 1;
+            return;
+        }
+
+        /* leaves come in order of weight and so do the nodes made of them */
+        qsort( keys, used, sizeof(*keys), compare_keys );
+        for (i = 0; i < used; i++) weight[i] = keys[i] >> 10;
+
+        leaf = 0;
+        node = used;
+        for (next = used; next < used * 2 - 1; next++)
+        {
+            for (j = 0; j < 2; j++)
+            {
+                if (leaf < used && (node >= next || weight[leaf] <= weight[node])) pick[j] = leaf++;
+                else pick[j] = node++;
+            }
+            weight[next] = weight[pick[0]] + weight[pick[1]];
+            parent[pick[0]] = parent[pick[1]] = next;
+        }
+
+        /* parents always come after their children */
+        depth[next - 1] = 0;
+        longest = 0;
+        for (i = next - 1; i-- > 0;)
+        {
+            depth[i] = depth[parent[i]] + 1;
+            if (i >= used) continue;
+            lens[keys[i] & 0x3ff] = depth[i];
+            longest = max( longest, depth[i] );
+        }
+        if (longest <= max_len) return;
+
+        for (i = 0; i < count; i++)
+            if (scaled[i]) scaled[i] = (scaled[i] >> 1) | 1;
+    }
+}
+
+/* canonical codes, in the order make_decode_table() expects */
+static void make_codes( const BYTE *lens, ULONG count, USHORT *codes )
+{
+    ULONG code = 0, bits, i;
+
+    for (bits = 1; bits <= LZX_MAX_CODE_LENGTH; bits++)
+    {
+        for (i = 0; i < count; i++)
+            if (lens[i] == bits) codes[i] = code++;
+        code <<= 1;
+    }
+}
+
+/* the counterpart of read_lengths(), the previous lengths are all zeroes */
+static void write_lengths( struct lzx_writer *writer, const BYTE *lens, ULONG count )
+{
+    BYTE symbol[LZX_MAINTREE_MAXSYMBOLS], extra[LZX_MAINTREE_MAXSYMBOLS], delta[LZX_MAINTREE_MAXSYMBOLS];
+    ULONG freqs[LZX_PRETREE_NUM_ELEMENTS];
+    BYTE pre_lens[LZX_PRETREE_NUM_ELEMENTS];
+    USHORT pre_codes[LZX_PRETREE_NUM_ELEMENTS];
+    ULONG items = 0, run, size, i;
+
+    memset( freqs, 0, sizeof(freqs) );
+
+    for (i = 0; i < count;)
+    {
+        for (run = 1; i + run < count && lens[i + run] == lens[i]; run++);
+
+        if (!lens[i] && run >= 4)
+        {
+            for (; run >= 20; run -= size, i += size)
+            {
+                size = min( run, 51 );
+                symbol[items] = 18;
+                extra[items++] = size - 20;
+                freqs[18]++;
+            }
+            if (run >= 4)
+            {
+                symbol[items] = 17;
+                extra[items++] = run - 4;
+                freqs[17]++;
+                i += run;
+            }
+        }
+        else if (run >= 4)
+        {
+            size = min( run, 5 );
+            symbol[items] = 19;
+            extra[items] = size - 4;
+            delta[items] = (17 - lens[i]) % 17;
+            freqs[19]++;
+            freqs[delta[items++]]++;
+            i += size;
+        }
+        else
+        {
+            symbol[items] = (17 - lens[i]) % 17;
+            freqs[symbol[items++]]++;
+            i++;
+        }
+    }
+
+    build_lengths( freqs, LZX_PRETREE_NUM_ELEMENTS, pre_lens, LZX_MAX_PRETREE_LENGTH );
+    make_codes( pre_lens, LZX_PRETREE_NUM_ELEMENTS, pre_codes );
+
+    for (i = 0; i < LZX_PRETREE_NUM_ELEMENTS; i++) put_bits( writer, pre_lens[i], 4 );
+    for (i = 0; i < items; i++)
+    {
+        put_bits( writer, pre_codes[symbol[i]], pre_lens[symbol[i]] );
+        if (symbol[i] == 17) put_bits( writer, extra[i], 4 );
+        else if (symbol[i] == 18) put_bits( writer, extra[i], 5 );
+        else if (symbol[i] == 19)
+        {
+            put_bits( writer, extra[i], 1 );
+            put_bits( writer, pre_codes[delta[i]], pre_lens[delta[i]] );
+        }
+    }
+}
+
+/* turns a match into its main tree element and updates the repeated offsets */
+static ULONG format_match( ULONG dist, ULONG len, DWORD *R, ULONG *footer, ULONG *footer_bits,
+                           ULONG *len_symbol )
+{
+    ULONG slot, header;
+
+    *footer = *footer_bits = 0;
+    if (dist == R[0]) slot = 0;
+    else if (dist == R[1])
+    {
+        slot = 1;
+        R[1] = R[0]; R[0] = dist;
+    }
+    else if (dist == R[2])
+    {
+        slot = 2;
+        R[2] = R[0]; R[0] = dist;
+    }
+    else
+    {
+        for (slot = LZX_POSITION_SLOTS - 1; position_base[slot] > dist + 2; slot--);
+        *footer = dist + 2 - position_base[slot];
+        *footer_bits = extra_bits[slot];
+        R[2] = R[1]; R[1] = R[0]; R[0] = dist;
+    }
+
+    header = len - LZX_MIN_MATCH;
+    *len_symbol = ~0u;
+    if (header >= LZX_NUM_PRIMARY_LENGTHS)
+    {
+        *len_symbol = header - LZX_NUM_PRIMARY_LENGTHS;
+        header = LZX_NUM_PRIMARY_LENGTHS;
+    }
+    return LZX_NUM_CHARS + (slot << 3) + header;
+}
+
+/* the counterpart of undo_e8_translation() */
+static void do_e8_translation( BYTE *data, DWORD size )
+{
+    LONG pos, rel_off, abs_off;
+
+    if (size <= 10) return;
+
+    for (pos = 0; pos < (LONG)size - 10;)
+    {
+        if (data[pos] != 0xe8)
+        {
+            pos++;
+            continue;
+        }
+
+        rel_off = data[pos + 1] | (data[pos + 2] << 8) | (data[pos + 3] << 16) | ((DWORD)data[pos + 4] << 24);
+        if (rel_off >= -pos && rel_off < LZX_E8_FILE_SIZE)
+        {
+            abs_off = rel_off < LZX_E8_FILE_SIZE - pos ? rel_off + pos : rel_off - LZX_E8_FILE_SIZE;
+            data[pos + 1] = (BYTE)abs_off;
+            data[pos + 2] = (BYTE)(abs_off >> 8);
+            data[pos + 3] = (BYTE)(abs_off >> 16);
+            data[pos + 4] = (BYTE)(abs_off >> 24);
+        }
+        pos += 5;
+    }
+}
+
+static inline ULONG hash3( const BYTE *p )
+{
+    return ((p[0] << 16) | (p[1] << 8) | p[2]) * 2654435761u >> (32 - LZX_HASH_BITS);
+}
+
+static void insert_hashes( struct lzx_encoder *lzx, DWORD pos, DWORD size )
+{
+    ULONG hash;
+
+    for (; lzx->insert < pos && lzx->insert + 3 <= size; lzx->insert++)
+    {
+        hash = hash3( lzx->data + lzx->insert );
+        lzx->prev[lzx->insert] = lzx->head[hash];
+        lzx->head[hash] = lzx->insert;
+    }
+}
+
+static DWORD find_match( struct lzx_encoder *lzx, DWORD pos, DWORD max_len, DWORD *dist )
+{
+    const BYTE *scan = lzx->data + pos, *match;
+    DWORD cand, chain, len, best = 2;
+
+    if (max_len < 3) return 0;
+
+    cand = lzx->head[hash3( scan )];
+    for (chain = LZX_MAX_CHAIN; cand != LZX_NO_POS && pos - cand <= LZX_MAX_DISTANCE && chain; chain--)
+    {
+        match = lzx->data + cand;
+        if (match[best] == scan[best] && match[0] == scan[0] && match[1] == scan[1])
+        {
+            for (len = 2; len < max_len && match[len] == scan[len]; len++);
+            if (len > best)
+            {
+                best = len;
+                *dist = pos - cand;
+                if (best >= LZX_NICE_LENGTH || best >= max_len) break;
+            }
+        }
+        cand = lzx->prev[cand];
+    }
+    return best >= 3 ? best : 0;
+}
+
+static inline void add_token( struct lzx_encoder *lzx, USHORT value, USHORT dist )
+{
+    lzx->value[lzx->count] = value;
+    lzx->dist[lzx->count++] = dist;
+}
+
+/* greedy parse with one step of lazy evaluation */
+static void parse_chunk( struct lzx_encoder *lzx, DWORD size )
+{
+    DWORD pos = 0, len, dist = 0, prev_len = 0, prev_dist = 0;
+    BOOL pending = FALSE;
+
+    memset( lzx->head, 0xff, sizeof(lzx->head) );
+    lzx->count = lzx->insert = 0;
+
+    while (pos < size)
+    {
+        insert_hashes( lzx, pos, size );
+
+        len = 0;
+        if (!pending || prev_len < LZX_NICE_LENGTH)
+            len = find_match( lzx, pos, min( size - pos, LZX_MAX_MATCH ), &dist );
+
+        /* take the match at the previous position unless this one is longer */
+        if (pending && prev_len && len <= prev_len)
+        {
+            add_token( lzx, prev_len, prev_dist );
+            pos += prev_len - 1;
+            pending = FALSE;
+            continue;
+        }
+        if (pending) add_token( lzx, lzx->data[pos - 1], 0 );
+
+        pending = TRUE;
+        prev_len = len;
+        prev_dist = dist;
+        pos++;
+    }
+    if (pending) add_token( lzx, lzx->data[size - 1], 0 );
+}
+
+DWORD lzx_compress_workspace_size(void)
+{
+    return sizeof(struct lzx_encoder);
+}
+
+/* compresses a chunk into a single verbatim block, returns 0 if it does not fit */
+DWORD lzx_compress( void *workspace, const BYTE *src, DWORD src_size, BYTE *dst, DWORD dst_size )
+{
+    struct lzx_encoder *lzx = workspace;
+    struct lzx_writer writer;
+    ULONG main_freqs[LZX_MAINTREE_MAXSYMBOLS], len_freqs[LZX_NUM_SECONDARY_LENGTHS];
+    BYTE main_lens[LZX_MAINTREE_MAXSYMBOLS], len_lens[LZX_NUM_SECONDARY_LENGTHS];
+    USHORT main_codes[LZX_MAINTREE_MAXSYMBOLS], len_codes[LZX_NUM_SECONDARY_LENGTHS];
+    ULONG symbol, footer, footer_bits, len_symbol, i;
+    DWORD R[3];
+
+    if (!src_size || src_size > LZX_DEFAULT_BLOCK_SIZE) return 0;
+
+    memcpy( lzx->data, src, src_size );
+    do_e8_translation( lzx->data, src_size );
+    parse_chunk( lzx, src_size );
+
+    memset( main_freqs, 0, sizeof(main_freqs) );
+    memset( len_freqs, 0, sizeof(len_freqs) );
+    R[0] = R[1] = R[2] = 1;
+    for (i = 0; i < lzx->count; i++)
+    {
+        if (!lzx->dist[i])
+        {
+            main_freqs[lzx->value[i]]++;
+            continue;
+        }
+        symbol = format_match( lzx->dist[i], lzx->value[i], R, &footer, &footer_bits, &len_symbol );
+        main_freqs[symbol]++;
+        if (len_symbol != ~0u) len_freqs[len_symbol]++;
+    }
+
+    build_lengths( main_freqs, LZX_MAINTREE_MAXSYMBOLS, main_lens, LZX_MAX_CODE_LENGTH );
+    build_lengths( len_freqs, LZX_NUM_SECONDARY_LENGTHS, len_lens, LZX_MAX_CODE_LENGTH );
+    make_codes( main_lens, LZX_MAINTREE_MAXSYMBOLS, main_codes );
+    make_codes( len_lens, LZX_NUM_SECONDARY_LENGTHS, len_codes );
+
+    writer.pos = dst;
+    writer.end = dst + dst_size;
+    writer.buf = 0;
+    writer.count = 0;
+    writer.overflow = FALSE;
+
+    put_bits( &writer, LZX_BLOCKTYPE_VERBATIM, 3 );
+    if (src_size == LZX_DEFAULT_BLOCK_SIZE) put_bits( &writer, 1, 1 );
+    else
+    {
+        put_bits( &writer, 0, 1 );
+        put_bits( &writer, src_size, 16 );
+    }
+    write_lengths( &writer, main_lens, LZX_NUM_CHARS );
+    write_lengths( &writer, main_lens + LZX_NUM_CHARS, LZX_MAINTREE_MAXSYMBOLS - LZX_NUM_CHARS );
+    write_lengths( &writer, len_lens, LZX_NUM_SECONDARY_LENGTHS );
+
+    R[0] = R[1] = R[2] = 1;
+    for (i = 0; i < lzx->count && !writer.overflow; i++)
+    {
+        if (!lzx->dist[i])
+        {
+            put_bits( &writer, main_codes[lzx->value[i]], main_lens[lzx->value[i]] );
+            continue;
+        }
+        symbol = format_match( lzx->dist[i], lzx->value[i], R, &footer, &footer_bits, &len_symbol );
+        put_bits( &writer, main_codes[symbol], main_lens[symbol] );
+        if (len_symbol != ~0u) put_bits( &writer, len_codes[len_symbol], len_lens[len_symbol] );
+        if (footer_bits) put_bits( &writer, footer, footer_bits );
+    }
+    flush_bits( &writer );
+
+    return writer.overflow ? 0 : writer.pos - dst;
+}
@@ -19,15 +19,34 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
  */
 
-#include <stdarg.h>
-
-#include "windef.h"
-#include "winbase.h"
-#include "wine/debug.h"
-#include "wimgapi.h"
+#include "wimgapi_private.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(wimgapi);
 
+static struct wim_file *get_wim_file(HANDLE handle)
+{
+    struct wim_file *wim = handle;
+
+    if (!wim || wim->magic != WIM_FILE_MAGIC)
+    {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return NULL;
+    }
+    return wim;
+}
+
+static struct wim_image *get_wim_image(HANDLE handle)
+{
+    struct wim_image *image = handle;
+
+    if (!image || image->magic != WIM_IMAGE_MAGIC)
+    {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return NULL;
+    }
+    return image;
+}
+
 DWORD WINAPI WIMRegisterMessageCallback(HANDLE wim, FARPROC callback, PVOID data)
 {
     FIXME("(%p %p %p) stub\n", wim, callback, data);
@@ -41,11 +60,214 @@ BOOL WINAPI WIMGetMountedImages(PWIM_MOUNT_LIST list, DWORD *length)
     return 0;
 }
 
-HANDLE WINAPI WIMCreateFile(WCHAR *path, DWORD access, DWORD creation, DWORD flags, DWORD compression, DWORD *result)
+HANDLE WINAPI WIMCreateFile(PCWSTR path, DWORD access, DWORD creation, DWORD flags, DWORD compression, DWORD *result)
 {
-    FIXME("(%s %d %d %d %d %p) stub\n", debugstr_w(path), access, creation, flags, compression, result);
-    SetLastError(ERROR_CALL_NOT_IMPLEMENTED);
-    return NULL;
+    TRACE("(%s %x %d %x %d %p)\n", debugstr_w(path), access, creation, flags, compression, result);
+
+    return wim_open(path, access, creation, flags, compression, result);
+}
+
+BOOL WINAPI WIMCloseHandle(HANDLE handle)
+{
+    struct wim_file *wim = handle;
+    struct wim_image *image = handle;
+
+    TRACE("(%p)\n", handle);
+
+    if (wim && wim->magic == WIM_FILE_MAGIC)
+    {
+        wim_release(wim);
+        return TRUE;
+    }
+    if (image && image->magic == WIM_IMAGE_MAGIC)
+    {
+        image->magic = 0;
+        wim_release(image->wim);
+        HeapFree(GetProcessHeap(), 0, image);
+        return TRUE;
+    }
+    SetLastError(ERROR_INVALID_HANDLE);
+    return FALSE;
+}
+
+DWORD WINAPI WIMGetImageCount(HANDLE handle)
+{
+    struct wim_file *wim;
+    DWORD count;
+
+    TRACE("(%p)\n", handle);
+
+    if (!(wim = get_wim_file(handle))) return 0;
+
+    EnterCriticalSection(&wim->cs);
+    count = wim->image_count;
+    LeaveCriticalSection(&wim->cs);
+    return count;
+}
+
+BOOL WINAPI WIMGetAttributes(HANDLE handle, PWIM_INFO info, DWORD size)
+{
+    struct wim_file *wim;
+
+    TRACE("(%p %p %u)\n", handle, info, size);
+
+    if (!(wim = get_wim_file(handle))) return FALSE;
+    if (!info || size < sizeof(*info))
+    {
+        SetLastError(ERROR_INSUFFICIENT_BUFFER);
+        return FALSE;
+    }
+
+    EnterCriticalSection(&wim->cs);
+    memset(info, 0, sizeof(*info));
+    lstrcpynW(info->WimPath, wim->path, MAX_PATH);
+    info->Guid = wim->header.guid;
+    info->ImageCount = wim->image_count;
+    info->CompressionType = wim->compression;
+    info->PartNumber = wim->header.part_number;
+    info->TotalParts = wim->header.total_parts;
+    info->BootIndex = wim->header.boot_index;
+    if (wim->header.flags & WIM_HDR_FLAG_READONLY) info->WimAttributes |= WIM_ATTRIBUTE_READONLY;
+    if (wim->header.flags & WIM_HDR_FLAG_SPANNED) info->WimAttributes |= WIM_ATTRIBUTE_SPANNED;
+    if (wim->header.flags & WIM_HDR_FLAG_RP_FIX) info->WimAttributes |= WIM_ATTRIBUTE_RP_FIX;
+    info->WimFlagsAndAttr = wim->flags;
+    LeaveCriticalSection(&wim->cs);
+    return TRUE;
+}
+
+HANDLE WINAPI WIMLoadImage(HANDLE handle, DWORD index)
+{
+    struct wim_file *wim;
+    struct wim_image *image;
+
+    TRACE("(%p %u)\n", handle, index);
+
+    if (!(wim = get_wim_file(handle))) return NULL;
+
+    EnterCriticalSection(&wim->cs);
+    if (!index || index > wim->image_count)
+    {
+        LeaveCriticalSection(&wim->cs);
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+    LeaveCriticalSection(&wim->cs);
+
+    if (!(image = HeapAlloc(GetProcessHeap(), 0, sizeof(*image))))
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+    image->magic = WIM_IMAGE_MAGIC;
+    image->wim = wim;
+    image->index = index - 1;
+    InterlockedIncrement(&wim->refs);
+    return image;
+}
+
+BOOL WINAPI WIMGetImageInformation(HANDLE handle, PVOID *info, PDWORD size)
+{
+    struct wim_file *wim = handle;
+    struct wim_image *image = handle;
+    DWORD index = ~0u;
+    WCHAR *xml;
+
+    TRACE("(%p %p %p)\n", handle, info, size);
+
+    if (image && image->magic == WIM_IMAGE_MAGIC)
+    {
+        wim = image->wim;
+        index = image->index;
+    }
+    else if (!(wim = get_wim_file(handle))) return FALSE;
+
+    if (!info || !size)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    EnterCriticalSection(&wim->cs);
+    xml = wim_build_xml(wim, index, size);
+    LeaveCriticalSection(&wim->cs);
+
+    /* the caller frees the buffer with LocalFree */
+    if (!xml || !(*info = LocalAlloc(LMEM_FIXED, *size + sizeof(WCHAR))))
+    {
+        HeapFree(GetProcessHeap(), 0, xml);
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return FALSE;
+    }
+    memcpy(*info, xml, *size + sizeof(WCHAR));
+    HeapFree(GetProcessHeap(), 0, xml);
+    return TRUE;
+}
+
+HANDLE WINAPI WIMCaptureImage(HANDLE handle, PCWSTR path, DWORD flags)
+{
+    struct wim_file *wim;
+    HANDLE image;
+
+    TRACE("(%p %s %x)\n", handle, debugstr_w(path), flags);
+
+    if (!(wim = get_wim_file(handle))) return NULL;
+    if (!path)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    EnterCriticalSection(&wim->cs);
+    image = capture_image(wim, path, flags);
+    LeaveCriticalSection(&wim->cs);
+    return image;
+}
+
+BOOL WINAPI WIMApplyImage(HANDLE handle, PCWSTR path, DWORD flags)
+{
+    struct wim_image *image;
+    BOOL ret;
+
+    TRACE("(%p %s %x)\n", handle, debugstr_w(path), flags);
+
+    if (!(image = get_wim_image(handle))) return FALSE;
+    if (!path)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    EnterCriticalSection(&image->wim->cs);
+    ret = apply_image(image, path, flags);
+    LeaveCriticalSection(&image->wim->cs);
+    return ret;
+}
+
+BOOL WINAPI WIMExportImage(HANDLE handle, HANDLE dest, DWORD flags)
+{
+    struct wim_image *image;
+    struct wim_file *wim;
+    BOOL ret;
+
+    TRACE("(%p %p %x)\n", handle, dest, flags);
+
+    if (!(image = get_wim_image(handle)) || !(wim = get_wim_file(dest))) return FALSE;
+
+    /* always take the locks in the same order */
+    if (image->wim < wim)
+    {
+        EnterCriticalSection(&image->wim->cs);
+        EnterCriticalSection(&wim->cs);
+    }
+    else
+    {
+        EnterCriticalSection(&wim->cs);
+        EnterCriticalSection(&image->wim->cs);
+    }
+    ret = export_image(image, wim, flags);
+    LeaveCriticalSection(&image->wim->cs);
+    LeaveCriticalSection(&wim->cs);
+    return ret;
 }
 
 HRESULT WINAPI DllCanUnloadNow(void)
@@ -0,0 +1,757 @@
+/*
+ * wimgapi chunk compression pipeline
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * NOTES
+ *
+ * Resources in a compressed WIM are split into independent 32 KB chunks, so
+ * the codec work is spread over a pool of worker threads while the calling
+ * thread reads the input, hashes it and writes the previous batch.  A batch
+ * is filled with chunks from as many resources as fit, which keeps the pool
+ * busy on images made of small files.
+ */
+
+#include "wimgapi_private.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(wimgapi);
+
+/* ntdll uses the MS-XCA LZ77+Huffman stream, which is what WIM calls XPRESS */
+#define XPRESS_FORMAT   (COMPRESSION_FORMAT_XPRESS_HUFF | COMPRESSION_ENGINE_STANDARD)
+
+static void compress_chunk( struct codec_pool *pool, DWORD worker, struct chunk_job *job )
+{
+    ULONG size = 0;
+    NTSTATUS status = STATUS_BUFFER_TOO_SMALL;
+
+    /* chunks that do not shrink are stored as they are */
+    if (pool->compression == WIM_COMPRESS_LZX && job->src_size > 1)
+    {
+        if ((size = lzx_compress( pool->workspaces[worker], job->src, job->src_size, job->dst,
+                                  job->src_size - 1 )))
+            status = STATUS_SUCCESS;
+    }
+    else if (pool->compression != WIM_COMPRESS_NONE && job->src_size > 1)
+        status = RtlCompressBuffer( XPRESS_FORMAT, (PUCHAR)job->src, job->src_size, job->dst,
+                                    job->src_size - 1, 4096, &size, pool->workspaces[worker] );
+
+    if (status == STATUS_SUCCESS && size < job->src_size)
+    {
+        job->data = job->dst;
+        job->data_size = size;
+    }
+    else
+    {
+        job->data = job->src;
+        job->data_size = job->src_size;
+    }
+}
+
+static void decompress_chunk( struct codec_pool *pool, DWORD worker, struct chunk_job *job )
+{
+    ULONG size = 0;
+    NTSTATUS status;
+
+    if (job->src_size == job->size || pool->compression == WIM_COMPRESS_NONE)
+    {
+        job->data = job->src;
+        job->data_size = job->src_size;
+        job->failed = job->src_size != job->size;
+        return;
+    }
+
+    if (pool->compression == WIM_COMPRESS_LZX)
+    {
+        job->data = job->dst;
+        job->data_size = job->size;
+        job->failed = !lzx_decompress( pool->workspaces[worker], job->src, job->src_size,
+                                       job->dst, job->size );
+        return;
+    }
+
+    status = RtlDecompressFragment( XPRESS_FORMAT, job->dst, job->size, (PUCHAR)job->src,
+                                    job->src_size, 0, &size, pool->workspaces[worker] );
+    job->data = job->dst;
+    job->data_size = size;
+    job->failed = status != STATUS_SUCCESS || size != job->size;
+}
+
+static void run_jobs( struct codec_pool *pool, DWORD worker )
+{
+    struct chunk_job *job;
+
+    for (;;)
+    {
+        EnterCriticalSection( &pool->cs );
+        job = pool->next_job < pool->job_count ? &pool->jobs[pool->next_job++] : NULL;
+        LeaveCriticalSection( &pool->cs );
+        if (!job) break;
+
+        if (pool->decompress)
+            decompress_chunk( pool, worker, job );
+        else
+            compress_chunk( pool, worker, job );
+
+        if (!InterlockedDecrement( &pool->pending )) SetEvent( pool->done );
+    }
+}
+
+static DWORD CALLBACK pool_thread( void *arg )
+{
+    struct codec_pool *pool = arg;
+    DWORD worker = InterlockedIncrement( &pool->started ) - 1;
+
+    for (;;)
+    {
+        WaitForSingleObject( pool->work, INFINITE );
+        if (pool->shutdown) break;
+        run_jobs( pool, worker );
+    }
+    return 0;
+}
+
+struct codec_pool *pool_create( DWORD compression, BOOL decompress )
+{
+    struct codec_pool *pool;
+    ULONG buffer_size = 0, fragment_size = 0, size;
+    SYSTEM_INFO info;
+    DWORD i;
+
+    if (compression != WIM_COMPRESS_NONE && compression != WIM_COMPRESS_XPRESS &&
+        compression != WIM_COMPRESS_LZX)
+    {
+        FIXME( "compression type %u not supported\n", compression );
+        SetLastError( ERROR_NOT_SUPPORTED );
+        return NULL;
+    }
+
+    if (!(pool = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*pool) )))
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return NULL;
+    }
+    pool->compression = compression;
+    pool->decompress = decompress;
+    InitializeCriticalSection( &pool->cs );
+
+    if (compression != WIM_COMPRESS_NONE)
+    {
+        /* the calling thread works on the batch too */
+        GetSystemInfo( &info );
+        pool->thread_count = min( info.dwNumberOfProcessors, WIM_MAX_THREADS ) - 1;
+
+        if (compression == WIM_COMPRESS_LZX)
+            size = decompress ? lzx_decompress_workspace_size() : lzx_compress_workspace_size();
+        else
+        {
+            RtlGetCompressionWorkSpaceSize( XPRESS_FORMAT, &buffer_size, &fragment_size );
+            size = decompress ? fragment_size : buffer_size;
+        }
+        for (i = 0; i <= pool->thread_count; i++)
+        {
+            if (size && !(pool->workspaces[i] = HeapAlloc( GetProcessHeap(), 0, size )))
+                goto failed;
+        }
+    }
+
+    if (!(pool->work = CreateSemaphoreW( NULL, 0, MAXLONG, NULL ))) goto failed;
+    if (!(pool->done = CreateEventW( NULL, FALSE, FALSE, NULL ))) goto failed;
+
+    for (i = 0; i < pool->thread_count; i++)
+    {
+        if (!(pool->threads[i] = CreateThread( NULL, 0, pool_thread, pool, 0, NULL )))
+        {
+            /* run with the threads we got */
+            pool->thread_count = i;
+            break;
+        }
+    }
+
+    TRACE( "%u worker threads\n", pool->thread_count );
+    return pool;
+
+failed:
+    pool_destroy( pool );
+    SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+    return NULL;
+}
+
+void pool_destroy( struct codec_pool *pool )
+{
+    DWORD i;
+
+    if (!pool) return;
+
+    if (pool->thread_count)
+    {
+        pool->shutdown = TRUE;
+        ReleaseSemaphore( pool->work, pool->thread_count, NULL );
+        WaitForMultipleObjects( pool->thread_count, pool->threads, TRUE, INFINITE );
+        for (i = 0; i < pool->thread_count; i++) CloseHandle( pool->threads[i] );
+    }
+    for (i = 0; i <= WIM_MAX_THREADS; i++) HeapFree( GetProcessHeap(), 0, pool->workspaces[i] );
+    if (pool->work) CloseHandle( pool->work );
+    if (pool->done) CloseHandle( pool->done );
+    DeleteCriticalSection( &pool->cs );
+    HeapFree( GetProcessHeap(), 0, pool );
+}
+
+/* start a batch; only one batch is in flight at a time */
+void pool_dispatch( struct codec_pool *pool, struct chunk_job *jobs, LONG count )
+{
+    LONG i;
+
+    for (i = 0; i < count; i++) jobs[i].failed = FALSE;
+
+    EnterCriticalSection( &pool->cs );
+    pool->jobs = jobs;
+    pool->job_count = count;
+    pool->next_job = 0;
+    pool->pending = count;
+    LeaveCriticalSection( &pool->cs );
+
+    if (count && pool->thread_count)
+        ReleaseSemaphore( pool->work, min( count, (LONG)pool->thread_count ), NULL );
+}
+
+/* help with the batch, then wait for the workers to finish theirs */
+BOOL pool_wait( struct codec_pool *pool )
+{
+    LONG i, count = pool->job_count;
+
+    if (!count) return TRUE;
+
+    run_jobs( pool, pool->thread_count );
+    WaitForSingleObject( pool->done, INFINITE );
+
+    EnterCriticalSection( &pool->cs );
+    pool->job_count = 0;
+    LeaveCriticalSection( &pool->cs );
+
+    for (i = 0; i < count; i++)
+        if (pool->jobs[i].failed) return FALSE;
+    return TRUE;
+}
+
+/***********************************************************************
+ * resource writer
+ *
+ * Resources are fed one after the other.  Their chunks are queued in the
+ * current slot; once a slot is full it is handed to the pool and the other
+ * slot, compressed in the meantime, is written out.  Duplicates are only
+ * known once a resource has been hashed completely, so a duplicate whose
+ * first chunks already went to disk is dropped by moving the write cursor
+ * back to its start.
+ */
+
+struct pending_resource
+{
+    struct pending_resource *next;
+    struct wim_resource      res;
+    DWORD                    chunks;        /* chunks in the resource */
+    DWORD                    fed;           /* chunks queued */
+    DWORD                    written;       /* chunks done by the output side */
+    DWORD                    fill;          /* bytes in the chunk being fed */
+    ULONGLONG                fed_bytes;
+    ULONGLONG               *offsets;       /* chunk offsets relative to the end of the table */
+    DWORD                    table_size;
+    BOOL                     ended;
+    BOOL                     duplicate;
+    BOOL                     unique;        /* never merged with another resource */
+    SHA_CTX                  sha;
+    BYTE                    *hash_out;
+    DWORD                   *index_out;
+};
+
+static BOOL is_compressed( const struct resource_writer *writer )
+{
+    return writer->wim->compression != WIM_COMPRESS_NONE;
+}
+
+BOOL writer_init( struct resource_writer *writer, struct wim_file *wim )
+{
+    DWORD i;
+
+    memset( writer, 0, sizeof(*writer) );
+    writer->wim = wim;
+    writer->cursor = wim->data_end;
+
+    if (!(writer->pool = pool_create( wim->compression, FALSE ))) return FALSE;
+
+    for (i = 0; i < 2; i++)
+    {
+        writer->slots[i].input = HeapAlloc( GetProcessHeap(), 0, WIM_BATCH_CHUNKS * WIM_CHUNK_SIZE );
+        writer->slots[i].output = HeapAlloc( GetProcessHeap(), 0, WIM_BATCH_CHUNKS * WIM_CHUNK_SIZE );
+        if (!writer->slots[i].input || !writer->slots[i].output)
+        {
+            writer_cleanup( writer );
+            SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+void writer_cleanup( struct resource_writer *writer )
+{
+    struct pending_resource *res, *next;
+    DWORD i;
+
+    /* make sure no worker still touches the slots */
+    if (writer->pool)
+    {
+        pool_wait( writer->pool );
+        pool_destroy( writer->pool );
+    }
+
+    for (res = writer->queue; res; res = next)
+    {
+        next = res->next;
+        HeapFree( GetProcessHeap(), 0, res->offsets );
+        HeapFree( GetProcessHeap(), 0, res );
+    }
+    for (i = 0; i < 2; i++)
+    {
+        HeapFree( GetProcessHeap(), 0, writer->slots[i].input );
+        HeapFree( GetProcessHeap(), 0, writer->slots[i].output );
+    }
+    memset( writer, 0, sizeof(*writer) );
+}
+
+static void writer_fail( struct resource_writer *writer, DWORD error )
+{
+    if (!writer->failed) SetLastError( error );
+    writer->failed = TRUE;
+}
+
+/* write the chunk table and hand the resource to the lookup table */
+static BOOL retire_resource( struct resource_writer *writer, struct pending_resource *pending )
+{
+    struct wim_file *wim = writer->wim;
+    struct wim_resource *existing = NULL;
+    BYTE *table;
+    DWORD i, entry_size;
+
+    if (!pending->unique) existing = wim_find_resource( wim, pending->res.hash );
+
+    if (existing)
+    {
+        existing->ref_count++;
+        if (pending->written) writer->cursor = pending->res.offset;
+        if (pending->index_out) *pending->index_out = existing - wim->resources;
+        return TRUE;
+    }
+
+    if (!pending->chunks) pending->res.offset = writer->cursor;
+    pending->res.size = writer->cursor - pending->res.offset;
+    pending->res.ref_count = 1;
+
+    if (pending->table_size)
+    {
+        entry_size = pending->table_size / (pending->chunks - 1);
+        if (!(table = HeapAlloc( GetProcessHeap(), 0, pending->table_size )))
+        {
+            writer_fail( writer, ERROR_NOT_ENOUGH_MEMORY );
+            return FALSE;
+        }
+        for (i = 1; i < pending->chunks; i++)
+        {
+            if (entry_size == sizeof(DWORD))
+                ((DWORD *)table)[i - 1] = (DWORD)pending->offsets[i];
+            else
+                ((ULONGLONG *)table)[i - 1] = pending->offsets[i];
+        }
+        if (!wim_write( wim, pending->res.offset, table, pending->table_size ))
+            writer_fail( writer, GetLastError() );
+        HeapFree( GetProcessHeap(), 0, table );
+        if (writer->failed) return FALSE;
+    }
+
+    if (!(existing = wim_add_resource( wim, &pending->res )))
+    {
+        writer_fail( writer, ERROR_NOT_ENOUGH_MEMORY );
+        return FALSE;
+    }
+    if (pending->index_out) *pending->index_out = existing - wim->resources;
+    return TRUE;
+}
+
+/* retire every resource at the head of the queue that has been written completely */
+static BOOL retire_ready( struct resource_writer *writer )
+{
+    struct pending_resource *head;
+
+    while ((head = writer->queue) && head->ended && head->written == head->fed)
+    {
+        if (!retire_resource( writer, head )) return FALSE;
+        writer->queue = head->next;
+        if (!writer->queue) writer->tail = NULL;
+        HeapFree( GetProcessHeap(), 0, head->offsets );
+        HeapFree( GetProcessHeap(), 0, head );
+    }
+    return TRUE;
+}
+
+static BOOL write_slot( struct resource_writer *writer, struct write_slot *slot )
+{
+    struct pending_resource *owner;
+    struct chunk_job *job;
+    LONG i;
+
+    for (i = 0; i < slot->count && !writer->failed; i++)
+    {
+        if (!retire_ready( writer )) break;
+
+        owner = slot->owners[i];
+        job = &slot->jobs[i];
+
+        if (!owner->written)
+        {
+            owner->res.offset = writer->cursor;
+            writer->cursor += owner->table_size;
+        }
+        owner->offsets[owner->written++] = writer->cursor - owner->res.offset - owner->table_size;
+
+        /* chunks of a known duplicate are not written at all */
+        if (owner->duplicate) continue;
+
+        if (!wim_write( writer->wim, writer->cursor, job->data, job->data_size ))
+            writer_fail( writer, GetLastError() );
+        writer->cursor += job->data_size;
+    }
+    slot->count = 0;
+    slot->busy = FALSE;
+
+    if (!writer->failed) retire_ready( writer );
+    return !writer->failed;
+}
+
+/* write the batch in flight, then start the current one */
+static BOOL writer_rotate( struct resource_writer *writer )
+{
+    struct write_slot *slot = &writer->slots[writer->current];
+    struct write_slot *prev = &writer->slots[!writer->current];
+
+    if (prev->busy)
+    {
+        if (!pool_wait( writer->pool ))
+        {
+            writer_fail( writer, ERROR_INVALID_DATA );
+            return FALSE;
+        }
+        if (!write_slot( writer, prev )) return FALSE;
+    }
+
+    if (slot->count)
+    {
+        pool_dispatch( writer->pool, slot->jobs, slot->count );
+        slot->busy = TRUE;
+        writer->current = !writer->current;
+    }
+    return TRUE;
+}
+
+BOOL writer_begin( struct resource_writer *writer, ULONGLONG size, BYTE flags, BYTE *hash, DWORD *index )
+{
+    struct pending_resource *pending;
+    ULONGLONG chunks = (size + WIM_CHUNK_SIZE - 1) / WIM_CHUNK_SIZE;
+
+    if (writer->failed) return FALSE;
+
+    if (!(pending = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*pending) )) ||
+        chunks > MAXDWORD - 1 ||
+        !(pending->offsets = HeapAlloc( GetProcessHeap(), 0, max( chunks, 1 ) * sizeof(ULONGLONG) )))
+    {
+        HeapFree( GetProcessHeap(), 0, pending );
+        writer_fail( writer, ERROR_NOT_ENOUGH_MEMORY );
+        return FALSE;
+    }
+
+    pending->res.original_size = size;
+    pending->res.flags = flags;
+    pending->chunks = chunks;
+    pending->unique = (flags & RESHDR_FLAG_METADATA) != 0;
+    pending->hash_out = hash;
+    pending->index_out = index;
+    if (is_compressed( writer ))
+    {
+        pending->res.flags |= RESHDR_FLAG_COMPRESSED;
+        if (chunks > 1)
+            pending->table_size = (chunks - 1) * (size > MAXDWORD ? sizeof(ULONGLONG) : sizeof(DWORD));
+    }
+    A_SHAInit( &pending->sha );
+
+    if (writer->tail) writer->tail->next = pending;
+    else writer->queue = pending;
+    writer->tail = pending;
+    writer->open = pending;
+    return TRUE;
+}
+
+/* room for the next bytes of the open resource, filled by the caller */
+BYTE *writer_get_buffer( struct resource_writer *writer, DWORD *room )
+{
+    struct pending_resource *open = writer->open;
+    struct write_slot *slot = &writer->slots[writer->current];
+
+    *room = WIM_CHUNK_SIZE - open->fill;
+    if (*room > open->res.original_size - open->fed_bytes)
+        *room = open->res.original_size - open->fed_bytes;
+    return slot->input + slot->count * WIM_CHUNK_SIZE + open->fill;
+}
+
+BOOL writer_commit( struct resource_writer *writer, DWORD size )
+{
+    struct pending_resource *open = writer->open;
+    struct write_slot *slot = &writer->slots[writer->current];
+    struct chunk_job *job;
+    BYTE *chunk = slot->input + slot->count * WIM_CHUNK_SIZE;
+
+    A_SHAUpdate( &open->sha, chunk + open->fill, size );
+    open->fill += size;
+    open->fed_bytes += size;
+
+    if (open->fill < WIM_CHUNK_SIZE && open->fed_bytes < open->res.original_size)
+        return TRUE;
+
+    job = &slot->jobs[slot->count];
+    job->src = chunk;
+    job->src_size = open->fill;
+    job->dst = slot->output + slot->count * WIM_CHUNK_SIZE;
+    job->size = open->fill;
+    slot->owners[slot->count++] = open;
+    open->fed++;
+    open->fill = 0;
+
+    if (slot->count == WIM_BATCH_CHUNKS) return writer_rotate( writer );
+    return TRUE;
+}
+
+BOOL writer_write( struct resource_writer *writer, const void *data, DWORD size )
+{
+    const BYTE *src = data;
+    DWORD room;
+    BYTE *buffer;
+
+    while (size)
+    {
+        buffer = writer_get_buffer( writer, &room );
+        if (!room)
+        {
+            writer_fail( writer, ERROR_INVALID_DATA );
+            return FALSE;
+        }
+        room = min( room, size );
+        memcpy( buffer, src, room );
+        if (!writer_commit( writer, room )) return FALSE;
+        src += room;
+        size -= room;
+    }
+    return TRUE;
+}
+
+BOOL writer_end( struct resource_writer *writer )
+{
+    struct pending_resource *open = writer->open, *pending;
+    struct write_slot *slot = &writer->slots[writer->current];
+
+    writer->open = NULL;
+    if (writer->failed) return FALSE;
+
+    if (open->fed_bytes != open->res.original_size)
+    {
+        /* the file changed size while we were reading it */
+        writer_fail( writer, ERROR_INVALID_DATA );
+        return FALSE;
+    }
+
+    A_SHAFinal( &open->sha, (ULONG *)open->res.hash );
+    if (open->hash_out) memcpy( open->hash_out, open->res.hash, SHA1_HASH_SIZE );
+
+    if (!open->unique)
+    {
+        open->duplicate = wim_find_resource( writer->wim, open->res.hash ) != NULL;
+        for (pending = writer->queue; pending != open && !open->duplicate; pending = pending->next)
+        {
+            if (!pending->unique && !pending->duplicate &&
+                !memcmp( pending->res.hash, open->res.hash, SHA1_HASH_SIZE ))
+                open->duplicate = TRUE;
+        }
+    }
+
+    /* chunks of a duplicate that are still queued need not be compressed */
+    if (open->duplicate)
+    {
+        while (slot->count && slot->owners[slot->count - 1] == open)
+        {
+            slot->count--;
+            open->fed--;
+        }
+    }
+
+    open->ended = TRUE;
+    return retire_ready( writer );
+}
+
+BOOL writer_flush( struct resource_writer *writer )
+{
+    if (writer->failed) return FALSE;
+
+    /* dispatch the current slot, then drain it */
+    if (!writer_rotate( writer )) return FALSE;
+    if (!writer_rotate( writer )) return FALSE;
+    if (!retire_ready( writer )) return FALSE;
+
+    writer->wim->data_end = writer->cursor;
+    return TRUE;
+}
+
+/***********************************************************************
+ * resource reader
+ */
+
+/* absolute file offsets of all chunks, plus the end of the last one */
+BOOL read_chunk_table( struct wim_file *wim, const struct wim_resource *res,
+                       ULONGLONG **offsets, DWORD *count )
+{
+    ULONGLONG chunks = (res->original_size + WIM_CHUNK_SIZE - 1) / WIM_CHUNK_SIZE;
+    ULONGLONG table_size, data_start, *table;
+    DWORD entry_size, i;
+    BYTE *raw;
+
+    entry_size = res->original_size > MAXDWORD ? sizeof(ULONGLONG) : sizeof(DWORD);
+    table_size = chunks ? (chunks - 1) * entry_size : 0;
+    if (chunks > MAXDWORD - 1 || table_size > res->size)
+    {
+        SetLastError( ERROR_FILE_CORRUPT );
+        return FALSE;
+    }
+
+    if (!(table = HeapAlloc( GetProcessHeap(), 0, (chunks + 1) * sizeof(ULONGLONG) )))
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return FALSE;
+    }
+    if (!(res->flags & RESHDR_FLAG_COMPRESSED))
+    {
+        for (i = 0; i < chunks; i++) table[i] = res->offset + (ULONGLONG)i * WIM_CHUNK_SIZE;
+        table[chunks] = res->offset + res->original_size;
+        *offsets = table;
+        *count = chunks;
+        return TRUE;
+    }
+
+    if (!(raw = HeapAlloc( GetProcessHeap(), 0, max( table_size, 1 ) )))
+    {
+        HeapFree( GetProcessHeap(), 0, table );
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return FALSE;
+    }
+    if (table_size && !wim_read( wim, res->offset, raw, table_size ))
+    {
+        HeapFree( GetProcessHeap(), 0, raw );
+        HeapFree( GetProcessHeap(), 0, table );
+        return FALSE;
+    }
+
+    data_start = res->offset + table_size;
+    table[0] = data_start;
+    for (i = 1; i < chunks; i++)
+    {
+        if (entry_size == sizeof(DWORD))
+            table[i] = data_start + ((DWORD *)raw)[i - 1];
+        else
+            table[i] = data_start + ((ULONGLONG *)raw)[i - 1];
+    }
+    table[chunks] = res->offset + res->size;
+    HeapFree( GetProcessHeap(), 0, raw );
+
+    for (i = 0; i < chunks; i++)
+    {
+        if (table[i + 1] < table[i] || table[i + 1] - table[i] > WIM_CHUNK_SIZE)
+        {
+            HeapFree( GetProcessHeap(), 0, table );
+            SetLastError( ERROR_FILE_CORRUPT );
+            return FALSE;
+        }
+    }
+
+    *offsets = table;
+    *count = chunks;
+    return TRUE;
+}
+
+/* read and decompress a whole resource into buffer, which holds original_size bytes */
+BOOL read_resource( struct wim_file *wim, struct codec_pool *pool, const struct wim_resource *res,
+                    BYTE *buffer )
+{
+    struct chunk_job *jobs;
+    ULONGLONG *offsets;
+    DWORD count, i;
+    BYTE *data;
+    BOOL ret;
+
+    if (!(res->flags & RESHDR_FLAG_COMPRESSED))
+    {
+        if (res->size != res->original_size || res->size > MAXLONG)
+        {
+            SetLastError( ERROR_FILE_CORRUPT );
+            return FALSE;
+        }
+        return wim_read( wim, res->offset, buffer, res->original_size );
+    }
+
+    if (!read_chunk_table( wim, res, &offsets, &count )) return FALSE;
+    if (offsets[count] - offsets[0] > MAXLONG)
+    {
+        HeapFree( GetProcessHeap(), 0, offsets );
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return FALSE;
+    }
+
+    jobs = HeapAlloc( GetProcessHeap(), 0, max( count, 1 ) * sizeof(*jobs) );
+    data = HeapAlloc( GetProcessHeap(), 0, max( offsets[count] - offsets[0], 1 ) );
+    if (!jobs || !data)
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        ret = FALSE;
+        goto done;
+    }
+    if (!(ret = wim_read( wim, offsets[0], data, offsets[count] - offsets[0] ))) goto done;
+
+    for (i = 0; i < count; i++)
+    {
+        jobs[i].src = data + (offsets[i] - offsets[0]);
+        jobs[i].src_size = offsets[i + 1] - offsets[i];
+        jobs[i].dst = buffer + (SIZE_T)i * WIM_CHUNK_SIZE;
+        jobs[i].size = min( WIM_CHUNK_SIZE, res->original_size - (ULONGLONG)i * WIM_CHUNK_SIZE );
+    }
+
+    pool_dispatch( pool, jobs, count );
+    if (!(ret = pool_wait( pool )))
+    {
+        SetLastError( ERROR_FILE_CORRUPT );
+        goto done;
+    }
+
+    for (i = 0; i < count; i++)
+        if (jobs[i].data != jobs[i].dst) memcpy( jobs[i].dst, jobs[i].data, jobs[i].size );
+
+done:
+    HeapFree( GetProcessHeap(), 0, data );
+    HeapFree( GetProcessHeap(), 0, jobs );
+    HeapFree( GetProcessHeap(), 0, offsets );
+    return ret;
+}
@@ -0,0 +1,809 @@
+/*
+ * WIM file handling
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "wimgapi_private.h"
+
+#include "ntsecapi.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(wimgapi);
+
+static const BYTE wim_tag[8] = { 'M','S','W','I','M',0,0,0 };
+
+static const WCHAR image_startW[] = {'<','I','M','A','G','E',0};
+static const WCHAR image_endW[] = {'<','/','I','M','A','G','E','>',0};
+static const WCHAR emptyW[] = {0};
+
+#define WIM_IO_BLOCK    (16 * 1024 * 1024)
+
+BOOL wim_read( struct wim_file *wim, ULONGLONG offset, void *buffer, SIZE_T size )
+{
+    OVERLAPPED ovl;
+    BYTE *ptr = buffer;
+    DWORD count, done;
+
+    while (size)
+    {
+        count = min( size, WIM_IO_BLOCK );
+        memset( &ovl, 0, sizeof(ovl) );
+        ovl.Offset = (DWORD)offset;
+        ovl.OffsetHigh = (DWORD)(offset >> 32);
+        if (!ReadFile( wim->file, ptr, count, &done, &ovl )) return FALSE;
+        if (done != count)
+        {
+            SetLastError( ERROR_FILE_CORRUPT );
+            return FALSE;
+        }
+        ptr += count;
+        offset += count;
+        size -= count;
+    }
+    return TRUE;
+}
+
+BOOL wim_write( struct wim_file *wim, ULONGLONG offset, const void *buffer, SIZE_T size )
+{
+    OVERLAPPED ovl;
+    const BYTE *ptr = buffer;
+    DWORD count, done;
+
+    while (size)
+    {
+        count = min( size, WIM_IO_BLOCK );
+        memset( &ovl, 0, sizeof(ovl) );
+        ovl.Offset = (DWORD)offset;
+        ovl.OffsetHigh = (DWORD)(offset >> 32);
+        if (!WriteFile( wim->file, ptr, count, &done, &ovl )) return FALSE;
+        ptr += count;
+        offset += count;
+        size -= count;
+    }
+    return TRUE;
+}
+
+static inline void reshdr_to_disk( RESHDR_DISK *disk, const struct wim_resource *res )
+{
+    disk->size_and_flags = (res->size & RESHDR_SIZE_MASK) | ((ULONGLONG)res->flags << 56);
+    disk->offset = res->offset;
+    disk->original_size = res->original_size;
+}
+
+static inline void reshdr_from_disk( struct wim_resource *res, const RESHDR_DISK *disk )
+{
+    res->size = disk->size_and_flags & RESHDR_SIZE_MASK;
+    res->flags = disk->size_and_flags >> 56;
+    res->offset = disk->offset;
+    res->original_size = disk->original_size;
+}
+
+/***********************************************************************
+ * lookup table
+ */
+
+static DWORD hash_slot( const struct wim_file *wim, const BYTE *hash )
+{
+    return *(const DWORD *)hash & (wim->hash_size - 1);
+}
+
+static BOOL rebuild_hash_index( struct wim_file *wim, DWORD size )
+{
+    DWORD *index, i, slot;
+
+    if (!(index = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, size * sizeof(DWORD) ))) return FALSE;
+
+    HeapFree( GetProcessHeap(), 0, wim->hash_index );
+    wim->hash_index = index;
+    wim->hash_size = size;
+
+    for (i = 0; i < wim->resource_count; i++)
+    {
+        if (wim->resources[i].flags & RESHDR_FLAG_METADATA) continue;
+        for (slot = hash_slot( wim, wim->resources[i].hash ); index[slot]; slot = (slot + 1) & (size - 1))
+            ;
+        index[slot] = i + 1;
+    }
+    return TRUE;
+}
+
+struct wim_resource *wim_find_resource( struct wim_file *wim, const BYTE *hash )
+{
+    DWORD slot;
+
+    if (!wim->hash_size) return NULL;
+
+    for (slot = hash_slot( wim, hash ); wim->hash_index[slot]; slot = (slot + 1) & (wim->hash_size - 1))
+    {
+        struct wim_resource *res = &wim->resources[wim->hash_index[slot] - 1];
+        if (!memcmp( res->hash, hash, SHA1_HASH_SIZE )) return res;
+    }
+    return NULL;
+}
+
+/* metadata resources are never shared, so they stay out of the hash index */
+struct wim_resource *wim_add_resource( struct wim_file *wim, const struct wim_resource *res )
+{
+    struct wim_resource *resources;
+    DWORD size, slot;
+
+    if (wim->resource_count == wim->resource_size)
+    {
+        size = max( 64, wim->resource_size * 2 );
+        if (wim->resources)
+            resources = HeapReAlloc( GetProcessHeap(), 0, wim->resources, size * sizeof(*resources) );
+        else
+            resources = HeapAlloc( GetProcessHeap(), 0, size * sizeof(*resources) );
+        if (!resources) return NULL;
+        wim->resources = resources;
+        wim->resource_size = size;
+    }
+
+    /* keep the index at most half full */
+    if ((wim->resource_count + 1) * 2 > wim->hash_size &&
+        !rebuild_hash_index( wim, max( 128, wim->hash_size * 2 ) ))
+        return NULL;
+
+    wim->resources[wim->resource_count] = *res;
+    if (!(res->flags & RESHDR_FLAG_METADATA))
+    {
+        for (slot = hash_slot( wim, res->hash ); wim->hash_index[slot]; slot = (slot + 1) & (wim->hash_size - 1))
+            ;
+        wim->hash_index[slot] = wim->resource_count + 1;
+    }
+    return &wim->resources[wim->resource_count++];
+}
+
+/* copy of the lookup table, to forget the resources of a failed operation */
+struct wim_resource *wim_save_resources( struct wim_file *wim, DWORD *count )
+{
+    struct wim_resource *saved;
+
+    if (!(saved = HeapAlloc( GetProcessHeap(), 0, max( wim->resource_count, 1 ) * sizeof(*saved) )))
+        return NULL;
+    memcpy( saved, wim->resources, wim->resource_count * sizeof(*saved) );
+    *count = wim->resource_count;
+    return saved;
+}
+
+void wim_restore_resources( struct wim_file *wim, const struct wim_resource *saved, DWORD count )
+{
+    memcpy( wim->resources, saved, count * sizeof(*saved) );
+    wim->resource_count = count;
+    if (wim->hash_size && !rebuild_hash_index( wim, wim->hash_size ))
+        ERR( "failed to rebuild the hash index\n" );
+}
+
+static BOOL read_lookup_table( struct wim_file *wim )
+{
+    struct wim_resource table, res;
+    WIM_LOOKUP_DISK *entries;
+    DWORD count, i;
+
+    reshdr_from_disk( &table, &wim->header.lookup_table );
+    if (!table.size) return TRUE;
+
+    if ((table.flags & RESHDR_FLAG_COMPRESSED) || table.size % sizeof(*entries) ||
+        table.size > MAXLONG)
+    {
+        SetLastError( ERROR_FILE_CORRUPT );
+        return FALSE;
+    }
+    count = table.size / sizeof(*entries);
+
+    if (!(entries = HeapAlloc( GetProcessHeap(), 0, table.size )))
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return FALSE;
+    }
+    if (!wim_read( wim, table.offset, entries, table.size ))
+    {
+        HeapFree( GetProcessHeap(), 0, entries );
+        return FALSE;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        reshdr_from_disk( &res, &entries[i].res );
+        res.ref_count = entries[i].ref_count;
+        memcpy( res.hash, entries[i].hash, SHA1_HASH_SIZE );
+        if (!wim_add_resource( wim, &res ))
+        {
+            HeapFree( GetProcessHeap(), 0, entries );
+            SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+            return FALSE;
+        }
+    }
+    HeapFree( GetProcessHeap(), 0, entries );
+
+    /* images are numbered in the order of their metadata resources */
+    for (i = 0; i < wim->resource_count && wim->image_count < wim->header.image_count; i++)
+    {
+        if (wim->resources[i].flags & RESHDR_FLAG_METADATA)
+            wim->images[wim->image_count++].metadata = i;
+    }
+    if (wim->image_count != wim->header.image_count)
+    {
+        SetLastError( ERROR_FILE_CORRUPT );
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/***********************************************************************
+ * XML data
+ */
+
+static WCHAR *strndupW( const WCHAR *str, SIZE_T len )
+{
+    WCHAR *ret = HeapAlloc( GetProcessHeap(), 0, (len + 1) * sizeof(WCHAR) );
+
+    if (ret)
+    {
+        memcpy( ret, str, len * sizeof(WCHAR) );
+        ret[len] = 0;
+    }
+    return ret;
+}
+
+static BOOL read_xml( struct wim_file *wim )
+{
+    struct wim_resource xml;
+    WCHAR *data, *start, *end, *content;
+    DWORD i, len;
+
+    reshdr_from_disk( &xml, &wim->header.xml_data );
+    if (!xml.size && !wim->image_count) return TRUE;
+    if (!xml.size || xml.size > 64 * 1024 * 1024 || (xml.flags & RESHDR_FLAG_COMPRESSED))
+    {
+        SetLastError( ERROR_FILE_CORRUPT );
+        return FALSE;
+    }
+
+    len = xml.size / sizeof(WCHAR);
+    if (!(data = HeapAlloc( GetProcessHeap(), 0, (len + 1) * sizeof(WCHAR) )))
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return FALSE;
+    }
+    if (!wim_read( wim, xml.offset, data, xml.size ))
+    {
+        HeapFree( GetProcessHeap(), 0, data );
+        return FALSE;
+    }
+    data[len] = 0;
+
+    /* only the IMAGE elements are kept, the rest is generated on write */
+    start = data;
+    for (i = 0; i < wim->image_count; i++)
+    {
+        if (!(start = strstrW( start, image_startW )) ||
+            !(content = strchrW( start, '>' )) ||
+            !(end = strstrW( content, image_endW )))
+            break;
+        content++;
+        if (!(wim->images[i].xml = strndupW( content, end - content ))) break;
+        start = end;
+    }
+    HeapFree( GetProcessHeap(), 0, data );
+
+    if (i != wim->image_count)
+    {
+        SetLastError( ERROR_FILE_CORRUPT );
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* the whole XML document, with a byte order mark; image is zero based, or ~0u for all images */
+WCHAR *wim_build_xml( struct wim_file *wim, DWORD image, DWORD *size )
+{
+    static const WCHAR wim_startW[] = {0xfeff,'<','W','I','M','>','<','T','O','T','A','L','B','Y','T','E','S','>',
+                                       '%','I','6','4','u','<','/','T','O','T','A','L','B','Y','T','E','S','>',0};
+    static const WCHAR wim_endW[] = {'<','/','W','I','M','>',0};
+    static const WCHAR image_fmtW[] = {'<','I','M','A','G','E',' ','I','N','D','E','X','=','"','%','u','"','>',0};
+    static const WCHAR bomW[] = {0xfeff,0};
+    SIZE_T len = 64;
+    WCHAR *ret, *p;
+    DWORD i;
+
+    for (i = 0; i < wim->image_count; i++)
+        if (wim->images[i].xml) len += strlenW( wim->images[i].xml ) + 40;
+
+    if (!(p = ret = HeapAlloc( GetProcessHeap(), 0, len * sizeof(WCHAR) ))) return NULL;
+
+    if (image == ~0u)
+        p += sprintfW( p, wim_startW, wim->data_end );
+    else
+    {
+        strcpyW( p, bomW );
+        p++;
+    }
+
+    for (i = 0; i < wim->image_count; i++)
+    {
+        if (image != ~0u && image != i) continue;
+        p += sprintfW( p, image_fmtW, i + 1 );
+        if (wim->images[i].xml)
+        {
+            strcpyW( p, wim->images[i].xml );
+            p += strlenW( p );
+        }
+        strcpyW( p, image_endW );
+        p += strlenW( p );
+    }
+
+    if (image == ~0u)
+    {
+        strcpyW( p, wim_endW );
+        p += strlenW( p );
+    }
+
+    *size = (p - ret) * sizeof(WCHAR);
+    return ret;
+}
+
+/***********************************************************************
+ * header and trailer
+ */
+
+/* lookup table and XML go after the resources, then the header points at them */
+BOOL wim_write_trailer( struct wim_file *wim )
+{
+    struct wim_resource table, xml;
+    WIM_LOOKUP_DISK *entries;
+    LARGE_INTEGER end;
+    WCHAR *data;
+    DWORD i, size;
+    BOOL ret;
+
+    if (!(entries = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                               max( wim->resource_count, 1 ) * sizeof(*entries) )))
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return FALSE;
+    }
+    for (i = 0; i < wim->resource_count; i++)
+    {
+        reshdr_to_disk( &entries[i].res, &wim->resources[i] );
+        entries[i].part_number = 1;
+        entries[i].ref_count = wim->resources[i].ref_count;
+        memcpy( entries[i].hash, wim->resources[i].hash, SHA1_HASH_SIZE );
+    }
+
+    memset( &table, 0, sizeof(table) );
+    table.offset = wim->data_end;
+    table.size = table.original_size = wim->resource_count * sizeof(*entries);
+    ret = wim_write( wim, table.offset, entries, table.size );
+    HeapFree( GetProcessHeap(), 0, entries );
+    if (!ret) return FALSE;
+
+    if (!(data = wim_build_xml( wim, ~0u, &size )))
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return FALSE;
+    }
+    memset( &xml, 0, sizeof(xml) );
+    xml.offset = table.offset + table.size;
+    xml.size = xml.original_size = size;
+    ret = wim_write( wim, xml.offset, data, size );
+    HeapFree( GetProcessHeap(), 0, data );
+    if (!ret) return FALSE;
+
+    end.QuadPart = xml.offset + xml.size;
+    if (!SetFilePointerEx( wim->file, end, NULL, FILE_BEGIN ) || !SetEndOfFile( wim->file ))
+        return FALSE;
+
+    reshdr_to_disk( &wim->header.lookup_table, &table );
+    reshdr_to_disk( &wim->header.xml_data, &xml );
+    wim->header.image_count = wim->image_count;
+    return wim_write( wim, 0, &wim->header, sizeof(wim->header) );
+}
+
+BOOL wim_add_image( struct wim_file *wim, DWORD metadata, WCHAR *xml )
+{
+    struct wim_image_info *images;
+
+    if (wim->images)
+        images = HeapReAlloc( GetProcessHeap(), 0, wim->images, (wim->image_count + 1) * sizeof(*images) );
+    else
+        images = HeapAlloc( GetProcessHeap(), 0, sizeof(*images) );
+    if (!images)
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return FALSE;
+    }
+    wim->images = images;
+    wim->images[wim->image_count].metadata = metadata;
+    wim->images[wim->image_count].xml = xml;
+    wim->image_count++;
+    return TRUE;
+}
+
+static void init_header( struct wim_file *wim, DWORD compression )
+{
+    memset( &wim->header, 0, sizeof(wim->header) );
+    memcpy( wim->header.tag, wim_tag, sizeof(wim_tag) );
+    wim->header.header_size = WIM_HEADER_SIZE;
+    wim->header.version = WIM_VERSION;
+    wim->header.part_number = 1;
+    wim->header.total_parts = 1;
+    RtlGenRandom( &wim->header.guid, sizeof(wim->header.guid) );
+
+    switch (compression)
+    {
+    case WIM_COMPRESS_XPRESS:
+        wim->header.flags = WIM_HDR_FLAG_COMPRESSION | WIM_HDR_FLAG_COMPRESS_XPRESS;
+        wim->header.chunk_size = WIM_CHUNK_SIZE;
+        break;
+    case WIM_COMPRESS_LZX:
+        wim->header.flags = WIM_HDR_FLAG_COMPRESSION | WIM_HDR_FLAG_COMPRESS_LZX;
+        wim->header.chunk_size = WIM_CHUNK_SIZE;
+        break;
+    }
+    wim->compression = compression;
+    wim->data_end = WIM_HEADER_SIZE;
+}
+
+static BOOL read_header( struct wim_file *wim )
+{
+    LARGE_INTEGER size;
+    DWORD flags;
+
+    if (!wim_read( wim, 0, &wim->header, sizeof(wim->header) ))
+    {
+        if (GetLastError() == ERROR_FILE_CORRUPT) SetLastError( ERROR_BAD_FORMAT );
+        return FALSE;
+    }
+
+    if (memcmp( wim->header.tag, wim_tag, sizeof(wim_tag) ) ||
+        wim->header.header_size != WIM_HEADER_SIZE)
+    {
+        SetLastError( ERROR_BAD_FORMAT );
+        return FALSE;
+    }
+    if (wim->header.total_parts != 1)
+    {
+        FIXME( "spanned WIM files are not supported\n" );
+        SetLastError( ERROR_NOT_SUPPORTED );
+        return FALSE;
+    }
+
+    flags = wim->header.flags;
+    if (!(flags & WIM_HDR_FLAG_COMPRESSION))
+        wim->compression = WIM_COMPRESS_NONE;
+    else if (flags & WIM_HDR_FLAG_COMPRESS_XPRESS)
+        wim->compression = WIM_COMPRESS_XPRESS;
+    else if (flags & WIM_HDR_FLAG_COMPRESS_LZX)
+        wim->compression = WIM_COMPRESS_LZX;
+    else if (flags & WIM_HDR_FLAG_COMPRESS_LZMS)
+        wim->compression = WIM_COMPRESS_LZMS;
+    else
+    {
+        SetLastError( ERROR_BAD_FORMAT );
+        return FALSE;
+    }
+    if (wim->compression != WIM_COMPRESS_NONE && wim->header.chunk_size != WIM_CHUNK_SIZE)
+    {
+        FIXME( "chunk size %u not supported\n", wim->header.chunk_size );
+        SetLastError( ERROR_NOT_SUPPORTED );
+        return FALSE;
+    }
+    if (wim->header.image_count > 0xffff)
+    {
+        SetLastError( ERROR_FILE_CORRUPT );
+        return FALSE;
+    }
+
+    /* append after everything, so a failed capture leaves the old trailer intact */
+    if (!GetFileSizeEx( wim->file, &size )) return FALSE;
+    wim->data_end = max( size.QuadPart, WIM_HEADER_SIZE );
+    return TRUE;
+}
+
+void wim_release( struct wim_file *wim )
+{
+    DWORD i;
+
+    if (InterlockedDecrement( &wim->refs )) return;
+
+    wim->magic = 0;
+    for (i = 0; i < wim->image_count; i++) HeapFree( GetProcessHeap(), 0, wim->images[i].xml );
+    HeapFree( GetProcessHeap(), 0, wim->images );
+    HeapFree( GetProcessHeap(), 0, wim->resources );
+    HeapFree( GetProcessHeap(), 0, wim->hash_index );
+    HeapFree( GetProcessHeap(), 0, wim->path );
+    if (wim->file != INVALID_HANDLE_VALUE) CloseHandle( wim->file );
+    DeleteCriticalSection( &wim->cs );
+    HeapFree( GetProcessHeap(), 0, wim );
+}
+
+struct wim_file *wim_open( PCWSTR path, DWORD access, DWORD creation, DWORD flags,
+                           DWORD compression, DWORD *result )
+{
+    struct wim_file *wim;
+    DWORD file_access = 0, share = FILE_SHARE_READ;
+    LARGE_INTEGER size;
+
+    if (!path || !(access & (WIM_GENERIC_READ | WIM_GENERIC_WRITE | WIM_GENERIC_MOUNT)) ||
+        creation < WIM_CREATE_NEW || creation > WIM_OPEN_ALWAYS || compression > WIM_COMPRESS_LZMS)
+    {
+        SetLastError( ERROR_INVALID_PARAMETER );
+        return NULL;
+    }
+
+    if (access & (WIM_GENERIC_READ | WIM_GENERIC_MOUNT)) file_access |= GENERIC_READ;
+    if (access & WIM_GENERIC_WRITE) file_access |= GENERIC_READ | GENERIC_WRITE;
+    if (flags & WIM_FLAG_SHARE_WRITE) share |= FILE_SHARE_WRITE;
+
+    if (!(wim = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*wim) )))
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return NULL;
+    }
+    wim->magic = WIM_FILE_MAGIC;
+    wim->refs = 1;
+    wim->access = access;
+    wim->flags = flags;
+    InitializeCriticalSection( &wim->cs );
+
+    if (!(wim->path = strndupW( path, strlenW( path ) )))
+    {
+        wim->file = INVALID_HANDLE_VALUE;
+        wim_release( wim );
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return NULL;
+    }
+
+    wim->file = CreateFileW( path, file_access, share, NULL, creation, FILE_ATTRIBUTE_NORMAL, NULL );
+    if (wim->file == INVALID_HANDLE_VALUE)
+    {
+        DWORD error = GetLastError();
+        wim_release( wim );
+        SetLastError( error );
+        return NULL;
+    }
+
+    if (!GetFileSizeEx( wim->file, &size )) size.QuadPart = 0;
+
+    if (!size.QuadPart)
+    {
+        if (!(access & WIM_GENERIC_WRITE))
+        {
+            wim_release( wim );
+            SetLastError( ERROR_BAD_FORMAT );
+            return NULL;
+        }
+        init_header( wim, compression );
+        if (!wim_write_trailer( wim ))
+        {
+            DWORD error = GetLastError();
+            wim_release( wim );
+            SetLastError( error );
+            return NULL;
+        }
+        if (result) *result = WIM_CREATED_NEW;
+        return wim;
+    }
+
+    if (!read_header( wim ) ||
+        !(wim->images = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                   max( wim->header.image_count, 1 ) * sizeof(*wim->images) )) ||
+        !read_lookup_table( wim ) || !read_xml( wim ))
+    {
+        DWORD error = GetLastError();
+        wim_release( wim );
+        SetLastError( error ? error : ERROR_FILE_CORRUPT );
+        return NULL;
+    }
+
+    if (result) *result = WIM_OPENED_EXISTING;
+    return wim;
+}
+
+/***********************************************************************
+ * export
+ */
+
+#define COPY_BLOCK  (1024 * 1024)
+
+/* copy a resource as it is stored, both files use the same compression */
+static BOOL copy_raw_resource( struct wim_file *src, struct resource_writer *writer,
+                               const struct wim_resource *res, DWORD *index )
+{
+    struct wim_file *dest = writer->wim;
+    struct wim_resource copy = *res;
+    ULONGLONG done;
+    struct wim_resource *added;
+    DWORD count;
+    BYTE *buffer;
+    BOOL ret = TRUE;
+
+    if (!(buffer = HeapAlloc( GetProcessHeap(), 0, COPY_BLOCK )))
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return FALSE;
+    }
+
+    copy.offset = dest->data_end;
+    for (done = 0; ret && done < res->size; done += count)
+    {
+        count = min( COPY_BLOCK, res->size - done );
+        ret = wim_read( src, res->offset + done, buffer, count ) &&
+              wim_write( dest, copy.offset + done, buffer, count );
+    }
+    HeapFree( GetProcessHeap(), 0, buffer );
+    if (!ret) return FALSE;
+
+    copy.ref_count = 1;
+    if (!(added = wim_add_resource( dest, &copy )))
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return FALSE;
+    }
+    if (index) *index = added - dest->resources;
+    dest->data_end += res->size;
+    writer->cursor = dest->data_end;
+    return TRUE;
+}
+
+/* decompress a resource and feed it to the writer of the destination */
+static BOOL recompress_resource( struct wim_file *src, struct codec_pool *pool, struct resource_writer *writer,
+                                 const struct wim_resource *res, DWORD *index )
+{
+    BYTE *buffer;
+    BOOL ret;
+
+    if (res->original_size > MAXLONG)
+    {
+        FIXME( "resource of %s bytes too large to convert\n", wine_dbgstr_longlong( res->original_size ) );
+        SetLastError( ERROR_NOT_SUPPORTED );
+        return FALSE;
+    }
+    if (!(buffer = HeapAlloc( GetProcessHeap(), 0, max( res->original_size, 1 ) )))
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return FALSE;
+    }
+
+    ret = read_resource( src, pool, res, buffer ) &&
+          writer_begin( writer, res->original_size, res->flags & RESHDR_FLAG_METADATA, NULL, index ) &&
+          writer_write( writer, buffer, res->original_size ) &&
+          writer_end( writer ) &&
+          writer_flush( writer );
+    HeapFree( GetProcessHeap(), 0, buffer );
+    return ret;
+}
+
+static BOOL export_resource( struct wim_file *src, struct codec_pool *pool, struct resource_writer *writer,
+                             const struct wim_resource *res, DWORD *index )
+{
+    struct wim_resource *existing;
+
+    if (!(res->flags & RESHDR_FLAG_METADATA) && (existing = wim_find_resource( writer->wim, res->hash )))
+    {
+        existing->ref_count++;
+        return TRUE;
+    }
+
+    if (src->compression == writer->wim->compression)
+        return copy_raw_resource( src, writer, res, index );
+    return recompress_resource( src, pool, writer, res, index );
+}
+
+static BOOL export_tree( struct wim_file *src, struct codec_pool *pool, struct resource_writer *writer,
+                         struct wim_dentry *dentry )
+{
+    struct wim_resource *res;
+    struct wim_dentry *child;
+
+    if (!hash_is_zero( dentry->hash ))
+    {
+        if (!(res = wim_find_resource( src, dentry->hash )))
+        {
+            SetLastError( ERROR_FILE_CORRUPT );
+            return FALSE;
+        }
+        if (!export_resource( src, pool, writer, res, NULL )) return FALSE;
+    }
+
+    for (child = dentry->children; child; child = child->next)
+        if (!export_tree( src, pool, writer, child )) return FALSE;
+    return TRUE;
+}
+
+BOOL export_image( struct wim_image *image, struct wim_file *dest, DWORD flags )
+{
+    struct wim_file *src = image->wim;
+    struct resource_writer writer;
+    struct codec_pool *pool = NULL;
+    struct wim_dentry *root = NULL;
+    struct wim_resource *saved = NULL;
+    WCHAR *xml = NULL;
+    DWORD metadata, saved_count, image_count = dest->image_count;
+    BOOL ret = FALSE;
+
+    if (src == dest)
+    {
+        SetLastError( ERROR_INVALID_PARAMETER );
+        return FALSE;
+    }
+    if (!(dest->access & WIM_GENERIC_WRITE))
+    {
+        SetLastError( ERROR_ACCESS_DENIED );
+        return FALSE;
+    }
+    if (flags & ~(WIM_EXPORT_ALLOW_DUPLICATES | WIM_EXPORT_ONLY_RESOURCES | WIM_EXPORT_ONLY_METADATA))
+    {
+        SetLastError( ERROR_INVALID_PARAMETER );
+        return FALSE;
+    }
+
+    if (!(pool = pool_create( src->compression, TRUE ))) return FALSE;
+    if (!writer_init( &writer, dest ))
+    {
+        pool_destroy( pool );
+        return FALSE;
+    }
+
+    if (!(saved = wim_save_resources( dest, &saved_count )))
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        goto done;
+    }
+    if (!(root = load_metadata( src, pool, image->index ))) goto done;
+
+    if (!(flags & WIM_EXPORT_ONLY_METADATA) && !export_tree( src, pool, &writer, root ))
+        goto done;
+
+    if (!(flags & WIM_EXPORT_ONLY_RESOURCES))
+    {
+        const WCHAR *src_xml = src->images[image->index].xml;
+
+        if (!export_resource( src, pool, &writer, &src->resources[src->images[image->index].metadata],
+                              &metadata ))
+            goto done;
+        if (!src_xml) src_xml = emptyW;
+        if (!(xml = strndupW( src_xml, strlenW( src_xml ) )))
+        {
+            SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+            goto done;
+        }
+        if (!wim_add_image( dest, metadata, xml )) goto done;
+        xml = NULL;
+    }
+
+    ret = wim_write_trailer( dest );
+
+done:
+    if (!ret && saved)
+    {
+        DWORD error = GetLastError();
+
+        if (dest->image_count > image_count)
+        {
+            HeapFree( GetProcessHeap(), 0, dest->images[image_count].xml );
+            dest->image_count = image_count;
+        }
+        wim_restore_resources( dest, saved, saved_count );
+        SetLastError( error );
+    }
+    HeapFree( GetProcessHeap(), 0, saved );
+    HeapFree( GetProcessHeap(), 0, xml );
+    dentry_free_tree( root );
+    writer_cleanup( &writer );
+    pool_destroy( pool );
+    return ret;
+}
@@ -1,8 +1,8 @@
 @ stdcall -private DllCanUnloadNow()
 @ stdcall -private DllMain(long long ptr)
-@ stub WIMApplyImage
-@ stub WIMCaptureImage
-@ stub WIMCloseHandle
+@ stdcall WIMApplyImage(ptr wstr long)
+@ stdcall WIMCaptureImage(ptr wstr long)
+@ stdcall WIMCloseHandle(ptr)
 @ stub WIMCommitImageHandle
 @ stub WIMCopyFile
 @ stdcall WIMCreateFile(wstr long long long long ptr)
@@ -10,20 +10,20 @@
 @ stub WIMDeleteImage
 @ stub WIMDeleteImageMounts
 @ stub WIMEnumImageFiles
-@ stub WIMExportImage
+@ stdcall WIMExportImage(ptr ptr long)
 @ stub WIMExtractImagePath
 @ stub WIMFindFirstImageFile
 @ stub WIMFindNextImageFile
-@ stub WIMGetAttributes
-@ stub WIMGetImageCount
-@ stub WIMGetImageInformation
+@ stdcall WIMGetAttributes(ptr ptr long)
+@ stdcall WIMGetImageCount(ptr)
+@ stdcall WIMGetImageInformation(ptr ptr ptr)
 @ stub WIMGetMessageCallbackCount
 @ stub WIMGetMountedImageHandle
 @ stub WIMGetMountedImageInfo
 @ stub WIMGetMountedImageInfoFromFile
 @ stdcall WIMGetMountedImages(ptr ptr)
 @ stub WIMInitFileIOCallbacks
-@ stub WIMLoadImage
+@ stdcall WIMLoadImage(ptr long)
 @ stub WIMMountImage
 @ stub WIMMountImageHandle
 @ stub WIMReadImageFile
@@ -0,0 +1,323 @@
+/*
+ * wimgapi internal definitions
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __WIMGAPI_PRIVATE_H
+#define __WIMGAPI_PRIVATE_H
+
+#include <stdarg.h>
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winbase.h"
+#include "winternl.h"
+#include "wine/debug.h"
+#include "wine/unicode.h"
+#include "wimgapi.h"
+
+/* on-disk format, see the WIM file format description shipped with the WAIK */
+
+#define WIM_HEADER_SIZE             208
+#define WIM_VERSION                 0x10d00
+#define WIM_CHUNK_SIZE              32768
+
+#define WIM_HDR_FLAG_COMPRESSION    0x00000002
+#define WIM_HDR_FLAG_READONLY       0x00000004
+#define WIM_HDR_FLAG_SPANNED        0x00000008
+#define WIM_HDR_FLAG_RP_FIX         0x00000080
+#define WIM_HDR_FLAG_COMPRESS_XPRESS 0x00020000
+#define WIM_HDR_FLAG_COMPRESS_LZX   0x00040000
+#define WIM_HDR_FLAG_COMPRESS_LZMS  0x00080000
+
+#define RESHDR_FLAG_FREE            0x01
+#define RESHDR_FLAG_METADATA        0x02
+#define RESHDR_FLAG_COMPRESSED      0x04
+#define RESHDR_FLAG_SPANNED         0x08
+
+#define RESHDR_SIZE_MASK            0x00ffffffffffffffULL
+
+#define SHA1_HASH_SIZE              20
+
+#include <pshpack1.h>
+typedef struct
+{
+    ULONGLONG size_and_flags;   /* stored size in the low 56 bits, RESHDR_FLAG_* in the top byte */
+    ULONGLONG offset;
+    ULONGLONG original_size;
+} RESHDR_DISK;
+
+typedef struct
+{
+    BYTE        tag[8];
+    DWORD       header_size;
+    DWORD       version;
+    DWORD       flags;
+    DWORD       chunk_size;
+    GUID        guid;
+    USHORT      part_number;
+    USHORT      total_parts;
+    DWORD       image_count;
+    RESHDR_DISK lookup_table;
+    RESHDR_DISK xml_data;
+    RESHDR_DISK boot_metadata;
+    DWORD       boot_index;
+    RESHDR_DISK integrity;
+    BYTE        unused[60];
+} WIM_HEADER_DISK;
+
+typedef struct
+{
+    RESHDR_DISK res;
+    USHORT      part_number;
+    DWORD       ref_count;
+    BYTE        hash[SHA1_HASH_SIZE];
+} WIM_LOOKUP_DISK;
+
+typedef struct
+{
+    ULONGLONG length;
+    DWORD     attributes;
+    DWORD     security_id;
+    ULONGLONG subdir_offset;
+    ULONGLONG unused[2];
+    FILETIME  creation_time;
+    FILETIME  last_access_time;
+    FILETIME  last_write_time;
+    BYTE      hash[SHA1_HASH_SIZE];
+    DWORD     unknown_0x54;
+    union
+    {
+        struct
+        {
+            DWORD  tag;
+            USHORT reserved;
+            USHORT flags;
+        } reparse;
+        ULONGLONG hard_link;
+    } u;
+    USHORT    stream_count;
+    USHORT    short_name_size;
+    USHORT    name_size;
+} WIM_DENTRY_DISK;
+#include <poppack.h>
+
+C_ASSERT(sizeof(WIM_HEADER_DISK) == WIM_HEADER_SIZE);
+C_ASSERT(sizeof(WIM_LOOKUP_DISK) == 50);
+C_ASSERT(sizeof(WIM_DENTRY_DISK) == 102);
+
+/* advapi32 exports these without a header */
+typedef struct
+{
+    ULONG Unknown[6];
+    ULONG State[5];
+    ULONG Count[2];
+    UCHAR Buffer[64];
+} SHA_CTX, *PSHA_CTX;
+
+void WINAPI A_SHAInit(PSHA_CTX);
+void WINAPI A_SHAUpdate(PSHA_CTX,const unsigned char*,UINT);
+void WINAPI A_SHAFinal(PSHA_CTX,PULONG);
+
+/* in-memory state */
+
+#define WIM_FILE_MAGIC      0x4d495746  /* 'FWIM' */
+#define WIM_IMAGE_MAGIC     0x4d495749  /* 'IWIM' */
+
+struct wim_resource
+{
+    ULONGLONG offset;
+    ULONGLONG size;             /* bytes stored in the file */
+    ULONGLONG original_size;
+    BYTE      flags;
+    DWORD     ref_count;
+    BYTE      hash[SHA1_HASH_SIZE];
+};
+
+struct wim_image_info
+{
+    DWORD  metadata;            /* index into the resource table */
+    WCHAR *xml;                 /* contents of the IMAGE element */
+};
+
+struct wim_file
+{
+    DWORD                  magic;
+    CRITICAL_SECTION       cs;
+    LONG                   refs;
+    HANDLE                 file;
+    DWORD                  access;
+    DWORD                  flags;
+    DWORD                  compression;     /* WIM_COMPRESS_* */
+    WCHAR                 *path;
+    WIM_HEADER_DISK        header;
+    struct wim_resource   *resources;
+    DWORD                  resource_count;
+    DWORD                  resource_size;
+    DWORD                 *hash_index;      /* open addressing, resource index + 1 */
+    DWORD                  hash_size;
+    struct wim_image_info *images;
+    DWORD                  image_count;
+    ULONGLONG              data_end;        /* new resources are appended here */
+};
+
+struct wim_image
+{
+    DWORD            magic;
+    struct wim_file *wim;
+    DWORD            index;                 /* zero based */
+};
+
+/* directory tree of an image */
+struct wim_dentry
+{
+    struct wim_dentry *parent;
+    struct wim_dentry *children;
+    struct wim_dentry *next;
+    WCHAR             *name;
+    DWORD              attributes;
+    FILETIME           creation_time;
+    FILETIME           last_access_time;
+    FILETIME           last_write_time;
+    ULONGLONG          size;
+    ULONGLONG          subdir_offset;
+    DWORD              reparse_tag;
+    BYTE               hash[SHA1_HASH_SIZE];
+};
+
+/* chunk codec thread pool, pool.c */
+
+#define WIM_MAX_THREADS     32
+#define WIM_BATCH_CHUNKS    64
+
+struct chunk_job
+{
+    const BYTE *src;
+    DWORD       src_size;
+    BYTE       *dst;            /* WIM_CHUNK_SIZE bytes of room */
+    DWORD       size;           /* uncompressed size of the chunk */
+    const BYTE *data;           /* result: compressed or decompressed bytes */
+    DWORD       data_size;
+    BOOL        failed;
+};
+
+struct codec_pool
+{
+    CRITICAL_SECTION  cs;
+    DWORD             compression;
+    BOOL              decompress;
+    DWORD             thread_count;
+    HANDLE            threads[WIM_MAX_THREADS];
+    void             *workspaces[WIM_MAX_THREADS + 1];
+    HANDLE            work;             /* semaphore */
+    HANDLE            done;             /* auto reset event, set when the batch is finished */
+    struct chunk_job *jobs;
+    LONG              job_count;
+    LONG              next_job;
+    LONG              pending;
+    LONG              started;
+    BOOL              shutdown;
+};
+
+struct codec_pool *pool_create(DWORD compression, BOOL decompress) DECLSPEC_HIDDEN;
+void pool_destroy(struct codec_pool *pool) DECLSPEC_HIDDEN;
+void pool_dispatch(struct codec_pool *pool, struct chunk_job *jobs, LONG count) DECLSPEC_HIDDEN;
+BOOL pool_wait(struct codec_pool *pool) DECLSPEC_HIDDEN;
+
+/* resource writer, pool.c */
+
+struct pending_resource;
+
+struct write_slot
+{
+    BYTE             *input;
+    BYTE             *output;
+    struct chunk_job  jobs[WIM_BATCH_CHUNKS];
+    struct pending_resource *owners[WIM_BATCH_CHUNKS];
+    LONG              count;
+    BOOL              busy;
+};
+
+struct resource_writer
+{
+    struct wim_file         *wim;
+    struct codec_pool       *pool;          /* NULL for uncompressed WIMs */
+    struct write_slot        slots[2];
+    DWORD                    current;
+    struct pending_resource *queue;         /* resources not completely written yet */
+    struct pending_resource *tail;
+    struct pending_resource *open;          /* resource being fed */
+    ULONGLONG                cursor;        /* file offset of the next chunk */
+    BOOL                     failed;
+};
+
+BOOL writer_init(struct resource_writer *writer, struct wim_file *wim) DECLSPEC_HIDDEN;
+BOOL writer_begin(struct resource_writer *writer, ULONGLONG size, BYTE flags, BYTE *hash,
+                  DWORD *index) DECLSPEC_HIDDEN;
+BYTE *writer_get_buffer(struct resource_writer *writer, DWORD *room) DECLSPEC_HIDDEN;
+BOOL writer_commit(struct resource_writer *writer, DWORD size) DECLSPEC_HIDDEN;
+BOOL writer_write(struct resource_writer *writer, const void *data, DWORD size) DECLSPEC_HIDDEN;
+BOOL writer_end(struct resource_writer *writer) DECLSPEC_HIDDEN;
+BOOL writer_flush(struct resource_writer *writer) DECLSPEC_HIDDEN;
+void writer_cleanup(struct resource_writer *writer) DECLSPEC_HIDDEN;
+
+BOOL read_resource(struct wim_file *wim, struct codec_pool *pool, const struct wim_resource *res,
+                   BYTE *buffer) DECLSPEC_HIDDEN;
+BOOL read_chunk_table(struct wim_file *wim, const struct wim_resource *res,
+                      ULONGLONG **offsets, DWORD *count) DECLSPEC_HIDDEN;
+
+/* lzx.c */
+
+DWORD lzx_decompress_workspace_size(void) DECLSPEC_HIDDEN;
+BOOL lzx_decompress(void *workspace, const BYTE *src, DWORD src_size, BYTE *dst, DWORD dst_size) DECLSPEC_HIDDEN;
+DWORD lzx_compress_workspace_size(void) DECLSPEC_HIDDEN;
+DWORD lzx_compress(void *workspace, const BYTE *src, DWORD src_size, BYTE *dst, DWORD dst_size) DECLSPEC_HIDDEN;
+
+/* wim.c */
+
+BOOL wim_read(struct wim_file *wim, ULONGLONG offset, void *buffer, SIZE_T size) DECLSPEC_HIDDEN;
+BOOL wim_write(struct wim_file *wim, ULONGLONG offset, const void *buffer, SIZE_T size) DECLSPEC_HIDDEN;
+struct wim_resource *wim_find_resource(struct wim_file *wim, const BYTE *hash) DECLSPEC_HIDDEN;
+struct wim_resource *wim_add_resource(struct wim_file *wim, const struct wim_resource *res) DECLSPEC_HIDDEN;
+struct wim_resource *wim_save_resources(struct wim_file *wim, DWORD *count) DECLSPEC_HIDDEN;
+void wim_restore_resources(struct wim_file *wim, const struct wim_resource *saved, DWORD count) DECLSPEC_HIDDEN;
+BOOL wim_add_image(struct wim_file *wim, DWORD metadata, WCHAR *xml) DECLSPEC_HIDDEN;
+BOOL wim_write_trailer(struct wim_file *wim) DECLSPEC_HIDDEN;
+WCHAR *wim_build_xml(struct wim_file *wim, DWORD image, DWORD *size) DECLSPEC_HIDDEN;
+struct wim_file *wim_open(PCWSTR path, DWORD access, DWORD creation, DWORD flags,
+                          DWORD compression, DWORD *result) DECLSPEC_HIDDEN;
+void wim_release(struct wim_file *wim) DECLSPEC_HIDDEN;
+
+static inline BOOL hash_is_zero(const BYTE *hash)
+{
+    DWORD i;
+
+    for (i = 0; i < SHA1_HASH_SIZE; i++)
+        if (hash[i]) return FALSE;
+    return TRUE;
+}
+
+/* metadata, capture.c and apply.c */
+
+struct wim_dentry *dentry_alloc(struct wim_dentry *parent, const WCHAR *name) DECLSPEC_HIDDEN;
+void dentry_free_tree(struct wim_dentry *root) DECLSPEC_HIDDEN;
+struct wim_dentry *load_metadata(struct wim_file *wim, struct codec_pool *pool, DWORD image) DECLSPEC_HIDDEN;
+HANDLE capture_image(struct wim_file *wim, PCWSTR path, DWORD flags) DECLSPEC_HIDDEN;
+BOOL apply_image(struct wim_image *image, PCWSTR path, DWORD flags) DECLSPEC_HIDDEN;
+BOOL export_image(struct wim_image *image, struct wim_file *dest, DWORD flags) DECLSPEC_HIDDEN;
+
+#endif /* __WIMGAPI_PRIVATE_H */
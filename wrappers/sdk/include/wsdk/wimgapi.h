@@ -23,6 +23,46 @@
 extern "C" {
 #endif
 
+#define WIM_GENERIC_READ                GENERIC_READ
+#define WIM_GENERIC_WRITE               GENERIC_WRITE
+#define WIM_GENERIC_MOUNT               GENERIC_EXECUTE
+
+#define WIM_CREATE_NEW                  CREATE_NEW
+#define WIM_CREATE_ALWAYS               CREATE_ALWAYS
+#define WIM_OPEN_EXISTING               OPEN_EXISTING
+#define WIM_OPEN_ALWAYS                 OPEN_ALWAYS
+
+#define WIM_COMPRESS_NONE               0
+#define WIM_COMPRESS_XPRESS             1
+#define WIM_COMPRESS_LZX                2
+#define WIM_COMPRESS_LZMS               3
+
+#define WIM_CREATED_NEW                 0
+#define WIM_OPENED_EXISTING             1
+
+#define WIM_FLAG_RESERVED               0x00000001
+#define WIM_FLAG_VERIFY                 0x00000002
+#define WIM_FLAG_INDEX                  0x00000004
+#define WIM_FLAG_NO_APPLY               0x00000008
+#define WIM_FLAG_NO_DIRACL              0x00000010
+#define WIM_FLAG_NO_FILEACL             0x00000020
+#define WIM_FLAG_SHARE_WRITE            0x00000040
+#define WIM_FLAG_FILEINFO               0x00000080
+#define WIM_FLAG_NO_RP_FIX              0x00000100
+#define WIM_FLAG_MOUNT_READONLY         0x00000200
+
+#define WIM_EXPORT_ALLOW_DUPLICATES     0x00000001
+#define WIM_EXPORT_ONLY_RESOURCES       0x00000002
+#define WIM_EXPORT_ONLY_METADATA        0x00000004
+
+#define WIM_ATTRIBUTE_NORMAL            0x00000000
+#define WIM_ATTRIBUTE_RESOURCE_ONLY     0x00000001
+#define WIM_ATTRIBUTE_METADATA_ONLY     0x00000002
+#define WIM_ATTRIBUTE_VERIFY_DATA       0x00000004
+#define WIM_ATTRIBUTE_RP_FIX            0x00000008
+#define WIM_ATTRIBUTE_SPANNED           0x00000010
+#define WIM_ATTRIBUTE_READONLY          0x00000020
+
 typedef struct _WIM_MOUNT_LIST
 {
     WCHAR WimPath[MAX_PATH];
@@ -31,6 +71,31 @@ typedef struct _WIM_MOUNT_LIST
     BOOL MountedForRW;
 } WIM_MOUNT_LIST, *PWIM_MOUNT_LIST, *LPWIM_MOUNT_LIST;
 
+typedef struct _WIM_INFO
+{
+    WCHAR WimPath[MAX_PATH];
+    GUID Guid;
+    DWORD ImageCount;
+    DWORD CompressionType;
+    USHORT PartNumber;
+    USHORT TotalParts;
+    DWORD BootIndex;
+    DWORD WimAttributes;
+    DWORD WimFlagsAndAttr;
+} WIM_INFO, *PWIM_INFO, *LPWIM_INFO;
+
+HANDLE WINAPI WIMCreateFile(PCWSTR,DWORD,DWORD,DWORD,DWORD,PDWORD);
+BOOL   WINAPI WIMCloseHandle(HANDLE);
+BOOL   WINAPI WIMGetAttributes(HANDLE,PWIM_INFO,DWORD);
+DWORD  WINAPI WIMGetImageCount(HANDLE);
+HANDLE WINAPI WIMLoadImage(HANDLE,DWORD);
+BOOL   WINAPI WIMGetImageInformation(HANDLE,PVOID*,PDWORD);
+HANDLE WINAPI WIMCaptureImage(HANDLE,PCWSTR,DWORD);
+BOOL   WINAPI WIMApplyImage(HANDLE,PCWSTR,DWORD);
+BOOL   WINAPI WIMExportImage(HANDLE,HANDLE,DWORD);
+BOOL   WINAPI WIMGetMountedImages(PWIM_MOUNT_LIST,PDWORD);
+DWORD  WINAPI WIMRegisterMessageCallback(HANDLE,FARPROC,PVOID);
+
 #ifdef __cplusplus
 }
 #endif